@@ -0,0 +1,91 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Stream start latency of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_LATENCY_H__
+#define __NAU_LATENCY_H__
+
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+
+/* The time spent in a stage of the stream start, like a DAI operation or
+ * the settling of a DAPM event, with a histogram in power of two
+ * microseconds. Bucket i counts the durations below 2^i microseconds,
+ * the last one takes the longer.
+ */
+#define NAU_LATENCY_BUCKETS	21
+
+struct nau_latency {
+	u32 count;
+	u32 last_us;
+	u32 max_us;
+	u64 total_us;
+	u32 hist[NAU_LATENCY_BUCKETS];
+};
+
+/* Account a stage started at @start. The streams of both directions start
+ * apart but may race; a lost count only blurs the statistics.
+ */
+static inline void nau_latency_add(struct nau_latency *lat, ktime_t start)
+{
+	u32 us = ktime_us_delta(ktime_get(), start);
+
+	lat->count++;
+	lat->last_us = us;
+	lat->total_us += us;
+	if (us > lat->max_us)
+		lat->max_us = us;
+	lat->hist[min(fls(us), NAU_LATENCY_BUCKETS - 1)]++;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline int nau_latency_show(struct seq_file *s, void *data)
+{
+	struct nau_latency *lat = s->private;
+	int i;
+
+	seq_printf(s, "count %u\nlast_us %u\nmax_us %u\navg_us %llu\n",
+		   lat->count, lat->last_us, lat->max_us, lat->count ?
+		   div_u64(lat->total_us, lat->count) : 0);
+	for (i = 0; i < NAU_LATENCY_BUCKETS; i++) {
+		if (!lat->hist[i])
+			continue;
+		if (i < NAU_LATENCY_BUCKETS - 1)
+			seq_printf(s, "<%lu\t%u\n", BIT(i), lat->hist[i]);
+		else
+			seq_printf(s, ">=%lu\t%u\n", BIT(i - 1), lat->hist[i]);
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nau_latency);
+
+/* One file per stage, in the directory latency under @root */
+static inline void nau_latency_debugfs_init(struct dentry *root,
+	struct nau_latency *lat, const char * const *names, int num)
+{
+	struct dentry *dir;
+	int i;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir("latency", root);
+	for (i = 0; i < num; i++)
+		debugfs_create_file(names[i], 0444, dir, &lat[i],
+				    &nau_latency_fops);
+}
+#else
+static inline void nau_latency_debugfs_init(struct dentry *root,
+	struct nau_latency *lat, const char * const *names, int num)
+{
+}
+#endif
+
+#endif /* __NAU_LATENCY_H__ */
@@ -0,0 +1,817 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the DSP mailbox of NAU83G10/20
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8310-dsp.c, as the mailbox protocol is
+ * static. The device sits on a fake I2C adapter, which plays the DSP side
+ * of NAU8310_RF000_DSP_COMM: the idle word, the messages checked for their
+ * LEN and PAD framing, the replies, and the faults asked for. The KCS
+ * region of the fake DSP holds what the setups wrote.
+ */
+
+#include <kunit/test.h>
+#include <linux/i2c.h>
+#include <linux/ktime.h>
+
+#define NAU8310_TEST_ADDR		0x10
+#define NAU8310_TEST_REVISION		0x00010203
+/* registers of the chip kept by the fake device */
+#define NAU8310_TEST_REG_NUM		0x80
+/* words of the longest reply, the preamble and the trailer too */
+#define NAU8310_TEST_REPLY_MAX		NAU8310_DSP_DRAIN_MAX
+#define NAU8310_TEST_CMD_NUM		(NAU8310_DSP_CMD_CLK_RESTART + 1)
+
+/* faults of the fake DSP, each taken once */
+enum {
+	NAU8310_TEST_FAULT_NONE,
+	/* no idle word until the chip reset */
+	NAU8310_TEST_FAULT_STUCK,
+	/* the next bus transfer fails */
+	NAU8310_TEST_FAULT_XFER,
+	/* execution error replied to a command */
+	NAU8310_TEST_FAULT_REPLY,
+	/* LEN of a reply trailer off by one */
+	NAU8310_TEST_FAULT_LEN,
+	/* PAD of a reply trailer wrong */
+	NAU8310_TEST_FAULT_PAD,
+};
+
+struct nau8310_test_dsp {
+	struct i2c_adapter adap;
+	/* register addressed by the last write on the bus */
+	unsigned int reg;
+	u16 regs[NAU8310_TEST_REG_NUM];
+	/* message taken from the host, and the reply queued ahead of idle */
+	u8 msg[NAU8310_DSP_FRAG_MAX][NAU8310_DSP_DATA_BYTE];
+	int msg_words;
+	u8 reply[NAU8310_TEST_REPLY_MAX][NAU8310_DSP_DATA_BYTE];
+	int reply_len;
+	int reply_pos;
+	u8 kcs[NAU8310_DSP_KCS_SHADOW_LEN];
+	DECLARE_BITMAP(kcs_written, NAU8310_DSP_KCS_SHADOW_LEN);
+	u32 counter;
+	int fault;
+	/* commands let through before the fault is taken */
+	int fault_after;
+	/* bus traffic, the transfers to the mailbox of them too */
+	unsigned int xfers;
+	unsigned int comm_xfers;
+	unsigned int msgs;
+	unsigned int bus_bytes;
+	unsigned int commands[NAU8310_TEST_CMD_NUM];
+	unsigned int bad_frames;
+	unsigned int resets;
+};
+
+struct nau8310_test_ctx {
+	struct nau8310_test_dsp dsp;
+	struct nau8310 nau8310;
+	struct snd_soc_component component;
+	struct i2c_client *client;
+};
+
+static bool nau8310_test_dsp_fault(struct nau8310_test_dsp *dsp, int fault)
+{
+	if (dsp->fault != fault)
+		return false;
+	if (dsp->fault_after) {
+		dsp->fault_after--;
+		return false;
+	}
+	dsp->fault = NAU8310_TEST_FAULT_NONE;
+
+	return true;
+}
+
+/* Queue the reply of @size bytes, framed as the DSP does */
+static void nau8310_test_dsp_reply(struct nau8310_test_dsp *dsp, int reply_id,
+				   const void *data, int size)
+{
+	int words = DIV_ROUND_UP(size, NAU8310_DSP_DATA_BYTE);
+	int len = size ? words + 1 : 0;
+	int pad = words * NAU8310_DSP_DATA_BYTE - size;
+	u8 *b;
+
+	memset(dsp->reply, 0, (len + 1) * NAU8310_DSP_DATA_BYTE);
+	b = dsp->reply[0];
+	b[0] = NAU8310_DSP_COMM_PREAMBLE & 0xff;
+	b[1] = NAU8310_DSP_COMM_PREAMBLE >> 8;
+	b[2] = (reply_id << 2) | (len & 0x3);
+	b[3] = len >> 2;
+	if (len) {
+		memcpy(dsp->reply[1], data, size);
+		b = dsp->reply[len];
+		b[0] = len;
+		b[1] = ((len >> 8) << 6) | (pad << 4);
+		if (nau8310_test_dsp_fault(dsp, NAU8310_TEST_FAULT_LEN))
+			b[0]++;
+		if (nau8310_test_dsp_fault(dsp, NAU8310_TEST_FAULT_PAD))
+			b[1] ^= 0x1 << 4;
+	}
+	dsp->reply_len = len + 1;
+	dsp->reply_pos = 0;
+}
+
+/* Check the framing of the message taken, and carry out its command */
+static void nau8310_test_dsp_exec(struct nau8310_test_dsp *dsp)
+{
+	const struct nau8310_cmd_info *cmd_info;
+	const u8 *b = dsp->msg[0];
+	int cmd_id = b[2] >> 2, len = (b[2] & 0x3) | (b[3] << 2);
+	int offset = 0, size = 0, pad = 0, words;
+	u8 result[NAU8310_DSP_DATA_BYTE] = { 0 };
+	u32 word;
+
+	dsp->msg_words = 0;
+	if (len >= NAU8310_DSP_FRAG_MAX) {
+		dsp->bad_frames++;
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_MSG_TOO_LONG,
+				       NULL, 0);
+		return;
+	}
+	if (!nau8310_dsp_commands(cmd_id)) {
+		nau8310_test_dsp_reply(dsp,
+			NAU8310_DSP_REPLY_COMMAND_DOESNT_EXISTS_ERR, NULL, 0);
+		return;
+	}
+	dsp->commands[cmd_id]++;
+	cmd_info = &nau8310_dsp_cmd_table[cmd_id];
+
+	/* the parameters, the payload and the trailer take up LEN exactly */
+	if (cmd_info->msg_param) {
+		if (len < 2)
+			goto bad_frame;
+		b = dsp->msg[1];
+		offset = b[0] | (b[1] << 8);
+		size = b[2] | (b[3] << 8);
+		if (cmd_info->setup_data) {
+			words = len - 2;
+			pad = words * NAU8310_DSP_DATA_BYTE - size;
+			if (pad < 0 || pad >= NAU8310_DSP_DATA_BYTE)
+				goto bad_frame;
+		} else if (len != 2) {
+			goto bad_frame;
+		}
+		b = dsp->msg[len];
+		if ((b[0] | ((b[1] & 0xc0) << 2)) != len ||
+			((b[1] & 0x30) >> 4) != pad)
+			goto bad_frame;
+	} else if (len) {
+		goto bad_frame;
+	}
+
+	if (nau8310_test_dsp_fault(dsp, NAU8310_TEST_FAULT_REPLY)) {
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_EXECUTION_ERR,
+				       NULL, 0);
+		return;
+	}
+
+	switch (cmd_id) {
+	case NAU8310_DSP_CMD_SET_KCS_SETUP:
+	case NAU8310_DSP_CMD_GET_KCS_SETUP:
+		if (offset + size > NAU8310_DSP_KCS_SHADOW_LEN) {
+			nau8310_test_dsp_reply(dsp,
+				NAU8310_DSP_REPLY_EXECUTION_ERR, NULL, 0);
+			return;
+		}
+		if (cmd_id == NAU8310_DSP_CMD_GET_KCS_SETUP) {
+			nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_OK,
+					       dsp->kcs + offset, size);
+			return;
+		}
+		memcpy(dsp->kcs + offset, dsp->msg[2], size);
+		bitmap_set(dsp->kcs_written, offset, size);
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_OK, NULL, 0);
+		return;
+	case NAU8310_DSP_CMD_GET_KCS_RSLTS:
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_OK, result,
+				       min_t(int, size, sizeof(result)));
+		return;
+	case NAU8310_DSP_CMD_GET_REVISION:
+	case NAU8310_DSP_CMD_GET_FRAME_STATUS:
+	case NAU8310_DSP_CMD_GET_COUNTER:
+		if (cmd_id == NAU8310_DSP_CMD_GET_REVISION)
+			word = NAU8310_TEST_REVISION;
+		else if (cmd_id == NAU8310_DSP_CMD_GET_FRAME_STATUS)
+			word = NAU8310_DSP_ALGO_OK;
+		else
+			word = dsp->counter++;
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_OK, &word,
+				       sizeof(word));
+		return;
+	default:
+		nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_OK, NULL, 0);
+		return;
+	}
+
+bad_frame:
+	dsp->bad_frames++;
+	nau8310_test_dsp_reply(dsp, NAU8310_DSP_REPLY_MSG_INTEGRETY_ERR,
+			       NULL, 0);
+}
+
+static void nau8310_test_dsp_write(struct nau8310_test_dsp *dsp, const u8 *w)
+{
+	const u8 *b = dsp->msg[0];
+
+	/* a word out of a message is dropped, as the DSP waits for one */
+	if (!dsp->msg_words &&
+		!nau8310_dsp_word_preamble(get_unaligned((u32 *)w))) {
+		dsp->bad_frames++;
+		return;
+	}
+	memcpy(dsp->msg[dsp->msg_words++], w, NAU8310_DSP_DATA_BYTE);
+	if (dsp->msg_words == ((b[2] & 0x3) | (b[3] << 2)) + 1 ||
+		dsp->msg_words == NAU8310_DSP_FRAG_MAX)
+		nau8310_test_dsp_exec(dsp);
+}
+
+static void nau8310_test_dsp_read(struct nau8310_test_dsp *dsp, u8 *w)
+{
+	u32 idle = NAU8310_DSP_COMM_IDLE_WORD;
+
+	if (dsp->fault == NAU8310_TEST_FAULT_STUCK)
+		memset(w, 0, NAU8310_DSP_DATA_BYTE);
+	else if (dsp->reply_pos < dsp->reply_len)
+		memcpy(w, dsp->reply[dsp->reply_pos++], NAU8310_DSP_DATA_BYTE);
+	else
+		memcpy(w, &idle, NAU8310_DSP_DATA_BYTE);
+}
+
+static void nau8310_test_reg_write(struct nau8310_test_dsp *dsp,
+				   unsigned int reg, u16 val)
+{
+	if (reg >= NAU8310_TEST_REG_NUM)
+		return;
+	dsp->regs[reg] = val;
+	/* the chip reset takes DSP back to idle */
+	if (reg == NAU8310_R01_SOFTWARE_RST) {
+		dsp->resets++;
+		dsp->msg_words = 0;
+		dsp->reply_len = dsp->reply_pos = 0;
+		if (dsp->fault == NAU8310_TEST_FAULT_STUCK)
+			dsp->fault = NAU8310_TEST_FAULT_NONE;
+	}
+}
+
+static int nau8310_test_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			     int num)
+{
+	struct nau8310_test_dsp *dsp = i2c_get_adapdata(adap);
+	struct i2c_msg *msg;
+	unsigned int val;
+	int i, j;
+
+	dsp->xfers++;
+	if (msgs[0].len >= NAU8310_DSP_REG_LEN &&
+		((msgs[0].buf[0] << 8) | msgs[0].buf[1]) == NAU8310_RF000_DSP_COMM)
+		dsp->comm_xfers++;
+	if (nau8310_test_dsp_fault(dsp, NAU8310_TEST_FAULT_XFER))
+		return -EIO;
+
+	for (i = 0; i < num; i++) {
+		msg = &msgs[i];
+		dsp->msgs++;
+		dsp->bus_bytes += msg->len;
+		if (msg->flags & I2C_M_RD) {
+			if (dsp->reg != NAU8310_RF000_DSP_COMM) {
+				if (msg->len != 2)
+					return -EINVAL;
+				val = dsp->reg < NAU8310_TEST_REG_NUM ?
+					dsp->regs[dsp->reg] : 0;
+				msg->buf[0] = val >> 8;
+				msg->buf[1] = val & 0xff;
+				continue;
+			}
+			if (msg->len % NAU8310_DSP_DATA_BYTE)
+				return -EINVAL;
+			for (j = 0; j < msg->len; j += NAU8310_DSP_DATA_BYTE)
+				nau8310_test_dsp_read(dsp, msg->buf + j);
+			continue;
+		}
+		if (msg->len < NAU8310_DSP_REG_LEN)
+			return -EINVAL;
+		dsp->reg = (msg->buf[0] << 8) | msg->buf[1];
+		if (msg->len == NAU8310_DSP_REG_LEN)
+			continue;
+		if (dsp->reg != NAU8310_RF000_DSP_COMM) {
+			if (msg->len != NAU8310_DSP_REG_LEN + 2)
+				return -EINVAL;
+			nau8310_test_reg_write(dsp, dsp->reg,
+					       (msg->buf[2] << 8) | msg->buf[3]);
+			continue;
+		}
+		if ((msg->len - NAU8310_DSP_REG_LEN) % NAU8310_DSP_DATA_BYTE)
+			return -EINVAL;
+		for (j = NAU8310_DSP_REG_LEN; j < msg->len;
+			j += NAU8310_DSP_DATA_BYTE)
+			nau8310_test_dsp_write(dsp, msg->buf + j);
+	}
+
+	return num;
+}
+
+static u32 nau8310_test_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm nau8310_test_algo = {
+	.master_xfer = nau8310_test_xfer,
+	.functionality = nau8310_test_func,
+};
+
+static const struct regmap_config nau8310_test_regmap_config = {
+	.reg_bits = NAU8310_REG_ADDR_LEN,
+	.val_bits = NAU8310_REG_DATA_LEN,
+	.max_register = NAU8310_TEST_REG_NUM - 1,
+	.cache_type = REGCACHE_NONE,
+};
+
+/* the mailbox of nau8310.c over the plain I2C bus, the same messages */
+static const struct regmap_config nau8310_test_dsp_regmap_config = {
+	.name = "dsp",
+	.reg_bits = NAU8310_REG_ADDR_LEN,
+	.val_bits = NAU8310_DSP_DATA_LEN,
+	.val_format_endian = REGMAP_ENDIAN_NATIVE,
+	.max_register = NAU8310_RF000_DSP_COMM,
+	.cache_type = REGCACHE_NONE,
+};
+
+/* the frame as nau8310_dsp_frame_init() lays it out */
+static int nau8310_test_frame_init(struct kunit *test, struct nau8310 *nau8310,
+				   struct i2c_client *client)
+{
+	u8 *slot;
+	int i;
+
+	nau8310->dsp_frame = kunit_kcalloc(test, NAU8310_DSP_FRAG_MAX,
+					   NAU8310_DSP_FRAME_SLOT, GFP_KERNEL);
+	nau8310->dsp_msgs = kunit_kcalloc(test, NAU8310_DSP_FRAG_MAX,
+					  sizeof(*nau8310->dsp_msgs), GFP_KERNEL);
+	if (!nau8310->dsp_frame || !nau8310->dsp_msgs)
+		return -ENOMEM;
+
+	for (i = 0; i < NAU8310_DSP_FRAG_MAX; i++) {
+		slot = nau8310->dsp_frame + i * NAU8310_DSP_FRAME_SLOT;
+		slot[0] = NAU8310_RF000_DSP_COMM >> 8;
+		slot[1] = NAU8310_RF000_DSP_COMM & 0xff;
+		nau8310->dsp_msgs[i].addr = client->addr;
+		nau8310->dsp_msgs[i].len = NAU8310_DSP_FRAME_SLOT;
+		nau8310->dsp_msgs[i].buf = slot;
+	}
+
+	return 0;
+}
+
+static int nau8310_test_init(struct kunit *test)
+{
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("nau8310-kunit", NAU8310_TEST_ADDR),
+	};
+	struct nau8310_test_ctx *ctx;
+	struct nau8310 *nau8310;
+	int ret;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	nau8310 = &ctx->nau8310;
+
+	ctx->dsp.adap.owner = THIS_MODULE;
+	ctx->dsp.adap.algo = &nau8310_test_algo;
+	strscpy(ctx->dsp.adap.name, "nau8310-kunit", sizeof(ctx->dsp.adap.name));
+	i2c_set_adapdata(&ctx->dsp.adap, &ctx->dsp);
+	ret = i2c_add_adapter(&ctx->dsp.adap);
+	if (ret)
+		return ret;
+	ctx->client = i2c_new_client_device(&ctx->dsp.adap, &info);
+	if (IS_ERR(ctx->client)) {
+		ret = PTR_ERR(ctx->client);
+		goto err_adap;
+	}
+	i2c_set_clientdata(ctx->client, nau8310);
+	nau8310->dev = &ctx->client->dev;
+	ctx->component.dev = nau8310->dev;
+
+	nau8310->regmap = regmap_init_i2c(ctx->client,
+					  &nau8310_test_regmap_config);
+	if (IS_ERR(nau8310->regmap)) {
+		ret = PTR_ERR(nau8310->regmap);
+		goto err_client;
+	}
+	nau8310->dsp_regmap = regmap_init_i2c(ctx->client,
+					      &nau8310_test_dsp_regmap_config);
+	if (IS_ERR(nau8310->dsp_regmap)) {
+		ret = PTR_ERR(nau8310->dsp_regmap);
+		goto err_regmap;
+	}
+	ret = nau8310_test_frame_init(test, nau8310, ctx->client);
+	if (ret)
+		goto err_dsp_regmap;
+	mutex_init(&nau8310->dsp_lock);
+	init_waitqueue_head(&nau8310->dsp_prio_wait);
+	init_completion(&nau8310->dsp_reply);
+	test->priv = ctx;
+
+	return 0;
+
+err_dsp_regmap:
+	regmap_exit(nau8310->dsp_regmap);
+err_regmap:
+	regmap_exit(nau8310->regmap);
+err_client:
+	i2c_unregister_device(ctx->client);
+err_adap:
+	i2c_del_adapter(&ctx->dsp.adap);
+	return ret;
+}
+
+static void nau8310_test_exit(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+
+	if (!ctx)
+		return;
+	regmap_exit(ctx->nau8310.dsp_regmap);
+	regmap_exit(ctx->nau8310.regmap);
+	i2c_unregister_device(ctx->client);
+	i2c_del_adapter(&ctx->dsp.adap);
+}
+
+/* Bus transfers to the mailbox for a message of @frag_len, and a reply of
+ * @reply_len words after its preamble: the idle check, the message, the
+ * preamble and the rest of the reply.
+ */
+static unsigned int nau8310_test_xfers(int frag_len, int reply_len)
+{
+#ifdef NAU8310_DSP_BURST_XFER
+	return 3 + (reply_len ? 1 : 0);
+#else
+	return 3 + frag_len + reply_len;
+#endif
+}
+
+/* A command without parameters, and its reply of one word */
+static void nau8310_test_dsp_command(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	struct nau8310_kcs_setup kcs_setup = { 0 };
+	int revision = 0;
+
+	KUNIT_ASSERT_EQ(test, nau8310_dsp_get_revision(&ctx->component,
+		&revision), 0);
+	KUNIT_EXPECT_EQ(test, revision, NAU8310_TEST_REVISION);
+	KUNIT_EXPECT_EQ(test, dsp->comm_xfers, nau8310_test_xfers(0, 2));
+
+	KUNIT_EXPECT_EQ(test, nau8310_send_dsp_command(&ctx->component,
+		NAU8310_DSP_CMD_CLK_STOP, &kcs_setup), 0);
+	KUNIT_EXPECT_EQ(test, dsp->commands[NAU8310_DSP_CMD_CLK_STOP], 1U);
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+	KUNIT_EXPECT_EQ(test, ctx->nau8310.dsp_stats.transfers, dsp->comm_xfers);
+	KUNIT_EXPECT_EQ(test, ctx->nau8310.dsp_stats.commands, 2U);
+}
+
+/* Each size of a KCS chunk is framed with its LEN and PAD, and read back */
+static void nau8310_test_dsp_framing(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	struct nau8310_kcs_setup kcs_setup;
+	u32 data[NAU8310_DSP_KCS_TX_MAX / NAU8310_DSP_DATA_BYTE];
+	u32 back[NAU8310_DSP_KCS_TX_MAX / NAU8310_DSP_DATA_BYTE];
+	u8 *b = (u8 *)data;
+	int i, size, offset;
+
+	for (size = 1; size <= NAU8310_DSP_KCS_TX_MAX; size++) {
+		offset = size * 3;
+		for (i = 0; i < size; i++)
+			b[i] = size + i;
+		memset(&kcs_setup, 0, sizeof(kcs_setup));
+		kcs_setup.set_kcs_offset = offset;
+		kcs_setup.set_len = size;
+		kcs_setup.set_kcs_data = data;
+		KUNIT_ASSERT_EQ_MSG(test, nau8310_send_dsp_command(
+			&ctx->component, NAU8310_DSP_CMD_SET_KCS_SETUP,
+			&kcs_setup), 0, "size %d", size);
+		KUNIT_EXPECT_EQ_MSG(test, memcmp(dsp->kcs + offset, data, size),
+			0, "size %d", size);
+
+		memset(back, 0, sizeof(back));
+		kcs_setup.get_len = size;
+		kcs_setup.get_data = back;
+		KUNIT_ASSERT_EQ_MSG(test, nau8310_send_dsp_command(
+			&ctx->component, NAU8310_DSP_CMD_GET_KCS_SETUP,
+			&kcs_setup), 0, "size %d", size);
+		KUNIT_EXPECT_EQ_MSG(test, memcmp(back, data, size), 0,
+			"size %d", size);
+	}
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+	KUNIT_EXPECT_EQ(test, ctx->nau8310.dsp_stats.proto_errors, 0U);
+}
+
+/* A message framed wrong is refused by the DSP with an integrity error */
+static void nau8310_test_dsp_bad_frame(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310 *nau8310 = &ctx->nau8310;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	/* trailer of 3 bytes sent: PAD 0 for 1, then LEN 2 for 3 */
+	static const u8 trailer[][2] = { { 3, 0x0 }, { 2, 0x1 << 4 } };
+	u8 *b;
+	int i, len;
+
+	for (i = 0; i < ARRAY_SIZE(trailer); i++) {
+		b = nau8310_dsp_frag(nau8310, 0);
+		memset(b, 0, NAU8310_DSP_DATA_BYTE);
+		b[0] = NAU8310_DSP_COMM_PREAMBLE & 0xff;
+		b[1] = NAU8310_DSP_COMM_PREAMBLE >> 8;
+		b[2] = (NAU8310_DSP_CMD_SET_KCS_SETUP << 2) | 3;
+		b = nau8310_dsp_frag(nau8310, 1);
+		memset(b, 0, NAU8310_DSP_DATA_BYTE);
+		b[2] = 3;
+		b = nau8310_dsp_frag(nau8310, 2);
+		memset(b, 0x5a, NAU8310_DSP_DATA_BYTE);
+		b = nau8310_dsp_frag(nau8310, 3);
+		memset(b, 0, NAU8310_DSP_DATA_BYTE);
+		b[0] = trailer[i][0];
+		b[1] = trailer[i][1];
+
+		KUNIT_ASSERT_EQ(test, nau8310_dsp_frags_write(&ctx->component,
+			4), 0);
+		KUNIT_EXPECT_EQ(test, nau8310_dsp_replied(&ctx->component,
+			&len), -NAU8310_DSP_REPLY_MSG_INTEGRETY_ERR);
+		KUNIT_EXPECT_EQ(test, len, 0);
+		KUNIT_EXPECT_EQ(test, dsp->bad_frames, i + 1U);
+	}
+	KUNIT_EXPECT_TRUE(test, bitmap_empty(dsp->kcs_written,
+		NAU8310_DSP_KCS_SHADOW_LEN));
+}
+
+/* A full KCS setup: the region matches, and the bus transfers per byte */
+static void nau8310_test_dsp_kcs_upload(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	int i, len, size = NAU8310_DSP_KCS_DAT_LEN_MAX;
+	unsigned int expected = 0, milli;
+	ktime_t start, spent;
+	u8 *data;
+
+	data = kunit_kmalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 7 + 1;
+	for (i = 0; i < size; i += len) {
+		len = min(size - i, NAU8310_DSP_KCS_TX_MAX);
+		expected += nau8310_test_xfers(2 +
+			DIV_ROUND_UP(len, NAU8310_DSP_DATA_BYTE), 0);
+	}
+	/* the result check at the end, a word and the trailer replied */
+	expected += nau8310_test_xfers(2, 2);
+
+	start = ktime_get();
+	KUNIT_ASSERT_EQ(test, nau8310_dsp_kcs_setup(&ctx->component, 0, size,
+		data), 0);
+	spent = ktime_sub(ktime_get(), start);
+	KUNIT_EXPECT_EQ(test, memcmp(dsp->kcs, data, size), 0);
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+	KUNIT_EXPECT_EQ(test, dsp->commands[NAU8310_DSP_CMD_SET_KCS_SETUP],
+		(unsigned int)DIV_ROUND_UP(size, NAU8310_DSP_KCS_TX_MAX));
+	KUNIT_EXPECT_EQ(test, dsp->commands[NAU8310_DSP_CMD_GET_KCS_RSLTS], 1U);
+	KUNIT_EXPECT_EQ(test, dsp->comm_xfers, expected);
+	KUNIT_EXPECT_EQ(test, ctx->nau8310.dsp_stats.transfers, dsp->comm_xfers);
+	KUNIT_EXPECT_EQ(test, ctx->nau8310.dsp_stats.bytes,
+		(unsigned int)size + NAU8310_DSP_DATA_BYTE);
+
+	milli = dsp->xfers * 1000 / size;
+	kunit_info(test, "%d KCS bytes: %u transfers, %u messages, %u bytes on the bus, %u.%03u transfers per byte, %lld ns\n",
+		   size, dsp->xfers, dsp->msgs, dsp->bus_bytes, milli / 1000,
+		   milli % 1000, ktime_to_ns(spent));
+}
+
+/* Only the chunks which differ are sent, the trailing ones too */
+static void nau8310_test_dsp_kcs_send_diff(struct kunit *test)
+{
+	/* chunks changed, the last one of them short */
+	static const unsigned int changed[] = {
+		0x00, 0x01, 0x10, 0x18, 0x11, 0x0a, 0x1f,
+	};
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	int chunks = 5, size = 4 * NAU8310_DSP_KCS_TX_MAX + 20, base = 0x100;
+	int i, c, off, end, ret, sent, runs, diff;
+	bool muted, old_null;
+	u8 *old, *data;
+
+	old = kunit_kmalloc(test, size, GFP_KERNEL);
+	data = kunit_kmalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, old);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+	for (i = 0; i < size; i++)
+		old[i] = i * 13 + 5;
+
+	/* the last pass sends all of it, without the old setup */
+	for (i = 0; i <= ARRAY_SIZE(changed); i++) {
+		old_null = i == ARRAY_SIZE(changed);
+		memcpy(data, old, size);
+		memcpy(dsp->kcs + base, old, size);
+		bitmap_zero(dsp->kcs_written, NAU8310_DSP_KCS_SHADOW_LEN);
+		dsp->commands[NAU8310_DSP_CMD_SET_KCS_SETUP] = 0;
+		dsp->commands[NAU8310_DSP_CMD_GET_KCS_RSLTS] = 0;
+		dsp->regs[NAU8310_R13_MUTE_CTRL] = 0;
+		sent = runs = diff = 0;
+		for (c = 0; c < chunks; c++) {
+			off = c * NAU8310_DSP_KCS_TX_MAX;
+			end = min(off + NAU8310_DSP_KCS_TX_MAX, size);
+			if (old_null || changed[i] & BIT(c)) {
+				/* the last byte of the chunk */
+				if (!old_null)
+					data[end - 1] ^= 0xff;
+				if (!c || !(old_null || changed[i] & BIT(c - 1)))
+					runs++;
+				diff += end - off;
+				sent++;
+			}
+		}
+
+		muted = false;
+		ret = nau8310_dsp_kcs_send_diff(&ctx->component, base,
+						old_null ? NULL : old, data,
+						size, &muted);
+		KUNIT_EXPECT_EQ_MSG(test, ret, diff, "changed 0x%x", changed[i]);
+		KUNIT_EXPECT_EQ_MSG(test, memcmp(dsp->kcs + base, data, size), 0,
+			"changed 0x%x", changed[i]);
+		/* a chunk per command, and a result check per run */
+		KUNIT_EXPECT_EQ_MSG(test,
+			dsp->commands[NAU8310_DSP_CMD_SET_KCS_SETUP],
+			(unsigned int)sent, "changed 0x%x", changed[i]);
+		KUNIT_EXPECT_EQ_MSG(test,
+			dsp->commands[NAU8310_DSP_CMD_GET_KCS_RSLTS],
+			(unsigned int)runs, "changed 0x%x", changed[i]);
+		for (c = 0; c < chunks; c++) {
+			off = c * NAU8310_DSP_KCS_TX_MAX;
+			end = min(off + NAU8310_DSP_KCS_TX_MAX, size);
+			KUNIT_EXPECT_EQ_MSG(test, !!test_bit(base + off,
+				dsp->kcs_written), old_null ||
+				!!(changed[i] & BIT(c)), "changed 0x%x chunk %d",
+				changed[i], c);
+			KUNIT_EXPECT_EQ_MSG(test, !!test_bit(base + end - 1,
+				dsp->kcs_written), old_null ||
+				!!(changed[i] & BIT(c)), "changed 0x%x chunk %d",
+				changed[i], c);
+		}
+		/* soft muted over the sending, left to the caller to unmute */
+		KUNIT_EXPECT_TRUE(test, muted == (diff > 0));
+		KUNIT_EXPECT_EQ(test, !!(dsp->regs[NAU8310_R13_MUTE_CTRL] &
+			NAU8310_SOFT_MUTE), diff > 0);
+	}
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+}
+
+/* The words of a reply left behind are read off before the message */
+static void nau8310_test_dsp_resync(struct kunit *test)
+{
+	/* a few left, and more than the idle wait reads till its timeout */
+	static const int stale[] = { 3, 64 };
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_dsp_stats *stats = &ctx->nau8310.dsp_stats;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	int i, revision;
+
+	for (i = 0; i < ARRAY_SIZE(stale); i++) {
+		memset(dsp->reply, 0, stale[i] * NAU8310_DSP_DATA_BYTE);
+		dsp->reply_len = stale[i];
+		dsp->reply_pos = 0;
+		revision = 0;
+		KUNIT_ASSERT_EQ(test, nau8310_dsp_get_revision(&ctx->component,
+			&revision), 0);
+		KUNIT_EXPECT_EQ(test, revision, NAU8310_TEST_REVISION);
+	}
+	KUNIT_EXPECT_EQ(test, stats->timeouts, 1U);
+	KUNIT_EXPECT_EQ(test, stats->resyncs, 1U);
+	KUNIT_EXPECT_EQ(test, stats->resets, 0U);
+	KUNIT_EXPECT_EQ(test, dsp->resets, 0U);
+
+	/* stuck until the chip reset */
+	dsp->fault = NAU8310_TEST_FAULT_STUCK;
+	KUNIT_ASSERT_EQ(test, nau8310_dsp_get_revision(&ctx->component,
+		&revision), 0);
+	KUNIT_EXPECT_EQ(test, stats->resets, 1U);
+	KUNIT_EXPECT_EQ(test, dsp->resets, 2U);
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+	KUNIT_EXPECT_EQ(test, stats->transfers, dsp->comm_xfers);
+}
+
+/* An error replied, a reply framed wrong or a transfer failed ends the
+ * command, and the next one goes through.
+ */
+static void nau8310_test_dsp_errors(struct kunit *test)
+{
+	static const struct {
+		int fault;
+		int cmd_id;
+		int ret;
+	} faults[] = {
+		{ NAU8310_TEST_FAULT_REPLY, NAU8310_DSP_CMD_GET_REVISION,
+		  -NAU8310_DSP_REPLY_EXECUTION_ERR },
+		{ NAU8310_TEST_FAULT_LEN, NAU8310_DSP_CMD_GET_REVISION,
+		  -EPROTO },
+		{ NAU8310_TEST_FAULT_LEN, NAU8310_DSP_CMD_GET_KCS_SETUP,
+		  -EPROTO },
+		{ NAU8310_TEST_FAULT_PAD, NAU8310_DSP_CMD_GET_KCS_SETUP,
+		  -EPROTO },
+		{ NAU8310_TEST_FAULT_XFER, NAU8310_DSP_CMD_GET_REVISION,
+		  -EIO },
+	};
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_dsp_stats *stats = &ctx->nau8310.dsp_stats;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	struct nau8310_kcs_setup kcs_setup;
+	unsigned int proto = 0, send = 0, reply = 0;
+	u32 data[2];
+	int i, revision;
+
+	for (i = 0; i < ARRAY_SIZE(faults); i++) {
+		memset(&kcs_setup, 0, sizeof(kcs_setup));
+		/* 6 bytes, 2 of the last word padded */
+		kcs_setup.set_len = kcs_setup.get_len = 6;
+		kcs_setup.get_data = data;
+		dsp->fault = faults[i].fault;
+		KUNIT_EXPECT_EQ_MSG(test, nau8310_send_dsp_command(
+			&ctx->component, faults[i].cmd_id, &kcs_setup),
+			faults[i].ret, "fault %d", i);
+		KUNIT_EXPECT_EQ(test, dsp->fault, NAU8310_TEST_FAULT_NONE);
+		if (faults[i].ret == -EPROTO)
+			proto++;
+		if (faults[i].fault == NAU8310_TEST_FAULT_XFER)
+			send++;
+		else
+			reply++;
+		KUNIT_EXPECT_EQ(test, stats->proto_errors, proto);
+		KUNIT_EXPECT_EQ(test, stats->send_errors, send);
+		KUNIT_EXPECT_EQ(test, stats->reply_errors, reply);
+
+		revision = 0;
+		KUNIT_EXPECT_EQ_MSG(test, nau8310_dsp_get_revision(
+			&ctx->component, &revision), 0, "fault %d", i);
+		KUNIT_EXPECT_EQ(test, revision, NAU8310_TEST_REVISION);
+	}
+	KUNIT_EXPECT_EQ(test, stats->timeouts, 0U);
+	KUNIT_EXPECT_EQ(test, dsp->bad_frames, 0U);
+}
+
+/* A chunk refused resumes the upload from the last good result check */
+static void nau8310_test_dsp_kcs_retry(struct kunit *test)
+{
+	struct nau8310_test_ctx *ctx = test->priv;
+	struct nau8310_dsp_stats *stats = &ctx->nau8310.dsp_stats;
+	struct nau8310_test_dsp *dsp = &ctx->dsp;
+	int i, size = 3 * NAU8310_DSP_KCS_TX_MAX;
+	u8 *data;
+
+	data = kunit_kmalloc(test, size, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, data);
+	for (i = 0; i < size; i++)
+		data[i] = i * 3 + 11;
+
+	/* the second chunk of the first pass */
+	dsp->fault = NAU8310_TEST_FAULT_REPLY;
+	dsp->fault_after = 1;
+	KUNIT_ASSERT_EQ(test, nau8310_dsp_kcs_setup(&ctx->component, 0, size,
+		data), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(dsp->kcs, data, size), 0);
+	KUNIT_EXPECT_EQ(test, stats->reply_errors, 1U);
+	KUNIT_EXPECT_EQ(test, stats->kcs_rewinds, 1U);
+	KUNIT_EXPECT_EQ(test, dsp->commands[NAU8310_DSP_CMD_SET_KCS_SETUP], 5U);
+
+	/* the strict checks fail at once */
+	ctx->nau8310.kcs_check_interval = 1;
+	dsp->fault = NAU8310_TEST_FAULT_REPLY;
+	dsp->fault_after = 1;
+	KUNIT_EXPECT_EQ(test, nau8310_dsp_kcs_setup(&ctx->component, 0, size,
+		data), -NAU8310_DSP_REPLY_EXECUTION_ERR);
+}
+
+static struct kunit_case nau8310_dsp_test_cases[] = {
+	KUNIT_CASE(nau8310_test_dsp_command),
+	KUNIT_CASE(nau8310_test_dsp_framing),
+	KUNIT_CASE(nau8310_test_dsp_bad_frame),
+	KUNIT_CASE(nau8310_test_dsp_kcs_upload),
+	KUNIT_CASE(nau8310_test_dsp_kcs_send_diff),
+	KUNIT_CASE(nau8310_test_dsp_resync),
+	KUNIT_CASE(nau8310_test_dsp_errors),
+	KUNIT_CASE(nau8310_test_dsp_kcs_retry),
+	{}
+};
+
+static struct kunit_suite nau8310_dsp_test_suite = {
+	.name = "nau8310-dsp",
+	.init = nau8310_test_init,
+	.exit = nau8310_test_exit,
+	.test_cases = nau8310_dsp_test_cases,
+};
+kunit_test_suite(nau8310_dsp_test_suite);
@@ -6,59 +6,91 @@
 // Author: John Hsu <KCHSU0@nuvoton.com>
 //         David Lin <ctlin0@nuvoton.com>
 
+#include <linux/bitmap.h>
+#include <linux/completion.h>
+#include <linux/crc32.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
 #include <linux/firmware.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
+#include <linux/ktime.h>
+#include <linux/list.h>
+#include <linux/lz4.h>
+#include <linux/math64.h>
 #include <linux/module.h>
+#include <linux/mutex.h>
 #include <linux/regmap.h>
+#include <linux/slab.h>
+#include <linux/uaccess.h>
+#include <linux/wait_bit.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
 #include <sound/soc.h>
 #include <sound/tlv.h>
+#include <asm/unaligned.h>
 
+#include "nau-latency.h"
+#include "nau-regmap.h"
 #include "nau8310.h"
 #include "nau8310-dsp.h"
 
-#define NAU8310_DSP_IDLE_RETRY 10
+#define CREATE_TRACE_POINTS
+#include "nau8310-trace.h"
 
 static int nau8310_dsp_set_kcs_setup(struct snd_soc_component *component, bool nowait);
+static void nau8310_dsp_fw_put(const struct firmware *fw);
+static void nau8310_dsp_switch_work(struct work_struct *work);
+static void nau8310_dsp_clk_work(struct work_struct *work);
+static int nau8310_dsp_profile_switch(struct snd_soc_component *component,
+				      int id);
+static int nau8310_dsp_get_revision(struct snd_soc_component *component,
+				    int *revision);
 
 static const struct nau8310_cmd_info nau8310_dsp_cmd_table[] = {
 	[NAU8310_DSP_CMD_GET_COUNTER] = {
 		.cmd_id = NAU8310_DSP_CMD_GET_COUNTER,
+		.prio = NAU8310_DSP_PRIO_DIAG,
 		.reply_data = 1,
 	},
 	[NAU8310_DSP_CMD_GET_FRAME_STATUS] = {
 		.cmd_id = NAU8310_DSP_CMD_GET_FRAME_STATUS,
+		.prio = NAU8310_DSP_PRIO_DIAG,
 		.reply_data = 1,
 	},
 	[NAU8310_DSP_CMD_GET_REVISION] = {
 		.cmd_id = NAU8310_DSP_CMD_GET_REVISION,
+		.prio = NAU8310_DSP_PRIO_DIAG,
 		.reply_data = 1,
 	},
 	[NAU8310_DSP_CMD_GET_KCS_RSLTS] = {
 		.cmd_id = NAU8310_DSP_CMD_GET_KCS_RSLTS,
+		.prio = NAU8310_DSP_PRIO_SETUP,
 		.msg_param = 1,
 		.reply_data = 1,
 	},
 	[NAU8310_DSP_CMD_GET_KCS_SETUP] = {
 		.cmd_id = NAU8310_DSP_CMD_GET_KCS_SETUP,
+		.prio = NAU8310_DSP_PRIO_DIAG,
 		.msg_param = 1,
 		.reply_data = 1,
 	},
 	[NAU8310_DSP_CMD_SET_KCS_SETUP] = {
 		.cmd_id = NAU8310_DSP_CMD_SET_KCS_SETUP,
+		.prio = NAU8310_DSP_PRIO_SETUP,
 		.msg_param = 1,
 		.setup_data = 1,
 	},
 	[NAU8310_DSP_CMD_CLK_STOP] = {
 		.cmd_id = NAU8310_DSP_CMD_CLK_STOP,
+		.prio = NAU8310_DSP_PRIO_CTRL,
 	},
 	[NAU8310_DSP_CMD_CLK_RESTART] = {
 		.cmd_id = NAU8310_DSP_CMD_CLK_RESTART,
+		.prio = NAU8310_DSP_PRIO_CTRL,
 	},
 };
 
@@ -90,143 +122,360 @@ static const char * const dsp_cmd_table[] = {
 	[NAU8310_DSP_CMD_CLK_RESTART] = "CLK_RESTART",
 };
 
-static void nau8310_sw_reset_chip(struct regmap *regmap)
+/* Drop the bytes of the KCS shadow in a range, the whole of it if @size
+ * is 0, as DSP no longer holds what was written there.
+ */
+static void nau8310_kcs_shadow_drop(struct nau8310 *nau8310, int offset,
+				    int size)
 {
-	regmap_write(regmap, NAU8310_R01_SOFTWARE_RST, 0x00);
-	regmap_write(regmap, NAU8310_R01_SOFTWARE_RST, 0x00);
+	if (!nau8310->kcs_shadow_map)
+		return;
+	if (!size)
+		size = NAU8310_DSP_KCS_SHADOW_LEN - offset;
+	mutex_lock(&nau8310->kcs_shadow_lock);
+	bitmap_clear(nau8310->kcs_shadow_map, offset, size);
+	mutex_unlock(&nau8310->kcs_shadow_lock);
 }
 
-/* checking for DSP IDLE pattern */
-static int nau8310_dsp_idle(struct snd_soc_component *component)
+static void nau8310_kcs_shadow_update(struct nau8310 *nau8310, int offset,
+				      int size, const void *data)
+{
+	if (!nau8310->kcs_shadow_map)
+		return;
+	mutex_lock(&nau8310->kcs_shadow_lock);
+	memcpy(nau8310->kcs_shadow + offset, data, size);
+	bitmap_set(nau8310->kcs_shadow_map, offset, size);
+	mutex_unlock(&nau8310->kcs_shadow_lock);
+}
+
+/* Copy a range out of the KCS shadow. Return false if any byte of it
+ * isn't held, or the reads are to be verified against DSP.
+ */
+static bool nau8310_kcs_shadow_read(struct nau8310 *nau8310, int offset,
+				    int size, void *data)
+{
+	bool held;
+
+	if (!nau8310->kcs_shadow_map || READ_ONCE(nau8310->kcs_verify) ||
+		offset + size > NAU8310_DSP_KCS_SHADOW_LEN)
+		return false;
+	mutex_lock(&nau8310->kcs_shadow_lock);
+	held = find_next_zero_bit(nau8310->kcs_shadow_map, offset + size,
+				  offset) >= offset + size;
+	if (held) {
+		memcpy(data, nau8310->kcs_shadow + offset, size);
+		nau8310->kcs_shadow_hits++;
+	}
+	mutex_unlock(&nau8310->kcs_shadow_lock);
+
+	return held;
+}
+
+/* Compare a range read back from DSP with the bytes of the shadow held */
+static void nau8310_kcs_shadow_check(struct nau8310 *nau8310, int offset,
+				     int size, const void *data)
+{
+	const u8 *b = data;
+	int i;
+
+	if (!nau8310->kcs_shadow_map ||
+		offset + size > NAU8310_DSP_KCS_SHADOW_LEN)
+		return;
+	mutex_lock(&nau8310->kcs_shadow_lock);
+	for (i = 0; i < size; i++)
+		if (test_bit(offset + i, nau8310->kcs_shadow_map) &&
+			nau8310->kcs_shadow[offset + i] != b[i])
+			break;
+	if (i < size) {
+		nau8310->kcs_shadow_mismatches++;
+		dev_warn(nau8310->dev, "KCS shadow differs from DSP at 0x%x\n",
+			 offset + i);
+	}
+	mutex_unlock(&nau8310->kcs_shadow_lock);
+}
+
+static void nau8310_sw_reset_chip(struct nau8310 *nau8310)
+{
+	regmap_write(nau8310->regmap, NAU8310_R01_SOFTWARE_RST, 0x00);
+	regmap_write(nau8310->regmap, NAU8310_R01_SOFTWARE_RST, 0x00);
+	nau8310_kcs_shadow_drop(nau8310, 0, 0);
+}
+
+static bool nau8310_dsp_word_idle(unsigned int word)
+{
+	return word == NAU8310_DSP_COMM_IDLE_WORD;
+}
+
+static bool nau8310_dsp_word_preamble(unsigned int word)
+{
+	const u8 *b = (const u8 *)&word;
+
+	return b[0] == (NAU8310_DSP_COMM_PREAMBLE & 0xff) &&
+		b[1] == (NAU8310_DSP_COMM_PREAMBLE >> 8);
+}
+
+/**
+ * nau8310_dsp_wait_word - Wait for an expected word in the DSP mailbox
+ *
+ * @component:  component to register
+ * @accept: check whether the word read from mailbox is expected
+ * @use_irq: sleep on the DSP reply interrupt between reads
+ * @word: the last word read from mailbox
+ * @polls: count of mailbox reads
+ *
+ * The mailbox is read at once, and then again with an exponential backoff
+ * between reads until the word is accepted or NAU8310_DSP_WAIT_TIMEOUT_US
+ * expires. If the DSP interrupt is wired, the driver sleeps until the DSP
+ * reply interrupt instead of the backoff.
+ */
+static int nau8310_dsp_wait_word(struct snd_soc_component *component,
+				 bool (*accept)(unsigned int word), bool use_irq,
+				 unsigned int *word, unsigned int *polls)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	u8 buf[4];
-	unsigned int idle_pattern;
-	int ret, retries;
+	unsigned int delay_us = NAU8310_DSP_POLL_MIN_US;
+	ktime_t timeout;
+	s64 remain_us;
+	int ret;
 
-	for (retries = NAU8310_DSP_IDLE_RETRY; retries > 0; retries--) {
-		ret = regmap_read(nau8310->regmap, NAU8310_RF000_DSP_COMM,
-				  &idle_pattern);
-		if (ret) {
-			dev_err(component->dev, "Failed to read dsp status\n");
+	use_irq = use_irq && nau8310->irq;
+	timeout = ktime_add_us(ktime_get(), NAU8310_DSP_WAIT_TIMEOUT_US);
+	for (*polls = 1; ; (*polls)++) {
+		ret = regmap_read(nau8310->dsp_regmap, NAU8310_RF000_DSP_COMM, word);
+		nau8310->dsp_stats.transfers++;
+		if (ret)
 			return ret;
-		}
-		if (idle_pattern == NAU8310_DSP_COMM_IDLE_WORD) {
-			dev_dbg(component->dev, "Idle pattern found\n");
+		if (accept(*word))
+			return 0;
+		remain_us = ktime_us_delta(timeout, ktime_get());
+		if (remain_us <= 0)
 			break;
+		if (use_irq) {
+			if (wait_for_completion_timeout(&nau8310->dsp_reply,
+				usecs_to_jiffies(remain_us)))
+				nau8310->dsp_stats.irq_replies++;
+			else
+				use_irq = false;
+		} else {
+			usleep_range(delay_us, delay_us * 2);
+			if (delay_us < NAU8310_DSP_POLL_MAX_US)
+				delay_us <<= 1;
 		}
-		nau8310_sw_reset_chip(nau8310->regmap);
 	}
-	/* The driver can't establish a connection to DSP.
-	 * Maybe it is not clocked, or previous synchronization issue.
-	 */
-	if (retries == 0) {
-		dev_err(component->dev, "Timeout for idle pattern\n");
-		return -EIO;
+	nau8310->dsp_stats.timeouts++;
+
+	return -ETIMEDOUT;
+}
+
+/**
+ * nau8310_dsp_drain - Drain the words left in the DSP mailbox
+ *
+ * @component:  component to register
+ * @word: the last word read from mailbox
+ * @polls: count of mailbox reads, added to
+ *
+ * A reply which was cut short or not read at all holds the words of its
+ * fragments in the mailbox ahead of the idle pattern. They are read back
+ * to back and thrown away, up to the longest reply, so the mailbox frames
+ * line up again without resetting the chip.
+ */
+static int nau8310_dsp_drain(struct snd_soc_component *component,
+			     unsigned int *word, unsigned int *polls)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int i, ret;
+
+	for (i = 0; i < NAU8310_DSP_DRAIN_MAX; i++) {
+		ret = regmap_read(nau8310->dsp_regmap, NAU8310_RF000_DSP_COMM, word);
+		nau8310->dsp_stats.transfers++;
+		(*polls)++;
+		if (ret)
+			return ret;
+		if (nau8310_dsp_word_idle(*word))
+			return 0;
+	}
+
+	return -ETIMEDOUT;
+}
+
+/* checking for DSP IDLE pattern */
+static int nau8310_dsp_idle(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	u8 buf[4];
+	unsigned int idle_pattern, polls;
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = nau8310_dsp_wait_word(component, nau8310_dsp_word_idle, false,
+				    &idle_pattern, &polls);
+	nau8310->dsp_stats.idle_polls = polls;
+	if (ret == -ETIMEDOUT) {
+		/* Maybe previous synchronization issue, drain what is left of
+		 * a reply first.
+		 */
+		dev_dbg(component->dev, "No idle pattern, drain and retry\n");
+		ret = nau8310_dsp_drain(component, &idle_pattern,
+					&nau8310->dsp_stats.idle_polls);
+		if (!ret)
+			nau8310->dsp_stats.resyncs++;
+	}
+	if (ret == -ETIMEDOUT) {
+		/* Still out of step, so reset once and give DSP another
+		 * chance.
+		 */
+		dev_dbg(component->dev, "No idle pattern, reset and retry\n");
+		nau8310_sw_reset_chip(nau8310);
+		ret = nau8310_dsp_wait_word(component, nau8310_dsp_word_idle,
+					    false, &idle_pattern, &polls);
+		nau8310->dsp_stats.idle_polls += polls;
+		if (!ret)
+			nau8310->dsp_stats.resets++;
+	}
+	trace_nau8310_dsp_idle_wait(component, nau8310->dsp_stats.idle_polls,
+				    ktime_to_ns(ktime_sub(ktime_get(), start)), ret);
+	if (ret) {
+		/* The driver can't establish a connection to DSP.
+		 * Maybe it is not clocked.
+		 */
+		dev_err_ratelimited(component->dev, "Timeout for idle pattern (%d)\n", ret);
+		return ret == -ETIMEDOUT ? -EIO : ret;
 	}
 
 	*(unsigned int *)&buf[0] = idle_pattern;
 
+	dev_dbg(component->dev, "Idle pattern found after %u polls\n",
+		nau8310->dsp_stats.idle_polls);
 	dev_dbg(component->dev, "[R] %02x %02x %02x %02x\n",
 		buf[0], buf[1], buf[2], buf[3]);
 
 	return 0;
 }
 
+/* the fragment @i of the message in the frame, behind its mailbox address */
+static u8 *nau8310_dsp_frag(struct nau8310 *nau8310, int i)
+{
+	return nau8310->dsp_frame + i * NAU8310_DSP_FRAME_SLOT +
+		NAU8310_DSP_REG_LEN;
+}
+
+static int nau8310_dsp_frags_write(struct snd_soc_component *component,
+				   int frag_cnt)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	u8 *data;
+	int ret, i;
+
+	for (i = 0; i < frag_cnt; i++) {
+		data = nau8310_dsp_frag(nau8310, i);
+		dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
+			data[0], data[1], data[2], data[3]);
+	}
+
+#ifdef NAU8310_DSP_BURST_XFER
+	ret = nau8310_dsp_frame_write(nau8310, frag_cnt);
+	nau8310->dsp_stats.transfers++;
+	return ret;
+#else
+	for (i = 0; i < frag_cnt; i++) {
+		data = nau8310_dsp_frag(nau8310, i);
+		ret = regmap_write(nau8310->dsp_regmap, NAU8310_RF000_DSP_COMM,
+				   get_unaligned((u32 *)data));
+		nau8310->dsp_stats.transfers++;
+		if (ret)
+			return ret;
+	}
+
+	return 0;
+#endif
+}
+
+/* The message is built into the frame of the device, the fragments laid
+ * out as they go on the bus. The caller has to hold dsp_lock.
+ */
 static int nau8310_massage_to_dsp(struct snd_soc_component *component,
 				  const struct nau8310_cmd_info *cmd_info, int frag_len,
 				  int param_offset, int param_size, void *param_data)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	u8 data[4], *b_data;
-	unsigned int *value = (unsigned int *)data;
 	unsigned int preamble = NAU8310_DSP_COMM_PREAMBLE;
+	u8 *data, *b_data;
 	int ret, i, data_size, padding = 0, frag_cnt = 0;
 
+	/* preamble, parameters, payload and trailer must fit in one message */
+	if (frag_len + 1 > NAU8310_DSP_FRAG_MAX) {
+		ret = -EMSGSIZE;
+		goto err;
+	}
+	for (i = 0; i <= frag_len; i++)
+		memset(nau8310_dsp_frag(nau8310, i), 0, NAU8310_DSP_DATA_BYTE);
+
 	ret = nau8310_dsp_idle(component);
 	if (ret)
 		goto err;
 
-	/* sending preamble fragment */
+	/* preamble fragment */
+	data = nau8310_dsp_frag(nau8310, 0);
 	data[0] = preamble;
 	data[1] = preamble >> 8;
 	data[2] = (cmd_info->cmd_id << 2) | (frag_len & 0x3);
 	data[3] = frag_len >> 2;
-	regmap_write(nau8310->regmap, NAU8310_RF000_DSP_COMM, *value);
 
 	dev_dbg(component->dev, "Sending preamble fragment (CMD_ID 0x%x, LEN 0x%x)\n",
 		cmd_info->cmd_id, frag_len);
-	dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
-		data[0], data[1], data[2], data[3]);
 
 	if (!cmd_info->msg_param)
-		goto done;
+		goto send;
 
-	/* sending payload + padding */
-	*value = 0;
+	/* parameters fragment */
+	data = nau8310_dsp_frag(nau8310, ++frag_cnt);
 	data[0] = param_offset;
 	data[1] = param_offset >> 8;
 	data[2] = param_size;
 	data[3] = param_size >> 8;
-	regmap_write(nau8310->regmap, NAU8310_RF000_DSP_COMM, *value);
-	frag_cnt++;
 
 	dev_dbg(component->dev, "Sending parameters fragment (offset 0x%x, size 0x%x)\n",
 		param_offset, param_size);
-	dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
-		data[0], data[1], data[2], data[3]);
 
+	/* payload + padding */
 	if (cmd_info->setup_data) {
 		b_data = (u8 *)param_data;
-		for (data_size = 0, *value = 0, i = 0; i < param_size; i++) {
-			data[i % NAU8310_DSP_DATA_BYTE] = b_data[i];
-			data_size++;
-			if (data_size == NAU8310_DSP_DATA_BYTE) {
-				regmap_write(nau8310->regmap,
-					     NAU8310_RF000_DSP_COMM, *value);
-				dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
-					data[0], data[1], data[2], data[3]);
+		for (data_size = 0, i = 0; i < param_size; i++) {
+			if (data_size == 0)
+				data = nau8310_dsp_frag(nau8310, ++frag_cnt);
+			data[data_size++] = b_data[i];
+			if (data_size == NAU8310_DSP_DATA_BYTE)
 				data_size = 0;
-				*value = 0;
-				frag_cnt++;
-
-
-			}
 		}
-		if (data_size > 0 && data_size < NAU8310_DSP_DATA_BYTE) {
-			/* sending the data fragments with padding bytes */
+		/* the last data fragment is sent with padding bytes */
+		if (data_size > 0)
 			padding = NAU8310_DSP_DATA_BYTE - data_size;
-			regmap_write(nau8310->regmap,
-				     NAU8310_RF000_DSP_COMM, *value);
-			dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
-				data[0], data[1], data[2], data[3]);
-			*value = 0;
-			frag_cnt++;
-
-		}
-		dev_dbg(component->dev, "\n");
 	}
 
-	/* sending trailing fragment */
+	/* trailing fragment */
 	frag_cnt++;
-	*value = 0;
+	data = nau8310_dsp_frag(nau8310, frag_cnt);
 	data[0] = frag_cnt;
 	data[1] = ((frag_cnt >> 8) << 6) | (padding << 4);
-	regmap_write(nau8310->regmap, NAU8310_RF000_DSP_COMM, *value);
 
 	dev_dbg(component->dev,	"Sending trailing fragment (LEN 0x%x, PAD 0x%x)\n",
 		frag_cnt, padding);
-	dev_dbg(component->dev, "[W] %02x %02x %02x %02x\n",
-		data[0], data[1], data[2], data[3]);
 
 	if (frag_cnt != frag_len) {
-		dev_err(component->dev,	"Sending massage error (CMD_ID 0x%x, LEN 0x%x) !!!\n",
+		dev_err_ratelimited(component->dev,	"Sending massage error (CMD_ID 0x%x, LEN 0x%x) !!!\n",
 			cmd_info->cmd_id, frag_cnt);
 		ret = -EPROTO;
 		goto err;
 	}
 
-done:
+send:
+	/* the preamble fragment isn't counted in the message length */
+	ret = nau8310_dsp_frags_write(component, frag_cnt + 1);
+	if (ret) {
+		dev_err_ratelimited(component->dev, "Failed to write message to dsp (%d)\n", ret);
+		goto err;
+	}
+
 	return 0;
 err:
 	return ret;
@@ -235,35 +484,36 @@ err:
 static int nau8310_dsp_replied(struct snd_soc_component *component, int *length)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_stats *stats = &nau8310->dsp_stats;
 	u8 buf[4];
 	const u8 *b = buf;
-	unsigned int reply_preamble;
-	int ret, retries, reply_id;
-
-	for (retries = 10; retries > 0; retries--) {
-		ret = regmap_read(nau8310->regmap, NAU8310_RF000_DSP_COMM,
-				  &reply_preamble);
-		if (ret) {
-			dev_err(component->dev, "Failed to read reply preamble of dsp\n");
-			return ret;
-		}
-		/* check for preamble */
-		*(unsigned int *)&buf[0] = reply_preamble;
-		if (b[0] == (NAU8310_DSP_COMM_PREAMBLE & 0xff) &&
-			b[1] == (NAU8310_DSP_COMM_PREAMBLE >> 8)) {
-			*length = b[2] & 0x3;
-			*length |= b[3] << 2;
-			reply_id = b[2] >> 2;
-			break;
+	unsigned int reply_preamble, polls;
+	ktime_t start = ktime_get();
+	int ret, reply_id;
+
+	ret = nau8310_dsp_wait_word(component, nau8310_dsp_word_preamble, true,
+				    &reply_preamble, &polls);
+	trace_nau8310_dsp_reply_wait(component, polls,
+				     ktime_to_ns(ktime_sub(ktime_get(), start)), ret);
+	stats->reply_polls = polls;
+	if (stats->max_reply_polls < polls)
+		stats->max_reply_polls = polls;
+	if (ret) {
+		if (ret == -ETIMEDOUT) {
+			dev_err_ratelimited(component->dev, "Timeout for reply preamble\n");
+			return -EIO;
 		}
+		dev_err_ratelimited(component->dev, "Failed to read reply preamble of dsp\n");
+		return ret;
 	}
-	if (retries == 0) {
-		dev_err(component->dev, "Timeout for reply preamble\n");
-		return -EIO;
-	}
-
-	dev_dbg(component->dev,	"Receiving preamble fragment (REPLY_ID 0x%x, LEN 0x%x)\n",
-		reply_id, *length);
+	/* parse for preamble */
+	*(unsigned int *)&buf[0] = reply_preamble;
+	*length = b[2] & 0x3;
+	*length |= b[3] << 2;
+	reply_id = b[2] >> 2;
+
+	dev_dbg(component->dev,	"Receiving preamble fragment (REPLY_ID 0x%x, LEN 0x%x, polls %u)\n",
+		reply_id, *length, polls);
 	dev_dbg(component->dev, "[R] %02x %02x %02x %02x\n",
 		b[0], b[1], b[2], b[3]);
 
@@ -273,6 +523,37 @@ static int nau8310_dsp_replied(struct snd_soc_component *component, int *length)
 		return -reply_id;
 }
 
+/* Read the fragments of a reply after its preamble, the trailing one too.
+ * The caller has to hold dsp_lock.
+ */
+static int nau8310_dsp_frags_read(struct snd_soc_component *component,
+				  u32 *words, int frag_len)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret;
+#ifndef NAU8310_DSP_BURST_XFER
+	unsigned int payload;
+	int i;
+#endif
+
+#ifdef NAU8310_DSP_BURST_XFER
+	ret = nau8310_dsp_frame_read(nau8310, words, frag_len);
+	nau8310->dsp_stats.transfers++;
+	return ret;
+#else
+	for (i = 0; i < frag_len; i++) {
+		ret = regmap_read(nau8310->dsp_regmap, NAU8310_RF000_DSP_COMM,
+				  &payload);
+		nau8310->dsp_stats.transfers++;
+		if (ret)
+			return ret;
+		words[i] = payload;
+	}
+
+	return 0;
+#endif
+}
+
 static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 	const struct nau8310_cmd_info *cmd_info, int data_size, void *data)
 {
@@ -280,6 +561,7 @@ static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 	u8 buf[4], *b_data;
 	const u8 *b = buf;
 	unsigned int payload, *data_buf;
+	u32 *words = NULL;
 	int i, j, ret, frag_len, frag_payload_len;
 	int data_count, len_pos, pad_len, pad_len_exp;
 
@@ -304,15 +586,22 @@ static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 	else if (frag_len == 0)
 		goto done;
 
+	words = kmalloc_array(frag_len, sizeof(*words), GFP_KERNEL);
+	if (!words) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ret = nau8310_dsp_frags_read(component, words, frag_len);
+	if (ret) {
+		dev_err_ratelimited(component->dev, "Failed to read payload of dsp\n");
+		goto err;
+	}
+
 	frag_payload_len = frag_len - 1;
 	if (cmd_info->msg_param)
 		data_count = data_size;
 	for (i = 0; i < frag_payload_len; i++) {
-		ret = regmap_read(nau8310->regmap, NAU8310_RF000_DSP_COMM, &payload);
-		if (ret) {
-			dev_err(component->dev, "Failed to read payload of dsp\n");
-			goto err;
-		}
+		payload = words[i];
 		if (cmd_info->msg_param) {
 			if (data_count >= NAU8310_DSP_DATA_BYTE) {
 				*data_buf++ = payload;
@@ -354,19 +643,16 @@ static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 			 data_size - data_count, data_size);
 	}
 
-	dev_dbg(component->dev, "Reading trailing fragment\n");
+	dev_dbg(component->dev, "Checking trailing fragment\n");
 
-	ret = regmap_read(nau8310->regmap, NAU8310_RF000_DSP_COMM, &payload);
-	if (ret) {
-		dev_err(component->dev, "Failed to read trailing fragment of dsp\n");
-		goto err;
-	}
+	payload = words[frag_payload_len];
 	*(unsigned int *)&buf[0] = payload;
 	len_pos = b[0];
 	len_pos |= (b[1] & 0xc0) << 2;
 	if (len_pos != frag_len) {
-		dev_err(component->dev, "LEN_POST = %02X, expected %02X\n",
+		dev_err_ratelimited(component->dev, "LEN_POST = %02X, expected %02X\n",
 			len_pos, frag_len);
+		nau8310->dsp_stats.proto_errors++;
 		ret = -EPROTO;
 		goto err;
 	}
@@ -378,8 +664,9 @@ static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 		pad_len_exp = 0;
 	}
 	if (pad_len != pad_len_exp) {
-		dev_err(component->dev, "PAD_LEN = %02X, expected %02X\n",
+		dev_err_ratelimited(component->dev, "PAD_LEN = %02X, expected %02X\n",
 			pad_len, pad_len_exp);
+		nau8310->dsp_stats.proto_errors++;
 		ret = -EPROTO;
 		goto err;
 	}
@@ -388,40 +675,93 @@ static int nau8310_reply_from_dsp(struct snd_soc_component *component,
 		len_pos, pad_len);
 	dev_dbg(component->dev, "[R] %02x %02x %02x %02x\n",
 		buf[0], buf[1], buf[2], buf[3]);
+	kfree(words);
 
 done:
 	return 0;
 err:
-	dev_err(component->dev, "DSP reply error %d !!!\n", ret);
+	kfree(words);
+	dev_err_ratelimited(component->dev, "DSP reply error %d !!!\n", ret);
 	return ret;
 }
 
-/**
- * nau8310_send_dsp_command - Send command to DSP
- *
- * @component:  component to register
- * @cmd_id:  DSP supported command ID
- * @kcs_setup: KCS setup structure
- *
- * The communication protocol is a Master-Slave type protocol
- * where the host processor is the master and DSP is the slave.
- * The Master initiates the communication and can either write or
- * read back from the slave.
- * Transactions from the Master are called "Messages",
- * and read-back data from the Slave is called a "Reply".
- *
- * The function sends command to DSP according to the command ID.
- * These commands include getting the information of DSP,
- * getting or setting KCS configuration, or making DSP control.
+/* The retries are the mailbox reads more than once in idle and reply waits. */
+static void nau8310_dsp_trace_cmd_end(struct snd_soc_component *component,
+				      int cmd_id, int frag_len, int bytes,
+				      ktime_t start, int ret)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_stats *stats = &nau8310->dsp_stats;
+	unsigned int retries = 0;
+
+	if (!trace_nau8310_dsp_cmd_end_enabled())
+		return;
+	if (stats->idle_polls)
+		retries += stats->idle_polls - 1;
+	if (stats->reply_polls)
+		retries += stats->reply_polls - 1;
+	trace_nau8310_dsp_cmd_end(component, cmd_id, frag_len, bytes, retries,
+				  ktime_to_ns(ktime_sub(ktime_get(), start)), ret);
+}
+
+static bool nau8310_dsp_prio_waiting(struct nau8310 *nau8310, int prio)
+{
+	int i;
+
+	for (i = prio + 1; i < NAU8310_DSP_PRIO_NUM; i++)
+		if (atomic_read(&nau8310->dsp_waiters[i]))
+			return true;
+
+	return false;
+}
+
+/* Take the mailbox for a command of class @prio. The classes above it
+ * waiting for the mailbox go first, so a clock command never waits behind
+ * a KCS upload, which takes the mailbox again for each chunk.
  */
-int nau8310_send_dsp_command(struct snd_soc_component *component,
+static void nau8310_dsp_lock(struct nau8310 *nau8310, int prio)
+{
+	atomic_inc(&nau8310->dsp_waiters[prio]);
+	for (;;) {
+		wait_event(nau8310->dsp_prio_wait,
+			   !nau8310_dsp_prio_waiting(nau8310, prio));
+		mutex_lock(&nau8310->dsp_lock);
+		if (!nau8310_dsp_prio_waiting(nau8310, prio))
+			break;
+		nau8310->dsp_stats.prio_yields++;
+		mutex_unlock(&nau8310->dsp_lock);
+	}
+	if (atomic_dec_and_test(&nau8310->dsp_waiters[prio]))
+		wake_up_all(&nau8310->dsp_prio_wait);
+}
+
+static void nau8310_dsp_unlock(struct nau8310 *nau8310)
+{
+	mutex_unlock(&nau8310->dsp_lock);
+}
+
+/* let the classes above @prio have the mailbox held across commands */
+static void nau8310_dsp_yield(struct nau8310 *nau8310, int prio)
+{
+	if (!nau8310_dsp_prio_waiting(nau8310, prio))
+		return;
+	nau8310->dsp_stats.prio_yields++;
+	nau8310_dsp_unlock(nau8310);
+	nau8310_dsp_lock(nau8310, prio);
+}
+
+/* The caller has to hold dsp_lock. */
+static int __nau8310_send_dsp_command(struct snd_soc_component *component,
 			     int cmd_id, struct nau8310_kcs_setup *kcs_setup)
 {
 	const struct nau8310_cmd_info *cmd_info;
+	struct nau8310 *nau8310;
+	ktime_t start;
 	int ret, frag_len = 0;
 
 	if (!component)
 		return -EINVAL;
+	nau8310 = snd_soc_component_get_drvdata(component);
 
 	if (!kcs_setup) {
 		ret = -EINVAL;
@@ -433,6 +773,13 @@ int nau8310_send_dsp_command(struct snd_soc_component *component,
 		goto msg_fail;
 	}
 
+	/* a command releases the DSP parked by the idle bias off */
+	if (nau8310->dsp_parked) {
+		regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
+				   NAU8310_DSP_RUNSTALL, 0);
+		nau8310->dsp_parked = false;
+	}
+
 	cmd_info = &nau8310_dsp_cmd_table[cmd_id];
 	if ((cmd_info->msg_param && !kcs_setup->set_len) ||
 		(cmd_info->setup_data && !kcs_setup->set_kcs_data) ||
@@ -461,225 +808,700 @@ int nau8310_send_dsp_command(struct snd_soc_component *component,
 	if (cmd_info->setup_data)
 		frag_len += (kcs_setup->set_len +
 			NAU8310_DSP_DATA_BYTE - 1) / NAU8310_DSP_DATA_BYTE;
+	nau8310->dsp_stats.commands++;
+	if (cmd_info->setup_data)
+		nau8310->dsp_stats.bytes += kcs_setup->set_len;
+	if (cmd_info->reply_data)
+		nau8310->dsp_stats.bytes += kcs_setup->get_len;
+	nau8310->dsp_stats.idle_polls = 0;
+	nau8310->dsp_stats.reply_polls = 0;
+	reinit_completion(&nau8310->dsp_reply);
+	start = ktime_get();
+	trace_nau8310_dsp_cmd_start(component, cmd_id, frag_len,
+				    kcs_setup->set_len);
 	ret = nau8310_massage_to_dsp(component, cmd_info, frag_len,
 		kcs_setup->set_kcs_offset, kcs_setup->set_len,
 		kcs_setup->set_kcs_data);
 	if (ret)
-		goto msg_fail;
+		goto msg_end;
 
 	ret = nau8310_reply_from_dsp(component, cmd_info,
 		kcs_setup->get_len, kcs_setup->get_data);
+	nau8310_dsp_trace_cmd_end(component, cmd_id, frag_len,
+				  kcs_setup->set_len, start, ret);
 	if (ret)
 		goto reply_fail;
 
 	return 0;
 
+msg_end:
+	nau8310_dsp_trace_cmd_end(component, cmd_id, frag_len,
+				  kcs_setup->set_len, start, ret);
+	nau8310->dsp_stats.send_errors++;
 msg_fail:
-	dev_err(component->dev, "Fail to send a message(%d) to dsp, ret %d.\n",
+	dev_err_ratelimited(component->dev, "Fail to send a message(%d) to dsp, ret %d.\n",
 		cmd_id, ret);
 	return ret;
 reply_fail:
-	dev_err(component->dev, "Reply fail (%d) from dsp.\n", ret);
+	nau8310->dsp_stats.reply_errors++;
+	dev_err_ratelimited(component->dev, "Reply fail (%d) from dsp.\n", ret);
 	return ret;
 }
 
 /**
- * nau8310_dsp_kcs_setup - Send KCS setup command to DSP
+ * nau8310_send_dsp_command - Send command to DSP
  *
  * @component:  component to register
- * @offset: address offset relative to KCS start
- * @size: size of data writen to KCS
- * @data: data writen to KCS setup
+ * @cmd_id:  DSP supported command ID
+ * @kcs_setup: KCS setup structure
  *
- * The function sends KCS setup command to DSP for
- * setting KCS configuration. The maximum size that you can transfer into
- * the DSP is 96 bytes. Therefore, the driver has to split the data into
- * 96 bytes chucks, if the setup configuration over the threshold.
+ * The communication protocol is a Master-Slave type protocol
+ * where the host processor is the master and DSP is the slave.
+ * The Master initiates the communication and can either write or
+ * read back from the slave.
+ * Transactions from the Master are called "Messages",
+ * and read-back data from the Slave is called a "Reply".
+ *
+ * The function sends command to DSP according to the command ID.
+ * These commands include getting the information of DSP,
+ * getting or setting KCS configuration, or making DSP control.
+ * The clock commands take the mailbox ahead of the KCS setup, and the
+ * KCS setup ahead of the commands for information.
  */
-int nau8310_dsp_kcs_setup(struct snd_soc_component *component,
-			  int offset, int size, const void *data)
+int nau8310_send_dsp_command(struct snd_soc_component *component,
+			     int cmd_id, struct nau8310_kcs_setup *kcs_setup)
 {
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	u8 *data_buf;
-	int cmd_id = NAU8310_DSP_CMD_SET_KCS_SETUP;
-	int retries, ret, data_len, data_rem, addr_offset;
-	unsigned int kcs_rst;
-
-	/* Limit full load of KCS_SETUP data and not beyond 3kB offset. */
-	if (!data || size > NAU8310_DSP_KCS_DAT_LEN_MAX ||
-		offset > NAU8310_DSP_KCS_OFFSET_MAX) {
-		ret = -EINVAL;
-		goto msg_fail;
-	}
+	struct nau8310 *nau8310;
+	int ret;
 
-	/* sending fragments for KCS setup */
-	data_buf = (u8 *)data;
-	addr_offset = offset;
-	data_rem = size;
-	retries = 0;
-	kcs_setup->get_data = &kcs_rst;
-	while (data_rem) {
-		if (data_rem > NAU8310_DSP_KCS_TX_MAX)
-			data_len = NAU8310_DSP_KCS_TX_MAX;
-		else
-			data_len = data_rem;
-		cmd_id = NAU8310_DSP_CMD_SET_KCS_SETUP;
-		kcs_setup->set_kcs_offset = addr_offset;
-		kcs_setup->set_len = data_len;
-		kcs_setup->set_kcs_data = data_buf;
-		ret = nau8310_send_dsp_command(component, cmd_id, kcs_setup);
-		if (ret < 0) {
-			if (retries++ < NAU8310_DSP_RETRY_MAX)
-				continue;
-			else
-				goto msg_fail;
-		} else {
-			data_buf += (u8)data_len;
-			addr_offset += data_len;
-			data_rem -= data_len;
-		}
-		/* checking KCS result */
-		cmd_id = NAU8310_DSP_CMD_GET_KCS_RSLTS;
-		kcs_setup->set_kcs_offset = 0;
-		kcs_setup->set_len = NAU8310_DSP_DATA_BYTE;
-		kcs_setup->get_len = kcs_setup->set_len;
-		ret = nau8310_send_dsp_command(component, cmd_id, kcs_setup);
-		if (ret < 0)
-			goto msg_fail;
-	}
+	if (!component)
+		return -EINVAL;
+	nau8310 = snd_soc_component_get_drvdata(component);
+	if (!nau8310_dsp_commands(cmd_id))
+		return __nau8310_send_dsp_command(component, cmd_id, kcs_setup);
 
-	return 0;
+	nau8310_dsp_lock(nau8310, nau8310_dsp_cmd_table[cmd_id].prio);
+	ret = __nau8310_send_dsp_command(component, cmd_id, kcs_setup);
+	nau8310_dsp_unlock(nau8310);
 
-msg_fail:
-	dev_err(component->dev, "Fail to send a kcs setup message(%d) to dsp, ret %d.\n",
-		cmd_id, ret);
 	return ret;
 }
 
-static int nau8310_dsp_get_counter_put(struct snd_kcontrol *kcontrol,
-				       struct snd_ctl_elem_value *ucontrol)
+/**
+ * nau8310_send_dsp_batch - Send a bundle of commands to DSP
+ *
+ * @component:  component to register
+ * @cmd_ids:  DSP supported command IDs
+ * @kcs_setups: KCS setup structures, one per command
+ * @num: number of commands
+ *
+ * The DSP takes one command per message, so the commands still go out
+ * one after the other, but under one hold of the mailbox, at the class
+ * of the highest one. Nothing gets in between, and the idle check ahead
+ * of each message after the first finds the DSP back at once. The batch
+ * stops at the first command which fails.
+ */
+int nau8310_send_dsp_batch(struct snd_soc_component *component,
+			   const int *cmd_ids,
+			   struct nau8310_kcs_setup *kcs_setups, int num)
 {
-	struct snd_soc_component *component =
-			snd_soc_kcontrol_component(kcontrol);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	int ret, counter;
+	struct nau8310 *nau8310;
+	int i, ret = 0, prio = NAU8310_DSP_PRIO_DIAG;
+
+	if (!component || !cmd_ids || !kcs_setups || num <= 0)
+		return -EINVAL;
+	nau8310 = snd_soc_component_get_drvdata(component);
+	for (i = 0; i < num; i++) {
+		if (!nau8310_dsp_commands(cmd_ids[i]))
+			return -EINVAL;
+		prio = max(prio, nau8310_dsp_cmd_table[cmd_ids[i]].prio);
+	}
+
+	nau8310_dsp_lock(nau8310, prio);
+	for (i = 0; i < num && !ret; i++)
+		ret = __nau8310_send_dsp_command(component, cmd_ids[i],
+						 &kcs_setups[i]);
+	nau8310_dsp_unlock(nau8310);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_send_dsp_batch);
+
+static bool nau8310_dsp_req_same(const struct nau8310_dsp_req *req, int cmd_id,
+				 const struct nau8310_kcs_setup *kcs_setup,
+				 nau8310_dsp_done_t done)
+{
+	const struct nau8310_cmd_info *cmd_info = &nau8310_dsp_cmd_table[cmd_id];
+
+	/* only the read requests without data writen can be coalesced */
+	if (req->cmd_id != cmd_id || req->done != done ||
+		!cmd_info->reply_data || cmd_info->setup_data)
+		return false;
+
+	return req->kcs_setup.set_kcs_offset == kcs_setup->set_kcs_offset &&
+		req->kcs_setup.set_len == kcs_setup->set_len &&
+		req->kcs_setup.get_len == kcs_setup->get_len;
+}
+
+/**
+ * nau8310_dsp_queue_command - Queue command to DSP and return at once
+ *
+ * @component:  component to register
+ * @cmd_id:  DSP supported command ID
+ * @kcs_setup: KCS setup structure, it is copied into the queue
+ * @done: callback with the result when the command finishes, can be NULL
+ *
+ * The command is serviced by the ordered DSP workqueue, so the caller
+ * doesn't wait for the mailbox round-trip. If the reply buffer isn't
+ * given, the reply of up to 4 bytes is kept in the request and passed
+ * to the callback. The buffers given by the caller must be valid until
+ * the callback. A read request identical to one still pending is
+ * coalesced with it, and the function returns 1.
+ */
+int nau8310_dsp_queue_command(struct snd_soc_component *component, int cmd_id,
+			      const struct nau8310_kcs_setup *kcs_setup,
+			      nau8310_dsp_done_t done)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_req *req;
+	unsigned long flags;
+	unsigned int i;
+	int ret = 0;
+
+	if (!kcs_setup || !nau8310_dsp_commands(cmd_id) || !nau8310->dsp_wq)
+		return -EINVAL;
+
+	spin_lock_irqsave(&nau8310->dsp_queue_lock, flags);
+	for (i = nau8310->dsp_queue_tail; i != nau8310->dsp_queue_head;
+		i = (i + 1) % NAU8310_DSP_QUEUE_LEN)
+		if (nau8310_dsp_req_same(&nau8310->dsp_queue[i], cmd_id,
+					 kcs_setup, done)) {
+			ret = 1;
+			goto unlock;
+		}
+	if ((nau8310->dsp_queue_head + 1) % NAU8310_DSP_QUEUE_LEN ==
+		nau8310->dsp_queue_tail) {
+		ret = -EBUSY;
+		goto unlock;
+	}
+	req = &nau8310->dsp_queue[nau8310->dsp_queue_head];
+	req->component = component;
+	req->cmd_id = cmd_id;
+	req->kcs_setup = *kcs_setup;
+	req->done = done;
+	nau8310->dsp_queue_head = (nau8310->dsp_queue_head + 1) %
+		NAU8310_DSP_QUEUE_LEN;
+unlock:
+	spin_unlock_irqrestore(&nau8310->dsp_queue_lock, flags);
+
+	if (ret == 1)
+		dev_dbg(component->dev, "Coalesce DSP command %s with pending one\n",
+			dsp_cmd_table[cmd_id]);
+	else if (!ret)
+		queue_work(nau8310->dsp_wq, &nau8310->dsp_work);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_queue_command);
+
+static void nau8310_dsp_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 = container_of(work, struct nau8310, dsp_work);
+	struct nau8310_dsp_req req;
+	unsigned long flags;
+	int ret;
+
+	for (;;) {
+		spin_lock_irqsave(&nau8310->dsp_queue_lock, flags);
+		if (nau8310->dsp_queue_tail == nau8310->dsp_queue_head) {
+			spin_unlock_irqrestore(&nau8310->dsp_queue_lock, flags);
+			break;
+		}
+		req = nau8310->dsp_queue[nau8310->dsp_queue_tail];
+		nau8310->dsp_queue_tail = (nau8310->dsp_queue_tail + 1) %
+			NAU8310_DSP_QUEUE_LEN;
+		spin_unlock_irqrestore(&nau8310->dsp_queue_lock, flags);
+
+		if (!req.kcs_setup.get_data) {
+			req.kcs_setup.get_data = &req.reply;
+			if (!req.kcs_setup.get_len)
+				req.kcs_setup.get_len = sizeof(req.reply);
+		}
+		ret = nau8310_send_dsp_command(req.component, req.cmd_id,
+					       &req.kcs_setup);
+		if (req.done)
+			req.done(req.component, req.cmd_id, ret, &req.kcs_setup);
+	}
+}
+
+/* Derive the DSP load from the counter since the last sample, if it is
+ * no older than a few periods of the monitor.
+ */
+static void nau8310_dsp_sample_load(struct nau8310 *nau8310,
+				    const struct nau8310_dsp_sample *last,
+				    struct nau8310_dsp_sample *sample,
+				    unsigned int period)
+{
+	unsigned int clk = READ_ONCE(nau8310->dsp_clk_rate);
+	u64 dt_ns = sample->time_ns - last->time_ns, rate;
+
+	if (!clk || !nau8310->fs || !dt_ns || dt_ns >
+		(u64)(period << NAU8310_DSP_MON_IDLE_SHIFT_MAX) * 2 * NSEC_PER_MSEC)
+		return;
+	/* cycles per second, the counter wraps at 32 bits */
+	rate = div64_u64((u64)(u32)(sample->counter - last->counter) *
+			 NSEC_PER_SEC, dt_ns);
+	sample->frame_cycles = div_u64(rate, nau8310->fs);
+	sample->load = div_u64(rate * 1000, clk);
+}
+
+/* Sample the frame status and the counter of DSP into the ring of the
+ * monitor, for the readers which shouldn't wait for the mailbox. The
+ * period backs off while no stream is active.
+ */
+static void nau8310_dsp_monitor_work(struct work_struct *work)
+{
+	struct nau8310_dsp_monitor *mon = container_of(to_delayed_work(work),
+					struct nau8310_dsp_monitor, work);
+	struct nau8310 *nau8310 = container_of(mon, struct nau8310, dsp_mon);
+	struct snd_soc_component *component = mon->component;
+	static const int cmd_ids[] = {
+		NAU8310_DSP_CMD_GET_FRAME_STATUS,
+		NAU8310_DSP_CMD_GET_COUNTER,
+	};
+	struct nau8310_kcs_setup kcs_setups[ARRAY_SIZE(cmd_ids)] = {};
+	struct nau8310_dsp_sample *sample;
+	unsigned int period = READ_ONCE(mon->period_ms);
+	u32 status = 0, counter = 0;
+	int ret;
+
+	if (!period)
+		return;
+
+	kcs_setups[0].get_len = kcs_setups[0].set_len = sizeof(status);
+	kcs_setups[0].get_data = &status;
+	kcs_setups[1].get_len = kcs_setups[1].set_len = sizeof(counter);
+	kcs_setups[1].get_data = &counter;
+	ret = nau8310_send_dsp_batch(component, cmd_ids, kcs_setups,
+				     ARRAY_SIZE(cmd_ids));
+	if (!ret) {
+		spin_lock(&mon->lock);
+		sample = &mon->ring[mon->head % NAU8310_DSP_MON_LEN];
+		sample->time_ns = ktime_get_ns();
+		sample->frame_status = status;
+		sample->counter = counter;
+		sample->frame_cycles = sample->load = 0;
+		if (mon->head)
+			nau8310_dsp_sample_load(nau8310,
+				&mon->ring[(mon->head - 1) % NAU8310_DSP_MON_LEN],
+				sample, period);
+		mon->head++;
+		spin_unlock(&mon->lock);
+	}
+
+	if (snd_soc_component_active(component))
+		mon->idle_shift = 0;
+	else if (mon->idle_shift < NAU8310_DSP_MON_IDLE_SHIFT_MAX)
+		mon->idle_shift++;
+	queue_delayed_work(nau8310->dsp_wq, &mon->work,
+			   msecs_to_jiffies(period << mon->idle_shift));
+}
+
+int nau8310_dsp_queue_init(struct nau8310 *nau8310)
+{
+	nau8310->dsp_queue = devm_kcalloc(nau8310->dev, NAU8310_DSP_QUEUE_LEN,
+					  sizeof(*nau8310->dsp_queue),
+					  GFP_KERNEL);
+	if (!nau8310->dsp_queue)
+		return -ENOMEM;
+	mutex_init(&nau8310->dsp_lock);
+	init_waitqueue_head(&nau8310->dsp_prio_wait);
+	spin_lock_init(&nau8310->dsp_queue_lock);
+	nau8310->dsp_queue_head = nau8310->dsp_queue_tail = 0;
+	INIT_WORK(&nau8310->dsp_work, nau8310_dsp_work);
+	INIT_DELAYED_WORK(&nau8310->dsp_mon.work, nau8310_dsp_monitor_work);
+	INIT_DELAYED_WORK(&nau8310->dsp_clk_work, nau8310_dsp_clk_work);
+	spin_lock_init(&nau8310->dsp_mon.lock);
+	mutex_init(&nau8310->kcs_shadow_lock);
+	nau8310->kcs_shadow = devm_kzalloc(nau8310->dev,
+					   NAU8310_DSP_KCS_SHADOW_LEN, GFP_KERNEL);
+	nau8310->kcs_shadow_map = devm_bitmap_zalloc(nau8310->dev,
+					NAU8310_DSP_KCS_SHADOW_LEN, GFP_KERNEL);
+	if (!nau8310->kcs_shadow || !nau8310->kcs_shadow_map)
+		return -ENOMEM;
+	mutex_init(&nau8310->dsp_switch_lock);
+	INIT_WORK(&nau8310->dsp_switch_work, nau8310_dsp_switch_work);
+	nau8310->dsp_wq = alloc_ordered_workqueue("%s-dsp", 0,
+						  dev_name(nau8310->dev));
+	if (!nau8310->dsp_wq)
+		return -ENOMEM;
+
+	return 0;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_queue_init);
+
+void nau8310_dsp_queue_flush(struct nau8310 *nau8310)
+{
+	if (nau8310->dsp_wq)
+		flush_workqueue(nau8310->dsp_wq);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_queue_flush);
+
+void nau8310_dsp_queue_free(struct nau8310 *nau8310)
+{
+	if (nau8310->dsp_wq) {
+		destroy_workqueue(nau8310->dsp_wq);
+		nau8310->dsp_wq = NULL;
+	}
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_queue_free);
+
+/* (re)start the sampling of the monitor if a period is set */
+void nau8310_dsp_monitor_start(struct nau8310 *nau8310)
+{
+	struct nau8310_dsp_monitor *mon = &nau8310->dsp_mon;
+
+	if (!nau8310->dsp_wq || !mon->component || !mon->period_ms ||
+		!nau8310->dsp_enable)
+		return;
+	mon->idle_shift = 0;
+	mod_delayed_work(nau8310->dsp_wq, &mon->work, 0);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_monitor_start);
+
+void nau8310_dsp_monitor_stop(struct nau8310 *nau8310)
+{
+	cancel_delayed_work_sync(&nau8310->dsp_mon.work);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_monitor_stop);
+
+/**
+ * nau8310_dsp_park - Stall or release the DSP of an idle amplifier
+ *
+ * @nau8310:  the amplifier
+ * @park:  stall the DSP if true, release it if false
+ *
+ * The DSP keeps its memory on the OSC while stalled, so a release is a
+ * single register write with neither reset, power up delay nor KCS load.
+ * A command sent meanwhile releases the DSP first.
+ */
+void nau8310_dsp_park(struct nau8310 *nau8310, bool park)
+{
+	nau8310_dsp_lock(nau8310, NAU8310_DSP_PRIO_CTRL);
+	if (nau8310->dsp_parked != park) {
+		regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
+				   NAU8310_DSP_RUNSTALL,
+				   park ? NAU8310_DSP_RUNSTALL : 0);
+		nau8310->dsp_parked = park;
+		if (park)
+			nau8310->dsp_parks++;
+	}
+	nau8310_dsp_unlock(nau8310);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_park);
+
+/* release the DSP resources when the device goes away */
+void nau8310_dsp_remove(struct nau8310 *nau8310)
+{
+	int i;
+
+	nau8310_dsp_monitor_stop(nau8310);
+	cancel_delayed_work_sync(&nau8310->dsp_clk_work);
+	nau8310_dsp_queue_free(nau8310);
+	nau8310_dsp_fw_put(nau8310->kcs_fw);
+	nau8310->kcs_fw = NULL;
+	/* the profiles still loading refer to the device */
+	wait_var_event(&nau8310->profile_pending,
+		       !atomic_read(&nau8310->profile_pending));
+	for (i = 0; i < NAU8310_DSP_PROFILE_NUM; i++) {
+		nau8310_dsp_fw_put(nau8310->profile[i].fw);
+		nau8310->profile[i].fw = NULL;
+	}
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_remove);
+
+/**
+ * nau8310_dsp_kcs_setup - Send KCS setup command to DSP
+ *
+ * @component:  component to register
+ * @offset: address offset relative to KCS start
+ * @size: size of data writen to KCS
+ * @data: data writen to KCS setup
+ *
+ * The function sends KCS setup command to DSP for
+ * setting KCS configuration. The maximum size that you can transfer into
+ * the DSP is 96 bytes. Therefore, the driver has to split the data into
+ * 96 bytes chucks, if the setup configuration over the threshold.
+ *
+ * The KCS result is checked every kcs_check_interval chunks and after the
+ * last one; the interval 1 checks each chunk and 0 only the last. A failed
+ * check resumes the upload from the chunk after the last good check.
+ * The data goes into the KCS shadow once all of it is sent.
+ */
+int nau8310_dsp_kcs_setup(struct snd_soc_component *component,
+			  int offset, int size, const void *data)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	unsigned int interval = READ_ONCE(nau8310->kcs_check_interval);
+	const u8 *data_buf;
+	int cmd_id = NAU8310_DSP_CMD_SET_KCS_SETUP;
+	int retries, ret, data_len, data_rem, addr_offset, chunks, verified;
+	unsigned int kcs_rst;
+
+	/* Limit full load of KCS_SETUP data and not beyond 3kB offset. */
+	if (!data || size > NAU8310_DSP_KCS_DAT_LEN_MAX ||
+		offset > NAU8310_DSP_KCS_OFFSET_MAX) {
+		ret = -EINVAL;
+		goto msg_fail;
+	}
+
+	/* sending fragments for KCS setup */
+	verified = 0;
+	data_rem = size;
+	chunks = retries = 0;
+	kcs_setup->get_data = &kcs_rst;
+	while (data_rem) {
+		addr_offset = offset + size - data_rem;
+		data_buf = (const u8 *)data + size - data_rem;
+		data_len = min(data_rem, NAU8310_DSP_KCS_TX_MAX);
+		cmd_id = NAU8310_DSP_CMD_SET_KCS_SETUP;
+		kcs_setup->set_kcs_offset = addr_offset;
+		kcs_setup->set_len = data_len;
+		kcs_setup->set_kcs_data = (void *)data_buf;
+		ret = nau8310_send_dsp_command(component, cmd_id, kcs_setup);
+		if (ret < 0) {
+			if (retries++ < NAU8310_DSP_RETRY_MAX)
+				goto rewind;
+			else
+				goto msg_fail;
+		}
+		data_rem -= data_len;
+		chunks++;
+		if (data_rem && interval != 1 &&
+		    (!interval || chunks % interval))
+			continue;
+		/* checking KCS result */
+		cmd_id = NAU8310_DSP_CMD_GET_KCS_RSLTS;
+		kcs_setup->set_kcs_offset = 0;
+		kcs_setup->set_len = NAU8310_DSP_DATA_BYTE;
+		kcs_setup->get_len = kcs_setup->set_len;
+		ret = nau8310_send_dsp_command(component, cmd_id, kcs_setup);
+		if (!ret) {
+			verified = size - data_rem;
+			continue;
+		}
+		/* a failure of the strict checks isn't retried */
+		if (interval == 1 || retries++ >= NAU8310_DSP_RETRY_MAX)
+			goto msg_fail;
+rewind:
+		if (size - data_rem != verified)
+			nau8310->dsp_stats.kcs_rewinds++;
+		data_rem = size - verified;
+	}
+	nau8310_kcs_shadow_update(nau8310, offset, size, data);
+
+	return 0;
+
+msg_fail:
+	if (data)
+		nau8310_kcs_shadow_drop(nau8310, offset, size);
+	dev_err(component->dev, "Fail to send a kcs setup message(%d) to dsp, ret %d.\n",
+		cmd_id, ret);
+	return ret;
+}
+
+static void nau8310_dsp_get_counter_done(struct snd_soc_component *component,
+					 int cmd_id, int ret,
+					 struct nau8310_kcs_setup *kcs_setup)
+{
+	if (ret)
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[cmd_id], ret);
+	else
+		dev_info(component->dev, "DSP counter %d\n",
+			 *(int *)kcs_setup->get_data);
+}
+
+static int nau8310_dsp_get_counter_put(struct snd_kcontrol *kcontrol,
+				       struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	int ret;
 
 	dev_info(component->dev, "Send DSP command %s\n",
 		 dsp_cmd_table[NAU8310_DSP_CMD_GET_COUNTER]);
 
-	kcs_setup->get_len = kcs_setup->set_len = sizeof(counter);
-	kcs_setup->get_data = (void *)&counter;
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_GET_COUNTER, kcs_setup);
-	if (ret) {
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+	kcs_setup->get_len = kcs_setup->set_len = sizeof(int);
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_GET_COUNTER,
+					kcs_setup, nau8310_dsp_get_counter_done);
+	if (ret < 0)
+		dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
 			dsp_cmd_table[NAU8310_DSP_CMD_GET_COUNTER], ret);
-	} else {
-		dev_info(component->dev, "DSP counter %d\n", counter);
-	}
 
 	return 0;
 }
 
+static void nau8310_dsp_get_revision_done(struct snd_soc_component *component,
+					  int cmd_id, int ret,
+					  struct nau8310_kcs_setup *kcs_setup)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	if (ret) {
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[cmd_id], ret);
+		return;
+	}
+	dev_info(component->dev, "DSP version %x\n",
+		 *(int *)kcs_setup->get_data);
+	if (!nau8310->dsp_revision_valid) {
+		nau8310->dsp_revision = *(int *)kcs_setup->get_data;
+		nau8310->dsp_revision_valid = true;
+	}
+}
+
+/* the revision cached is given without a command to DSP */
 static int nau8310_dsp_get_revision_put(struct snd_kcontrol *kcontrol,
 					struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	int ret, version;
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	int ret;
 
+	if (nau8310->dsp_revision_valid) {
+		dev_info(component->dev, "DSP version %x\n",
+			 nau8310->dsp_revision);
+		return 0;
+	}
 	dev_info(component->dev, "Send DSP command %s\n",
 		 dsp_cmd_table[NAU8310_DSP_CMD_GET_REVISION]);
-	kcs_setup->get_len = kcs_setup->set_len = sizeof(version);
-	kcs_setup->get_data = (void *)&version;
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_GET_REVISION, kcs_setup);
-	if (ret) {
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+	kcs_setup->get_len = kcs_setup->set_len = sizeof(int);
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_GET_REVISION,
+					kcs_setup, nau8310_dsp_get_revision_done);
+	if (ret < 0)
+		dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
 			dsp_cmd_table[NAU8310_DSP_CMD_GET_REVISION], ret);
-	} else {
-		dev_info(component->dev, "DSP version %x\n", version);
-	}
 
 	return 0;
 }
 
+static void nau8310_dsp_get_frame_status_done(struct snd_soc_component *component,
+					      int cmd_id, int ret,
+					      struct nau8310_kcs_setup *kcs_setup)
+{
+	if (ret)
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[cmd_id], ret);
+	else
+		dev_info(component->dev, "DSP frame status %x\n",
+			 *(int *)kcs_setup->get_data);
+}
+
 static int nau8310_dsp_get_frame_status_put(struct snd_kcontrol *kcontrol,
 					    struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	int ret, status;
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	int ret;
 
 	dev_info(component->dev, "Send DSP command %s\n",
 		 dsp_cmd_table[NAU8310_DSP_CMD_GET_FRAME_STATUS]);
-	kcs_setup->get_len = kcs_setup->set_len = sizeof(status);
-	kcs_setup->get_data = (void *)&status;
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_GET_FRAME_STATUS, kcs_setup);
-	if (ret) {
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+	kcs_setup->get_len = kcs_setup->set_len = sizeof(int);
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_GET_FRAME_STATUS,
+					kcs_setup, nau8310_dsp_get_frame_status_done);
+	if (ret < 0)
+		dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
 			dsp_cmd_table[NAU8310_DSP_CMD_GET_FRAME_STATUS], ret);
-	} else {
-		dev_info(component->dev, "DSP frame status %x\n", status);
-	}
 
 	return 0;
 }
 
+static void nau8310_dsp_get_kcs_setup_done(struct snd_soc_component *component,
+					   int cmd_id, int ret,
+					   struct nau8310_kcs_setup *kcs_setup)
+{
+	char *data = kcs_setup->get_data, buf[100];
+	int i, count;
+
+	if (ret) {
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[cmd_id], ret);
+		goto done;
+	}
+	if (cmd_id == NAU8310_DSP_CMD_GET_KCS_SETUP)
+		nau8310_kcs_shadow_check(snd_soc_component_get_drvdata(component),
+					 kcs_setup->set_kcs_offset,
+					 kcs_setup->get_len, data);
+
+	dev_dbg(component->dev, "DSP KCS result:\n");
+	for (i = 0; i < kcs_setup->get_len; i += 16) {
+		if (kcs_setup->get_len - i < 16)
+			break;
+		dev_dbg(component->dev,	"%02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x",
+			data[i], data[i+1], data[i+2], data[i+3],
+			data[i+4], data[i+5], data[i+6], data[i+7],
+			data[i+8], data[i+9], data[i+10], data[i+11],
+			data[i+12], data[i+13], data[i+14], data[i+15]);
+	}
+	count = 0;
+	for (; i < kcs_setup->get_len; i++)
+		count += sprintf(buf + count, "%02x ", data[i]);
+	dev_dbg(component->dev, "%s", buf);
+	dev_info(component->dev, "Get length %d of kcs_setup\n",
+		 kcs_setup->get_len);
+done:
+	kfree(data);
+}
+
 static int nau8310_dsp_get_kcs_setup_put(struct snd_kcontrol *kcontrol,
 					 struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	int ret, i, buf_off, buf_len, count;
-	char *data, buf[100];
-
-	data = kcalloc(nau8310->kcs_setup_size, sizeof(char), GFP_KERNEL);
-	if (!data)
-		return -ENOMEM;
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	int ret, buf_off, buf_len;
+	char *data;
 
 	if (nau8310->kcs_setup_size == 0) {
-		kfree(data);
 		ret = -EINVAL;
 		dev_err(component->dev, "KCS of DSP not load yet (%d)\n", ret);
 		return ret;
 	}
+	/* freed by the callback after the command finished */
+	data = kcalloc(nau8310->kcs_setup_size, sizeof(char), GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+
 	buf_off = 0;
 	buf_len = nau8310->kcs_setup_size;
-	dev_info(nau8310->dev, "Send DSP command %s (OFF %d, LEN %d)\n",
-		 dsp_cmd_table[NAU8310_DSP_CMD_GET_KCS_SETUP], buf_off, buf_len);
 	kcs_setup->set_kcs_offset = buf_off;
 	kcs_setup->get_len = kcs_setup->set_len = buf_len;
 	kcs_setup->get_data = data;
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_GET_KCS_SETUP, kcs_setup);
+	if (nau8310_kcs_shadow_read(nau8310, buf_off, buf_len, data)) {
+		dev_info(nau8310->dev, "KCS setup from shadow (OFF %d, LEN %d)\n",
+			 buf_off, buf_len);
+		nau8310_dsp_get_kcs_setup_done(component,
+			NAU8310_DSP_CMD_GET_KCS_SETUP, 0, kcs_setup);
+		return 0;
+	}
+	dev_info(nau8310->dev, "Send DSP command %s (OFF %d, LEN %d)\n",
+		 dsp_cmd_table[NAU8310_DSP_CMD_GET_KCS_SETUP], buf_off, buf_len);
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_GET_KCS_SETUP,
+					kcs_setup, nau8310_dsp_get_kcs_setup_done);
 	if (ret) {
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_GET_KCS_SETUP], ret);
-	} else {
-		dev_dbg(component->dev, "DSP KCS result:\n");
-		for (i = 0; i < kcs_setup->get_len; i += 16) {
-			dev_dbg(component->dev,	"%02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x %02x",
-				data[i], data[i+1], data[i+2], data[i+3],
-				data[i+4], data[i+5], data[i+6], data[i+7],
-				data[i+8], data[i+9], data[i+10], data[i+11],
-				data[i+12], data[i+13], data[i+14], data[i+15]);
-			if (kcs_setup->get_len - i < 16)
-				break;
-		}
-		count = 0;
-		for (; i < kcs_setup->get_len; i++)
-			count += sprintf(buf + count, "%02x ", data[i]);
-		dev_dbg(component->dev, "%s", buf);
-		dev_info(component->dev, "Get length %d of kcs_setup\n",
-			 kcs_setup->get_len);
+		/* not queued or coalesced with the pending one */
+		kfree(data);
+		if (ret < 0)
+			dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
+				dsp_cmd_table[NAU8310_DSP_CMD_GET_KCS_SETUP], ret);
 	}
-	kfree(data);
 
 	return 0;
 }
@@ -691,7 +1513,7 @@ static int nau8310_dsp_set_kcs_setup_put(struct snd_kcontrol *kcontrol,
 			snd_soc_kcontrol_component(kcontrol);
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 
-	nau8310_sw_reset_chip(nau8310->regmap);
+	nau8310_sw_reset_chip(nau8310);
 	/* wait for the power ready */
 	msleep(200);
 	regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
@@ -700,46 +1522,387 @@ static int nau8310_dsp_set_kcs_setup_put(struct snd_kcontrol *kcontrol,
 	return nau8310_dsp_set_kcs_setup(component, false);
 }
 
-static int nau8310_dsp_clk_restart_put(struct snd_kcontrol *kcontrol,
-				       struct snd_ctl_elem_value *ucontrol)
+/* The KCS patch is the TLV header, then a word of KCS offset and the data
+ * written there. Offset and length are word aligned and the range has to
+ * be within the KCS setup loaded.
+ */
+static int nau8310_dsp_kcs_patch_put(struct snd_kcontrol *kcontrol,
+				     const unsigned int __user *bytes,
+				     unsigned int size)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	const struct snd_ctl_tlv __user *tlv =
+			(const struct snd_ctl_tlv __user *)bytes;
+	struct snd_ctl_tlv header;
+	unsigned int offset, len;
+	void *data;
 	int ret;
 
-	dev_info(component->dev, "Send DSP command %s\n",
-		 dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART]);
+	if (nau8310->kcs_setup_size == 0)
+		return -EINVAL;
+	if (size < sizeof(header) + sizeof(offset))
+		return -EINVAL;
+	if (copy_from_user(&header, tlv, sizeof(header)))
+		return -EFAULT;
+	if (header.length < sizeof(offset) ||
+		header.length > size - sizeof(header))
+		return -EINVAL;
+	if (copy_from_user(&offset, tlv->tlv, sizeof(offset)))
+		return -EFAULT;
+	len = header.length - sizeof(offset);
+	if (!len || !IS_ALIGNED(offset, NAU8310_DSP_DATA_BYTE) ||
+		!IS_ALIGNED(len, NAU8310_DSP_DATA_BYTE) ||
+		offset > nau8310->kcs_setup_size ||
+		len > nau8310->kcs_setup_size - offset) {
+		dev_err(component->dev, "KCS patch out of setup (OFF %u, LEN %u)\n",
+			offset, len);
+		return -EINVAL;
+	}
 
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_CLK_RESTART, kcs_setup);
+	data = memdup_user(&tlv->tlv[1], len);
+	if (IS_ERR(data))
+		return PTR_ERR(data);
+
+	dev_dbg(component->dev, "Send DSP command %s (OFF %u, LEN %u)\n",
+		dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP], offset, len);
+	ret = nau8310_dsp_kcs_setup(component, offset, len, data);
+	kfree(data);
 	if (ret)
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART], ret);
+		return ret;
+	nau8310->kcs_patch_off = offset;
+	nau8310->kcs_patch_len = len;
 
 	return 0;
 }
 
-static int nau8310_dsp_clk_stop_put(struct snd_kcontrol *kcontrol,
+/* read back the range of the last patch, in the format of put, from the
+ * KCS shadow or from DSP if verified
+ */
+static int nau8310_dsp_kcs_patch_get(struct snd_kcontrol *kcontrol,
+				     unsigned int __user *bytes,
+				     unsigned int size)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	struct snd_ctl_tlv __user *tlv = (struct snd_ctl_tlv __user *)bytes;
+	struct snd_ctl_tlv header;
+	unsigned int offset = nau8310->kcs_patch_off;
+	unsigned int len = nau8310->kcs_patch_len;
+	void *data;
+	int ret;
+
+	if (size < sizeof(header) + sizeof(offset) + len)
+		return -ENOSPC;
+	header.numid = kcontrol->id.numid;
+	header.length = sizeof(offset) + len;
+	if (copy_to_user(tlv, &header, sizeof(header)) ||
+		copy_to_user(tlv->tlv, &offset, sizeof(offset)))
+		return -EFAULT;
+	if (!len)
+		return 0;
+
+	data = kmalloc(len, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+	if (nau8310_kcs_shadow_read(nau8310, offset, len, data)) {
+		ret = 0;
+		goto copy;
+	}
+	kcs_setup->set_kcs_offset = offset;
+	kcs_setup->get_len = kcs_setup->set_len = len;
+	kcs_setup->get_data = data;
+	ret = nau8310_send_dsp_command(component, NAU8310_DSP_CMD_GET_KCS_SETUP,
+				       kcs_setup);
+	if (!ret)
+		nau8310_kcs_shadow_check(nau8310, offset, len, data);
+copy:
+	if (!ret && copy_to_user(&tlv->tlv[1], data, len))
+		ret = -EFAULT;
+	kfree(data);
+
+	return ret;
+}
+
+static void nau8310_dsp_cmd_done(struct snd_soc_component *component,
+				 int cmd_id, int ret,
+				 struct nau8310_kcs_setup *kcs_setup)
+{
+	if (ret)
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[cmd_id], ret);
+}
+
+static int nau8310_dsp_clk_restart_put(struct snd_kcontrol *kcontrol,
+				       struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	int ret;
+
+	dev_info(component->dev, "Send DSP command %s\n",
+		 dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART]);
+
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_CLK_RESTART,
+					kcs_setup, nau8310_dsp_cmd_done);
+	if (ret < 0)
+		dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
+			dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART], ret);
+
+	return 0;
+}
+
+static int nau8310_dsp_clk_stop_put(struct snd_kcontrol *kcontrol,
 				    struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
 	int ret;
 
 	dev_info(component->dev, "Send DSP command %s\n",
 		 dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP]);
 
-	ret = nau8310_send_dsp_command(component,
-				       NAU8310_DSP_CMD_CLK_STOP, kcs_setup);
-	if (ret)
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+	ret = nau8310_dsp_queue_command(component, NAU8310_DSP_CMD_CLK_STOP,
+					kcs_setup, nau8310_dsp_cmd_done);
+	if (ret < 0)
+		dev_err(component->dev, "Queue DSP command %s fail (%d)\n",
 			dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP], ret);
 
 	return 0;
 }
 
+/* The KCS profiles of DSP, the first one is the firmware loaded at probe */
+static const char * const nau8310_dsp_profile_texts[NAU8310_DSP_PROFILE_NUM] = {
+	"Music", "Voice" };
+
+static const char * const nau8310_dsp_profile_fw[NAU8310_DSP_PROFILE_NUM] = {
+	NAU8310_DSP_FIRMWARE, NAU8310_DSP_FIRMWARE_VOICE };
+
+static const struct soc_enum nau8310_dsp_profile_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8310_dsp_profile_texts),
+			    nau8310_dsp_profile_texts);
+
+static int nau8310_dsp_profile_get(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8310->dsp_profile;
+
+	return 0;
+}
+
+static int nau8310_dsp_profile_put(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	unsigned int id = ucontrol->value.enumerated.item[0];
+	int ret;
+
+	if (id >= NAU8310_DSP_PROFILE_NUM)
+		return -EINVAL;
+	if (id == nau8310->dsp_profile)
+		return 0;
+
+	ret = nau8310_dsp_profile_switch(component, id);
+	if (ret)
+		return ret;
+
+	return 1;
+}
+
+static int nau8310_dsp_kcs_check_get(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->kcs_check_interval;
+
+	return 0;
+}
+
+static int nau8310_dsp_kcs_check_put(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	long interval = ucontrol->value.integer.value[0];
+
+	if (interval < 0 || interval > NAU8310_DSP_KCS_CHECK_MAX)
+		return -EINVAL;
+	if (interval == nau8310->kcs_check_interval)
+		return 0;
+
+	/* taken by the next upload */
+	WRITE_ONCE(nau8310->kcs_check_interval, interval);
+
+	return 1;
+}
+
+static int nau8310_dsp_kcs_verify_get(struct snd_kcontrol *kcontrol,
+				      struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->kcs_verify;
+
+	return 0;
+}
+
+static int nau8310_dsp_kcs_verify_put(struct snd_kcontrol *kcontrol,
+				      struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	bool verify = !!ucontrol->value.integer.value[0];
+
+	if (verify == nau8310->kcs_verify)
+		return 0;
+	WRITE_ONCE(nau8310->kcs_verify, verify);
+
+	return 1;
+}
+
+static int nau8310_dsp_monitor_period_get(struct snd_kcontrol *kcontrol,
+					  struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->dsp_mon.period_ms;
+
+	return 0;
+}
+
+static int nau8310_dsp_monitor_period_put(struct snd_kcontrol *kcontrol,
+					  struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_monitor *mon = &nau8310->dsp_mon;
+	long period = ucontrol->value.integer.value[0];
+
+	if (period < 0 || period > NAU8310_DSP_MON_PERIOD_MAX)
+		return -EINVAL;
+	if (period == mon->period_ms)
+		return 0;
+
+	nau8310_dsp_monitor_stop(nau8310);
+	mon->component = component;
+	WRITE_ONCE(mon->period_ms, period);
+	nau8310_dsp_monitor_start(nau8310);
+
+	return 1;
+}
+
+/* the samples of the monitor from the oldest, without the mailbox */
+static int nau8310_dsp_monitor_get(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_monitor *mon = &nau8310->dsp_mon;
+	struct nau8310_dsp_sample *samples =
+			(struct nau8310_dsp_sample *)ucontrol->value.bytes.data;
+	unsigned int i, num, first;
+
+	spin_lock(&mon->lock);
+	num = min_t(unsigned int, mon->head, NAU8310_DSP_MON_LEN);
+	first = mon->head - num;
+	for (i = 0; i < num; i++)
+		samples[i] = mon->ring[(first + i) % NAU8310_DSP_MON_LEN];
+	spin_unlock(&mon->lock);
+
+	return 0;
+}
+
+static int nau8310_dsp_stats_info(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = NAU8310_DSP_STATS_NUM;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = INT_MAX;
+
+	return 0;
+}
+
+static int nau8310_dsp_revision_info(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = 1;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = INT_MAX;
+
+	return 0;
+}
+
+/* the revision cached at the first load, 0 if not known */
+static int nau8310_dsp_revision_get(struct snd_kcontrol *kcontrol,
+				    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->dsp_revision_valid ?
+		nau8310->dsp_revision : 0;
+
+	return 0;
+}
+
+/* commands, idle polls, reply polls, max reply polls, timeouts, irq replies,
+ * transfers, KCS bytes, framing errors, KCS rewinds, yields to priority,
+ * resyncs by a drain, resyncs by a chip reset, failed messages, failed
+ * replies
+ */
+static int nau8310_dsp_stats_get(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_stats *stats = &nau8310->dsp_stats;
+	long *val = ucontrol->value.integer.value;
+
+	val[0] = stats->commands;
+	val[1] = stats->idle_polls;
+	val[2] = stats->reply_polls;
+	val[3] = stats->max_reply_polls;
+	val[4] = stats->timeouts;
+	val[5] = stats->irq_replies;
+	val[6] = stats->transfers;
+	val[7] = stats->bytes;
+	val[8] = stats->proto_errors;
+	val[9] = stats->kcs_rewinds;
+	val[10] = stats->prio_yields;
+	val[11] = stats->resyncs;
+	val[12] = stats->resets;
+	val[13] = stats->send_errors;
+	val[14] = stats->reply_errors;
+
+	return 0;
+}
+
 int nau8310_dsp_cmd_get(struct snd_kcontrol *kcontrol,
 			struct snd_ctl_elem_value *ucontrol)
 {
@@ -759,12 +1922,134 @@ static const struct snd_kcontrol_new nau8310_dsp_snd_controls[] = {
 		       nau8310_dsp_cmd_get, nau8310_dsp_get_kcs_setup_put),
 	SOC_SINGLE_EXT("DSP set KCS setup command", SND_SOC_NOPM, 0, 1, 0,
 		       nau8310_dsp_cmd_get, nau8310_dsp_set_kcs_setup_put),
+	SOC_ENUM_EXT("DSP Profile", nau8310_dsp_profile_enum,
+		     nau8310_dsp_profile_get, nau8310_dsp_profile_put),
+	SND_SOC_BYTES_TLV("DSP KCS Patch", sizeof(struct snd_ctl_tlv) +
+			  NAU8310_DSP_DATA_BYTE + NAU8310_DSP_KCS_PATCH_MAX,
+			  nau8310_dsp_kcs_patch_get, nau8310_dsp_kcs_patch_put),
 	SOC_SINGLE_EXT("DSP clock restart command", SND_SOC_NOPM, 0, 1, 0,
 		       nau8310_dsp_cmd_get, nau8310_dsp_clk_restart_put),
 	SOC_SINGLE_EXT("DSP clock stop command", SND_SOC_NOPM, 0, 1, 0,
 		       nau8310_dsp_cmd_get, nau8310_dsp_clk_stop_put),
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "DSP Mailbox Statistics",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = nau8310_dsp_stats_info,
+		.get = nau8310_dsp_stats_get,
+	},
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "DSP Revision",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = nau8310_dsp_revision_info,
+		.get = nau8310_dsp_revision_get,
+	},
+	SOC_SINGLE_EXT("DSP KCS Check Interval", SND_SOC_NOPM, 0,
+		       NAU8310_DSP_KCS_CHECK_MAX, 0,
+		       nau8310_dsp_kcs_check_get, nau8310_dsp_kcs_check_put),
+	SOC_SINGLE_BOOL_EXT("DSP KCS Verify Switch", 0,
+			    nau8310_dsp_kcs_verify_get, nau8310_dsp_kcs_verify_put),
+	SOC_SINGLE_EXT("DSP Monitor Period", SND_SOC_NOPM, 0,
+		       NAU8310_DSP_MON_PERIOD_MAX, 0,
+		       nau8310_dsp_monitor_period_get,
+		       nau8310_dsp_monitor_period_put),
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "DSP Monitor Samples",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = snd_soc_bytes_info_ext,
+		.get = nau8310_dsp_monitor_get,
+		.private_value = (unsigned long)&(struct soc_bytes_ext) {
+			.max = sizeof(struct nau8310_dsp_sample) *
+				NAU8310_DSP_MON_LEN,
+		},
+	},
 };
 
+/* The switch to the DSP path runs out of the control. The amplifier stays
+ * in bypass while the DSP powers up and loads the KCS setup, and the route
+ * flips to DSP once it's ready. Turning the switch off meanwhile aborts the
+ * bring-up at the next step.
+ */
+static void nau8310_dsp_switch_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, dsp_switch_work);
+	struct snd_soc_component *component =
+		snd_soc_dapm_to_component(nau8310->dapm);
+	struct snd_kcontrol *kcontrol = nau8310->dsp_switch_kctl;
+	struct snd_ctl_elem_value *ucontrol;
+	int ret = 0;
+
+	mutex_lock(&nau8310->dsp_switch_lock);
+	if (!nau8310->dsp_switch_target)
+		goto abort;
+	nau8310->dsp_switch_state = NAU8310_DSP_SW_POWER_UP;
+	mutex_unlock(&nau8310->dsp_switch_lock);
+
+	nau8310_sw_reset_chip(nau8310);
+	/* wait for the power ready */
+	msleep(200);
+
+	mutex_lock(&nau8310->dsp_switch_lock);
+	if (!nau8310->dsp_switch_target)
+		goto abort;
+	nau8310->dsp_switch_state = NAU8310_DSP_SW_LOADING;
+	mutex_unlock(&nau8310->dsp_switch_lock);
+
+	regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
+			   NAU8310_DSP_RUNSTALL, 0);
+	ret = nau8310_dsp_set_kcs_setup(component, false);
+
+	ucontrol = kzalloc(sizeof(*ucontrol), GFP_KERNEL);
+	if (!ret && !ucontrol)
+		ret = -ENOMEM;
+
+	mutex_lock(&nau8310->dsp_switch_lock);
+	if (!nau8310->dsp_switch_target)
+		goto abort_free;
+	if (!ret) {
+		ucontrol->value.integer.value[0] = 1;
+		ret = snd_soc_dapm_put_volsw(kcontrol, ucontrol);
+		ret = ret < 0 ? ret : 0;
+	}
+	if (ret) {
+		dev_warn(nau8310->dev, "Can't enable DSP, so enable bypass mode\n");
+		nau8310->dsp_switch_target = false;
+		snd_ctl_notify(component->card->snd_card,
+			       SNDRV_CTL_EVENT_MASK_VALUE, &kcontrol->id);
+	}
+abort_free:
+	kfree(ucontrol);
+abort:
+	nau8310->dsp_switch_state = NAU8310_DSP_SW_IDLE;
+	mutex_unlock(&nau8310->dsp_switch_lock);
+}
+
+static int nau8310_dsp_snd_soc_dapm_get(struct snd_kcontrol *kcontrol,
+					struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_dapm_context *dapm =
+			snd_soc_dapm_kcontrol_dapm(kcontrol);
+	struct snd_soc_component *component = snd_soc_dapm_to_component(dapm);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret = 0;
+
+	/* the switch in progress reads as turned on */
+	mutex_lock(&nau8310->dsp_switch_lock);
+	if (nau8310->dsp_switch_state != NAU8310_DSP_SW_IDLE)
+		ucontrol->value.integer.value[0] = nau8310->dsp_switch_target;
+	else
+		ret = snd_soc_dapm_get_volsw(kcontrol, ucontrol);
+	mutex_unlock(&nau8310->dsp_switch_lock);
+
+	return ret;
+}
+
 static int nau8310_dsp_snd_soc_dapm_put(struct snd_kcontrol *kcontrol,
 					struct snd_ctl_elem_value *ucontrol)
 {
@@ -778,8 +2063,9 @@ static int nau8310_dsp_snd_soc_dapm_put(struct snd_kcontrol *kcontrol,
 	unsigned int shift = mc->shift;
 	int max = mc->max;
 	unsigned int mask = (1 << fls(max)) - 1;
-	unsigned int val, orig, tmp;
-	int connect, ret;
+	unsigned int orig;
+	bool connect, pending;
+	int ret, err;
 
 	ret = regmap_read(nau8310->regmap, reg, &orig);
 	if (ret) {
@@ -787,125 +2073,662 @@ static int nau8310_dsp_snd_soc_dapm_put(struct snd_kcontrol *kcontrol,
 		return ret;
 	}
 
-	val = (ucontrol->value.integer.value[0] & mask);
-	connect = !!val;
-	mask = mask << shift;
-	val = val << shift;
-	tmp = orig & ~mask;
-	tmp |= val & mask;
-	if (tmp != orig && connect) {
-		nau8310_sw_reset_chip(nau8310->regmap);
-		/* wait for the power ready */
-		msleep(200);
-		regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
-				   NAU8310_DSP_RUNSTALL, 0);
-		ret = nau8310_dsp_set_kcs_setup(component, false);
-		if (ret)
+	connect = !!(ucontrol->value.integer.value[0] & mask);
+	mutex_lock(&nau8310->dsp_switch_lock);
+	pending = nau8310->dsp_switch_state != NAU8310_DSP_SW_IDLE;
+	if (pending) {
+		/* the work picks up the change at its next step */
+		ret = nau8310->dsp_switch_target != connect;
+		nau8310->dsp_switch_target = connect;
+		if (connect)
+			goto unlock;
+	} else if (connect && !((orig >> shift) & mask)) {
+		nau8310->dsp_switch_kctl = kcontrol;
+		nau8310->dsp_switch_target = true;
+		nau8310->dsp_switch_state = NAU8310_DSP_SW_QUEUED;
+		queue_work(system_unbound_wq, &nau8310->dsp_switch_work);
+		ret = 1;
+		goto unlock;
+	}
+	/* the path stays in bypass until the switch is done */
+	err = snd_soc_dapm_put_volsw(kcontrol, ucontrol);
+	ret = err < 0 ? err : (err || ret);
+unlock:
+	mutex_unlock(&nau8310->dsp_switch_lock);
+
+	return ret;
+}
+
+#define NAU8310_DSP_SOC_DAPM_SINGLE(xname, reg, shift, mask, invert) \
+	SOC_SINGLE_EXT(xname, reg, shift, mask, invert, \
+		       nau8310_dsp_snd_soc_dapm_get, \
+		       nau8310_dsp_snd_soc_dapm_put)
+
+static const struct snd_kcontrol_new nau8310_dacdat_select_dsp =
+	NAU8310_DSP_SOC_DAPM_SINGLE("Switch", NAU8310_R1A_DSP_CORE_CTRL2,
+				    NAU8310_DAC_SEL_DSP_SFT, 1, 0);
+
+static void nau8310_dsp_clk_stop(struct nau8310 *nau8310)
+{
+	struct snd_soc_component *component;
+	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	int ret;
+
+	if (!nau8310->dsp_clk_on || !nau8310->dapm)
+		return;
+	component = snd_soc_dapm_to_component(nau8310->dapm);
+	dev_dbg(component->dev, "Send DSP command %s\n",
+		dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP]);
+	ret = nau8310_send_dsp_command(component,
+				       NAU8310_DSP_CMD_CLK_STOP, kcs_setup);
+	if (ret)
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP], ret);
+	nau8310->dsp_clk_on = false;
+}
+
+/* The DSP clock stops at the end of its window after the power down */
+static void nau8310_dsp_clk_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, dsp_clk_work.work);
+
+	nau8310_dsp_clk_stop(nau8310);
+}
+
+/* Stop the DSP clock now if its window is still open, before suspend */
+void nau8310_dsp_clk_flush(struct nau8310 *nau8310)
+{
+	if (cancel_delayed_work_sync(&nau8310->dsp_clk_work))
+		nau8310_dsp_clk_stop(nau8310);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_clk_flush);
+
+static int nau8310_dsp_clock_event(struct snd_soc_dapm_widget *w,
+				   struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component =
+			snd_soc_dapm_to_component(w->dapm);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	int ret;
+
+	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		/* the clock still runs if the stop is pending in its window */
+		cancel_delayed_work_sync(&nau8310->dsp_clk_work);
+		if (nau8310->dsp_clk_on) {
+			nau8310->dsp_clk_skips++;
+		} else {
+			dev_dbg(component->dev, "Send DSP command %s\n",
+				dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART]);
+			ret = nau8310_send_dsp_command(component,
+					NAU8310_DSP_CMD_CLK_RESTART, kcs_setup);
+			if (ret)
+				dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+					dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART],
+					ret);
+			else
+				nau8310->dsp_clk_on = true;
+		}
+		/* Switch the clock source of DSP to MCLK, if it clocks DSP. */
+		if (!nau8310_dsp_on_osc(nau8310))
+			regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
+					   NAU8310_DSP_SEL_OSC, 0);
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		if (nau8310->dsp_clk_grace_ms)
+			queue_delayed_work(nau8310->dsp_wq,
+				&nau8310->dsp_clk_work,
+				msecs_to_jiffies(nau8310->dsp_clk_grace_ms));
+		else
+			nau8310_dsp_clk_stop(nau8310);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static const struct snd_soc_dapm_widget nau8310_dsp_dapm_widgets[] = {
+	SND_SOC_DAPM_PGA("DSP", SND_SOC_NOPM, 0, 0, NULL, 0),
+	SND_SOC_DAPM_SWITCH("DAC data from DSP", SND_SOC_NOPM,
+			    0, 0, &nau8310_dacdat_select_dsp),
+	SND_SOC_DAPM_SUPPLY("DSP Clock", SND_SOC_NOPM, 0, 0,
+			    nau8310_dsp_clock_event, SND_SOC_DAPM_PRE_PMU |
+			    SND_SOC_DAPM_POST_PMD),
+};
+
+static const struct snd_soc_dapm_route nau8310_dsp_dapm_routes[] = {
+	{ "DSP", NULL, "Capture Sense" },
+	{ "DAC data from DSP", "Switch", "DSP" },
+	{ "DAC", NULL, "DAC data from DSP" },
+	{ "DSP", NULL, "DSP Clock" },
+};
+
+/*
+ * Firmware shared by all amplifiers of the module. The entries are
+ * keyed by firmware name and freed when the last user puts it. The KCS
+ * image of a firmware is parsed once, as it enters the cache.
+ */
+struct nau8310_fw_entry {
+	struct list_head list;
+	const char *name;
+	const struct firmware *fw;
+	struct nau8310_kcs_image image;
+	unsigned int users;
+};
+
+static LIST_HEAD(nau8310_fw_list);
+static DEFINE_MUTEX(nau8310_fw_lock);
+
+static struct nau8310_fw_entry *nau8310_dsp_fw_find(const char *name)
+{
+	struct nau8310_fw_entry *entry;
+
+	list_for_each_entry(entry, &nau8310_fw_list, list)
+		if (!strcmp(entry->name, name))
+			return entry;
+
+	return NULL;
+}
+
+static struct nau8310_fw_entry *nau8310_dsp_fw_find_fw(const struct firmware *fw)
+{
+	struct nau8310_fw_entry *entry;
+
+	list_for_each_entry(entry, &nau8310_fw_list, list)
+		if (entry->fw == fw)
+			return entry;
+
+	return NULL;
+}
+
+/* the profile a plain KCS setup belongs to, by the name of its file */
+static int nau8310_dsp_fw_profile(const char *name)
+{
+	int i;
+
+	for (i = 0; i < NAU8310_DSP_PROFILE_NUM; i++)
+		if (!strcmp(nau8310_dsp_profile_fw[i], name))
+			return i;
+
+	return 0;
+}
+
+static u32 nau8310_dsp_crc(const void *data, size_t size)
+{
+	return ~crc32_le(~0, data, size);
+}
+
+static void nau8310_kcs_image_free(struct nau8310_kcs_image *img)
+{
+	int i;
+
+	for (i = 0; i < img->num; i++) {
+		kfree(img->sect[i].raw);
+		img->sect[i].raw = NULL;
+	}
+}
+
+/* Decompress the LZ4 block of a section, of @raw_size bytes as sent */
+static int nau8310_kcs_section_inflate(struct nau8310_kcs_section *sect,
+				       u32 raw_size)
+{
+	int ret;
+
+	if (raw_size > NAU8310_DSP_KCS_SHADOW_LEN)
+		return -EINVAL;
+	sect->raw = kmalloc(raw_size, GFP_KERNEL);
+	if (!sect->raw)
+		return -ENOMEM;
+	ret = LZ4_decompress_safe(sect->data, sect->raw, sect->size, raw_size);
+	if (ret != raw_size ||
+		nau8310_dsp_crc(sect->raw, raw_size) != sect->crc)
+		return -EBADMSG;
+	sect->data = sect->raw;
+	sect->size = raw_size;
+
+	return 0;
+}
+
+/* Index the sections of a firmware container, or take a file without the
+ * magic as one KCS setup of @profile from offset 0. The sections stored
+ * compressed are decompressed, and nau8310_kcs_image_free() frees them.
+ */
+static int nau8310_dsp_fw_parse(const struct firmware *fw, int profile,
+				struct nau8310_kcs_image *img)
+{
+	const struct nau8310_fw_header *hdr = (const void *)fw->data;
+	const struct nau8310_fw_section_desc *desc;
+	struct nau8310_kcs_section *sect;
+	size_t desc_size;
+	u32 off, size, raw_size;
+	int i, num, ver, ret;
+
+	if (fw->size < sizeof(*hdr) ||
+		le32_to_cpu(hdr->magic) != NAU8310_DSP_FW_MAGIC) {
+		if (!fw->size)
 			return -EINVAL;
+		sect = &img->sect[0];
+		sect->profile = profile;
+		sect->kcs_offset = 0;
+		sect->data = fw->data;
+		sect->size = fw->size;
+		sect->crc = nau8310_dsp_crc(fw->data, fw->size);
+		img->num = 1;
+		return 0;
+	}
+
+	num = le16_to_cpu(hdr->num_sections);
+	ver = le16_to_cpu(hdr->version);
+	if (ver == NAU8310_DSP_FW_VERSION)
+		desc_size = sizeof(struct nau8310_fw_section_desc);
+	else if (ver == NAU8310_DSP_FW_VERSION_LZ4)
+		desc_size = sizeof(struct nau8310_fw_section_desc_lz4);
+	else
+		return -EINVAL;
+	if (le32_to_cpu(hdr->size) != fw->size || !num ||
+		num > NAU8310_DSP_FW_SECT_MAX ||
+		fw->size < sizeof(*hdr) + num * desc_size)
+		return -EINVAL;
+	/* the CRC of the header covers the section table and the data */
+	if (nau8310_dsp_crc(hdr + 1, fw->size - sizeof(*hdr)) !=
+		le32_to_cpu(hdr->crc))
+		return -EBADMSG;
+
+	for (i = 0; i < num; i++) {
+		desc = (const void *)((const u8 *)(hdr + 1) + i * desc_size);
+		sect = &img->sect[i];
+		off = le32_to_cpu(desc->offset);
+		size = le32_to_cpu(desc->size);
+		sect->profile = le16_to_cpu(desc->profile);
+		sect->kcs_offset = le16_to_cpu(desc->kcs_offset);
+		if (off > fw->size || !size || size > fw->size - off ||
+			sect->kcs_offset > NAU8310_DSP_KCS_OFFSET_MAX ||
+			sect->profile >= NAU8310_DSP_PROFILE_NUM) {
+			ret = -EINVAL;
+			goto err;
+		}
+		sect->data = fw->data + off;
+		sect->size = size;
+		sect->crc = le32_to_cpu(desc->crc);
+		sect->raw = NULL;
+		img->num = i + 1;
+		if (ver != NAU8310_DSP_FW_VERSION_LZ4)
+			continue;
+		raw_size = le32_to_cpu(((const struct nau8310_fw_section_desc_lz4 *)
+					desc)->raw_size);
+		if (raw_size) {
+			ret = nau8310_kcs_section_inflate(sect, raw_size);
+			if (ret)
+				goto err;
+		}
+	}
+
+	return 0;
+err:
+	nau8310_kcs_image_free(img);
+	return ret;
+}
+
+/* The caller has to hold nau8310_fw_lock. */
+static const struct firmware *__nau8310_dsp_fw_add(const char *name,
+						     const struct firmware *fw)
+{
+	struct nau8310_fw_entry *entry;
+	int ret;
+
+	entry = nau8310_dsp_fw_find(name);
+	if (entry) {
+		release_firmware(fw);
+		goto done;
+	}
+	entry = kzalloc(sizeof(*entry), GFP_KERNEL);
+	if (!entry) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	ret = nau8310_dsp_fw_parse(fw, nau8310_dsp_fw_profile(name),
+				   &entry->image);
+	if (ret) {
+		kfree(entry);
+		goto err;
+	}
+	entry->name = name;
+	entry->fw = fw;
+	list_add(&entry->list, &nau8310_fw_list);
+done:
+	entry->users++;
+
+	return entry->fw;
+err:
+	release_firmware(fw);
+	return ERR_PTR(ret);
+}
+
+/**
+ * nau8310_dsp_fw_add - Put firmware into the shared cache
+ *
+ * @name: name of firmware
+ * @fw: firmware loaded by caller, its ownership is passed to the cache
+ *
+ * Return the cached firmware with one reference for the caller. If the
+ * same name is cached already, the firmware given is released and the
+ * cached one is returned. Return an error pointer if the firmware isn't
+ * a valid KCS image, which is released too.
+ */
+static const struct firmware *nau8310_dsp_fw_add(const char *name,
+						   const struct firmware *fw)
+{
+	mutex_lock(&nau8310_fw_lock);
+	fw = __nau8310_dsp_fw_add(name, fw);
+	mutex_unlock(&nau8310_fw_lock);
+
+	return fw;
+}
+
+/* The first user loads the firmware, and the others wait and share it. */
+static int nau8310_dsp_fw_get(struct device *dev, const char *name,
+			      const struct firmware **fw)
+{
+	struct nau8310_fw_entry *entry;
+	int ret = 0;
+
+	mutex_lock(&nau8310_fw_lock);
+	entry = nau8310_dsp_fw_find(name);
+	if (entry) {
+		entry->users++;
+		*fw = entry->fw;
+		dev_dbg(dev, "Share firmware %s (users %u)\n", name, entry->users);
+		goto done;
+	}
+	ret = request_firmware(fw, name, dev);
+	if (ret)
+		goto done;
+	*fw = __nau8310_dsp_fw_add(name, *fw);
+	if (IS_ERR(*fw)) {
+		ret = PTR_ERR(*fw);
+		*fw = NULL;
+		dev_err(dev, "Invalid KCS firmware %s (%d)\n", name, ret);
+	}
+done:
+	mutex_unlock(&nau8310_fw_lock);
+
+	return ret;
+}
+
+/* one more reference to a firmware the caller holds */
+static void nau8310_dsp_fw_hold(const struct firmware *fw)
+{
+	struct nau8310_fw_entry *entry;
+
+	mutex_lock(&nau8310_fw_lock);
+	entry = nau8310_dsp_fw_find_fw(fw);
+	if (entry)
+		entry->users++;
+	mutex_unlock(&nau8310_fw_lock);
+}
+
+/* the KCS image of a firmware the caller holds */
+static const struct nau8310_kcs_image *
+nau8310_dsp_fw_image(const struct firmware *fw)
+{
+	struct nau8310_fw_entry *entry;
+
+	mutex_lock(&nau8310_fw_lock);
+	entry = nau8310_dsp_fw_find_fw(fw);
+	mutex_unlock(&nau8310_fw_lock);
+
+	return entry ? &entry->image : NULL;
+}
+
+static void nau8310_dsp_fw_put(const struct firmware *fw)
+{
+	struct nau8310_fw_entry *entry;
+
+	if (!fw)
+		return;
+
+	mutex_lock(&nau8310_fw_lock);
+	entry = nau8310_dsp_fw_find_fw(fw);
+	if (!entry) {
+		release_firmware(fw);
+	} else if (!--entry->users) {
+		list_del(&entry->list);
+		nau8310_kcs_image_free(&entry->image);
+		release_firmware(entry->fw);
+		kfree(entry);
+	}
+	mutex_unlock(&nau8310_fw_lock);
+}
+
+static bool nau8310_kcs_image_has(const struct nau8310_kcs_image *img,
+				  int profile)
+{
+	int i;
+
+	for (i = 0; img && i < img->num; i++)
+		if (img->sect[i].profile == profile)
+			return true;
+
+	return false;
+}
+
+/* bytes of KCS setup up to the end of the last section of @profile */
+static int nau8310_kcs_image_size(const struct nau8310_kcs_image *img,
+				  int profile)
+{
+	const struct nau8310_kcs_section *sect;
+	int i, size = 0;
+
+	for (i = 0; i < img->num; i++) {
+		sect = &img->sect[i];
+		if (sect->profile == profile)
+			size = max(size, sect->kcs_offset + sect->size);
+	}
+
+	return size;
+}
+
+static const struct nau8310_kcs_section *
+nau8310_kcs_image_find(const struct nau8310_kcs_image *img, int profile,
+		       int kcs_offset, int size)
+{
+	const struct nau8310_kcs_section *sect;
+	int i;
+
+	for (i = 0; i < img->num; i++) {
+		sect = &img->sect[i];
+		if (sect->profile == profile && sect->kcs_offset == kcs_offset &&
+			sect->size == size)
+			return sect;
+	}
+
+	return NULL;
+}
+
+/* keep KCS setup loaded for the delta reload on resume, fw reference
+ * is passed to the device.
+ */
+static void nau8310_dsp_kcs_cache(struct nau8310 *nau8310,
+				  const struct firmware *fw, int profile)
+{
+	nau8310->dsp_profile = profile;
+	if (nau8310->kcs_fw == fw) {
+		nau8310_dsp_fw_put(fw);
+		return;
+	}
+	nau8310_dsp_fw_put(nau8310->kcs_fw);
+	nau8310->kcs_fw = fw;
+}
+
+/* Send the runs of NAU8310_DSP_KCS_TX_MAX bytes chunks of @data which
+ * differ from @old, or every chunk without @old, to the KCS setup from
+ * @base. The output is soft muted before the first chunk sent, and left
+ * to the caller to unmute. Return the bytes sent or a negative error code.
+ */
+static int nau8310_dsp_kcs_send_diff(struct snd_soc_component *component,
+				     int base, const u8 *old, const u8 *data,
+				     int size, bool *muted)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret = 0, off, end, len, run_off = -1, sent = 0, diff = 0;
+
+	/* one step past the last chunk, which sends the run pending */
+	for (off = 0; off < size + NAU8310_DSP_KCS_TX_MAX;
+	     off += NAU8310_DSP_KCS_TX_MAX) {
+		end = min(off + NAU8310_DSP_KCS_TX_MAX, size);
+		if (off < size && (!old ||
+			memcmp(old + off, data + off, end - off))) {
+			if (run_off < 0)
+				run_off = off;
+			diff += end - off;
+			continue;
+		}
+		if (run_off < 0)
+			continue;
+		if (!*muted) {
+			regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
+					   NAU8310_SOFT_MUTE, NAU8310_SOFT_MUTE);
+			*muted = true;
+		}
+		len = min(off, size) - run_off;
+		dev_dbg(component->dev, "Send DSP command %s (OFF %d, LEN %d)\n",
+			dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP],
+			base + run_off, len);
+		ret = nau8310_dsp_kcs_setup(component, base + run_off, len,
+					    data + run_off);
+		if (ret) {
+			dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+				dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP], ret);
+			break;
+		}
+		sent += len;
+		run_off = -1;
+	}
+	if (ret)
+		return ret;
+	/* every chunk which differs is in a run sent */
+	if (sent != diff) {
+		dev_err(component->dev, "KCS setup sent %d of %d bytes\n",
+			sent, diff);
+		return -EIO;
+	}
+
+	return sent;
+}
+
+static void nau8310_dsp_kcs_unmute(struct nau8310 *nau8310, bool muted)
+{
+	if (muted)
+		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
+				   NAU8310_SOFT_MUTE, 0);
+}
+
+/**
+ * nau8310_dsp_kcs_send_image - Send the sections of a KCS profile
+ *
+ * @component:  component to register
+ * @img: image holding the profile
+ * @profile: profile to send
+ * @cur: image applied to DSP, or NULL to send every section
+ * @cur_profile: profile of @cur applied
+ *
+ * A section with the same CRC as the one applied at its offset is
+ * skipped, and one of the same length is sent by the chunks which differ,
+ * all under one soft mute. Return the bytes sent or a negative error code.
+ */
+static int nau8310_dsp_kcs_send_image(struct snd_soc_component *component,
+				      const struct nau8310_kcs_image *img,
+				      int profile,
+				      const struct nau8310_kcs_image *cur,
+				      int cur_profile)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	const struct nau8310_kcs_section *sect, *old;
+	bool muted = false;
+	int i, ret = 0, sent = 0;
+
+	for (i = 0; i < img->num; i++) {
+		sect = &img->sect[i];
+		if (sect->profile != profile)
+			continue;
+		old = cur ? nau8310_kcs_image_find(cur, cur_profile,
+				sect->kcs_offset, sect->size) : NULL;
+		if (old && old->crc == sect->crc)
+			continue;
+		ret = nau8310_dsp_kcs_send_diff(component, sect->kcs_offset,
+						old ? old->data : NULL,
+						sect->data, sect->size, &muted);
+		if (ret < 0)
+			break;
+		sent += ret;
 	}
+	nau8310_dsp_kcs_unmute(nau8310, muted);
 
-	return snd_soc_dapm_put_volsw(kcontrol, ucontrol);
+	return ret < 0 ? ret : sent;
 }
 
-#define NAU8310_DSP_SOC_DAPM_SINGLE(xname, reg, shift, mask, invert) \
-	SOC_SINGLE_EXT(xname, reg, shift, mask, invert, \
-		       snd_soc_dapm_get_volsw, nau8310_dsp_snd_soc_dapm_put)
-
-static const struct snd_kcontrol_new nau8310_dacdat_select_dsp =
-	NAU8310_DSP_SOC_DAPM_SINGLE("Switch", NAU8310_R1A_DSP_CORE_CTRL2,
-				    NAU8310_DAC_SEL_DSP_SFT, 1, 0);
-
-static int nau8310_dsp_clock_event(struct snd_soc_dapm_widget *w,
-				   struct snd_kcontrol *kcontrol, int event)
+/* Send the first profile of the firmware loaded. The reference of @fw is
+ * passed to the device if it succeeds.
+ */
+static int nau8310_dsp_kcs_load(struct snd_soc_component *component,
+				const struct firmware *fw)
 {
-	struct snd_soc_component *component =
-			snd_soc_dapm_to_component(w->dapm);
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	const struct nau8310_kcs_image *img = nau8310_dsp_fw_image(fw);
 	int ret;
 
-	switch (event) {
-	case SND_SOC_DAPM_PRE_PMU:
-		dev_dbg(component->dev, "Send DSP command %s\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART]);
-		ret = nau8310_send_dsp_command(component,
-					       NAU8310_DSP_CMD_CLK_RESTART, kcs_setup);
-		if (ret)
-			dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-				dsp_cmd_table[NAU8310_DSP_CMD_CLK_RESTART],
-				ret);
-		/* Switch the clock source of DSP to MCLK. */
-		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-				   NAU8310_DSP_SEL_OSC, 0);
-		break;
-	case SND_SOC_DAPM_POST_PMD:
-		dev_dbg(component->dev, "Send DSP command %s\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP]);
-		ret = nau8310_send_dsp_command(component,
-					       NAU8310_DSP_CMD_CLK_STOP, kcs_setup);
-		if (ret)
-			dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-				dsp_cmd_table[NAU8310_DSP_CMD_CLK_STOP], ret);
-		break;
-	default:
+	if (!nau8310_kcs_image_has(img, 0)) {
+		dev_err(component->dev, "No KCS setup of %s in firmware %s\n",
+			nau8310_dsp_profile_texts[0], NAU8310_DSP_FIRMWARE);
 		return -EINVAL;
 	}
+	nau8310->kcs_setup_size = nau8310_kcs_image_size(img, 0);
+	ret = nau8310_dsp_kcs_send_image(component, img, 0, NULL, 0);
+	if (ret < 0)
+		return ret;
+	nau8310_dsp_kcs_cache(nau8310, fw, 0);
+	/* once, the reloads run the same firmware */
+	if (!nau8310->dsp_revision_valid &&
+		!nau8310_dsp_get_revision(component, &nau8310->dsp_revision)) {
+		nau8310->dsp_revision_valid = true;
+		dev_dbg(component->dev, "DSP version %x\n",
+			nau8310->dsp_revision);
+	}
 
 	return 0;
 }
 
-static const struct snd_soc_dapm_widget nau8310_dsp_dapm_widgets[] = {
-	SND_SOC_DAPM_PGA("DSP", SND_SOC_NOPM, 0, 0, NULL, 0),
-	SND_SOC_DAPM_SWITCH("DAC data from DSP", SND_SOC_NOPM,
-			    0, 0, &nau8310_dacdat_select_dsp),
-	SND_SOC_DAPM_SUPPLY("DSP Clock", SND_SOC_NOPM, 0, 0,
-			    nau8310_dsp_clock_event, SND_SOC_DAPM_PRE_PMU |
-			    SND_SOC_DAPM_POST_PMD),
-};
-
-static const struct snd_soc_dapm_route nau8310_dsp_dapm_routes[] = {
-	{ "DSP", NULL, "Capture Sense" },
-	{ "DAC data from DSP", "Switch", "DSP" },
-	{ "DAC", NULL, "DAC data from DSP" },
-	{ "DSP", NULL, "DSP Clock" },
-};
-
 static void nau8310_dsp_fw_cb(const struct firmware *fw, void *context)
 {
 	struct snd_soc_component *component = context;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 	struct snd_soc_dapm_context *dapm = nau8310->dapm;
-	int ret, buf_off, buf_len;
+	int ret;
 
 	if (!fw) {
 		dev_err(component->dev, "Cannot load firmware %s\n",
 			NAU8310_DSP_FIRMWARE);
 		goto err;
 	}
-	regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-			   NAU8310_SOFT_MUTE, NAU8310_SOFT_MUTE);
-
-	buf_off = 0;
-	buf_len = nau8310->kcs_setup_size = fw->size;
-
-	dev_dbg(component->dev, "Send DSP command %s (OFF %d, LEN %d)\n",
-		dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP],
-		buf_off, buf_len);
-
-	ret = nau8310_dsp_kcs_setup(component, buf_off, buf_len, fw->data);
-	if (ret) {
-		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP], ret);
+	fw = nau8310_dsp_fw_add(NAU8310_DSP_FIRMWARE, fw);
+	if (IS_ERR(fw)) {
+		dev_err(component->dev, "Invalid KCS firmware %s (%ld)\n",
+			NAU8310_DSP_FIRMWARE, PTR_ERR(fw));
+		fw = NULL;
 		goto err;
 	}
-	regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-			   NAU8310_SOFT_MUTE, 0);
 
-	release_firmware(fw);
+	ret = nau8310_dsp_kcs_load(component, fw);
+	if (ret)
+		goto err;
 
 	return;
 err:
-	release_firmware(fw);
+	nau8310_dsp_fw_put(fw);
 	snd_soc_dapm_del_routes(dapm, nau8310_dsp_dapm_routes,
 				ARRAY_SIZE(nau8310_dsp_dapm_routes));
 	regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
@@ -914,12 +2737,10 @@ err:
 			   NAU8310_SOFT_MUTE, 0);
 }
 
-static int nau8310_dsp_set_kcs_setup(struct snd_soc_component *component, bool nowait)
+static int nau8310_dsp_algo_ready(struct snd_soc_component *component)
 {
-	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
-	const struct firmware *fw;
-	int ret, status = 0, buf_off, buf_len;
+	int ret, status = 0;
 
 	dev_dbg(component->dev, "Send DSP command %s\n",
 		dsp_cmd_table[NAU8310_DSP_CMD_GET_FRAME_STATUS]);
@@ -932,18 +2753,195 @@ static int nau8310_dsp_set_kcs_setup(struct snd_soc_component *component, bool n
 	if (ret) {
 		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
 			dsp_cmd_table[NAU8310_DSP_CMD_GET_FRAME_STATUS], ret);
-		goto err;
+		return ret;
 	}
 
 	if (!(status & NAU8310_DSP_ALGO_OK)) {
 		dev_err(component->dev, "Algorithm of DSP is not ready, status %x\n",
 			status);
-		ret = -EIO;
-		goto err;
+		return -EIO;
 	}
 
 	dev_info(component->dev, "Algorithm of DSP is ready, status %x\n", status);
 
+	return 0;
+}
+
+/**
+ * nau8310_dsp_kcs_reload - Restore KCS setup from the cached firmware
+ *
+ * @component:  component to register
+ *
+ * The function reads back each section of the profile applied from DSP.
+ * A section whose CRC matches the readback is kept, and the others are
+ * compared in chunks of NAU8310_DSP_KCS_TX_MAX bytes and only the runs of
+ * chunks which differ are sent again. If the readback fails, the whole
+ * section is sent without requesting the firmware from the file system.
+ */
+static int nau8310_dsp_kcs_reload(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	const struct nau8310_kcs_image *img;
+	const struct nau8310_kcs_section *sect;
+	int i, ret = 0, off, len, sent = 0;
+	bool muted = false;
+	u8 *readback;
+
+	img = nau8310_dsp_fw_image(nau8310->kcs_fw);
+	if (!img)
+		return -ENOENT;
+
+	for (i = 0; i < img->num; i++) {
+		sect = &img->sect[i];
+		if (sect->profile != nau8310->dsp_profile)
+			continue;
+		readback = kzalloc(sect->size, GFP_KERNEL);
+		if (!readback) {
+			ret = -ENOMEM;
+			break;
+		}
+		for (off = 0; off < sect->size; off += len) {
+			len = min(sect->size - off, NAU8310_DSP_KCS_DAT_LEN_MAX);
+			kcs_setup->set_kcs_offset = sect->kcs_offset + off;
+			kcs_setup->get_len = kcs_setup->set_len = len;
+			kcs_setup->get_data = readback + off;
+			ret = nau8310_send_dsp_command(component,
+						       NAU8310_DSP_CMD_GET_KCS_SETUP,
+						       kcs_setup);
+			if (ret)
+				break;
+		}
+		if (!ret && nau8310_dsp_crc(readback, sect->size) == sect->crc) {
+			kfree(readback);
+			continue;
+		}
+		/* without readback, every chunk is taken as different */
+		if (ret)
+			dev_dbg(component->dev, "KCS readback fail (%d), reload all\n",
+				ret);
+		ret = nau8310_dsp_kcs_send_diff(component, sect->kcs_offset,
+						ret ? NULL : readback, sect->data,
+						sect->size, &muted);
+		kfree(readback);
+		if (ret < 0)
+			break;
+		sent += ret;
+		ret = 0;
+	}
+	nau8310_dsp_kcs_unmute(nau8310, muted);
+	if (ret < 0)
+		return ret;
+
+	dev_dbg(component->dev, "Reload %d of %d bytes KCS setup\n", sent,
+		nau8310->kcs_setup_size);
+
+	return 0;
+}
+
+/**
+ * nau8310_dsp_profile_switch - Apply a preloaded KCS profile
+ *
+ * @component:  component to register
+ * @id: profile to apply
+ *
+ * The profile is taken from the firmware applied if it has the sections
+ * of @id, or else from the preloaded file of the profile. The function
+ * skips the sections the same as the ones applied and sends only the
+ * chunks which differ, so the output is muted for the diff only. The
+ * switch time is accounted under the dsp_profile latency of debugfs.
+ */
+static int nau8310_dsp_profile_switch(struct snd_soc_component *component,
+				      int id)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	const struct firmware *fw, *cur = nau8310->kcs_fw;
+	const struct nau8310_kcs_image *img, *cur_img;
+	ktime_t start = ktime_get();
+	int ret;
+
+	cur_img = nau8310_dsp_fw_image(cur);
+	if (nau8310_kcs_image_has(cur_img, id))
+		fw = cur;
+	else
+		fw = smp_load_acquire(&nau8310->profile[id].fw);
+	img = nau8310_dsp_fw_image(fw);
+	if (!nau8310_kcs_image_has(img, id) || !cur_img) {
+		dev_err(component->dev, "DSP profile %s not loaded\n",
+			nau8310_dsp_profile_texts[id]);
+		return -ENOENT;
+	}
+
+	ret = nau8310_dsp_kcs_send_image(component, img, id, cur_img,
+					 nau8310->dsp_profile);
+	if (ret < 0)
+		return ret;
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_PROFILE], start);
+	nau8310->kcs_setup_size = nau8310_kcs_image_size(img, id);
+	dev_dbg(component->dev, "Switch to DSP profile %s, %d of %d bytes sent\n",
+		nau8310_dsp_profile_texts[id], ret, nau8310->kcs_setup_size);
+
+	/* the profile keeps its reference, the resume reload takes another */
+	nau8310_dsp_fw_hold(fw);
+	nau8310_dsp_kcs_cache(nau8310, fw, id);
+
+	return 0;
+}
+
+static void nau8310_dsp_profile_cb(const struct firmware *fw, void *context)
+{
+	struct nau8310_dsp_profile *profile = context;
+	struct nau8310 *nau8310 = profile->nau8310;
+	int id = profile - nau8310->profile;
+
+	if (!fw) {
+		dev_warn(nau8310->dev, "Cannot load DSP profile %s\n",
+			 nau8310_dsp_profile_fw[id]);
+	} else {
+		fw = nau8310_dsp_fw_add(nau8310_dsp_profile_fw[id], fw);
+		if (IS_ERR(fw))
+			dev_warn(nau8310->dev, "Invalid DSP profile %s (%ld)\n",
+				 nau8310_dsp_profile_fw[id], PTR_ERR(fw));
+		else
+			smp_store_release(&profile->fw, fw);
+	}
+
+	if (atomic_dec_and_test(&nau8310->profile_pending))
+		wake_up_var(&nau8310->profile_pending);
+}
+
+/* load the KCS profiles in background, the switch waits for none of them */
+static void nau8310_dsp_profile_preload(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_dsp_profile *profile;
+	int i, ret;
+
+	for (i = 0; i < NAU8310_DSP_PROFILE_NUM; i++) {
+		profile = &nau8310->profile[i];
+		profile->nau8310 = nau8310;
+		atomic_inc(&nau8310->profile_pending);
+		ret = request_firmware_nowait(THIS_MODULE, true,
+					      nau8310_dsp_profile_fw[i],
+					      component->dev, GFP_KERNEL,
+					      profile, nau8310_dsp_profile_cb);
+		if (ret) {
+			atomic_dec(&nau8310->profile_pending);
+			dev_warn(component->dev, "Failed to load DSP profile %s (%d)\n",
+				 nau8310_dsp_profile_fw[i], ret);
+		}
+	}
+}
+
+static int nau8310_dsp_set_kcs_setup(struct snd_soc_component *component, bool nowait)
+{
+	const struct firmware *fw = NULL;
+	int ret;
+
+	ret = nau8310_dsp_algo_ready(component);
+	if (ret)
+		goto err;
+
 	if (nowait) {
 		dev_dbg(component->dev, "Request firmware and no wait.\n");
 		ret = request_firmware_nowait(THIS_MODULE, true,
@@ -956,53 +2954,127 @@ static int nau8310_dsp_set_kcs_setup(struct snd_soc_component *component, bool n
 		}
 	} else {
 		dev_dbg(component->dev, "Request firmware and wait until finish.\n");
-		ret = request_firmware(&fw, NAU8310_DSP_FIRMWARE, component->dev);
+		ret = nau8310_dsp_fw_get(component->dev, NAU8310_DSP_FIRMWARE, &fw);
 		if (ret) {
 			dev_err(component->dev, "Failed to load firmware (%d)\n", ret);
 			goto err;
 		}
-		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-				   NAU8310_SOFT_MUTE, NAU8310_SOFT_MUTE);
-
-		buf_off = 0;
-		buf_len = nau8310->kcs_setup_size = fw->size;
-		dev_dbg(component->dev, "Send DSP command %s (OFF %d, LEN %d)\n",
-			dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP],
-			buf_off, buf_len);
-		ret = nau8310_dsp_kcs_setup(component, buf_off, buf_len, fw->data);
+		ret = nau8310_dsp_kcs_load(component, fw);
 		if (ret) {
-			dev_err(component->dev, "Send DSP command %s fail (%d)\n",
-				dsp_cmd_table[NAU8310_DSP_CMD_SET_KCS_SETUP],
-				ret);
-			goto err_loaded;
+			nau8310_dsp_fw_put(fw);
+			goto err;
 		}
-		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-				   NAU8310_SOFT_MUTE, 0);
-		release_firmware(fw);
 	}
 
 	return 0;
 
-err_loaded:
-	regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-			   NAU8310_SOFT_MUTE, 0);
-	if (fw)
-		release_firmware(fw);
 err:
 	return ret;
 }
 
-int nau8310_dsp_init(struct snd_soc_component *component)
+#ifdef CONFIG_DEBUG_FS
+/* The KCS setup read back from DSP at any offset, or from the KCS shadow
+ * if it holds the range and the reads aren't verified. A read is split in
+ * commands of up to NAU8310_DSP_KCS_DAT_LEN_MAX bytes taken under one hold
+ * of the mailbox, and a failing command ends it short.
+ */
+static ssize_t nau8310_dsp_kcs_read(struct file *file, char __user *user_buf,
+				    size_t count, loff_t *ppos)
 {
+	struct snd_soc_component *component = file->private_data;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	struct snd_soc_dapm_context *dapm = nau8310->dapm;
-	int ret;
+	struct nau8310_kcs_setup kcs_setup_comp = {}, *kcs_setup = &kcs_setup_comp;
+	size_t size = nau8310->kcs_setup_size, off, len;
+	loff_t pos = *ppos;
+	int ret = 0;
+	u8 *data;
+
+	if (!size)
+		return -ENODEV;
+	if (pos < 0)
+		return -EINVAL;
+	if (pos >= size || !count)
+		return 0;
+	count = min_t(size_t, count, size - pos);
+	data = kmalloc(count, GFP_KERNEL);
+	if (!data)
+		return -ENOMEM;
+	if (nau8310_kcs_shadow_read(nau8310, pos, count, data)) {
+		off = count;
+		goto copy;
+	}
 
-	dev_dbg(component->dev, "DSP initializing...\n");
+	nau8310_dsp_lock(nau8310, NAU8310_DSP_PRIO_DIAG);
+	for (off = 0; off < count; off += len) {
+		if (off)
+			nau8310_dsp_yield(nau8310, NAU8310_DSP_PRIO_DIAG);
+		len = min_t(size_t, count - off, NAU8310_DSP_KCS_DAT_LEN_MAX);
+		kcs_setup->set_kcs_offset = pos + off;
+		kcs_setup->get_len = kcs_setup->set_len = len;
+		kcs_setup->get_data = data + off;
+		ret = __nau8310_send_dsp_command(component,
+			NAU8310_DSP_CMD_GET_KCS_SETUP, kcs_setup);
+		if (ret)
+			break;
+	}
+	nau8310_dsp_unlock(nau8310);
+	nau8310_kcs_shadow_check(nau8310, pos, off, data);
 
-	ret = nau8310_dsp_set_kcs_setup(component, false);
-	if (ret)
-		goto err;
+copy:
+	if (off) {
+		if (copy_to_user(user_buf, data, off)) {
+			ret = -EFAULT;
+		} else {
+			*ppos = pos + off;
+			ret = off;
+		}
+	}
+	kfree(data);
+
+	return ret;
+}
+
+static const struct file_operations nau8310_dsp_kcs_fops = {
+	.open = simple_open,
+	.read = nau8310_dsp_kcs_read,
+	.llseek = default_llseek,
+};
+
+static void nau8310_dsp_debugfs_init(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct dentry *dir;
+
+	if (!component->debugfs_root)
+		return;
+
+	debugfs_create_file("kcs_setup", 0400, component->debugfs_root,
+			    component, &nau8310_dsp_kcs_fops);
+	dir = debugfs_create_dir("kcs_shadow", component->debugfs_root);
+	debugfs_create_u32("hits", 0444, dir, &nau8310->kcs_shadow_hits);
+	debugfs_create_u32("mismatches", 0444, dir,
+			   &nau8310->kcs_shadow_mismatches);
+	/* the failures of the mailbox by class; their logs are rate limited */
+	dir = debugfs_create_dir("dsp_errors", component->debugfs_root);
+	debugfs_create_u32("send", 0444, dir, &nau8310->dsp_stats.send_errors);
+	debugfs_create_u32("reply", 0444, dir,
+			   &nau8310->dsp_stats.reply_errors);
+	debugfs_create_u32("timeout", 0444, dir, &nau8310->dsp_stats.timeouts);
+	debugfs_create_u32("protocol", 0444, dir,
+			   &nau8310->dsp_stats.proto_errors);
+}
+#else
+static void nau8310_dsp_debugfs_init(struct snd_soc_component *component)
+{
+}
+#endif
+
+/* add controls, widgets and routes of DSP into the component */
+int nau8310_dsp_init_controls(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct snd_soc_dapm_context *dapm = nau8310->dapm;
+	int ret;
 
 	ret = snd_soc_add_component_controls(component, nau8310_dsp_snd_controls,
 					     ARRAY_SIZE(nau8310_dsp_snd_controls));
@@ -1022,6 +3094,8 @@ int nau8310_dsp_init(struct snd_soc_component *component)
 		dev_err(component->dev, "Add DSP route fail (%d)\n", ret);
 		goto err;
 	}
+	nau8310_dsp_debugfs_init(component);
+	nau8310_dsp_profile_preload(component);
 
 	return 0;
 err:
@@ -1029,10 +3103,116 @@ err:
 				ARRAY_SIZE(nau8310_dsp_dapm_routes));
 	return ret;
 }
+EXPORT_SYMBOL_GPL(nau8310_dsp_init_controls);
+
+/* load KCS setup after controls added, the DSP path is removed if fail */
+int nau8310_dsp_load(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	ret = nau8310_dsp_set_kcs_setup(component, false);
+	if (ret)
+		snd_soc_dapm_del_routes(nau8310->dapm, nau8310_dsp_dapm_routes,
+					ARRAY_SIZE(nau8310_dsp_dapm_routes));
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_load);
+
+int nau8310_dsp_init(struct snd_soc_component *component)
+{
+	int ret;
+
+	dev_dbg(component->dev, "DSP initializing...\n");
+
+	ret = nau8310_dsp_set_kcs_setup(component, false);
+	if (ret)
+		return ret;
+
+	return nau8310_dsp_init_controls(component);
+}
 EXPORT_SYMBOL_GPL(nau8310_dsp_init);
 
+static int nau8310_dsp_get_revision(struct snd_soc_component *component,
+				    int *revision)
+{
+	struct nau8310_kcs_setup kcs_setup_comp, *kcs_setup = &kcs_setup_comp;
+	int ret;
+
+	kcs_setup->get_len = kcs_setup->set_len = sizeof(*revision);
+	kcs_setup->get_data = (void *)revision;
+
+	ret = nau8310_send_dsp_command(component,
+				       NAU8310_DSP_CMD_GET_REVISION, kcs_setup);
+	if (ret)
+		dev_err(component->dev, "Send DSP command %s fail (%d)\n",
+			dsp_cmd_table[NAU8310_DSP_CMD_GET_REVISION], ret);
+
+	return ret;
+}
+
+/**
+ * nau8310_dsp_retain - Record the DSP state kept over a suspend
+ *
+ * @component:  component to register
+ *
+ * The DSP is checked against the firmware revision at resume, so the
+ * state is kept only if the revision was cached at the first load.
+ */
+int nau8310_dsp_retain(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	return nau8310->dsp_revision_valid ? 0 : -ENODEV;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_retain);
+
+/**
+ * nau8310_dsp_retained - Check the DSP state kept over a suspend
+ *
+ * @component:  component to register
+ *
+ * The DSP released from the stall must answer with the revision cached
+ * and its algorithm must be ready. Otherwise the state went
+ * away with the power and the caller reloads the DSP from scratch.
+ */
+int nau8310_dsp_retained(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret, revision = 0;
+
+	ret = nau8310_dsp_get_revision(component, &revision);
+	if (ret)
+		return ret;
+	if (revision != nau8310->dsp_revision) {
+		dev_info(component->dev, "DSP version %x, %x cached\n",
+			 revision, nau8310->dsp_revision);
+		return -EIO;
+	}
+
+	return nau8310_dsp_algo_ready(component);
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_retained);
+
 int nau8310_dsp_resume(struct snd_soc_component *component)
 {
-	return nau8310_dsp_set_kcs_setup(component, false);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	/* the chip was reset, the shadow is refilled by the reload */
+	nau8310_kcs_shadow_drop(nau8310, 0, 0);
+	if (!nau8310->kcs_fw)
+		return nau8310_dsp_set_kcs_setup(component, false);
+
+	ret = nau8310_dsp_algo_ready(component);
+	if (ret)
+		return ret;
+
+	return nau8310_dsp_kcs_reload(component);
 }
 EXPORT_SYMBOL_GPL(nau8310_dsp_resume);
+
+#ifdef CONFIG_SND_SOC_NAU8310_KUNIT_TEST
+#include "nau8310-dsp-test.c"
+#endif
@@ -17,9 +17,42 @@
 /* max bytes of data to transfer into DSP each time during the KCS setup */
 #define NAU8310_DSP_KCS_TX_MAX			96
 #define NAU8310_DSP_RETRY_MAX			3
+/* KCS setup chunks sent between the result checks, 0 for the end only */
+#define NAU8310_DSP_KCS_CHECK_MAX		32
+/* mailbox polling interval doubles from MIN to MAX until the timeout */
+#define NAU8310_DSP_POLL_MIN_US			50
+#define NAU8310_DSP_POLL_MAX_US			1600
+#define NAU8310_DSP_WAIT_TIMEOUT_US		20000
+/* mailbox reads to drain the longest reply left behind, back to idle */
+#define NAU8310_DSP_DRAIN_MAX			(NAU8310_DSP_KCS_DAT_LEN_MAX / \
+						NAU8310_DSP_DATA_BYTE + 3)
+/* the longest sampling period of the monitor and its back off while idle */
+#define NAU8310_DSP_MON_PERIOD_MAX		10000
+#define NAU8310_DSP_MON_IDLE_SHIFT_MAX		3
+/* the longest window the DSP clock runs on after the power down */
+#define NAU8310_DSP_CLK_GRACE_MAX		10000
 #define NAU8310_DSP_KCS_DAT_LEN_BITS		10
 #define NAU8310_DSP_KCS_DAT_LEN_MAX		((1 << NAU8310_DSP_KCS_DAT_LEN_BITS) - 1)
 #define NAU8310_DSP_KCS_OFFSET_MAX		3072
+/* bytes of the KCS region the driver can address, kept in the shadow */
+#define NAU8310_DSP_KCS_SHADOW_LEN		(NAU8310_DSP_KCS_OFFSET_MAX + \
+						NAU8310_DSP_KCS_DAT_LEN_MAX)
+/* max bytes of a KCS patch, whole words as offset and length are aligned */
+#define NAU8310_DSP_KCS_PATCH_MAX		(NAU8310_DSP_KCS_DAT_LEN_MAX & \
+						~(NAU8310_DSP_DATA_BYTE - 1))
+/* fragments of the longest message: preamble, parameters, payload, trailer */
+#define NAU8310_DSP_FRAG_MAX			(3 + NAU8310_DSP_KCS_TX_MAX / \
+						NAU8310_DSP_DATA_BYTE)
+
+/* a fragment in the frame of a message, behind the address of the mailbox */
+#define NAU8310_DSP_FRAME_SLOT			(NAU8310_DSP_REG_LEN + \
+						NAU8310_DSP_DATA_BYTE)
+
+/* Send each mailbox message, and read each reply after its preamble, as
+ * one I2C transfer instead of a register access per fragment. Undefine it
+ * to fall back to the per-word register writes and reads.
+ */
+#define NAU8310_DSP_BURST_XFER
 
 /* FRAME_STATUS (0x9) */
 #define NAU8310_DSP_SNS_OVF_SFT			31
@@ -49,10 +82,66 @@
 #define NAU8310_DSP_ALGO_OK			0x1
 
 #define NAU8310_DSP_FIRMWARE			"Nuvoton/NAU83G10.kcs.bin"
+#define NAU8310_DSP_FIRMWARE_VOICE		"Nuvoton/NAU83G10-voice.kcs.bin"
 #define NAU8310_DSP_FWHDR_SIZE			8
 #define NAU8310_DSP_FWHDR_SIREV			4
 #define NAU8310_DSP_FW_KCS_DATA			NAU8310_DSP_FWHDR_SIZE
 
+/*
+ * Firmware container of the KCS setups, little endian. The header is
+ * followed by the table of sections and their data. A section is a part
+ * of the KCS setup of one profile from kcs_offset, and the CRC32 of the
+ * header covers everything after it. A file without the magic is taken as
+ * one plain KCS setup of the profile named by the file.
+ *
+ * Version 2 adds the size of the section data as sent to the table; a
+ * section with a size there is stored as one LZ4 block, and its CRC is the
+ * one of the data decompressed. The block is decompressed once, as the
+ * firmware enters the cache, into a buffer of the section's size, which
+ * is bounded by the KCS region.
+ */
+#define NAU8310_DSP_FW_MAGIC			0x53434b4e	/* "NKCS" */
+#define NAU8310_DSP_FW_VERSION			1
+#define NAU8310_DSP_FW_VERSION_LZ4		2
+#define NAU8310_DSP_FW_SECT_MAX			16
+
+struct nau8310_fw_header {
+	__le32 magic;
+	__le16 version;
+	__le16 num_sections;
+	__le32 size;
+	__le32 crc;
+} __packed;
+
+struct nau8310_fw_section_desc {
+	__le16 profile;
+	__le16 kcs_offset;
+	__le32 offset;
+	__le32 size;
+	__le32 crc;
+} __packed;
+
+/* the section table of version 2, raw_size 0 for the data stored as is */
+struct nau8310_fw_section_desc_lz4 {
+	struct nau8310_fw_section_desc desc;
+	__le32 raw_size;
+} __packed;
+
+struct nau8310_kcs_section {
+	int profile;
+	int kcs_offset;
+	const u8 *data;
+	int size;
+	u32 crc;
+	/* the data decompressed, owned by the image */
+	u8 *raw;
+};
+
+struct nau8310_kcs_image {
+	int num;
+	struct nau8310_kcs_section sect[NAU8310_DSP_FW_SECT_MAX];
+};
+
 enum {
 	NAU8310_DSP_REPLY_OK,
 	NAU8310_DSP_REPLY_MSG_INTEGRETY_ERR,
@@ -75,6 +164,8 @@ enum {
 
 struct nau8310_cmd_info {
 	int cmd_id;
+	/* class taking the mailbox, NAU8310_DSP_PRIO_* */
+	int prio;
 	/* parameters include offset, size, and data */
 	bool msg_param;
 	/* data for write only */
@@ -98,7 +189,122 @@ struct nau8310_kcs_setup {
 	void *get_data;
 };
 
+typedef void (*nau8310_dsp_done_t)(struct snd_soc_component *component,
+				   int cmd_id, int ret,
+				   struct nau8310_kcs_setup *kcs_setup);
+
+/* depth of DSP command queue, one slot is kept empty */
+#define NAU8310_DSP_QUEUE_LEN			16
+
+/**
+ * component: component the command sent to
+ * cmd_id: DSP supported command ID
+ * kcs_setup: copy of KCS setup structure from the caller
+ * done: callback when the command finishes
+ * reply: buffer for short reply if the caller doesn't give one
+ */
+struct nau8310_dsp_req {
+	struct snd_soc_component *component;
+	int cmd_id;
+	struct nau8310_kcs_setup kcs_setup;
+	nau8310_dsp_done_t done;
+	u32 reply;
+};
+
+/* steps of the switch to the DSP path, out of the control */
+enum {
+	NAU8310_DSP_SW_IDLE,
+	NAU8310_DSP_SW_QUEUED,
+	NAU8310_DSP_SW_POWER_UP,
+	NAU8310_DSP_SW_LOADING,
+};
+
+#if NAU8310_DSP_BUILT
+int nau8310_send_dsp_command(struct snd_soc_component *component,
+			     int cmd_id, struct nau8310_kcs_setup *kcs_setup);
+int nau8310_send_dsp_batch(struct snd_soc_component *component,
+			   const int *cmd_ids,
+			   struct nau8310_kcs_setup *kcs_setups, int num);
+int nau8310_dsp_queue_command(struct snd_soc_component *component, int cmd_id,
+			      const struct nau8310_kcs_setup *kcs_setup,
+			      nau8310_dsp_done_t done);
+int nau8310_dsp_queue_init(struct nau8310 *nau8310);
+void nau8310_dsp_queue_flush(struct nau8310 *nau8310);
+void nau8310_dsp_queue_free(struct nau8310 *nau8310);
+void nau8310_dsp_monitor_start(struct nau8310 *nau8310);
+void nau8310_dsp_monitor_stop(struct nau8310 *nau8310);
+void nau8310_dsp_clk_flush(struct nau8310 *nau8310);
+void nau8310_dsp_park(struct nau8310 *nau8310, bool park);
+void nau8310_dsp_remove(struct nau8310 *nau8310);
 int nau8310_dsp_init(struct snd_soc_component *component);
+int nau8310_dsp_init_controls(struct snd_soc_component *component);
+int nau8310_dsp_load(struct snd_soc_component *component);
 int nau8310_dsp_resume(struct snd_soc_component *component);
+int nau8310_dsp_retain(struct snd_soc_component *component);
+int nau8310_dsp_retained(struct snd_soc_component *component);
+#else
+static inline int nau8310_send_dsp_command(struct snd_soc_component *component,
+	int cmd_id, struct nau8310_kcs_setup *kcs_setup)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_send_dsp_batch(struct snd_soc_component *component,
+	const int *cmd_ids, struct nau8310_kcs_setup *kcs_setups, int num)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_queue_command(
+	struct snd_soc_component *component, int cmd_id,
+	const struct nau8310_kcs_setup *kcs_setup, nau8310_dsp_done_t done)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_queue_init(struct nau8310 *nau8310)
+{
+	return 0;
+}
+
+static inline void nau8310_dsp_queue_flush(struct nau8310 *nau8310) {}
+static inline void nau8310_dsp_queue_free(struct nau8310 *nau8310) {}
+static inline void nau8310_dsp_monitor_start(struct nau8310 *nau8310) {}
+static inline void nau8310_dsp_monitor_stop(struct nau8310 *nau8310) {}
+static inline void nau8310_dsp_clk_flush(struct nau8310 *nau8310) {}
+static inline void nau8310_dsp_park(struct nau8310 *nau8310, bool park) {}
+static inline void nau8310_dsp_remove(struct nau8310 *nau8310) {}
+
+static inline int nau8310_dsp_init(struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_init_controls(
+	struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_load(struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_resume(struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_retain(struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+
+static inline int nau8310_dsp_retained(struct snd_soc_component *component)
+{
+	return -ENODEV;
+}
+#endif
 
 #endif /* __NAU8310_DSP_H__ */
@@ -0,0 +1,124 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints of the NAU83G10/20 DSP mailbox protocol.
+ *
+ * Copyright 2021 Nuvoton Technology Crop.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nau8310
+
+#if !defined(__NAU8310_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __NAU8310_TRACE_H__
+
+#include <linux/tracepoint.h>
+#include <sound/soc.h>
+
+TRACE_EVENT(nau8310_dsp_cmd_start,
+
+	TP_PROTO(struct snd_soc_component *component, int cmd_id,
+		 int frag_len, int bytes),
+
+	TP_ARGS(component, cmd_id, frag_len, bytes),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(component->dev))
+		__field(int, cmd_id)
+		__field(int, frag_len)
+		__field(int, bytes)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(component->dev));
+		__entry->cmd_id = cmd_id;
+		__entry->frag_len = frag_len;
+		__entry->bytes = bytes;
+	),
+
+	TP_printk("%s cmd_id=0x%x frag_len=%d bytes=%d", __get_str(name),
+		  __entry->cmd_id, __entry->frag_len, __entry->bytes)
+);
+
+TRACE_EVENT(nau8310_dsp_cmd_end,
+
+	TP_PROTO(struct snd_soc_component *component, int cmd_id,
+		 int frag_len, int bytes, unsigned int retries, s64 elapsed_ns,
+		 int ret),
+
+	TP_ARGS(component, cmd_id, frag_len, bytes, retries, elapsed_ns, ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(component->dev))
+		__field(int, cmd_id)
+		__field(int, frag_len)
+		__field(int, bytes)
+		__field(unsigned int, retries)
+		__field(s64, elapsed_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(component->dev));
+		__entry->cmd_id = cmd_id;
+		__entry->frag_len = frag_len;
+		__entry->bytes = bytes;
+		__entry->retries = retries;
+		__entry->elapsed_ns = elapsed_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s cmd_id=0x%x frag_len=%d bytes=%d retries=%u elapsed=%lldns ret=%d",
+		  __get_str(name), __entry->cmd_id, __entry->frag_len,
+		  __entry->bytes, __entry->retries, __entry->elapsed_ns,
+		  __entry->ret)
+);
+
+DECLARE_EVENT_CLASS(nau8310_dsp_wait,
+
+	TP_PROTO(struct snd_soc_component *component, unsigned int polls,
+		 s64 elapsed_ns, int ret),
+
+	TP_ARGS(component, polls, elapsed_ns, ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(component->dev))
+		__field(unsigned int, polls)
+		__field(s64, elapsed_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(component->dev));
+		__entry->polls = polls;
+		__entry->elapsed_ns = elapsed_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s polls=%u elapsed=%lldns ret=%d", __get_str(name),
+		  __entry->polls, __entry->elapsed_ns, __entry->ret)
+);
+
+DEFINE_EVENT(nau8310_dsp_wait, nau8310_dsp_idle_wait,
+
+	TP_PROTO(struct snd_soc_component *component, unsigned int polls,
+		 s64 elapsed_ns, int ret),
+
+	TP_ARGS(component, polls, elapsed_ns, ret)
+);
+
+DEFINE_EVENT(nau8310_dsp_wait, nau8310_dsp_reply_wait,
+
+	TP_PROTO(struct snd_soc_component *component, unsigned int polls,
+		 s64 elapsed_ns, int ret),
+
+	TP_ARGS(component, polls, elapsed_ns, ret)
+);
+
+#endif /* __NAU8310_TRACE_H__ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH ../../sound/soc/codecs
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nau8310-trace
+#include <trace/define_trace.h>
@@ -9,11 +9,14 @@
 #include <linux/acpi.h>
 #include <linux/clk.h>
 #include <linux/delay.h>
+#include <linux/devm-helpers.h>
 #include <linux/i2c.h>
 #include <linux/init.h>
+#include <linux/interrupt.h>
 #include <linux/module.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/thermal.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/jack.h>
@@ -22,6 +25,12 @@
 #include <sound/soc.h>
 #include <sound/tlv.h>
 
+#include "nau-dapm-stat.h"
+#include "nau-delay.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-regmap.h"
+#include "nau-volramp.h"
 #include "nau8310.h"
 #include "nau8310-dsp.h"
 static void nau8310_software_reset(struct regmap *regmap);
@@ -36,6 +45,10 @@ static int nau8310_set_sysclk(struct snd_soc_component *component, int clk_id,
 #define DSP_CLK_MAX 102400000
 #define DSP_MCLK_HI_SPEED 12288000
 #define WIDGET_NAME_MAX_SIZE 80
+/* the ramp time of soft mute */
+#define SOFT_MUTE_RAMP_MS 30
+/* the power up forced after a clock loss before the detection re-armed */
+#define CLK_REARM_MS 20
 
 static const struct nau8310_src_attr dsp_src_mult[] = {
 	/* param : power of 2 */
@@ -48,6 +61,10 @@ static const struct nau8310_src_attr dsp_src_mult[] = {
 
 /* scaling for MCLK source */
 #define CLK_PROC_BYPASS (-1)
+/* the DSP on the internal OSC, as no DSP clock comes from MCLK */
+#define CLK_PROC_OSC (-2)
+/* index of mclk_n1_div dividing by 1 */
+#define CLK_N1_DIV1 1
 
 static const struct nau8310_src_attr mclk_n1_div[] = {
 	{ 3, 0x2 },
@@ -86,6 +103,37 @@ static const struct nau8310_srate_attr target_srate_table[] = {
 	{ 32000, 2, false, { 8192000, 12800000, 16000000 }, 0x2 },
 };
 
+/* The selections of the clock source search for the common MCLK, i.e.
+ * (n1_sel, mult_sel, n2_sel, dsp_mult_sel) chosen by nau8310_clksrc_choose().
+ * The pairs not listed here are searched at runtime.
+ */
+static const struct nau8310_clk_preset clk_preset_table[] = {
+	/* { MCLK, FS, n1_sel, mult_sel, n2_sel, dsp_mult_sel } */
+	/* MCLK 12.288MHz */
+	{ 12288000, 48000, 2, CLK_PROC_BYPASS, 0, 4 },
+	{ 12288000, 16000, 0, 3, 3, 4 },
+	{ 12288000, 8000, 0, 2, 3, 4 },
+	{ 12288000, 12000, 2, CLK_PROC_BYPASS, 2, 4 },
+	{ 12288000, 24000, 2, CLK_PROC_BYPASS, 1, 4 },
+	{ 12288000, 32000, 0, 4, 3, 4 },
+	/* MCLK 11.2896MHz */
+	{ 11289600, 44100, 1, CLK_PROC_BYPASS, 0, 3 },
+	/* MCLK 24.576MHz */
+	{ 24576000, 48000, 2, CLK_PROC_BYPASS, 1, 3 },
+	{ 24576000, 16000, 0, 2, 3, 3 },
+	{ 24576000, 8000, 0, 1, 3, 3 },
+	{ 24576000, 12000, 2, CLK_PROC_BYPASS, 3, 3 },
+	{ 24576000, 24000, 2, CLK_PROC_BYPASS, 2, 3 },
+	{ 24576000, 32000, 0, 3, 3, 3 },
+	/* MCLK 19.2MHz */
+	{ 19200000, 48000, 0, CLK_PROC_BYPASS, 0, 4 },
+	{ 19200000, 16000, 0, 3, 3, 4 },
+	{ 19200000, 8000, 0, 2, 3, 4 },
+	{ 19200000, 12000, 2, CLK_PROC_BYPASS, 2, 3 },
+	{ 19200000, 24000, 2, CLK_PROC_BYPASS, 1, 3 },
+	{ 19200000, 32000, 0, 4, 3, 4 },
+};
+
 /* the maximum frequency of CLK_ADC and CLK_DAC */
 #define CLK_DA_AD_MAX 6144000
 
@@ -113,6 +161,10 @@ static const struct nau8310_osr_attr osr_adc_dsp_sel[] = {
 	{ 128, 2 },		/* OSR 128, SRC 1/8 */
 };
 
+/* the group delay of the converter filters, by their design */
+static const struct nau_delay_filter nau8310_dac_filter = { 17, 128 };
+static const struct nau_delay_filter nau8310_adc_filter = { 13, 96 };
+
 static const struct reg_default nau8310_reg_defaults[] = {
 	{ NAU8310_R02_I2C_ADDR, 0x0000 },
 	{ NAU8310_R03_CLK_CTRL, 0x0000 },
@@ -198,68 +250,63 @@ static const struct reg_default nau8310_reg_defaults[] = {
 	{ NAU8310_R9B_BIQ2_COE_8, 0x0000 },
 	{ NAU8310_R9C_BIQ2_COE_9, 0x0000 },
 	{ NAU8310_R9D_BIQ2_COE_10, 0x0000 },
-	{ NAU8310_RF000_DSP_COMM, 0x0000 },
 };
 
+#define NAU8310_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8310_R03_CLK_CTRL, NAU8310_R10_RIGHT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8310_R12_HPF_CTRL, NAU8310_R2A_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8310_R2C_ALC_CTRL1, NAU8310_R33_LPF_CTRL) |	\
+	NAU_REG(w, NAU8310_R40_CLK_DET_CTRL) |				\
+	NAU_REG(w, NAU8310_R46_I2C_DEVICE_ID) |				\
+	NAU_REG_RANGE(w, NAU8310_R49_SARDOUT_RAM_STATUS, NAU8310_R4A_ANALOG_READ) |	\
+	NAU_REG(w, NAU8310_R55_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8310_R60_BIAS_ADJ, NAU8310_R66_ANALOG_CONTROL_6) |	\
+	NAU_REG_RANGE(w, NAU8310_R68_ANALOG_CONTROL_7, NAU8310_R69_CLIP_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8310_R6B_ANALOG_CONTROL_8, NAU8310_R6C_ANALOG_CONTROL_9) |	\
+	NAU_REG_RANGE(w, NAU8310_R71_ANALOG_ADC_1, NAU8310_R73_RDAC) |	\
+	NAU_REG_RANGE(w, NAU8310_R76_BOOST, NAU8310_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8310_R7F_POWER_UP_CONTROL, NAU8310_R9D_BIQ2_COE_10))
+
+static const u32 nau8310_readable_map[] = NAU_REGMAP(NAU8310_READABLE_REGS);
+
 static bool nau8310_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8310_R03_CLK_CTRL ... NAU8310_R10_RIGHT_TIME_SLOT:
-	case NAU8310_R12_HPF_CTRL ... NAU8310_R2A_DAC_CTRL2:
-	case NAU8310_R2C_ALC_CTRL1 ... NAU8310_R33_LPF_CTRL:
-	case NAU8310_R40_CLK_DET_CTRL:
-	case NAU8310_R46_I2C_DEVICE_ID:
-	case NAU8310_R49_SARDOUT_RAM_STATUS ... NAU8310_R4A_ANALOG_READ:
-	case NAU8310_R55_MISC_CTRL:
-	case NAU8310_R60_BIAS_ADJ ... NAU8310_R66_ANALOG_CONTROL_6:
-	case NAU8310_R68_ANALOG_CONTROL_7 ... NAU8310_R69_CLIP_CTRL:
-	case NAU8310_R6B_ANALOG_CONTROL_8 ... NAU8310_R6C_ANALOG_CONTROL_9:
-	case NAU8310_R71_ANALOG_ADC_1 ... NAU8310_R73_RDAC:
-	case NAU8310_R76_BOOST ... NAU8310_R77_FEPGA:
-	case NAU8310_R7F_POWER_UP_CONTROL ... NAU8310_R9D_BIQ2_COE_10:
-	case NAU8310_RF000_DSP_COMM:
-		return true;
-	default:
-		return false;
-	}
-
+	return nau_regmap_access(nau8310_readable_map, reg);
 }
 
+#define NAU8310_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8310_R00_HARDWARE_RST, NAU8310_R10_RIGHT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8310_R12_HPF_CTRL, NAU8310_R1A_DSP_CORE_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8310_R28_ADC_RATE, NAU8310_R2A_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8310_R2C_ALC_CTRL1, NAU8310_R33_LPF_CTRL) |	\
+	NAU_REG(w, NAU8310_R40_CLK_DET_CTRL) |				\
+	NAU_REG(w, NAU8310_R55_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8310_R60_BIAS_ADJ, NAU8310_R66_ANALOG_CONTROL_6) |	\
+	NAU_REG_RANGE(w, NAU8310_R68_ANALOG_CONTROL_7, NAU8310_R69_CLIP_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8310_R6B_ANALOG_CONTROL_8, NAU8310_R6C_ANALOG_CONTROL_9) |	\
+	NAU_REG_RANGE(w, NAU8310_R71_ANALOG_ADC_1, NAU8310_R73_RDAC) |	\
+	NAU_REG_RANGE(w, NAU8310_R76_BOOST, NAU8310_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8310_R7F_POWER_UP_CONTROL, NAU8310_R9D_BIQ2_COE_10))
+
+static const u32 nau8310_writeable_map[] = NAU_REGMAP(NAU8310_WRITEABLE_REGS);
+
 static bool nau8310_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8310_R00_HARDWARE_RST ... NAU8310_R10_RIGHT_TIME_SLOT:
-	case NAU8310_R12_HPF_CTRL ... NAU8310_R1A_DSP_CORE_CTRL2:
-	case NAU8310_R28_ADC_RATE ... NAU8310_R2A_DAC_CTRL2:
-	case NAU8310_R2C_ALC_CTRL1 ... NAU8310_R33_LPF_CTRL:
-	case NAU8310_R40_CLK_DET_CTRL:
-	case NAU8310_R55_MISC_CTRL:
-	case NAU8310_R60_BIAS_ADJ ... NAU8310_R66_ANALOG_CONTROL_6:
-	case NAU8310_R68_ANALOG_CONTROL_7 ... NAU8310_R69_CLIP_CTRL:
-	case NAU8310_R6B_ANALOG_CONTROL_8 ... NAU8310_R6C_ANALOG_CONTROL_9:
-	case NAU8310_R71_ANALOG_ADC_1 ... NAU8310_R73_RDAC:
-	case NAU8310_R76_BOOST ... NAU8310_R77_FEPGA:
-	case NAU8310_R7F_POWER_UP_CONTROL ... NAU8310_R9D_BIQ2_COE_10:
-	case NAU8310_RF000_DSP_COMM:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8310_writeable_map, reg);
 }
 
+#define NAU8310_VOLATILE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8310_R00_HARDWARE_RST, NAU8310_R01_SOFTWARE_RST) |	\
+	NAU_REG(w, NAU8310_R06_INT_CLR_STATUS) |			\
+	NAU_REG_RANGE(w, NAU8310_R1B_CLK_DOUBLER_O, NAU8310_R27_DSP_STATUS_2) |	\
+	NAU_REG(w, NAU8310_R46_I2C_DEVICE_ID) |				\
+	NAU_REG_RANGE(w, NAU8310_R49_SARDOUT_RAM_STATUS, NAU8310_R4A_ANALOG_READ))
+
+static const u32 nau8310_volatile_map[] = NAU_REGMAP(NAU8310_VOLATILE_REGS);
+
 static bool nau8310_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8310_R00_HARDWARE_RST ... NAU8310_R01_SOFTWARE_RST:
-	case NAU8310_R06_INT_CLR_STATUS:
-	case NAU8310_R1B_CLK_DOUBLER_O ... NAU8310_R27_DSP_STATUS_2:
-	case NAU8310_R46_I2C_DEVICE_ID:
-	case NAU8310_R49_SARDOUT_RAM_STATUS ... NAU8310_R4A_ANALOG_READ:
-	case NAU8310_RF000_DSP_COMM:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8310_volatile_map, reg);
 }
 
 static int nau8310_clkdet_put(struct snd_kcontrol *kcontrol,
@@ -286,6 +333,228 @@ static int nau8310_clkdet_put(struct snd_kcontrol *kcontrol,
 	return 0;
 }
 
+static int nau8310_osc_delay_get(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->osc_delay_ms;
+
+	return 0;
+}
+
+/* Only for the machines which keep MCLK on after the stream shutdown. */
+static int nau8310_osc_delay_put(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	long delay = ucontrol->value.integer.value[0];
+
+	if (delay < 0 || delay > NAU8310_OSC_DELAY_MAX_MS)
+		return -EINVAL;
+	if (delay == nau8310->osc_delay_ms)
+		return 0;
+	nau8310->osc_delay_ms = delay;
+
+	return 1;
+}
+
+static int nau8310_keepalive_get(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->keepalive.ms;
+
+	return 0;
+}
+
+/* applied from the next stream opened */
+static int nau8310_keepalive_put(struct snd_kcontrol *kcontrol,
+				 struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	long ms = ucontrol->value.integer.value[0];
+
+	if (ms < 0 || ms > NAU_KEEPALIVE_MAX_MS)
+		return -EINVAL;
+	if (ms == nau8310->keepalive.ms)
+		return 0;
+	WRITE_ONCE(nau8310->keepalive.ms, ms);
+
+	return 1;
+}
+
+static void __nau8310_thermal_vol(struct nau8310 *nau8310);
+
+static int nau8310_dac_vol_get(struct snd_kcontrol *kcontrol,
+			       struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = READ_ONCE(nau8310->thermal.dac_vol);
+
+	return 0;
+}
+
+/* The volume without the thermal backoff, ramped to by the driver */
+static int nau8310_dac_vol_put(struct snd_kcontrol *kcontrol,
+			       struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_thermal *th = &nau8310->thermal;
+	long vol = ucontrol->value.integer.value[0];
+	int ret = 0;
+
+	if (vol < 0 || vol > NAU8310_DAC_VOL_MAX)
+		return -EINVAL;
+	mutex_lock(&th->lock);
+	if (vol != th->dac_vol) {
+		WRITE_ONCE(th->dac_vol, vol);
+		__nau8310_thermal_vol(nau8310);
+		ret = 1;
+	}
+	mutex_unlock(&th->lock);
+
+	return ret;
+}
+
+static int nau8310_vol_ramp_get(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->vol_ramp.rate;
+
+	return 0;
+}
+
+/* applied from the next volume change, 0 writes the volume at once */
+static int nau8310_vol_ramp_put(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	long rate = ucontrol->value.integer.value[0];
+
+	if (rate < 0 || rate > NAU_VOL_RAMP_RATE_MAX)
+		return -EINVAL;
+	if (rate == nau8310->vol_ramp.rate)
+		return 0;
+	WRITE_ONCE(nau8310->vol_ramp.rate, rate);
+
+	return 1;
+}
+
+static int nau8310_boost_adapt_get(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	unsigned int *val = (void *)&nau8310->boost_adapt + mc->reg;
+
+	ucontrol->value.integer.value[0] = *val;
+
+	return 0;
+}
+
+/* The period, floor and release of the adaptive boost. A period set while
+ * the DAC plays starts the sampling, and 0 restores the ceiling.
+ */
+static int nau8310_boost_adapt_put(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
+	unsigned int *val = (void *)bst + mc->reg;
+	long value = ucontrol->value.integer.value[0];
+
+	if (value < mc->min || value > mc->max)
+		return -EINVAL;
+	if (value == *val)
+		return 0;
+	WRITE_ONCE(*val, value);
+	if (bst->active && mc->reg == offsetof(struct nau8310_boost_adapt,
+					       period_ms))
+		mod_delayed_work(system_wq, &bst->work, 0);
+
+	return 1;
+}
+
+/* the member of struct nau8310_boost_adapt by its offset in reg */
+#define NAU8310_BOOST_ADAPT(xname, member, xmax) \
+	SOC_SINGLE_EXT(xname, offsetof(struct nau8310_boost_adapt, member), \
+		       0, xmax, 0, nau8310_boost_adapt_get, \
+		       nau8310_boost_adapt_put)
+
+static int nau8310_echo_ref_get(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8310->echo_ref_slot + 1;
+
+	return 0;
+}
+
+/* The reference moves only while no stream runs, for a fixed delay. */
+static int nau8310_echo_ref_put(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	unsigned int item = ucontrol->value.enumerated.item[0];
+
+	if (item >= e->items)
+		return -EINVAL;
+	if (item == nau8310->echo_ref_slot + 1)
+		return 0;
+	if (snd_soc_component_active(component))
+		return -EBUSY;
+	nau8310->echo_ref_slot = (int)item - 1;
+	nau8310_echo_ref_apply(nau8310);
+
+	return 1;
+}
+
+static int nau8310_echo_ref_delay_get(struct snd_kcontrol *kcontrol,
+				      struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8310->echo_ref_delay;
+
+	return 0;
+}
+
 int nau8310_clkdet_get(struct snd_kcontrol *kcontrol,
 		       struct snd_ctl_elem_value *ucontrol)
 {
@@ -328,34 +597,16 @@ static int nau8310_biq_coeff_put(struct snd_kcontrol *kcontrol,
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
-	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
-	u16 *val, value;
-	int i, reg, ret;
-
-	data = kmemdup(ucontrol->value.bytes.data,
-		       params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
+	int ret;
 
-	val = (u16 *)data;
-	reg = NAU8310_R80_BIQ0_COE_1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		/* conversion of 16-bit integers between native CPU format
-		 * and big endian format
-		 */
-		value = be16_to_cpu(*(val + i));
-		ret = regmap_write(nau8310->regmap, reg + i, value);
-		if (ret) {
-			dev_err(nau8310->dev, "BIQ configuration fail, register: %x ret: %d\n",
-				reg + i, ret);
-			kfree(data);
-			return ret;
-		}
+	ret = nau_biq_rates_write(&nau8310->biq_rates,
+				  ucontrol->value.bytes.data);
+	if (ret < 0) {
+		dev_err(nau8310->dev, "BIQ configuration fail, ret: %d\n", ret);
+		return ret;
 	}
-	kfree(data);
 
-	return 0;
+	return !!ret;
 }
 
 static const char * const nau8310_adc_decimation[] = { "32", "64", "128" };
@@ -401,6 +652,10 @@ static const struct soc_enum nau8310_adc_alcgain_sel_enum =
 			      0xf, ARRAY_SIZE(nau8310_adc_alcgain_slot),
 			      nau8310_adc_alcgain_slot, nau8310_adc_alcgain_val);
 
+static const struct soc_enum nau8310_echo_ref_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8310_adc_alcgain_slot),
+			    nau8310_adc_alcgain_slot);
+
 static const char * const nau8310_adc_isense_slot[] = { "Disable", "Slot 1",
 	"Slot 3", "Slot 5", "Slot 7" };
 
@@ -445,9 +700,22 @@ static const DECLARE_TLV_DB_MINMAX(pga_gain_tlv, 0, 1600);
 static const struct snd_kcontrol_new nau8310_snd_controls[] = {
 	SOC_ENUM("ADC Decimation Rate", nau8310_adc_decimation_enum),
 	SOC_ENUM("DAC Oversampling Rate", nau8310_dac_oversampl_enum),
-	SND_SOC_BYTES_EXT("BIQ Coefficients", 60,
+	SND_SOC_BYTES_EXT("BIQ Coefficients", NAU8310_BIQ_COE_NUM * 2,
 			  nau8310_biq_coeff_get, nau8310_biq_coeff_put),
-
+	SOC_SINGLE_EXT("OSC Switch Delay", SND_SOC_NOPM, 0,
+		       NAU8310_OSC_DELAY_MAX_MS, 0,
+		       nau8310_osc_delay_get, nau8310_osc_delay_put),
+	SOC_SINGLE_EXT("Keepalive Time", SND_SOC_NOPM, 0,
+		       NAU_KEEPALIVE_MAX_MS, 0,
+		       nau8310_keepalive_get, nau8310_keepalive_put),
+
+	SOC_SINGLE_EXT("Speaker Volume", SND_SOC_NOPM, 0,
+		       NAU8310_DAC_VOL_MAX, 0,
+		       nau8310_dac_vol_get, nau8310_dac_vol_put),
+	/* DAC volume codes stepped per 5 ms */
+	SOC_SINGLE_EXT("Volume Ramp Rate", SND_SOC_NOPM, 0,
+		       NAU_VOL_RAMP_RATE_MAX, 0,
+		       nau8310_vol_ramp_get, nau8310_vol_ramp_put),
 	SOC_SINGLE_TLV("ADC Left Channel Volume",
 		       NAU8310_R14_ADC_VOL_CTRL, NAU8310_ADC_GAIN_L_SFT,
 		       NAU8310_ADC_GAIN_L_MAX, 0, adc_vol_tlv),
@@ -465,9 +733,25 @@ static const struct snd_kcontrol_new nau8310_snd_controls[] = {
 	 */
 	SOC_SINGLE("Boost Margin", NAU8310_R17_BOOST_CTRL1,
 		   NAU8310_BSTMARGIN_SFT, NAU8310_BSTMARGIN_MAX, 0),
+	NAU8310_BOOST_ADAPT("Boost Adapt Period", period_ms,
+			    NAU8310_BOOST_PERIOD_MAX_MS),
+	NAU8310_BOOST_ADAPT("Boost Adapt Floor", floor, NAU8310_BSTLIMIT_MAX),
+	NAU8310_BOOST_ADAPT("Boost Adapt Release", release,
+			    NAU8310_BOOST_RELEASE_MAX),
 
 	SOC_ENUM("AEC Channel", nau8310_aec_channel_sel_enum),
 	SOC_ENUM("AEC Source", nau8310_aec_source_sel_enum),
+	SOC_ENUM_EXT("Echo Reference Slot", nau8310_echo_ref_enum,
+		     nau8310_echo_ref_get, nau8310_echo_ref_put),
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "Echo Reference Delay",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ,
+		.info = snd_soc_info_volsw,
+		.get = nau8310_echo_ref_delay_get,
+		.private_value = SOC_SINGLE_VALUE(SND_SOC_NOPM, 0,
+				NAU8310_ECHO_REF_DELAY_MAX, 0, 0),
+	},
 	SOC_ENUM("DAC Channel Source", nau8310_dac_sel_enum),
 	SOC_ENUM("ADC ALC Gain Channel Source", nau8310_adc_alcgain_sel_enum),
 	SOC_ENUM("ADC I Sense Channel Source", nau8310_adc_sel_i_enum),
@@ -535,9 +819,10 @@ static int nau8310_clock_event(struct snd_soc_dapm_widget *w,
 
 	switch (event) {
 	case SND_SOC_DAPM_PRE_PMU:
-		/* Switch the clock source of DSP to MCLK. */
-		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-				   NAU8310_DSP_SEL_OSC, 0);
+		/* Switch the clock source of DSP to MCLK, if it clocks DSP. */
+		if (!nau8310_dsp_on_osc(nau8310))
+			regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
+					   NAU8310_DSP_SEL_OSC, 0);
 		break;
 	default:
 		return -EINVAL;
@@ -553,8 +838,32 @@ static int nau8310_powerup_event(struct snd_soc_dapm_widget *w,
 			snd_soc_dapm_to_component(w->dapm);
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 
-	if (nau8310->clock_detection)
+	nau_keepalive_power(&nau8310->keepalive,
+			    event == SND_SOC_DAPM_POST_PMU);
+
+	/* With the clock detection, the chip powers up by itself and only
+	 * the recovery from a clock loss is armed for the stream.
+	 */
+	if (nau8310->clock_detection) {
+		switch (event) {
+		case SND_SOC_DAPM_POST_PMU:
+			nau8310->clk_armed = true;
+			break;
+		case SND_SOC_DAPM_POST_PMD:
+			nau8310->clk_armed = false;
+			cancel_delayed_work_sync(&nau8310->clk_work);
+			if (nau8310->clk_forced) {
+				regmap_update_bits(nau8310->regmap,
+					NAU8310_R40_CLK_DET_CTRL,
+					NAU8310_PWRUP_DFT, 0);
+				nau8310->clk_forced = false;
+			}
+			break;
+		default:
+			return -EINVAL;
+		}
 		return 0;
+	}
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
@@ -595,83 +904,387 @@ static int nau8310_adc_event(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
-static int nau8310_dac_event(struct snd_soc_dapm_widget *w,
-			     struct snd_kcontrol *kcontrol, int event)
+/* The I2S output is released after the ramp of soft unmute. */
+static void nau8310_unmute_work(struct work_struct *work)
 {
-	struct snd_soc_component *component =
-			snd_soc_dapm_to_component(w->dapm);
-	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, unmute_work.work);
 
-	/* Soft mute to prevent the pop noise */
-	switch (event) {
-	case SND_SOC_DAPM_POST_PMU:
-		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-				   NAU8310_SOFT_MUTE, 0);
-		msleep(30);
-		regmap_update_bits(nau8310->regmap, NAU8310_R0E_I2S_PCM_CTRL2,
-				   NAU8310_I2S_TRISTATE, 0);
-		break;
-	case SND_SOC_DAPM_PRE_PMD:
-		regmap_update_bits(nau8310->regmap, NAU8310_R0E_I2S_PCM_CTRL2,
-				   NAU8310_I2S_TRISTATE, NAU8310_I2S_TRISTATE);
-		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
-				   NAU8310_SOFT_MUTE, NAU8310_SOFT_MUTE);
-		msleep(30);
-		break;
-	default:
-		return -EINVAL;
+	regmap_update_bits(nau8310->regmap, NAU8310_R0E_I2S_PCM_CTRL2,
+			   NAU8310_I2S_TRISTATE, 0);
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_DAC_UNMUTE],
+			nau8310->unmute_start);
+}
+
+/* The demand on the boost: the DSP frame status if the monitor sampled it
+ * lately, or else the DAC volume with a hysteresis between two codes.
+ */
+static bool nau8310_boost_loud(struct nau8310 *nau8310)
+{
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
+	struct nau8310_dsp_monitor *mon = &nau8310->dsp_mon;
+	struct nau8310_dsp_sample *sample;
+	u64 age_ns = U64_MAX;
+	u32 status = 0;
+	unsigned int vol;
+
+	spin_lock(&mon->lock);
+	if (mon->head) {
+		sample = &mon->ring[(mon->head - 1) % NAU8310_DSP_MON_LEN];
+		age_ns = ktime_get_ns() - sample->time_ns;
+		status = sample->frame_status;
 	}
+	spin_unlock(&mon->lock);
+	if (age_ns < 2ULL * bst->period_ms * NSEC_PER_MSEC)
+		return status & (NAU8310_DSP_ALC_STS | NAU8310_DSP_AUD_OVF);
 
-	return 0;
+	if (regmap_read(nau8310->regmap, NAU8310_R13_MUTE_CTRL, &vol))
+		return true;
+	vol &= NAU8310_DAC_VOL_MAX;
+
+	return vol >= (bst->loud ? NAU8310_BOOST_VOL_QUIET :
+		       NAU8310_BOOST_VOL_LOUD);
 }
 
-static int check_dsp_enabled(struct snd_soc_dapm_widget *source,
-			     struct snd_soc_dapm_widget *sink)
+static void nau8310_boost_apply(struct nau8310 *nau8310, unsigned int target)
 {
-	struct snd_soc_component *component =
-			snd_soc_dapm_to_component(source->dapm);
-	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
 
-	return nau8310->dsp_enable;
+	if (target == bst->target)
+		return;
+	if (target > bst->target)
+		bst->raises++;
+	else
+		bst->drops++;
+	bst->target = target;
+	regmap_update_bits(nau8310->regmap, NAU8310_R17_BOOST_CTRL1,
+			   NAU8310_BSTLIMIT_MASK, target << NAU8310_BSTLIMIT_SFT);
 }
 
-static const struct snd_soc_dapm_widget nau8310_dapm_widgets[] = {
-	SND_SOC_DAPM_SUPPLY("Clock", SND_SOC_NOPM, 0, 0,
-			    nau8310_clock_event, SND_SOC_DAPM_PRE_PMU),
-	SND_SOC_DAPM_SUPPLY("PowerUp", SND_SOC_NOPM, 0, 0,
-			    nau8310_powerup_event, SND_SOC_DAPM_POST_PMU |
-			    SND_SOC_DAPM_POST_PMD),
+/* Fast attack and slow release of the boost target between the floor and
+ * the target limit the stream started with.
+ */
+static void nau8310_boost_work(struct work_struct *work)
+{
+	struct nau8310_boost_adapt *bst = container_of(to_delayed_work(work),
+					struct nau8310_boost_adapt, work);
+	struct nau8310 *nau8310 =
+		container_of(bst, struct nau8310, boost_adapt);
+	unsigned int period = READ_ONCE(bst->period_ms);
+	unsigned int target = bst->target;
+
+	if (!period) {
+		nau8310_boost_apply(nau8310, bst->ceiling);
+		return;
+	}
 
-	SND_SOC_DAPM_SWITCH_E("ALC gain selection mode", SND_SOC_NOPM,
-			      0, 0, &nau8310_alc_gain_select, nau8310_adc_event,
-			      SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+	bst->samples++;
+	bst->loud = nau8310_boost_loud(nau8310);
+	if (bst->loud) {
+		bst->quiet = 0;
+		target = bst->ceiling;
+	} else if (++bst->quiet >= bst->release) {
+		bst->quiet = 0;
+		if (target > bst->floor)
+			target--;
+	}
+	nau8310_boost_apply(nau8310, target);
+	bst->saved_step_ms += (u64)(bst->ceiling - bst->target) * period;
 
-	SND_SOC_DAPM_SIGGEN("Sense"),
+	schedule_delayed_work(&bst->work, msecs_to_jiffies(period));
+}
 
-	SND_SOC_DAPM_PGA("SAR", NAU8310_R07_SAR_CTRL1, NAU8310_SAR_ENA_SFT,
-			 0, NULL, 0),
-	SND_SOC_DAPM_PGA("ADC_I", NAU8310_R04_ENA_CTRL,
-			 NAU8310_ADCEN_I_SFT, 0, NULL, 0),
-	SND_SOC_DAPM_PGA("ADC_V", NAU8310_R04_ENA_CTRL,
-			 NAU8310_ADCEN_V_SFT, 0, NULL, 0),
-	SND_SOC_DAPM_PGA("Capture Sense", SND_SOC_NOPM, 0, 0, NULL, 0),
+/* The ceiling is the target limit programmed, by property or control. */
+static void nau8310_boost_start(struct nau8310 *nau8310)
+{
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
+	unsigned int value;
+
+	if (nau8310->silicon_id != NAU8310_REG_SI_REV_G10 ||
+		!(nau8310->boost_convert_enable & 0x1) ||
+		regmap_read(nau8310->regmap, NAU8310_R17_BOOST_CTRL1, &value))
+		return;
+	bst->ceiling = bst->target = (value & NAU8310_BSTLIMIT_MASK) >>
+		NAU8310_BSTLIMIT_SFT;
+	bst->quiet = 0;
+	bst->loud = true;
+	bst->active = true;
+	if (bst->period_ms)
+		schedule_delayed_work(&bst->work,
+				      msecs_to_jiffies(bst->period_ms));
+}
 
-	SND_SOC_DAPM_ADC_E("ADC_OUT", "Capture", SND_SOC_NOPM, 0, 0,
-			   nau8310_adc_event, SND_SOC_DAPM_POST_PMU |
-			   SND_SOC_DAPM_POST_PMD),
+/* the next stream starts from the ceiling */
+static void nau8310_boost_stop(struct nau8310 *nau8310)
+{
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
 
-	SND_SOC_DAPM_AIF_IN("AIFRX", "Playback", 0, SND_SOC_NOPM, 0, 0),
+	if (!bst->active)
+		return;
+	bst->active = false;
+	cancel_delayed_work_sync(&bst->work);
+	nau8310_boost_apply(nau8310, bst->ceiling);
+}
 
-	SND_SOC_DAPM_DAC_E("DAC", NULL, NAU8310_R04_ENA_CTRL,
-			   NAU8310_DAC_CH_EN_SFT, 0,
-			   nau8310_dac_event, SND_SOC_DAPM_POST_PMU |
-			   SND_SOC_DAPM_PRE_PMD),
+/* The DAC volume less the backoff applied, with @th->lock held */
+static void __nau8310_thermal_vol(struct nau8310 *nau8310)
+{
+	struct nau8310_thermal *th = &nau8310->thermal;
+	unsigned int att = th->applied * NAU8310_THERMAL_STEP;
+	unsigned int vol = th->dac_vol > att ? th->dac_vol - att : 0;
 
-	SND_SOC_DAPM_OUTPUT("Speaker"),
-};
+	nau_vol_ramp_set(&nau8310->vol_ramp, &vol);
+}
 
-static const struct snd_soc_dapm_route nau8310_dapm_routes[] = {
-	{ "SAR", NULL, "Sense" },
+static void nau8310_thermal_apply(struct nau8310 *nau8310)
+{
+	struct nau8310_thermal *th = &nau8310->thermal;
+	unsigned int state;
+
+	mutex_lock(&th->lock);
+	state = max_t(unsigned int, th->cdev_state, th->otp_state);
+	if (state == th->applied)
+		goto unlock;
+	if (state > th->applied)
+		th->backoffs++;
+	th->applied = state;
+	__nau8310_thermal_vol(nau8310);
+unlock:
+	mutex_unlock(&th->lock);
+}
+
+/* The over temperature of the last DSP frame status the monitor sampled,
+ * so the thermal monitor costs no bus access of its own. The backoff
+ * steps up for each report and down after NAU8310_THERMAL_RELEASE quiet
+ * samples; the period backs off while there is nothing to release.
+ */
+static void nau8310_thermal_work(struct work_struct *work)
+{
+	struct nau8310_thermal *th = container_of(to_delayed_work(work),
+					struct nau8310_thermal, work);
+	struct nau8310 *nau8310 = container_of(th, struct nau8310, thermal);
+	struct nau8310_dsp_monitor *mon = &nau8310->dsp_mon;
+	unsigned int period = READ_ONCE(th->period_ms);
+	struct nau8310_dsp_sample *sample;
+	u64 age_ns = U64_MAX;
+	u32 status = 0;
+
+	if (!period)
+		return;
+
+	spin_lock(&mon->lock);
+	if (mon->head) {
+		sample = &mon->ring[(mon->head - 1) % NAU8310_DSP_MON_LEN];
+		age_ns = ktime_get_ns() - sample->time_ns;
+		status = sample->frame_status;
+	}
+	spin_unlock(&mon->lock);
+	/* a sample of the last period only, the monitor may have stopped */
+	if (age_ns >= 2ULL * (period << th->idle_shift) * NSEC_PER_MSEC)
+		status = 0;
+
+	if (status & NAU8310_DSP_OCP_OTP) {
+		th->otp_events++;
+		th->quiet = 0;
+		th->idle_shift = 0;
+		if (th->otp_state < th->max_state)
+			th->otp_state++;
+	} else if (th->otp_state) {
+		if (++th->quiet >= NAU8310_THERMAL_RELEASE) {
+			th->quiet = 0;
+			th->otp_state--;
+		}
+	} else if (th->idle_shift < NAU8310_THERMAL_IDLE_SHIFT_MAX) {
+		th->idle_shift++;
+	}
+	nau8310_thermal_apply(nau8310);
+
+	/* the backoff is released after the playback too */
+	if (th->active || th->otp_state)
+		schedule_delayed_work(&th->work,
+				      msecs_to_jiffies(period << th->idle_shift));
+}
+
+static void nau8310_thermal_start(struct nau8310 *nau8310)
+{
+	struct nau8310_thermal *th = &nau8310->thermal;
+
+	th->active = true;
+	if (th->max_state && th->period_ms) {
+		th->idle_shift = 0;
+		mod_delayed_work(system_wq, &th->work, 0);
+	}
+}
+
+static int nau8310_thermal_get_max_state(struct thermal_cooling_device *cdev,
+					 unsigned long *state)
+{
+	struct nau8310 *nau8310 = cdev->devdata;
+
+	*state = nau8310->thermal.max_state;
+
+	return 0;
+}
+
+static int nau8310_thermal_get_cur_state(struct thermal_cooling_device *cdev,
+					 unsigned long *state)
+{
+	struct nau8310 *nau8310 = cdev->devdata;
+
+	*state = nau8310->thermal.cdev_state;
+
+	return 0;
+}
+
+static int nau8310_thermal_set_cur_state(struct thermal_cooling_device *cdev,
+					 unsigned long state)
+{
+	struct nau8310 *nau8310 = cdev->devdata;
+
+	if (state > nau8310->thermal.max_state)
+		return -EINVAL;
+	nau8310->thermal.cdev_state = state;
+	nau8310_thermal_apply(nau8310);
+
+	return 0;
+}
+
+static const struct thermal_cooling_device_ops nau8310_cooling_ops = {
+	.get_max_state = nau8310_thermal_get_max_state,
+	.get_cur_state = nau8310_thermal_get_cur_state,
+	.set_cur_state = nau8310_thermal_set_cur_state,
+};
+
+/* The volume programmed by the initiation is the one without backoff,
+ * and the one the volume ramp starts from.
+ */
+static int nau8310_thermal_init(struct nau8310 *nau8310)
+{
+	struct nau8310_thermal *th = &nau8310->thermal;
+	struct device *dev = nau8310->dev;
+	struct thermal_cooling_device *cdev;
+	static const unsigned int shift = NAU8310_DAC_VOL_SFT;
+	int ret;
+
+	mutex_init(&th->lock);
+	ret = devm_delayed_work_autocancel(dev, &th->work, nau8310_thermal_work);
+	if (ret)
+		return ret;
+	ret = nau_vol_ramp_init(&nau8310->vol_ramp, nau8310->regmap,
+				NAU8310_R13_MUTE_CTRL, NAU8310_DAC_VOL_MAX, 1,
+				&shift);
+	if (ret)
+		return ret;
+	th->dac_vol = nau8310->vol_ramp.target[0];
+	if (!th->max_state)
+		return 0;
+
+	cdev = devm_thermal_of_cooling_device_register(dev, dev->of_node,
+						       "nau8310", nau8310,
+						       &nau8310_cooling_ops);
+	if (IS_ERR(cdev)) {
+		/* the monitor of DSP backs off the volume still */
+		dev_warn(dev, "No cooling device (%ld)\n", PTR_ERR(cdev));
+		return 0;
+	}
+	th->cdev = cdev;
+
+	return 0;
+}
+
+static int nau8310_dac_event(struct snd_soc_dapm_widget *w,
+			     struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component =
+			snd_soc_dapm_to_component(w->dapm);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	s64 remain_us;
+
+	/* Soft mute to prevent the pop noise. The ramps of the amplifiers on
+	 * a card overlap; unmute completes in background, and mute of every
+	 * amplifier starts before the DAPM sequence waits for any one.
+	 */
+	switch (event) {
+	case SND_SOC_DAPM_POST_PMU:
+		nau8310->unmute_start = ktime_get();
+		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
+				   NAU8310_SOFT_MUTE, 0);
+		schedule_delayed_work(&nau8310->unmute_work,
+				      msecs_to_jiffies(SOFT_MUTE_RAMP_MS));
+		nau8310_boost_start(nau8310);
+		nau8310_thermal_start(nau8310);
+		break;
+	case SND_SOC_DAPM_WILL_PMD:
+		nau8310->thermal.active = false;
+		nau8310_boost_stop(nau8310);
+		cancel_delayed_work_sync(&nau8310->unmute_work);
+		regmap_update_bits(nau8310->regmap, NAU8310_R0E_I2S_PCM_CTRL2,
+				   NAU8310_I2S_TRISTATE, NAU8310_I2S_TRISTATE);
+		regmap_update_bits(nau8310->regmap, NAU8310_R13_MUTE_CTRL,
+				   NAU8310_SOFT_MUTE, NAU8310_SOFT_MUTE);
+		nau8310->mute_start = ktime_get();
+		break;
+	case SND_SOC_DAPM_PRE_PMD:
+		/* the rest of the mute ramp before the DAC powers down */
+		remain_us = SOFT_MUTE_RAMP_MS * USEC_PER_MSEC -
+			ktime_us_delta(ktime_get(), nau8310->mute_start);
+		if (remain_us > 0)
+			fsleep(remain_us);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int check_dsp_enabled(struct snd_soc_dapm_widget *source,
+			     struct snd_soc_dapm_widget *sink)
+{
+	struct snd_soc_component *component =
+			snd_soc_dapm_to_component(source->dapm);
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	return nau8310_dsp_active(nau8310);
+}
+
+static const struct snd_soc_dapm_widget nau8310_dapm_widgets[] = {
+	SND_SOC_DAPM_SUPPLY("Clock", SND_SOC_NOPM, 0, 0,
+			    nau8310_clock_event, SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_SUPPLY("PowerUp", SND_SOC_NOPM, 0, 0,
+			    nau8310_powerup_event, SND_SOC_DAPM_POST_PMU |
+			    SND_SOC_DAPM_POST_PMD),
+
+	SND_SOC_DAPM_SWITCH_E("ALC gain selection mode", SND_SOC_NOPM,
+			      0, 0, &nau8310_alc_gain_select, nau8310_adc_event,
+			      SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+
+	SND_SOC_DAPM_SIGGEN("Sense"),
+
+	SND_SOC_DAPM_PGA("SAR", NAU8310_R07_SAR_CTRL1, NAU8310_SAR_ENA_SFT,
+			 0, NULL, 0),
+	SND_SOC_DAPM_PGA("ADC_I", NAU8310_R04_ENA_CTRL,
+			 NAU8310_ADCEN_I_SFT, 0, NULL, 0),
+	SND_SOC_DAPM_PGA("ADC_V", NAU8310_R04_ENA_CTRL,
+			 NAU8310_ADCEN_V_SFT, 0, NULL, 0),
+	SND_SOC_DAPM_PGA("Capture Sense", SND_SOC_NOPM, 0, 0, NULL, 0),
+
+	SND_SOC_DAPM_ADC_E("ADC_OUT", "Capture", SND_SOC_NOPM, 0, 0,
+			   nau8310_adc_event, SND_SOC_DAPM_POST_PMU |
+			   SND_SOC_DAPM_POST_PMD),
+
+	SND_SOC_DAPM_AIF_IN("AIFRX", "Playback", 0, SND_SOC_NOPM, 0, 0),
+
+	SND_SOC_DAPM_DAC_E("DAC", NULL, NAU8310_R04_ENA_CTRL,
+			   NAU8310_DAC_CH_EN_SFT, 0,
+			   nau8310_dac_event, SND_SOC_DAPM_POST_PMU |
+			   SND_SOC_DAPM_WILL_PMD | SND_SOC_DAPM_PRE_PMD),
+
+	SND_SOC_DAPM_OUTPUT("Speaker"),
+};
+
+static const struct snd_soc_dapm_route nau8310_dapm_routes[] = {
+	{ "SAR", NULL, "Sense" },
 	{ "ADC_I", NULL, "Sense" },
 	{ "ADC_V", NULL, "Sense" },
 	{ "Capture Sense", NULL, "SAR" },
@@ -692,8 +1305,13 @@ static int nau8310_srate_clk_apply(struct nau8310 *nau8310,
 				   const struct nau8310_srate_attr *srate_table,
 				   int n1_sel, int mclk_mult_sel, int n2_sel, int dsp_mult_sel)
 {
+	struct nau_reg_txn txn;
+	bool dsp_osc = dsp_mult_sel == CLK_PROC_OSC;
 	int dsp_clk, mult_sel;
 
+	/* the DSP on the OSC keeps the DSP source of the OSC clocks */
+	if (dsp_osc)
+		dsp_mult_sel = nau8310->clk_osc.dsp_mult_sel;
 	if (!srate_table || srate_table->adc_div < 0 ||
 		dsp_mult_sel < 0 || dsp_mult_sel >= ARRAY_SIZE(dsp_src_mult) ||
 		n2_sel < 0 || n2_sel >= ARRAY_SIZE(mclk_n2_div) ||
@@ -702,66 +1320,82 @@ static int nau8310_srate_clk_apply(struct nau8310 *nau8310,
 			nau8310->fs);
 		return -EINVAL;
 	}
-	regmap_update_bits(nau8310->regmap, NAU8310_R03_CLK_CTRL,
-			   NAU8310_CLK_ADC_DIV2 | NAU8310_CLK_ADC_DIV4,
-			   srate_table->adc_div << NAU8310_CLK_ADC_DIV4_SFT);
-	regmap_update_bits(nau8310->regmap, NAU8310_R40_CLK_DET_CTRL,
-			   NAU8310_SRATE_MASK | NAU8310_DIV_MAX,
-			   (srate_table->range << NAU8310_SRATE_SFT) |
-			   (srate_table->max ? NAU8310_DIV_MAX : 0));
-	if (srate_table->fs == 44100)
-		regmap_update_bits(nau8310->regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_ALT_SRATE_EN, NAU8310_ALT_SRATE_EN);
-	else
-		regmap_update_bits(nau8310->regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_ALT_SRATE_EN, 0);
-
-	dsp_clk = nau8310->mclk << dsp_src_mult[dsp_mult_sel].param;
-	dsp_clk = dsp_clk / mclk_n1_div[n1_sel].param;
-
-	dev_dbg(nau8310->dev, "FS %dHz, DSP_CLK %uHz, n1_sel (%d), mclk_mult_sel (%d), n2_sel (%d), dsp_mult_sel (%d).\n",
-		nau8310->fs, dsp_clk, n1_sel, mclk_mult_sel, n2_sel, dsp_mult_sel);
+	nau_reg_txn_begin(&txn, nau8310->regmap);
+	nau_reg_txn_update_bits(&txn, NAU8310_R03_CLK_CTRL,
+				NAU8310_CLK_ADC_DIV2 | NAU8310_CLK_ADC_DIV4,
+				srate_table->adc_div << NAU8310_CLK_ADC_DIV4_SFT);
+	nau_reg_txn_update_bits(&txn, NAU8310_R40_CLK_DET_CTRL,
+				NAU8310_SRATE_MASK | NAU8310_DIV_MAX |
+				NAU8310_ALT_SRATE_EN,
+				(srate_table->range << NAU8310_SRATE_SFT) |
+				(srate_table->max ? NAU8310_DIV_MAX : 0) |
+				(srate_table->fs == 44100 ? NAU8310_ALT_SRATE_EN : 0));
+
+	if (dsp_osc) {
+		dsp_clk = nau8310->dsp_osc_rate;
+	} else {
+		dsp_clk = nau8310->mclk << dsp_src_mult[dsp_mult_sel].param;
+		dsp_clk = dsp_clk / mclk_n1_div[n1_sel].param;
+	}
 
-	regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-			   NAU8310_CLK_DSP_SRC_MASK,
-			   dsp_src_mult[dsp_mult_sel].val << NAU8310_CLK_DSP_SRC_SFT);
-	regmap_update_bits(nau8310->regmap, NAU8310_R03_CLK_CTRL,
-			   NAU8310_MCLK_SRC_MASK, mclk_n2_div[n2_sel].val);
-	regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-			   NAU8310_CLK_MUL_SRC_MASK,
-			   mclk_n1_div[n1_sel].val << NAU8310_CLK_MUL_SRC_SFT);
+	dev_dbg(nau8310->dev, "FS %dHz, DSP_CLK %uHz%s, n1_sel (%d), mclk_mult_sel (%d), n2_sel (%d), dsp_mult_sel (%d).\n",
+		nau8310->fs, dsp_clk, dsp_osc ? " OSC" : "", n1_sel,
+		mclk_mult_sel, n2_sel, dsp_mult_sel);
+
+	nau_reg_txn_update_bits(&txn, NAU8310_R04_ENA_CTRL,
+				NAU8310_CLK_DSP_SRC_MASK,
+				dsp_src_mult[dsp_mult_sel].val << NAU8310_CLK_DSP_SRC_SFT);
+	if (dsp_osc)
+		nau_reg_txn_update_bits(&txn, NAU8310_R04_ENA_CTRL,
+					NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC,
+					NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC);
+	nau_reg_txn_update_bits(&txn, NAU8310_R03_CLK_CTRL,
+				NAU8310_MCLK_SRC_MASK, mclk_n2_div[n2_sel].val);
+	nau_reg_txn_update_bits(&txn, NAU8310_R04_ENA_CTRL,
+				NAU8310_CLK_MUL_SRC_MASK,
+				mclk_n1_div[n1_sel].val << NAU8310_CLK_MUL_SRC_SFT);
 	if (mclk_mult_sel != CLK_PROC_BYPASS) {
-		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-				   NAU8310_MCLK_SEL_MASK,
-				   mclk_src_mult[mclk_mult_sel].val <<
-				   NAU8310_MCLK_SEL_SFT);
+		nau_reg_txn_update_bits(&txn, NAU8310_R04_ENA_CTRL,
+					NAU8310_MCLK_SEL_MASK,
+					mclk_src_mult[mclk_mult_sel].val <<
+					NAU8310_MCLK_SEL_SFT);
 		mult_sel = (mclk_mult_sel > dsp_mult_sel ? mclk_mult_sel : dsp_mult_sel);
 	} else {
 		mult_sel = dsp_mult_sel;
-		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-						   NAU8310_MCLK_SEL_MASK, 0);
+		nau_reg_txn_update_bits(&txn, NAU8310_R04_ENA_CTRL,
+					NAU8310_MCLK_SEL_MASK, 0);
 	}
 	switch (mult_sel) {
 	case 4:	/* multiplier 16x, i.e. 2^4 */
-		regmap_update_bits(nau8310->regmap, NAU8310_R68_ANALOG_CONTROL_7,
-				   NAU8310_MCLKX_MASK, NAU8310_MCLK16XEN |
-				   NAU8310_MCLK8XEN | NAU8310_MCLK4XEN);
+		nau_reg_txn_update_bits(&txn, NAU8310_R68_ANALOG_CONTROL_7,
+					NAU8310_MCLKX_MASK, NAU8310_MCLK16XEN |
+					NAU8310_MCLK8XEN | NAU8310_MCLK4XEN);
 		break;
 	case 3:	/* multiplier 8x, i.e. 2^3 */
-		regmap_update_bits(nau8310->regmap, NAU8310_R68_ANALOG_CONTROL_7,
-				   NAU8310_MCLKX_MASK, NAU8310_MCLK8XEN |
-				   NAU8310_MCLK4XEN);
+		nau_reg_txn_update_bits(&txn, NAU8310_R68_ANALOG_CONTROL_7,
+					NAU8310_MCLKX_MASK, NAU8310_MCLK8XEN |
+					NAU8310_MCLK4XEN);
 		break;
 	case 2:	/* multiplier 4x, i.e. 2^2 */
-		regmap_update_bits(nau8310->regmap, NAU8310_R68_ANALOG_CONTROL_7,
-				   NAU8310_MCLKX_MASK, NAU8310_MCLK4XEN);
+		nau_reg_txn_update_bits(&txn, NAU8310_R68_ANALOG_CONTROL_7,
+					NAU8310_MCLKX_MASK, NAU8310_MCLK4XEN);
 		break;
 	default:
 		return -EINVAL;
 	}
+	WRITE_ONCE(nau8310->dsp_clk_rate, dsp_clk);
 
-	return 0;
+	/* each clock register is programmed once */
+	return nau_reg_txn_commit(&txn);
+}
+
+/* Returns true if the clocks of the stream run the DSP on the OSC */
+bool nau8310_dsp_on_osc(struct nau8310 *nau8310)
+{
+	return nau8310->clk_applied.mclk &&
+		nau8310->clk_applied.dsp_mult_sel == CLK_PROC_OSC;
 }
+EXPORT_SYMBOL_GPL(nau8310_dsp_on_osc);
 
 int nau8310_clkdsp_choose(struct nau8310 *nau8310, int *n1_sel, bool n1_try,
 			  int *dsp_n1_sel, int *dsp_mult_sel)
@@ -834,7 +1468,17 @@ int nau8310_clkdsp_choose(struct nau8310 *nau8310, int *n1_sel, bool n1_try,
 	return 0;
 
 proc_err:
-	return -EINVAL;
+	/* A MCLK too slow for DSP, like BCLK of two slots, still clocks the
+	 * audio path; the DSP falls back to the internal OSC.
+	 */
+	if (!nau8310->mclk || !nau8310->dsp_osc_rate)
+		return -EINVAL;
+	if (!n1_try) {
+		*dsp_n1_sel = n1_sel ? *n1_sel : CLK_N1_DIV1;
+		*dsp_mult_sel = CLK_PROC_OSC;
+	}
+
+	return 0;
 }
 
 static int nau8310_clock_check(struct nau8310 *nau8310, int stream, int rate,
@@ -847,7 +1491,7 @@ static int nau8310_clock_check(struct nau8310 *nau8310, int stream, int rate,
 			goto err;
 		osrate = osr_dac_sel[osr].osr;
 	} else {
-		if (nau8310->dsp_enable)
+		if (nau8310_dsp_active(nau8310))
 			if (osr >= ARRAY_SIZE(osr_adc_dsp_sel))
 				goto err;
 			else
@@ -887,6 +1531,9 @@ static int nau8310_osr_apply(struct nau8310 *nau8310)
 	regmap_update_bits(nau8310->regmap, NAU8310_R03_CLK_CTRL,
 			   NAU8310_CLK_DAC_SRC_MASK,
 			   osr_dac_sel[osr].clk_src << NAU8310_CLK_DAC_SRC_SFT);
+	nau_delay_set(&nau8310->delay, stream,
+		      nau_delay_filter_frames(&nau8310_dac_filter,
+					      osr_dac_sel[osr].osr));
 
 	regmap_read(nau8310->regmap, NAU8310_R28_ADC_RATE, &osr);
 	osr &= NAU8310_ADC_SYNC_DOWN_MASK;
@@ -894,14 +1541,21 @@ static int nau8310_osr_apply(struct nau8310 *nau8310)
 	if (nau8310_clock_check(nau8310, stream, nau8310->fs, osr))
 		return -EINVAL;
 
-	if (nau8310->dsp_enable) {
+	if (nau8310_dsp_active(nau8310)) {
 		regmap_update_bits(nau8310->regmap, NAU8310_R03_CLK_CTRL,
 				   NAU8310_CLK_ADC_SRC_MASK,
 				   osr_adc_dsp_sel[osr].clk_src << NAU8310_CLK_ADC_SRC_SFT);
+		/* the ADC samples at a quarter of the frame rate for DSP */
+		nau_delay_set(&nau8310->delay, stream, 4 *
+			      nau_delay_filter_frames(&nau8310_adc_filter,
+						      osr_adc_dsp_sel[osr].osr));
 	} else {
 		regmap_update_bits(nau8310->regmap, NAU8310_R03_CLK_CTRL,
 				   NAU8310_CLK_ADC_SRC_MASK,
 				   osr_adc_sel[osr].clk_src << NAU8310_CLK_ADC_SRC_SFT);
+		nau_delay_set(&nau8310->delay, stream,
+			      nau_delay_filter_frames(&nau8310_adc_filter,
+						      osr_adc_sel[osr].osr));
 	}
 
 	return 0;
@@ -948,10 +1602,23 @@ proc_err:
 	return NULL;
 }
 
+static const struct nau8310_clk_preset *nau8310_clk_preset_find(int mclk, int fs)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(clk_preset_table); i++)
+		if (clk_preset_table[i].mclk == mclk &&
+			clk_preset_table[i].fs == fs)
+			return &clk_preset_table[i];
+
+	return NULL;
+}
+
 static int nau8310_clksrc_choose(struct nau8310 *nau8310,
 				 const struct nau8310_srate_attr **srate_table,
 				 int *n1_sel, int *mult_sel, int *n2_sel, int *dsp_mult_sel)
 {
+	const struct nau8310_clk_preset *preset;
 	int i, j, mclk, mclk_max, ratio, ratio_sel, n2_max, ret;
 
 	if (!nau8310->mclk || !nau8310->fs)
@@ -962,6 +1629,18 @@ static int nau8310_clksrc_choose(struct nau8310 *nau8310,
 	if (*srate_table == NULL)
 		goto proc_err;
 
+	preset = nau8310_clk_preset_find(nau8310->mclk, nau8310->fs);
+	if (preset) {
+		*n1_sel = preset->n1_sel;
+		*mult_sel = preset->mult_sel;
+		*n2_sel = preset->n2_sel;
+		*dsp_mult_sel = preset->dsp_mult_sel;
+		dev_dbg(nau8310->dev, "FS %dHz, MCLK %dHz, preset (n1,mu,n2,dmu):(%d,%d,%d,%d)\n",
+			nau8310->fs, nau8310->mclk, *n1_sel, *mult_sel, *n2_sel,
+			*dsp_mult_sel);
+		return 0;
+	}
+
 	/* First check clock from MCLK directly, decide N2 for MCLK_SRC.
 	 * If not good, consider 1/N1 and Multiplier.
 	 */
@@ -1022,27 +1701,125 @@ proc_done:
 	return 0;
 }
 
-static int nau8310_clock_config(struct nau8310 *nau8310)
+static bool nau8310_clk_solution_same(const struct nau8310_clk_solution *a,
+				      const struct nau8310_clk_solution *b)
 {
-	const struct nau8310_srate_attr *srate_table;
-	int ret, n1_sel, mult_sel, n2_sel, dsp_mult_sel;
+	return a->mclk == b->mclk && a->fs == b->fs &&
+		a->dsp_enable == b->dsp_enable &&
+		a->srate_table == b->srate_table && a->n1_sel == b->n1_sel &&
+		a->mult_sel == b->mult_sel && a->n2_sel == b->n2_sel &&
+		a->dsp_mult_sel == b->dsp_mult_sel;
+}
 
-	ret = nau8310_clksrc_choose(nau8310, &srate_table, &n1_sel, &mult_sel,
-				    &n2_sel, &dsp_mult_sel);
-	if (ret)
-		goto err;
-	ret = nau8310_srate_clk_apply(nau8310, srate_table, n1_sel, mult_sel,
-				      n2_sel, dsp_mult_sel);
-	if (ret)
-		goto err;
+/* Look up the clock solution of current MCLK and fs in the cache. If missed,
+ * choose clock source and keep the result in the cache in round robin.
+ */
+static const struct nau8310_clk_solution *
+nau8310_clk_solve(struct nau8310 *nau8310)
+{
+	struct nau8310_clk_solution *sol;
+	int i, ret;
+
+	for (i = 0; i < NAU8310_CLK_CACHE_NUM; i++) {
+		sol = &nau8310->clk_cache[i];
+		if (sol->mclk && sol->mclk == nau8310->mclk &&
+			sol->fs == nau8310->fs &&
+			sol->dsp_enable == nau8310->dsp_enable)
+			return sol;
+	}
 
-	ret = nau8310_osr_apply(nau8310);
+	sol = &nau8310->clk_cache[nau8310->clk_cache_next];
+	sol->mclk = 0;
+	ret = nau8310_clksrc_choose(nau8310, &sol->srate_table, &sol->n1_sel,
+				    &sol->mult_sel, &sol->n2_sel,
+				    &sol->dsp_mult_sel);
 	if (ret)
-		goto err;
+		return ERR_PTR(ret);
+	sol->mclk = nau8310->mclk;
+	sol->fs = nau8310->fs;
+	sol->dsp_enable = nau8310->dsp_enable;
+	nau8310->clk_cache_next =
+		(nau8310->clk_cache_next + 1) % NAU8310_CLK_CACHE_NUM;
+
+	return sol;
+}
 
-	return 0;
-err:
-	return ret;
+/* Program the clock solution, the registers keep the one applied last time */
+static int nau8310_clk_apply(struct nau8310 *nau8310,
+			     const struct nau8310_clk_solution *sol)
+{
+	int ret;
+
+	if (!nau8310_clk_solution_same(sol, &nau8310->clk_applied)) {
+		nau8310->clk_applied.mclk = 0;
+		ret = nau8310_srate_clk_apply(nau8310, sol->srate_table,
+					      sol->n1_sel, sol->mult_sel,
+					      sol->n2_sel, sol->dsp_mult_sel);
+		if (ret)
+			return ret;
+		nau8310->clk_applied = *sol;
+	}
+
+	return nau8310_osr_apply(nau8310);
+}
+
+static int nau8310_clock_config(struct nau8310 *nau8310)
+{
+	const struct nau8310_clk_solution *sol;
+
+	sol = nau8310_clk_solve(nau8310);
+	if (IS_ERR(sol))
+		return PTR_ERR(sol);
+
+	return nau8310_clk_apply(nau8310, sol);
+}
+
+/* Back to the clocks of the internal OSC without solving them again. The
+ * solution doesn't depend on DSP, only the oversampling does.
+ */
+static int nau8310_clock_osc(struct nau8310 *nau8310)
+{
+	struct nau8310_clk_solution sol = nau8310->clk_osc;
+
+	nau8310->fs = sol.fs;
+	nau8310->mclk = sol.mclk;
+	sol.dsp_enable = nau8310->dsp_enable;
+
+	return nau8310_clk_apply(nau8310, &sol);
+}
+
+/* The clock detection powers the chip down when the host stops BCLK/MCLK,
+ * and waits for the clocks long before it powers up again. The clocks
+ * staged for the stream are programmed again, and the power up is forced
+ * at once, then given back to the detection after CLK_REARM_MS.
+ */
+static void nau8310_clk_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, clk_work.work);
+	struct nau8310_clk_solution sol = nau8310->clk_applied;
+
+	if (!nau8310->clk_armed)
+		return;
+
+	if (nau8310->clk_forced) {
+		regmap_update_bits(nau8310->regmap, NAU8310_R40_CLK_DET_CTRL,
+				   NAU8310_PWRUP_DFT, 0);
+		nau8310->clk_forced = false;
+		return;
+	}
+
+	nau8310->clk_applied.mclk = 0;
+	if (sol.mclk && nau8310_clk_apply(nau8310, &sol))
+		dev_warn(nau8310->dev, "Can't restore clocks after the loss\n");
+	regmap_update_bits(nau8310->regmap, NAU8310_R40_CLK_DET_CTRL,
+			   NAU8310_PWRUP_DFT, NAU8310_PWRUP_DFT);
+	nau8310->clk_forced = true;
+	nau8310->clk_recoveries++;
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_CLK_RECOVERY],
+			nau8310->clk_loss_start);
+	schedule_delayed_work(&nau8310->clk_work,
+			      msecs_to_jiffies(CLK_REARM_MS));
 }
 
 static int nau8310_trigger(struct snd_pcm_substream *substream,
@@ -1050,6 +1827,7 @@ static int nau8310_trigger(struct snd_pcm_substream *substream,
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	ktime_t start = ktime_get();
 
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_STOP:
@@ -1060,6 +1838,7 @@ static int nau8310_trigger(struct snd_pcm_substream *substream,
 		dev_dbg(component->dev, "Switch the clock source of DSP to OSC");
 		break;
 	}
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_TRIGGER], start);
 
 	return 0;
 }
@@ -1070,17 +1849,45 @@ static int nau8310_hw_params(struct snd_pcm_substream *substream,
 	struct snd_soc_component *component = dai->component;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0;
+	ktime_t start = ktime_get();
 	int ret;
 
+	/* The clocks stay as they are, unless lost to the internal OSC or
+	 * changed for the DSP. The OSR are controls, so their clock sources
+	 * follow them each time.
+	 */
+	if (nau8310->clk_applied.mclk &&
+	    nau8310->clk_applied.mclk == nau8310->mclk &&
+	    nau8310->clk_applied.fs == params_rate(params) &&
+	    nau8310->clk_applied.dsp_enable == nau8310->dsp_enable &&
+	    nau_hw_params_skip(&nau8310->hw_params_cache, substream->stream,
+			       params)) {
+		ret = nau8310_osr_apply(nau8310);
+		goto err;
+	}
+
 	nau8310->fs = params_rate(params);
-	if (nau8310->dsp_enable && nau8310->fs != 48000) {
+	if (nau8310_dsp_active(nau8310) && nau8310->fs != 48000) {
 		dev_err(nau8310->dev, "For ROM Code revision 00, DSP only run at 48kHz.\n");
 		return -EINVAL;
 	}
+	if (nau8310->sysclk_id == NAU8310_CLK_ID_BCLK) {
+		ret = snd_soc_tdm_params_to_bclk(params,
+			nau8310->tdm_slot_width, nau8310->tdm_slots, 1);
+		if (ret < 0)
+			goto err;
+		ret = nau8310_set_mclk(nau8310, ret);
+		if (ret)
+			goto err;
+	}
 	ret = nau8310_clock_config(nau8310);
 	if (ret)
 		goto err;
 
+	/* S24_LE has 24 bits of data in a 32-bit slot: the word length is
+	 * the data width, while the BCLK above counts the slot of the
+	 * physical width, unless the TDM slots set their own width.
+	 */
 	switch (params_width(params)) {
 	case 16:
 		val_len |= NAU8310_I2S_DL_16;
@@ -1101,9 +1908,12 @@ static int nau8310_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8310->regmap, NAU8310_R0D_I2S_PCM_CTRL1,
 			   NAU8310_I2S_DL_MASK, val_len);
-
-	return 0;
+	nau_biq_rates_switch(&nau8310->biq_rates, params_rate(params));
+	nau_hw_params_done(&nau8310->hw_params_cache, substream->stream,
+			   params);
+	ret = 0;
 err:
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_HW_PARAMS], start);
 	return ret;
 }
 
@@ -1156,6 +1966,7 @@ static int nau8310_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 		return -EINVAL;
 	}
 
+	nau_hw_params_reset(&nau8310->hw_params_cache);
 	regmap_update_bits(nau8310->regmap, NAU8310_R0D_I2S_PCM_CTRL1,
 			   NAU8310_I2S_DF_MASK | NAU8310_I2S_BP_MASK |
 			   NAU8310_I2S_PCMB_EN, ctrl1_val);
@@ -1165,6 +1976,50 @@ static int nau8310_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 	return 0;
 }
 
+/* The ADC channel the echo reference replaces, the voltage sense on the
+ * even slots and the current sense on the odd ones, and its selection
+ * of the slot in TDM_CTRL.
+ */
+static void nau8310_echo_ref_sel(int slot, unsigned int *mask,
+				 unsigned int *val)
+{
+	if (slot & 0x1) {
+		*mask = NAU8310_ADC_I_SEL_MASK;
+		*val = NAU8310_ADC_I_SEL_SLOT1 + ((slot / 2) << NAU8310_ADC_I_SEL_SFT);
+	} else {
+		*mask = NAU8310_ADC_V_SEL_MASK;
+		*val = NAU8310_ADC_V_SEL_SLOT0 + slot / 2;
+	}
+}
+
+/* Route the DSP output to the capture slot of the echo reference, or give
+ * the capture back to the sense data. The reference is tapped after the
+ * DSP inside the frame of the interface, so its delay to the playback
+ * doesn't change while the mode stays.
+ */
+static void nau8310_echo_ref_apply(struct nau8310 *nau8310)
+{
+	struct regmap *regmap = nau8310->regmap;
+	int slot = nau8310->echo_ref_slot;
+	unsigned int mask, val;
+
+	if (slot < 0) {
+		regmap_update_bits(regmap, NAU8310_R0B_I2S_PCM_CTRL0,
+				   NAU8310_AEC_MODE_AEC, nau8310->aec_enable ?
+				   NAU8310_AEC_MODE_AEC : NAU8310_AEC_MODE_IV);
+		return;
+	}
+
+	nau8310_echo_ref_sel(slot, &mask, &val);
+	regmap_update_bits(regmap, NAU8310_R0C_TDM_CTRL,
+			   NAU8310_TDM_EN | mask, NAU8310_TDM_EN | val);
+	regmap_update_bits(regmap, NAU8310_R0B_I2S_PCM_CTRL0,
+			   NAU8310_AEC_CH_SEL_LEFT | NAU8310_AEC_SRC_SEL_DAC |
+			   NAU8310_AEC_MODE_AEC, ((slot & 0x1) ?
+			   NAU8310_AEC_CH_SEL_RIGHT : NAU8310_AEC_CH_SEL_LEFT) |
+			   NAU8310_AEC_SRC_SEL_DSP | NAU8310_AEC_MODE_AEC);
+}
+
 /**
  * nau8310_set_tdm_slot - configure DAI TDM.
  * @dai: DAI
@@ -1188,6 +2043,11 @@ static int nau8310_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
 	if (slots > 8)
 		return -EINVAL;
 
+	nau_hw_params_reset(&nau8310->hw_params_cache);
+	/* the BCLK of the streams, if it is the master clock */
+	nau8310->tdm_slots = tx_mask || rx_mask ? slots : 0;
+	nau8310->tdm_slot_width = tx_mask || rx_mask ? slot_width : 0;
+
 	if (tx_mask || rx_mask)
 		ctrl_val |= NAU8310_TDM_EN;
 
@@ -1261,6 +2121,14 @@ static int nau8310_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
 		}
 	}
 
+	/* the slot of the echo reference is kept for its channel */
+	if (nau8310->echo_ref_slot >= 0) {
+		unsigned int mask, val;
+
+		nau8310_echo_ref_sel(nau8310->echo_ref_slot, &mask, &val);
+		ctrl_val = (ctrl_val & ~mask) | val | NAU8310_TDM_EN;
+	}
+
 	dev_dbg(nau8310->dev, "%s: tx_mask: 0x%08X, rx_mask: 0x%08X, ADC slots: 0x%08X, DAC slots: 0x%08X\n",
 		 __func__, tx_mask, rx_mask, ctrl_val, ctrl0_val);
 
@@ -1273,99 +2141,352 @@ static int nau8310_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
 	return 0;
 }
 
-int nau8310_startup(struct snd_pcm_substream *substream, struct snd_soc_dai *dai)
+/* Switch clock source to OSC before MCLK off if DSP is enabled. */
+static void nau8310_dsp_sel_osc(struct nau8310 *nau8310)
 {
-	struct snd_soc_component *component = dai->component;
-	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	if (nau8310_clock_osc(nau8310))
+		return;
+	regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
+			   NAU8310_DSP_SEL_OSC, NAU8310_DSP_SEL_OSC);
+}
 
-	if (nau8310->dsp_enable)
-		snd_soc_dapm_enable_pin(nau8310->dapm, "Sense");
+static void nau8310_osc_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, osc_work.work);
 
-	return 0;
+	nau8310_dsp_sel_osc(nau8310);
 }
 
-static void nau8310_shutdown(struct snd_pcm_substream *substream,
-			     struct snd_soc_dai *dai)
+/* The rates of target_srate_table; DSP mode runs at 48kHz only. */
+static const unsigned int nau8310_rates[] = {
+	8000, 12000, 16000, 24000, 32000, 44100, 48000, 64000, 96000,
+};
+
+static const struct snd_pcm_hw_constraint_list nau8310_rate_constraints = {
+	.count = ARRAY_SIZE(nau8310_rates),
+	.list = nau8310_rates,
+};
+
+/* A codec to codec link has no host to read the I/V sense, and runs the
+ * DAI operations from a DAPM event with the DAPM mutex of the card held.
+ */
+static bool nau8310_c2c_link(struct snd_pcm_substream *substream)
+{
+	struct snd_soc_pcm_runtime *rtd = asoc_substream_to_rtd(substream);
+
+	return rtd->dai_link->params;
+}
+
+int nau8310_startup(struct snd_pcm_substream *substream, struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	ktime_t start = ktime_get();
+	int ret;
 
-	if (nau8310->dsp_enable) {
-		int ret;
-
-		snd_soc_dapm_disable_pin(nau8310->dapm, "Sense");
-
-		/* For internal Ring OSC, the default fs apply to 48kHz */
-		nau8310->fs = 48000;
-		ret = nau8310_set_sysclk(component, 0, 0,
-			nau8310->fs * 256, SND_SOC_CLOCK_IN);
-		if (ret)
-			goto err;
-		ret = nau8310_clock_config(nau8310);
-		if (ret)
-			goto err;
-
-		/* Switch clock source to OSC before MCLK off if DSP is enabled. */
-		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
-			NAU8310_DSP_SEL_OSC, NAU8310_DSP_SEL_OSC);
+	/* still in the MCLK domain of the last stream */
+	cancel_delayed_work_sync(&nau8310->osc_work);
+	nau_keepalive_startup(&nau8310->keepalive, substream, dai);
+	if (nau8310_dsp_active(nau8310)) {
+		ret = snd_pcm_hw_constraint_single(substream->runtime,
+						   SNDRV_PCM_HW_PARAM_RATE, 48000);
+		if (!nau8310_c2c_link(substream))
+			snd_soc_dapm_enable_pin(nau8310->dapm, "Sense");
+	} else {
+		ret = snd_pcm_hw_constraint_list(substream->runtime, 0,
+						 SNDRV_PCM_HW_PARAM_RATE,
+						 &nau8310_rate_constraints);
 	}
+	if (ret < 0)
+		return ret;
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_STARTUP], start);
 
-err:
-	return;
+	return 0;
 }
 
-static int nau8310_set_sysclk(struct snd_soc_component *component,
-			      int clk_id, int source, unsigned int freq, int dir)
+static void nau8310_shutdown(struct snd_pcm_substream *substream,
+			     struct snd_soc_dai *dai)
 {
+	struct snd_soc_component *component = dai->component;
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 
+	if (nau8310_dsp_active(nau8310)) {
+		if (!nau8310_c2c_link(substream))
+			snd_soc_dapm_disable_pin(nau8310->dapm, "Sense");
+
+		/* The MCLK domain is kept for a while if the machine leaves
+		 * MCLK running, the next stream cancels the switch.
+		 */
+		if (nau8310->osc_delay_ms)
+			schedule_delayed_work(&nau8310->osc_work,
+				msecs_to_jiffies(nau8310->osc_delay_ms));
+		else
+			nau8310_dsp_sel_osc(nau8310);
+	}
+}
+
+static int nau8310_set_mclk(struct nau8310 *nau8310, unsigned int freq)
+{
 	if (freq < MASTER_CLK_MIN || freq > MASTER_CLK_MAX) {
 		dev_err(nau8310->dev, "Exceed the range of input clocks, MCLK %dHz\n",
 			freq);
 		return -EINVAL;
 	}
+	/* the machine sets the same clock for every stream */
+	if (nau8310->mclk == freq)
+		return 0;
 	nau8310->mclk = freq;
 	dev_dbg(nau8310->dev, "%s, MCLK %dHz\n", __func__, nau8310->mclk);
 
 	return 0;
 }
 
+/* With NAU8310_CLK_ID_BCLK the rate is taken from each stream and @freq
+ * is ignored.
+ */
+static int nau8310_set_sysclk(struct snd_soc_component *component,
+			      int clk_id, int source, unsigned int freq, int dir)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	switch (clk_id) {
+	case NAU8310_CLK_ID_MCLK:
+		nau8310->sysclk_id = clk_id;
+		return nau8310_set_mclk(nau8310, freq);
+	case NAU8310_CLK_ID_BCLK:
+		nau8310->sysclk_id = clk_id;
+		dev_dbg(nau8310->dev, "%s, MCLK from BCLK\n", __func__);
+		return 0;
+	default:
+		return -EINVAL;
+	}
+}
+
+static void nau8310_dsp_power_up(struct nau8310 *nau8310)
+{
+	nau_hw_params_reset(&nau8310->hw_params_cache);
+	nau8310_software_reset(nau8310->regmap);
+	/* wait for the power ready */
+	msleep(120);
+	regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
+			   NAU8310_DSP_RUNSTALL | NAU8310_DAC_SEL_DSP_OUT,
+			   NAU8310_DAC_SEL_DSP_OUT);
+}
+
+static void nau8310_dsp_bypass(struct nau8310 *nau8310)
+{
+	regmap_update_bits(nau8310->regmap,
+			   NAU8310_R1A_DSP_CORE_CTRL2,
+			   NAU8310_DSP_RUNSTALL | NAU8310_DAC_SEL_DSP_OUT,
+			   NAU8310_DSP_RUNSTALL);
+}
+
+/* The power up delay and KCS loading of each amplifier run in parallel. */
+static void nau8310_dsp_init_work(struct work_struct *work)
+{
+	struct nau8310 *nau8310 =
+		container_of(work, struct nau8310, dsp_init_work);
+	struct snd_soc_component *component =
+		snd_soc_dapm_to_component(nau8310->dapm);
+	int ret;
+
+	nau8310_dsp_power_up(nau8310);
+	ret = nau8310_dsp_load(component);
+	if (ret) {
+		nau8310_dsp_bypass(nau8310);
+		dev_warn(nau8310->dev, "Can't enable DSP, so enable bypass mode\n");
+	} else {
+		nau8310->dsp_enable = true;
+	}
+	nau8310->dsp_init_ret = ret;
+	complete_all(&nau8310->dsp_ready);
+}
+
+static const char * const nau8310_latency_names[NAU8310_LAT_NUM] = {
+	[NAU8310_LAT_STARTUP] = "startup",
+	[NAU8310_LAT_HW_PARAMS] = "hw_params",
+	[NAU8310_LAT_TRIGGER] = "trigger",
+	[NAU8310_LAT_DAC_UNMUTE] = "dac_unmute",
+	[NAU8310_LAT_DSP_WAIT] = "dsp_wait",
+	[NAU8310_LAT_PROFILE] = "dsp_profile",
+	[NAU8310_LAT_CLK_RECOVERY] = "clk_recovery",
+	[NAU8310_LAT_WAKE] = "idle_wake",
+};
+
+static void nau8310_clk_debugfs_init(struct nau8310 *nau8310,
+				     struct dentry *root)
+{
+	struct dentry *dir;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir("clk_loss", root);
+	debugfs_create_u32("events", 0444, dir, &nau8310->clk_loss_events);
+	debugfs_create_u32("recoveries", 0444, dir, &nau8310->clk_recoveries);
+	debugfs_create_u32("dsp_clk_skips", 0444, root, &nau8310->dsp_clk_skips);
+}
+
+static void nau8310_boost_debugfs_init(struct nau8310 *nau8310,
+				       struct dentry *root)
+{
+	struct nau8310_boost_adapt *bst = &nau8310->boost_adapt;
+	struct dentry *dir;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir("boost", root);
+	debugfs_create_u32("target", 0444, dir, &bst->target);
+	debugfs_create_u32("samples", 0444, dir, &bst->samples);
+	debugfs_create_u32("raises", 0444, dir, &bst->raises);
+	debugfs_create_u32("drops", 0444, dir, &bst->drops);
+	debugfs_create_u64("saved_step_ms", 0444, dir, &bst->saved_step_ms);
+}
+
+static void nau8310_thermal_debugfs_init(struct nau8310 *nau8310,
+					 struct dentry *root)
+{
+	struct nau8310_thermal *th = &nau8310->thermal;
+	struct dentry *dir;
+
+	if (!root || !th->max_state)
+		return;
+
+	dir = debugfs_create_dir("thermal", root);
+	debugfs_create_u32("state", 0444, dir, &th->applied);
+	debugfs_create_u32("otp_state", 0444, dir, &th->otp_state);
+	debugfs_create_u32("otp_events", 0444, dir, &th->otp_events);
+	debugfs_create_u32("backoffs", 0444, dir, &th->backoffs);
+}
+
+static void nau8310_dsp_retain_debugfs_init(struct nau8310 *nau8310,
+					    struct dentry *root)
+{
+	struct dentry *dir;
+
+	if (!root || !nau8310->dsp_retain)
+		return;
+
+	dir = debugfs_create_dir("dsp_retain", root);
+	debugfs_create_u32("hits", 0444, dir, &nau8310->dsp_retain_hits);
+	debugfs_create_u32("misses", 0444, dir, &nau8310->dsp_retain_misses);
+}
+
+static void nau8310_idle_debugfs_init(struct nau8310 *nau8310,
+				      struct dentry *root)
+{
+	if (root && nau8310->idle_bias_off)
+		debugfs_create_u32("dsp_parks", 0444, root, &nau8310->dsp_parks);
+}
+
+static const struct regmap_config nau8310_regmap_config;
+
+/* The widgets of the power accounting, which keep the most current */
+static const char * const nau8310_dapm_stat_names[] = {
+	"Clock", "PowerUp", "SAR", "ADC_OUT", "DAC", "DSP Clock",
+};
+
 static int nau8310_codec_probe(struct snd_soc_component *component)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 	struct snd_soc_dapm_context *dapm =
 			snd_soc_component_get_dapm(component);
+	int ret;
 
 	nau8310->dapm = dapm;
+	/* the register sync of resume under the debugfs of the component */
+	nau_regcache_debugfs_init(component->debugfs_root, "resume",
+				  &nau8310->resume_sync);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8310->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+					 &nau8310->regcache_report, nau8310->regmap,
+					 &nau8310_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8310->latency,
+				 nau8310_latency_names, NAU8310_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8310->hw_params_cache);
+	nau_delay_debugfs_init(component->debugfs_root, &nau8310->delay);
+	nau_biq_rates_debugfs_init(component->debugfs_root, "biq_rate_switches",
+				   &nau8310->biq_rates);
+	nau8310_clk_debugfs_init(nau8310, component->debugfs_root);
+	nau8310_boost_debugfs_init(nau8310, component->debugfs_root);
+	nau8310_dsp_retain_debugfs_init(nau8310, component->debugfs_root);
+	nau8310_idle_debugfs_init(nau8310, component->debugfs_root);
+	nau8310_thermal_debugfs_init(nau8310, component->debugfs_root);
+	nau_vol_ramp_debugfs_init(component->debugfs_root, &nau8310->vol_ramp);
+	nau_keepalive_debugfs_init(component->debugfs_root,
+				   &nau8310->keepalive);
+	nau_dapm_stat_init(&nau8310->dapm_stat, nau8310_dapm_stat_names,
+			   ARRAY_SIZE(nau8310_dapm_stat_names));
+	nau_dapm_stat_debugfs_init(component->debugfs_root,
+				   &nau8310->dapm_stat);
 
 	/* For internal Ring OSC, the default fs apply to 48kHz */
 	nau8310->fs = 48000;
-	ret = nau8310_set_sysclk(component, 0, 0,
-				 nau8310->fs * 256, SND_SOC_CLOCK_IN);
+	ret = nau8310_set_mclk(nau8310, nau8310->fs * 256);
 	if (ret)
-		goto err;
+		return ret;
 	ret = nau8310_clock_config(nau8310);
 	if (ret)
-		goto err;
+		return ret;
+	nau8310->clk_osc = nau8310->clk_applied;
+	nau8310->dsp_osc_rate = nau8310->dsp_clk_rate;
 	regmap_update_bits(nau8310->regmap, NAU8310_R68_ANALOG_CONTROL_7,
 			   NAU8310_MU_HALF_RANGE_EN, NAU8310_MU_HALF_RANGE_EN);
 	regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
 			   NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC,
 			   NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC);
-	nau8310_software_reset(nau8310->regmap);
-	/* wait for the power ready */
-	msleep(120);
-	regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
-			   NAU8310_DSP_RUNSTALL | NAU8310_DAC_SEL_DSP_OUT,
-			   NAU8310_DAC_SEL_DSP_OUT);
+	nau_pm_card_link(component);
+	if (nau8310->idle_bias_off)
+		snd_soc_component_get_dapm(component)->idle_bias_off = true;
+
+	if (!NAU8310_DSP_BUILT) {
+		nau8310_dsp_bypass(nau8310);
+		nau8310->dsp_init_ret = -ENODEV;
+		complete_all(&nau8310->dsp_ready);
+		return 0;
+	}
+	if (nau8310->dsp_async_init) {
+		/* The controls must be ready before the card instantiated;
+		 * the machine driver waits the DSP by nau8310_dsp_wait_ready.
+		 */
+		snd_soc_dapm_disable_pin(dapm, "Sense");
+		ret = nau8310_dsp_init_controls(component);
+		if (ret) {
+			nau8310_dsp_bypass(nau8310);
+			dev_warn(nau8310->dev, "Can't enable DSP, so enable bypass mode\n");
+			nau8310->dsp_init_ret = ret;
+			complete_all(&nau8310->dsp_ready);
+			return 0;
+		}
+		reinit_completion(&nau8310->dsp_ready);
+		queue_work(system_unbound_wq, &nau8310->dsp_init_work);
+		return 0;
+	}
+
+	nau8310_dsp_power_up(nau8310);
 	/* Loading DSP firmware */
 	ret = nau8310_enable_dsp(component);
-	if(ret)
-		dev_warn("Can't enable DSP, so enable bypass mode\n");
+	if (ret)
+		dev_warn(nau8310->dev, "Can't enable DSP, so enable bypass mode\n");
 
 	return 0;
 }
 
+static void nau8310_codec_remove(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	cancel_work_sync(&nau8310->dsp_init_work);
+	cancel_work_sync(&nau8310->dsp_switch_work);
+	cancel_delayed_work_sync(&nau8310->dsp_clk_work);
+	nau_vol_ramp_finish(&nau8310->vol_ramp);
+	nau_pm_card_unlink(component);
+	nau8310->dapm = NULL;
+}
+
 int nau8310_enable_dsp(struct snd_soc_component *component)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
@@ -1381,21 +2502,151 @@ int nau8310_enable_dsp(struct snd_soc_component *component)
 	return 0;
 
 err:
-	regmap_update_bits(nau8310->regmap,
-			   NAU8310_R1A_DSP_CORE_CTRL2,
-			   NAU8310_DSP_RUNSTALL | NAU8310_DAC_SEL_DSP_OUT,
-			   NAU8310_DSP_RUNSTALL);
+	nau8310_dsp_bypass(nau8310);
 	return ret;
 }
 EXPORT_SYMBOL_GPL(nau8310_enable_dsp);
 
+/**
+ * nau8310_dsp_wait_ready - wait the DSP bring-up of async init mode done
+ * @component: component of the amplifier
+ * @timeout_ms: the maximum waiting time in milliseconds
+ *
+ * Returns 0 if DSP is running, or the error the amplifier goes bypass mode.
+ * Return 0 immediately if the amplifier doesn't init DSP asynchronously.
+ */
+int nau8310_dsp_wait_ready(struct snd_soc_component *component,
+			   unsigned int timeout_ms)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	ktime_t start = ktime_get();
+	unsigned long left;
+
+	if (!nau8310->dsp_async_init)
+		return 0;
+	left = wait_for_completion_timeout(&nau8310->dsp_ready,
+					   msecs_to_jiffies(timeout_ms));
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_DSP_WAIT], start);
+	if (!left)
+		return -ETIMEDOUT;
+
+	return nau8310->dsp_init_ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_wait_ready);
+
+/**
+ * nau8310_mclk_idle - set the time the machine keeps MCLK after a stream
+ * @component: component of the amplifier
+ * @ms: the idle time of MCLK in milliseconds, 0 if it stops at once
+ *
+ * The DSP stays in the MCLK domain as long, so a stream within it starts
+ * without the switches to the OSC and back.
+ */
+void nau8310_mclk_idle(struct snd_soc_component *component, unsigned int ms)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	nau8310->osc_delay_ms = min_t(unsigned int, ms,
+				      NAU8310_OSC_DELAY_MAX_MS);
+}
+EXPORT_SYMBOL_GPL(nau8310_mclk_idle);
+
+/**
+ * nau8310_mclk_gate - move the DSP to the OSC as the machine stops MCLK
+ * @component: component of the amplifier
+ *
+ * Called before MCLK stops, so the DSP never runs on a gated clock even
+ * if the switch delayed by the shutdown isn't due yet.
+ */
+void nau8310_mclk_gate(struct snd_soc_component *component)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+
+	cancel_delayed_work_sync(&nau8310->osc_work);
+	if (nau8310_dsp_active(nau8310))
+		nau8310_dsp_sel_osc(nau8310);
+}
+EXPORT_SYMBOL_GPL(nau8310_mclk_gate);
+
+/* With the idle bias off, the DSP is stalled as the amplifier goes idle.
+ * The clock stop and the OSC switch still pending in their windows go
+ * first, and the monitor has nothing to sample meanwhile. A DSP busy with
+ * its load or a profile switch stays as it is.
+ */
+static void nau8310_idle_park(struct nau8310 *nau8310)
+{
+	if (!nau8310->idle_bias_off || !nau8310_dsp_active(nau8310) ||
+	    work_busy(&nau8310->dsp_init_work) ||
+	    work_busy(&nau8310->dsp_switch_work))
+		return;
+	nau8310_dsp_monitor_stop(nau8310);
+	nau8310_dsp_clk_flush(nau8310);
+	cancel_delayed_work_sync(&nau8310->osc_work);
+	nau8310_dsp_sel_osc(nau8310);
+	nau8310_dsp_park(nau8310, true);
+}
+
+static void nau8310_idle_wake(struct nau8310 *nau8310)
+{
+	ktime_t start = ktime_get();
+
+	if (!nau8310->dsp_parked)
+		return;
+	nau8310_dsp_park(nau8310, false);
+	nau8310_dsp_monitor_start(nau8310);
+	nau_latency_add(&nau8310->latency[NAU8310_LAT_WAKE], start);
+}
+
+/* The bias of the amplifier follows its widgets; the power accounting
+ * takes the levels, and the widgets of the DSP added at probe or later.
+ * Only the idle bias off acts on the way to OFF and back.
+ */
+static int nau8310_set_bias_level(struct snd_soc_component *component,
+				  enum snd_soc_bias_level level)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
+	enum snd_soc_bias_level old = snd_soc_component_get_bias_level(component);
+
+	nau_dapm_stat_attach(&nau8310->dapm_stat, component);
+	nau_dapm_stat_bias(&nau8310->dapm_stat, level);
+
+	if (level == SND_SOC_BIAS_OFF && old == SND_SOC_BIAS_STANDBY)
+		nau8310_idle_park(nau8310);
+	else if (level == SND_SOC_BIAS_STANDBY && old == SND_SOC_BIAS_OFF)
+		nau8310_idle_wake(nau8310);
+
+	return 0;
+}
+
 static int __maybe_unused nau8310_suspend(struct snd_soc_component *component)
 {
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 
-	if (nau8310->dsp_enable)
+	nau_hw_params_reset(&nau8310->hw_params_cache);
+	/* no DSP command runs after the register cache only */
+	flush_work(&nau8310->dsp_init_work);
+	flush_work(&nau8310->dsp_switch_work);
+	flush_delayed_work(&nau8310->osc_work);
+	flush_delayed_work(&nau8310->unmute_work);
+	nau_vol_ramp_finish(&nau8310->vol_ramp);
+	nau8310_dsp_monitor_stop(nau8310);
+	nau8310_dsp_clk_flush(nau8310);
+	nau8310_dsp_queue_flush(nau8310);
+	if (nau8310_dsp_active(nau8310))
 		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
 				   NAU8310_DSP_SEL_OSC, NAU8310_DSP_SEL_OSC);
+	nau8310->dsp_retained = false;
+	/* the suspend and resume below take over a parked DSP */
+	nau8310->dsp_parked = false;
+	if (nau8310_dsp_active(nau8310) && nau8310->dsp_retain &&
+	    !nau8310_dsp_retain(component)) {
+		/* stall the DSP with its memory on the OSC, no reload at resume */
+		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
+				   NAU8310_DSP_OSC_EN, NAU8310_DSP_OSC_EN);
+		regmap_update_bits(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2,
+				   NAU8310_DSP_RUNSTALL, NAU8310_DSP_RUNSTALL);
+		nau8310->dsp_retained = true;
+	}
 
 	regcache_cache_only(nau8310->regmap, true);
 	regcache_mark_dirty(nau8310->regmap);
@@ -1408,8 +2659,12 @@ static int __maybe_unused nau8310_resume(struct snd_soc_component *component)
 	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(component);
 	int ret, value;
 
+	/* the lazy cache is read while still in the cache only mode */
+	nau_regcache_scan(nau8310->regmap, &nau8310_regmap_config,
+			  &nau8310->resume_sync);
 	regcache_cache_only(nau8310->regmap, false);
-	regcache_sync(nau8310->regmap);
+	nau_regcache_sync(nau8310->regmap, &nau8310_regmap_config,
+			  &nau8310->resume_sync);
 
 	ret = regmap_read(nau8310->regmap, NAU8310_R1A_DSP_CORE_CTRL2, &value);
 	if (ret) {
@@ -1417,11 +2672,10 @@ static int __maybe_unused nau8310_resume(struct snd_soc_component *component)
 			ret);
 		goto err;
 	}
-	if (nau8310->dsp_enable && (value & NAU8310_DAC_SEL_DSP_OUT)) {
+	if (nau8310_dsp_active(nau8310) && (value & NAU8310_DAC_SEL_DSP_OUT)) {
 		/* For internal Ring OSC, the default fs apply to 48kHz */
 		nau8310->fs = 48000;
-		ret = nau8310_set_sysclk(component, 0, 0,
-					 nau8310->fs * 256, SND_SOC_CLOCK_IN);
+		ret = nau8310_set_mclk(nau8310, nau8310->fs * 256);
 		if (ret)
 			goto err;
 		ret = nau8310_clock_config(nau8310);
@@ -1430,6 +2684,20 @@ static int __maybe_unused nau8310_resume(struct snd_soc_component *component)
 		regmap_update_bits(nau8310->regmap, NAU8310_R04_ENA_CTRL,
 				   NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC,
 				   NAU8310_DSP_OSC_EN | NAU8310_DSP_SEL_OSC);
+		if (nau8310->dsp_retained) {
+			nau8310->dsp_retained = false;
+			regmap_update_bits(nau8310->regmap,
+					   NAU8310_R1A_DSP_CORE_CTRL2,
+					   NAU8310_DSP_RUNSTALL, 0);
+			if (!nau8310_dsp_retained(component)) {
+				nau8310->dsp_retain_hits++;
+				nau8310_dsp_monitor_start(nau8310);
+				return 0;
+			}
+			/* the state is lost, load the DSP from scratch */
+			nau8310->dsp_retain_misses++;
+			dev_info(nau8310->dev, "DSP not retained, reload it\n");
+		}
 		nau8310_software_reset(nau8310->regmap);
 		/* wait for the power ready */
 		msleep(120);
@@ -1440,6 +2708,7 @@ static int __maybe_unused nau8310_resume(struct snd_soc_component *component)
 			dev_err(nau8310->dev, "Failed to resume DSP: %d\n", ret);
 			goto err;
 		}
+		nau8310_dsp_monitor_start(nau8310);
 	}
 
 	return 0;
@@ -1453,9 +2722,9 @@ err:
 
 static const struct snd_soc_component_driver soc_component_dev_nau8310 = {
 	.probe			= nau8310_codec_probe,
+	.remove			= nau8310_codec_remove,
 	.set_sysclk		= nau8310_set_sysclk,
-	.suspend		= nau8310_suspend,
-	.resume			= nau8310_resume,
+	.set_bias_level		= nau8310_set_bias_level,
 	.controls		= nau8310_snd_controls,
 	.num_controls		= ARRAY_SIZE(nau8310_snd_controls),
 	.dapm_widgets		= nau8310_dapm_widgets,
@@ -1469,6 +2738,25 @@ static const struct snd_soc_component_driver soc_component_dev_nau8310 = {
 	.non_legacy_dai_naming	= 1,
 };
 
+/* The frames the filters hold, and on playback the DSP profile applied */
+static snd_pcm_sframes_t nau8310_delay(struct snd_pcm_substream *substream,
+				       struct snd_soc_dai *dai)
+{
+	struct nau8310 *nau8310 = snd_soc_component_get_drvdata(dai->component);
+	snd_pcm_sframes_t frames;
+	int profile;
+
+	frames = nau_delay_get(&nau8310->delay, substream->stream);
+	if (nau8310_dsp_active(nau8310) &&
+	    substream->stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		profile = READ_ONCE(nau8310->dsp_profile);
+		if (profile >= 0 && profile < NAU8310_DSP_PROFILE_NUM)
+			frames += nau8310->profile[profile].latency_frames;
+	}
+
+	return frames;
+}
+
 static const struct snd_soc_dai_ops nau8310_dai_ops = {
 	.startup	= nau8310_startup,
 	.hw_params	= nau8310_hw_params,
@@ -1476,11 +2764,13 @@ static const struct snd_soc_dai_ops nau8310_dai_ops = {
 	.shutdown	= nau8310_shutdown,
 	.set_fmt	= nau8310_set_fmt,
 	.set_tdm_slot	= nau8310_set_tdm_slot,
+	.delay		= nau8310_delay,
 };
 
 #define NAU8310_RATES SNDRV_PCM_RATE_8000_192000
 #define NAU8310_FORMATS (SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S20_3LE \
-	 | SNDRV_PCM_FMTBIT_S24_3LE | SNDRV_PCM_FMTBIT_S32_LE)
+	 | SNDRV_PCM_FMTBIT_S24_3LE | SNDRV_PCM_FMTBIT_S24_LE \
+	 | SNDRV_PCM_FMTBIT_S32_LE)
 
 static struct snd_soc_dai_driver nau8310_dai = {
 	.name = NAU8310_CODEC_DAI,
@@ -1501,25 +2791,15 @@ static struct snd_soc_dai_driver nau8310_dai = {
 	.ops = &nau8310_dai_ops,
 };
 
-static int nau8310_reg_write(void *context, unsigned int reg, unsigned int value)
+/* The control registers take 16-bit address and 16-bit data in big endian,
+ * with the address incremented through the data of a burst.
+ */
+static int nau8310_i2c_write(void *context, const void *data, size_t count)
 {
 	struct i2c_client *client = context;
-	u8 buf[6];
-	int ret, count = 0;
-
-	buf[count++] = reg >> 8;
-	buf[count++] = reg;
-	if (reg != NAU8310_RF000_DSP_COMM) {
-		/* format for G10, 2 bytes value and endian big */
-		buf[count++] = value >> 8;
-		buf[count++] = value;
-		dev_dbg(&client->dev, "Reg:0x%x Value:0x%x\n", reg, value);
-	} else {
-		/* format for DSP, 4 bytes value and native */
-		*(u32 *)&buf[count] = value;
-		count += sizeof(u32);
-	}
-	ret = i2c_master_send(client, buf, count);
+	int ret;
+
+	ret = i2c_master_send(client, data, count);
 	if (ret == count)
 		return 0;
 	else if (ret < 0)
@@ -1528,43 +2808,301 @@ static int nau8310_reg_write(void *context, unsigned int reg, unsigned int value
 		return -EIO;
 }
 
-static int nau8310_reg_read(void *context, unsigned int reg, unsigned int *value)
+static int nau8310_i2c_gather_write(void *context, const void *reg,
+				    size_t reg_size, const void *val,
+				    size_t val_size)
+{
+	struct i2c_client *client = context;
+	struct i2c_msg xfer[2];
+	int ret;
+
+	/* regmap puts the address and the data together without NOSTART */
+	if (!i2c_check_functionality(client->adapter, I2C_FUNC_NOSTART))
+		return -ENOTSUPP;
+
+	xfer[0].addr = client->addr;
+	xfer[0].flags = 0;
+	xfer[0].len = reg_size;
+	xfer[0].buf = (u8 *)reg;
+
+	xfer[1].addr = client->addr;
+	xfer[1].flags = I2C_M_NOSTART;
+	xfer[1].len = val_size;
+	xfer[1].buf = (u8 *)val;
+
+	ret = i2c_transfer(client->adapter, xfer, ARRAY_SIZE(xfer));
+	if (ret == ARRAY_SIZE(xfer))
+		return 0;
+	else if (ret < 0)
+		return ret;
+	else
+		return -EIO;
+}
+
+static int nau8310_i2c_read(void *context, const void *reg, size_t reg_size,
+			    void *val, size_t val_size)
 {
 	struct i2c_client *client = context;
 	struct i2c_msg xfer[2];
-	u8 buf[4];
-	const u8 *b = buf;
-	u16 reg_buf;
 	int ret;
 
-	reg_buf = cpu_to_be16(reg);
 	xfer[0].addr = client->addr;
-	xfer[0].len = sizeof(reg_buf);
-	xfer[0].buf = (u8 *)&reg_buf;
 	xfer[0].flags = 0;
+	xfer[0].len = reg_size;
+	xfer[0].buf = (u8 *)reg;
 
 	xfer[1].addr = client->addr;
-	xfer[1].len = (reg != NAU8310_RF000_DSP_COMM ? 2 : 4);
-	xfer[1].buf = buf;
 	xfer[1].flags = I2C_M_RD;
+	xfer[1].len = val_size;
+	xfer[1].buf = val;
 
 	ret = i2c_transfer(client->adapter, xfer, ARRAY_SIZE(xfer));
-	if (ret < 0)
+	if (ret == ARRAY_SIZE(xfer))
+		return 0;
+	else if (ret < 0)
 		return ret;
-	else if (ret != ARRAY_SIZE(xfer))
+	else
 		return -EIO;
+}
 
-	if (reg != NAU8310_RF000_DSP_COMM) {
-		/* parse for G10, 2 bytes value and endian big */
-		*value = b[1];
-		*value |= ((unsigned int)b[0]) << 8;
-	} else {
-		/* parse for DSP, 4 bytes value and native */
-		*value = *(u32 *)b;
+static const struct regmap_bus nau8310_i2c_bus = {
+	.write = nau8310_i2c_write,
+	.gather_write = nau8310_i2c_gather_write,
+	.read = nau8310_i2c_read,
+};
+
+/* The DSP mailbox takes a word of 4 bytes in native order per message,
+ * each behind the address of the mailbox. The words of a FIFO block are
+ * queued into one i2c_transfer() with repeated starts in between, split
+ * only when the adapter can't carry that many messages.
+ */
+static int nau8310_dsp_xfer(struct i2c_client *client, const u8 *reg,
+			    u8 *val, size_t val_size, bool read)
+{
+	const struct i2c_adapter_quirks *q = client->adapter->quirks;
+	int i, ret, msgs, words = val_size / NAU8310_DSP_DATA_BYTE;
+	int per_word = read ? 2 : 1, max_words = words;
+	int len = read ? NAU8310_DSP_DATA_BYTE :
+		NAU8310_DSP_REG_LEN + NAU8310_DSP_DATA_BYTE;
+	struct i2c_msg *xfer, *msg;
+	u8 *buf;
+
+	if (!words || val_size % NAU8310_DSP_DATA_BYTE)
+		return -EINVAL;
+	if (q && q->max_num_msgs)
+		max_words = max_t(int, q->max_num_msgs / per_word, 1);
+
+	xfer = kcalloc(words, per_word * sizeof(*xfer) + (read ? 0 : len),
+		       GFP_KERNEL);
+	if (!xfer)
+		return -ENOMEM;
+	buf = (u8 *)&xfer[words * per_word];
+
+	for (i = 0, msg = xfer; i < words; i++) {
+		if (read) {
+			msg->addr = client->addr;
+			msg->len = NAU8310_DSP_REG_LEN;
+			msg->buf = (u8 *)reg;
+			msg++;
+			msg->flags = I2C_M_RD;
+			msg->buf = val + i * len;
+		} else {
+			memcpy(buf, reg, NAU8310_DSP_REG_LEN);
+			memcpy(buf + NAU8310_DSP_REG_LEN,
+			       val + i * NAU8310_DSP_DATA_BYTE,
+			       NAU8310_DSP_DATA_BYTE);
+			msg->buf = buf;
+			buf += len;
+		}
+		msg->addr = client->addr;
+		msg->len = len;
+		msg++;
 	}
+
+	for (i = 0; i < words; i += max_words) {
+		msgs = min(words - i, max_words) * per_word;
+		ret = i2c_transfer(client->adapter, &xfer[i * per_word], msgs);
+		if (ret != msgs) {
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+	}
+	kfree(xfer);
+
+	return ret;
+}
+
+static int nau8310_dsp_gather_write(void *context, const void *reg,
+				    size_t reg_size, const void *val,
+				    size_t val_size)
+{
+	if (reg_size != NAU8310_DSP_REG_LEN)
+		return -EINVAL;
+
+	return nau8310_dsp_xfer(context, reg, (u8 *)val, val_size, false);
+}
+
+static int nau8310_dsp_write(void *context, const void *data, size_t count)
+{
+	if (count <= NAU8310_DSP_REG_LEN)
+		return -EINVAL;
+
+	return nau8310_dsp_gather_write(context, data, NAU8310_DSP_REG_LEN,
+					data + NAU8310_DSP_REG_LEN,
+					count - NAU8310_DSP_REG_LEN);
+}
+
+static int nau8310_dsp_read(void *context, const void *reg, size_t reg_size,
+			    void *val, size_t val_size)
+{
+	if (reg_size != NAU8310_DSP_REG_LEN)
+		return -EINVAL;
+
+	return nau8310_dsp_xfer(context, reg, val, val_size, true);
+}
+
+/* The frame of the mailbox messages, in memory the I2C controller can map
+ * for DMA. Each fragment is one I2C message with the mailbox address ahead
+ * of it, so the messages are built in place and sent without a copy.
+ */
+static int nau8310_dsp_frame_init(struct nau8310 *nau8310,
+				  struct i2c_client *client)
+{
+	u8 *slot;
+	int i;
+
+	nau8310->dsp_frame = devm_kcalloc(&client->dev, NAU8310_DSP_FRAG_MAX,
+					  NAU8310_DSP_FRAME_SLOT, GFP_KERNEL);
+	nau8310->dsp_msgs = devm_kcalloc(&client->dev, NAU8310_DSP_FRAG_MAX,
+					 sizeof(*nau8310->dsp_msgs), GFP_KERNEL);
+	if (!nau8310->dsp_frame || !nau8310->dsp_msgs)
+		return -ENOMEM;
+
+	for (i = 0; i < NAU8310_DSP_FRAG_MAX; i++) {
+		slot = nau8310->dsp_frame + i * NAU8310_DSP_FRAME_SLOT;
+		slot[0] = NAU8310_RF000_DSP_COMM >> 8;
+		slot[1] = NAU8310_RF000_DSP_COMM & 0xff;
+		nau8310->dsp_msgs[i].addr = client->addr;
+		nau8310->dsp_msgs[i].flags = I2C_M_DMA_SAFE;
+		nau8310->dsp_msgs[i].len = NAU8310_DSP_FRAME_SLOT;
+		nau8310->dsp_msgs[i].buf = slot;
+	}
+
 	return 0;
 }
 
+/**
+ * nau8310_dsp_frame_write - Send the fragments built in the frame
+ *
+ * @nau8310: component driver data
+ * @count: number of fragments from the start of the frame
+ *
+ * The fragments go out in one i2c_transfer(), with repeated starts and
+ * without releasing the bus between words, split only when the adapter
+ * can't carry that many messages. The bus stays locked over the split, so
+ * no other device interleaves with the message. The caller has to hold
+ * dsp_lock.
+ */
+int nau8310_dsp_frame_write(struct nau8310 *nau8310, int count)
+{
+	struct i2c_client *client = to_i2c_client(nau8310->dev);
+	const struct i2c_adapter_quirks *q = client->adapter->quirks;
+	int i, ret = 0, num, max_num = count;
+
+	if (count <= 0 || count > NAU8310_DSP_FRAG_MAX)
+		return -EINVAL;
+	if (q && q->max_num_msgs)
+		max_num = q->max_num_msgs;
+
+	i2c_lock_bus(client->adapter, I2C_LOCK_SEGMENT);
+	for (i = 0; i < count; i += num) {
+		num = min(count - i, max_num);
+		ret = __i2c_transfer(client->adapter, &nau8310->dsp_msgs[i], num);
+		if (ret != num) {
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+	}
+	i2c_unlock_bus(client->adapter, I2C_LOCK_SEGMENT);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_frame_write);
+
+/**
+ * nau8310_dsp_frame_read - Read words of a reply from the mailbox
+ *
+ * @nau8310: component driver data
+ * @words: buffer of @count words, in native order
+ * @count: number of words
+ *
+ * Each word is read behind the address of the mailbox, all of them in one
+ * i2c_transfer() with repeated starts, split only when the adapter can't
+ * carry that many messages. The bus stays locked over the split, so no
+ * other device interleaves with the reply. The caller has to hold dsp_lock.
+ */
+int nau8310_dsp_frame_read(struct nau8310 *nau8310, u32 *words, int count)
+{
+	struct i2c_client *client = to_i2c_client(nau8310->dev);
+	const struct i2c_adapter_quirks *q = client->adapter->quirks;
+	int i, ret = 0, num, max_num = count;
+	struct i2c_msg *msgs, *msg;
+	u8 *reg, *buf;
+
+	if (count <= 0)
+		return -EINVAL;
+	if (q && q->max_num_msgs)
+		max_num = max_t(int, q->max_num_msgs / 2, 1);
+
+	msgs = kzalloc(count * (2 * sizeof(*msgs) + NAU8310_DSP_DATA_BYTE) +
+		       NAU8310_DSP_REG_LEN, GFP_KERNEL);
+	if (!msgs)
+		return -ENOMEM;
+	buf = (u8 *)&msgs[2 * count];
+	reg = buf + count * NAU8310_DSP_DATA_BYTE;
+	reg[0] = NAU8310_RF000_DSP_COMM >> 8;
+	reg[1] = NAU8310_RF000_DSP_COMM & 0xff;
+
+	for (i = 0, msg = msgs; i < count; i++) {
+		msg->addr = client->addr;
+		msg->len = NAU8310_DSP_REG_LEN;
+		msg->buf = reg;
+		msg++;
+		msg->addr = client->addr;
+		msg->flags = I2C_M_RD;
+		msg->len = NAU8310_DSP_DATA_BYTE;
+		msg->buf = buf + i * NAU8310_DSP_DATA_BYTE;
+		msg++;
+	}
+
+	i2c_lock_bus(client->adapter, I2C_LOCK_SEGMENT);
+	for (i = 0; i < count; i += num) {
+		num = min(count - i, max_num);
+		ret = __i2c_transfer(client->adapter, &msgs[2 * i], 2 * num);
+		if (ret != 2 * num) {
+			ret = ret < 0 ? ret : -EIO;
+			break;
+		}
+		ret = 0;
+	}
+	i2c_unlock_bus(client->adapter, I2C_LOCK_SEGMENT);
+	if (!ret)
+		memcpy(words, buf, count * NAU8310_DSP_DATA_BYTE);
+	kfree(msgs);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8310_dsp_frame_read);
+
+static const struct regmap_bus nau8310_dsp_bus = {
+	.write = nau8310_dsp_write,
+	.gather_write = nau8310_dsp_gather_write,
+	.read = nau8310_dsp_read,
+	.val_format_endian_default = REGMAP_ENDIAN_NATIVE,
+};
+
 static const struct regmap_config nau8310_regmap_config = {
 	.reg_bits = NAU8310_REG_ADDR_LEN,
 	.val_bits = NAU8310_REG_DATA_LEN,
@@ -1573,14 +3111,34 @@ static const struct regmap_config nau8310_regmap_config = {
 	.readable_reg = nau8310_readable_reg,
 	.writeable_reg = nau8310_writeable_reg,
 	.volatile_reg = nau8310_volatile_reg,
-	.reg_read = nau8310_reg_read,
-	.reg_write = nau8310_reg_write,
 
 	.cache_type = REGCACHE_RBTREE,
 	.reg_defaults = nau8310_reg_defaults,
 	.num_reg_defaults = ARRAY_SIZE(nau8310_reg_defaults),
 };
 
+static bool nau8310_dsp_reg(struct device *dev, unsigned int reg)
+{
+	return reg == NAU8310_RF000_DSP_COMM;
+}
+
+/* the mailbox is a FIFO, the blocks of it stay at the one address */
+static const struct regmap_config nau8310_dsp_regmap_config = {
+	.name = "dsp",
+	.reg_bits = NAU8310_REG_ADDR_LEN,
+	.val_bits = NAU8310_DSP_DATA_LEN,
+	.val_format_endian = REGMAP_ENDIAN_NATIVE,
+
+	.max_register = NAU8310_RF000_DSP_COMM,
+	.readable_reg = nau8310_dsp_reg,
+	.writeable_reg = nau8310_dsp_reg,
+	.volatile_reg = nau8310_dsp_reg,
+	.readable_noinc_reg = nau8310_dsp_reg,
+	.writeable_noinc_reg = nau8310_dsp_reg,
+
+	.cache_type = REGCACHE_NONE,
+};
+
 static void nau8310_reset_chip(struct regmap *regmap)
 {
 	regmap_write(regmap, NAU8310_R00_HARDWARE_RST, 0x0001);
@@ -1593,38 +3151,183 @@ static void nau8310_software_reset(struct regmap *regmap)
 	regmap_write(regmap, NAU8310_R01_SOFTWARE_RST, 0x0000);
 }
 
-static void nau8310_init_regs(struct nau8310 *nau8310)
-{
-	struct regmap *regmap = nau8310->regmap;
-
+/* The fixed part of the initiation before the software reset, the reset
+ * values with the settings below made. Each register is written once;
+ * the settings depending on the device properties or the silicon are
+ * updated afterwards.
+ */
+static const struct reg_sequence nau8310_init_seq[] = {
 	/* Latch IIC LSB value */
-	regmap_write(regmap, NAU8310_R02_I2C_ADDR, 0x0001);
+	{ NAU8310_R02_I2C_ADDR, 0x0001 },
 	/* Block MCLK */
-	regmap_update_bits(regmap, NAU8310_R04_ENA_CTRL,
-			   NAU8310_MCLK_SEL_MASK, 0x7 << NAU8310_MCLK_SEL_SFT);
-	/* stall DSP */
-	regmap_update_bits(regmap, NAU8310_R1A_DSP_CORE_CTRL2,
-			   NAU8310_DSP_RUNSTALL, NAU8310_DSP_RUNSTALL);
+	{ NAU8310_R04_ENA_CTRL, 0x0700 },
 	/* Default ADCI from slot1, ADCV from slot 0. */
-	regmap_update_bits(regmap, NAU8310_R0C_TDM_CTRL,
-			   NAU8310_ADC_I_SEL_MASK | NAU8310_ADC_V_SEL_MASK,
-			   (0x4 << NAU8310_ADC_I_SEL_SFT) | 0x4);
+	{ NAU8310_R0C_TDM_CTRL, 0x0c24 },
 	/* Set I-sense digital gain to +10.25dB */
-	regmap_update_bits(regmap, NAU8310_R14_ADC_VOL_CTRL,
-			   NAU8310_ADC_GAIN_L_MASK | NAU8310_ADC_GAIN_R_MASK,
-			   (0x1 << NAU8310_ADC_GAIN_L_SFT) | 0x62);
+	{ NAU8310_R14_ADC_VOL_CTRL, 0x0162 },
+	/* stall DSP */
+	{ NAU8310_R1A_DSP_CORE_CTRL2, 0x0010 },
+	/* Default oversampling/decimations settings are unusable
+	 * (audible hiss). Set it to something better.
+	 */
+	{ NAU8310_R29_DAC_CTRL1, 0x0080 },
+	/* Set ALC parameters */
+	{ NAU8310_R2C_ALC_CTRL1, 0x20e0 },
+	{ NAU8310_R2D_ALC_CTRL2, 0x5350 },
+	/* Temperature compensation */
+	{ NAU8310_R30_TEMP_COMP_CTRL, 0x7d00 },
+	/* Low pass filter control */
+	{ NAU8310_R33_LPF_CTRL, 0xbdc0 },
+	/* DAC Reference Voltage Decoupling Capacitors. */
+	{ NAU8310_R63_ANALOG_CONTROL_3, 0x0030 },
+	/* Auto-Att Min Gain 12dB, Class-D P&N Driver Slew Rate +75%. */
+	{ NAU8310_R64_ANALOG_CONTROL_4, 0x0c1b },
+	/* Bias Current, Monitor Vboost drops below VBAT,
+	 * Non-Overlapping-Time Control.
+	 */
+	{ NAU8310_R65_ANALOG_CONTROL_5, 0x4d82 },
+	/* Slew Rate Adjust, Bias Current. */
+	{ NAU8310_R66_ANALOG_CONTROL_6, 0x0e94 },
+	/* VREF Bandgap buffer ON, I/V Sense Ref Buffer Setting -1.5dB. */
+	{ NAU8310_R68_ANALOG_CONTROL_7, 0x0640 },
+	/* current limiting for low VBAT level */
+	{ NAU8310_R6C_ANALOG_CONTROL_9, 0x000f },
 	/* PGA in Class A Mode */
-	regmap_update_bits(regmap, NAU8310_R76_BOOST,
-			   NAU8310_STG2_SEL_CLASSA, NAU8310_STG2_SEL_CLASSA);
+	{ NAU8310_R76_BOOST, 0x4000 },
 	/* Set I-sense PGA Bias Current to minimum,
 	 * Disable PGA Common Mode Lock.
 	 */
-	regmap_update_bits(regmap, NAU8310_R77_FEPGA,
-			   NAU8310_CURR_TRIM_MASK | NAU8310_CMLCK_ENB,
-			   (0x7 << NAU8310_CURR_TRIM_SFT) | NAU8310_CMLCK_ENB);
+	{ NAU8310_R77_FEPGA, 0x0780 },
 	/* Set I-sense PGA to +12dB gain */
-	regmap_update_bits(regmap, NAU8310_R7F_POWER_UP_CONTROL,
-			   NAU8310_PGA_GAIN_MASK, 0x3 << NAU8310_PGA_GAIN_SFT);
+	{ NAU8310_R7F_POWER_UP_CONTROL, 0x0030 },
+};
+
+/*
+ * Amplifiers sharing a broadcast address. The hardware reset and the fixed
+ * part of the initiation go to the whole group in one pass, by the first
+ * member probed; the members after it only take the values into their
+ * register cache. A member probed again since was reset and initiated one
+ * by one as usual.
+ */
+static LIST_HEAD(nau8310_bcast_list);
+static DEFINE_MUTEX(nau8310_bcast_lock);
+
+static void nau8310_bcast_join(struct nau8310 *nau8310, struct i2c_client *i2c)
+{
+	struct nau8310_bcast *bcast;
+	u32 addr;
+	int ret;
+
+	if (device_property_read_u32(&i2c->dev, "nuvoton,broadcast-addr",
+				     &addr))
+		return;
+	if (i2c->flags & I2C_CLIENT_TEN) {
+		dev_warn(&i2c->dev, "No broadcast for 10-bit address\n");
+		return;
+	}
+
+	mutex_lock(&nau8310_bcast_lock);
+	list_for_each_entry(bcast, &nau8310_bcast_list, list)
+		if (bcast->client->adapter == i2c->adapter &&
+		    bcast->client->addr == addr)
+			goto found;
+	bcast = kzalloc(sizeof(*bcast), GFP_KERNEL);
+	if (!bcast) {
+		ret = -ENOMEM;
+		goto err;
+	}
+	bcast->client = i2c_new_dummy_device(i2c->adapter, addr);
+	if (IS_ERR(bcast->client)) {
+		ret = PTR_ERR(bcast->client);
+		kfree(bcast);
+		goto err;
+	}
+	list_add(&bcast->list, &nau8310_bcast_list);
+found:
+	bcast->users++;
+	nau8310->bcast = bcast;
+	mutex_unlock(&nau8310_bcast_lock);
+	return;
+err:
+	mutex_unlock(&nau8310_bcast_lock);
+	dev_warn(&i2c->dev, "Can't take broadcast address 0x%x (%d)\n",
+		 addr, ret);
+}
+
+static void nau8310_bcast_leave(struct nau8310 *nau8310)
+{
+	struct nau8310_bcast *bcast = nau8310->bcast;
+
+	if (!bcast)
+		return;
+
+	mutex_lock(&nau8310_bcast_lock);
+	if (!--bcast->users) {
+		list_del(&bcast->list);
+		i2c_unregister_device(bcast->client);
+		kfree(bcast);
+	}
+	mutex_unlock(&nau8310_bcast_lock);
+	nau8310->bcast = NULL;
+}
+
+static int nau8310_bcast_write(struct i2c_client *client, unsigned int reg,
+			       unsigned int value)
+{
+	u8 buf[4] = { reg >> 8, reg, value >> 8, value };
+
+	return nau8310_i2c_write(client, buf, sizeof(buf));
+}
+
+/* Returns true if the amplifier got the reset and the fixed initiation by
+ * the broadcast, now or by the member probed first.
+ */
+static bool nau8310_bcast_init(struct nau8310 *nau8310,
+			       struct i2c_client *i2c)
+{
+	struct nau8310_bcast *bcast = nau8310->bcast;
+	bool shared = false;
+	int i, ret;
+
+	if (!bcast)
+		return false;
+
+	mutex_lock(&nau8310_bcast_lock);
+	if (!bcast->tried) {
+		bcast->tried = true;
+		ret = nau8310_bcast_write(bcast->client,
+					  NAU8310_R00_HARDWARE_RST, 0x0001);
+		if (!ret)
+			ret = nau8310_bcast_write(bcast->client,
+						  NAU8310_R00_HARDWARE_RST, 0x0000);
+		for (i = 0; !ret && i < ARRAY_SIZE(nau8310_init_seq); i++)
+			ret = nau8310_bcast_write(bcast->client,
+						  nau8310_init_seq[i].reg,
+						  nau8310_init_seq[i].def);
+		if (ret)
+			dev_warn(nau8310->dev, "Broadcast to 0x%x fail (%d), program one by one\n",
+				 bcast->client->addr, ret);
+		bcast->programmed = !ret;
+	}
+	/* each member takes the broadcast once */
+	if (bcast->programmed && !test_and_set_bit(i2c->addr, bcast->served))
+		shared = true;
+	mutex_unlock(&nau8310_bcast_lock);
+
+	return shared;
+}
+
+static void nau8310_init_regs(struct nau8310 *nau8310, bool shared)
+{
+	struct regmap *regmap = nau8310->regmap;
+
+	/* the fixed part already programmed by the broadcast goes to cache */
+	if (shared)
+		regcache_cache_only(regmap, true);
+	regmap_multi_reg_write(regmap, nau8310_init_seq,
+			       ARRAY_SIZE(nau8310_init_seq));
+	if (shared)
+		regcache_cache_only(regmap, false);
 	/* Normal I2S Audio data w/o SAR ADC data.
 	 * Default oversampling/decimations settings are unusable
 	 * (audible hiss). Set it to something better.
@@ -1633,61 +3336,32 @@ static void nau8310_init_regs(struct nau8310 *nau8310)
 			   NAU8310_I2S_MODE | NAU8310_ADC_SYNC_DOWN_MASK,
 			   (nau8310->normal_iis_data << NAU8310_I2S_MODE_SFT) |
 			   NAU8310_ADC_SYNC_DOWN_64);
-	regmap_update_bits(regmap, NAU8310_R29_DAC_CTRL1,
-			   NAU8310_DAC_OVERSAMPLE_MASK, NAU8310_DAC_OVERSAMPLE_64);
-	/* Enable auto attenuation for better output signal */
-	regmap_update_bits(regmap, NAU8310_R2E_ALC_CTRL3,
-			   NAU8310_AUTOATT_EN, NAU8310_AUTOATT_EN);
-	/* Set ALC parameters */
-	regmap_update_bits(regmap, NAU8310_R2C_ALC_CTRL1,
-			   NAU8310_ALC_MAXGAIN_MASK,
-			   0x7 << NAU8310_ALC_MAXGAIN_SFT);
-	regmap_update_bits(regmap, NAU8310_R2D_ALC_CTRL2,
-			   NAU8310_ALC_DCY_MASK | NAU8310_ALC_ATK_MASK |
-			   NAU8310_ALC_HLD_MASK, (0x5 << NAU8310_ALC_DCY_SFT) |
-			   (0x3 << NAU8310_ALC_ATK_SFT) |
-			   (0x5 << NAU8310_ALC_HLD_SFT));
+	/* Enable auto attenuation for better output signal, and ALC to
+	 * avoid signal distortion when battery low.
+	 */
 	regmap_update_bits(regmap, NAU8310_R2E_ALC_CTRL3,
-			   NAU8310_LIM_MDE_MASK | NAU8310_VBAT_THLD_MASK,
-			   (0x3 << NAU8310_LIM_MDE_SFT) |
-			   (0x18 << NAU8310_VBAT_THLD_SFT));
-
-	/* Enable ALC to avoid signal distortion when battery low. */
-	if (nau8310->alc_enable)
-		regmap_update_bits(regmap, NAU8310_R2E_ALC_CTRL3,
-				   NAU8310_ALC_EN, NAU8310_ALC_EN);
+			   NAU8310_AUTOATT_EN | NAU8310_LIM_MDE_MASK |
+			   NAU8310_VBAT_THLD_MASK | NAU8310_ALC_EN,
+			   NAU8310_AUTOATT_EN | (0x3 << NAU8310_LIM_MDE_SFT) |
+			   (0x18 << NAU8310_VBAT_THLD_SFT) |
+			   (nau8310->alc_enable ? NAU8310_ALC_EN : 0));
 	/* Enable AEC for plarform used */
 	if (nau8310->aec_enable)
 		regmap_update_bits(regmap, NAU8310_R0B_I2S_PCM_CTRL0,
 				   NAU8310_AEC_MODE_AEC, NAU8310_AEC_MODE_AEC);
-
-	if (nau8310->clock_detection)
-		regmap_update_bits(regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_CLKPWRUP_DIS | NAU8310_PWRUP_DFT, 0);
-	else
-		regmap_update_bits(regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_CLKPWRUP_DIS | NAU8310_PWRUP_DFT,
-				   NAU8310_CLKPWRUP_DIS);
-	if (nau8310->clock_det_data)
-		regmap_update_bits(regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_APWRUP_EN, NAU8310_APWRUP_EN);
-	else
-		regmap_update_bits(regmap, NAU8310_R40_CLK_DET_CTRL,
-				   NAU8310_APWRUP_EN, 0);
+	if (nau8310->echo_ref_slot >= 0)
+		nau8310_echo_ref_apply(nau8310);
+
+	regmap_update_bits(regmap, NAU8310_R40_CLK_DET_CTRL,
+			   NAU8310_CLKPWRUP_DIS | NAU8310_PWRUP_DFT |
+			   NAU8310_APWRUP_EN,
+			   (nau8310->clock_detection ? 0 : NAU8310_CLKPWRUP_DIS) |
+			   (nau8310->clock_det_data ? NAU8310_APWRUP_EN : 0));
 	/* Boost Target Limit and Margin */
 	regmap_update_bits(regmap, NAU8310_R17_BOOST_CTRL1,
 			   NAU8310_BSTLIMIT_MASK | NAU8310_BSTMARGIN_MASK,
 			   (nau8310->boost_target_limit << NAU8310_BSTLIMIT_SFT) |
 			   nau8310->boost_target_margin);
-	/* Temperature compensation */
-	regmap_update_bits(regmap, NAU8310_R30_TEMP_COMP_CTRL,
-			   NAU8310_TEMP_COMP_ACT2_MASK, 0);
-	/* Low pass filter control */
-	regmap_update_bits(regmap, NAU8310_R33_LPF_CTRL,
-			   NAU8310_LPF_IN1_EN | NAU8310_LPF_IN1_TC_MASK |
-			   NAU8310_LPF_IN2_EN | NAU8310_LPF_IN2_TC_MASK,
-			   NAU8310_LPF_IN1_EN | (0x7 << NAU8310_LPF_IN1_TC_SFT) |
-			   NAU8310_LPF_IN2_EN | (0x7 << NAU8310_LPF_IN2_TC_SFT));
 	/* Set Boost Attack/Decay, Hold Time and TC EN */
 	regmap_update_bits(regmap, NAU8310_R18_BOOST_CTRL2, NAU8310_TC_EN |
 			   NAU8310_BSTHOLD_MASK | NAU8310_BSTSTEPTIME_MASK |
@@ -1699,32 +3373,6 @@ static void nau8310_init_regs(struct nau8310 *nau8310)
 	regmap_update_bits(regmap, NAU8310_R73_RDAC,
 			   NAU8310_DACVREFSEL_MASK,
 			   nau8310->dac_vref << NAU8310_DACVREFSEL_SFT);
-	/* DAC Reference Voltage Decoupling Capacitors. */
-	regmap_update_bits(regmap, NAU8310_R63_ANALOG_CONTROL_3,
-			   NAU8310_DACREFCAP_MASK, 0x3 << NAU8310_DACREFCAP_SFT);
-	/* Auto-Att Min Gain 12dB, Class-D P&N Driver Slew Rate +75%. */
-	regmap_update_bits(regmap, NAU8310_R64_ANALOG_CONTROL_4,
-			   NAU8310_AUTOATTMIN_MASK | NAU8310_CLASSD_SLEWN_MASK |
-			   NAU8310_CLASSD_SLEWP_MASK | NAU8310_CLASSD_SHORTP_MASK |
-			   NAU8310_CLASSD_SHORTN_MASK,
-			   NAU8310_CLASSD_SHORTP_100UP | NAU8310_AUTOATTMIN_12DB |
-			   NAU8310_CLASSD_SLEWP_75UP | NAU8310_CLASSD_SLEWN_75UP);
-	/* Bias Current, Monitor Vboost drops below VBAT,
-	 * Non-Overlapping-Time Control.
-	 */
-	regmap_update_bits(regmap, NAU8310_R65_ANALOG_CONTROL_5,
-			   NAU8310_BSTINDR_MASK | NAU8310_BSTCURGEN_MASK |
-			   NAU8310_BSTMONEN | NAU8310_BSTCLKPULSE_MASK,
-			   (0x4 << NAU8310_BSTINDR_SFT) | NAU8310_BSTMONEN |
-			   (0xd << NAU8310_BSTCURGEN_SFT) | 0x2);
-	/* Slew Rate Adjust, Bias Current. */
-	regmap_update_bits(regmap, NAU8310_R66_ANALOG_CONTROL_6,
-			   NAU8310_BSTSLEWPOFF_MASK | NAU8310_BSTSLEWPON_MASK |
-			   NAU8310_BSTSLEWNON_MASK | NAU8310_BSTSLEWNOFF_MASK |
-			   NAU8310_BSTIPDR_MASK, (0x3 << NAU8310_BSTSLEWPOFF_SFT) |
-			   (0x2 << NAU8310_BSTSLEWPON_SFT) |
-			   (0x2 << NAU8310_BSTSLEWNON_SFT) |
-			   (0x1 << NAU8310_BSTSLEWNOFF_SFT) | 0x4);
 	if (nau8310->silicon_id == NAU8310_REG_SI_REV_G10) {
 		/* Peak Current 4A, Low Voltage 2.8V */
 		regmap_update_bits(regmap, NAU8310_R6B_ANALOG_CONTROL_8,
@@ -1737,17 +3385,10 @@ static void nau8310_init_regs(struct nau8310 *nau8310)
 				   NAU8310_VBAT_PCL_MASK | NAU8310_VBAT_THD_MASK,
 				   (0x7 << NAU8310_VBAT_THD_SFT));
 	}
-	/* current limiting for low VBAT level */
-	regmap_update_bits(regmap, NAU8310_R6C_ANALOG_CONTROL_9,
-			   NAU8310_VBAT_CURLMT_MASK, 0xf);
 	/* VMID Tieoff (VMID Resistor Selection) */
 	regmap_update_bits(regmap, NAU8310_R60_BIAS_ADJ,
 			   NAU8310_BIAS_VMID_SEL_MASK,
 			   nau8310->vref_impedance << NAU8310_BIAS_VMID_SEL_SFT);
-	/* VREF Bandgap buffer ON, I/V Sense Ref Buffer Setting -1.5dB. */
-	regmap_update_bits(regmap, NAU8310_R68_ANALOG_CONTROL_7,
-			   NAU8310_ADCGAIN_MASK | NAU8310_VREFBG_EN,
-			   (0x3 << NAU8310_ADCGAIN_SFT) | NAU8310_VREFBG_EN);
 	nau8310_software_reset(regmap);
 	/* Enable VMID, BIAS, DAC, DCA CLOCK, ADC, Voltage/Current Amps,
 	 * ADC Resetb gated by 'PowerUp' Signal.
@@ -1776,6 +3417,62 @@ static void nau8310_init_regs(struct nau8310 *nau8310)
 			   nau8310->sar_sampling_time << NAU8310_SAR_SAMPLING_TIME_SFT);
 }
 
+static irqreturn_t nau8310_interrupt(int irq, void *data)
+{
+	struct nau8310 *nau8310 = (struct nau8310 *)data;
+	unsigned int active_irq;
+
+	if (regmap_read(nau8310->regmap, NAU8310_R06_INT_CLR_STATUS,
+			&active_irq)) {
+		dev_err(nau8310->dev, "failed to read irq status\n");
+		return IRQ_NONE;
+	}
+	active_irq &= NAU8310_INT_STATUS_MASK;
+	if (!active_irq)
+		return IRQ_NONE;
+
+	/* The DSP puts reply into mailbox, wake up the command waiter. */
+	if (active_irq & NAU8310_INT_STATUS_DSP2I2C)
+		complete(&nau8310->dsp_reply);
+	/* The clock detection powered the chip down, recover the stream. */
+	if (active_irq & NAU8310_INT_STATUS_PWR) {
+		nau8310->clk_loss_events++;
+		if (nau8310->clk_armed && !nau8310->clk_forced &&
+		    !delayed_work_pending(&nau8310->clk_work)) {
+			nau8310->clk_loss_start = ktime_get();
+			schedule_delayed_work(&nau8310->clk_work, 0);
+		}
+	}
+	regmap_write(nau8310->regmap, NAU8310_R06_INT_CLR_STATUS, active_irq);
+
+	return IRQ_HANDLED;
+}
+
+static int nau8310_setup_irq(struct nau8310 *nau8310)
+{
+	int ret;
+
+	ret = devm_request_threaded_irq(nau8310->dev, nau8310->irq, NULL,
+		nau8310_interrupt, IRQF_TRIGGER_LOW | IRQF_ONESHOT,
+		"nau8310", nau8310);
+	if (ret) {
+		dev_err(nau8310->dev, "Cannot request irq %d (%d)\n",
+			nau8310->irq, ret);
+		return ret;
+	}
+
+	/* The DSP reply interrupt is used for the mailbox protocol, and the
+	 * power interrupt for the recovery from a clock loss.
+	 */
+	regmap_update_bits(nau8310->regmap, NAU8310_R05_INTERRUPT_CTRL,
+			   NAU8310_DSP2I2C_INT_MASK | NAU8310_DSP2I2C_INT_DIS |
+			   NAU8310_PWR_INT_MASK | NAU8310_PWR_INT_DIS, 0);
+	regmap_update_bits(nau8310->regmap, NAU8310_R0A_IO_CTRL,
+			   NAU8310_IRQ_OUTPUT_EN, NAU8310_IRQ_OUTPUT_EN);
+
+	return 0;
+}
+
 static void nau8310_print_device_properties(struct nau8310 *nau8310)
 {
 	struct device *dev = nau8310->dev;
@@ -1792,9 +3489,45 @@ static void nau8310_print_device_properties(struct nau8310 *nau8310)
 	dev_dbg(dev, "boost-convert-enable:    %d\n", nau8310->boost_convert_enable);
 	dev_dbg(dev, "boost-target-limit:      %x\n", nau8310->boost_target_limit);
 	dev_dbg(dev, "boost-target-margin:     %x\n", nau8310->boost_target_margin);
+	dev_dbg(dev, "boost-adapt-period-ms:   %u\n", nau8310->boost_adapt.period_ms);
+	dev_dbg(dev, "boost-adapt-floor:       %x\n", nau8310->boost_adapt.floor);
+	dev_dbg(dev, "boost-adapt-release:     %u\n", nau8310->boost_adapt.release);
 	dev_dbg(dev, "normal-iis-data:         %d\n", nau8310->normal_iis_data);
 	dev_dbg(dev, "alc-enable:              %d\n", nau8310->alc_enable);
 	dev_dbg(dev, "aec-enable:              %d\n", nau8310->aec_enable);
+	dev_dbg(dev, "echo-ref-slot:           %d\n", nau8310->echo_ref_slot);
+	dev_dbg(dev, "echo-ref-delay-frames:   %u\n", nau8310->echo_ref_delay);
+	dev_dbg(dev, "dsp-async-init:          %d\n", nau8310->dsp_async_init);
+	dev_dbg(dev, "dsp-retention:           %d\n", nau8310->dsp_retain);
+	dev_dbg(dev, "idle-bias-off:           %d\n", nau8310->idle_bias_off);
+	dev_dbg(dev, "dsp-clock-grace-ms:      %u\n", nau8310->dsp_clk_grace_ms);
+	dev_dbg(dev, "dsp-latency-frames:      %u %u\n",
+		nau8310->profile[0].latency_frames,
+		nau8310->profile[1].latency_frames);
+	dev_dbg(dev, "kcs-check-interval:      %u\n", nau8310->kcs_check_interval);
+	dev_dbg(dev, "thermal-max-state:       %u\n", nau8310->thermal.max_state);
+	dev_dbg(dev, "thermal-period-ms:       %u\n", nau8310->thermal.period_ms);
+	dev_dbg(dev, "keepalive-ms:            %u\n", nau8310->keepalive.ms);
+}
+
+/* One delay per profile; the profiles past the list take its last one */
+static void nau8310_read_dsp_latency(struct device *dev,
+				     struct nau8310 *nau8310)
+{
+	u32 latency[NAU8310_DSP_PROFILE_NUM];
+	int i, num;
+
+	num = device_property_count_u32(dev, "nuvoton,dsp-latency-frames");
+	if (num <= 0)
+		return;
+	num = min(num, NAU8310_DSP_PROFILE_NUM);
+	if (device_property_read_u32_array(dev, "nuvoton,dsp-latency-frames",
+					   latency, num))
+		return;
+	for (i = 0; i < NAU8310_DSP_PROFILE_NUM; i++)
+		nau8310->profile[i].latency_frames =
+			min_t(u32, latency[min(i, num - 1)],
+			      NAU8310_DSP_LATENCY_MAX);
 }
 
 static int nau8310_read_device_properties(struct device *dev,
@@ -1845,6 +3578,19 @@ static int nau8310_read_device_properties(struct device *dev,
 					       &nau8310->boost_target_margin);
 		if (ret)
 			nau8310->boost_target_margin = 0x2;
+		ret = device_property_read_u32(dev, "nuvoton,boost-adapt-period-ms",
+					       &nau8310->boost_adapt.period_ms);
+		if (ret || nau8310->boost_adapt.period_ms >
+			NAU8310_BOOST_PERIOD_MAX_MS)
+			nau8310->boost_adapt.period_ms = 0;
+		ret = device_property_read_u32(dev, "nuvoton,boost-adapt-floor",
+					       &nau8310->boost_adapt.floor);
+		if (ret || nau8310->boost_adapt.floor > NAU8310_BSTLIMIT_MAX)
+			nau8310->boost_adapt.floor = 0x20;
+		ret = device_property_read_u32(dev, "nuvoton,boost-adapt-release",
+					       &nau8310->boost_adapt.release);
+		if (ret || nau8310->boost_adapt.release > NAU8310_BOOST_RELEASE_MAX)
+			nau8310->boost_adapt.release = 8;
 	}
 	nau8310->normal_iis_data =
 		device_property_read_bool(dev, "nuvoton,normal-iis-data");
@@ -1852,6 +3598,41 @@ static int nau8310_read_device_properties(struct device *dev,
 		device_property_read_bool(dev, "nuvoton,alc-enable");
 	nau8310->aec_enable =
 		device_property_read_bool(dev, "nuvoton,aec-enable");
+	ret = device_property_read_u32(dev, "nuvoton,echo-ref-slot",
+				       &nau8310->echo_ref_slot);
+	if (ret || nau8310->echo_ref_slot < 0 || nau8310->echo_ref_slot > 7)
+		nau8310->echo_ref_slot = -1;
+	ret = device_property_read_u32(dev, "nuvoton,echo-ref-delay-frames",
+				       &nau8310->echo_ref_delay);
+	if (ret || nau8310->echo_ref_delay > NAU8310_ECHO_REF_DELAY_MAX)
+		nau8310->echo_ref_delay = 0;
+	nau8310->dsp_async_init =
+		device_property_read_bool(dev, "nuvoton,dsp-async-init");
+	nau8310->dsp_retain =
+		device_property_read_bool(dev, "nuvoton,dsp-retention");
+	nau8310->idle_bias_off =
+		device_property_read_bool(dev, "nuvoton,idle-bias-off");
+	nau8310_read_dsp_latency(dev, nau8310);
+	ret = device_property_read_u32(dev, "nuvoton,dsp-clock-grace-ms",
+				       &nau8310->dsp_clk_grace_ms);
+	if (ret || nau8310->dsp_clk_grace_ms > NAU8310_DSP_CLK_GRACE_MAX)
+		nau8310->dsp_clk_grace_ms = 0;
+	ret = device_property_read_u32(dev, "nuvoton,kcs-check-interval",
+				       &nau8310->kcs_check_interval);
+	if (ret || nau8310->kcs_check_interval > NAU8310_DSP_KCS_CHECK_MAX)
+		nau8310->kcs_check_interval = 1;
+	ret = device_property_read_u32(dev, "nuvoton,thermal-max-state",
+				       &nau8310->thermal.max_state);
+	if (ret || nau8310->thermal.max_state > NAU8310_THERMAL_STATE_MAX)
+		nau8310->thermal.max_state = 0;
+	ret = device_property_read_u32(dev, "nuvoton,thermal-period-ms",
+				       &nau8310->thermal.period_ms);
+	if (ret)
+		nau8310->thermal.period_ms = 0;
+	ret = device_property_read_u32(dev, "nuvoton,keepalive-ms",
+				       &nau8310->keepalive.ms);
+	if (ret || nau8310->keepalive.ms > NAU_KEEPALIVE_MAX_MS)
+		nau8310->keepalive.ms = 0;
 
 	return 0;
 }
@@ -1860,6 +3641,8 @@ static int nau8310_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8310 *nau8310 = dev_get_platdata(dev);
+	struct regmap_config regmap_config;
+	bool shared;
 	int ret, value;
 
 	if (!nau8310) {
@@ -1869,36 +3652,98 @@ static int nau8310_i2c_probe(struct i2c_client *i2c)
 	}
 	i2c_set_clientdata(i2c, nau8310);
 
-	nau8310->regmap = devm_regmap_init(dev, NULL, i2c,
-					   &nau8310_regmap_config);
+	/* the amplifiers of a board cache only the registers they use */
+	nau_regmap_lazy_config(&regmap_config, &nau8310_regmap_config);
+	nau8310->regcache_report.lazy = true;
+	nau8310->regmap = nau_regstat_regmap_init(dev, &nau8310_i2c_bus, i2c,
+			&regmap_config, &nau8310->regstat);
 	if (IS_ERR(nau8310->regmap))
 		return PTR_ERR(nau8310->regmap);
+	nau8310->dsp_regmap = devm_regmap_init(dev, &nau8310_dsp_bus, i2c,
+					       &nau8310_dsp_regmap_config);
+	if (IS_ERR(nau8310->dsp_regmap))
+		return PTR_ERR(nau8310->dsp_regmap);
+	ret = nau8310_dsp_frame_init(nau8310, i2c);
+	if (ret)
+		return ret;
 
 	nau8310->dev = dev;
+	nau8310->irq = i2c->irq;
 	nau8310->dsp_enable = false;
+	memset(nau8310->clk_cache, 0, sizeof(nau8310->clk_cache));
+	nau8310->clk_cache_next = 0;
+	nau8310->clk_applied.mclk = 0;
+	nau_biq_rates_init(&nau8310->biq_rates, nau8310->regmap,
+			   NAU8310_R80_BIQ0_COE_1, NAU8310_BIQ_COE_NUM * 2,
+			   &nau8310->biq_shadow, 0, 0);
+	init_completion(&nau8310->dsp_reply);
+	init_completion(&nau8310->dsp_ready);
+	INIT_WORK(&nau8310->dsp_init_work, nau8310_dsp_init_work);
+	ret = devm_delayed_work_autocancel(dev, &nau8310->osc_work,
+					   nau8310_osc_work);
+	if (ret)
+		return ret;
+	ret = devm_delayed_work_autocancel(dev, &nau8310->unmute_work,
+					   nau8310_unmute_work);
+	if (ret)
+		return ret;
+	ret = devm_delayed_work_autocancel(dev, &nau8310->clk_work,
+					   nau8310_clk_work);
+	if (ret)
+		return ret;
+	ret = devm_delayed_work_autocancel(dev, &nau8310->boost_adapt.work,
+					   nau8310_boost_work);
+	if (ret)
+		return ret;
+	ret = nau8310_dsp_queue_init(nau8310);
+	if (ret)
+		return ret;
 
-	nau8310_reset_chip(nau8310->regmap);
+	nau8310_bcast_join(nau8310, i2c);
+	shared = nau8310_bcast_init(nau8310, i2c);
+	if (!shared)
+		nau8310_reset_chip(nau8310->regmap);
 	ret = regmap_read(nau8310->regmap, NAU8310_R46_I2C_DEVICE_ID, &value);
 	if (ret) {
 		dev_err(dev, "Failed to read device id from the NAU8310: %d\n",
 			ret);
-		return ret;
+		goto err;
 	}
 	nau8310->silicon_id = value & NAU8310_REG_SI_REV_MASK;
 	ret = nau8310_read_device_properties(dev, nau8310);
 	if (ret)
-		return ret;
+		goto err;
 	nau8310_print_device_properties(nau8310);
-	nau8310_init_regs(nau8310);
+	nau8310_init_regs(nau8310, shared);
+	ret = nau8310_thermal_init(nau8310);
+	if (ret)
+		goto err;
+	/* Without the interrupt, the reply from DSP is polled. */
+	if (nau8310->irq && nau8310_setup_irq(nau8310))
+		nau8310->irq = 0;
 
-	return snd_soc_register_component(dev, &soc_component_dev_nau8310,
-					  &nau8310_dai, 1);
+	ret = snd_soc_register_component(dev, &soc_component_dev_nau8310,
+					 &nau8310_dai, 1);
+	if (ret)
+		goto err;
+	nau_pm_async_init(dev);
+
+	return 0;
+err:
+	nau8310_dsp_remove(nau8310);
+	nau8310_bcast_leave(nau8310);
+	return ret;
 }
 
 
 static int nau8310_i2c_remove(struct i2c_client *client)
 {
+	struct nau8310 *nau8310 = i2c_get_clientdata(client);
+
 	snd_soc_unregister_component(&client->dev);
+	cancel_delayed_work_sync(&nau8310->vol_ramp.work);
+	nau8310_dsp_remove(nau8310);
+	nau8310_bcast_leave(nau8310);
 	return 0;
 }
 
@@ -1927,11 +3772,49 @@ static const struct acpi_device_id nau8310_acpi_match[] = {
 MODULE_DEVICE_TABLE(acpi, nau8310_acpi_match);
 #endif
 
+/* The DSP reload of resume runs from the I2C device, which resumes in
+ * parallel with the other amplifiers of the card and the rest of the
+ * system, rather than from the card, which resumes its components one
+ * after the other.
+ */
+static int __maybe_unused nau8310_i2c_suspend(struct device *dev)
+{
+	struct nau8310 *nau8310 = dev_get_drvdata(dev);
+
+	if (!nau8310->dapm)
+		return 0;
+	/* A path the card keeps up over the suspend, like a codec to codec
+	 * link playing with the host asleep, keeps the amplifier on as well.
+	 */
+	nau8310->kept_on = snd_soc_dapm_get_bias_level(nau8310->dapm) ==
+		SND_SOC_BIAS_ON;
+	if (nau8310->kept_on)
+		return 0;
+
+	return nau8310_suspend(snd_soc_dapm_to_component(nau8310->dapm));
+}
+
+static int __maybe_unused nau8310_i2c_resume(struct device *dev)
+{
+	struct nau8310 *nau8310 = dev_get_drvdata(dev);
+
+	if (!nau8310->dapm || nau8310->kept_on)
+		return 0;
+
+	return nau8310_resume(snd_soc_dapm_to_component(nau8310->dapm));
+}
+
+static const struct dev_pm_ops nau8310_pm_ops = {
+	SET_SYSTEM_SLEEP_PM_OPS(nau8310_i2c_suspend, nau8310_i2c_resume)
+};
+
 static struct i2c_driver nau8310_i2c_driver = {
 	.driver = {
 		.name = "nau8310",
 		.of_match_table = of_match_ptr(nau8310_of_ids),
 		.acpi_match_table = ACPI_PTR(nau8310_acpi_match),
+		.pm = &nau8310_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8310_i2c_probe,
 	.remove = nau8310_i2c_remove,
@@ -1943,3 +3826,7 @@ MODULE_DESCRIPTION("ASoC NAU83G10/20 Boosted Mono Class-D Amplifier with DSP and
 MODULE_AUTHOR("John Hsu <kchsu0@nuvoton.com>");
 MODULE_AUTHOR("David Lin <ctlin0@nuvoton.com>");
 MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_SND_SOC_NAU8310_KUNIT_TEST
+#include "nau8310-test.c"
+#endif
@@ -10,6 +10,15 @@
 #ifndef __NAU8310_H__
 #define __NAU8310_H__
 
+/* the types embedded in struct nau8310, for the machine drivers too */
+#include "nau-biq.h"
+#include "nau-delay.h"
+#include "nau-hwparams.h"
+#include "nau-keepalive.h"
+#include "nau-latency.h"
+#include "nau-regmap.h"
+#include "nau-volramp.h"
+
 #define NAU8310_R00_HARDWARE_RST		0x00
 #define NAU8310_R01_SOFTWARE_RST		0x01
 #define NAU8310_R02_I2C_ADDR			0x02
@@ -113,10 +122,14 @@
 #define NAU8310_R9C_BIQ2_COE_9			0x9c
 #define NAU8310_R9D_BIQ2_COE_10			0x9d
 #define NAU8310_RF000_DSP_COMM			0xf000
-#define NAU8310_REG_MAX				NAU8310_RF000_DSP_COMM
+#define NAU8310_REG_MAX				NAU8310_R9D_BIQ2_COE_10
+/* the three biquads, BIQ0_COE_1 (0x80) to BIQ2_COE_10 (0x9d) */
+#define NAU8310_BIQ_COE_NUM			30
 /* 16-bit control register address, and 16-bits control register data */
 #define NAU8310_REG_ADDR_LEN			16
 #define NAU8310_REG_DATA_LEN			16
+/* the DSP mailbox, in a regmap of its own with 32-bit native data */
+#define NAU8310_DSP_REG_LEN			(NAU8310_REG_ADDR_LEN / 8)
 
 
 /* CLK_CTRL (0x03) */
@@ -563,14 +576,214 @@
 #define NAU8310_CODEC_DAI "nau8310-hifi"
 
 
+#define NAU8310_DSP_STATS_NUM			15
+
+/* statistics of DSP mailbox, polls are counted for the last command */
+struct nau8310_dsp_stats {
+	unsigned int commands;
+	unsigned int idle_polls;
+	unsigned int reply_polls;
+	unsigned int max_reply_polls;
+	unsigned int timeouts;
+	unsigned int irq_replies;
+	/* mailbox transfers, KCS data bytes and framing errors, cumulative */
+	unsigned int transfers;
+	unsigned int bytes;
+	unsigned int proto_errors;
+	/* KCS uploads resumed from the last good result check */
+	unsigned int kcs_rewinds;
+	/* mailbox given up to a waiting command of a higher class */
+	unsigned int prio_yields;
+	/* lost idle patterns recovered by a drain, and by a chip reset */
+	unsigned int resyncs;
+	unsigned int resets;
+	/* commands failed on the message sent, and on the reply */
+	unsigned int send_errors;
+	unsigned int reply_errors;
+};
+
+/* classes of the DSP commands taking the mailbox, from the lowest */
+enum {
+	NAU8310_DSP_PRIO_DIAG,
+	NAU8310_DSP_PRIO_SETUP,
+	NAU8310_DSP_PRIO_CTRL,
+	NAU8310_DSP_PRIO_NUM,
+};
+
+/* DSP frame status and counter sampled in background, the last ones kept */
+#define NAU8310_DSP_MON_LEN 16
+
+/* The counter runs with the DSP cycles spent on the algorithm. Between two
+ * samples it gives the cycles per frame at the sample rate, and the load
+ * in per mille of the DSP clock; both are 0 for the first sample after a
+ * gap or while the DSP clock isn't known.
+ */
+struct nau8310_dsp_sample {
+	u64 time_ns;
+	u32 frame_status;
+	u32 counter;
+	u32 frame_cycles;
+	u32 load;
+};
+
+struct nau8310_dsp_monitor {
+	struct snd_soc_component *component;
+	struct delayed_work work;
+	/* sampling period, 0 to stop; it doubles up to 8 times while idle */
+	unsigned int period_ms;
+	unsigned int idle_shift;
+	struct nau8310_dsp_sample ring[NAU8310_DSP_MON_LEN];
+	unsigned int head;
+	spinlock_t lock;
+};
+
+/* The boost target limit follows the output level, sampled while the DAC
+ * is powered. A loud sample raises the target to the ceiling at once, and
+ * the target steps down to the floor after each run of release quiet
+ * samples.
+ */
+#define NAU8310_BOOST_PERIOD_MAX_MS 1000
+#define NAU8310_BOOST_RELEASE_MAX 64
+/* DAC volume codes of the hysteresis when DSP status isn't sampled */
+#define NAU8310_BOOST_VOL_LOUD 0xc0
+#define NAU8310_BOOST_VOL_QUIET 0xb0
+
+struct nau8310_boost_adapt {
+	struct delayed_work work;
+	/* sampling period, 0 for the fixed target */
+	unsigned int period_ms;
+	unsigned int floor;
+	unsigned int release;
+	/* target limit of the stream start, and the one applied */
+	unsigned int ceiling;
+	unsigned int target;
+	unsigned int quiet;
+	bool loud;
+	bool active;
+	/* counters, cumulative */
+	u32 samples;
+	u32 raises;
+	u32 drops;
+	/* the target steps under the ceiling times the time spent there */
+	u64 saved_step_ms;
+};
+
+/* Thermal backoff of the DAC volume, by the state of the cooling device
+ * or by the over temperature the DSP reports, whichever is higher. Each
+ * state takes NAU8310_THERMAL_STEP codes off the volume.
+ */
+#define NAU8310_THERMAL_STEP 4
+#define NAU8310_THERMAL_STATE_MAX 16
+#define NAU8310_THERMAL_RELEASE 8
+#define NAU8310_THERMAL_IDLE_SHIFT_MAX 3
+
+struct nau8310_thermal {
+	struct thermal_cooling_device *cdev;
+	struct delayed_work work;
+	struct mutex lock;
+	/* sampling period, 0 for no monitor; it doubles up to 8 times while
+	 * the DSP reports no over temperature
+	 */
+	unsigned int period_ms;
+	unsigned int idle_shift;
+	unsigned int max_state;
+	unsigned long cdev_state;
+	unsigned int otp_state;
+	unsigned int quiet;
+	unsigned int applied;
+	/* DAC volume without the backoff */
+	unsigned int dac_vol;
+	bool active;
+	u32 otp_events;
+	u32 backoffs;
+};
+
+#define NAU8310_ECHO_REF_DELAY_MAX 4096
+
+#define NAU8310_CLK_CACHE_NUM 4
+
+/* The master clock of the codec, as set_sysclk() gives it. With BCLK the
+ * board feeds BCLK into the MCLK pin, and the rate follows the stream.
+ */
+enum {
+	NAU8310_CLK_ID_MCLK,
+	NAU8310_CLK_ID_BCLK,
+};
+#define NAU8310_OSC_DELAY_MAX_MS 10000
+
+/* clock source solution chosen for a MCLK and sampling rate pair */
+struct nau8310_clk_solution {
+	int mclk;
+	int fs;
+	int dsp_enable;
+	const struct nau8310_srate_attr *srate_table;
+	int n1_sel;
+	int mult_sel;
+	int n2_sel;
+	int dsp_mult_sel;
+};
+
+/* The stages of the stream start, and the DSP profile switch, timed under
+ * debugfs
+ */
+enum {
+	NAU8310_LAT_STARTUP,
+	NAU8310_LAT_HW_PARAMS,
+	NAU8310_LAT_TRIGGER,
+	NAU8310_LAT_DAC_UNMUTE,
+	NAU8310_LAT_DSP_WAIT,
+	NAU8310_LAT_PROFILE,
+	NAU8310_LAT_CLK_RECOVERY,
+	NAU8310_LAT_WAKE,
+	NAU8310_LAT_NUM,
+};
+
+/* KCS profiles of DSP, like music and voice, preloaded for the switch */
+#define NAU8310_DSP_PROFILE_NUM 2
+
+struct nau8310_dsp_profile {
+	struct nau8310 *nau8310;
+	const struct firmware *fw;
+	/* algorithmic delay of the profile in frames, fixed by the firmware */
+	u32 latency_frames;
+};
+
+#define NAU8310_DSP_LATENCY_MAX 4096
+
+/* amplifiers on an adapter sharing a broadcast address */
+struct nau8310_bcast {
+	struct list_head list;
+	struct i2c_client *client;
+	unsigned int users;
+	bool tried;
+	bool programmed;
+	/* 7-bit addresses of the members which took the broadcast */
+	DECLARE_BITMAP(served, 128);
+};
+
 struct nau8310 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct regmap *dsp_regmap;
+	struct nau8310_bcast *bcast;
+	/* mailbox message framed as transmitted, and its I2C messages */
+	u8 *dsp_frame;
+	struct i2c_msg *dsp_msgs;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
 	struct snd_soc_dapm_context *dapm;
 	char silicon_id;
 	int irq;
 	int mclk;
 	int fs;
+	int sysclk_id;
+	int tdm_slots;
+	int tdm_slot_width;
+	/* DSP clock applied with the sample rate, for the load of DSP, and
+	 * the one of the internal OSC the DSP falls back to
+	 */
+	unsigned int dsp_clk_rate;
+	unsigned int dsp_osc_rate;
 	int vref_impedance;
 	int dac_vref;
 	int sar_voltage;
@@ -583,12 +796,117 @@ struct nau8310 {
 	int boost_convert_enable;
 	int boost_target_limit;
 	int boost_target_margin;
+	struct nau8310_boost_adapt boost_adapt;
+	struct nau8310_thermal thermal;
+	/* ramp of the DAC volume, to the one less the thermal backoff */
+	struct nau_vol_ramp vol_ramp;
 	int normal_iis_data;
 	int alc_enable;
 	int aec_enable;
+	/* capture slot of the DSP output as echo reference, -1 for none,
+	 * and its delay in frames the host AEC is told
+	 */
+	int echo_ref_slot;
+	unsigned int echo_ref_delay;
+	int dsp_async_init;
+	/* solutions of clock source choosing, and the one programmed */
+	struct nau8310_clk_solution clk_cache[NAU8310_CLK_CACHE_NUM];
+	int clk_cache_next;
+	struct nau8310_clk_solution clk_applied;
+	/* clocks for the internal OSC, solved at probe */
+	struct nau8310_clk_solution clk_osc;
+	/* the switch to OSC after shutdown deferred, 0 for no delay */
+	unsigned int osc_delay_ms;
+	struct delayed_work osc_work;
+	/* the power down window after the stream */
+	struct nau_keepalive keepalive;
+	/* soft mute ramps of the DAC */
+	struct delayed_work unmute_work;
+	ktime_t unmute_start;
+	ktime_t mute_start;
+	/* recovery of the power down by the clock detection */
+	struct delayed_work clk_work;
+	ktime_t clk_loss_start;
+	bool clk_armed;
+	bool clk_forced;
+	u32 clk_loss_events;
+	u32 clk_recoveries;
 	/* DSP data */
 	int dsp_enable;
+	/* firmware revision read once the first KCS setup is loaded, and
+	 * what the DSP is checked against after a stall over a suspend
+	 */
+	int dsp_revision;
+	bool dsp_revision_valid;
+	/* the DSP stalled on the internal OSC over a suspend */
+	bool dsp_retain;
+	bool dsp_retained;
+	u32 dsp_retain_hits;
+	u32 dsp_retain_misses;
+	/* the bias off while idle, with the DSP stalled on the OSC */
+	bool idle_bias_off;
+	bool dsp_parked;
+	u32 dsp_parks;
+	/* the DSP clock stop deferred for a window after the power down;
+	 * a power up within it sends neither CLK_STOP nor CLK_RESTART
+	 */
+	unsigned int dsp_clk_grace_ms;
+	struct delayed_work dsp_clk_work;
+	bool dsp_clk_on;
+	u32 dsp_clk_skips;
 	int kcs_setup_size;
+	/* KCS setup chunks uploaded between the result checks */
+	unsigned int kcs_check_interval;
+	/* range applied by the last KCS patch, read back by its control */
+	int kcs_patch_off;
+	int kcs_patch_len;
+	/* copy of the KCS region written to DSP, a bit per byte held; the
+	 * reads are served from it unless verified against DSP
+	 */
+	struct mutex kcs_shadow_lock;
+	u8 *kcs_shadow;
+	unsigned long *kcs_shadow_map;
+	bool kcs_verify;
+	u32 kcs_shadow_hits;
+	u32 kcs_shadow_mismatches;
+	/* KCS setup loaded last time and shared by amps, for reload on resume */
+	const struct firmware *kcs_fw;
+	struct nau8310_dsp_profile profile[NAU8310_DSP_PROFILE_NUM];
+	int dsp_profile;
+	atomic_t profile_pending;
+	struct completion dsp_reply;
+	struct nau8310_dsp_stats dsp_stats;
+	/* serialize the mailbox transactions, by the classes waiting */
+	struct mutex dsp_lock;
+	atomic_t dsp_waiters[NAU8310_DSP_PRIO_NUM];
+	wait_queue_head_t dsp_prio_wait;
+	struct nau8310_dsp_req *dsp_queue;
+	unsigned int dsp_queue_head;
+	unsigned int dsp_queue_tail;
+	spinlock_t dsp_queue_lock;
+	struct workqueue_struct *dsp_wq;
+	struct work_struct dsp_work;
+	struct nau8310_dsp_monitor dsp_mon;
+	/* DSP bring-up out of the component probe for async init mode */
+	struct work_struct dsp_init_work;
+	struct completion dsp_ready;
+	int dsp_init_ret;
+	/* switch of the DSP path, in bypass until the DSP is ready */
+	struct work_struct dsp_switch_work;
+	struct mutex dsp_switch_lock;
+	struct snd_kcontrol *dsp_switch_kctl;
+	int dsp_switch_state;
+	bool dsp_switch_target;
+	struct nau_regcache_stat resume_sync;
+	/* on over the system suspend, for a path the card keeps up */
+	bool kept_on;
+	struct nau_latency latency[NAU8310_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	struct nau_delay delay;
+	struct nau_dapm_stat dapm_stat;
+	struct nau_coeff_shadow biq_shadow;
+	/* the coefficients kept per sampling rate */
+	struct nau_biq_rates biq_rates;
 };
 
 struct nau8310_src_attr {
@@ -616,6 +934,35 @@ struct nau8310_osr_attr {
 	unsigned int clk_src;
 };
 
+struct nau8310_clk_preset {
+	int mclk;
+	int fs;
+	int n1_sel;
+	int mult_sel;
+	int n2_sel;
+	int dsp_mult_sel;
+};
+
+/* The DSP builds in, unless the kernel picks the features of the Nuvoton
+ * codecs by CONFIG_SND_SOC_NAU_FEATURES without CONFIG_SND_SOC_NAU8310_DSP.
+ * The amplifier then always runs in the bypass mode, the DSP branches fold
+ * away and nau8310-dsp.o is left out of the build.
+ */
+#define NAU8310_DSP_BUILT (!IS_ENABLED(CONFIG_SND_SOC_NAU_FEATURES) || \
+	IS_ENABLED(CONFIG_SND_SOC_NAU8310_DSP))
+
+static inline bool nau8310_dsp_active(const struct nau8310 *nau8310)
+{
+	return NAU8310_DSP_BUILT && nau8310->dsp_enable;
+}
+
 int nau8310_enable_dsp(struct snd_soc_component *component);
+int nau8310_dsp_wait_ready(struct snd_soc_component *component,
+			   unsigned int timeout_ms);
+void nau8310_mclk_idle(struct snd_soc_component *component, unsigned int ms);
+void nau8310_mclk_gate(struct snd_soc_component *component);
+int nau8310_dsp_frame_write(struct nau8310 *nau8310, int count);
+int nau8310_dsp_frame_read(struct nau8310 *nau8310, u32 *words, int count);
+bool nau8310_dsp_on_osc(struct nau8310 *nau8310);
 
 #endif /* __NAU8310_H__ */
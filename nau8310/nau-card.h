@@ -0,0 +1,151 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Power domain of the machine drivers with several Nuvoton codecs
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_CARD_H__
+#define __NAU_CARD_H__
+
+#include <linux/clk.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <sound/soc.h>
+
+#define NAU_CARD_IDLE_MAX_MS	10000
+
+/* The codecs of a card are clocked and brought up as one domain. ASoC
+ * changes the bias of the card context before the codecs on the way up
+ * and after them on the way down, and those of the codecs in parallel.
+ * So the domain takes MCLK once before any codec powers up and drops it
+ * after the last one is down, and the barrier runs as the card goes ON,
+ * when every codec has started: the stream waits the slowest codec, not
+ * the sum of them.
+ *
+ * MCLK stays on for idle_ms once the card is idle, so a stream coming soon
+ * after finds it running, and the codecs clocked from it as they were. It
+ * is on again before the hw_params of the codecs. The gate callback,
+ * optional, moves the codecs off MCLK just before it stops.
+ */
+struct nau_card_domain {
+	struct snd_soc_card *card;
+	struct clk *mclk;
+	bool mclk_on;
+	struct mutex mclk_lock;
+	struct delayed_work mclk_work;
+	unsigned int idle_ms;
+	void (*gate)(struct snd_soc_card *card);
+	/* waits all the codecs ready, optional */
+	int (*barrier)(struct snd_soc_card *card);
+	ktime_t start;
+	s64 ready_us;
+};
+
+static inline void nau_card_mclk_work(struct work_struct *work)
+{
+	struct nau_card_domain *domain = container_of(work,
+		struct nau_card_domain, mclk_work.work);
+	struct snd_soc_card *card = domain->card;
+
+	mutex_lock(&domain->mclk_lock);
+	/* a stream started since, it gates MCLK as it ends */
+	if (domain->mclk_on &&
+	    snd_soc_dapm_get_bias_level(&card->dapm) <= SND_SOC_BIAS_STANDBY) {
+		if (domain->gate)
+			domain->gate(card);
+		clk_disable_unprepare(domain->mclk);
+		domain->mclk_on = false;
+		dev_dbg(card->dev, "MCLK gated\n");
+	}
+	mutex_unlock(&domain->mclk_lock);
+}
+
+static inline void nau_card_domain_init(struct nau_card_domain *domain,
+	struct snd_soc_card *card)
+{
+	domain->card = card;
+	mutex_init(&domain->mclk_lock);
+	INIT_DELAYED_WORK(&domain->mclk_work, nau_card_mclk_work);
+}
+
+/* Enable MCLK, or keep it on, for the hw_params of the machine too */
+static inline int nau_card_mclk_get(struct nau_card_domain *domain)
+{
+	struct snd_soc_card *card = domain->card;
+	int ret = 0;
+
+	if (!domain->mclk)
+		return 0;
+	if (cancel_delayed_work_sync(&domain->mclk_work))
+		dev_dbg(card->dev, "MCLK kept from the last stream\n");
+	mutex_lock(&domain->mclk_lock);
+	if (!domain->mclk_on) {
+		ret = clk_prepare_enable(domain->mclk);
+		if (ret)
+			dev_err(card->dev, "Unable to enable MCLK (%d)\n", ret);
+		else
+			domain->mclk_on = true;
+	}
+	mutex_unlock(&domain->mclk_lock);
+
+	return ret;
+}
+
+/* Gate MCLK after the idle time, unless a stream starts within it */
+static inline void nau_card_mclk_put(struct nau_card_domain *domain)
+{
+	if (domain->mclk_on)
+		mod_delayed_work(system_power_efficient_wq, &domain->mclk_work,
+				 msecs_to_jiffies(domain->idle_ms));
+}
+
+static inline void nau_card_domain_exit(struct nau_card_domain *domain)
+{
+	flush_delayed_work(&domain->mclk_work);
+}
+
+/* for the set_bias_level of the card */
+static inline int nau_card_set_bias_level(struct nau_card_domain *domain,
+	struct snd_soc_card *card, struct snd_soc_dapm_context *dapm,
+	enum snd_soc_bias_level level)
+{
+	if (dapm != &card->dapm || level != SND_SOC_BIAS_PREPARE ||
+	    dapm->bias_level != SND_SOC_BIAS_STANDBY)
+		return 0;
+
+	domain->start = ktime_get();
+
+	return nau_card_mclk_get(domain);
+}
+
+/* for the set_bias_level_post of the card */
+static inline int nau_card_set_bias_level_post(struct nau_card_domain *domain,
+	struct snd_soc_card *card, struct snd_soc_dapm_context *dapm,
+	enum snd_soc_bias_level level)
+{
+	int ret = 0;
+
+	if (dapm != &card->dapm)
+		return 0;
+
+	switch (level) {
+	case SND_SOC_BIAS_ON:
+		if (domain->barrier)
+			ret = domain->barrier(card);
+		domain->ready_us = ktime_us_delta(ktime_get(), domain->start);
+		dev_dbg(card->dev, "codecs ready in %lldus\n", domain->ready_us);
+		break;
+	case SND_SOC_BIAS_STANDBY:
+	case SND_SOC_BIAS_OFF:
+		nau_card_mclk_put(domain);
+		break;
+	default:
+		break;
+	}
+
+	return ret;
+}
+
+#endif /* __NAU_CARD_H__ */
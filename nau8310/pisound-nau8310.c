@@ -18,6 +18,7 @@
 #include <linux/types.h>
 #include <linux/input.h>
 #include <linux/clk.h>
+#include <linux/of.h>
 #include <sound/core.h>
 #include <sound/soc.h>
 #include <sound/pcm_params.h>
@@ -25,13 +26,32 @@
 #include <sound/jack.h>
 
 #include "../codecs/nau8310.h"
+#ifdef RPI_HOSTLESS_PA
+#include "../codecs/nau8540.h"
+#endif
+#include "nau-card.h"
 
 #define BCM2835_CLK_SRC_GPCLK1 25000000
+#define NAU8310_CLK_SRC_11 11289600
 #define NAU8310_CLK_SRC_12 12288000
 #define NAU8310_CLK_SRC_19 19200000
 #define NAU8310_CLK_SRC_24 24000000
+#define NAU8310_DSP_READY_TIMEOUT_MS 3000
+/* sense capture of low latency, in periods of 1ms at 48kHz */
+#define NAU8310_SENSE_PERIOD_FRAMES 48
+#define NAU8310_SENSE_PERIODS_MAX 4
+/* amp n gets slot n, and the first four send V sense in slot n and
+ * I sense in slot n + 4; the others have no slot left for their sense.
+ */
+#define NAU8310_SENSE_AMPS_MAX 4
+#define NAU8310_TDM_TX_MASK(n) \
+	((n) < NAU8310_SENSE_AMPS_MAX ? BIT(n) | BIT(4 + (n)) : 0)
+#define NAU8310_TDM_RX_MASK(n) BIT(n)
+#define NAU8310_AMPS_MAX 8
 
 #define RPI_TDM_I2S
+/* the microphones of nau8540 straight to the amplifiers, with no host */
+//#define RPI_HOSTLESS_PA
 
 #ifdef CONFIG_OF
 #define	COMPONENT_NAME_LEFT "nau8310.1-0010"
@@ -40,21 +60,24 @@
 #define COMPONENT_NAME_LEFT "i2c-NVTN2000:00"
 #define COMPONENT_NAME_RIGHT "i2c-NVTN2000:01"
 #endif
+#define COMPONENT_NAME_MIC "nau8540.1-001c"
 
 struct pisound_nau8310_dev {
 	struct snd_soc_card *card;
 	struct clk *mclk_gpclk;
 	unsigned long mclk_rate;
-	bool clk_enable;
-};
-
-static const unsigned int nau8310_rates[] = {
-	48000,
-};
-
-static struct snd_pcm_hw_constraint_list nau8310_constraints = {
-	.list = nau8310_rates,
-	.count = ARRAY_SIZE(nau8310_rates),
+	/* the rate set to mclk_gpclk last time */
+	unsigned long gpclk_rate;
+	/* MCLK and the power up of the amplifiers, once for the card */
+	struct nau_card_domain domain;
+	bool sense_low_latency;
+	/* the slot layout of an amplifier is fixed, program it once */
+	bool tdm_applied[NAU8310_AMPS_MAX];
+	/* the amplifiers in the order of their slots, by their name prefix */
+	int num_amps;
+	const char *amp_prefix[NAU8310_AMPS_MAX];
+	const char *amp_spk[NAU8310_AMPS_MAX];
+	const char *amp_out[NAU8310_AMPS_MAX];
 };
 
 static int pisound_nau8310_startup(struct snd_pcm_substream *substream)
@@ -62,25 +85,22 @@ static int pisound_nau8310_startup(struct snd_pcm_substream *substream)
 	struct snd_soc_pcm_runtime *rtd = asoc_substream_to_rtd(substream);
 	struct snd_soc_card *card = rtd->card;
 	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
-	int ret;
 	dev_dbg(rtd->dev, "%s\n", __func__);
-	dev_dbg(rtd->dev, "constraint to 48k\n");
-	/* Setup constraints, because when nau8310 enable DSP, it just support 48K */
-	snd_pcm_hw_constraint_list(substream->runtime, 0,
-	                           SNDRV_PCM_HW_PARAM_RATE, &nau8310_constraints);
-
-	if (dev_nau8310->mclk_gpclk && !dev_nau8310->clk_enable) {
-		ret = clk_prepare_enable(dev_nau8310->mclk_gpclk);
-		if (ret) {
-			dev_err(rtd->dev, "Unable to prepare mclk_gpclk (%d)\n", ret);
-			goto err;
-		}
-		dev_nau8310->clk_enable = 1;
-		dev_dbg(rtd->dev, "Updated mclk_gpclk %luHz\n", clk_get_rate(dev_nau8310->mclk_gpclk));
-		dev_dbg(rtd->dev, "MCLK enable");
+	/* The amplifiers constrain the rate to 48K themselves when DSP runs,
+	 * and also take 44.1K family in bypass mode.
+	 */
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+	    dev_nau8310->sense_low_latency) {
+		/* I/V sense for the host protection, with latency bounded */
+		dev_dbg(rtd->dev, "sense capture of low latency\n");
+		snd_pcm_hw_constraint_single(substream->runtime,
+		                             SNDRV_PCM_HW_PARAM_PERIOD_SIZE,
+		                             NAU8310_SENSE_PERIOD_FRAMES);
+		snd_pcm_hw_constraint_minmax(substream->runtime,
+		                             SNDRV_PCM_HW_PARAM_PERIODS, 2,
+		                             NAU8310_SENSE_PERIODS_MAX);
 	}
 
-err:
 	return 0;
 }
 
@@ -93,8 +113,27 @@ static int pisound_nau8310_hw_params(struct snd_pcm_substream *substream,
 	struct snd_soc_dai *cpu_dai = asoc_rtd_to_cpu(rtd, 0);
 	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
 	unsigned int sample_bits = snd_pcm_format_physical_width(params_format(params));
+	unsigned long mclk_rate = dev_nau8310->mclk_rate;
 	int i, ret;
 	dev_dbg(rtd->dev, "%s\n", __func__);
+	/* MCLK may be gated while idle, the amplifiers need it from here */
+	ret = nau_card_mclk_get(&dev_nau8310->domain);
+	if (ret)
+		return ret;
+	/* 44.1K family runs in DSP bypass mode, from MCLK of the same family */
+	if (dev_nau8310->mclk_gpclk) {
+		if (!(params_rate(params) % 11025))
+			mclk_rate = NAU8310_CLK_SRC_11;
+		if (dev_nau8310->gpclk_rate != mclk_rate) {
+			ret = clk_set_rate(dev_nau8310->mclk_gpclk,
+			                   clk_round_rate(dev_nau8310->mclk_gpclk, mclk_rate));
+			if (ret) {
+				dev_err(rtd->dev, "Unable to set mclk_gpclk rate (%d)\n", ret);
+				return ret;
+			}
+			dev_nau8310->gpclk_rate = mclk_rate;
+		}
+	}
 #ifdef RPI_TDM_I2S //if set bclk_ratio, RPI3 will be TDM I2S mode.
 	ret = snd_soc_dai_set_bclk_ratio(cpu_dai, 2 * sample_bits);
 	if (ret < 0) {
@@ -103,17 +142,15 @@ static int pisound_nau8310_hw_params(struct snd_pcm_substream *substream,
 #endif
 	for_each_rtd_codec_dais(rtd, i, codec_dai) {
 #ifdef RPI_TDM_I2S
-		if (!strcmp(codec_dai->component->name, COMPONENT_NAME_LEFT)) {
-			/* DEV0 tdm slot configuration */
-			snd_soc_dai_set_tdm_slot(codec_dai, 0x11, 0x1, 8, 16);
-		}
-		if (!strcmp(codec_dai->component->name, COMPONENT_NAME_RIGHT)) {
-			/* DEV1 tdm slot configuration */
-			snd_soc_dai_set_tdm_slot(codec_dai, 0x22, 0x2, 8, 16);
+		/* tdm slot configuration of DEVi in the order of the link */
+		if (i < NAU8310_AMPS_MAX && !dev_nau8310->tdm_applied[i]) {
+			ret = snd_soc_dai_set_tdm_slot(codec_dai, NAU8310_TDM_TX_MASK(i),
+			                               NAU8310_TDM_RX_MASK(i), 8, 16);
+			dev_nau8310->tdm_applied[i] = !ret;
 		}
 #endif
 		/* Configure sysclk for codec */
-		ret = snd_soc_dai_set_sysclk(codec_dai, 0, dev_nau8310->mclk_rate, SND_SOC_CLOCK_IN);
+		ret = snd_soc_dai_set_sysclk(codec_dai, 0, mclk_rate, SND_SOC_CLOCK_IN);
 		if (ret < 0) {
 			dev_err(rtd->dev, "failed to set sysclk\n");
 			return ret;
@@ -123,26 +160,22 @@ static int pisound_nau8310_hw_params(struct snd_pcm_substream *substream,
 	return ret;
 }
 
-static void pisound_nau8310_shutdown(struct snd_pcm_substream *substream)
+/* A stream closed without a start doesn't take the card bias down. */
+static int pisound_nau8310_hw_free(struct snd_pcm_substream *substream)
 {
 	struct snd_soc_pcm_runtime *rtd = asoc_substream_to_rtd(substream);
-	struct snd_soc_card *card = rtd->card;
-	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(rtd->card);
 
-	dev_dbg(rtd->dev, "%s\n", __func__);
+	nau_card_mclk_put(&dev_nau8310->domain);
 
-	if (dev_nau8310->mclk_gpclk && dev_nau8310->clk_enable) {
-		dev_dbg(rtd->dev, "MCLK disable\n");
-		clk_disable_unprepare(dev_nau8310->mclk_gpclk);
-		dev_nau8310->clk_enable = 0;
-	}
+	return 0;
 }
 
 /* machine stream operations */
 static struct snd_soc_ops pisound_nau8310_ops = {
 	.hw_params = pisound_nau8310_hw_params,
+	.hw_free = pisound_nau8310_hw_free,
 	.startup = pisound_nau8310_startup,
-	.shutdown = pisound_nau8310_shutdown,
 };
 
 SND_SOC_DAILINK_DEF(pisnd,
@@ -156,6 +189,62 @@ SND_SOC_DAILINK_DEF(amps,
                     DAILINK_COMP_ARRAY(COMP_CODEC(COMPONENT_NAME_LEFT, NAU8310_CODEC_DAI)),
                     COMP_CODEC(COMPONENT_NAME_RIGHT, NAU8310_CODEC_DAI));
 
+#ifdef RPI_HOSTLESS_PA
+SND_SOC_DAILINK_DEF(pa_mic,
+                    DAILINK_COMP_ARRAY(COMP_CODEC(COMPONENT_NAME_MIC, "nau8540-hifi")));
+
+/* the stream of the bus while the host sleeps, MIC1 and MIC2 to the amps */
+static const struct snd_soc_pcm_stream pisound_nau8310_pa_params = {
+	.formats = SNDRV_PCM_FMTBIT_S16_LE,
+	.rate_min = 48000,
+	.rate_max = 48000,
+	.channels_min = 2,
+	.channels_max = 2,
+};
+
+static const char * const pisound_nau8310_pa_pins[] = {
+	"MIC1", "MIC2",
+};
+
+/* No machine hw_params runs on a codec to codec link, so the clocks are
+ * set once here. nau8540 drives BCLK and FS of the bus from MCLK, and the
+ * amplifiers follow them, on the MCLK of the card as well. MCLK has to be
+ * 12.288MHz, by "nuvoton,clock-rates".
+ */
+static int pisound_nau8310_pa_init(struct snd_soc_pcm_runtime *rtd)
+{
+	struct snd_soc_card *card = rtd->card;
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+	struct snd_soc_dai *mic_dai = asoc_rtd_to_cpu(rtd, 0);
+	struct snd_soc_dai *codec_dai;
+	int i, ret;
+
+	ret = snd_soc_component_set_sysclk(mic_dai->component, NAU8540_CLK_MCLK,
+	                                   0, NAU8310_CLK_SRC_12, SND_SOC_CLOCK_IN);
+	if (ret < 0)
+		return ret;
+	for_each_rtd_codec_dais(rtd, i, codec_dai) {
+		ret = snd_soc_dai_set_sysclk(codec_dai, NAU8310_CLK_ID_MCLK,
+		                             NAU8310_CLK_SRC_12, SND_SOC_CLOCK_IN);
+		if (ret < 0)
+			return ret;
+	}
+	/* The path stays up over the system suspend, from the microphones
+	 * to the speakers; it is off until the microphones are switched on.
+	 */
+	for (i = 0; i < ARRAY_SIZE(pisound_nau8310_pa_pins); i++)
+		snd_soc_dapm_ignore_suspend(&card->dapm, pisound_nau8310_pa_pins[i]);
+	for (i = 0; i < dev_nau8310->num_amps; i++) {
+		snd_soc_dapm_ignore_suspend(&card->dapm, dev_nau8310->amp_out[i]);
+		snd_soc_dapm_ignore_suspend(&card->dapm, dev_nau8310->amp_spk[i]);
+	}
+	snd_soc_dapm_disable_pin(&card->dapm, "MIC1");
+	snd_soc_dapm_disable_pin(&card->dapm, "MIC2");
+
+	return 0;
+}
+#endif
+
 static struct snd_soc_dai_link pisound_nau8310_dai[] = {
 	{
 		.name = "pisound-nau8310",
@@ -169,23 +258,104 @@ static struct snd_soc_dai_link pisound_nau8310_dai[] = {
 		.ops = &pisound_nau8310_ops,
 		.dai_fmt = SND_SOC_DAIFMT_I2S | SND_SOC_DAIFMT_NB_NF | SND_SOC_DAIFMT_CBS_CFS,
 	},
-
+#ifdef RPI_HOSTLESS_PA
+	{
+		/* the host I2S has to be idle while it runs on the bus */
+		.name = "pisound-nau8310-pa",
+		.stream_name = "PA",
+		.cpus = pa_mic,
+		.num_cpus = 1,
+		.codecs = amps,
+		.num_codecs = ARRAY_SIZE(amps),
+		.init = pisound_nau8310_pa_init,
+		.params = &pisound_nau8310_pa_params,
+		.num_params = 1,
+		.ignore_suspend = 1,
+		/* the amps are consumers, nau8540 at the CPU end provides */
+		.dai_fmt = SND_SOC_DAIFMT_I2S | SND_SOC_DAIFMT_NB_NF | SND_SOC_DAIFMT_CBS_CFS,
+	},
+#endif
 };
 
-static const struct snd_kcontrol_new pisound_nau8310_controls[] = {
-	SOC_DAPM_PIN_SWITCH("Left Spk"),
-	SOC_DAPM_PIN_SWITCH("Right Spk"),
-};
+static int pisound_nau8310_sense_get(struct snd_kcontrol *kcontrol,
+                                     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_card *card = snd_kcontrol_chip(kcontrol);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
 
-static const struct snd_soc_dapm_widget pisound_nau8310_dapm_widgets[] = {
-	SND_SOC_DAPM_SPK("Left Spk", NULL),
-	SND_SOC_DAPM_SPK("Right Spk", NULL),
-};
+	ucontrol->value.integer.value[0] = dev_nau8310->sense_low_latency;
+
+	return 0;
+}
+
+/* applied from the next capture stream opened */
+static int pisound_nau8310_sense_put(struct snd_kcontrol *kcontrol,
+                                     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_card *card = snd_kcontrol_chip(kcontrol);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+	bool enable = !!ucontrol->value.integer.value[0];
+
+	if (dev_nau8310->sense_low_latency == enable)
+		return 0;
+	dev_nau8310->sense_low_latency = enable;
+
+	return 1;
+}
+
+/* The amplifiers keep the DSP on MCLK as long as the card keeps MCLK */
+static void pisound_nau8310_mclk_idle_apply(struct snd_soc_card *card)
+{
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+	struct snd_soc_pcm_runtime *rtd;
+	struct snd_soc_dai *codec_dai;
+	int i;
+
+	for_each_card_rtds(card, rtd)
+		for_each_rtd_codec_dais(rtd, i, codec_dai)
+			nau8310_mclk_idle(codec_dai->component,
+			                  dev_nau8310->domain.idle_ms);
+}
+
+static int pisound_nau8310_mclk_idle_get(struct snd_kcontrol *kcontrol,
+                                         struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_card *card = snd_kcontrol_chip(kcontrol);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+
+	ucontrol->value.integer.value[0] = dev_nau8310->domain.idle_ms;
+
+	return 0;
+}
+
+/* applied from the next stream closed */
+static int pisound_nau8310_mclk_idle_put(struct snd_kcontrol *kcontrol,
+                                         struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_card *card = snd_kcontrol_chip(kcontrol);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+	long ms = ucontrol->value.integer.value[0];
 
-static const struct snd_soc_dapm_route pisound_nau8310_audio_map[] = {
-	/* speaker */
-	{ "Left Spk", NULL, "Left Speaker" },
-	{ "Right Spk", NULL, "Right Speaker" },
+	if (ms < 0 || ms > NAU_CARD_IDLE_MAX_MS)
+		return -EINVAL;
+	if (dev_nau8310->domain.idle_ms == ms)
+		return 0;
+	dev_nau8310->domain.idle_ms = ms;
+	pisound_nau8310_mclk_idle_apply(card);
+
+	return 1;
+}
+
+/* the pin switches of the speakers follow, one per amplifier */
+static const struct snd_kcontrol_new pisound_nau8310_controls[] = {
+#ifdef RPI_HOSTLESS_PA
+	SOC_DAPM_PIN_SWITCH("MIC1"),
+	SOC_DAPM_PIN_SWITCH("MIC2"),
+#endif
+	SOC_SINGLE_BOOL_EXT("Sense Low Latency Switch", 0,
+	                    pisound_nau8310_sense_get, pisound_nau8310_sense_put),
+	SOC_SINGLE_EXT("MCLK Idle Time", SND_SOC_NOPM, 0, NAU_CARD_IDLE_MAX_MS, 0,
+	               pisound_nau8310_mclk_idle_get, pisound_nau8310_mclk_idle_put),
 };
 
 static struct snd_soc_codec_conf nau8310_codec_conf[] = {
@@ -199,23 +369,199 @@ static struct snd_soc_codec_conf nau8310_codec_conf[] = {
 	},
 };
 
+/* The amplifiers bring up DSP in parallel, wait all of them done here. */
+static void pisound_nau8310_dsp_barrier(struct snd_soc_card *card)
+{
+	struct snd_soc_pcm_runtime *rtd;
+	struct snd_soc_dai *codec_dai;
+	int i, ret;
+
+	for_each_card_rtds(card, rtd) {
+		for_each_rtd_codec_dais(rtd, i, codec_dai) {
+			ret = nau8310_dsp_wait_ready(codec_dai->component,
+						     NAU8310_DSP_READY_TIMEOUT_MS);
+			if (ret)
+				dev_warn(card->dev, "%s DSP not ready (%d), run bypass mode\n",
+					 codec_dai->component->name, ret);
+		}
+	}
+}
+
+/* The DSP of the amplifiers leaves MCLK before it stops */
+static void pisound_nau8310_mclk_gate(struct snd_soc_card *card)
+{
+	struct snd_soc_pcm_runtime *rtd;
+	struct snd_soc_dai *codec_dai;
+	int i;
+
+	for_each_card_rtds(card, rtd)
+		for_each_rtd_codec_dais(rtd, i, codec_dai)
+			nau8310_mclk_gate(codec_dai->component);
+}
+
+/* The amplifiers power up together as the card goes ON */
+static int pisound_nau8310_ready_barrier(struct snd_soc_card *card)
+{
+	pisound_nau8310_dsp_barrier(card);
+
+	return 0;
+}
+
+static int pisound_nau8310_set_bias_level(struct snd_soc_card *card,
+                                          struct snd_soc_dapm_context *dapm,
+                                          enum snd_soc_bias_level level)
+{
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+
+	return nau_card_set_bias_level(&dev_nau8310->domain, card, dapm, level);
+}
+
+static int pisound_nau8310_set_bias_level_post(struct snd_soc_card *card,
+                                               struct snd_soc_dapm_context *dapm,
+                                               enum snd_soc_bias_level level)
+{
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+
+	return nau_card_set_bias_level_post(&dev_nau8310->domain, card, dapm, level);
+}
+
 static struct snd_soc_card snd_soc_pisound_nau8310 = {
 	.name = "pisoundnau8310",
 	.owner = THIS_MODULE,
 	.dai_link = pisound_nau8310_dai,
 	.num_links = ARRAY_SIZE(pisound_nau8310_dai),
 
-	.controls = pisound_nau8310_controls,
-	.num_controls = ARRAY_SIZE(pisound_nau8310_controls),
-	.dapm_widgets = pisound_nau8310_dapm_widgets,
-	.num_dapm_widgets = ARRAY_SIZE(pisound_nau8310_dapm_widgets),
-	.dapm_routes = pisound_nau8310_audio_map,
-	.num_dapm_routes = ARRAY_SIZE(pisound_nau8310_audio_map),
+	/* the controls, the speakers and the codecs set by the amplifiers */
+	.set_bias_level = pisound_nau8310_set_bias_level,
+	.set_bias_level_post = pisound_nau8310_set_bias_level_post,
+};
 
-	.codec_conf = nau8310_codec_conf,
-	.num_configs = ARRAY_SIZE(nau8310_codec_conf),
+static void pisound_nau8310_node_put(void *data)
+{
+	of_node_put(data);
+}
 
-};
+/* The amplifiers of "nuvoton,amps", in the order of their TDM slots, and
+ * their name prefixes "nuvoton,amp-prefixes", "Amp1" and on by default.
+ * Without the property, the card has the two amplifiers of the board.
+ */
+static int pisound_nau8310_amps_of(struct device *dev,
+                                   struct pisound_nau8310_dev *dev_nau8310)
+{
+	struct snd_soc_card *card = dev_nau8310->card;
+	struct device_node *np = dev->of_node;
+	struct snd_soc_dai_link_component *codecs;
+	struct snd_soc_dai_link *links;
+	struct snd_soc_codec_conf *conf;
+	int i, n, ret;
+
+	n = np ? of_count_phandle_with_args(np, "nuvoton,amps", NULL) : -ENOENT;
+	if (n == -ENOENT) {
+		dev_nau8310->num_amps = ARRAY_SIZE(nau8310_codec_conf);
+		for (i = 0; i < dev_nau8310->num_amps; i++)
+			dev_nau8310->amp_prefix[i] = nau8310_codec_conf[i].name_prefix;
+		card->dai_link = pisound_nau8310_dai;
+		card->codec_conf = nau8310_codec_conf;
+		card->num_configs = ARRAY_SIZE(nau8310_codec_conf);
+		return 0;
+	}
+	if (n < 1 || n > NAU8310_AMPS_MAX) {
+		dev_err(dev, "%d amplifiers in 'nuvoton,amps', up to %d\n",
+		        n, NAU8310_AMPS_MAX);
+		return -EINVAL;
+	}
+
+	codecs = devm_kcalloc(dev, n, sizeof(*codecs), GFP_KERNEL);
+	conf = devm_kcalloc(dev, n, sizeof(*conf), GFP_KERNEL);
+	/* the links of the amplifiers, the template stays for the next probe */
+	links = devm_kmemdup(dev, pisound_nau8310_dai,
+	                     sizeof(pisound_nau8310_dai), GFP_KERNEL);
+	if (!codecs || !conf || !links)
+		return -ENOMEM;
+	for (i = 0; i < n; i++) {
+		const char *prefix;
+
+		codecs[i].of_node = of_parse_phandle(np, "nuvoton,amps", i);
+		if (!codecs[i].of_node)
+			return -EINVAL;
+		ret = devm_add_action_or_reset(dev, pisound_nau8310_node_put,
+		                               codecs[i].of_node);
+		if (ret)
+			return ret;
+		codecs[i].dai_name = NAU8310_CODEC_DAI;
+		if (of_property_read_string_index(np, "nuvoton,amp-prefixes", i,
+		                                  &prefix))
+			prefix = devm_kasprintf(dev, GFP_KERNEL, "Amp%d", i + 1);
+		if (!prefix)
+			return -ENOMEM;
+		conf[i].dlc.of_node = codecs[i].of_node;
+		conf[i].name_prefix = prefix;
+		dev_nau8310->amp_prefix[i] = prefix;
+	}
+	dev_nau8310->num_amps = n;
+	for (i = 0; i < ARRAY_SIZE(pisound_nau8310_dai); i++) {
+		links[i].codecs = codecs;
+		links[i].num_codecs = n;
+	}
+	card->dai_link = links;
+	card->codec_conf = conf;
+	card->num_configs = n;
+	dev_info(dev, "%d amplifiers\n", n);
+
+	return 0;
+}
+
+/* A speaker and its pin switch per amplifier, after the card controls */
+static int pisound_nau8310_amps_dapm(struct device *dev,
+                                     struct pisound_nau8310_dev *dev_nau8310)
+{
+	struct snd_soc_card *card = dev_nau8310->card;
+	int i, n = dev_nau8310->num_amps, num_controls;
+	struct snd_soc_dapm_widget *widgets;
+	struct snd_soc_dapm_route *routes;
+	struct snd_kcontrol_new *controls, *pin;
+
+	num_controls = ARRAY_SIZE(pisound_nau8310_controls) + n;
+	widgets = devm_kcalloc(dev, n, sizeof(*widgets), GFP_KERNEL);
+	routes = devm_kcalloc(dev, n, sizeof(*routes), GFP_KERNEL);
+	controls = devm_kcalloc(dev, num_controls, sizeof(*controls), GFP_KERNEL);
+	if (!widgets || !routes || !controls)
+		return -ENOMEM;
+	memcpy(controls, pisound_nau8310_controls, sizeof(pisound_nau8310_controls));
+	for (i = 0; i < n; i++) {
+		const char *spk, *out;
+
+		spk = devm_kasprintf(dev, GFP_KERNEL, "%s Spk",
+		                     dev_nau8310->amp_prefix[i]);
+		out = devm_kasprintf(dev, GFP_KERNEL, "%s Speaker",
+		                     dev_nau8310->amp_prefix[i]);
+		if (!spk || !out)
+			return -ENOMEM;
+		widgets[i] = SND_SOC_DAPM_SPK(spk, NULL);
+		routes[i].sink = spk;
+		routes[i].source = out;
+		/* SOC_DAPM_PIN_SWITCH(spk) */
+		pin = &controls[ARRAY_SIZE(pisound_nau8310_controls) + i];
+		pin->iface = SNDRV_CTL_ELEM_IFACE_MIXER;
+		pin->name = devm_kasprintf(dev, GFP_KERNEL, "%s Switch", spk);
+		if (!pin->name)
+			return -ENOMEM;
+		pin->info = snd_soc_dapm_info_pin_switch;
+		pin->get = snd_soc_dapm_get_pin_switch;
+		pin->put = snd_soc_dapm_put_pin_switch;
+		pin->private_value = (unsigned long)spk;
+		dev_nau8310->amp_spk[i] = spk;
+		dev_nau8310->amp_out[i] = out;
+	}
+	card->dapm_widgets = widgets;
+	card->num_dapm_widgets = n;
+	card->dapm_routes = routes;
+	card->num_dapm_routes = n;
+	card->controls = controls;
+	card->num_controls = num_controls;
+
+	return 0;
+}
 
 static int pisound_nau8310_probe(struct platform_device *pdev)
 {
@@ -230,6 +576,16 @@ static int pisound_nau8310_probe(struct platform_device *pdev)
 	if (!dev_nau8310)
 		return -ENOMEM;
 	dev_nau8310->card = card;
+	nau_card_domain_init(&dev_nau8310->domain, card);
+	dev_nau8310->domain.barrier = pisound_nau8310_ready_barrier;
+	dev_nau8310->domain.gate = pisound_nau8310_mclk_gate;
+	/* MCLK stops as the card goes idle, unless an idle time is set */
+	device_property_read_u32(&pdev->dev, "nuvoton,mclk-idle-ms",
+	                         &dev_nau8310->domain.idle_ms);
+	dev_nau8310->domain.idle_ms = min_t(unsigned int, dev_nau8310->domain.idle_ms,
+	                                    NAU_CARD_IDLE_MAX_MS);
+	/* the bias of the card changes during the registration */
+	snd_soc_card_set_drvdata(card, dev_nau8310);
 
 	if (pdev->dev.of_node) {
 		struct snd_soc_dai_link *dai = &pisound_nau8310_dai[0];
@@ -245,20 +601,31 @@ static int pisound_nau8310_probe(struct platform_device *pdev)
 			return -EINVAL;
 		}
 	}
+	ret = pisound_nau8310_amps_of(&pdev->dev, dev_nau8310);
+	if (ret)
+		return ret;
+	ret = pisound_nau8310_amps_dapm(&pdev->dev, dev_nau8310);
+	if (ret)
+		return ret;
 
 	ret = devm_snd_soc_register_card(&pdev->dev, &snd_soc_pisound_nau8310);
 	if (ret && ret != -EPROBE_DEFER)
 		dev_err(&pdev->dev, "Failed to register card %d\n", ret);
 	else {
-		int ret, clock_rate = 0;
+		int err, clock_rate = 0;
 
+		if (!ret) {
+			pisound_nau8310_dsp_barrier(card);
+			pisound_nau8310_mclk_idle_apply(card);
+		}
 		dev_nau8310->mclk_gpclk = devm_clk_get(card->dev, NULL);
 		if (IS_ERR(dev_nau8310->mclk_gpclk)) {
 			dev_info(card->dev, "No 'mclk_gpclk' clock found");
 			dev_nau8310->mclk_gpclk = NULL;
 		}
-		ret = device_property_read_u32(card->dev, "nuvoton,clock-rates", &clock_rate);
-		if (ret)
+		dev_nau8310->domain.mclk = dev_nau8310->mclk_gpclk;
+		err = device_property_read_u32(card->dev, "nuvoton,clock-rates", &clock_rate);
+		if (err)
 			dev_nau8310->mclk_rate = BCM2835_CLK_SRC_GPCLK1;
 		else
 			dev_nau8310->mclk_rate = NAU8310_CLK_SRC_12;
@@ -267,23 +634,25 @@ static int pisound_nau8310_probe(struct platform_device *pdev)
 		if (dev_nau8310->mclk_gpclk) {
 			mclk_gpclk_rate = clk_round_rate(dev_nau8310->mclk_gpclk,
 			                                 dev_nau8310->mclk_rate);
-			ret = clk_set_rate(dev_nau8310->mclk_gpclk,
+			err = clk_set_rate(dev_nau8310->mclk_gpclk,
 			                   mclk_gpclk_rate);
-			if (ret) {
-				dev_err(card->dev, "Unable to set mclk_gpclk rate (%d)\n", ret);
+			if (err) {
+				dev_err(card->dev, "Unable to set mclk_gpclk rate (%d)\n", err);
+				ret = err;
 				goto clk_err;
 			}
+			dev_nau8310->gpclk_rate = dev_nau8310->mclk_rate;
 #if 0//defined(DEBUG)
-			ret = clk_prepare_enable(dev_nau8310->mclk_gpclk);
-			if (ret) {
-				dev_err(card->dev, "Unable to prepare mclk_gpclk (%d)\n", ret);
+			err = clk_prepare_enable(dev_nau8310->mclk_gpclk);
+			if (err) {
+				dev_err(card->dev, "Unable to prepare mclk_gpclk (%d)\n", err);
+				ret = err;
 				goto clk_err;
 			}
 			mclk_gpclk_rate = clk_get_rate(dev_nau8310->mclk_gpclk);
 			dev_dbg(card->dev, "Updated mclk_gpclk %luHz\n", mclk_gpclk_rate);
 #endif
 		}
-		snd_soc_card_set_drvdata(card, dev_nau8310);
 	}
 
 clk_err:
@@ -293,7 +662,10 @@ clk_err:
 static int pisound_nau8310_remove(struct platform_device *pdev)
 {
 	struct snd_soc_card *card = platform_get_drvdata(pdev);
+	struct pisound_nau8310_dev *dev_nau8310 = snd_soc_card_get_drvdata(card);
+
 	snd_soc_unregister_card(card);
+	nau_card_domain_exit(&dev_nau8310->domain);
 
 	return 0;
 }
@@ -9,6 +9,9 @@
 // Based on MAX98357A.c
 
 #include <linux/acpi.h>
+#include <linux/bitmap.h>
+#include <linux/delay.h>
+#include <linux/devm-helpers.h>
 #include <linux/device.h>
 #include <linux/err.h>
 #include <linux/gpio.h>
@@ -17,16 +20,147 @@
 #include <linux/module.h>
 #include <linux/of.h>
 #include <linux/platform_device.h>
+#include <linux/property.h>
+#include <linux/spinlock.h>
+#include <linux/workqueue.h>
 #include <sound/pcm.h>
 #include <sound/soc.h>
 #include <sound/soc-dai.h>
 #include <sound/soc-dapm.h>
 
+#include "nau-keepalive.h"
+#include "nau-pm.h"
+
 struct nau8315_priv {
 	struct gpio_desc *enable;
+	/* EN pins of all the amps on the card, switched in one operation */
+	struct gpio_descs *group;
+	unsigned long *group_on;
+	unsigned long *group_off;
 	int enpin_switch;
+	/* EN asserted ahead of the stream for the startup time of the amp,
+	 * and kept for the hold-off time after the stop.
+	 */
+	bool prewarm;
+	u32 startup_ms;
+	u32 hold_off_ms;
+	struct delayed_work off_work;
+	/* the state of EN and the stream, shared with the trigger */
+	spinlock_t lock;
+	bool en_on;
+	bool running;
+	ktime_t en_time;
+	/* the power down window after the stream */
+	struct nau_keepalive keepalive;
 };
 
+static void nau8315_enable_set(struct nau8315_priv *nau8315, int value)
+{
+	struct gpio_descs *group = nau8315->group;
+
+	if (group)
+		gpiod_set_array_value(group->ndescs, group->desc, group->info,
+				      value ? nau8315->group_on :
+				      nau8315->group_off);
+	else
+		gpiod_set_value(nau8315->enable, value);
+}
+
+/* Assert EN, and wait for the rest of the startup time of the amp */
+static void nau8315_prewarm(struct nau8315_priv *nau8315)
+{
+	unsigned long flags;
+	s64 remain_us;
+
+	cancel_delayed_work_sync(&nau8315->off_work);
+	spin_lock_irqsave(&nau8315->lock, flags);
+	if (!nau8315->en_on) {
+		nau8315_enable_set(nau8315, 1);
+		nau8315->en_on = true;
+		nau8315->en_time = ktime_get();
+	}
+	spin_unlock_irqrestore(&nau8315->lock, flags);
+
+	remain_us = nau8315->startup_ms * USEC_PER_MSEC -
+		ktime_us_delta(ktime_get(), nau8315->en_time);
+	if (remain_us > 0)
+		fsleep(remain_us);
+}
+
+/* The hold-off is over without a new start, so deassert EN. */
+static void nau8315_off_work(struct work_struct *work)
+{
+	struct nau8315_priv *nau8315 =
+		container_of(work, struct nau8315_priv, off_work.work);
+	unsigned long flags;
+
+	spin_lock_irqsave(&nau8315->lock, flags);
+	if (!nau8315->running && nau8315->en_on) {
+		nau8315_enable_set(nau8315, 0);
+		nau8315->en_on = false;
+	}
+	spin_unlock_irqrestore(&nau8315->lock, flags);
+}
+
+static int nau8315_daiops_startup(struct snd_pcm_substream *substream,
+		struct snd_soc_dai *dai)
+{
+	struct nau8315_priv *nau8315 =
+		snd_soc_component_get_drvdata(dai->component);
+
+	nau_keepalive_startup(&nau8315->keepalive, substream, dai);
+
+	return 0;
+}
+
+static int nau8315_daiops_prepare(struct snd_pcm_substream *substream,
+		struct snd_soc_dai *dai)
+{
+	struct nau8315_priv *nau8315 =
+		snd_soc_component_get_drvdata(dai->component);
+
+	/* The first start is prewarmed by DAPM, the later ones here. */
+	if (nau8315->prewarm && nau8315->enpin_switch)
+		nau8315_prewarm(nau8315);
+
+	return 0;
+}
+
+static int nau8315_prewarm_trigger(struct nau8315_priv *nau8315,
+		int cmd)
+{
+	unsigned long flags;
+
+	spin_lock_irqsave(&nau8315->lock, flags);
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		nau8315->running = true;
+		cancel_delayed_work(&nau8315->off_work);
+		if (nau8315->enpin_switch && !nau8315->en_on) {
+			nau8315_enable_set(nau8315, 1);
+			nau8315->en_on = true;
+			nau8315->en_time = ktime_get();
+		}
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		nau8315->running = false;
+		schedule_delayed_work(&nau8315->off_work,
+				      msecs_to_jiffies(nau8315->hold_off_ms));
+		break;
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+		nau8315->running = false;
+		nau8315_enable_set(nau8315, 0);
+		nau8315->en_on = false;
+		break;
+	}
+	spin_unlock_irqrestore(&nau8315->lock, flags);
+
+	return 0;
+}
+
 static int nau8315_daiops_trigger(struct snd_pcm_substream *substream,
 		int cmd, struct snd_soc_dai *dai)
 {
@@ -34,22 +168,25 @@ static int nau8315_daiops_trigger(struct snd_pcm_substream *substream,
 	struct nau8315_priv *nau8315 =
 		snd_soc_component_get_drvdata(component);
 
-	if (!nau8315->enable)
+	if (!nau8315->enable && !nau8315->group)
 		return 0;
 
+	if (nau8315->prewarm)
+		return nau8315_prewarm_trigger(nau8315, cmd);
+
 	switch (cmd) {
 	case SNDRV_PCM_TRIGGER_START:
 	case SNDRV_PCM_TRIGGER_RESUME:
 	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
 		if (nau8315->enpin_switch) {
-			gpiod_set_value(nau8315->enable, 1);
+			nau8315_enable_set(nau8315, 1);
 			dev_dbg(component->dev, "set enable to 1");
 		}
 		break;
 	case SNDRV_PCM_TRIGGER_STOP:
 	case SNDRV_PCM_TRIGGER_SUSPEND:
 	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
-		gpiod_set_value(nau8315->enable, 0);
+		nau8315_enable_set(nau8315, 0);
 		dev_dbg(component->dev, "set enable to 0");
 		break;
 	}
@@ -65,14 +202,57 @@ static int nau8315_enpin_event(struct snd_soc_dapm_widget *w,
 	struct nau8315_priv *nau8315 =
 		snd_soc_component_get_drvdata(component);
 
-	if (event & SND_SOC_DAPM_PRE_PMU)
+	nau_keepalive_power(&nau8315->keepalive, event & SND_SOC_DAPM_PRE_PMU);
+
+	if (event & SND_SOC_DAPM_PRE_PMU) {
 		nau8315->enpin_switch = 1;
-	else if (event & SND_SOC_DAPM_POST_PMD)
+		if (nau8315->prewarm)
+			nau8315_prewarm(nau8315);
+	} else if (event & SND_SOC_DAPM_POST_PMD) {
 		nau8315->enpin_switch = 0;
+	}
 
 	return 0;
 }
 
+static int nau8315_keepalive_get(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8315_priv *nau8315 =
+		snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8315->keepalive.ms;
+
+	return 0;
+}
+
+/* applied from the next stream opened */
+static int nau8315_keepalive_put(struct snd_kcontrol *kcontrol,
+		struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8315_priv *nau8315 =
+		snd_soc_component_get_drvdata(component);
+	long ms = ucontrol->value.integer.value[0];
+
+	if (ms < 0 || ms > NAU_KEEPALIVE_MAX_MS)
+		return -EINVAL;
+	if (ms == nau8315->keepalive.ms)
+		return 0;
+	WRITE_ONCE(nau8315->keepalive.ms, ms);
+
+	return 1;
+}
+
+static const struct snd_kcontrol_new nau8315_controls[] = {
+	SOC_SINGLE_EXT("Keepalive Time", SND_SOC_NOPM, 0,
+		       NAU_KEEPALIVE_MAX_MS, 0,
+		       nau8315_keepalive_get, nau8315_keepalive_put),
+};
+
 static const struct snd_soc_dapm_widget nau8315_dapm_widgets[] = {
 	SND_SOC_DAPM_OUTPUT("Speaker"),
 	SND_SOC_DAPM_OUT_DRV_E("EN_Pin", SND_SOC_NOPM, 0, 0, NULL, 0,
@@ -85,23 +265,49 @@ static const struct snd_soc_dapm_route nau8315_dapm_routes[] = {
 	{"Speaker", NULL, "EN_Pin"},
 };
 
+static int nau8315_component_probe(struct snd_soc_component *component)
+{
+	struct nau8315_priv *nau8315 =
+		snd_soc_component_get_drvdata(component);
+
+	nau_keepalive_debugfs_init(component->debugfs_root,
+				   &nau8315->keepalive);
+	nau_pm_card_link(component);
+
+	return 0;
+}
+
+static void nau8315_component_remove(struct snd_soc_component *component)
+{
+	nau_pm_card_unlink(component);
+}
+
 static const struct snd_soc_component_driver nau8315_component_driver = {
+	.probe			= nau8315_component_probe,
+	.remove			= nau8315_component_remove,
+	.controls		= nau8315_controls,
+	.num_controls		= ARRAY_SIZE(nau8315_controls),
 	.dapm_widgets		= nau8315_dapm_widgets,
 	.num_dapm_widgets	= ARRAY_SIZE(nau8315_dapm_widgets),
 	.dapm_routes		= nau8315_dapm_routes,
 	.num_dapm_routes	= ARRAY_SIZE(nau8315_dapm_routes),
-	.idle_bias_on		= 1,
 	.use_pmdown_time	= 1,
 	.endianness		= 1,
 	.non_legacy_dai_naming	= 1,
 };
 
 static const struct snd_soc_dai_ops nau8315_dai_ops = {
+	.startup	= nau8315_daiops_startup,
+	.prepare	= nau8315_daiops_prepare,
 	.trigger	= nau8315_daiops_trigger,
 };
 
 #define NAU8315_RATES SNDRV_PCM_RATE_8000_96000
-#define NAU8315_FORMATS (SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S24_3LE)
+/* The amplifier detects the word length from the BCLK per frame, so S24_LE
+ * comes in as 24-bit data in 32-bit slots.
+ */
+#define NAU8315_FORMATS (SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S24_3LE \
+	 | SNDRV_PCM_FMTBIT_S24_LE)
 
 static struct snd_soc_dai_driver nau8315_dai_driver = {
 	.name = "nau8315-hifi",
@@ -115,9 +321,34 @@ static struct snd_soc_dai_driver nau8315_dai_driver = {
 	.ops    = &nau8315_dai_ops,
 };
 
+/* The trigger is atomic, so the pins of the group mustn't sleep */
+static int nau8315_group_init(struct device *dev, struct nau8315_priv *nau8315)
+{
+	struct gpio_descs *group = nau8315->group;
+	int i;
+
+	for (i = 0; i < group->ndescs; i++) {
+		if (gpiod_cansleep(group->desc[i])) {
+			dev_err(dev, "group EN pin %d can sleep\n", i);
+			return -EINVAL;
+		}
+	}
+
+	nau8315->group_on = devm_bitmap_zalloc(dev, group->ndescs,
+					       GFP_KERNEL);
+	nau8315->group_off = devm_bitmap_zalloc(dev, group->ndescs,
+						GFP_KERNEL);
+	if (!nau8315->group_on || !nau8315->group_off)
+		return -ENOMEM;
+	bitmap_fill(nau8315->group_on, group->ndescs);
+
+	return 0;
+}
+
 static int nau8315_platform_probe(struct platform_device *pdev)
 {
 	struct nau8315_priv *nau8315;
+	int ret;
 
 	nau8315 = devm_kzalloc(&pdev->dev, sizeof(*nau8315), GFP_KERNEL);
 	if (!nau8315)
@@ -128,7 +359,40 @@ static int nau8315_platform_probe(struct platform_device *pdev)
 	if (IS_ERR(nau8315->enable))
 		return PTR_ERR(nau8315->enable);
 
+	/* The amp listing the EN pins of the group switches them all, the
+	 * others have no pin of their own.
+	 */
+	nau8315->group = devm_gpiod_get_array_optional(&pdev->dev,
+				"group-enable", GPIOD_OUT_LOW);
+	if (IS_ERR(nau8315->group))
+		return PTR_ERR(nau8315->group);
+	if (nau8315->group) {
+		ret = nau8315_group_init(&pdev->dev, nau8315);
+		if (ret)
+			return ret;
+	}
+
+	/* Prewarm the amp for the startup time, if there is one. */
+	spin_lock_init(&nau8315->lock);
+	if ((nau8315->enable || nau8315->group) &&
+	    !device_property_read_u32(&pdev->dev, "nuvoton,startup-time-ms",
+				      &nau8315->startup_ms)) {
+		nau8315->prewarm = true;
+		device_property_read_u32(&pdev->dev, "nuvoton,hold-off-time-ms",
+					 &nau8315->hold_off_ms);
+		ret = devm_delayed_work_autocancel(&pdev->dev,
+				&nau8315->off_work, nau8315_off_work);
+		if (ret)
+			return ret;
+	}
+
+	if (device_property_read_u32(&pdev->dev, "nuvoton,keepalive-ms",
+				     &nau8315->keepalive.ms) ||
+	    nau8315->keepalive.ms > NAU_KEEPALIVE_MAX_MS)
+		nau8315->keepalive.ms = 0;
+
 	dev_set_drvdata(&pdev->dev, nau8315);
+	nau_pm_async_init(&pdev->dev);
 
 	return devm_snd_soc_register_component(&pdev->dev,
 			&nau8315_component_driver,
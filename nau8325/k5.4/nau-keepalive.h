@@ -0,0 +1,89 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Power down hysteresis of the Nuvoton amplifier drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_KEEPALIVE_H__
+#define __NAU_KEEPALIVE_H__
+
+#include <linux/compiler.h>
+#include <linux/debugfs.h>
+#include <linux/types.h>
+#include <linux/version.h>
+#include <sound/soc.h>
+
+/* The amplifier stays powered for a window after the last stream stops,
+ * so the next short stream starts without the full power cycle. The
+ * window is the pmdown time the link got from the machine driver, raised
+ * to the largest one of the amps on the link, and applies unless the
+ * link ignores the pmdown time. The streams started while the amp is
+ * still powered count as the cycles avoided.
+ */
+#define NAU_KEEPALIVE_MAX_MS	60000
+
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 8, 0)
+#define nau_keepalive_first_codec(rtd)	asoc_rtd_to_codec(rtd, 0)
+#else
+#define nau_keepalive_first_codec(rtd)	((rtd)->codec_dais[0])
+#endif
+
+struct nau_keepalive {
+	unsigned int ms;	/* 0 for the pmdown time of the card */
+	/* the link of the amp, and its pmdown time before any amp raised it */
+	struct snd_soc_pcm_runtime *rtd;
+	unsigned int link_ms;
+	bool powered;
+	u32 power_cycles;
+	u32 avoided;
+};
+
+/* For the startup of the DAI. The codec DAIs of a link start in order, so
+ * the first one starts over from the pmdown time of the machine driver,
+ * which it keeps aside, and each amp after it only raises the window. A
+ * link whose first codec is not one of the amps keeps the largest window
+ * it ever had.
+ */
+static inline void nau_keepalive_startup(struct nau_keepalive *ka,
+	struct snd_pcm_substream *substream, struct snd_soc_dai *dai)
+{
+	struct snd_soc_pcm_runtime *rtd = substream->private_data;
+	unsigned int ms = READ_ONCE(ka->ms), base = rtd->pmdown_time;
+
+	if (substream->stream != SNDRV_PCM_STREAM_PLAYBACK)
+		return;
+	if (dai == nau_keepalive_first_codec(rtd)) {
+		if (ka->rtd != rtd) {
+			ka->rtd = rtd;
+			ka->link_ms = rtd->pmdown_time;
+		}
+		base = ka->link_ms;
+	}
+	rtd->pmdown_time = max_t(unsigned int, base, ms);
+	if (READ_ONCE(ka->powered))
+		ka->avoided++;
+}
+
+/* for the power events of the output */
+static inline void nau_keepalive_power(struct nau_keepalive *ka, bool on)
+{
+	if (on && !ka->powered)
+		ka->power_cycles++;
+	WRITE_ONCE(ka->powered, on);
+}
+
+static inline void nau_keepalive_debugfs_init(struct dentry *root,
+	struct nau_keepalive *ka)
+{
+	struct dentry *dir;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir("keepalive", root);
+	debugfs_create_u32("power_cycles", 0444, dir, &ka->power_cycles);
+	debugfs_create_u32("avoided", 0444, dir, &ka->avoided);
+}
+
+#endif /* __NAU_KEEPALIVE_H__ */
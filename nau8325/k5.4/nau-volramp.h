@@ -0,0 +1,192 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * DAC volume ramp of the Nuvoton amplifier drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_VOLRAMP_H__
+#define __NAU_VOLRAMP_H__
+
+#include <linux/debugfs.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/regmap.h>
+#include <linux/string.h>
+#include <linux/types.h>
+#include <linux/workqueue.h>
+
+/* The amplifiers ramp the soft mute, but take a new DAC volume at once.
+ * With a rate set, a volume written goes to the target and the driver
+ * walks the register there by rate codes per NAU_VOL_RAMP_TICK_MS, so a
+ * ducking costs the client one write per amp. The volume read back is
+ * the target. A rate of 0 writes the volume at once.
+ */
+#define NAU_VOL_RAMP_TICK_MS	5
+#define NAU_VOL_RAMP_RATE_MAX	64
+#define NAU_VOL_RAMP_CH		2
+
+struct nau_vol_ramp {
+	struct mutex lock;
+	struct delayed_work work;
+	struct regmap *regmap;
+	unsigned int reg;
+	unsigned int max;	/* the field mask, at shift 0 */
+	unsigned int num;	/* fields in the register */
+	unsigned int shift[NAU_VOL_RAMP_CH];
+	unsigned int cur[NAU_VOL_RAMP_CH];
+	unsigned int target[NAU_VOL_RAMP_CH];
+	ktime_t last;
+	u32 rate;
+	u32 steps;
+};
+
+/* Write the volume of @ramp->cur, with @ramp->lock held */
+static inline void __nau_vol_ramp_write(struct nau_vol_ramp *ramp)
+{
+	unsigned int mask = 0, val = 0, i;
+
+	for (i = 0; i < ramp->num; i++) {
+		mask |= ramp->max << ramp->shift[i];
+		val |= ramp->cur[i] << ramp->shift[i];
+	}
+	regmap_update_bits(ramp->regmap, ramp->reg, mask, val);
+}
+
+static inline void nau_vol_ramp_work(struct work_struct *work)
+{
+	struct nau_vol_ramp *ramp = container_of(to_delayed_work(work),
+		struct nau_vol_ramp, work);
+	unsigned int step, i;
+	bool done = true;
+	ktime_t now;
+
+	mutex_lock(&ramp->lock);
+	/* the steps due since the last, as a late tick catches up */
+	now = ktime_get();
+	step = max_t(unsigned int, 1, ramp->rate *
+		ktime_ms_delta(now, ramp->last) / NAU_VOL_RAMP_TICK_MS);
+	ramp->last = now;
+	for (i = 0; i < ramp->num; i++) {
+		if (ramp->cur[i] < ramp->target[i])
+			ramp->cur[i] = min(ramp->cur[i] + step, ramp->target[i]);
+		else if (ramp->cur[i] > ramp->target[i])
+			ramp->cur[i] = ramp->cur[i] > ramp->target[i] + step ?
+				ramp->cur[i] - step : ramp->target[i];
+		if (ramp->cur[i] != ramp->target[i])
+			done = false;
+	}
+	__nau_vol_ramp_write(ramp);
+	ramp->steps++;
+	if (!done)
+		queue_delayed_work(system_highpri_wq, &ramp->work,
+			msecs_to_jiffies(NAU_VOL_RAMP_TICK_MS));
+	mutex_unlock(&ramp->lock);
+}
+
+/**
+ * nau_vol_ramp_init - Take the DAC volume fields of a register.
+ * @ramp: the ramp of the DAC volume.
+ * @regmap: register map of the amplifier.
+ * @reg: the register of the volume.
+ * @max: the mask of a field, at shift 0.
+ * @num: the fields, 1 or 2.
+ * @shift: the shifts of the fields.
+ *
+ * The volume in place is read once the registers are initiated.
+ */
+static inline int nau_vol_ramp_init(struct nau_vol_ramp *ramp,
+	struct regmap *regmap, unsigned int reg, unsigned int max,
+	unsigned int num, const unsigned int *shift)
+{
+	unsigned int val, i;
+	int ret;
+
+	mutex_init(&ramp->lock);
+	INIT_DELAYED_WORK(&ramp->work, nau_vol_ramp_work);
+	ramp->regmap = regmap;
+	ramp->reg = reg;
+	ramp->max = max;
+	ramp->num = min_t(unsigned int, num, NAU_VOL_RAMP_CH);
+	ret = regmap_read(regmap, reg, &val);
+	if (ret)
+		return ret;
+	for (i = 0; i < ramp->num; i++) {
+		ramp->shift[i] = shift[i];
+		ramp->cur[i] = ramp->target[i] = (val >> shift[i]) & max;
+	}
+
+	return 0;
+}
+
+/**
+ * nau_vol_ramp_set - Set the volume the register goes to.
+ * @ramp: the ramp of the DAC volume.
+ * @vol: the volume of each field.
+ *
+ * Returns 1 if the target changed, 0 if not.
+ */
+static inline int nau_vol_ramp_set(struct nau_vol_ramp *ramp,
+	const unsigned int *vol)
+{
+	bool change = false;
+	unsigned int i;
+
+	mutex_lock(&ramp->lock);
+	for (i = 0; i < ramp->num; i++) {
+		if (ramp->target[i] != vol[i])
+			change = true;
+		ramp->target[i] = vol[i];
+	}
+	if (!change)
+		goto done;
+	if (!READ_ONCE(ramp->rate)) {
+		memcpy(ramp->cur, ramp->target, sizeof(ramp->cur));
+		__nau_vol_ramp_write(ramp);
+	} else if (!delayed_work_pending(&ramp->work)) {
+		/* the first step at once, the next ones a tick apart */
+		ramp->last = ktime_sub_ms(ktime_get(), NAU_VOL_RAMP_TICK_MS);
+		queue_delayed_work(system_highpri_wq, &ramp->work, 0);
+	}
+ done:
+	mutex_unlock(&ramp->lock);
+
+	return change;
+}
+
+static inline void nau_vol_ramp_get(struct nau_vol_ramp *ramp,
+	unsigned int *vol)
+{
+	mutex_lock(&ramp->lock);
+	memcpy(vol, ramp->target, sizeof(ramp->target));
+	mutex_unlock(&ramp->lock);
+}
+
+/* End the ramp at the target now, before a suspend or the removal */
+static inline void nau_vol_ramp_finish(struct nau_vol_ramp *ramp)
+{
+	cancel_delayed_work_sync(&ramp->work);
+	mutex_lock(&ramp->lock);
+	if (memcmp(ramp->cur, ramp->target, sizeof(ramp->cur))) {
+		memcpy(ramp->cur, ramp->target, sizeof(ramp->cur));
+		__nau_vol_ramp_write(ramp);
+	}
+	mutex_unlock(&ramp->lock);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_vol_ramp_debugfs_init(struct dentry *root,
+	struct nau_vol_ramp *ramp)
+{
+	if (root)
+		debugfs_create_u32("vol_ramp_steps", 0444, root, &ramp->steps);
+}
+#else
+static inline void nau_vol_ramp_debugfs_init(struct dentry *root,
+	struct nau_vol_ramp *ramp)
+{
+}
+#endif
+
+#endif /* __NAU_VOLRAMP_H__ */
@@ -0,0 +1,216 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the clock source solver of NAU8325
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8325.c, as the solver and its tables are
+ * static.
+ */
+
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+
+/* the MCLK of the boards, in MASTER_CLK_MIN..MASTER_CLK_MAX */
+static const int nau8325_test_mclk[] = {
+	2048000, 3072000, 4096000, 5644800, 6144000, 8192000, 11289600,
+	12000000, 12288000, 16384000, 19200000, 22579200, 24000000,
+	24576000, 38400000, 45158400, 49152000,
+};
+
+static int nau8325_test_init(struct kunit *test)
+{
+	struct nau8325 *nau8325;
+
+	nau8325 = kunit_kzalloc(test, sizeof(*nau8325), GFP_KERNEL);
+	if (!nau8325)
+		return -ENOMEM;
+	nau8325->dev = root_device_register("nau8325-kunit");
+	if (IS_ERR(nau8325->dev))
+		return PTR_ERR(nau8325->dev);
+	test->priv = nau8325;
+
+	return 0;
+}
+
+static void nau8325_test_exit(struct kunit *test)
+{
+	struct nau8325 *nau8325 = test->priv;
+
+	root_device_unregister(nau8325->dev);
+}
+
+static bool nau8325_test_dsp_clk_ok(int mclk, int n1, int dsp_mult)
+{
+	int dsp_clk = (mclk << dsp_src_mult[dsp_mult].param) /
+		mclk_n1_div[n1].param;
+
+	return dsp_clk >= DSP_CLK_MIN && dsp_clk <= DSP_CLK_MAX;
+}
+
+static bool nau8325_test_dsp_n1_ok(int mclk, int n1)
+{
+	int j;
+
+	for (j = 0; j < ARRAY_SIZE(dsp_src_mult); j++)
+		if (nau8325_test_dsp_clk_ok(mclk, n1, j))
+			return true;
+
+	return false;
+}
+
+static bool nau8325_test_mclk_src_ok(const struct nau8325_srate_attr *srate,
+	int mclk_src)
+{
+	int i;
+
+	for (i = 0; i < NAU8325_MCLK_FS_RATIO_NUM; i++)
+		if (srate->mclk_src[i] && srate->mclk_src[i] == mclk_src)
+			return true;
+
+	return false;
+}
+
+/* Search all the selections for one within the limits, as reference */
+static bool nau8325_test_solvable(const struct nau8325_srate_attr *srate,
+	int mclk)
+{
+	int i, j, k;
+
+	for (i = 0; i < ARRAY_SIZE(mclk_n1_div); i++) {
+		if (!nau8325_test_dsp_n1_ok(mclk, i))
+			continue;
+		for (k = 0; k < ARRAY_SIZE(mclk_n2_div); k++) {
+			if (nau8325_test_mclk_src_ok(srate,
+				mclk >> mclk_n2_div[k].param))
+				return true;
+			for (j = 0; j < ARRAY_SIZE(mclk_src_mult); j++)
+				if (nau8325_test_mclk_src_ok(srate,
+					((mclk << mclk_src_mult[j].param) /
+					mclk_n1_div[i].param) >>
+					mclk_n2_div[k].param))
+					return true;
+		}
+	}
+
+	return false;
+}
+
+/* Check the selections as nau8325_srate_clk_apply() programs them */
+static void nau8325_test_check(struct kunit *test, int mclk, int fs,
+	const struct nau8325_srate_attr *srate,
+	int n1, int mult, int n2, int dsp_mult)
+{
+	int mclk_src;
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, srate);
+	KUNIT_EXPECT_EQ(test, srate->fs, fs);
+	KUNIT_ASSERT_TRUE_MSG(test, n1 >= 0 && n1 < ARRAY_SIZE(mclk_n1_div),
+		"MCLK %d fs %d: n1_sel %d", mclk, fs, n1);
+	KUNIT_ASSERT_TRUE_MSG(test, n2 >= 0 && n2 < ARRAY_SIZE(mclk_n2_div),
+		"MCLK %d fs %d: n2_sel %d", mclk, fs, n2);
+	KUNIT_ASSERT_TRUE_MSG(test, mult == CLK_PROC_BYPASS ||
+		(mult >= 0 && mult < ARRAY_SIZE(mclk_src_mult)),
+		"MCLK %d fs %d: mult_sel %d", mclk, fs, mult);
+	KUNIT_ASSERT_TRUE_MSG(test, dsp_mult >= 0 &&
+		dsp_mult < ARRAY_SIZE(dsp_src_mult),
+		"MCLK %d fs %d: dsp_mult_sel %d", mclk, fs, dsp_mult);
+
+	if (mult == CLK_PROC_BYPASS)
+		mclk_src = mclk >> mclk_n2_div[n2].param;
+	else
+		mclk_src = ((mclk << mclk_src_mult[mult].param) /
+			mclk_n1_div[n1].param) >> mclk_n2_div[n2].param;
+	KUNIT_EXPECT_TRUE_MSG(test, nau8325_test_mclk_src_ok(srate, mclk_src),
+		"MCLK %d fs %d: MCLK_SRC %d", mclk, fs, mclk_src);
+	KUNIT_EXPECT_TRUE_MSG(test, nau8325_test_dsp_clk_ok(mclk, n1, dsp_mult),
+		"MCLK %d fs %d: DSP clock %d out of %d..%d", mclk, fs,
+		(mclk << dsp_src_mult[dsp_mult].param) / mclk_n1_div[n1].param,
+		DSP_CLK_MIN, DSP_CLK_MAX);
+}
+
+/* Sweep MCLK x fs; the solver finds a clock whenever one exists */
+static void nau8325_test_clksrc_sweep(struct kunit *test)
+{
+	struct nau8325 *nau8325 = test->priv;
+	const struct nau8325_srate_attr *srate;
+	int i, f, n1, mult, n2, dsp_mult, ret, calls = 0, solved = 0;
+	ktime_t start, spent = 0;
+
+	for (f = 0; f < ARRAY_SIZE(target_srate_table); f++) {
+		/* no ADC divider, the apply of the clocks rejects the rate */
+		if (target_srate_table[f].adc_div < 0)
+			continue;
+		for (i = 0; i < ARRAY_SIZE(nau8325_test_mclk); i++) {
+			nau8325->mclk = nau8325_test_mclk[i];
+			nau8325->fs = target_srate_table[f].fs;
+			n1 = mult = n2 = dsp_mult = 0;
+			start = ktime_get();
+			ret = nau8325_clksrc_choose(nau8325, &srate, &n1,
+				&mult, &n2, &dsp_mult);
+			spent = ktime_add(spent, ktime_sub(ktime_get(), start));
+			calls++;
+			if (!ret) {
+				solved++;
+				nau8325_test_check(test, nau8325->mclk,
+					nau8325->fs, srate, n1, mult, n2,
+					dsp_mult);
+				continue;
+			}
+			KUNIT_EXPECT_FALSE_MSG(test,
+				nau8325_test_solvable(&target_srate_table[f],
+				nau8325->mclk),
+				"MCLK %d fs %d not solved", nau8325->mclk,
+				nau8325->fs);
+		}
+	}
+	KUNIT_EXPECT_GT(test, solved, 0);
+	kunit_info(test, "%d of %d solved, %lld ns per call\n", solved, calls,
+		div_s64(ktime_to_ns(spent), calls));
+}
+
+/* Each preset is a solution within the limits */
+static void nau8325_test_clk_preset(struct kunit *test)
+{
+	const struct nau8325_clk_preset *p;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(clk_preset_table); i++) {
+		p = &clk_preset_table[i];
+		nau8325_test_check(test, p->mclk, p->fs,
+			target_srate_attribute(p->fs), p->n1_sel,
+			p->mult_sel, p->n2_sel, p->dsp_mult_sel);
+	}
+}
+
+/* Each rate has an OSR of the DAC within CLK_DA_AD_MAX */
+static void nau8325_test_osr(struct kunit *test)
+{
+	int f, osr, fs, dac;
+
+	for (f = 0; f < ARRAY_SIZE(target_srate_table); f++) {
+		fs = target_srate_table[f].fs;
+		dac = 0;
+		for (osr = 0; osr < ARRAY_SIZE(osr_dac_sel); osr++)
+			if (osr_dac_sel[osr].osr &&
+				fs * osr_dac_sel[osr].osr <= CLK_DA_AD_MAX)
+				dac++;
+		KUNIT_EXPECT_GT_MSG(test, dac, 0, "fs %d DAC", fs);
+	}
+}
+
+static struct kunit_case nau8325_test_cases[] = {
+	KUNIT_CASE(nau8325_test_clksrc_sweep),
+	KUNIT_CASE(nau8325_test_clk_preset),
+	KUNIT_CASE(nau8325_test_osr),
+	{}
+};
+
+static struct kunit_suite nau8325_test_suite = {
+	.name = "nau8325-clk",
+	.init = nau8325_test_init,
+	.exit = nau8325_test_exit,
+	.test_cases = nau8325_test_cases,
+};
+kunit_test_suite(nau8325_test_suite);
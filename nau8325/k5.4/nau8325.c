@@ -13,6 +13,8 @@
 #include <linux/delay.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/property.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
 #include <linux/clk.h>
@@ -23,6 +25,11 @@
 #include <sound/pcm_params.h>
 #include <sound/soc.h>
 #include <sound/jack.h>
+#include "nau-keepalive.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-regmap.h"
+#include "nau-volramp.h"
 #include "nau8325.h"
 
 static void nau8325_software_reset(struct regmap *regmap);
@@ -36,6 +43,15 @@ static int nau8325_set_sysclk(struct snd_soc_component *component, int clk_id,
 #define DSP_CLK_MIN 96000000
 #define DSP_CLK_MAX 102400000
 #define DSP_MCLK_HI_SPEED 12288000
+/* the power up forced after a clock loss before the detection re-armed */
+#define CLK_REARM_MS 20
+/* the members of a group unmute without the rest after the first one */
+#define GROUP_UNMUTE_MS 10
+/* the ramp time of soft mute */
+#define SOFT_MUTE_RAMP_MS 30
+
+static LIST_HEAD(nau8325_groups);
+static DEFINE_MUTEX(nau8325_groups_lock);
 
 /* scaling for MCLK source */
 #define CLK_PROC_BYPASS (-1)
@@ -93,6 +109,24 @@ static const struct nau8325_srate_attr target_srate_table[] = {
 	{ 32000, 2, false, { 8192000, 12800000, 16000000 }, 0x2 },
 };
 
+/* The selections of the clock source search for the common MCLK, i.e.
+ * (n1_sel, mult_sel, n2_sel, dsp_mult_sel) chosen by nau8325_clksrc_choose().
+ * The pairs not listed here are searched at runtime.
+ */
+static const struct nau8325_clk_preset clk_preset_table[] = {
+	/* { MCLK, FS, n1_sel, mult_sel, n2_sel, dsp_mult_sel } */
+	/* MCLK 12.288MHz */
+	{ 12288000, 48000, 1, CLK_PROC_BYPASS, 0, 3 },
+	{ 12288000, 96000, 1, 2, 1, 3 },
+	{ 12288000, 12000, 1, CLK_PROC_BYPASS, 2, 3 },
+	{ 12288000, 24000, 1, CLK_PROC_BYPASS, 1, 3 },
+	/* MCLK 24.576MHz */
+	{ 24576000, 48000, 2, CLK_PROC_BYPASS, 1, 3 },
+	{ 24576000, 96000, 2, CLK_PROC_BYPASS, 0, 3 },
+	{ 24576000, 12000, 2, 0, 2, 3 },
+	{ 24576000, 24000, 2, CLK_PROC_BYPASS, 2, 3 },
+};
+
 static const struct reg_default nau8325_reg_defaults[] = {
 	{ NAU8325_REG_HARDWARE_RST, 0x0000 },
 	{ NAU8325_REG_SOFTWARE_RST, 0x0000 },
@@ -136,69 +170,68 @@ static const struct reg_default nau8325_reg_defaults[] = {
 	{ NAU8325_REG_RDAC, 0x0008 },
 };
 
+#define NAU8325_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8325_REG_CLK_CTRL, NAU8325_REG_INT_CLR_STATUS) |	\
+	NAU_REG(w, NAU8325_REG_IRQOUT) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_IO_CTRL, NAU8325_REG_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8325_REG_HPF_CTRL, NAU8325_REG_DAC_VOLUME) |	\
+	NAU_REG(w, NAU8325_REG_DEBUG_READ1) |				\
+	NAU_REG(w, NAU8325_REG_DEBUG_READ2) |				\
+	NAU_REG(w, NAU8325_REG_DEBUG_READ3) |				\
+	NAU_REG(w, NAU8325_REG_DAC_CTRL1) |				\
+	NAU_REG(w, NAU8325_REG_DAC_CTRL2) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_ALC_CTRL1, NAU8325_REG_ALC_CTRL4) |	\
+	NAU_REG(w, NAU8325_REG_CLK_DET_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_TEST_STATUS) |				\
+	NAU_REG(w, NAU8325_REG_ANALOG_READ) |				\
+	NAU_REG(w, NAU8325_REG_MIXER_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_BIAS_ADJ, NAU8325_REG_ANALOG_CONTROL_6) |	\
+	NAU_REG(w, NAU8325_REG_CLIP_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_RDAC))
+
+static const u32 nau8325_readable_map[] = NAU_REGMAP(NAU8325_READABLE_REGS);
+
 static bool nau8325_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8325_REG_CLK_CTRL ... NAU8325_REG_INT_CLR_STATUS:
-	case NAU8325_REG_IRQOUT:
-	case NAU8325_REG_IO_CTRL ... NAU8325_REG_TIME_SLOT:
-	case NAU8325_REG_HPF_CTRL ... NAU8325_REG_DAC_VOLUME:
-	case NAU8325_REG_DEBUG_READ1:
-	case NAU8325_REG_DEBUG_READ2:
-	case NAU8325_REG_DEBUG_READ3:
-	case NAU8325_REG_DAC_CTRL1:
-	case NAU8325_REG_DAC_CTRL2:
-	case NAU8325_REG_ALC_CTRL1 ... NAU8325_REG_ALC_CTRL4:
-	case NAU8325_REG_CLK_DET_CTRL:
-	case NAU8325_REG_TEST_STATUS:
-	case NAU8325_REG_ANALOG_READ:
-	case NAU8325_REG_MIXER_CTRL:
-	case NAU8325_REG_MISC_CTRL:
-	case NAU8325_REG_BIAS_ADJ ... NAU8325_REG_ANALOG_CONTROL_6:
-	case NAU8325_REG_CLIP_CTRL:
-	case NAU8325_REG_RDAC:
-		return true;
-	default:
-		return false;
-	}
-
+	return nau_regmap_access(nau8325_readable_map, reg);
 }
 
+#define NAU8325_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8325_REG_CLK_CTRL, NAU8325_REG_INT_CLR_STATUS) |	\
+	NAU_REG(w, NAU8325_REG_IRQOUT) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_IO_CTRL, NAU8325_REG_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8325_REG_HPF_CTRL, NAU8325_REG_DAC_VOLUME) |	\
+	NAU_REG(w, NAU8325_REG_DAC_CTRL1) |				\
+	NAU_REG(w, NAU8325_REG_DAC_CTRL2) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_ALC_CTRL1, NAU8325_REG_ALC_CTRL4) |	\
+	NAU_REG(w, NAU8325_REG_CLK_DET_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_TEST_STATUS) |				\
+	NAU_REG(w, NAU8325_REG_MIXER_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8325_REG_BIAS_ADJ, NAU8325_REG_ANALOG_CONTROL_6) |	\
+	NAU_REG(w, NAU8325_REG_CLIP_CTRL) |				\
+	NAU_REG(w, NAU8325_REG_RDAC))
+
+static const u32 nau8325_writeable_map[] = NAU_REGMAP(NAU8325_WRITEABLE_REGS);
+
 static bool nau8325_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8325_REG_CLK_CTRL ... NAU8325_REG_INT_CLR_STATUS:
-	case NAU8325_REG_IRQOUT:
-	case NAU8325_REG_IO_CTRL ... NAU8325_REG_TIME_SLOT:
-	case NAU8325_REG_HPF_CTRL ... NAU8325_REG_DAC_VOLUME:
-	case NAU8325_REG_DAC_CTRL1:
-	case NAU8325_REG_DAC_CTRL2:
-	case NAU8325_REG_ALC_CTRL1 ... NAU8325_REG_ALC_CTRL4:
-	case NAU8325_REG_CLK_DET_CTRL:
-	case NAU8325_REG_TEST_STATUS:
-	case NAU8325_REG_MIXER_CTRL:
-	case NAU8325_REG_MISC_CTRL:
-	case NAU8325_REG_BIAS_ADJ ... NAU8325_REG_ANALOG_CONTROL_6:
-	case NAU8325_REG_CLIP_CTRL:
-	case NAU8325_REG_RDAC:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8325_writeable_map, reg);
 }
 
+#define NAU8325_VOLATILE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8325_REG_HARDWARE_RST, NAU8325_REG_SOFTWARE_RST) |	\
+	NAU_REG(w, NAU8325_REG_DEVICE_ID) |				\
+	NAU_REG(w, NAU8325_REG_INT_CLR_STATUS) |			\
+	NAU_REG_RANGE(w, NAU8325_REG_DEBUG_READ1, NAU8325_REG_DEBUG_READ3) |	\
+	NAU_REG_RANGE(w, NAU8325_REG_TEST_STATUS, NAU8325_REG_ANALOG_READ))
+
+static const u32 nau8325_volatile_map[] = NAU_REGMAP(NAU8325_VOLATILE_REGS);
+
 static bool nau8325_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8325_REG_HARDWARE_RST ... NAU8325_REG_SOFTWARE_RST:
-	case NAU8325_REG_DEVICE_ID:
-	case NAU8325_REG_INT_CLR_STATUS:
-	case NAU8325_REG_DEBUG_READ1 ... NAU8325_REG_DEBUG_READ3:
-	case NAU8325_REG_TEST_STATUS ... NAU8325_REG_ANALOG_READ:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8325_volatile_map, reg);
 }
 
 static int nau8325_clkdet_put(struct snd_kcontrol *kcontrol,
@@ -284,14 +317,206 @@ static const struct soc_enum nau8325_limiter_mode_enum =
 	ARRAY_SIZE(nau8325_limiter_mode), nau8325_limiter_mode);
 
 static const DECLARE_TLV_DB_MINMAX_MUTE(dac_vol_tlv, -8000, 600);
+static const unsigned int nau8325_vol_shift[NAU_VOL_RAMP_CH] = {
+	NAU8325_DAC_VOLUME_L_SFT, NAU8325_DAC_VOLUME_R_SFT,
+};
 static const DECLARE_TLV_DB_MINMAX(adc_vol_tlv, 0, 24125);
 static const DECLARE_TLV_DB_MINMAX(pga_gain_tlv, 0, 1600);
 
+/* The volume read back is the one the ramp goes to */
+static int nau8325_volume_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	unsigned int vol[NAU_VOL_RAMP_CH];
+
+	nau_vol_ramp_get(&nau8325->vol_ramp, vol);
+	ucontrol->value.integer.value[0] = vol[0];
+	ucontrol->value.integer.value[1] = vol[1];
+
+	return 0;
+}
+
+static int nau8325_volume_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	unsigned int vol[NAU_VOL_RAMP_CH] = {
+		ucontrol->value.integer.value[0],
+		ucontrol->value.integer.value[1],
+	};
+
+	if (vol[0] > NAU8325_DAC_VOL_MAX || vol[1] > NAU8325_DAC_VOL_MAX)
+		return -EINVAL;
+
+	return nau_vol_ramp_set(&nau8325->vol_ramp, vol);
+}
+
+/* The volume of all the members of the group in one pass, each ramped */
+static int nau8325_group_volume_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	struct nau8325_group *group = nau8325->group;
+	unsigned int vol[NAU_VOL_RAMP_CH] = {
+		ucontrol->value.integer.value[0],
+		ucontrol->value.integer.value[1],
+	};
+	struct nau8325 *member;
+	int change = 0;
+
+	if (!group)
+		return nau8325_volume_put(kcontrol, ucontrol);
+
+	if (vol[0] > NAU8325_DAC_VOL_MAX || vol[1] > NAU8325_DAC_VOL_MAX)
+		return -EINVAL;
+
+	mutex_lock(&group->lock);
+	list_for_each_entry(member, &group->members, group_node)
+		change |= nau_vol_ramp_set(&member->vol_ramp, vol);
+	mutex_unlock(&group->lock);
+
+	return change;
+}
+
+static int nau8325_vol_ramp_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8325->vol_ramp.rate;
+
+	return 0;
+}
+
+/* applied from the next volume change, 0 writes the volume at once */
+static int nau8325_vol_ramp_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	long rate = ucontrol->value.integer.value[0];
+
+	if (rate < 0 || rate > NAU_VOL_RAMP_RATE_MAX)
+		return -EINVAL;
+	if (rate == nau8325->vol_ramp.rate)
+		return 0;
+	WRITE_ONCE(nau8325->vol_ramp.rate, rate);
+
+	return 1;
+}
+
+static int nau8325_spk_mute_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = !nau8325->spk_muted;
+
+	return 0;
+}
+
+/* Start the ramp of the soft mute. The DAPM events don't wait it; only
+ * the power down of the DACs waits the rest of the ramp.
+ */
+static void nau8325_soft_mute(struct nau8325 *nau8325, bool mute)
+{
+	regmap_update_bits(nau8325->regmap, NAU8325_REG_MUTE_CTRL,
+		NAU8325_SOFT_MUTE, mute ? NAU8325_SOFT_MUTE : 0);
+	nau8325->mute_ramp_end = ktime_add_ms(ktime_get(), SOFT_MUTE_RAMP_MS);
+}
+
+static void nau8325_soft_mute_wait(struct nau8325 *nau8325)
+{
+	s64 us = ktime_us_delta(nau8325->mute_ramp_end, ktime_get());
+
+	if (us > 0)
+		usleep_range(us, us + 1000);
+}
+
+/* The mute goes to the DAC powered up, or waits for the power up */
+static void nau8325_spk_mute_apply(struct nau8325 *nau8325, bool muted)
+{
+	nau8325->spk_muted = muted;
+	if (nau8325->dac_on && (!nau8325->group || nau8325->group->unmuted))
+		nau8325_soft_mute(nau8325, muted);
+}
+
+/* The mute of all the members of the group in one pass */
+static int nau8325_spk_mute_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	struct nau8325_group *group = nau8325->group;
+	bool muted = !ucontrol->value.integer.value[0];
+	struct nau8325 *member;
+
+	if (muted == nau8325->spk_muted)
+		return 0;
+
+	if (!group) {
+		nau8325_spk_mute_apply(nau8325, muted);
+		return 1;
+	}
+
+	mutex_lock(&group->lock);
+	list_for_each_entry(member, &group->members, group_node)
+		nau8325_spk_mute_apply(member, muted);
+	mutex_unlock(&group->lock);
+
+	return 1;
+}
+
+static int nau8325_keepalive_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8325->keepalive.ms;
+
+	return 0;
+}
+
+/* applied from the next stream opened */
+static int nau8325_keepalive_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+	long ms = ucontrol->value.integer.value[0];
+
+	if (ms < 0 || ms > NAU_KEEPALIVE_MAX_MS)
+		return -EINVAL;
+	if (ms == nau8325->keepalive.ms)
+		return 0;
+	WRITE_ONCE(nau8325->keepalive.ms, ms);
+
+	return 1;
+}
+
 static const struct snd_kcontrol_new nau8325_snd_controls[] = {
 	SOC_ENUM("DAC Oversampling Rate", nau8325_dac_oversampl_enum),
-	SOC_DOUBLE_TLV("Speaker Volume",NAU8325_REG_DAC_VOLUME,
+	SOC_DOUBLE_EXT_TLV("Speaker Volume", NAU8325_REG_DAC_VOLUME,
 		NAU8325_DAC_VOLUME_L_SFT, NAU8325_DAC_VOLUME_R_SFT,
-		NAU8325_DAC_VOL_MAX,0, dac_vol_tlv),
+		NAU8325_DAC_VOL_MAX, 0, nau8325_volume_get,
+		nau8325_volume_put, dac_vol_tlv),
+	SOC_DOUBLE_EXT_TLV("Group Speaker Volume", NAU8325_REG_DAC_VOLUME,
+		NAU8325_DAC_VOLUME_L_SFT, NAU8325_DAC_VOLUME_R_SFT,
+		NAU8325_DAC_VOL_MAX, 0, nau8325_volume_get,
+		nau8325_group_volume_put, dac_vol_tlv),
+	/* DAC volume codes stepped per 5 ms */
+	SOC_SINGLE_EXT("Volume Ramp Rate", SND_SOC_NOPM, 0,
+		NAU_VOL_RAMP_RATE_MAX, 0,
+		nau8325_vol_ramp_get, nau8325_vol_ramp_put),
+	SOC_SINGLE_BOOL_EXT("Group Speaker Switch", 0,
+		nau8325_spk_mute_get, nau8325_spk_mute_put),
 	
 	SOC_ENUM("DAC ALC Gain Channel Source",
 		nau8325_dac_alcgain_sel_enum),
@@ -302,6 +527,9 @@ static const struct snd_kcontrol_new nau8325_snd_controls[] = {
 
 	SOC_SINGLE_EXT("Clock Detection", SND_SOC_NOPM, 0, 1, 0,
 		nau8325_clkdet_get, nau8325_clkdet_put),
+	SOC_SINGLE_EXT("Keepalive Time", SND_SOC_NOPM, 0,
+		NAU_KEEPALIVE_MAX_MS, 0,
+		nau8325_keepalive_get, nau8325_keepalive_put),
 
 	SOC_SINGLE("ALC Max Gain", NAU8325_REG_ALC_CTRL1,
 		NAU8325_ALC_MAXGAIN_SFT, NAU8325_ALC_MAXGAIN_MAX, 0),
@@ -335,26 +563,100 @@ static const struct snd_kcontrol_new nau8325_snd_controls[] = {
 		NAU8325_RECV_MODE_SFT, 1, 0),
 };
 
-static int nau8325_dac_event(struct snd_soc_dapm_widget *w,
+/* Unmute the members powered up, with group lock held */
+static void nau8325_group_unmute(struct nau8325_group *group)
+{
+	struct nau8325 *member;
+
+	list_for_each_entry(member, &group->members, group_node)
+		if (member->dac_on && !member->spk_muted)
+			nau8325_soft_mute(member, false);
+	group->unmuted = true;
+}
+
+/* Some members don't power up, unmute the others anyway */
+static void nau8325_group_unmute_work(struct work_struct *work)
+{
+	struct nau8325_group *group =
+		container_of(work, struct nau8325_group, unmute_work.work);
+
+	mutex_lock(&group->lock);
+	if (!group->unmuted && group->powered)
+		nau8325_group_unmute(group);
+	mutex_unlock(&group->lock);
+}
+
+/* The members unmute together when the last one powers up, and mute
+ * together when the first one powers down; the members on a link stop
+ * together. Each member waits its own ramp before its DACs power down.
+ */
+static int nau8325_group_mute_event(struct nau8325 *nau8325, int event)
+{
+	struct nau8325_group *group = nau8325->group;
+	struct nau8325 *member;
+
+	mutex_lock(&group->lock);
+	switch (event) {
+	case SND_SOC_DAPM_POST_PMU:
+		nau8325->dac_on = true;
+		group->powered++;
+		if (!group->unmuted && group->powered == group->num)
+			nau8325_group_unmute(group);
+		else if (group->unmuted && !nau8325->spk_muted)
+			/* join the members unmuted by the work */
+			nau8325_soft_mute(nau8325, false);
+		else if (!group->unmuted)
+			schedule_delayed_work(&group->unmute_work,
+				msecs_to_jiffies(GROUP_UNMUTE_MS));
+		break;
+	case SND_SOC_DAPM_PRE_PMD:
+		if (group->unmuted) {
+			list_for_each_entry(member, &group->members, group_node)
+				if (member->dac_on)
+					nau8325_soft_mute(member, true);
+			group->unmuted = false;
+		}
+		nau8325->dac_on = false;
+		group->powered--;
+		break;
+	default:
+		mutex_unlock(&group->lock);
+		return -EINVAL;
+	}
+	if (group->unmuted || !group->powered)
+		cancel_delayed_work(&group->unmute_work);
+	mutex_unlock(&group->lock);
+
+	if (event == SND_SOC_DAPM_PRE_PMD)
+		nau8325_soft_mute_wait(nau8325);
+
+	return 0;
+}
+
+/* The soft mute is global to both DACs, so it runs once per stream from
+ * the widget past them: the unmute after both DACs power up, and the mute
+ * before them powering down, to prevent the pop noise.
+ */
+static int nau8325_mute_event(struct snd_soc_dapm_widget *w,
 	struct snd_kcontrol *kcontrol, int event)
 {
 	struct snd_soc_component *component =
 		snd_soc_dapm_to_component(w->dapm);
 	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
 
+	if (nau8325->group)
+		return nau8325_group_mute_event(nau8325, event);
+
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
-		regmap_update_bits(nau8325->regmap,
-			NAU8325_REG_MUTE_CTRL,
-			NAU8325_SOFT_MUTE, 0);
-		msleep(30);
+		nau8325->dac_on = true;
+		if (!nau8325->spk_muted)
+			nau8325_soft_mute(nau8325, false);
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
-		/* Soft mute the output to prevent the pop noise */
-		regmap_update_bits(nau8325->regmap,
-			NAU8325_REG_MUTE_CTRL,
-			NAU8325_SOFT_MUTE, NAU8325_SOFT_MUTE);
-		msleep(30);
+		nau8325_soft_mute(nau8325, true);
+		nau8325->dac_on = false;
+		nau8325_soft_mute_wait(nau8325);
 		break;
 	default:
 		return -EINVAL;
@@ -370,8 +672,32 @@ static int nau8325_powerup_event(struct snd_soc_dapm_widget *w,
 		snd_soc_dapm_to_component(w->dapm);
 	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
 
-	if (nau8325->clock_detection)
+	nau_keepalive_power(&nau8325->keepalive,
+		event == SND_SOC_DAPM_POST_PMU);
+
+	/* With the clock detection, the chip powers up by itself and only
+	 * the recovery from a clock loss is armed for the stream.
+	 */
+	if (nau8325->clock_detection) {
+		switch (event) {
+		case SND_SOC_DAPM_POST_PMU:
+			nau8325->clk_armed = true;
+			break;
+		case SND_SOC_DAPM_POST_PMD:
+			nau8325->clk_armed = false;
+			cancel_delayed_work_sync(&nau8325->clk_work);
+			if (nau8325->clk_forced) {
+				regmap_update_bits(nau8325->regmap,
+					NAU8325_REG_CLK_DET_CTRL,
+					NAU8325_PWRUP_DFT, 0);
+				nau8325->clk_forced = false;
+			}
+			break;
+		default:
+			return -EINVAL;
+		}
 		return 0;
+	}
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
@@ -394,12 +720,12 @@ static const struct snd_soc_dapm_widget nau8325_dapm_widgets[] = {
 	SND_SOC_DAPM_SUPPLY("PowerUp", SND_SOC_NOPM, 0, 0,
 		nau8325_powerup_event, SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
 	SND_SOC_DAPM_AIF_IN("AIFRX", "Playback", 0, SND_SOC_NOPM, 0, 0),
-	SND_SOC_DAPM_DAC_E("DAC_L", NULL, NAU8325_REG_ENA_CTRL,
-		NAU8325_DAC_LEFT_CH_EN_SFT, 0, nau8325_dac_event,
-		SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
-	SND_SOC_DAPM_DAC_E("DAC_R", NULL, NAU8325_REG_ENA_CTRL,
-		NAU8325_DAC_RIGHT_CH_EN_SFT, 0, nau8325_dac_event,
-		SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
+	SND_SOC_DAPM_DAC("DAC_L", NULL, NAU8325_REG_ENA_CTRL,
+		NAU8325_DAC_LEFT_CH_EN_SFT, 0),
+	SND_SOC_DAPM_DAC("DAC_R", NULL, NAU8325_REG_ENA_CTRL,
+		NAU8325_DAC_RIGHT_CH_EN_SFT, 0),
+	SND_SOC_DAPM_PGA_E("Soft Mute", SND_SOC_NOPM, 0, 0, NULL, 0,
+		nau8325_mute_event, SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
 
 	SND_SOC_DAPM_OUTPUT("SPK"),
 };
@@ -411,8 +737,9 @@ static const struct snd_soc_dapm_route nau8325_dapm_routes[] = {
 	{ "DAC_R", NULL, "I2S Normal Mode" },
 	{ "DAC_L", NULL, "AIFRX" },
 	{ "DAC_R", NULL, "AIFRX" },
-	{ "SPK", NULL, "DAC_L" },
-	{ "SPK", NULL, "DAC_R" },
+	{ "Soft Mute", NULL, "DAC_L" },
+	{ "Soft Mute", NULL, "DAC_R" },
+	{ "SPK", NULL, "Soft Mute" },
 };
 
 static int nau8325_srate_clk_apply(struct nau8325 *nau8325,
@@ -625,10 +952,23 @@ proc_err:
 }
 
 
+static const struct nau8325_clk_preset *nau8325_clk_preset_find(int mclk, int fs)
+{
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(clk_preset_table); i++)
+		if (clk_preset_table[i].mclk == mclk &&
+			clk_preset_table[i].fs == fs)
+			return &clk_preset_table[i];
+
+	return NULL;
+}
+
 static int nau8325_clksrc_choose(struct nau8325 *nau8325,
 	const struct nau8325_srate_attr **srate_table,
 	int *n1_sel, int *mult_sel, int *n2_sel, int *dsp_mult_sel)
 {
+	const struct nau8325_clk_preset *preset;
 	int i, j, mclk, mclk_max, ratio, ratio_sel, n2_max, ret;
 
 	if (!nau8325->mclk || !nau8325->fs)
@@ -639,6 +979,18 @@ static int nau8325_clksrc_choose(struct nau8325 *nau8325,
 	if (*srate_table == NULL)
 		goto proc_err;
 
+	preset = nau8325_clk_preset_find(nau8325->mclk, nau8325->fs);
+	if (preset) {
+		*n1_sel = preset->n1_sel;
+		*mult_sel = preset->mult_sel;
+		*n2_sel = preset->n2_sel;
+		*dsp_mult_sel = preset->dsp_mult_sel;
+		dev_dbg(nau8325->dev, "FS %dHz, MCLK %dHz, preset (n1,mu,n2,dmu):(%d,%d,%d,%d)\n",
+			nau8325->fs, nau8325->mclk, *n1_sel, *mult_sel, *n2_sel,
+			*dsp_mult_sel);
+		return 0;
+	}
+
 	/* First check clock from MCLK directly, decide N2 for MCLK_SRC.
 	 * If not good, consider 1/N1 and Multiplier.
 	 */
@@ -703,28 +1055,105 @@ proc_done:
 }
 
 
-static int nau8325_clock_config(struct nau8325 *nau8325)
+static int nau8325_clk_apply(struct nau8325 *nau8325,
+	const struct nau8325_clk_solution *sol)
 {
-	const struct nau8325_srate_attr *srate_table;
-	int ret, n1_sel, mult_sel, n2_sel, dsp_mult_sel;
+	int ret;
 
-	ret = nau8325_clksrc_choose(nau8325, &srate_table,
-		&n1_sel, &mult_sel, &n2_sel, &dsp_mult_sel);
+	ret = nau8325_srate_clk_apply(nau8325, sol->srate_table,
+		sol->n1_sel, sol->mult_sel, sol->n2_sel, sol->dsp_mult_sel);
 	if (ret)
-		goto err;
+		return ret;
 
-	ret = nau8325_srate_clk_apply(nau8325, srate_table,
-		n1_sel, mult_sel, n2_sel, dsp_mult_sel);
-	if (ret)
-		goto err;
+	return nau8325_osr_apply(nau8325);
+}
+
+/* The first member configured solves the clocks of the group and programs
+ * all the members on the bus; the others find theirs programmed.
+ */
+static int nau8325_group_clock_config(struct nau8325 *nau8325)
+{
+	struct nau8325_group *group = nau8325->group;
+	struct nau8325_clk_solution *sol = &group->clk;
+	struct nau8325 *member;
+	int ret = 0;
+
+	mutex_lock(&group->lock);
+	if (sol->mclk != nau8325->mclk || sol->fs != nau8325->fs) {
+		sol->mclk = 0;
+		ret = nau8325_clksrc_choose(nau8325, &sol->srate_table,
+			&sol->n1_sel, &sol->mult_sel, &sol->n2_sel,
+			&sol->dsp_mult_sel);
+		if (ret)
+			goto out;
+		sol->mclk = nau8325->mclk;
+		sol->fs = nau8325->fs;
+		group->clk_gen++;
+
+		list_for_each_entry(member, &group->members, group_node) {
+			member->mclk = sol->mclk;
+			member->fs = sol->fs;
+			ret = nau8325_clk_apply(member, sol);
+			if (ret)
+				goto out;
+			member->clk_gen = group->clk_gen;
+		}
+	} else if (nau8325->clk_gen != group->clk_gen) {
+		ret = nau8325_clk_apply(nau8325, sol);
+		if (!ret)
+			nau8325->clk_gen = group->clk_gen;
+	} else {
+		ret = nau8325_osr_apply(nau8325);
+	}
+out:
+	mutex_unlock(&group->lock);
+	return ret;
+}
+
+static int nau8325_clock_config(struct nau8325 *nau8325)
+{
+	struct nau8325_clk_solution sol;
+	int ret;
 
-	ret = nau8325_osr_apply(nau8325);
+	if (nau8325->group)
+		return nau8325_group_clock_config(nau8325);
+
+	ret = nau8325_clksrc_choose(nau8325, &sol.srate_table,
+		&sol.n1_sel, &sol.mult_sel, &sol.n2_sel, &sol.dsp_mult_sel);
 	if (ret)
-		goto err;
+		return ret;
 
-	return 0;
-err:
-	return ret;
+	return nau8325_clk_apply(nau8325, &sol);
+}
+
+/* The clock detection powers the chip down when the host stops BCLK/MCLK,
+ * and waits for the clocks long before it powers up again. The registers
+ * keep the clocks of the stream, so the power up is forced at once, then
+ * given back to the detection after CLK_REARM_MS.
+ */
+static void nau8325_clk_work(struct work_struct *work)
+{
+	struct nau8325 *nau8325 =
+		container_of(work, struct nau8325, clk_work.work);
+
+	if (!nau8325->clk_armed)
+		return;
+
+	if (nau8325->clk_forced) {
+		regmap_update_bits(nau8325->regmap, NAU8325_REG_CLK_DET_CTRL,
+			NAU8325_PWRUP_DFT, 0);
+		nau8325->clk_forced = false;
+		return;
+	}
+
+	regmap_update_bits(nau8325->regmap, NAU8325_REG_CLK_DET_CTRL,
+		NAU8325_PWRUP_DFT, NAU8325_PWRUP_DFT);
+	nau8325->clk_forced = true;
+	nau8325->clk_recoveries++;
+	nau_latency_add(&nau8325->latency[NAU8325_LAT_CLK_RECOVERY],
+		nau8325->clk_loss_start);
+	schedule_delayed_work(&nau8325->clk_work,
+		msecs_to_jiffies(CLK_REARM_MS));
 }
 
 static int nau8325_hw_params(struct snd_pcm_substream *substream,
@@ -733,6 +1162,7 @@ static int nau8325_hw_params(struct snd_pcm_substream *substream,
 	struct snd_soc_component *component = dai->component;
 	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0;
+	ktime_t start = ktime_get();
 	int ret;
 
 	nau8325->fs = params_rate(params);
@@ -760,6 +1190,7 @@ static int nau8325_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8325->regmap, NAU8325_REG_I2S_PCM_CTRL1,
 		NAU8325_I2S_DL_MASK, val_len);
+	nau_latency_add(&nau8325->latency[NAU8325_LAT_HW_PARAMS], start);
 
 	return 0;
 err:
@@ -838,18 +1269,58 @@ static int nau8325_set_sysclk(struct snd_soc_component *component, int clk_id,
 	return 0;
 }
 
+static const char * const nau8325_latency_names[NAU8325_LAT_NUM] = {
+	[NAU8325_LAT_HW_PARAMS] = "hw_params",
+	[NAU8325_LAT_CLK_RECOVERY] = "clk_recovery",
+};
+
+static void nau8325_clk_debugfs_init(struct nau8325 *nau8325,
+	struct dentry *root)
+{
+	struct dentry *dir;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir("clk_loss", root);
+	debugfs_create_u32("events", 0444, dir, &nau8325->clk_loss_events);
+	debugfs_create_u32("recoveries", 0444, dir, &nau8325->clk_recoveries);
+}
+
+static const struct regmap_config nau8325_regmap_config;
+
 static int nau8325_codec_probe(struct snd_soc_component *component)
 {
 	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
 	struct snd_soc_dapm_context *dapm = snd_soc_component_get_dapm(component);
 
 	nau8325->dapm = dapm;
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8325->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+					 &nau8325->regcache_report, nau8325->regmap,
+					 &nau8325_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8325->latency,
+				 nau8325_latency_names, NAU8325_LAT_NUM);
+	nau8325_clk_debugfs_init(nau8325, component->debugfs_root);
+	nau_keepalive_debugfs_init(component->debugfs_root,
+		&nau8325->keepalive);
+	nau_vol_ramp_debugfs_init(component->debugfs_root, &nau8325->vol_ramp);
+	nau_pm_card_link(component);
 
 	return 0;
 }
 
+static void nau8325_codec_remove(struct snd_soc_component *component)
+{
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(component);
+
+	nau_vol_ramp_finish(&nau8325->vol_ramp);
+	nau_pm_card_unlink(component);
+}
+
 static struct snd_soc_component_driver nau8325_component_driver = {
 	.probe = nau8325_codec_probe,
+	.remove = nau8325_codec_remove,
 	.set_sysclk = nau8325_set_sysclk,
 	.suspend_bias_off = true,
 	.controls = nau8325_snd_controls,
@@ -858,10 +1329,21 @@ static struct snd_soc_component_driver nau8325_component_driver = {
 	.num_dapm_widgets = ARRAY_SIZE(nau8325_dapm_widgets),
 	.dapm_routes = nau8325_dapm_routes,
 	.num_dapm_routes = ARRAY_SIZE(nau8325_dapm_routes),
-	
+	.use_pmdown_time = 1,
 };
 
+static int nau8325_startup(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct nau8325 *nau8325 = snd_soc_component_get_drvdata(dai->component);
+
+	nau_keepalive_startup(&nau8325->keepalive, substream, dai);
+
+	return 0;
+}
+
 static const struct snd_soc_dai_ops nau8325_dai_ops = {
+	.startup = nau8325_startup,
 	.hw_params = nau8325_hw_params,
 	.set_fmt = nau8325_set_fmt,
 };
@@ -1001,11 +1483,120 @@ static void nau8325_init_regs(struct nau8325 *nau8325)
 		
 }
 
+static int nau8325_group_join(struct nau8325 *nau8325, u32 id)
+{
+	struct nau8325_group *group;
+
+	mutex_lock(&nau8325_groups_lock);
+	list_for_each_entry(group, &nau8325_groups, node)
+		if (group->id == id)
+			goto found;
+
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group) {
+		mutex_unlock(&nau8325_groups_lock);
+		return -ENOMEM;
+	}
+	group->id = id;
+	INIT_LIST_HEAD(&group->members);
+	mutex_init(&group->lock);
+	INIT_DELAYED_WORK(&group->unmute_work, nau8325_group_unmute_work);
+	list_add(&group->node, &nau8325_groups);
+found:
+	mutex_lock(&group->lock);
+	list_add_tail(&nau8325->group_node, &group->members);
+	group->num++;
+	nau8325->group = group;
+	mutex_unlock(&group->lock);
+	mutex_unlock(&nau8325_groups_lock);
+
+	return 0;
+}
+
+static void nau8325_group_leave(struct nau8325 *nau8325)
+{
+	struct nau8325_group *group = nau8325->group;
+	bool last;
+
+	if (!group)
+		return;
+
+	mutex_lock(&nau8325_groups_lock);
+	mutex_lock(&group->lock);
+	list_del(&nau8325->group_node);
+	last = !--group->num;
+	nau8325->group = NULL;
+	mutex_unlock(&group->lock);
+	if (last)
+		list_del(&group->node);
+	mutex_unlock(&nau8325_groups_lock);
+
+	if (last) {
+		cancel_delayed_work_sync(&group->unmute_work);
+		mutex_destroy(&group->lock);
+		kfree(group);
+	}
+}
+
+static irqreturn_t nau8325_interrupt(int irq, void *data)
+{
+	struct nau8325 *nau8325 = (struct nau8325 *)data;
+	unsigned int active_irq;
+
+	if (regmap_read(nau8325->regmap, NAU8325_REG_INT_CLR_STATUS,
+		&active_irq)) {
+		dev_err(nau8325->dev, "failed to read irq status\n");
+		return IRQ_NONE;
+	}
+	active_irq &= NAU8325_INT_STATUS_MASK;
+	if (!active_irq)
+		return IRQ_NONE;
+
+	/* The clock detection powered the chip down, recover the stream. */
+	if (active_irq & NAU8325_INT_STATUS_PWR) {
+		nau8325->clk_loss_events++;
+		if (nau8325->clk_armed && !nau8325->clk_forced &&
+			!delayed_work_pending(&nau8325->clk_work)) {
+			nau8325->clk_loss_start = ktime_get();
+			schedule_delayed_work(&nau8325->clk_work, 0);
+		}
+	}
+	regmap_write(nau8325->regmap, NAU8325_REG_INT_CLR_STATUS, active_irq);
+
+	return IRQ_HANDLED;
+}
+
+static int nau8325_setup_irq(struct nau8325 *nau8325)
+{
+	int ret;
+
+	ret = devm_request_threaded_irq(nau8325->dev, nau8325->irq, NULL,
+		nau8325_interrupt, IRQF_TRIGGER_LOW | IRQF_ONESHOT,
+		"nau8325", nau8325);
+	if (ret) {
+		dev_err(nau8325->dev, "Cannot request irq %d (%d)\n",
+			nau8325->irq, ret);
+		return ret;
+	}
+
+	/* Only the power interrupt is used, for the recovery from a clock
+	 * loss.
+	 */
+	regmap_update_bits(nau8325->regmap, NAU8325_REG_INTERRUPT_CTRL,
+		NAU8325_PWR_INT_MASK | NAU8325_PWR_INT_DIS, 0);
+	regmap_update_bits(nau8325->regmap, NAU8325_REG_IO_CTRL,
+		NAU8325_IRQ_OUTPUT_EN, NAU8325_IRQ_OUTPUT_EN);
+
+	return 0;
+}
+
 static int nau8325_i2c_probe(struct i2c_client *i2c, const struct i2c_device_id *id)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8325 *nau8325 = dev_get_platdata(dev);
+	struct regmap_config regmap_config;
 	int ret, value;
+	u32 group_id;
 
 	if (!nau8325) {
 		nau8325 = devm_kzalloc(dev, sizeof(*nau8325), GFP_KERNEL);
@@ -1016,10 +1607,16 @@ static int nau8325_i2c_probe(struct i2c_client *i2c, const struct i2c_device_id
 	}
 	i2c_set_clientdata(i2c, nau8325);
 
-	nau8325->regmap = devm_regmap_init_i2c(i2c, &nau8325_regmap_config);
+	/* the amplifiers of a board cache only the registers they use */
+	nau_regmap_lazy_config(&regmap_config, &nau8325_regmap_config);
+	nau8325->regcache_report.lazy = true;
+	nau8325->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&regmap_config, &nau8325->regstat);
 	if (IS_ERR(nau8325->regmap))
 		return PTR_ERR(nau8325->regmap);
 	nau8325->dev = dev;
+	nau8325->irq = i2c->irq;
+	INIT_DELAYED_WORK(&nau8325->clk_work, nau8325_clk_work);
 	
 	ret = regmap_read(nau8325->regmap, NAU8325_REG_DEVICE_ID, &value);
 	if (ret) {
@@ -1029,13 +1626,43 @@ static int nau8325_i2c_probe(struct i2c_client *i2c, const struct i2c_device_id
 	}
 	nau8325_reset_chip(nau8325->regmap);
 	nau8325_init_regs(nau8325);
+	ret = nau_vol_ramp_init(&nau8325->vol_ramp, nau8325->regmap,
+		NAU8325_REG_DAC_VOLUME, NAU8325_DAC_VOL_MAX, NAU_VOL_RAMP_CH,
+		nau8325_vol_shift);
+	if (ret)
+		return ret;
+	/* Without the interrupt, the chip waits the clock detection alone. */
+	if (nau8325->irq && nau8325_setup_irq(nau8325))
+		nau8325->irq = 0;
+	if (device_property_read_u32(dev, "nuvoton,keepalive-ms",
+		&nau8325->keepalive.ms) ||
+	    nau8325->keepalive.ms > NAU_KEEPALIVE_MAX_MS)
+		nau8325->keepalive.ms = 0;
+	if (!device_property_read_u32(dev, "nuvoton,amp-group", &group_id)) {
+		ret = nau8325_group_join(nau8325, group_id);
+		if (ret)
+			return ret;
+	}
+
+	ret = devm_snd_soc_register_component(dev, &nau8325_component_driver, &nau8325_dai, 1);
+	if (ret)
+		nau8325_group_leave(nau8325);
+	else
+		nau_pm_async_init(dev);
 
-	return devm_snd_soc_register_component(dev, &nau8325_component_driver, &nau8325_dai, 1);
+	return ret;
 }
 
 static int nau8325_i2c_remove(struct i2c_client *client)
 {
+	struct nau8325 *nau8325 = i2c_get_clientdata(client);
+
+	if (nau8325->irq)
+		disable_irq(nau8325->irq);
+	cancel_delayed_work_sync(&nau8325->clk_work);
 	snd_soc_unregister_component(&client->dev);
+	cancel_delayed_work_sync(&nau8325->vol_ramp.work);
+	nau8325_group_leave(nau8325);
 	return 0;
 }
 
@@ -1057,6 +1684,7 @@ static struct i2c_driver nau8325_i2c_driver = {
 	.driver = {
 		.name = "nau8325",
 		.of_match_table = of_match_ptr(nau8325_of_ids),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = nau8325_i2c_probe,
 	.remove = nau8325_i2c_remove,
@@ -1068,3 +1696,7 @@ MODULE_DESCRIPTION("ASoC NAU8325 is a stereo high efficiency filter-free Class-D
 MODULE_AUTHOR("Seven Lee <wtli@nuvoton.com>");
 MODULE_AUTHOR("David Lin <CTLIN0@nuvoton.com>");
 MODULE_LICENSE("GPL v2");
+
+#ifdef CONFIG_SND_SOC_NAU8325_KUNIT_TEST
+#include "nau8325-test.c"
+#endif
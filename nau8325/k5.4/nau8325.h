@@ -414,9 +414,21 @@
 #define NAU8325_CODEC_DAI "nau8325-hifi"
 
 
+/* The stages of the stream start, and the recovery from a clock loss,
+ * timed under debugfs
+ */
+enum {
+	NAU8325_LAT_HW_PARAMS,
+	NAU8325_LAT_CLK_RECOVERY,
+	NAU8325_LAT_NUM,
+};
+
 struct nau8325 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_latency latency[NAU8325_LAT_NUM];
 	struct snd_soc_dapm_context *dapm;
 	int irq;
 	int mclk;
@@ -435,6 +447,25 @@ struct nau8325 {
 	int boost_margin;
 	int normal_iis_data;
 	int alc_enable;
+	/* recovery of the power down by the clock detection */
+	struct delayed_work clk_work;
+	ktime_t clk_loss_start;
+	bool clk_armed;
+	bool clk_forced;
+	u32 clk_loss_events;
+	u32 clk_recoveries;
+	/* the power down window after the stream */
+	struct nau_keepalive keepalive;
+	/* ramp of the DAC volume of both channels */
+	struct nau_vol_ramp vol_ramp;
+	/* the speaker mute by user, applied when the DAC powers up */
+	bool spk_muted;
+	/* the DACs powered up, and the end of the soft mute ramp */
+	bool dac_on;
+	ktime_t mute_ramp_end;
+	struct nau8325_group *group;
+	struct list_head group_node;
+	unsigned int clk_gen;
 };
 
 struct nau8325_src_attr {
@@ -462,4 +493,42 @@ struct nau8325_osr_attr {
 	unsigned int clk_src;
 };
 
+struct nau8325_clk_preset {
+	int mclk;
+	int fs;
+	int n1_sel;
+	int mult_sel;
+	int n2_sel;
+	int dsp_mult_sel;
+};
+
+/* the clock source chosen for the MCLK and fs */
+struct nau8325_clk_solution {
+	int mclk;
+	int fs;
+	const struct nau8325_srate_attr *srate_table;
+	int n1_sel;
+	int mult_sel;
+	int n2_sel;
+	int dsp_mult_sel;
+};
+
+/* Amps on one I2S/TDM bus, joined by the property "nuvoton,amp-group".
+ * The clocks are solved once for all the members, the volume and mute go
+ * out to the members in one pass, and the members unmute together.
+ */
+struct nau8325_group {
+	struct list_head node;
+	struct list_head members;
+	u32 id;
+	int num;
+	/* the members with the DAC powered up */
+	int powered;
+	bool unmuted;
+	struct nau8325_clk_solution clk;
+	unsigned int clk_gen;
+	struct mutex lock;
+	struct delayed_work unmute_work;
+};
+
 #endif /* __NAU8325_H__ */
@@ -0,0 +1,23 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * Helpers shared by the Nuvoton codec drivers, built as the module
+ * snd-soc-nau-common with CONFIG_SND_SOC_NAU_COMMON
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#define NAU_COMMON_BUILD
+
+#include <linux/module.h>
+
+#include "nau-fll.h"
+#include "nau-regmap.h"
+
+EXPORT_SYMBOL_GPL(nau_fll_calc);
+EXPORT_SYMBOL_GPL(nau_fll_solve);
+EXPORT_SYMBOL_GPL(nau_regcache_scan);
+EXPORT_SYMBOL_GPL(nau_regcache_sync);
+EXPORT_SYMBOL_GPL(nau_regmap_coeff_update);
+
+MODULE_DESCRIPTION("ASoC Nuvoton codec shared helpers");
+MODULE_LICENSE("GPL");
@@ -0,0 +1,27 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Linkage of the helpers shared by the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_COMMON_H__
+#define __NAU_COMMON_H__
+
+#include <linux/kconfig.h>
+
+/* The larger helpers of the shared headers are built once, in the module
+ * snd-soc-nau-common, when CONFIG_SND_SOC_NAU_COMMON is set; the drivers
+ * then only see their declarations. Otherwise each driver keeps its own
+ * static inline copy, as a chip directory copied alone needs.
+ * nau-common.c defines NAU_COMMON_BUILD to take the bodies.
+ */
+#if IS_ENABLED(CONFIG_SND_SOC_NAU_COMMON) && !defined(NAU_COMMON_BUILD)
+#define NAU_COMMON_DECLARE
+#elif defined(NAU_COMMON_BUILD)
+#define NAU_COMMON_API
+#else
+#define NAU_COMMON_API static inline
+#endif
+
+#endif /* __NAU_COMMON_H__ */
@@ -0,0 +1,39 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * System sleep order of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_PM_H__
+#define __NAU_PM_H__
+
+#include <linux/device.h>
+#include <linux/pm.h>
+#include <sound/soc.h>
+
+/* The codec device suspends and resumes alongside the other devices of
+ * the system rather than in their list order, so the time it takes to
+ * resume overlaps with theirs. The parent bus is waited for already. The
+ * card is not: it runs the component suspend and resume, so it is linked
+ * as a consumer of the codec for the PM core to suspend the card ahead of
+ * the codec and resume it after.
+ */
+static inline void nau_pm_async_init(struct device *dev)
+{
+	device_enable_async_suspend(dev);
+}
+
+static inline void nau_pm_card_link(struct snd_soc_component *component)
+{
+	if (!device_link_add(component->card->dev, component->dev,
+			     DL_FLAG_STATELESS))
+		dev_warn(component->dev, "Failed to link the card for sleep\n");
+}
+
+static inline void nau_pm_card_unlink(struct snd_soc_component *component)
+{
+	device_link_remove(component->card->dev, component->dev);
+}
+
+#endif /* __NAU_PM_H__ */
@@ -0,0 +1,998 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Register access, cache sync and coefficient helpers of the Nuvoton codec
+ * drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_REGMAP_H__
+#define __NAU_REGMAP_H__
+
+#include <linux/bitmap.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/kernel.h>
+#include <linux/ktime.h>
+#include <linux/log2.h>
+#include <linux/math64.h>
+#include <linux/rbtree.h>
+#include <linux/regmap.h>
+#include <linux/seq_file.h>
+#include <linux/slab.h>
+#include <linux/string.h>
+
+#include "nau-common.h"
+
+/* The access maps cover the registers below NAU_REGMAP_NUM, one bit per
+ * register in 32 bit words. They are built at compile time from the
+ * register ranges of the drivers, so the access predicates of regmap
+ * only test one bit.
+ */
+#define NAU_REGMAP_NUM	256
+
+#define __NAU_REGMAP_SFT(x)	((x) < 0 ? 0 : (x) > 31 ? 31 : (x))
+
+/* The bits of map word @w covered by the registers @lo ... @hi */
+#define NAU_REG_RANGE(w, lo, hi)					\
+	(((int)(hi) < (w) * 32 || (int)(lo) > (w) * 32 + 31) ? 0U :	\
+	 ((~0U >> (31 - __NAU_REGMAP_SFT((int)(hi) - (w) * 32))) &	\
+	  (~0U << __NAU_REGMAP_SFT((int)(lo) - (w) * 32))))
+
+#define NAU_REG(w, reg)		NAU_REG_RANGE(w, reg, reg)
+
+/* The map of the registers given by @regs(w), a macro ORing the ranges */
+#define NAU_REGMAP(regs)						\
+	{ regs(0), regs(1), regs(2), regs(3),				\
+	  regs(4), regs(5), regs(6), regs(7) }
+
+static inline bool nau_regmap_access(const u32 *map, unsigned int reg)
+{
+	return reg < NAU_REGMAP_NUM && (map[reg / 32] >> (reg % 32)) & 1;
+}
+
+/* The statistics of the register sync after the codec lost its registers */
+struct nau_regcache_stat {
+	u32 count;	/* syncs done */
+	u32 regs;	/* registers written by the last sync */
+	u32 runs;	/* runs of contiguous registers of the last sync */
+	u32 bytes;	/* address and data bytes of the last sync on the bus */
+	u32 time_us;	/* duration of the last sync */
+	u32 cached;	/* registers with a default found in the cache */
+	unsigned long *dirty;	/* the defaults changed, by their index */
+};
+
+/**
+ * nau_regmap_lazy_config - the config of a register cache filled on use
+ * @lazy: the config to fill in
+ * @config: configuration of the codec, with its defaults
+ *
+ * regcache copies the defaults for each instance and caches all of them
+ * at init. The cache of @lazy starts empty instead and takes a register as
+ * it is first read or written, so each instance of a codec holds only the
+ * registers it uses, and the defaults stay in @config once for all of
+ * them. nau_regcache_scan() compares with @config and leaves out the
+ * registers never cached, which the chip holds at their defaults still.
+ * The first read of a register goes to the chip, so the codec has to be
+ * reachable until its registers of interest are cached.
+ */
+static inline void nau_regmap_lazy_config(struct regmap_config *lazy,
+	const struct regmap_config *config)
+{
+	*lazy = *config;
+	lazy->reg_defaults = NULL;
+	lazy->num_reg_defaults = 0;
+}
+
+/**
+ * nau_regcache_scan - find the registers changed from the defaults
+ * @regmap: regmap of the codec
+ * @config: configuration of @regmap, the defaults sorted by register
+ * @stat: statistics of the sync, which keep the registers found
+ *
+ * The cache is read alone, without a change of the cache only mode: call
+ * it before the cache only mode of the suspend is left, so a register of
+ * nau_regmap_lazy_config() never cached fails instead of being read from
+ * the chip. A regmap caching all of its defaults is read from its cache
+ * in any mode.
+ *
+ * Return: 0 on success, or -ENOMEM.
+ */
+#ifdef NAU_COMMON_DECLARE
+int nau_regcache_scan(struct regmap *regmap,
+	const struct regmap_config *config, struct nau_regcache_stat *stat);
+#else
+NAU_COMMON_API int nau_regcache_scan(struct regmap *regmap,
+	const struct regmap_config *config, struct nau_regcache_stat *stat)
+{
+	const struct reg_default *defs = config->reg_defaults;
+	struct device *dev = regmap_get_device(regmap);
+	int i, num = config->num_reg_defaults;
+	unsigned int val;
+
+	if (!stat->dirty) {
+		stat->dirty = devm_kcalloc(dev, BITS_TO_LONGS(num),
+					   sizeof(long), GFP_KERNEL);
+		if (!stat->dirty)
+			return -ENOMEM;
+	}
+	bitmap_zero(stat->dirty, num);
+	stat->cached = 0;
+	for (i = 0; i < num; i++) {
+		if (config->volatile_reg &&
+		    config->volatile_reg(dev, defs[i].reg))
+			continue;
+		if (regmap_read(regmap, defs[i].reg, &val))
+			continue;
+		stat->cached++;
+		if (val != defs[i].def)
+			__set_bit(i, stat->dirty);
+	}
+
+	return 0;
+}
+#endif
+
+/**
+ * nau_regcache_sync - write back the registers changed from the defaults
+ * @regmap: regmap marked dirty
+ * @config: configuration of @regmap, the defaults sorted by register
+ * @stat: statistics of the sync
+ *
+ * Only the registers found by nau_regcache_scan() are synced, run by run
+ * of contiguous registers, so regcache writes each run in one raw
+ * transfer when the bus format allows it. Without a scan, the whole cache
+ * is synced. The register patch of @regmap is not applied; the caller has
+ * to write it again.
+ *
+ * Return: 0 on success, or the error of regcache.
+ */
+#ifdef NAU_COMMON_DECLARE
+int nau_regcache_sync(struct regmap *regmap,
+	const struct regmap_config *config, struct nau_regcache_stat *stat);
+#else
+NAU_COMMON_API int nau_regcache_sync(struct regmap *regmap,
+	const struct regmap_config *config, struct nau_regcache_stat *stat)
+{
+	const struct reg_default *defs = config->reg_defaults;
+	int reg_bytes = DIV_ROUND_UP(config->reg_bits, 8);
+	int val_bytes = DIV_ROUND_UP(config->val_bits, 8);
+	int i, ret, num = config->num_reg_defaults;
+	unsigned int base = 0, len = 0;
+	bool burst, dirty;
+	ktime_t start;
+
+	if (!stat->dirty)
+		return regcache_sync(regmap);
+
+	/* The buses of the driver own register access and the formats not
+	 * aligned to bytes, like 7 bit address and 9 bit data in one word,
+	 * write the registers one by one.
+	 */
+	burst = !config->use_single_write && !config->reg_write &&
+		!(config->reg_bits % 8) && !(config->val_bits % 8);
+	if (!burst)
+		reg_bytes = DIV_ROUND_UP(config->reg_bits + config->val_bits,
+					 8) - val_bytes;
+
+	start = ktime_get();
+	stat->regs = stat->runs = stat->bytes = 0;
+	for (i = 0; i <= num; i++) {
+		dirty = i < num && test_bit(i, stat->dirty);
+		if (dirty && len && defs[i].reg == base + len) {
+			len++;
+			continue;
+		}
+		if (len) {
+			ret = regcache_sync_region(regmap, base, base + len - 1);
+			if (ret)
+				return ret;
+			stat->regs += len;
+			stat->runs++;
+			stat->bytes += burst ? reg_bytes + len * val_bytes :
+				len * (reg_bytes + val_bytes);
+			len = 0;
+		}
+		if (dirty) {
+			base = defs[i].reg;
+			len = 1;
+		}
+	}
+	stat->count++;
+	stat->time_us = ktime_us_delta(ktime_get(), start);
+
+	return 0;
+}
+#endif
+
+/* The coefficient words last written to the codec, big endian like the
+ * bytes control elements, so only the changed words are written again.
+ */
+#define NAU_COEFF_MAX	64
+
+struct nau_coeff_shadow {
+	u8 data[NAU_COEFF_MAX];
+	bool valid;
+};
+
+/**
+ * nau_regmap_coeff_update - write the coefficient words changed
+ * @regmap: regmap of the codec
+ * @reg: register of the first coefficient
+ * @shadow: coefficients last written, invalid if the codec lost them
+ * @data: big endian coefficient words of the bytes control element
+ * @len: bytes of @data
+ * @en_reg: register of the coefficient write enable
+ * @en_mask: bit of the write enable, 0 if the codec has none
+ *
+ * The runs of words differing from @shadow are written, in a raw burst
+ * when the bus allows. If no word changed, nothing is written, the write
+ * enable included.
+ *
+ * Return: the number of words written, or a negative error.
+ */
+#ifdef NAU_COMMON_DECLARE
+int nau_regmap_coeff_update(struct regmap *regmap,
+	unsigned int reg, struct nau_coeff_shadow *shadow, const u8 *data,
+	size_t len, unsigned int en_reg, unsigned int en_mask);
+#else
+NAU_COMMON_API int nau_regmap_coeff_update(struct regmap *regmap,
+	unsigned int reg, struct nau_coeff_shadow *shadow, const u8 *data,
+	size_t len, unsigned int en_reg, unsigned int en_mask)
+{
+	bool raw = regmap_can_raw_write(regmap);
+	int i, j, k, num = len / 2, ret = 0, written = 0;
+	u8 *buf = shadow->data;
+	u32 dirty = 0;
+
+	if (len > NAU_COEFF_MAX || len % 2)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++)
+		if (!shadow->valid || memcmp(buf + i * 2, data + i * 2, 2))
+			dirty |= BIT(i);
+	if (!dirty)
+		return 0;
+
+	if (en_mask) {
+		ret = regmap_update_bits(regmap, en_reg, en_mask, 0);
+		if (ret)
+			return ret;
+	}
+	memcpy(buf, data, len);
+	for (i = 0; i < num && !ret; i = j) {
+		for (j = i; j < num && dirty & BIT(j); j++)
+			;
+		if (j == i) {
+			j++;
+			continue;
+		}
+		if (raw)
+			ret = regmap_raw_write(regmap, reg + i, buf + i * 2,
+					       (j - i) * 2);
+		else
+			for (k = i; k < j && !ret; k++)
+				ret = regmap_write(regmap, reg + k,
+					(buf[k * 2] << 8) | buf[k * 2 + 1]);
+		written += j - i;
+	}
+	shadow->valid = !ret;
+	if (en_mask)
+		regmap_update_bits(regmap, en_reg, en_mask, en_mask);
+
+	return ret ? ret : written;
+}
+#endif
+
+/* A register update of the bits in @mask to @val */
+struct nau_reg_update {
+	unsigned int reg;
+	unsigned int mask;
+	unsigned int val;
+};
+
+#define NAU_REG_TXN_MAX	16
+
+/* A transaction of register updates. The updates of a register merge into
+ * one, at the place of its first update, and the commit programs them in
+ * that order by regmap_update_bits(), so a register cached with the value
+ * already is not written at all. A barrier closes the updates merged so
+ * far: the updates staged after it are committed after all those before,
+ * the same register included, for the sequences whose order keeps the
+ * outputs free of pops. The transaction takes no lock of its own.
+ */
+struct nau_reg_txn {
+	struct regmap *regmap;
+	struct nau_reg_update upd[NAU_REG_TXN_MAX];
+	int num;
+	int barrier;	/* the first update a new one may merge into */
+	int err;
+};
+
+static inline void nau_reg_txn_begin(struct nau_reg_txn *txn,
+	struct regmap *regmap)
+{
+	txn->regmap = regmap;
+	txn->num = txn->barrier = txn->err = 0;
+}
+
+static inline void nau_reg_txn_update_bits(struct nau_reg_txn *txn,
+	unsigned int reg, unsigned int mask, unsigned int val)
+{
+	struct nau_reg_update *upd;
+	int i;
+
+	for (i = txn->barrier; i < txn->num; i++)
+		if (txn->upd[i].reg == reg)
+			break;
+	if (i == txn->num) {
+		if (WARN_ON(txn->num >= NAU_REG_TXN_MAX)) {
+			txn->err = -ENOSPC;
+			return;
+		}
+		txn->upd[i] = (struct nau_reg_update) { reg, 0, 0 };
+		txn->num++;
+	}
+	upd = &txn->upd[i];
+	upd->mask |= mask;
+	upd->val = (upd->val & ~mask) | (val & mask);
+}
+
+static inline void nau_reg_txn_seq(struct nau_reg_txn *txn,
+	const struct nau_reg_update *seq, int num)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		nau_reg_txn_update_bits(txn, seq[i].reg, seq[i].mask,
+					seq[i].val);
+}
+
+/* The updates staged next are committed after the ones staged so far */
+static inline void nau_reg_txn_barrier(struct nau_reg_txn *txn)
+{
+	txn->barrier = txn->num;
+}
+
+/**
+ * nau_reg_txn_commit - program the updates of a transaction
+ * @txn: transaction, empty again afterwards
+ *
+ * A transaction which overflowed writes nothing.
+ *
+ * Return: 0 on success, or the first error.
+ */
+static inline int nau_reg_txn_commit(struct nau_reg_txn *txn)
+{
+	int i, ret = txn->err;
+
+	for (i = 0; i < txn->num && !ret; i++)
+		ret = regmap_update_bits(txn->regmap, txn->upd[i].reg,
+					 txn->upd[i].mask, txn->upd[i].val);
+	txn->num = txn->barrier = txn->err = 0;
+
+	return ret;
+}
+
+/* The register cache of a regmap, reported under debugfs so its type is
+ * weighed on the board itself. The footprint of the rbtree and the flat
+ * caches is estimated from the allocations of regcache for the register
+ * map: the rbtree takes the defaults in blocks which bridge the holes
+ * shorter than a block node, and the flat one a word per register up to
+ * the last one. On the dense maps below NAU_REGMAP_NUM, the rbtree keeps
+ * a single block or two whose lookup hits the node cached by regcache,
+ * in less memory than the flat array. The lookup time is measured at
+ * each read of the report over the cached registers with a default,
+ * regmap lock included. The registers cached by this instance are weighed
+ * by the same model, along with the copy of the defaults regcache keeps
+ * for an eager cache. A lookup of the lazy cache of
+ * nau_regmap_lazy_config() would read the chip for a register not cached
+ * yet, so the report leaves it out; the registers it holds are counted
+ * by nau_regcache_scan() at each resume instead.
+ */
+struct nau_regcache_report {
+	struct regmap *regmap;
+	const struct regmap_config *config;
+	bool lazy;	/* the regmap was set up by nau_regmap_lazy_config() */
+};
+
+#ifdef CONFIG_DEBUG_FS
+#define NAU_REGCACHE_ROUNDS	16
+
+/* the layout of a block node of the rbtree cache */
+struct nau_rbtree_node {
+	void *block;
+	unsigned long *cache_present;
+	unsigned int base_reg;
+	unsigned int blklen;
+	struct rb_node node;
+};
+
+/* the slab size taken by a kmalloc of @size bytes */
+static inline size_t nau_kmalloc_size(size_t size)
+{
+	size = max_t(size_t, size, KMALLOC_MIN_SIZE);
+	if (KMALLOC_MIN_SIZE <= 32 && size > 64 && size <= 96)
+		return 96;
+	if (KMALLOC_MIN_SIZE <= 64 && size > 128 && size <= 192)
+		return 192;
+
+	return roundup_pow_of_two(size);
+}
+
+static inline size_t nau_rbtree_block_size(unsigned int len, int word)
+{
+	return nau_kmalloc_size(sizeof(struct nau_rbtree_node)) +
+		nau_kmalloc_size(len * word) +
+		nau_kmalloc_size(BITS_TO_LONGS(len) * sizeof(long));
+}
+
+/* The blocks of an rbtree cache holding the registers fed in order */
+struct nau_rbtree_est {
+	unsigned int stride;
+	unsigned int max_dist;
+	int word;
+	unsigned int base;
+	unsigned int top;
+	unsigned int regs;
+	unsigned int blocks;
+	size_t bytes;
+};
+
+static inline void nau_rbtree_est_init(struct nau_rbtree_est *est,
+	const struct regmap_config *config)
+{
+	memset(est, 0, sizeof(*est));
+	est->stride = config->reg_stride ?: 1;
+	est->word = DIV_ROUND_UP(config->val_bits, 8);
+	est->max_dist = est->stride * sizeof(struct nau_rbtree_node) / est->word;
+}
+
+static inline void nau_rbtree_est_add(struct nau_rbtree_est *est,
+	unsigned int reg)
+{
+	est->regs++;
+	if (est->blocks && reg - est->top <= est->max_dist) {
+		est->top = reg;
+		return;
+	}
+	if (est->blocks)
+		est->bytes += nau_rbtree_block_size(
+			(est->top - est->base) / est->stride + 1, est->word);
+	est->base = est->top = reg;
+	est->blocks++;
+}
+
+static inline void nau_rbtree_est_end(struct nau_rbtree_est *est)
+{
+	if (est->blocks)
+		est->bytes += nau_rbtree_block_size(
+			(est->top - est->base) / est->stride + 1, est->word);
+}
+
+static inline const char *nau_regcache_type_name(enum regcache_type type)
+{
+	switch (type) {
+	case REGCACHE_NONE:
+		return "none";
+	case REGCACHE_RBTREE:
+		return "rbtree";
+	case REGCACHE_FLAT:
+		return "flat";
+	default:
+		return "other";
+	}
+}
+
+static inline int nau_regcache_report_show(struct seq_file *s, void *data)
+{
+	struct nau_regcache_report *rep = s->private;
+	const struct regmap_config *config = rep->config;
+	const struct reg_default *defs = config->reg_defaults;
+	struct device *dev = regmap_get_device(rep->regmap);
+	unsigned int stride = config->reg_stride ?: 1;
+	unsigned int val, lookups = 0;
+	int i, n, num = config->num_reg_defaults;
+	struct nau_rbtree_est est;
+	ktime_t start;
+	u64 ns;
+
+	nau_rbtree_est_init(&est, config);
+	for (i = 0; i < num; i++)
+		nau_rbtree_est_add(&est, defs[i].reg);
+	nau_rbtree_est_end(&est);
+
+	seq_printf(s, "type %s\n", nau_regcache_type_name(config->cache_type));
+	seq_printf(s, "rbtree_bytes %zu\nrbtree_blocks %u\n", est.bytes,
+		   est.blocks);
+	seq_printf(s, "flat_bytes %zu\n", nau_kmalloc_size(
+		   (config->max_register / stride + 1) * sizeof(unsigned int)));
+	if (config->cache_type == REGCACHE_NONE)
+		return 0;
+
+	seq_printf(s, "lazy %d\ndefaults_copy_bytes %zu\n", rep->lazy,
+		   rep->lazy || !num ? 0 :
+		   nau_kmalloc_size(num * sizeof(struct reg_default)));
+	if (rep->lazy)
+		return 0;
+
+	/* an eager cache holds all the defaults, so the reads below are
+	 * lookups of the cache alone in any cache mode
+	 */
+	nau_rbtree_est_init(&est, config);
+	for (i = 0; i < num; i++) {
+		if (config->volatile_reg &&
+		    config->volatile_reg(dev, defs[i].reg))
+			continue;
+		if (!regmap_read(rep->regmap, defs[i].reg, &val))
+			nau_rbtree_est_add(&est, defs[i].reg);
+	}
+	nau_rbtree_est_end(&est);
+	seq_printf(s, "cached_regs %u\ncached_blocks %u\ncached_bytes %zu\n",
+		   est.regs, est.blocks, est.bytes);
+
+	start = ktime_get();
+	for (n = 0; n < NAU_REGCACHE_ROUNDS; n++)
+		for (i = 0; i < num; i++) {
+			if (config->volatile_reg &&
+			    config->volatile_reg(dev, defs[i].reg))
+				continue;
+			if (!regmap_read(rep->regmap, defs[i].reg, &val))
+				lookups++;
+		}
+	ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+	seq_printf(s, "lookups %u\nlookup_ns %llu\n", lookups,
+		   lookups ? div_u64(ns, lookups) : 0);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nau_regcache_report);
+
+static inline void nau_regcache_report_debugfs_init(struct dentry *root,
+	struct nau_regcache_report *rep, struct regmap *regmap,
+	const struct regmap_config *config)
+{
+	if (!root)
+		return;
+
+	rep->regmap = regmap;
+	rep->config = config;
+	debugfs_create_file("regcache", 0444, root, rep,
+			    &nau_regcache_report_fops);
+}
+
+static inline void nau_regcache_debugfs_init(struct dentry *root,
+	const char *name, struct nau_regcache_stat *stat)
+{
+	struct dentry *dir;
+
+	if (!root)
+		return;
+
+	dir = debugfs_create_dir(name, root);
+	debugfs_create_u32("count", 0444, dir, &stat->count);
+	debugfs_create_u32("regs", 0444, dir, &stat->regs);
+	debugfs_create_u32("runs", 0444, dir, &stat->runs);
+	debugfs_create_u32("bytes", 0444, dir, &stat->bytes);
+	debugfs_create_u32("time_us", 0444, dir, &stat->time_us);
+	debugfs_create_u32("cached", 0444, dir, &stat->cached);
+}
+#else
+static inline void nau_regcache_report_debugfs_init(struct dentry *root,
+	struct nau_regcache_report *rep, struct regmap *regmap,
+	const struct regmap_config *config)
+{
+}
+
+static inline void nau_regcache_debugfs_init(struct dentry *root,
+	const char *name, struct nau_regcache_stat *stat)
+{
+}
+#endif
+
+/* The register I/O statistics, built only for the kernels configured with
+ * CONFIG_SND_SOC_NAU_REGSTAT, to find the hot registers and call sites
+ * without the regmap tracing. The regmap of the codec takes the lock of
+ * the statistics, which counts each regmap call and its call site, and
+ * the bus transfers are counted and timed per register. The counters are
+ * per CPU and only written under the regmap lock, so nothing but the lock
+ * of regmap itself is taken. The registers from NAU_REGMAP_NUM share the
+ * last counter; the bus time of a burst goes to its first register.
+ */
+#if defined(CONFIG_SND_SOC_NAU_REGSTAT) && defined(CONFIG_DEBUG_FS) && \
+	defined(CONFIG_STACKTRACE)
+
+#include <linux/i2c.h>
+#include <linux/jhash.h>
+#include <linux/kallsyms.h>
+#include <linux/mutex.h>
+#include <linux/percpu.h>
+#include <linux/stacktrace.h>
+
+#define NAU_REGSTAT_REGS	(NAU_REGMAP_NUM + 1)
+/* call sites told apart, the last counter takes the others */
+#define NAU_REGSTAT_SITES	32
+#define NAU_REGSTAT_DEPTH	6
+
+struct nau_regstat_cpu {
+	u64 reads[NAU_REGSTAT_REGS];
+	u64 writes[NAU_REGSTAT_REGS];
+	u64 bus_ns[NAU_REGSTAT_REGS];
+	u64 calls;	/* regmap calls */
+	u64 cached;	/* regmap calls served without the bus */
+	u64 site_calls[NAU_REGSTAT_SITES + 1];
+	u64 site_ns[NAU_REGSTAT_SITES + 1];
+};
+
+/* The call stack into regmap of a call site, resolved when printed */
+struct nau_regstat_site {
+	u32 hash;
+	unsigned long ip[NAU_REGSTAT_DEPTH];
+};
+
+struct nau_regstat {
+	struct nau_regstat_cpu __percpu *cpu;
+	struct nau_regstat_site site[NAU_REGSTAT_SITES];
+	struct mutex lock;
+	struct regmap_config config;
+	struct regmap_bus bus;
+	const struct regmap_bus *inner_bus;
+	int (*reg_read)(void *context, unsigned int reg, unsigned int *val);
+	int (*reg_write)(void *context, unsigned int reg, unsigned int val);
+	void *ctx;
+	unsigned int reg_bytes;
+	unsigned int val_bytes;
+	/* the call site of the regmap call in progress, under lock */
+	int cur_site;
+	bool bus_used;
+};
+
+static inline void nau_regstat_lock(void *arg)
+{
+	struct nau_regstat *stat = arg;
+	unsigned long ip[NAU_REGSTAT_DEPTH] = { 0 };
+	struct nau_regstat_site *site;
+	u32 hash;
+	int i, n;
+
+	mutex_lock(&stat->lock);
+	stack_trace_save(ip, NAU_REGSTAT_DEPTH, 1);
+	hash = jhash(ip, sizeof(ip), 0) ?: 1;
+	stat->cur_site = NAU_REGSTAT_SITES;
+	stat->bus_used = false;
+	for (i = 0; i < NAU_REGSTAT_SITES; i++) {
+		n = (hash + i) % NAU_REGSTAT_SITES;
+		site = &stat->site[n];
+		if (!site->hash) {
+			memcpy(site->ip, ip, sizeof(ip));
+			smp_store_release(&site->hash, hash);
+		}
+		if (site->hash == hash && !memcmp(site->ip, ip, sizeof(ip))) {
+			stat->cur_site = n;
+			break;
+		}
+	}
+}
+
+static inline void nau_regstat_unlock(void *arg)
+{
+	struct nau_regstat *stat = arg;
+
+	this_cpu_inc(stat->cpu->calls);
+	if (!stat->bus_used)
+		this_cpu_inc(stat->cpu->cached);
+	this_cpu_inc(stat->cpu->site_calls[stat->cur_site]);
+	mutex_unlock(&stat->lock);
+}
+
+static inline void nau_regstat_account(struct nau_regstat *stat,
+	unsigned int reg, unsigned int num, bool write, u64 start)
+{
+	u64 ns = ktime_get_ns() - start;
+	unsigned int i, idx;
+
+	for (i = 0; i < num; i++) {
+		idx = min(reg + i, (unsigned int)NAU_REGMAP_NUM);
+		if (write)
+			this_cpu_inc(stat->cpu->writes[idx]);
+		else
+			this_cpu_inc(stat->cpu->reads[idx]);
+	}
+	idx = min(reg, (unsigned int)NAU_REGMAP_NUM);
+	this_cpu_add(stat->cpu->bus_ns[idx], ns);
+	this_cpu_add(stat->cpu->site_ns[stat->cur_site], ns);
+	stat->bus_used = true;
+}
+
+/* The register address of the bus format, big endian */
+static inline unsigned int nau_regstat_reg(struct nau_regstat *stat,
+	const void *reg)
+{
+	const u8 *b = reg;
+
+	return stat->reg_bytes == 2 ? (b[0] << 8) | b[1] : b[0];
+}
+
+static inline int nau_regstat_write(void *context, const void *data,
+	size_t count)
+{
+	struct nau_regstat *stat = context;
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = stat->inner_bus->write(stat->ctx, data, count);
+	nau_regstat_account(stat, nau_regstat_reg(stat, data),
+			    (count - stat->reg_bytes) / stat->val_bytes, true,
+			    start);
+
+	return ret;
+}
+
+static inline int nau_regstat_gather_write(void *context, const void *reg,
+	size_t reg_size, const void *val, size_t val_size)
+{
+	struct nau_regstat *stat = context;
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = stat->inner_bus->gather_write(stat->ctx, reg, reg_size, val,
+					    val_size);
+	nau_regstat_account(stat, nau_regstat_reg(stat, reg),
+			    val_size / stat->val_bytes, true, start);
+
+	return ret;
+}
+
+static inline int nau_regstat_read(void *context, const void *reg,
+	size_t reg_size, void *val, size_t val_size)
+{
+	struct nau_regstat *stat = context;
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = stat->inner_bus->read(stat->ctx, reg, reg_size, val, val_size);
+	nau_regstat_account(stat, nau_regstat_reg(stat, reg),
+			    val_size / stat->val_bytes, false, start);
+
+	return ret;
+}
+
+static inline int nau_regstat_reg_read(void *context, unsigned int reg,
+	unsigned int *val)
+{
+	struct nau_regstat *stat = context;
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = stat->reg_read(stat->ctx, reg, val);
+	nau_regstat_account(stat, reg, 1, false, start);
+
+	return ret;
+}
+
+static inline int nau_regstat_reg_write(void *context, unsigned int reg,
+	unsigned int val)
+{
+	struct nau_regstat *stat = context;
+	u64 start = ktime_get_ns();
+	int ret;
+
+	ret = stat->reg_write(stat->ctx, reg, val);
+	nau_regstat_account(stat, reg, 1, true, start);
+
+	return ret;
+}
+
+/* The plain I2C transfers of regmap, for the codecs on the I2C bus of
+ * regmap. The adapters of SMBus only aren't supported.
+ */
+static inline int nau_regstat_i2c_write(void *context, const void *data,
+	size_t count)
+{
+	struct i2c_client *i2c = context;
+	int ret;
+
+	ret = i2c_master_send(i2c, data, count);
+	if (ret == count)
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
+static inline int nau_regstat_i2c_read(void *context, const void *reg,
+	size_t reg_size, void *val, size_t val_size)
+{
+	struct i2c_client *i2c = context;
+	struct i2c_msg xfer[2] = {
+		{ .addr = i2c->addr, .len = reg_size, .buf = (void *)reg },
+		{ .addr = i2c->addr, .flags = I2C_M_RD, .len = val_size,
+		  .buf = val },
+	};
+	int ret;
+
+	ret = i2c_transfer(i2c->adapter, xfer, 2);
+	if (ret == 2)
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
+static const struct regmap_bus nau_regstat_i2c_bus = {
+	.write = nau_regstat_i2c_write,
+	.read = nau_regstat_i2c_read,
+};
+
+/**
+ * nau_regstat_regmap_init - initialize a regmap counted by the statistics
+ * @dev: device of the codec
+ * @bus: bus of the regmap, NULL for the register access of @config
+ * @ctx: context of @bus or of the register access
+ * @config: configuration of the regmap, without lock of its own
+ * @stat: statistics, living as long as @dev
+ *
+ * Return: the regmap, or an error pointer.
+ */
+static inline struct regmap *nau_regstat_regmap_init(struct device *dev,
+	const struct regmap_bus *bus, void *ctx,
+	const struct regmap_config *config, struct nau_regstat *stat)
+{
+	stat->cpu = devm_alloc_percpu(dev, struct nau_regstat_cpu);
+	if (!stat->cpu)
+		return ERR_PTR(-ENOMEM);
+
+	mutex_init(&stat->lock);
+	stat->config = *config;
+	stat->config.lock = nau_regstat_lock;
+	stat->config.unlock = nau_regstat_unlock;
+	stat->config.lock_arg = stat;
+	stat->ctx = ctx;
+	stat->reg_bytes = DIV_ROUND_UP(config->reg_bits, 8);
+	stat->val_bytes = DIV_ROUND_UP(config->val_bits, 8);
+	stat->cur_site = NAU_REGSTAT_SITES;
+	if (bus) {
+		stat->inner_bus = bus;
+		stat->bus = *bus;
+		stat->bus.write = nau_regstat_write;
+		stat->bus.gather_write = bus->gather_write ?
+			nau_regstat_gather_write : NULL;
+		stat->bus.read = nau_regstat_read;
+		bus = &stat->bus;
+	} else {
+		stat->reg_read = config->reg_read;
+		stat->reg_write = config->reg_write;
+		if (config->reg_read)
+			stat->config.reg_read = nau_regstat_reg_read;
+		if (config->reg_write)
+			stat->config.reg_write = nau_regstat_reg_write;
+	}
+
+	return devm_regmap_init(dev, bus, stat, &stat->config);
+}
+
+static inline struct regmap *nau_regstat_regmap_init_i2c(
+	struct i2c_client *i2c, const struct regmap_config *config,
+	struct nau_regstat *stat)
+{
+	return nau_regstat_regmap_init(&i2c->dev, &nau_regstat_i2c_bus, i2c,
+				       config, stat);
+}
+
+/* The function of the call site, the first out of regmap */
+static inline unsigned long nau_regstat_caller(struct nau_regstat_site *site)
+{
+	static const char * const skip[] = {
+		"regmap", "_regmap", "regcache", "snd_soc_component",
+	};
+	char sym[KSYM_SYMBOL_LEN];
+	int i, j;
+
+	for (i = 0; i < NAU_REGSTAT_DEPTH && site->ip[i]; i++) {
+		sprint_symbol_no_offset(sym, site->ip[i]);
+		for (j = 0; j < ARRAY_SIZE(skip); j++)
+			if (strstarts(sym, skip[j]))
+				break;
+		if (j == ARRAY_SIZE(skip))
+			return site->ip[i];
+	}
+
+	return site->ip[0];
+}
+
+static inline int nau_regstat_show(struct seq_file *s, void *data)
+{
+	struct nau_regstat *stat = s->private;
+	struct nau_regstat_cpu *sum, *cpu;
+	u8 order[NAU_REGSTAT_SITES + 1];
+	int c, i, j, n = 0;
+
+	sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+	if (!sum)
+		return -ENOMEM;
+
+	for_each_possible_cpu(c) {
+		cpu = per_cpu_ptr(stat->cpu, c);
+		for (i = 0; i < NAU_REGSTAT_REGS; i++) {
+			sum->reads[i] += cpu->reads[i];
+			sum->writes[i] += cpu->writes[i];
+			sum->bus_ns[i] += cpu->bus_ns[i];
+		}
+		sum->calls += cpu->calls;
+		sum->cached += cpu->cached;
+		for (i = 0; i <= NAU_REGSTAT_SITES; i++) {
+			sum->site_calls[i] += cpu->site_calls[i];
+			sum->site_ns[i] += cpu->site_ns[i];
+		}
+	}
+
+	seq_printf(s, "calls %llu cached %llu (%llu%%)\n", sum->calls,
+		   sum->cached, sum->calls ?
+		   div64_u64(sum->cached * 100, sum->calls) : 0);
+	seq_puts(s, "reg\treads\twrites\tbus_us\n");
+	for (i = 0; i < NAU_REGSTAT_REGS; i++) {
+		if (!sum->reads[i] && !sum->writes[i])
+			continue;
+		seq_printf(s, "%s0x%02x\t%llu\t%llu\t%llu\n",
+			   i == NAU_REGMAP_NUM ? ">=" : "", i, sum->reads[i],
+			   sum->writes[i], div_u64(sum->bus_ns[i], 1000));
+	}
+
+	/* the call sites by bus time */
+	for (i = 0; i <= NAU_REGSTAT_SITES; i++) {
+		if (!sum->site_calls[i])
+			continue;
+		for (j = n++; j > 0 && sum->site_ns[order[j - 1]] <
+		     sum->site_ns[i]; j--)
+			order[j] = order[j - 1];
+		order[j] = i;
+	}
+	seq_puts(s, "site\tcalls\tbus_us\n");
+	for (j = 0; j < n; j++) {
+		i = order[j];
+		if (i < NAU_REGSTAT_SITES &&
+		    smp_load_acquire(&stat->site[i].hash))
+			seq_printf(s, "%ps", (void *)nau_regstat_caller(
+				   &stat->site[i]));
+		else
+			seq_puts(s, "others");
+		seq_printf(s, "\t%llu\t%llu\n", sum->site_calls[i],
+			   div_u64(sum->site_ns[i], 1000));
+	}
+	kfree(sum);
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nau_regstat);
+
+static inline void nau_regstat_debugfs_init(struct dentry *root,
+	struct nau_regstat *stat)
+{
+	if (!root)
+		return;
+
+	debugfs_create_file("regstat", 0444, root, stat, &nau_regstat_fops);
+}
+#else
+struct nau_regstat {
+};
+
+static inline struct regmap *nau_regstat_regmap_init(struct device *dev,
+	const struct regmap_bus *bus, void *ctx,
+	const struct regmap_config *config, struct nau_regstat *stat)
+{
+	return devm_regmap_init(dev, bus, ctx, config);
+}
+
+static inline struct regmap *nau_regstat_regmap_init_i2c(
+	struct i2c_client *i2c, const struct regmap_config *config,
+	struct nau_regstat *stat)
+{
+	return devm_regmap_init_i2c(i2c, config);
+}
+
+static inline void nau_regstat_debugfs_init(struct dentry *root,
+	struct nau_regstat *stat)
+{
+}
+#endif
+
+#endif /* __NAU_REGMAP_H__ */
@@ -12,11 +12,16 @@
 #include <linux/delay.h>
 #include <linux/pm.h>
 #include <linux/i2c.h>
+#include <linux/debugfs.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/property.h>
 #include <linux/regmap.h>
 #include <linux/regulator/consumer.h>
 #include <linux/spi/spi.h>
 #include <linux/slab.h>
 #include <linux/of_device.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -24,6 +29,12 @@
 #include <sound/soc-dapm.h>
 #include <sound/initval.h>
 #include <sound/tlv.h>
+#include "nau-delay.h"
+#include "nau-hwparams.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-regmap.h"
+#include "nau-fll.h"
 #include "nau8540.h"
 
 
@@ -35,7 +46,7 @@
 #define CLK_ADC_MAX 6144000
 
 /* scaling for mclk from sysclk_src output */
-static const struct nau8540_fll_attr mclk_src_scaling[] = {
+static const struct nau_fll_attr mclk_src_scaling[] = {
 	{ 1, 0x0 },
 	{ 2, 0x2 },
 	{ 4, 0x3 },
@@ -49,7 +60,7 @@ static const struct nau8540_fll_attr mclk_src_scaling[] = {
 };
 
 /* ratio for input clk freq */
-static const struct nau8540_fll_attr fll_ratio[] = {
+static const struct nau_fll_attr fll_ratio[] = {
 	{ 512000, 0x01 },
 	{ 256000, 0x02 },
 	{ 128000, 0x04 },
@@ -59,13 +70,25 @@ static const struct nau8540_fll_attr fll_ratio[] = {
 	{ 4000, 0x40 },
 };
 
-static const struct nau8540_fll_attr fll_pre_scalar[] = {
+static const struct nau_fll_attr fll_pre_scalar[] = {
 	{ 1, 0x0 },
 	{ 2, 0x1 },
 	{ 4, 0x2 },
 	{ 8, 0x3 },
 };
 
+static const struct nau_fll_desc nau8540_fll_desc = {
+	.mclk_src = mclk_src_scaling,
+	.num_mclk_src = ARRAY_SIZE(mclk_src_scaling),
+	.ratio = fll_ratio,
+	.num_ratio = ARRAY_SIZE(fll_ratio),
+	.pre_scalar = fll_pre_scalar,
+	.num_pre_scalar = ARRAY_SIZE(fll_pre_scalar),
+	.fref_max = NAU_FREF_MAX,
+	.fvco_min = NAU_FVCO_MIN,
+	.fvco_max = NAU_FVCO_MAX,
+};
+
 /* over sampling rate */
 static const struct nau8540_osr_attr osr_adc_sel[] = {
 	{ 32, 3 },	/* OSR 32, SRC 1/8 */
@@ -74,6 +97,11 @@ static const struct nau8540_osr_attr osr_adc_sel[] = {
 	{ 256, 0 },	/* OSR 256, SRC 1 */
 };
 
+/* The group delay of the ADC filters, by their design. The ALC only sets
+ * the gain and the TDM only places the slots, so neither adds frames.
+ */
+static const struct nau_delay_filter nau8540_adc_filter = { 13, 96 };
+
 static const struct reg_default nau8540_reg_defaults[] = {
 	{NAU8540_REG_POWER_MANAGEMENT, 0x0000},
 	{NAU8540_REG_CLOCK_CTRL, 0x0000},
@@ -128,57 +156,297 @@ static const struct reg_default nau8540_reg_defaults[] = {
 	{NAU8540_REG_PWR, 0x0000},
 };
 
+#define NAU8540_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8540_REG_POWER_MANAGEMENT, NAU8540_REG_FLL_VCO_RSV) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_PCM_CTRL0, NAU8540_REG_PCM_CTRL4) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_ALC_CONTROL_1, NAU8540_REG_ALC_CONTROL_5) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_ALC_GAIN_CH12, NAU8540_REG_ADC_SAMPLE_RATE) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_DIGITAL_GAIN_CH1, NAU8540_REG_DIGITAL_MUX) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_P2P_CH1, NAU8540_REG_I2C_CTRL) |	\
+	NAU_REG(w, NAU8540_REG_I2C_DEVICE_ID) |				\
+	NAU_REG_RANGE(w, NAU8540_REG_VMID_CTRL, NAU8540_REG_MUTE) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_ANALOG_ADC1, NAU8540_REG_PWR))
+
+static const u32 nau8540_readable_map[] = NAU_REGMAP(NAU8540_READABLE_REGS);
+
 static bool nau8540_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8540_REG_POWER_MANAGEMENT ... NAU8540_REG_FLL_VCO_RSV:
-	case NAU8540_REG_PCM_CTRL0 ... NAU8540_REG_PCM_CTRL4:
-	case NAU8540_REG_ALC_CONTROL_1 ... NAU8540_REG_ALC_CONTROL_5:
-	case NAU8540_REG_ALC_GAIN_CH12 ... NAU8540_REG_ADC_SAMPLE_RATE:
-	case NAU8540_REG_DIGITAL_GAIN_CH1 ... NAU8540_REG_DIGITAL_MUX:
-	case NAU8540_REG_P2P_CH1 ... NAU8540_REG_I2C_CTRL:
-	case NAU8540_REG_I2C_DEVICE_ID:
-	case NAU8540_REG_VMID_CTRL ... NAU8540_REG_MUTE:
-	case NAU8540_REG_ANALOG_ADC1 ... NAU8540_REG_PWR:
-		return true;
-	default:
-		return false;
+	return nau_regmap_access(nau8540_readable_map, reg);
+}
+
+#define NAU8540_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8540_REG_SW_RESET, NAU8540_REG_FLL_VCO_RSV) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_PCM_CTRL0, NAU8540_REG_PCM_CTRL4) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_ALC_CONTROL_1, NAU8540_REG_ALC_CONTROL_5) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_NOTCH_FIL1_CH1, NAU8540_REG_ADC_SAMPLE_RATE) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_DIGITAL_GAIN_CH1, NAU8540_REG_DIGITAL_MUX) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_GPIO_CTRL, NAU8540_REG_I2C_CTRL) |	\
+	NAU_REG(w, NAU8540_REG_RST) |					\
+	NAU_REG_RANGE(w, NAU8540_REG_VMID_CTRL, NAU8540_REG_MUTE) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_ANALOG_ADC1, NAU8540_REG_PWR))
+
+static const u32 nau8540_writeable_map[] = NAU_REGMAP(NAU8540_WRITEABLE_REGS);
+
+static bool nau8540_writeable_reg(struct device *dev, unsigned int reg)
+{
+	return nau_regmap_access(nau8540_writeable_map, reg);
+}
+
+#define NAU8540_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8540_REG_SW_RESET) |				\
+	NAU_REG_RANGE(w, NAU8540_REG_ALC_GAIN_CH12, NAU8540_REG_ALC_STATUS) |	\
+	NAU_REG_RANGE(w, NAU8540_REG_P2P_CH1, NAU8540_REG_PEAK_CH4) |	\
+	NAU_REG(w, NAU8540_REG_I2C_DEVICE_ID) |				\
+	NAU_REG(w, NAU8540_REG_RST))
+
+static const u32 nau8540_volatile_map[] = NAU_REGMAP(NAU8540_VOLATILE_REGS);
+
+static bool nau8540_volatile_reg(struct device *dev, unsigned int reg)
+{
+	return nau_regmap_access(nau8540_volatile_map, reg);
+}
+
+
+/* the widgets of the capture path held powered in the standby-armed mode */
+static const char * const nau8540_armed_pins[] = {
+	"MICBIAS1", "MICBIAS2",
+	"Frontend PGA1", "Frontend PGA2", "Frontend PGA3", "Frontend PGA4",
+	"Precharge1", "Precharge2", "Precharge3", "Precharge4",
+	"ADC CH1", "ADC CH2", "ADC CH3", "ADC CH4",
+};
+
+/* Apply the standby-armed mode. The precharge and the ADC power-up run
+ * here, out of the capture start, and the pins stay forced afterwards.
+ * A forced pin is released by disabling and enabling it again.
+ */
+static void nau8540_standby_arm(struct nau8540 *nau8540, bool arm)
+{
+	struct snd_soc_dapm_context *dapm = nau8540->dapm;
+	int i;
+
+	mutex_lock(&dapm->card->dapm_mutex);
+	if (arm == nau8540->armed)
+		goto out;
+	for (i = 0; i < ARRAY_SIZE(nau8540_armed_pins); i++) {
+		if (arm) {
+			snd_soc_dapm_force_enable_pin_unlocked(dapm,
+				nau8540_armed_pins[i]);
+		} else {
+			snd_soc_dapm_disable_pin_unlocked(dapm,
+				nau8540_armed_pins[i]);
+			snd_soc_dapm_enable_pin_unlocked(dapm,
+				nau8540_armed_pins[i]);
+		}
 	}
+	/* the idle capture path is held muted */
+	if (arm && !nau8540->capture_on)
+		regmap_update_bits(nau8540->regmap, NAU8540_REG_MUTE,
+				   NAU8540_PGA_CH_ALL_MUTE, NAU8540_PGA_CH_ALL_MUTE);
+	snd_soc_dapm_sync_unlocked(dapm);
+	nau8540->armed = arm;
+out:
+	mutex_unlock(&dapm->card->dapm_mutex);
+}
+
+static void nau8540_arm_work(struct work_struct *work)
+{
+	struct nau8540 *nau8540 = container_of(work, struct nau8540, arm_work);
 
+	nau8540_standby_arm(nau8540, nau8540->standby_armed);
 }
 
-static bool nau8540_writeable_reg(struct device *dev, unsigned int reg)
+static int nau8540_standby_armed_get(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
 {
-	switch (reg) {
-	case NAU8540_REG_SW_RESET ... NAU8540_REG_FLL_VCO_RSV:
-	case NAU8540_REG_PCM_CTRL0 ... NAU8540_REG_PCM_CTRL4:
-	case NAU8540_REG_ALC_CONTROL_1 ... NAU8540_REG_ALC_CONTROL_5:
-	case NAU8540_REG_NOTCH_FIL1_CH1 ... NAU8540_REG_ADC_SAMPLE_RATE:
-	case NAU8540_REG_DIGITAL_GAIN_CH1 ... NAU8540_REG_DIGITAL_MUX:
-	case NAU8540_REG_GPIO_CTRL ... NAU8540_REG_I2C_CTRL:
-	case NAU8540_REG_RST:
-	case NAU8540_REG_VMID_CTRL ... NAU8540_REG_MUTE:
-	case NAU8540_REG_ANALOG_ADC1 ... NAU8540_REG_PWR:
-		return true;
-	default:
-		return false;
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8540->standby_armed;
+
+	return 0;
+}
+
+/* Trade the standby power of the capture path for its start latency */
+static int nau8540_standby_armed_put(struct snd_kcontrol *kcontrol,
+				     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	bool arm = !!ucontrol->value.integer.value[0];
+
+	if (nau8540->standby_armed == arm)
+		return 0;
+	nau8540->standby_armed = arm;
+	schedule_work(&nau8540->arm_work);
+
+	return 1;
+}
+
+/* the peak data of the ADC channels, in the order of ANALOG_PWR bits */
+static const unsigned int nau8540_peak_regs[] = {
+	NAU8540_REG_PEAK_CH1, NAU8540_REG_PEAK_CH2,
+	NAU8540_REG_PEAK_CH3, NAU8540_REG_PEAK_CH4,
+};
+
+/* The AGC clock stays on for the peak meter or an ALC profile, off
+ * otherwise, and the ALC runs on the channels of the profile. Called with
+ * the ALC lock held.
+ */
+static void nau8540_agc_restore(struct nau8540 *nau8540)
+{
+	struct nau8540_alc *alc = &nau8540->alc;
+	bool alc_on = alc->profile != NAU8540_ALC_OFF;
+	unsigned int pwr;
+
+	/* the ALC of a channel powered down stays off */
+	regmap_read(nau8540->regmap, NAU8540_REG_ANALOG_PWR, &pwr);
+	pwr &= alc->channels;
+	regmap_update_bits(nau8540->regmap, NAU8540_REG_CLOCK_CTRL,
+			   NAU8540_CLK_AGC_EN, nau8540->meter.on || alc_on ?
+			   NAU8540_CLK_AGC_EN : 0);
+	regmap_update_bits(nau8540->regmap, NAU8540_REG_ALC_CONTROL_3,
+			   NAU8540_ALC_CH_ALL_EN, alc_on ?
+			   pwr << NAU8540_ALC_CH_EN_SFT : 0);
+}
+
+/* Switch the profile with the ALC of all channels off, then turn it on
+ * for the channels together in one write.
+ */
+static void nau8540_alc_apply(struct nau8540 *nau8540, int profile)
+{
+	struct regmap *regmap = nau8540->regmap;
+	const u32 *regs = nau8540->alc.regs[profile];
+	int i;
+
+	regmap_update_bits(regmap, NAU8540_REG_ALC_CONTROL_3,
+			   NAU8540_ALC_CH_ALL_EN, 0);
+	for (i = 0; i < NAU8540_ALC_REGS; i++) {
+		if (NAU8540_REG_ALC_CONTROL_1 + i == NAU8540_REG_ALC_CONTROL_3)
+			regmap_update_bits(regmap, NAU8540_REG_ALC_CONTROL_3,
+					   ~NAU8540_ALC_CH_ALL_EN & 0xffff,
+					   regs[i]);
+		else
+			regmap_write(regmap, NAU8540_REG_ALC_CONTROL_1 + i,
+				     regs[i]);
 	}
+	nau8540->alc.profile = profile;
+	nau8540_agc_restore(nau8540);
 }
 
-static bool nau8540_volatile_reg(struct device *dev, unsigned int reg)
+static const char * const nau8540_alc_profiles[NAU8540_ALC_NUM] = {
+	"Off", "Near Field", "Far Field"};
+
+static const struct soc_enum nau8540_alc_profile_enum =
+	SOC_ENUM_SINGLE_EXT(NAU8540_ALC_NUM, nau8540_alc_profiles);
+
+static int nau8540_alc_profile_get(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
 {
-	switch (reg) {
-	case NAU8540_REG_SW_RESET:
-	case NAU8540_REG_ALC_GAIN_CH12 ... NAU8540_REG_ALC_STATUS:
-	case NAU8540_REG_P2P_CH1 ... NAU8540_REG_PEAK_CH4:
-	case NAU8540_REG_I2C_DEVICE_ID:
-	case NAU8540_REG_RST:
-		return true;
-	default:
-		return false;
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8540->alc.profile;
+
+	return 0;
+}
+
+static int nau8540_alc_profile_put(struct snd_kcontrol *kcontrol,
+				   struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	unsigned int profile = ucontrol->value.enumerated.item[0];
+	int ret = 0;
+
+	if (profile >= NAU8540_ALC_NUM)
+		return -EINVAL;
+
+	mutex_lock(&nau8540->alc.lock);
+	if (profile != nau8540->alc.profile) {
+		nau8540_alc_apply(nau8540, profile);
+		ret = 1;
+	}
+	mutex_unlock(&nau8540->alc.lock);
+
+	return ret;
+}
+
+static int nau8540_meter_switch_get(struct snd_kcontrol *kcontrol,
+				    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8540->meter.on;
+
+	return 0;
+}
+
+static int nau8540_meter_switch_put(struct snd_kcontrol *kcontrol,
+				    struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	struct nau8540_meter *meter = &nau8540->meter;
+	bool on = !!ucontrol->value.integer.value[0];
+
+	mutex_lock(&nau8540->alc.lock);
+	if (meter->on == on) {
+		mutex_unlock(&nau8540->alc.lock);
+		return 0;
 	}
+	mutex_lock(&meter->lock);
+	meter->on = on;
+	memset(meter->peak, 0, sizeof(meter->peak));
+	meter->next = jiffies;
+	mutex_unlock(&meter->lock);
+	nau8540_agc_restore(nau8540);
+	mutex_unlock(&nau8540->alc.lock);
+
+	return 1;
+}
+
+static int nau8540_meter_info(struct snd_kcontrol *kcontrol,
+			      struct snd_ctl_elem_info *uinfo)
+{
+	uinfo->type = SNDRV_CTL_ELEM_TYPE_INTEGER;
+	uinfo->count = NAU8540_METER_CHANNELS;
+	uinfo->value.integer.min = 0;
+	uinfo->value.integer.max = NAU8540_PEAK_MAX;
+
+	return 0;
 }
 
+/* The peaks of the last sample; a read within the period of the sample
+ * takes them without any bus access. Nothing is sampled while the meter
+ * is off or the chip is suspended, and the last peaks are kept.
+ */
+static int nau8540_meter_get(struct snd_kcontrol *kcontrol,
+			     struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	struct nau8540_meter *meter = &nau8540->meter;
+	unsigned int val;
+	int i;
+
+	mutex_lock(&meter->lock);
+	if (meter->on && time_after_eq(jiffies, meter->next)) {
+		for (i = 0; i < NAU8540_METER_CHANNELS; i++) {
+			if (regmap_read(nau8540->regmap,
+					nau8540_peak_regs[i], &val))
+				break;
+			meter->peak[i] = val & NAU8540_PEAK_MAX;
+		}
+		meter->next = jiffies +
+			msecs_to_jiffies(NAU8540_METER_PERIOD_MS);
+	}
+	for (i = 0; i < NAU8540_METER_CHANNELS; i++)
+		ucontrol->value.integer.value[i] = meter->peak[i];
+	mutex_unlock(&meter->lock);
+
+	return 0;
+}
 
 static const DECLARE_TLV_DB_MINMAX(adc_vol_tlv, -12800, 3600);
 static const DECLARE_TLV_DB_MINMAX(fepga_gain_tlv, -100, 3600);
@@ -201,6 +469,22 @@ static const struct snd_kcontrol_new nau8540_snd_controls[] = {
 		0, 0x25, 0, fepga_gain_tlv),
 	SOC_SINGLE_TLV("Frontend PGA4 Volume", NAU8540_REG_FEPGA4,
 		8, 0x25, 0, fepga_gain_tlv),
+
+	SOC_SINGLE_BOOL_EXT("Standby Armed Switch", 0,
+			    nau8540_standby_armed_get, nau8540_standby_armed_put),
+
+	SOC_SINGLE_BOOL_EXT("Peak Meter Switch", 0,
+			    nau8540_meter_switch_get, nau8540_meter_switch_put),
+	SOC_ENUM_EXT("ALC Profile", nau8540_alc_profile_enum,
+		     nau8540_alc_profile_get, nau8540_alc_profile_put),
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "Peak Meter",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ |
+			  SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = nau8540_meter_info,
+		.get = nau8540_meter_get,
+	},
 };
 
 static const char * const adc_channel[] = {
@@ -230,6 +514,169 @@ static SOC_ENUM_SINGLE_DECL(
 static const struct snd_kcontrol_new digital_ch1_mux =
 	SOC_DAPM_ENUM("Digital CH1 Select", digital_ch1_enum);
 
+static LIST_HEAD(nau8540_groups);
+static DEFINE_MUTEX(nau8540_group_lock);
+
+/* Join the TDM group of the id, and take the place of the address. */
+static int nau8540_group_join(struct nau8540 *nau8540, u32 id)
+{
+	struct nau8540_group *group;
+	int i, ret = 0;
+
+	mutex_lock(&nau8540_group_lock);
+	list_for_each_entry(group, &nau8540_groups, node)
+		if (group->id == id)
+			goto found;
+	group = kzalloc(sizeof(*group), GFP_KERNEL);
+	if (!group) {
+		ret = -ENOMEM;
+		goto out;
+	}
+	group->id = id;
+	list_add(&group->node, &nau8540_groups);
+found:
+	if (group->num >= NAU8540_GROUP_MAX) {
+		dev_err(nau8540->dev, "Too many chips in TDM group %u\n", id);
+		ret = -EINVAL;
+		goto out;
+	}
+	for (i = group->num; i > 0; i--) {
+		if (group->members[i - 1]->addr < nau8540->addr)
+			break;
+		group->members[i] = group->members[i - 1];
+	}
+	group->members[i] = nau8540;
+	group->num++;
+	for (i = 0; i < group->num; i++)
+		group->members[i]->group_pos = i;
+	nau8540->group = group;
+out:
+	mutex_unlock(&nau8540_group_lock);
+	return ret;
+}
+
+static void nau8540_group_leave(void *data)
+{
+	struct nau8540 *nau8540 = data;
+	struct nau8540_group *group = nau8540->group;
+	int i;
+
+	mutex_lock(&nau8540_group_lock);
+	for (i = nau8540->group_pos; i < group->num - 1; i++) {
+		group->members[i] = group->members[i + 1];
+		group->members[i]->group_pos = i;
+	}
+	group->num--;
+	if (!group->num) {
+		list_del(&group->node);
+		kfree(group);
+	}
+	nau8540->group = NULL;
+	mutex_unlock(&nau8540_group_lock);
+}
+
+/* Reset the ADC digital of the chip, or of all the chips of its group
+ * back to back which keeps them sample aligned.
+ */
+static void nau8540_group_reset(struct nau8540 *nau8540)
+{
+	struct nau8540_group *group = nau8540->group;
+	int i;
+
+	if (!group) {
+		regmap_write(nau8540->regmap, NAU8540_REG_RST, 0x1);
+		regmap_write(nau8540->regmap, NAU8540_REG_RST, 0);
+		return;
+	}
+
+	mutex_lock(&nau8540_group_lock);
+	for (i = 0; i < group->num; i++)
+		if (group->members[i]->capture_on)
+			regmap_write(group->members[i]->regmap,
+				     NAU8540_REG_RST, 0x1);
+	for (i = 0; i < group->num; i++)
+		if (group->members[i]->capture_on)
+			regmap_write(group->members[i]->regmap,
+				     NAU8540_REG_RST, 0);
+	mutex_unlock(&nau8540_group_lock);
+}
+
+/* Start the capturing chips of the group together, once the ADC of
+ * each one is up. The DAPM sequence of the card powers the chips one
+ * after the other, so the test runs after each of them.
+ */
+static void nau8540_group_start(struct nau8540 *nau8540)
+{
+	struct nau8540_group *group = nau8540->group;
+	unsigned int val, pwr;
+	bool ready = true;
+	int i;
+
+	if (!group)
+		return;
+
+	mutex_lock(&nau8540_group_lock);
+	for (i = 0; i < group->num && ready; i++) {
+		if (!group->members[i]->capture_on)
+			continue;
+		regmap_read(group->members[i]->regmap,
+			    NAU8540_REG_ANALOG_PWR, &pwr);
+		regmap_read(group->members[i]->regmap,
+			    NAU8540_REG_POWER_MANAGEMENT, &val);
+		pwr &= NAU8540_ADC_ALL_EN;
+		ready = (val & pwr) == pwr;
+	}
+	mutex_unlock(&nau8540_group_lock);
+	if (ready)
+		nau8540_group_reset(nau8540);
+}
+
+/* Precharge the chips of the group at once. The frontend PGAs of the
+ * card are all up before the first precharge, so the chips going up
+ * are known, and the next chips find their precharge done.
+ */
+static void nau8540_group_precharge(struct nau8540 *nau8540)
+{
+	struct nau8540_group *group = nau8540->group;
+	struct nau8540 *members[NAU8540_GROUP_MAX];
+	unsigned int val;
+	int i, num = 0;
+	ktime_t start;
+
+	if (nau8540->precharged)
+		return;
+
+	start = ktime_get();
+
+	if (group) {
+		mutex_lock(&nau8540_group_lock);
+		for (i = 0; i < group->num; i++) {
+			if (group->members[i]->precharged)
+				continue;
+			regmap_read(group->members[i]->regmap,
+				    NAU8540_REG_PWR, &val);
+			if (val & NAU8540_PWR_FEPGA_ALL)
+				members[num++] = group->members[i];
+		}
+		mutex_unlock(&nau8540_group_lock);
+	} else {
+		members[num++] = nau8540;
+	}
+
+	for (i = 0; i < num; i++)
+		regmap_update_bits(members[i]->regmap, NAU8540_REG_REFERENCE,
+				   NAU8540_DISCHRG_EN, NAU8540_DISCHRG_EN);
+	msleep(40);
+	for (i = 0; i < num; i++) {
+		regmap_update_bits(members[i]->regmap, NAU8540_REG_REFERENCE,
+				   NAU8540_DISCHRG_EN, 0);
+		regmap_update_bits(members[i]->regmap, NAU8540_REG_FEPGA2,
+				   NAU8540_ACDC_CTL_MASK, 0);
+		members[i]->precharged = true;
+	}
+	nau_latency_add(&nau8540->latency[NAU8540_LAT_PRECHARGE], start);
+}
+
 static int nau8540_fepga_event(struct snd_soc_dapm_widget *w,
 			       struct snd_kcontrol *k, int event)
 {
@@ -238,6 +685,9 @@ static int nau8540_fepga_event(struct snd_soc_dapm_widget *w,
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
+		/* a channel joining the ones running keeps their inputs */
+		if (nau8540->precharged)
+			break;
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_FEPGA2,
 				   NAU8540_ACDC_CTL_MASK, NAU8540_ACDC_CTL_MIC1P_VREF |
 				   NAU8540_ACDC_CTL_MIC1N_VREF | NAU8540_ACDC_CTL_MIC2P_VREF |
@@ -257,15 +707,15 @@ static int nau8540_precharge_event(struct snd_soc_dapm_widget *w,
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 
+	/* each channel has its own, but the precharge is of the chip */
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
-		regmap_update_bits(nau8540->regmap, NAU8540_REG_REFERENCE,
-				   NAU8540_DISCHRG_EN, NAU8540_DISCHRG_EN);
-		msleep(40);
-		regmap_update_bits(nau8540->regmap, NAU8540_REG_REFERENCE,
-				   NAU8540_DISCHRG_EN, 0);
-		regmap_update_bits(nau8540->regmap, NAU8540_REG_FEPGA2,
-				   NAU8540_ACDC_CTL_MASK, 0);
+		nau8540->precharge_users++;
+		nau8540_group_precharge(nau8540);
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		if (!--nau8540->precharge_users)
+			nau8540->precharged = false;
 		break;
 	default:
 		break;
@@ -279,23 +729,38 @@ static int adc_power_control(struct snd_soc_dapm_widget *w,
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	unsigned int val, pwr;
+	ktime_t start;
 
 	if (SND_SOC_DAPM_EVENT_ON(event)) {
+		/* the channels powered together settle together */
+		regmap_read(nau8540->regmap, NAU8540_REG_ANALOG_PWR, &pwr);
+		regmap_read(nau8540->regmap, NAU8540_REG_POWER_MANAGEMENT, &val);
+		pwr &= NAU8540_ADC_ALL_EN;
+		if ((val & pwr) == pwr)
+			return 0;
+		start = ktime_get();
 		msleep(160);
 		/* DO12 and DO34 pad output enable */
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_POWER_MANAGEMENT,
-				   NAU8540_ADC_ALL_EN, NAU8540_ADC_ALL_EN);
+				   pwr, pwr);
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL1,
 			NAU8540_I2S_DO12_TRI, 0);
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL2,
 			NAU8540_I2S_DO34_TRI, 0);
+		nau8540_group_start(nau8540);
+		nau_latency_add(&nau8540->latency[NAU8540_LAT_ADC_SETTLE],
+				start);
 	} else if (SND_SOC_DAPM_EVENT_OFF(event)) {
+		regmap_update_bits(nau8540->regmap, NAU8540_REG_POWER_MANAGEMENT,
+				   BIT(w->shift), 0);
+		regmap_read(nau8540->regmap, NAU8540_REG_POWER_MANAGEMENT, &val);
+		if (val & NAU8540_ADC_ALL_EN)
+			return 0;
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL1,
 			NAU8540_I2S_DO12_TRI, NAU8540_I2S_DO12_TRI);
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL2,
 			NAU8540_I2S_DO34_TRI, NAU8540_I2S_DO34_TRI);
-		regmap_update_bits(nau8540->regmap, NAU8540_REG_POWER_MANAGEMENT,
-				   NAU8540_ADC_ALL_EN, 0);
 	}
 	return 0;
 }
@@ -306,9 +771,20 @@ static int aiftx_power_control(struct snd_soc_dapm_widget *w,
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 
-	if (SND_SOC_DAPM_EVENT_OFF(event)) {
+	if (SND_SOC_DAPM_EVENT_ON(event)) {
+		/* the armed capture path only needs the unmute */
+		nau8540->capture_on = true;
+		regmap_update_bits(nau8540->regmap, NAU8540_REG_MUTE,
+				   NAU8540_PGA_CH_ALL_MUTE, 0);
+		nau8540_group_start(nau8540);
+	} else if (SND_SOC_DAPM_EVENT_OFF(event)) {
 		regmap_write(nau8540->regmap, NAU8540_REG_RST, 0x0001);
 		regmap_write(nau8540->regmap, NAU8540_REG_RST, 0x0000);
+		nau8540->capture_on = false;
+		if (nau8540->armed)
+			regmap_update_bits(nau8540->regmap, NAU8540_REG_MUTE,
+					   NAU8540_PGA_CH_ALL_MUTE,
+					   NAU8540_PGA_CH_ALL_MUTE);
 	}
 	return 0;
 }
@@ -331,8 +807,18 @@ static const struct snd_soc_dapm_widget nau8540_dapm_widgets[] = {
 	SND_SOC_DAPM_PGA_S("Frontend PGA4", 0, NAU8540_REG_PWR, 15, 0,
 			   nau8540_fepga_event, SND_SOC_DAPM_POST_PMU),
 
-	SND_SOC_DAPM_PGA_S("Precharge", 1, SND_SOC_NOPM, 0, 0,
-			   nau8540_precharge_event, SND_SOC_DAPM_POST_PMU),
+	SND_SOC_DAPM_PGA_S("Precharge1", 1, SND_SOC_NOPM, 0, 0,
+			   nau8540_precharge_event,
+			   SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+	SND_SOC_DAPM_PGA_S("Precharge2", 1, SND_SOC_NOPM, 0, 0,
+			   nau8540_precharge_event,
+			   SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+	SND_SOC_DAPM_PGA_S("Precharge3", 1, SND_SOC_NOPM, 0, 0,
+			   nau8540_precharge_event,
+			   SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+	SND_SOC_DAPM_PGA_S("Precharge4", 1, SND_SOC_NOPM, 0, 0,
+			   nau8540_precharge_event,
+			   SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
 
 	SND_SOC_DAPM_PGA_S("ADC CH1", 2, NAU8540_REG_ANALOG_PWR, 0, 0,
 			   adc_power_control, SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
@@ -353,7 +839,7 @@ static const struct snd_soc_dapm_widget nau8540_dapm_widgets[] = {
 		SND_SOC_NOPM, 0, 0, &digital_ch1_mux),
 
 	SND_SOC_DAPM_AIF_OUT_E("AIFTX", "Capture", 0, SND_SOC_NOPM, 0, 0,
-		aiftx_power_control, SND_SOC_DAPM_POST_PMD),
+		aiftx_power_control, SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
 };
 
 static const struct snd_soc_dapm_route nau8540_dapm_routes[] = {
@@ -362,15 +848,15 @@ static const struct snd_soc_dapm_route nau8540_dapm_routes[] = {
 	{"Frontend PGA3", NULL, "MIC3"},
 	{"Frontend PGA4", NULL, "MIC4"},
 
-	{"Precharge", NULL, "Frontend PGA1"},
-	{"Precharge", NULL, "Frontend PGA2"},
-	{"Precharge", NULL, "Frontend PGA3"},
-	{"Precharge", NULL, "Frontend PGA4"},
+	{"Precharge1", NULL, "Frontend PGA1"},
+	{"Precharge2", NULL, "Frontend PGA2"},
+	{"Precharge3", NULL, "Frontend PGA3"},
+	{"Precharge4", NULL, "Frontend PGA4"},
 
-	{"ADC CH1", NULL, "Precharge"},
-	{"ADC CH2", NULL, "Precharge"},
-	{"ADC CH3", NULL, "Precharge"},
-	{"ADC CH4", NULL, "Precharge"},
+	{"ADC CH1", NULL, "Precharge1"},
+	{"ADC CH2", NULL, "Precharge2"},
+	{"ADC CH3", NULL, "Precharge3"},
+	{"ADC CH4", NULL, "Precharge4"},
 
 	{"ADC CH1", NULL, "MICBIAS1"},
 	{"ADC CH2", NULL, "MICBIAS1"},
@@ -431,6 +917,46 @@ static int nau8540_dai_startup(struct snd_pcm_substream *substream,
 					    0, CLK_ADC_MAX / osr->osr);
 }
 
+static const char * const nau8540_mic_pins[] = {
+	"MIC1", "MIC2", "MIC3", "MIC4",
+};
+
+/* Power only the channels of the stream. The slots of the chip the stream
+ * takes, from the channel count and the TDM mask, give the ADC channels
+ * through the slot muxes, and the MIC pins of the others are disabled, so
+ * their frontend PGA, precharge and ADC stay down. The muxes are read
+ * here, so a change of theirs applies from the next hw_params.
+ */
+static void nau8540_adc_gate(struct nau8540 *nau8540, unsigned int channels)
+{
+	struct snd_soc_dapm_context *dapm = nau8540->dapm;
+	unsigned int ctrl4, mux, slots = 0, adcs = 0;
+	int i;
+
+	if (channels > nau8540->slot_first)
+		slots = GENMASK(min_t(unsigned int, channels -
+			nau8540->slot_first, NAU8540_GROUP_SLOTS) - 1, 0);
+	regmap_read(nau8540->regmap, NAU8540_REG_PCM_CTRL4, &ctrl4);
+	if (ctrl4 & NAU8540_TDM_MODE)
+		slots &= ctrl4 & NAU8540_TDM_TX_MASK;
+	regmap_read(nau8540->regmap, NAU8540_REG_DIGITAL_MUX, &mux);
+	for (i = 0; i < NAU8540_GROUP_SLOTS; i++)
+		if (slots & BIT(i))
+			adcs |= BIT((mux & NAU8540_DIGMUX_MASK(i)) >>
+				NAU8540_DIGMUX_SFT(i));
+	if (adcs == nau8540->adc_used)
+		return;
+	for (i = 0; i < ARRAY_SIZE(nau8540_mic_pins); i++) {
+		if (adcs & BIT(i))
+			snd_soc_dapm_enable_pin(dapm, nau8540_mic_pins[i]);
+		else
+			snd_soc_dapm_disable_pin(dapm, nau8540_mic_pins[i]);
+	}
+	nau8540->adc_used = adcs;
+	dev_dbg(nau8540->dev, "ADC channels %#x of %u channels\n", adcs,
+		channels);
+}
+
 static int nau8540_hw_params(struct snd_pcm_substream *substream,
 	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
 {
@@ -438,6 +964,8 @@ static int nau8540_hw_params(struct snd_pcm_substream *substream,
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0;
 	const struct nau8540_osr_attr *osr;
+	ktime_t start = ktime_get();
+	int ret;
 
 	/* CLK_ADC = OSR * FS
 	 * ADC clock frequency is defined as Over Sampling Rate (OSR)
@@ -453,7 +981,23 @@ static int nau8540_hw_params(struct snd_pcm_substream *substream,
 	regmap_update_bits(nau8540->regmap, NAU8540_REG_CLOCK_SRC,
 		NAU8540_CLK_ADC_SRC_MASK,
 		osr->clk_src << NAU8540_CLK_ADC_SRC_SFT);
+	nau_delay_set(&nau8540->delay, substream->stream,
+		nau_delay_filter_frames(&nau8540_adc_filter, osr->osr));
+	nau8540_adc_gate(nau8540, params_channels(params));
+	/* the OSR is a control, so its clock source follows it each time */
+	if (nau_hw_params_skip(&nau8540->hw_params_cache, substream->stream,
+		params))
+		return 0;
+	if (nau8540->clk_auto != NAU8540_CLK_DIS) {
+		ret = nau8540_fll_auto(nau8540, params);
+		if (ret)
+			return ret;
+	}
 
+	/* S24_LE has 24 bits of data in a 32-bit slot: the word length is
+	 * the data width, while the BCLK of the auto clocking counts the
+	 * slot of the physical width, unless the TDM slots set their own.
+	 */
 	switch (params_width(params)) {
 	case 16:
 		val_len |= NAU8540_I2S_DL_16;
@@ -473,6 +1017,9 @@ static int nau8540_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL0,
 		NAU8540_I2S_DL_MASK, val_len);
+	nau_hw_params_done(&nau8540->hw_params_cache, substream->stream,
+		params);
+	nau_latency_add(&nau8540->latency[NAU8540_LAT_HW_PARAMS], start);
 
 	return 0;
 }
@@ -524,6 +1071,7 @@ static int nau8540_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 		return -EINVAL;
 	}
 
+	nau_hw_params_reset(&nau8540->hw_params_cache);
 	regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL0,
 		NAU8540_I2S_DL_MASK | NAU8540_I2S_DF_MASK |
 		NAU8540_I2S_BP_INV | NAU8540_I2S_PCMB_EN, ctrl1_val);
@@ -545,7 +1093,9 @@ static int nau8540_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
  * @slots: Number of slots in use.
  * @slot_width: Width in bits for each slot.
  *
- * Configures a DAI for TDM operation. Only support 4 slots TDM.
+ * Configures a DAI for TDM operation. Only support 4 slots TDM. A chip
+ * of a TDM group takes the 4 slots of its place in the group instead
+ * of tx_mask, and slots must cover the whole group.
  */
 static int nau8540_set_tdm_slot(struct snd_soc_dai *dai,
 	unsigned int tx_mask, unsigned int rx_mask, int slots, int slot_width)
@@ -553,17 +1103,31 @@ static int nau8540_set_tdm_slot(struct snd_soc_dai *dai,
 	struct snd_soc_component *component = dai->component;
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 	unsigned int ctrl2_val = 0, ctrl4_val = 0;
+	int slot_first = 0;
 
-	if (slots > 4 || ((tx_mask & 0xf0) && (tx_mask & 0xf)))
-		return -EINVAL;
-
+	nau_hw_params_reset(&nau8540->hw_params_cache);
 	ctrl4_val |= (NAU8540_TDM_MODE | NAU8540_TDM_OFFSET_EN);
-	if (tx_mask & 0xf0) {
+	if (nau8540->group) {
+		/* the slots of a group member follow from its place */
+		if (slots < nau8540->group->num * NAU8540_GROUP_SLOTS)
+			return -EINVAL;
+		slot_first = nau8540->group_pos * NAU8540_GROUP_SLOTS;
+		ctrl2_val = slot_first * slot_width;
+		ctrl4_val |= NAU8540_TDM_TX_MASK;
+		if (ctrl2_val > NAU8540_I2S_TSLOT_L_MASK)
+			return -EINVAL;
+	} else if (slots > 4 || ((tx_mask & 0xf0) && (tx_mask & 0xf))) {
+		return -EINVAL;
+	} else if (tx_mask & 0xf0) {
+		slot_first = 4;
 		ctrl2_val = 4 * slot_width;
 		ctrl4_val |= (tx_mask >> 4);
 	} else {
 		ctrl4_val |= tx_mask;
 	}
+	nau8540->tdm_slots = slots;
+	nau8540->tdm_width = slot_width;
+	nau8540->slot_first = slot_first;
 	regmap_update_bits(nau8540->regmap, NAU8540_REG_PCM_CTRL4,
 		NAU8540_TDM_MODE | NAU8540_TDM_OFFSET_EN |
 		NAU8540_TDM_TX_MASK, ctrl4_val);
@@ -576,53 +1140,135 @@ static int nau8540_set_tdm_slot(struct snd_soc_dai *dai,
 	return 0;
 }
 
-static int nau8540_dai_trigger(struct snd_pcm_substream *substream,
-			       int cmd, struct snd_soc_dai *dai)
+/* Return the mask of the powered channels without peak data. */
+static unsigned int nau8540_stalled_channels(struct nau8540 *nau8540)
+{
+	unsigned int pwr, val, stalled = 0;
+	int i;
+
+	regmap_read(nau8540->regmap, NAU8540_REG_ANALOG_PWR, &pwr);
+	for (i = 0; i < ARRAY_SIZE(nau8540_peak_regs); i++) {
+		if (!(pwr & BIT(i)))
+			continue;
+		regmap_read(nau8540->regmap, nau8540_peak_regs[i], &val);
+		dev_dbg(nau8540->dev, "ADC CH%d peak data %x", i + 1, val);
+		if (!val)
+			stalled |= BIT(i);
+	}
+
+	return stalled;
+}
+
+/* Restart the digital path of the @stalled channels alone, muted, while
+ * the healthy ones keep streaming. A channel takes the same bit in MUTE
+ * and POWER_MANAGEMENT. Returns the channels still stalled.
+ */
+static unsigned int nau8540_channel_reset(struct nau8540 *nau8540,
+					  unsigned int stalled)
 {
-	struct snd_soc_component *component = dai->component;
-	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 	struct regmap *regmap = nau8540->regmap;
-	unsigned int val;
-	int ret = 0;
 
-	/* Reading the peak data to detect abnormal data in the ADC channel.
-	 * If abnormal data happens, the driver takes recovery actions to
-	 * refresh the ADC channel.
+	regmap_update_bits(regmap, NAU8540_REG_MUTE, stalled, stalled);
+	regmap_update_bits(regmap, NAU8540_REG_POWER_MANAGEMENT, stalled, 0);
+	regmap_update_bits(regmap, NAU8540_REG_POWER_MANAGEMENT,
+			   stalled, stalled);
+	regmap_update_bits(regmap, NAU8540_REG_MUTE, stalled, 0);
+
+	return nau8540_stalled_channels(nau8540) & stalled;
+}
+
+/* Reading the peak data to detect abnormal data in the ADC channels.
+ * If abnormal data happens, the driver takes recovery actions to
+ * refresh the ADC channels. It runs after the capture start, out of
+ * the trigger which can be atomic.
+ */
+static void nau8540_health_work(struct work_struct *work)
+{
+	struct nau8540 *nau8540 =
+		container_of(work, struct nau8540, health_work.work);
+	struct regmap *regmap = nau8540->regmap;
+	unsigned int stalled, pwr;
+	ktime_t start;
+	int i;
+
+	/* the ALC of a profile is on again once the check is done, on the
+	 * channels powered
 	 */
-	switch (cmd) {
-	case SNDRV_PCM_TRIGGER_START:
-		regmap_update_bits(regmap, NAU8540_REG_CLOCK_CTRL,
-				   NAU8540_CLK_AGC_EN, NAU8540_CLK_AGC_EN);
-		regmap_update_bits(regmap, NAU8540_REG_ALC_CONTROL_3,
-				   NAU8540_ALC_CH_ALL_EN, NAU8540_ALC_CH_ALL_EN);
-
-		regmap_read(regmap, NAU8540_REG_PEAK_CH1, &val);
-		dev_dbg(nau8540->dev, "1.ADC CH1 peak data %x", val);
-		if (!val) {
+	regmap_read(regmap, NAU8540_REG_ANALOG_PWR, &pwr);
+	regmap_update_bits(regmap, NAU8540_REG_CLOCK_CTRL,
+			   NAU8540_CLK_AGC_EN, NAU8540_CLK_AGC_EN);
+	regmap_update_bits(regmap, NAU8540_REG_ALC_CONTROL_3,
+			   NAU8540_ALC_CH_ALL_EN,
+			   (pwr & NAU8540_ADC_ALL_EN) << NAU8540_ALC_CH_EN_SFT);
+
+	stalled = nau8540_stalled_channels(nau8540);
+	if (stalled) {
+		start = ktime_get();
+		nau8540->recovery_count++;
+		for (i = 0; i < NAU8540_METER_CHANNELS; i++)
+			if (stalled & BIT(i))
+				nau8540->recovery_ch[i]++;
+		stalled = nau8540_channel_reset(nau8540, stalled);
+		if (stalled) {
+			/* the last resort, the whole group is reset to stay
+			 * aligned
+			 */
+			nau8540->recovery_group++;
 			regmap_update_bits(regmap, NAU8540_REG_MUTE,
-					   NAU8540_PGA_CH_ALL_MUTE, NAU8540_PGA_CH_ALL_MUTE);
+					   NAU8540_PGA_CH_ALL_MUTE,
+					   NAU8540_PGA_CH_ALL_MUTE);
 			regmap_update_bits(regmap, NAU8540_REG_MUTE,
 					   NAU8540_PGA_CH_ALL_MUTE, 0);
-			regmap_write(regmap, NAU8540_REG_RST, 0x1);
-			regmap_write(regmap, NAU8540_REG_RST, 0);
-			regmap_read(regmap, NAU8540_REG_PEAK_CH1, &val);
-			dev_dbg(nau8540->dev, "2.ADC CH1 peak data %x", val);
-			if (!val) {
-				dev_err(nau8540->dev, "Channel recovery failed!!");
-				ret = -EIO;
-			}
+			nau8540_group_reset(nau8540);
+			stalled = nau8540_stalled_channels(nau8540);
 		}
-		regmap_update_bits(regmap, NAU8540_REG_CLOCK_CTRL,
-				   NAU8540_CLK_AGC_EN, 0);
-		regmap_update_bits(regmap, NAU8540_REG_ALC_CONTROL_3,
-				   NAU8540_ALC_CH_ALL_EN, 0);
-		break;
+		nau_latency_add(&nau8540->latency[NAU8540_LAT_RECOVERY],
+				start);
+		if (stalled) {
+			nau8540->recovery_fail++;
+			dev_err_ratelimited(nau8540->dev,
+					    "Channel recovery failed: %#x\n",
+					    stalled);
+		}
+	}
 
+	mutex_lock(&nau8540->alc.lock);
+	nau8540_agc_restore(nau8540);
+	mutex_unlock(&nau8540->alc.lock);
+}
+
+static int nau8540_dai_trigger(struct snd_pcm_substream *substream,
+			       int cmd, struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	switch (cmd) {
+	case SNDRV_PCM_TRIGGER_START:
+	case SNDRV_PCM_TRIGGER_RESUME:
+	case SNDRV_PCM_TRIGGER_PAUSE_RELEASE:
+		schedule_delayed_work(&nau8540->health_work,
+			msecs_to_jiffies(NAU8540_HEALTH_DELAY_MS));
+		break;
+	case SNDRV_PCM_TRIGGER_STOP:
+	case SNDRV_PCM_TRIGGER_SUSPEND:
+	case SNDRV_PCM_TRIGGER_PAUSE_PUSH:
+		cancel_delayed_work(&nau8540->health_work);
+		break;
 	default:
 		break;
 	}
 
-	return ret;
+	return 0;
+}
+
+/* The frames the filters hold at the OSR of the stream */
+static snd_pcm_sframes_t nau8540_dai_delay(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(dai->component);
+
+	return nau_delay_get(&nau8540->delay, substream->stream);
 }
 
 static const struct snd_soc_dai_ops nau8540_dai_ops = {
@@ -631,11 +1277,13 @@ static const struct snd_soc_dai_ops nau8540_dai_ops = {
 	.set_fmt = nau8540_set_fmt,
 	.set_tdm_slot = nau8540_set_tdm_slot,
 	.trigger = nau8540_dai_trigger,
+	.delay = nau8540_dai_delay,
 };
 
 #define NAU8540_RATES SNDRV_PCM_RATE_8000_48000
 #define NAU8540_FORMATS (SNDRV_PCM_FMTBIT_S16_LE | SNDRV_PCM_FMTBIT_S20_3LE \
-	 | SNDRV_PCM_FMTBIT_S24_3LE | SNDRV_PCM_FMTBIT_S32_LE)
+	 | SNDRV_PCM_FMTBIT_S24_3LE | SNDRV_PCM_FMTBIT_S24_LE \
+	 | SNDRV_PCM_FMTBIT_S32_LE)
 
 static struct snd_soc_dai_driver nau8540_dai = {
 	.name = "nau8540-hifi",
@@ -649,74 +1297,8 @@ static struct snd_soc_dai_driver nau8540_dai = {
 	.ops = &nau8540_dai_ops,
 };
 
-/**
- * nau8540_calc_fll_param - Calculate FLL parameters.
- * @fll_in: external clock provided to codec.
- * @fs: sampling rate.
- * @fll_param: Pointer to structure of FLL parameters.
- *
- * Calculate FLL parameters to configure codec.
- *
- * Returns 0 for success or negative error code.
- */
-static int nau8540_calc_fll_param(unsigned int fll_in,
-	unsigned int fs, struct nau8540_fll *fll_param)
-{
-	u64 fvco, fvco_max;
-	unsigned int fref, i, fvco_sel;
-
-	/* Ensure the reference clock frequency (FREF) is <= 13.5MHz by dividing
-	 * freq_in by 1, 2, 4, or 8 using FLL pre-scalar.
-	 * FREF = freq_in / NAU8540_FLL_REF_DIV_MASK
-	 */
-	for (i = 0; i < ARRAY_SIZE(fll_pre_scalar); i++) {
-		fref = fll_in / fll_pre_scalar[i].param;
-		if (fref <= NAU_FREF_MAX)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_pre_scalar))
-		return -EINVAL;
-	fll_param->clk_ref_div = fll_pre_scalar[i].val;
-
-	/* Choose the FLL ratio based on FREF */
-	for (i = 0; i < ARRAY_SIZE(fll_ratio); i++) {
-		if (fref >= fll_ratio[i].param)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_ratio))
-		return -EINVAL;
-	fll_param->ratio = fll_ratio[i].val;
-
-	/* Calculate the frequency of DCO (FDCO) given freq_out = 256 * Fs.
-	 * FDCO must be within the 90MHz - 124MHz or the FFL cannot be
-	 * guaranteed across the full range of operation.
-	 * FDCO = freq_out * 2 * mclk_src_scaling
-	 */
-	fvco_max = 0;
-	fvco_sel = ARRAY_SIZE(mclk_src_scaling);
-	for (i = 0; i < ARRAY_SIZE(mclk_src_scaling); i++) {
-		fvco = 256ULL * fs * 2 * mclk_src_scaling[i].param;
-		if (fvco > NAU_FVCO_MIN && fvco < NAU_FVCO_MAX &&
-			fvco_max < fvco) {
-			fvco_max = fvco;
-			fvco_sel = i;
-		}
-	}
-	if (ARRAY_SIZE(mclk_src_scaling) == fvco_sel)
-		return -EINVAL;
-	fll_param->mclk_src = mclk_src_scaling[fvco_sel].val;
-
-	/* Calculate the FLL 10-bit integer input and the FLL 16-bit fractional
-	 * input based on FDCO, FREF and FLL ratio.
-	 */
-	fvco = div_u64(fvco_max << 16, fref * fll_param->ratio);
-	fll_param->fll_int = (fvco >> 16) & 0x3FF;
-	fll_param->fll_frac = fvco & 0xFFFF;
-	return 0;
-}
-
 static void nau8540_fll_apply(struct regmap *regmap,
-	struct nau8540_fll *fll_param)
+	struct nau_fll *fll_param)
 {
 	regmap_update_bits(regmap, NAU8540_REG_CLOCK_SRC,
 		NAU8540_CLK_SRC_MASK | NAU8540_CLK_MCLK_SRC_MASK,
@@ -755,13 +1337,12 @@ static void nau8540_fll_apply(struct regmap *regmap,
 	}
 }
 
-/* freq_out must be 256*Fs in order to achieve the best performance */
-static int nau8540_set_pll(struct snd_soc_component *component, int pll_id, int source,
-		unsigned int freq_in, unsigned int freq_out)
+/* Lock the FLL of @pll_id to @freq_in for the sysclk of 256 * @fs */
+static int nau8540_fll_config(struct nau8540 *nau8540, int pll_id,
+	unsigned int freq_in, unsigned int fs)
 {
-	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
-	struct nau8540_fll fll_param;
-	int ret, fs;
+	struct nau_fll fll_param;
+	int ret;
 
 	switch (pll_id) {
 	case NAU8540_CLK_FLL_MCLK:
@@ -789,10 +1370,10 @@ static int nau8540_set_pll(struct snd_soc_component *component, int pll_id, int
 		return -EINVAL;
 	}
 	dev_dbg(nau8540->dev, "Sysclk is %dHz and clock id is %d\n",
-		freq_out, pll_id);
+		fs * 256, pll_id);
 
-	fs = freq_out / 256;
-	ret = nau8540_calc_fll_param(freq_in, fs, &fll_param);
+	ret = nau_fll_solve(&nau8540_fll_desc, &nau8540->fll_cache, freq_in, fs,
+			    16, &fll_param);
 	if (ret < 0) {
 		dev_err(nau8540->dev, "Unsupported input clock %d\n", freq_in);
 		return ret;
@@ -802,19 +1383,92 @@ static int nau8540_set_pll(struct snd_soc_component *component, int pll_id, int
 		fll_param.fll_int, fll_param.clk_ref_div);
 
 	nau8540_fll_apply(nau8540->regmap, &fll_param);
-	mdelay(2);
+	nau_fll_wait_lock();
 	regmap_update_bits(nau8540->regmap, NAU8540_REG_CLOCK_SRC,
 		NAU8540_CLK_SRC_MASK, NAU8540_CLK_SRC_VCO);
 
 	return 0;
 }
 
+/* freq_out must be 256*Fs in order to achieve the best performance */
+static int nau8540_set_pll(struct snd_soc_component *component, int pll_id, int source,
+		unsigned int freq_in, unsigned int freq_out)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	/* the machine clocks the codec from now on */
+	nau8540->clk_auto = NAU8540_CLK_DIS;
+	nau8540->clk_auto_in = 0;
+
+	return nau8540_fll_config(nau8540, pll_id, freq_in, freq_out / 256);
+}
+
+/* The auto clocking locks the FLL to the BCLK or FS of the stream. The
+ * codec is the slave then, as its BCLK would come from the FLL as master.
+ * The FLL is left alone while the stream keeps the same reference.
+ */
+static int nau8540_fll_auto(struct nau8540 *nau8540,
+	struct snd_pcm_hw_params *params)
+{
+	unsigned int ctrl, freq_in, fs = params_rate(params);
+	int ret;
+
+	regmap_read(nau8540->regmap, NAU8540_REG_PCM_CTRL1, &ctrl);
+	if (ctrl & NAU8540_I2S_MS_MASTER) {
+		dev_err(nau8540->dev, "No FLL auto clocking as master\n");
+		return -EINVAL;
+	}
+	if (nau8540->clk_auto == NAU8540_CLK_FLL_FS)
+		freq_in = fs;
+	else
+		freq_in = snd_soc_tdm_params_to_bclk(params, nau8540->tdm_width,
+			nau8540->tdm_slots, 1);
+	if (freq_in == nau8540->clk_auto_in && fs == nau8540->clk_auto_fs)
+		return 0;
+
+	nau8540->clk_auto_in = 0;
+	ret = nau8540_fll_config(nau8540, nau8540->clk_auto, freq_in, fs);
+	if (ret)
+		return ret;
+	nau8540->clk_auto_in = freq_in;
+	nau8540->clk_auto_fs = fs;
+
+	return 0;
+}
+
+/**
+ * nau8540_mclk_gateable - tell if the codec runs without MCLK
+ * @component: the codec component
+ *
+ * Returns true once the auto clocking has locked the FLL to BCLK or FS,
+ * so the machine driver may gate MCLK during the stream.
+ */
+bool nau8540_mclk_gateable(struct snd_soc_component *component)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	return nau8540->clk_auto != NAU8540_CLK_DIS && nau8540->clk_auto_in;
+}
+EXPORT_SYMBOL_GPL(nau8540_mclk_gateable);
+
 static int nau8540_set_sysclk(struct snd_soc_component *component,
 	int clk_id, int source, unsigned int freq, int dir)
 {
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 
+	nau8540->clk_auto = NAU8540_CLK_DIS;
+	nau8540->clk_auto_in = 0;
 	switch (clk_id) {
+	case NAU8540_CLK_AUTO_BLK:
+		nau8540->clk_auto = NAU8540_CLK_FLL_BLK;
+		nau_hw_params_reset(&nau8540->hw_params_cache);
+		break;
+
+	case NAU8540_CLK_AUTO_FS:
+		nau8540->clk_auto = NAU8540_CLK_FLL_FS;
+		nau_hw_params_reset(&nau8540->hw_params_cache);
+		break;
+
 	case NAU8540_CLK_DIS:
 	case NAU8540_CLK_MCLK:
 		regmap_update_bits(nau8540->regmap, NAU8540_REG_CLOCK_SRC,
@@ -858,7 +1512,7 @@ static void nau8540_init_regs(struct nau8540 *nau8540)
 	regmap_update_bits(regmap, NAU8540_REG_REFERENCE,
 		NAU8540_PRECHARGE_DIS | NAU8540_GLOBAL_BIAS_EN,
 		NAU8540_PRECHARGE_DIS | NAU8540_GLOBAL_BIAS_EN);
-	mdelay(2);
+	usleep_range(2000, 3000);
 	regmap_update_bits(regmap, NAU8540_REG_MIC_BIAS,
 		NAU8540_PU_PRE, NAU8540_PU_PRE);
 	regmap_update_bits(regmap, NAU8540_REG_CLOCK_CTRL,
@@ -882,12 +1536,95 @@ static void nau8540_init_regs(struct nau8540 *nau8540)
 		NAU8540_I2S_DO12_TRI, NAU8540_I2S_DO12_TRI);
 	regmap_update_bits(regmap, NAU8540_REG_PCM_CTRL2,
 		NAU8540_I2S_DO34_TRI, NAU8540_I2S_DO34_TRI);
+	/* ahead of the DAPM muxes, which take their state from it */
+	if (nau8540->slot_mux)
+		regmap_write(regmap, NAU8540_REG_DIGITAL_MUX,
+			nau8540->slot_mux);
+}
+
+static const struct regmap_config nau8540_regmap_config;
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const nau8540_latency_names[NAU8540_LAT_NUM] = {
+	[NAU8540_LAT_HW_PARAMS] = "hw_params",
+	[NAU8540_LAT_PRECHARGE] = "precharge",
+	[NAU8540_LAT_ADC_SETTLE] = "adc_settle",
+	[NAU8540_LAT_RECOVERY] = "recovery",
+};
+
+/* The recovery counters of the channel health check under the debugfs
+ * of the component.
+ */
+static void nau8540_debugfs_init(struct snd_soc_component *component)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+	struct dentry *dir;
+	char name[8];
+	int i;
+
+	if (!component->debugfs_root)
+		return;
+
+	dir = debugfs_create_dir("health", component->debugfs_root);
+	debugfs_create_u32("recovery", 0444, dir, &nau8540->recovery_count);
+	debugfs_create_u32("failed", 0444, dir, &nau8540->recovery_fail);
+	debugfs_create_u32("group", 0444, dir, &nau8540->recovery_group);
+	for (i = 0; i < NAU8540_METER_CHANNELS; i++) {
+		snprintf(name, sizeof(name), "ch%d", i + 1);
+		debugfs_create_u32(name, 0444, dir, &nau8540->recovery_ch[i]);
+	}
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8540->regstat);
+	nau_regcache_debugfs_init(component->debugfs_root, "resume",
+		&nau8540->resume_sync);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+		&nau8540->regcache_report, nau8540->regmap,
+		&nau8540_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8540->latency,
+		nau8540_latency_names, NAU8540_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8540->hw_params_cache);
+	nau_delay_debugfs_init(component->debugfs_root, &nau8540->delay);
+}
+#else
+static inline void nau8540_debugfs_init(struct snd_soc_component *component)
+{
+}
+#endif
+
+static int nau8540_component_probe(struct snd_soc_component *component)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	nau8540->dapm = snd_soc_component_get_dapm(component);
+	nau8540_debugfs_init(component);
+	/* arm the capture path right after probe, out of the probe path */
+	if (nau8540->standby_armed)
+		schedule_work(&nau8540->arm_work);
+	nau_pm_card_link(component);
+
+	return 0;
+}
+
+static void nau8540_component_remove(struct snd_soc_component *component)
+{
+	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
+
+	cancel_work_sync(&nau8540->arm_work);
+	cancel_delayed_work_sync(&nau8540->health_work);
+	nau_pm_card_unlink(component);
 }
 
 static int __maybe_unused nau8540_suspend(struct snd_soc_component *component)
 {
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 
+	nau_hw_params_reset(&nau8540->hw_params_cache);
+	nau8540->clk_auto_in = 0;
+	cancel_delayed_work_sync(&nau8540->health_work);
+	/* release the armed capture path for the suspend */
+	cancel_work_sync(&nau8540->arm_work);
+	nau8540_standby_arm(nau8540, false);
+
 	regcache_cache_only(nau8540->regmap, true);
 	regcache_mark_dirty(nau8540->regmap);
 
@@ -898,13 +1635,23 @@ static int __maybe_unused nau8540_resume(struct snd_soc_component *component)
 {
 	struct nau8540 *nau8540 = snd_soc_component_get_drvdata(component);
 
+	/* the lazy cache has no defaults for regcache_sync() to skip; it is
+	 * read while still in the cache only mode
+	 */
+	nau_regcache_scan(nau8540->regmap, &nau8540_regmap_config,
+			  &nau8540->resume_sync);
 	regcache_cache_only(nau8540->regmap, false);
-	regcache_sync(nau8540->regmap);
+	nau_regcache_sync(nau8540->regmap, &nau8540_regmap_config,
+			  &nau8540->resume_sync);
+	if (nau8540->standby_armed)
+		schedule_work(&nau8540->arm_work);
 
 	return 0;
 }
 
 static const struct snd_soc_component_driver nau8540_component_driver = {
+	.probe			= nau8540_component_probe,
+	.remove			= nau8540_component_remove,
 	.set_sysclk		= nau8540_set_sysclk,
 	.set_pll		= nau8540_set_pll,
 	.suspend		= nau8540_suspend,
@@ -936,11 +1683,73 @@ static const struct regmap_config nau8540_regmap_config = {
 	.num_reg_defaults = ARRAY_SIZE(nau8540_reg_defaults),
 };
 
+static const char * const nau8540_alc_props[NAU8540_ALC_NUM] = {
+	[NAU8540_ALC_NEAR_FIELD] = "nuvoton,alc-near-field",
+	[NAU8540_ALC_FAR_FIELD] = "nuvoton,alc-far-field",
+};
+
+/* the ALC_CONTROL_1 to ALC_CONTROL_5 defaults of the chip */
+static const u32 nau8540_alc_defaults[NAU8540_ALC_REGS] = {
+	0x0000, 0x700B, 0x0022, 0x1010, 0x1010,
+};
+
+/* The profiles missing from the board keep the ALC defaults of the chip */
+static void nau8540_alc_read_props(struct device *dev,
+				   struct nau8540_alc *alc)
+{
+	int i;
+
+	for (i = 0; i < NAU8540_ALC_NUM; i++) {
+		if (nau8540_alc_props[i] &&
+		    !device_property_read_u32_array(dev, nau8540_alc_props[i],
+				alc->regs[i], NAU8540_ALC_REGS))
+			continue;
+		memcpy(alc->regs[i], nau8540_alc_defaults,
+		       sizeof(nau8540_alc_defaults));
+	}
+	if (device_property_read_u32(dev, "nuvoton,alc-channels",
+				     &alc->channels))
+		alc->channels = NAU8540_ADC_ALL_EN;
+	alc->channels &= NAU8540_ADC_ALL_EN;
+	alc->profile = NAU8540_ALC_OFF;
+}
+
+/* The slot map of the board gives the slot of each ADC channel, among the
+ * 4 slots of the chip, so the host gets the channels in the order of the
+ * mic array. The "Digital CHn Select" muxes pick the ADC channel of each
+ * slot, so the map sets them to its inverse.
+ */
+static int nau8540_slot_map_read(struct device *dev, struct nau8540 *nau8540)
+{
+	u32 map[NAU8540_GROUP_SLOTS];
+	unsigned int mux = 0, used = 0;
+	int i;
+
+	if (device_property_read_u32_array(dev, "nuvoton,tdm-slot-map", map,
+					   NAU8540_GROUP_SLOTS))
+		return 0;
+	for (i = 0; i < NAU8540_GROUP_SLOTS; i++) {
+		if (map[i] >= NAU8540_GROUP_SLOTS || used & BIT(map[i])) {
+			dev_err(dev, "Invalid TDM slot map\n");
+			return -EINVAL;
+		}
+		used |= BIT(map[i]);
+		mux |= i << NAU8540_DIGMUX_SFT(map[i]);
+	}
+	nau8540->slot_mux = mux;
+	dev_dbg(dev, "TDM slot map <%u %u %u %u>\n",
+		map[0], map[1], map[2], map[3]);
+
+	return 0;
+}
+
 static int nau8540_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8540 *nau8540 = dev_get_platdata(dev);
+	struct regmap_config regmap_config;
 	int ret, value;
+	u32 group;
 
 	if (!nau8540) {
 		nau8540 = devm_kzalloc(dev, sizeof(*nau8540), GFP_KERNEL);
@@ -949,7 +1758,10 @@ static int nau8540_i2c_probe(struct i2c_client *i2c)
 	}
 	i2c_set_clientdata(i2c, nau8540);
 
-	nau8540->regmap = devm_regmap_init_i2c(i2c, &nau8540_regmap_config);
+	nau_regmap_lazy_config(&regmap_config, &nau8540_regmap_config);
+	nau8540->regcache_report.lazy = true;
+	nau8540->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&regmap_config, &nau8540->regstat);
 	if (IS_ERR(nau8540->regmap))
 		return PTR_ERR(nau8540->regmap);
 	ret = regmap_read(nau8540->regmap, NAU8540_REG_I2C_DEVICE_ID, &value);
@@ -960,8 +1772,37 @@ static int nau8540_i2c_probe(struct i2c_client *i2c)
 	}
 
 	nau8540->dev = dev;
+	nau8540->addr = i2c->addr;
+	/* the MIC pins start enabled */
+	nau8540->adc_used = NAU8540_ADC_ALL_EN;
+	if (!device_property_read_u32(dev, "nuvoton,tdm-group", &group)) {
+		ret = nau8540_group_join(nau8540, group);
+		if (ret)
+			return ret;
+		ret = devm_add_action_or_reset(dev, nau8540_group_leave,
+					       nau8540);
+		if (ret)
+			return ret;
+	}
+	nau8540->standby_armed =
+		device_property_read_bool(dev, "nuvoton,standby-armed");
+	ret = device_property_match_string(dev, "nuvoton,fll-auto-ref", "fs");
+	if (ret >= 0)
+		nau8540->clk_auto = NAU8540_CLK_FLL_FS;
+	else if (device_property_match_string(dev, "nuvoton,fll-auto-ref",
+		"bclk") >= 0)
+		nau8540->clk_auto = NAU8540_CLK_FLL_BLK;
+	INIT_WORK(&nau8540->arm_work, nau8540_arm_work);
+	INIT_DELAYED_WORK(&nau8540->health_work, nau8540_health_work);
+	mutex_init(&nau8540->meter.lock);
+	mutex_init(&nau8540->alc.lock);
+	nau8540_alc_read_props(dev, &nau8540->alc);
+	ret = nau8540_slot_map_read(dev, nau8540);
+	if (ret)
+		return ret;
 	nau8540_reset_chip(nau8540->regmap);
 	nau8540_init_regs(nau8540);
+	nau_pm_async_init(dev);
 
 	return devm_snd_soc_register_component(dev,
 		&nau8540_component_driver, &nau8540_dai, 1);
@@ -985,6 +1826,7 @@ static struct i2c_driver nau8540_i2c_driver = {
 	.driver = {
 		.name = "nau8540",
 		.of_match_table = of_match_ptr(nau8540_of_ids),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8540_i2c_probe,
 	.id_table = nau8540_i2c_ids,
@@ -9,6 +9,16 @@
 #ifndef __NAU8540_H__
 #define __NAU8540_H__
 
+/* the types embedded in struct nau8540, for the machine drivers too */
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include "nau-delay.h"
+#include "nau-fll.h"
+#include "nau-hwparams.h"
+#include "nau-latency.h"
+#include "nau-regmap.h"
+
 #define NAU8540_REG_SW_RESET			0x00
 #define NAU8540_REG_POWER_MANAGEMENT	0x01
 #define NAU8540_REG_CLOCK_CTRL		0x02
@@ -176,6 +186,7 @@
 #define NAU8540_ALC_CH3_EN		(0x1 << 14)
 #define NAU8540_ALC_CH4_EN		(0x1 << 15)
 #define NAU8540_ALC_CH_ALL_EN		(0xf << 12)
+#define NAU8540_ALC_CH_EN_SFT		12
 
 /* ADC_SAMPLE_RATE (0x3A) */
 #define NAU8540_CH_SYNC		(0x1 << 14)
@@ -185,6 +196,10 @@
 #define NAU8540_ADC_OSR_64		0x1
 #define NAU8540_ADC_OSR_32		0x0
 
+/* DIGITAL_MUX (0x44) */
+#define NAU8540_DIGMUX_SFT(slot)	((slot) * 2)
+#define NAU8540_DIGMUX_MASK(slot)	(0x3 << NAU8540_DIGMUX_SFT(slot))
+
 /* VMID_CTRL (0x60) */
 #define NAU8540_VMID_EN		(1 << 6)
 #define NAU8540_VMID_SEL_SFT		4
@@ -197,6 +212,9 @@
 #define NAU8540_PGA_CH4_MUTE		0x8
 #define NAU8540_PGA_CH_ALL_MUTE		0xf
 
+/* ANALOG_PWR (0x66) */
+#define NAU8540_PWR_ADC_CH_ALL		0xf
+
 /* MIC_BIAS (0x67) */
 #define NAU8540_PU_PRE			(0x1 << 8)
 
@@ -227,6 +245,52 @@
 #define NAU8540_ACDC_CTL_MIC1N_VREF	(0x1 << 9)
 #define NAU8540_ACDC_CTL_MIC1P_VREF	(0x1 << 8)
 
+/* PWR (0x6D) */
+#define NAU8540_PWR_FEPGA_ALL		(0xf << 12)
+
+/* chips of a TDM group, each one driving 4 slots */
+#define NAU8540_GROUP_MAX	4
+#define NAU8540_GROUP_SLOTS	4
+
+/* time for the peak data to build up after the capture start */
+#define NAU8540_HEALTH_DELAY_MS	10
+
+/* The peak meter of the ADC channels. The peak detector runs on the AGC
+ * clock, and the data is sampled once a period at most, however often the
+ * control is read.
+ */
+#define NAU8540_METER_CHANNELS	4
+#define NAU8540_METER_PERIOD_MS	50
+#define NAU8540_PEAK_MAX	0xffff
+
+struct nau8540_meter {
+	struct mutex lock;
+	unsigned long next;
+	unsigned int peak[NAU8540_METER_CHANNELS];
+	bool on;
+};
+
+/* The ALC profiles. A profile holds ALC_CONTROL_1 to ALC_CONTROL_5 of the
+ * board, and the channel enables of ALC_CONTROL_3 come from the channels
+ * of the ALC instead.
+ */
+enum {
+	NAU8540_ALC_OFF,
+	NAU8540_ALC_NEAR_FIELD,
+	NAU8540_ALC_FAR_FIELD,
+	NAU8540_ALC_NUM,
+};
+
+#define NAU8540_ALC_REGS	5
+
+struct nau8540_alc {
+	/* serialize the profile, the meter switch and the AGC clock */
+	struct mutex lock;
+	u32 regs[NAU8540_ALC_NUM][NAU8540_ALC_REGS];
+	u32 channels;
+	int profile;
+};
+
 /* System Clock Source */
 enum {
 	NAU8540_CLK_DIS,
@@ -235,24 +299,74 @@ enum {
 	NAU8540_CLK_FLL_MCLK,
 	NAU8540_CLK_FLL_BLK,
 	NAU8540_CLK_FLL_FS,
+	/* the FLL follows BCLK or FS at hw_params, and MCLK can be gated */
+	NAU8540_CLK_AUTO_BLK,
+	NAU8540_CLK_AUTO_FS,
 };
 
-struct nau8540 {
-	struct device *dev;
-	struct regmap *regmap;
+struct nau8540;
+
+/* The chips sharing one TDM bus. The members are kept in the order of
+ * their I2C address, which gives the slots of each one.
+ */
+struct nau8540_group {
+	struct list_head node;
+	u32 id;
+	struct nau8540 *members[NAU8540_GROUP_MAX];
+	int num;
 };
 
-struct nau8540_fll {
-	int mclk_src;
-	int ratio;
-	int fll_frac;
-	int fll_int;
-	int clk_ref_div;
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8540_LAT_HW_PARAMS,
+	NAU8540_LAT_PRECHARGE,
+	NAU8540_LAT_ADC_SETTLE,
+	NAU8540_LAT_RECOVERY,
+	NAU8540_LAT_NUM,
 };
 
-struct nau8540_fll_attr {
-	unsigned int param;
-	unsigned int val;
+struct nau8540 {
+	struct device *dev;
+	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_regcache_stat resume_sync;
+	struct nau_latency latency[NAU8540_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	struct nau_delay delay;
+	struct nau_fll_cache fll_cache;
+	/* The FLL reference of the auto clocking, NAU8540_CLK_FLL_BLK or
+	 * NAU8540_CLK_FLL_FS, or NAU8540_CLK_DIS if the machine clocks the
+	 * codec. The FLL is locked to clk_auto_in at clk_auto_fs, 0 if not.
+	 */
+	int clk_auto;
+	unsigned int clk_auto_in;
+	unsigned int clk_auto_fs;
+	int tdm_slots;
+	int tdm_width;
+	/* the DIGITAL_MUX of the slot map of the board, 0 if none */
+	unsigned int slot_mux;
+	int slot_first;		/* the first slot of the chip in TDM */
+	unsigned int adc_used;	/* the ADC channels the stream takes */
+	unsigned short addr;
+	struct nau8540_group *group;
+	int group_pos;
+	bool precharged;
+	int precharge_users;
+	struct snd_soc_dapm_context *dapm;
+	/* capture path held powered in standby */
+	struct work_struct arm_work;
+	bool standby_armed;
+	bool armed;
+	bool capture_on;
+	/* channel health check after the capture start */
+	struct delayed_work health_work;
+	u32 recovery_count;
+	u32 recovery_fail;
+	u32 recovery_group;	/* the channel reset failed, the group reset */
+	u32 recovery_ch[NAU8540_METER_CHANNELS];
+	struct nau8540_meter meter;
+	struct nau8540_alc alc;
 };
 
 /* over sampling rate */
@@ -261,5 +375,6 @@ struct nau8540_osr_attr {
 	unsigned int clk_src;
 };
 
+bool nau8540_mclk_gateable(struct snd_soc_component *component);
 
 #endif	/* __NAU8540_H__ */
@@ -13,11 +13,12 @@
 #include <linux/moduleparam.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
-#include <linux/delay.h>
+#include <linux/completion.h>
 #include <linux/pm.h>
 #include <linux/i2c.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -156,10 +157,9 @@ static bool nau8810_volatile_reg(struct device *dev, unsigned int reg)
 }
 
 /* The EQ parameters get function is to get the 5 band equalizer control.
- * The regmap raw read can't work here because regmap doesn't provide
- * value format for value width of 9 bits. Therefore, the driver reads data
- * from cache and makes value format according to the endianness of
- * bytes type control element.
+ * The big endian values of the bytes type control element are the register
+ * format of the regmap bus, so the driver reads them out of the cache in
+ * one raw read.
  */
 static int nau8810_eq_get(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
@@ -167,30 +167,16 @@ static int nau8810_eq_get(struct snd_kcontrol *kcontrol,
 	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
 	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
 	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	int i, reg, reg_val;
-	u16 *val;
-
-	val = (u16 *)ucontrol->value.bytes.data;
-	reg = NAU8810_REG_EQ1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		regmap_read(nau8810->regmap, reg + i, &reg_val);
-		/* conversion of 16-bit integers between native CPU format
-		 * and big endian format
-		 */
-		reg_val = cpu_to_be16(reg_val);
-		memcpy(val + i, &reg_val, sizeof(reg_val));
-	}
 
-	return 0;
+	return regmap_raw_read(nau8810->regmap, NAU8810_REG_EQ1,
+		ucontrol->value.bytes.data, params->max);
 }
 
 /* The EQ parameters put function is to make configuration of 5 band equalizer
  * control. These configuration includes central frequency, equalizer gain,
  * cut-off frequency, bandwidth control, and equalizer path.
- * The regmap raw write can't work here because regmap doesn't provide
- * register and value format for register with address 7 bits and value 9 bits.
- * Therefore, the driver makes value format according to the endianness of
- * bytes type control element and writes data to codec.
+ * The big endian values of the bytes type control element go to the codec
+ * in one raw write, which the regmap bus sends as one I2C transfer.
  */
 static int nau8810_eq_put(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
@@ -198,33 +184,14 @@ static int nau8810_eq_put(struct snd_kcontrol *kcontrol,
 	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
 	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
 	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
-	u16 *val, value;
-	int i, reg, ret;
-
-	data = kmemdup(ucontrol->value.bytes.data,
-		params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
-
-	val = (u16 *)data;
-	reg = NAU8810_REG_EQ1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		/* conversion of 16-bit integers between native CPU format
-		 * and big endian format
-		 */
-		value = be16_to_cpu(*(val + i));
-		ret = regmap_write(nau8810->regmap, reg + i, value);
-		if (ret) {
-			dev_err(component->dev, "EQ configuration fail, register: %x ret: %d\n",
-				reg + i, ret);
-			kfree(data);
-			return ret;
-		}
-	}
-	kfree(data);
+	int ret;
 
-	return 0;
+	ret = regmap_raw_write(nau8810->regmap, NAU8810_REG_EQ1,
+		ucontrol->value.bytes.data, params->max);
+	if (ret)
+		dev_err(component->dev, "EQ configuration fail, ret: %d\n", ret);
+
+	return ret;
 }
 
 static const char * const nau8810_companding[] = {
@@ -353,6 +320,39 @@ static const struct snd_kcontrol_new nau8810_snd_controls[] = {
 		NAU8810_ADCOS_SFT, 1, 0),
 };
 
+/* The mic inputs are kept before the power update of the put, which
+ * checks them for the bias.
+ */
+static int nau8810_mic_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_dapm_kcontrol_component(kcontrol);
+	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+		(struct soc_mixer_control *)kcontrol->private_value;
+	unsigned int bit, old = nau8810->mic_src;
+	int ret;
+
+	bit = mc->reg == NAU8810_REG_ADCBOOST ?
+		NAU8810_MIC_SRC_BST : (1 << mc->shift);
+	if (ucontrol->value.integer.value[0])
+		nau8810->mic_src |= bit;
+	else
+		nau8810->mic_src &= ~bit;
+	ret = snd_soc_dapm_put_volsw(kcontrol, ucontrol);
+	if (ret < 0)
+		nau8810->mic_src = old;
+
+	return ret;
+}
+
+#define NAU8810_MIC_SWITCH(xname, reg, shift, max) \
+{	.iface = SNDRV_CTL_ELEM_IFACE_MIXER, .name = xname, \
+	.info = snd_soc_info_volsw, \
+	.get = snd_soc_dapm_get_volsw, .put = nau8810_mic_put, \
+	.private_value = SOC_SINGLE_VALUE(reg, shift, max, 0, 0) }
+
 /* Speaker Output Mixer */
 static const struct snd_kcontrol_new nau8810_speaker_mixer_controls[] = {
 	SOC_DAPM_SINGLE("AUX Bypass Switch", NAU8810_REG_SPKMIX,
@@ -379,18 +379,18 @@ static const struct snd_kcontrol_new nau8810_pgaboost_mixer_controls[] = {
 		NAU8810_AUXBSTGAIN_SFT, 0x7, 0),
 	SOC_DAPM_SINGLE("PGA Mute Switch", NAU8810_REG_PGAGAIN,
 		NAU8810_PGAMT_SFT, 1, 1),
-	SOC_DAPM_SINGLE("PMIC PGA Switch", NAU8810_REG_ADCBOOST,
-		NAU8810_PMICBSTGAIN_SFT, 0x7, 0),
+	NAU8810_MIC_SWITCH("PMIC PGA Switch", NAU8810_REG_ADCBOOST,
+		NAU8810_PMICBSTGAIN_SFT, 0x7),
 };
 
 /* Input PGA */
 static const struct snd_kcontrol_new nau8810_inpga[] = {
 	SOC_DAPM_SINGLE("AUX Switch", NAU8810_REG_INPUT_SIGNAL,
 		NAU8810_AUXPGA_SFT, 1, 0),
-	SOC_DAPM_SINGLE("MicN Switch", NAU8810_REG_INPUT_SIGNAL,
-		NAU8810_NMICPGA_SFT, 1, 0),
-	SOC_DAPM_SINGLE("MicP Switch", NAU8810_REG_INPUT_SIGNAL,
-		NAU8810_PMICPGA_SFT, 1, 0),
+	NAU8810_MIC_SWITCH("MicN Switch", NAU8810_REG_INPUT_SIGNAL,
+		NAU8810_NMICPGA_SFT, 1),
+	NAU8810_MIC_SWITCH("MicP Switch", NAU8810_REG_INPUT_SIGNAL,
+		NAU8810_PMICPGA_SFT, 1),
 };
 
 /* Loopback Switch */
@@ -403,10 +403,8 @@ static int check_mclk_select_pll(struct snd_soc_dapm_widget *source,
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(source->dapm);
 	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
-	unsigned int value;
 
-	regmap_read(nau8810->regmap, NAU8810_REG_CLOCK, &value);
-	return (value & NAU8810_CLKM_MASK);
+	return nau8810->clk_pll;
 }
 
 static int check_mic_enabled(struct snd_soc_dapm_widget *source,
@@ -415,15 +413,8 @@ static int check_mic_enabled(struct snd_soc_dapm_widget *source,
 	struct snd_soc_component *component =
 		snd_soc_dapm_to_component(source->dapm);
 	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
-	unsigned int value;
 
-	regmap_read(nau8810->regmap, NAU8810_REG_INPUT_SIGNAL, &value);
-	if (value & NAU8810_PMICPGA_EN || value & NAU8810_NMICPGA_EN)
-		return 1;
-	regmap_read(nau8810->regmap, NAU8810_REG_ADCBOOST, &value);
-	if (value & NAU8810_PMICBSTGAIN_MASK)
-		return 1;
-	return 0;
+	return !!nau8810->mic_src;
 }
 
 static const struct snd_soc_dapm_widget nau8810_dapm_widgets[] = {
@@ -598,6 +589,7 @@ static int nau8810_set_pll(struct snd_soc_dai *codec_dai, int pll_id,
 		pll_param->mclk_scaler << NAU8810_MCLKSEL_SFT);
 	regmap_update_bits(map, NAU8810_REG_CLOCK,
 		NAU8810_CLKM_MASK, NAU8810_CLKM_PLL);
+	nau8810->clk_pll = true;
 
 	return 0;
 }
@@ -688,6 +680,7 @@ static int nau8810_mclk_clkdiv(struct nau8810 *nau8810, int rate)
 		NAU8810_MCLKSEL_MASK, (div << NAU8810_MCLKSEL_SFT));
 	regmap_update_bits(nau8810->regmap, NAU8810_REG_CLOCK,
 		NAU8810_CLKM_MASK, NAU8810_CLKM_MCLK);
+	nau8810->clk_pll = false;
 
 	return 0;
 }
@@ -769,6 +762,41 @@ static int nau8810_pcm_hw_params(struct snd_pcm_substream *substream,
 	return ret;
 }
 
+/* Write back the registers and start the fast charge of the reference,
+ * out of the bias callback. The charge work ends the charge.
+ */
+static void nau8810_sync_work(struct work_struct *work)
+{
+	struct nau8810 *nau8810 =
+		container_of(work, struct nau8810, sync_work);
+	struct regmap *map = nau8810->regmap;
+
+	regcache_sync(map);
+	regmap_update_bits(map, NAU8810_REG_POWER1,
+		NAU8810_REFIMP_MASK, NAU8810_REFIMP_3K);
+	schedule_delayed_work(&nau8810->charge_work,
+		msecs_to_jiffies(NAU8810_REFIMP_CHARGE_MS));
+}
+
+/* The fast charge of the reference is over, so go to the standby 300K. */
+static void nau8810_charge_work(struct work_struct *work)
+{
+	struct nau8810 *nau8810 =
+		container_of(work, struct nau8810, charge_work.work);
+
+	regmap_update_bits(nau8810->regmap, NAU8810_REG_POWER1,
+		NAU8810_REFIMP_MASK, NAU8810_REFIMP_300K);
+	complete_all(&nau8810->charge_done);
+}
+
+/* Stop the sync and the fast charge, and release whoever waits for them. */
+static void nau8810_charge_cancel(struct nau8810 *nau8810)
+{
+	cancel_work_sync(&nau8810->sync_work);
+	cancel_delayed_work_sync(&nau8810->charge_work);
+	complete_all(&nau8810->charge_done);
+}
+
 static int nau8810_set_bias_level(struct snd_soc_component *component,
 	enum snd_soc_bias_level level)
 {
@@ -778,6 +806,10 @@ static int nau8810_set_bias_level(struct snd_soc_component *component,
 	switch (level) {
 	case SND_SOC_BIAS_ON:
 	case SND_SOC_BIAS_PREPARE:
+		/* the first stream waits the sync and the fast charge out */
+		if (!wait_for_completion_timeout(&nau8810->charge_done,
+			msecs_to_jiffies(NAU8810_REFIMP_TIMEOUT_MS)))
+			dev_warn(component->dev, "Reference charge timeout\n");
 		regmap_update_bits(map, NAU8810_REG_POWER1,
 			NAU8810_REFIMP_MASK, NAU8810_REFIMP_80K);
 		break;
@@ -788,16 +820,16 @@ static int nau8810_set_bias_level(struct snd_soc_component *component,
 			NAU8810_IOBUF_EN | NAU8810_ABIAS_EN);
 
 		if (snd_soc_component_get_bias_level(component) == SND_SOC_BIAS_OFF) {
-			regcache_sync(map);
-			regmap_update_bits(map, NAU8810_REG_POWER1,
-				NAU8810_REFIMP_MASK, NAU8810_REFIMP_3K);
-			mdelay(100);
+			reinit_completion(&nau8810->charge_done);
+			schedule_work(&nau8810->sync_work);
+			break;
 		}
 		regmap_update_bits(map, NAU8810_REG_POWER1,
 			NAU8810_REFIMP_MASK, NAU8810_REFIMP_300K);
 		break;
 
 	case SND_SOC_BIAS_OFF:
+		nau8810_charge_cancel(nau8810);
 		regmap_write(map, NAU8810_REG_POWER1, 0);
 		regmap_write(map, NAU8810_REG_POWER2, 0);
 		regmap_write(map, NAU8810_REG_POWER3, 0);
@@ -840,21 +872,113 @@ static struct snd_soc_dai_driver nau8810_dai = {
 	.symmetric_rates = 1,
 };
 
+/* The NAU8810 takes one 16 bit word per register, 7 bit address and 9 bit
+ * data, and doesn't increase the address by itself. The regmap bus gets
+ * the registers in 8 bit address and 16 bit big endian data, so regmap can
+ * do raw and bulk access, and sends a burst of registers in one I2C
+ * transfer with one message per register.
+ */
+static int nau8810_bus_gather_write(void *context, const void *reg,
+	size_t reg_size, const void *val, size_t val_size)
+{
+	struct i2c_client *client = context;
+	struct i2c_msg msgs[NAU8810_BURST_REGS];
+	u8 buf[NAU8810_BURST_REGS][2];
+	unsigned int addr = *(const u8 *)reg;
+	const u8 *data = val;
+	int i, num = val_size / 2, ret;
+
+	if (reg_size != 1 || val_size % 2 || num > NAU8810_BURST_REGS)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		buf[i][0] = ((addr + i) << 1) | (data[i * 2] & 0x1);
+		buf[i][1] = data[i * 2 + 1];
+		msgs[i].addr = client->addr;
+		msgs[i].flags = 0;
+		msgs[i].len = 2;
+		msgs[i].buf = buf[i];
+	}
+	ret = i2c_transfer(client->adapter, msgs, num);
+	if (ret == num)
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
+static int nau8810_bus_write(void *context, const void *data, size_t count)
+{
+	if (count < 1)
+		return -EINVAL;
+
+	return nau8810_bus_gather_write(context, data, 1,
+		(const u8 *)data + 1, count - 1);
+}
+
+static int nau8810_bus_read(void *context, const void *reg, size_t reg_size,
+	void *val, size_t val_size)
+{
+	struct i2c_client *client = context;
+	struct i2c_msg msgs[2];
+	u8 addr = *(const u8 *)reg, cmd, *data = val;
+	int i, ret;
+
+	if (reg_size != 1 || val_size % 2)
+		return -EINVAL;
+
+	for (i = 0; i < val_size / 2; i++) {
+		cmd = (addr + i) << 1;
+		msgs[0].addr = client->addr;
+		msgs[0].flags = 0;
+		msgs[0].len = 1;
+		msgs[0].buf = &cmd;
+		msgs[1].addr = client->addr;
+		msgs[1].flags = I2C_M_RD;
+		msgs[1].len = 2;
+		msgs[1].buf = data + i * 2;
+		ret = i2c_transfer(client->adapter, msgs, 2);
+		if (ret != 2)
+			return ret < 0 ? ret : -EIO;
+		data[i * 2] &= 0x1;
+	}
+
+	return 0;
+}
+
+static const struct regmap_bus nau8810_regmap_bus = {
+	.write = nau8810_bus_write,
+	.gather_write = nau8810_bus_gather_write,
+	.read = nau8810_bus_read,
+	.max_raw_write = NAU8810_BURST_REGS * 2,
+	.reg_format_endian_default = REGMAP_ENDIAN_BIG,
+	.val_format_endian_default = REGMAP_ENDIAN_BIG,
+};
+
 static const struct regmap_config nau8810_regmap_config = {
-	.reg_bits = 7,
-	.val_bits = 9,
+	.reg_bits = 8,
+	.val_bits = 16,
 
 	.max_register = NAU8810_REG_MAX,
 	.readable_reg = nau8810_readable_reg,
 	.writeable_reg = nau8810_writeable_reg,
 	.volatile_reg = nau8810_volatile_reg,
+	/* contiguous registers are synced in one transfer */
+	.use_single_write = false,
 
 	.cache_type = REGCACHE_RBTREE,
 	.reg_defaults = nau8810_reg_defaults,
 	.num_reg_defaults = ARRAY_SIZE(nau8810_reg_defaults),
 };
 
+static void nau8810_remove(struct snd_soc_component *component)
+{
+	struct nau8810 *nau8810 = snd_soc_component_get_drvdata(component);
+
+	nau8810_charge_cancel(nau8810);
+}
+
 static const struct snd_soc_component_driver nau8810_component_driver = {
+	.remove			= nau8810_remove,
 	.set_bias_level		= nau8810_set_bias_level,
 	.controls		= nau8810_snd_controls,
 	.num_controls		= ARRAY_SIZE(nau8810_snd_controls),
@@ -874,6 +998,7 @@ static int nau8810_i2c_probe(struct i2c_client *i2c,
 {
 	struct device *dev = &i2c->dev;
 	struct nau8810 *nau8810 = dev_get_platdata(dev);
+	unsigned int value;
 
 	if (!nau8810) {
 		nau8810 = devm_kzalloc(dev, sizeof(*nau8810), GFP_KERNEL);
@@ -882,12 +1007,28 @@ static int nau8810_i2c_probe(struct i2c_client *i2c,
 	}
 	i2c_set_clientdata(i2c, nau8810);
 
-	nau8810->regmap = devm_regmap_init_i2c(i2c, &nau8810_regmap_config);
+	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C))
+		return -EIO;
+
+	nau8810->regmap = devm_regmap_init(dev, &nau8810_regmap_bus, i2c,
+		&nau8810_regmap_config);
 	if (IS_ERR(nau8810->regmap))
 		return PTR_ERR(nau8810->regmap);
 	nau8810->dev = dev;
+	INIT_WORK(&nau8810->sync_work, nau8810_sync_work);
+	INIT_DELAYED_WORK(&nau8810->charge_work, nau8810_charge_work);
+	init_completion(&nau8810->charge_done);
+	complete_all(&nau8810->charge_done);
 
 	regmap_write(nau8810->regmap, NAU8810_REG_RESET, 0x00);
+	/* the clock and mic inputs of the defaults after reset */
+	regmap_read(nau8810->regmap, NAU8810_REG_CLOCK, &value);
+	nau8810->clk_pll = value & NAU8810_CLKM_MASK;
+	regmap_read(nau8810->regmap, NAU8810_REG_INPUT_SIGNAL, &value);
+	nau8810->mic_src = value & (NAU8810_PMICPGA_EN | NAU8810_NMICPGA_EN);
+	regmap_read(nau8810->regmap, NAU8810_REG_ADCBOOST, &value);
+	if (value & NAU8810_PMICBSTGAIN_MASK)
+		nau8810->mic_src |= NAU8810_MIC_SRC_BST;
 
 	return devm_snd_soc_register_component(dev,
 		&nau8810_component_driver, &nau8810_dai, 1);
@@ -268,6 +268,13 @@ enum {
 	NAU8810_SCLK_PLL,
 };
 
+/* registers of an I2C transfer */
+#define NAU8810_BURST_REGS	16
+
+/* fast charge time of the reference through REFIMP_3K */
+#define NAU8810_REFIMP_CHARGE_MS	100
+#define NAU8810_REFIMP_TIMEOUT_MS	1000
+
 struct nau8810_pll {
 	int pre_factor;
 	int mclk_scaler;
@@ -275,12 +282,26 @@ struct nau8810_pll {
 	int pll_int;
 };
 
+/* the boost of MICP in the mic inputs, next to the bits of INPUT_SIGNAL */
+#define NAU8810_MIC_SRC_BST		(0x1 << 2)
+
 struct nau8810 {
 	struct device *dev;
 	struct regmap *regmap;
 	struct nau8810_pll pll;
 	int sysclk;
 	int clk_id;
+	/* the master clock from PLL and the mic inputs switched on, kept as
+	 * they are programmed for the checks of the DAPM graph walks
+	 */
+	bool clk_pll;
+	unsigned int mic_src;
+	/* register sync and fast charge of the reference, out of the bias
+	 * callback, waited by the first stream
+	 */
+	struct work_struct sync_work;
+	struct delayed_work charge_work;
+	struct completion charge_done;
 };
 
 #endif
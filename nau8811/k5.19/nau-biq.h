@@ -0,0 +1,143 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Biquad coefficients per sampling rate of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_BIQ_H__
+#define __NAU_BIQ_H__
+
+#include <linux/debugfs.h>
+#include <linux/mutex.h>
+#include <linux/string.h>
+#include <linux/types.h>
+
+#include "nau-regmap.h"
+
+/* The coefficients of a biquad only hold for the rate they are designed
+ * for. The ones written by a control are kept for the rate of the stream
+ * configured last, and a hw_params at another rate programs the set kept
+ * for that rate again. A client writes the set of each rate once instead
+ * of at every rate change. A rate without a set keeps the coefficients in
+ * place, and the ones written before any stream aren't kept.
+ */
+#define NAU_BIQ_RATES	4
+
+struct nau_biq_set {
+	unsigned int fs;	/* 0 if unused */
+	u8 data[NAU_COEFF_MAX];
+};
+
+struct nau_biq_rates {
+	struct mutex lock;
+	struct regmap *regmap;
+	unsigned int reg;	/* register of the first coefficient */
+	unsigned int en_reg;
+	unsigned int en_mask;	/* the write enable, 0 if the codec has none */
+	size_t len;		/* bytes of the coefficients */
+	struct nau_coeff_shadow *shadow;
+	struct nau_biq_set set[NAU_BIQ_RATES];
+	unsigned int next;
+	unsigned int fs;	/* the rate of the coefficients in place */
+	u32 switches;
+};
+
+static inline void nau_biq_rates_init(struct nau_biq_rates *rates,
+	struct regmap *regmap, unsigned int reg, size_t len,
+	struct nau_coeff_shadow *shadow, unsigned int en_reg,
+	unsigned int en_mask)
+{
+	mutex_init(&rates->lock);
+	rates->regmap = regmap;
+	rates->reg = reg;
+	rates->len = len;
+	rates->shadow = shadow;
+	rates->en_reg = en_reg;
+	rates->en_mask = en_mask;
+}
+
+static inline struct nau_biq_set *nau_biq_rates_find(
+	struct nau_biq_rates *rates, unsigned int fs)
+{
+	int i;
+
+	for (i = 0; i < NAU_BIQ_RATES; i++)
+		if (rates->set[i].fs == fs)
+			return &rates->set[i];
+
+	return NULL;
+}
+
+/**
+ * nau_biq_rates_write - Program the coefficients and keep them for the rate.
+ * @rates: the coefficient sets of the biquad.
+ * @data: big endian coefficient words, @rates->len bytes.
+ *
+ * Returns 1 if a word changed, 0 if not, or a negative error code.
+ */
+static inline int nau_biq_rates_write(struct nau_biq_rates *rates,
+	const u8 *data)
+{
+	struct nau_biq_set *set;
+	int ret;
+
+	mutex_lock(&rates->lock);
+	ret = nau_regmap_coeff_update(rates->regmap, rates->reg, rates->shadow,
+		data, rates->len, rates->en_reg, rates->en_mask);
+	if (ret < 0 || !rates->fs)
+		goto done;
+	set = nau_biq_rates_find(rates, rates->fs);
+	if (!set) {
+		set = &rates->set[rates->next];
+		rates->next = (rates->next + 1) % NAU_BIQ_RATES;
+		set->fs = rates->fs;
+	}
+	memcpy(set->data, data, rates->len);
+ done:
+	mutex_unlock(&rates->lock);
+
+	return ret < 0 ? ret : !!ret;
+}
+
+/* Program the coefficients kept for @fs, the rate of a new stream */
+static inline int nau_biq_rates_switch(struct nau_biq_rates *rates,
+	unsigned int fs)
+{
+	struct nau_biq_set *set;
+	int ret = 0;
+
+	if (!fs)
+		return 0;
+	mutex_lock(&rates->lock);
+	if (rates->fs == fs)
+		goto done;
+	rates->fs = fs;
+	set = nau_biq_rates_find(rates, fs);
+	if (!set)
+		goto done;
+	ret = nau_regmap_coeff_update(rates->regmap, rates->reg, rates->shadow,
+		set->data, rates->len, rates->en_reg, rates->en_mask);
+	if (ret > 0)
+		rates->switches++;
+ done:
+	mutex_unlock(&rates->lock);
+
+	return ret < 0 ? ret : 0;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_biq_rates_debugfs_init(struct dentry *root,
+	const char *name, struct nau_biq_rates *rates)
+{
+	if (root)
+		debugfs_create_u32(name, 0444, root, &rates->switches);
+}
+#else
+static inline void nau_biq_rates_debugfs_init(struct dentry *root,
+	const char *name, struct nau_biq_rates *rates)
+{
+}
+#endif
+
+#endif /* __NAU_BIQ_H__ */
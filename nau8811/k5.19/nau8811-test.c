@@ -0,0 +1,219 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the clock source solver of NAU8811
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8811.c, as the solver and its tables are
+ * static.
+ */
+
+#include <kunit/test.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+
+/* the MCLK of the boards, in MASTER_CLK_MIN..MASTER_CLK_MAX */
+static const unsigned int nau8811_test_mclk[] = {
+	2048000, 3072000, 4096000, 5644800, 6144000, 8192000, 11289600,
+	12000000, 12288000, 16384000, 19200000, 22579200, 24000000,
+	24576000,
+};
+
+static int nau8811_test_init(struct kunit *test)
+{
+	struct nau8811 *nau8811;
+
+	nau8811 = kunit_kzalloc(test, sizeof(*nau8811), GFP_KERNEL);
+	if (!nau8811)
+		return -ENOMEM;
+	nau8811->dev = root_device_register("nau8811-kunit");
+	if (IS_ERR(nau8811->dev))
+		return PTR_ERR(nau8811->dev);
+	test->priv = nau8811;
+
+	return 0;
+}
+
+static void nau8811_test_exit(struct kunit *test)
+{
+	struct nau8811 *nau8811 = test->priv;
+
+	root_device_unregister(nau8811->dev);
+}
+
+/* Search all the multipliers and dividers for a MCLK_SRC, as reference */
+static bool nau8811_test_solvable(const struct nau8811_srate_attr *srate,
+				  unsigned int mclk)
+{
+	unsigned int src;
+	int i, j, ratio;
+
+	for (i = 0; i < ARRAY_SIZE(mclk_src_mult); i++)
+		for (j = 0; j < ARRAY_SIZE(mclk_src_div); j++) {
+			src = mclk * mclk_src_mult[i].param;
+			if (src % mclk_src_div[j].param)
+				continue;
+			src /= mclk_src_div[j].param;
+			for (ratio = 0; ratio < NAU8811_MCLK_FS_RATIO_NUM; ratio++)
+				if (srate->mclk_src[ratio] == src)
+					return true;
+		}
+
+	return false;
+}
+
+/* The MCLK_SRC programmed is the exact one of the ratio to fs */
+static void nau8811_test_check(struct kunit *test,
+			       const struct nau8811_clk_solution *sol)
+{
+	const struct nau8811_srate_attr *srate = target_srate_attribute(sol->fs);
+	unsigned int src;
+
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, srate);
+	KUNIT_ASSERT_TRUE_MSG(test, sol->mult >= 0 &&
+			      sol->mult < ARRAY_SIZE(mclk_src_mult),
+			      "MCLK %u fs %u: mult %d", sol->mclk, sol->fs,
+			      sol->mult);
+	KUNIT_ASSERT_TRUE_MSG(test, sol->div >= 0 &&
+			      sol->div < ARRAY_SIZE(mclk_src_div),
+			      "MCLK %u fs %u: div %d", sol->mclk, sol->fs,
+			      sol->div);
+	KUNIT_ASSERT_TRUE_MSG(test, sol->ratio >= 0 &&
+			      sol->ratio < NAU8811_MCLK_FS_RATIO_NUM,
+			      "MCLK %u fs %u: ratio %d", sol->mclk, sol->fs,
+			      sol->ratio);
+
+	src = sol->mclk * mclk_src_mult[sol->mult].param;
+	KUNIT_EXPECT_EQ(test, src % mclk_src_div[sol->div].param, 0U);
+	src /= mclk_src_div[sol->div].param;
+	KUNIT_EXPECT_NE(test, srate->mclk_src[sol->ratio], 0U);
+	KUNIT_EXPECT_EQ_MSG(test, src, srate->mclk_src[sol->ratio],
+			    "MCLK %u fs %u", sol->mclk, sol->fs);
+}
+
+/* Sweep MCLK x fs; the solver finds a clock whenever one exists */
+static void nau8811_test_clksrc_sweep(struct kunit *test)
+{
+	struct nau8811 *nau8811 = test->priv;
+	struct nau8811_clk_solution sol;
+	int i, f, ret, calls = 0, solved = 0;
+	ktime_t start, spent = 0;
+
+	for (f = 0; f < ARRAY_SIZE(target_srate_table); f++)
+		for (i = 0; i < ARRAY_SIZE(nau8811_test_mclk); i++) {
+			nau8811->mclk = nau8811_test_mclk[i];
+			nau8811->fs = target_srate_table[f].fs;
+			start = ktime_get();
+			ret = nau8811_clksrc_choose(nau8811, &sol);
+			spent = ktime_add(spent, ktime_sub(ktime_get(), start));
+			calls++;
+			if (!ret) {
+				solved++;
+				sol.mclk = nau8811->mclk;
+				sol.fs = nau8811->fs;
+				nau8811_test_check(test, &sol);
+				continue;
+			}
+			KUNIT_EXPECT_FALSE_MSG(test,
+				nau8811_test_solvable(&target_srate_table[f],
+						      nau8811->mclk),
+				"MCLK %u fs %u not solved", nau8811->mclk,
+				nau8811->fs);
+		}
+	KUNIT_EXPECT_GT(test, solved, 0);
+	kunit_info(test, "%d of %d solved, %lld ns per call\n", solved, calls,
+		   div_s64(ktime_to_ns(spent), calls));
+}
+
+/* A hit returns the entry kept, a failure keeps nothing */
+static void nau8811_test_clk_cache(struct kunit *test)
+{
+	struct nau8811 *nau8811 = test->priv;
+	const struct nau8811_clk_solution *sol, *hit;
+	ktime_t start, solve, lookup;
+	int i, next;
+
+	nau8811->mclk = 12288000;
+	nau8811->fs = 48000;
+	start = ktime_get();
+	sol = nau8811_clk_solve(nau8811);
+	solve = ktime_sub(ktime_get(), start);
+	KUNIT_ASSERT_FALSE(test, IS_ERR(sol));
+	nau8811_test_check(test, sol);
+
+	next = nau8811->clk_cache_next;
+	start = ktime_get();
+	hit = nau8811_clk_solve(nau8811);
+	lookup = ktime_sub(ktime_get(), start);
+	KUNIT_EXPECT_PTR_EQ(test, hit, sol);
+	KUNIT_EXPECT_EQ(test, nau8811->clk_cache_next, next);
+
+	nau8811->mclk = 2000000;
+	KUNIT_EXPECT_TRUE(test, IS_ERR(nau8811_clk_solve(nau8811)));
+	KUNIT_EXPECT_EQ(test, nau8811->clk_cache_next, next);
+	for (i = 0; i < NAU8811_CLK_CACHE_NUM; i++)
+		KUNIT_EXPECT_NE(test, nau8811->clk_cache[i].mclk, 2000000U);
+
+	kunit_info(test, "solve %lld ns, cache hit %lld ns\n",
+		   ktime_to_ns(solve), ktime_to_ns(lookup));
+}
+
+/* The OSR of each policy is within CLK_DA_AD_MAX, the highest or lowest */
+static void nau8811_test_osr_pick(struct kunit *test)
+{
+	static const int policies[] = {
+		NAU8811_OSR_LOW_LATENCY, NAU8811_OSR_LOW_POWER,
+		NAU8811_OSR_QUALITY,
+	};
+	const struct nau8811_osr_attr *sel;
+	unsigned int fs;
+	int f, p, s, i, num, pick;
+
+	for (f = 0; f < ARRAY_SIZE(target_srate_table); f++) {
+		fs = target_srate_table[f].fs;
+		for (s = 0; s < 2; s++) {
+			sel = s ? osr_adc_sel : osr_dac_sel;
+			num = s ? ARRAY_SIZE(osr_adc_sel) :
+				ARRAY_SIZE(osr_dac_sel);
+			for (p = 0; p < ARRAY_SIZE(policies); p++) {
+				pick = nau8811_osr_pick(sel, num, fs,
+							policies[p]);
+				KUNIT_ASSERT_GE_MSG(test, pick, 0,
+						    "fs %u %s policy %d", fs,
+						    s ? "ADC" : "DAC",
+						    policies[p]);
+				KUNIT_EXPECT_NE(test, sel[pick].osr, 0U);
+				KUNIT_EXPECT_LE(test, fs * sel[pick].osr,
+						(unsigned int)CLK_DA_AD_MAX);
+				for (i = 0; i < num; i++) {
+					if (!sel[i].osr ||
+					    fs * sel[i].osr > CLK_DA_AD_MAX)
+						continue;
+					if (policies[p] == NAU8811_OSR_LOW_POWER)
+						KUNIT_EXPECT_LE(test,
+							sel[pick].osr,
+							sel[i].osr);
+					else
+						KUNIT_EXPECT_GE(test,
+							sel[pick].osr,
+							sel[i].osr);
+				}
+			}
+		}
+	}
+}
+
+static struct kunit_case nau8811_test_cases[] = {
+	KUNIT_CASE(nau8811_test_clksrc_sweep),
+	KUNIT_CASE(nau8811_test_clk_cache),
+	KUNIT_CASE(nau8811_test_osr_pick),
+	{}
+};
+
+static struct kunit_suite nau8811_test_suite = {
+	.name = "nau8811-clk",
+	.init = nau8811_test_init,
+	.exit = nau8811_test_exit,
+	.test_cases = nau8811_test_cases,
+};
+kunit_test_suite(nau8811_test_suite);
@@ -7,13 +7,17 @@
 //
 #include <linux/acpi.h>
 #include <linux/clk.h>
+#include <linux/debugfs.h>
 #include <linux/delay.h>
+#include <linux/devm-helpers.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
 #include <linux/module.h>
 #include <linux/math64.h>
+#include <linux/mutex.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/jack.h>
@@ -21,6 +25,12 @@
 #include <sound/pcm_params.h>
 #include <sound/soc.h>
 #include <sound/tlv.h>
+#include <asm/unaligned.h>
+#include "nau-biq.h"
+#include "nau-hwparams.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-regmap.h"
 #include "nau8811.h"
 
 /* Range of Master Clock MCLK (Hz) */
@@ -35,6 +45,9 @@
 /* the default DMIC clock frequency */
 #define DMIC_CLK 3072000
 
+/* the rising time of VREF before VMID and the bias enabled */
+#define NAU8811_VREF_SETTLE_MS 600
+
 static const struct nau8811_osr_attr osr_dac_sel[] = {
 	{ 64, 2 },	/* OSR 64, SRC 1/4 */
 	{ 256, 0 },	/* OSR 256, SRC 1 */
@@ -58,8 +71,10 @@ static const struct nau8811_src_attr mclk_src_div[] = {
 	{ 6, 0x6 },
 };
 
+/* MCLK straight first, then doubled */
 static const struct nau8811_src_attr mclk_src_mult[] = {
-	{ 2, 0x1 },
+	{ 1, NAU8811_SYSCLK_SEL_MCLK },
+	{ 2, NAU8811_SYSCLK_SEL_2MCLK },
 };
 
 /* Sample Rate and MCLK_SRC selections */
@@ -146,76 +161,76 @@ static const struct reg_default nau8811_reg_defaults[] = {
 	{ NAU8811_R7F_POWER_UP_CONTROL, 0x0 },
 };
 
+#define NAU8811_READABLE_REGS(w) (					\
+	NAU_REG(w, NAU8811_R01_ENA_CTRL) |				\
+	NAU_REG(w, NAU8811_R03_CLK_DIVIDER) |				\
+	NAU_REG(w, NAU8811_R08_PDB_CTL) |				\
+	NAU_REG_RANGE(w, NAU8811_R0F_INTERRUPT_MASK, NAU8811_R13_DMIC_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8811_R1B_TDM_CTRL, NAU8811_R1E_LEFT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8811_R21_BIQ0_COF1, NAU8811_R2D_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8811_R30_ADC_DGAIN_CTRL, NAU8811_R31_MUTE_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8811_R34_DAC_DGAIN_CTRL, NAU8811_R3D_DAC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8811_R41_BIQ1_COF1, NAU8811_R4A_BIQ1_COF10) |	\
+	NAU_REG(w, NAU8811_R4C_IMM_MODE_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8811_R51_VCM_BUF, NAU8811_R53_SPG_AMP_OFFSETDEC) |	\
+	NAU_REG(w, NAU8811_R55_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8811_R58_I2C_DEVICE_ID, NAU8811_R59_SARDOUT_RAM_STATUS) |	\
+	NAU_REG(w, NAU8811_R66_BIAS_ADJ) |				\
+	NAU_REG(w, NAU8811_R69_SPARE_ANALOG) |				\
+	NAU_REG(w, NAU8811_R6B_MUTE_CTL) |				\
+	NAU_REG_RANGE(w, NAU8811_R71_ANALOG_ADC_1, NAU8811_R74_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8811_R76_BOOST, NAU8811_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8811_R7E_PGA_GAIN, NAU8811_R7F_POWER_UP_CONTROL) |	\
+	NAU_REG(w, NAU8811_R82_GENERAL_STATUS))
+
+static const u32 nau8811_readable_map[] = NAU_REGMAP(NAU8811_READABLE_REGS);
+
 static bool nau8811_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8811_R01_ENA_CTRL:
-	case NAU8811_R03_CLK_DIVIDER:
-	case NAU8811_R08_PDB_CTL:
-	case NAU8811_R0F_INTERRUPT_MASK ... NAU8811_R13_DMIC_CTRL:
-	case NAU8811_R1B_TDM_CTRL ... NAU8811_R1E_LEFT_TIME_SLOT:
-	case NAU8811_R21_BIQ0_COF1 ... NAU8811_R2D_DAC_CTRL2:
-	case NAU8811_R30_ADC_DGAIN_CTRL ... NAU8811_R31_MUTE_CTRL:
-	case NAU8811_R34_DAC_DGAIN_CTRL ... NAU8811_R3D_DAC_DRC_ATKDCY:
-	case NAU8811_R41_BIQ1_COF1 ... NAU8811_R4A_BIQ1_COF10:
-	case NAU8811_R4C_IMM_MODE_CTRL:
-	case NAU8811_R51_VCM_BUF ... NAU8811_R53_SPG_AMP_OFFSETDEC:
-	case NAU8811_R55_MISC_CTRL:
-	case NAU8811_R58_I2C_DEVICE_ID ... NAU8811_R59_SARDOUT_RAM_STATUS:
-	case NAU8811_R66_BIAS_ADJ:
-	case NAU8811_R69_SPARE_ANALOG:
-	case NAU8811_R6B_MUTE_CTL:
-	case NAU8811_R71_ANALOG_ADC_1 ... NAU8811_R74_MIC_BIAS:
-	case NAU8811_R76_BOOST ... NAU8811_R77_FEPGA:
-	case NAU8811_R7E_PGA_GAIN ... NAU8811_R7F_POWER_UP_CONTROL:
-	case NAU8811_R82_GENERAL_STATUS:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8811_readable_map, reg);
 }
 
+#define NAU8811_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8811_R00_RESET, NAU8811_R01_ENA_CTRL) |	\
+	NAU_REG(w, NAU8811_R03_CLK_DIVIDER) |				\
+	NAU_REG(w, NAU8811_R08_PDB_CTL) |				\
+	NAU_REG(w, NAU8811_R0F_INTERRUPT_MASK) |			\
+	NAU_REG_RANGE(w, NAU8811_R11_INT_CLR_KEY_STATUS, NAU8811_R13_DMIC_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8811_R1B_TDM_CTRL, NAU8811_R1E_LEFT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8811_R21_BIQ0_COF1, NAU8811_R2D_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8811_R30_ADC_DGAIN_CTRL, NAU8811_R31_MUTE_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8811_R34_DAC_DGAIN_CTRL, NAU8811_R3D_DAC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8811_R41_BIQ1_COF1, NAU8811_R4A_BIQ1_COF10) |	\
+	NAU_REG(w, NAU8811_R4C_IMM_MODE_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8811_R51_VCM_BUF, NAU8811_R53_SPG_AMP_OFFSETDEC) |	\
+	NAU_REG(w, NAU8811_R55_MISC_CTRL) |				\
+	NAU_REG(w, NAU8811_R66_BIAS_ADJ) |				\
+	NAU_REG(w, NAU8811_R69_SPARE_ANALOG) |				\
+	NAU_REG(w, NAU8811_R6B_MUTE_CTL) |				\
+	NAU_REG_RANGE(w, NAU8811_R71_ANALOG_ADC_1, NAU8811_R74_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8811_R76_BOOST, NAU8811_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8811_R7E_PGA_GAIN, NAU8811_R7F_POWER_UP_CONTROL))
+
+static const u32 nau8811_writeable_map[] = NAU_REGMAP(NAU8811_WRITEABLE_REGS);
+
 static bool nau8811_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8811_R00_RESET ... NAU8811_R01_ENA_CTRL:
-	case NAU8811_R03_CLK_DIVIDER:
-	case NAU8811_R08_PDB_CTL:
-	case NAU8811_R0F_INTERRUPT_MASK:
-	case NAU8811_R11_INT_CLR_KEY_STATUS ... NAU8811_R13_DMIC_CTRL:
-	case NAU8811_R1B_TDM_CTRL ... NAU8811_R1E_LEFT_TIME_SLOT:
-	case NAU8811_R21_BIQ0_COF1 ... NAU8811_R2D_DAC_CTRL2:
-	case NAU8811_R30_ADC_DGAIN_CTRL ... NAU8811_R31_MUTE_CTRL:
-	case NAU8811_R34_DAC_DGAIN_CTRL ... NAU8811_R3D_DAC_DRC_ATKDCY:
-	case NAU8811_R41_BIQ1_COF1 ... NAU8811_R4A_BIQ1_COF10:
-	case NAU8811_R4C_IMM_MODE_CTRL:
-	case NAU8811_R51_VCM_BUF ... NAU8811_R53_SPG_AMP_OFFSETDEC:
-	case NAU8811_R55_MISC_CTRL:
-	case NAU8811_R66_BIAS_ADJ:
-	case NAU8811_R69_SPARE_ANALOG:
-	case NAU8811_R6B_MUTE_CTL:
-	case NAU8811_R71_ANALOG_ADC_1 ... NAU8811_R74_MIC_BIAS:
-	case NAU8811_R76_BOOST ... NAU8811_R77_FEPGA:
-	case NAU8811_R7E_PGA_GAIN ... NAU8811_R7F_POWER_UP_CONTROL:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8811_writeable_map, reg);
 }
 
+#define NAU8811_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8811_R00_RESET) |					\
+	NAU_REG_RANGE(w, NAU8811_R10_IRQ_STATUS, NAU8811_R11_INT_CLR_KEY_STATUS) |	\
+	NAU_REG_RANGE(w, NAU8811_R21_BIQ0_COF1, NAU8811_R2A_BIQ0_COF10) |	\
+	NAU_REG_RANGE(w, NAU8811_R41_BIQ1_COF1, NAU8811_R4A_BIQ1_COF10) |	\
+	NAU_REG_RANGE(w, NAU8811_R58_I2C_DEVICE_ID, NAU8811_R59_SARDOUT_RAM_STATUS) |	\
+	NAU_REG(w, NAU8811_R82_GENERAL_STATUS))
+
+static const u32 nau8811_volatile_map[] = NAU_REGMAP(NAU8811_VOLATILE_REGS);
+
 static bool nau8811_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8811_R00_RESET:
-	case NAU8811_R10_IRQ_STATUS ... NAU8811_R11_INT_CLR_KEY_STATUS:
-	case NAU8811_R21_BIQ0_COF1 ... NAU8811_R2A_BIQ0_COF10:
-	case NAU8811_R41_BIQ1_COF1 ... NAU8811_R4A_BIQ1_COF10:
-	case NAU8811_R58_I2C_DEVICE_ID ... NAU8811_R59_SARDOUT_RAM_STATUS:
-	case NAU8811_R82_GENERAL_STATUS:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8811_volatile_map, reg);
 }
 
 static int nau8811_dac_biq_coeff_get(struct snd_kcontrol *kcontrol,
@@ -244,32 +259,16 @@ static int nau8811_dac_biq_coeff_put(struct snd_kcontrol *kcontrol,
 {
 	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
 	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
-	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
-	u16 *val, value;
-	int i, reg, ret;
-
-	data = kmemdup(ucontrol->value.bytes.data, params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
+	int ret;
 
-	val = (u16 *)data;
-	reg = NAU8811_R41_BIQ1_COF1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		/* conversion of 16-bit integers between native CPU format and big endian format */
-		value = be16_to_cpu(*(val + i));
-		ret = regmap_write(nau8811->regmap, reg + i, value);
-		if (ret) {
-			dev_err(component->dev,
-				"DAC BIQ configuration fail, register: %x ret: %d\n",
-				reg + i, ret);
-			kfree(data);
-			return ret;
-		}
+	ret = nau_biq_rates_write(&nau8811->dac_biq_rates,
+				  ucontrol->value.bytes.data);
+	if (ret < 0) {
+		dev_err(component->dev, "DAC BIQ configuration fail, ret: %d\n", ret);
+		return ret;
 	}
-	kfree(data);
 
-	return 0;
+	return !!ret;
 }
 
 static int nau8811_adc_biq_coeff_get(struct snd_kcontrol *kcontrol,
@@ -298,34 +297,149 @@ static int nau8811_adc_biq_coeff_put(struct snd_kcontrol *kcontrol,
 {
 	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
 	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
-	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
-	u16 *val, value;
-	int i, reg, ret;
+	int ret;
 
-	data = kmemdup(ucontrol->value.bytes.data, params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
+	ret = nau_biq_rates_write(&nau8811->adc_biq_rates,
+				  ucontrol->value.bytes.data);
+	if (ret < 0) {
+		dev_err(component->dev, "ADC BIQ configuration fail, ret: %d\n", ret);
+		return ret;
+	}
 
-	val = (u16 *)data;
-	reg = NAU8811_R21_BIQ0_COF1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		/* conversion of 16-bit integers between native CPU format and big endian format */
-		value = be16_to_cpu(*(val + i));
-		ret = regmap_write(nau8811->regmap, reg + i, value);
-		if (ret) {
-			dev_err(component->dev,
-				"ADC BIQ configuration fail, register: %x ret: %d\n",
-				reg + i, ret);
-			kfree(data);
-			return ret;
-		}
+	return !!ret;
+}
+
+static int nau8811_biq_preset_get(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_value *ucontrol)
+{
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	struct nau8811_biq_bank *bank =
+		container_of(e, struct nau8811_biq_bank, enum_ctl);
+
+	ucontrol->value.enumerated.item[0] = bank->sel;
+
+	return 0;
+}
+
+/* The coefficient words of the preset differing from the ones programmed
+ * go in one burst, so switching between close presets costs only a few
+ * register writes. The preset is kept for the rate of the stream, like the
+ * coefficients of the bytes control.
+ */
+static int nau8811_biq_preset_put(struct snd_kcontrol *kcontrol,
+				  struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	struct nau8811_biq_bank *bank =
+		container_of(e, struct nau8811_biq_bank, enum_ctl);
+	unsigned int sel = ucontrol->value.enumerated.item[0];
+	int ret;
+
+	if (sel >= bank->num)
+		return -EINVAL;
+
+	ret = nau_biq_rates_write(bank->rates, bank->coeffs[sel]);
+	if (ret < 0) {
+		dev_err(component->dev, "BIQ preset %s fail, ret: %d\n",
+			bank->names[sel], ret);
+		return ret;
 	}
-	kfree(data);
+	ret = bank->sel != sel;
+	bank->sel = sel;
+
+	return ret;
+}
+
+/* Enable VMID and the bias once the slow rising VREF settles */
+static void nau8811_vref_work(struct work_struct *work)
+{
+	struct nau8811 *nau8811 =
+		container_of(work, struct nau8811, vref_work.work);
+
+	regmap_update_bits(nau8811->regmap, NAU8811_R66_BIAS_ADJ,
+			   NAU8811_VMIDEN_EN, NAU8811_VMIDEN_EN);
+	regmap_update_bits(nau8811->regmap, NAU8811_R76_BOOST,
+			   NAU8811_BIASEN_EN, NAU8811_BIASEN_EN);
+}
+
+/* Get the VREF settled before the first use of the analog */
+static void nau8811_vref_wait(struct nau8811 *nau8811)
+{
+	flush_delayed_work(&nau8811->vref_work);
+}
+
+/* Precharge VCM and power up its buffer, with vcm_lock held */
+static void nau8811_vcm_charge(struct nau8811 *nau8811)
+{
+	ktime_t start;
+
+	if (nau8811->vcm_charged)
+		return;
+
+	start = ktime_get();
+	nau8811_vref_wait(nau8811);
+
+	regmap_update_bits(nau8811->regmap, NAU8811_R51_VCM_BUF,
+			   NAU8811_VOUT_PRECHG_DISABLE_MASK,
+			   NAU8811_VOUT_PRECHG_DISABLE_OFF);
+	msleep(600);
+	regmap_update_bits(nau8811->regmap, NAU8811_R51_VCM_BUF,
+			   NAU8811_PDB_VCMBUF_MASK, NAU8811_PDB_VCMBUF_EN);
+	nau8811->vcm_charged = true;
+	nau_latency_add(&nau8811->latency[NAU8811_LAT_VCM_CHARGE], start);
+}
+
+static void nau8811_vcm_discharge(struct nau8811 *nau8811)
+{
+	regmap_update_bits(nau8811->regmap, NAU8811_R51_VCM_BUF,
+			   NAU8811_PDB_VCMBUF_MASK, 0);
+	nau8811->vcm_charged = false;
+}
+
+/* The precharge of the low latency mode, out of the probe and streams */
+static void nau8811_vcm_work(struct work_struct *work)
+{
+	struct nau8811 *nau8811 = container_of(work, struct nau8811, vcm_work);
+
+	mutex_lock(&nau8811->vcm_lock);
+	if (nau8811->vcm_keep_charged)
+		nau8811_vcm_charge(nau8811);
+	mutex_unlock(&nau8811->vcm_lock);
+}
+
+static int nau8811_vcm_keep_get(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8811->vcm_keep_charged;
 
 	return 0;
 }
 
+/* Trade the standby power of VCM buffer for the start latency of playback */
+static int nau8811_vcm_keep_put(struct snd_kcontrol *kcontrol,
+				struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component = snd_soc_kcontrol_component(kcontrol);
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+	bool keep = !!ucontrol->value.integer.value[0];
+	int changed;
+
+	mutex_lock(&nau8811->vcm_lock);
+	changed = nau8811->vcm_keep_charged != keep;
+	nau8811->vcm_keep_charged = keep;
+	if (!keep && !nau8811->vcm_active && nau8811->vcm_charged)
+		nau8811_vcm_discharge(nau8811);
+	mutex_unlock(&nau8811->vcm_lock);
+	if (keep)
+		schedule_work(&nau8811->vcm_work);
+
+	return changed;
+}
+
 static const char * const nau8811_tdm_slot[] = {"Slot 0", "Slot 1", "Slot 2", "Slot 3",
 						"Slot 4", "Slot 5", "Slot 6", "Slot 7" };
 
@@ -357,6 +471,45 @@ static const DECLARE_TLV_DB_MINMAX(adc_vol_tlv, -6600, 2400);
 static const DECLARE_TLV_DB_MINMAX(spk_vol_tlv, 0, 560);
 static const DECLARE_TLV_DB_MINMAX(fepga_gain_tlv, -100, 3600);
 
+static const char * const nau8811_osr_policy[] = {
+	"Manual", "Low Latency", "Low Power", "Quality" };
+
+static const struct soc_enum nau8811_osr_policy_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8811_osr_policy),
+		nau8811_osr_policy);
+
+static int nau8811_osr_policy_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8811->osr_policy;
+
+	return 0;
+}
+
+/* The policy takes effect at the next hw_params */
+static int nau8811_osr_policy_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+	unsigned int policy = ucontrol->value.enumerated.item[0];
+
+	if (policy >= ARRAY_SIZE(nau8811_osr_policy))
+		return -EINVAL;
+	if (policy == nau8811->osr_policy)
+		return 0;
+
+	nau8811->osr_policy = policy;
+	nau_hw_params_reset(&nau8811->hw_params_cache);
+
+	return 1;
+}
+
 static const struct snd_kcontrol_new nau8811_controls[] = {
 	SOC_SINGLE_TLV("Sidetone Volume", NAU8811_R30_ADC_DGAIN_CTRL,
 		       NAU8811_ADC_TO_DAC_ST0_SFT, 0x0f, 0, sidetone_vol_tlv),
@@ -371,6 +524,8 @@ static const struct snd_kcontrol_new nau8811_controls[] = {
 
 	SOC_ENUM("ADC Decimation Rate", nau8811_adc_decimation_enum),
 	SOC_ENUM("DAC Oversampling Rate", nau8811_dac_oversampl_enum),
+	SOC_ENUM_EXT("OSR Policy", nau8811_osr_policy_enum,
+		nau8811_osr_policy_get, nau8811_osr_policy_put),
 	SOC_ENUM("DAC Channel Source", nau8811_dac_sel_enum),
 	SOC_ENUM("ADC Channel Source", nau8811_adc_sel_enum),
 
@@ -382,6 +537,8 @@ static const struct snd_kcontrol_new nau8811_controls[] = {
 		   NAU8811_ADCPHS0_SFT, 1, 0),
 	SOC_SINGLE("DAC Phase Switch", NAU8811_R1B_TDM_CTRL,
 		   NAU8811_DACPHS0_SFT, 1, 0),
+	SOC_SINGLE_BOOL_EXT("VCM Keep Charged Switch", 0,
+			    nau8811_vcm_keep_get, nau8811_vcm_keep_put),
 };
 
 static const struct snd_kcontrol_new nau8811_dmic_mode_switch =
@@ -423,6 +580,30 @@ static int dmic_clock_control(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
+/* The time from the prepare of the stream until the path is up */
+static void nau8811_start_done(struct nau8811 *nau8811, int stream)
+{
+	if (!nau8811->start_time[stream])
+		return;
+
+	nau8811->start_us[stream] =
+		ktime_us_delta(ktime_get(), nau8811->start_time[stream]);
+	nau8811->start_time[stream] = 0;
+}
+
+/* The ADC settles muted and the soft mute ramps it in later, so the
+ * capture stream doesn't hold the DAPM thread for the settle.
+ */
+static void nau8811_adc_unmute_work(struct work_struct *work)
+{
+	struct nau8811 *nau8811 =
+		container_of(work, struct nau8811, adc_unmute_work.work);
+
+	regmap_update_bits(nau8811->regmap, NAU8811_R31_MUTE_CTRL,
+			   NAU8811_ADC_SMUTE_EN, 0);
+	nau8811_start_done(nau8811, SNDRV_PCM_STREAM_CAPTURE);
+}
+
 static int nau8811_input_adc_event(struct snd_soc_dapm_widget *w,
 				   struct snd_kcontrol *kcontrol, int event)
 {
@@ -432,11 +613,11 @@ static int nau8811_input_adc_event(struct snd_soc_dapm_widget *w,
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
 		/* Avoid related noise from possible DC offset */
-		msleep(300);
-		regmap_update_bits(nau8811->regmap, NAU8811_R31_MUTE_CTRL,
-				   NAU8811_ADC_SMUTE_EN, 0);
+		schedule_delayed_work(&nau8811->adc_unmute_work,
+				      msecs_to_jiffies(NAU8811_ADC_SETTLE_MS));
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
+		cancel_delayed_work_sync(&nau8811->adc_unmute_work);
 		regmap_update_bits(nau8811->regmap, NAU8811_R31_MUTE_CTRL,
 				   NAU8811_ADC_SMUTE_EN, NAU8811_ADC_SMUTE_EN);
 		break;
@@ -469,22 +650,32 @@ static int nau8811_dac_event(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
+/* VCM is held charged after the stream in the low latency mode, so only
+ * the first stream pays its precharge, unless the precharge at probe
+ * finished before.
+ */
 static int nau8811_vcm_event(struct snd_soc_dapm_widget *w,
 			     struct snd_kcontrol *kcontrol, int event)
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
 
+	mutex_lock(&nau8811->vcm_lock);
 	switch (event) {
 	case SND_SOC_DAPM_PRE_PMU:
-		regmap_update_bits(nau8811->regmap, NAU8811_R51_VCM_BUF,
-				   NAU8811_VOUT_PRECHG_DISABLE_MASK,
-				   NAU8811_VOUT_PRECHG_DISABLE_OFF);
-		msleep(600);
+		nau8811_vcm_charge(nau8811);
+		nau8811->vcm_active = true;
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		nau8811->vcm_active = false;
+		if (!nau8811->vcm_keep_charged)
+			nau8811_vcm_discharge(nau8811);
 		break;
 	default:
+		mutex_unlock(&nau8811->vcm_lock);
 		return -EINVAL;
 	}
+	mutex_unlock(&nau8811->vcm_lock);
 
 	return 0;
 }
@@ -527,6 +718,7 @@ static int nau8811_i2s_output_event(struct snd_soc_dapm_widget *w,
 		/* Disables the TESTDAC to let DAC signal pass through. */
 		regmap_update_bits(nau8811->regmap, NAU8811_R66_BIAS_ADJ,
 				   NAU8811_TESTDAC_EN, 0);
+		nau8811_start_done(nau8811, SNDRV_PCM_STREAM_PLAYBACK);
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
 		/* Disables the TESTDAC to let DAC signal pass through. */
@@ -574,9 +766,9 @@ static const struct snd_soc_dapm_widget nau8811_dapm_widgets[] = {
 
 	SND_SOC_DAPM_AIF_IN("AIFRX", "Playback", 0, SND_SOC_NOPM, 0, 0),
 
-	SND_SOC_DAPM_PGA_S("VCM Buffer", 0, NAU8811_R51_VCM_BUF,
-			   NAU8811_PDB_VCMBUF_SFT, 0, nau8811_vcm_event,
-			   SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_PGA_S("VCM Buffer", 0, SND_SOC_NOPM, 0, 0,
+			   nau8811_vcm_event,
+			   SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
 
 	SND_SOC_DAPM_PGA_S("VREF Buffer", 1, NAU8811_R08_PDB_CTL,
 			   NAU8811_PDB_DAC_SFT, 0, NULL, 0),
@@ -618,39 +810,28 @@ static const struct snd_soc_dapm_route nau8811_dapm_routes[] = {
 	{"SPK", NULL, "I2S Output"},
 };
 
-static int nau8811_clksrc_div(struct nau8811 *nau8811,
-			      const struct nau8811_srate_attr *srate_table, unsigned int mclk)
+/* Returns the MCLK/fs ratio @mclk makes with a divider, and the divider
+ * in @div, or NAU8811_MCLK_FS_RATIO_NUM if none.
+ */
+static int nau8811_clksrc_div(const struct nau8811_srate_attr *srate_table,
+			      unsigned int mclk, int *div)
 {
-	int i, ratio;
 	unsigned int mclk_int;
+	int i, ratio;
 
-	ratio = NAU8811_MCLK_FS_RATIO_NUM;
 	for (i = 0; i < ARRAY_SIZE(mclk_src_div); i++) {
-		if (mclk % mclk_src_div[i].param != 0)
+		if (mclk % mclk_src_div[i].param)
 			continue;
-		else {
-			mclk_int = mclk / mclk_src_div[i].param;
-			if (srate_table->mclk_src[NAU8811_MCLK_FS_RATIO_256] == mclk_int) {
-				ratio = NAU8811_MCLK_FS_RATIO_256;
-				break;
-			} else if (srate_table->mclk_src[NAU8811_MCLK_FS_RATIO_400] == mclk_int) {
-				ratio = NAU8811_MCLK_FS_RATIO_400;
-				break;
-			} else if (srate_table->mclk_src[NAU8811_MCLK_FS_RATIO_500] == mclk_int) {
-				ratio = NAU8811_MCLK_FS_RATIO_500;
-				break;
+		mclk_int = mclk / mclk_src_div[i].param;
+		for (ratio = 0; ratio < NAU8811_MCLK_FS_RATIO_NUM; ratio++) {
+			if (srate_table->mclk_src[ratio] == mclk_int) {
+				*div = i;
+				return ratio;
 			}
 		}
 	}
-	if (i == ARRAY_SIZE(mclk_src_div))
-		return ratio;
 
-	if (ratio != NAU8811_MCLK_FS_RATIO_NUM) {
-		regmap_update_bits(nau8811->regmap, NAU8811_R03_CLK_DIVIDER,
-				   NAU8811_CLK_MCLK_SRC_MASK, mclk_src_div[i].val);
-		dev_dbg(nau8811->dev, "mclk should be divided %d!\n", mclk_src_div[i].param);
-	}
-	return ratio;
+	return NAU8811_MCLK_FS_RATIO_NUM;
 }
 
 static const struct nau8811_srate_attr *target_srate_attribute(unsigned int srate)
@@ -683,54 +864,83 @@ static void nau8811_set_freq_range(struct nau8811 *nau8811)
 				   NAU8811_MCLK_RNG_SEL_MASK, NAU8811_MCLK_RNG_SEL_7);
 }
 
-static int nau8811_clock_config(struct nau8811 *nau8811)
+/* Search every multiplier of MCLK with every divider for a ratio to fs */
+static int nau8811_clksrc_choose(struct nau8811 *nau8811,
+				 struct nau8811_clk_solution *sol)
 {
-	struct nau8811_srate_attr tmp_table, *srate_table = &tmp_table;
-	int i = 0, mult_sel, ratio;
-	unsigned int mult_mclk = 0;
+	const struct nau8811_srate_attr *srate_table;
+	int i;
 
-	if (!nau8811->mclk || !nau8811->fs) {
-		dev_err(nau8811->dev, "mclk or fs is empty!\n");
-		goto proc_err;
-	}
-	/* select sampling rate and MCLK_SRC */
-	srate_table = (struct nau8811_srate_attr *)target_srate_attribute(nau8811->fs);
-	if (srate_table == NULL) {
+	srate_table = target_srate_attribute(nau8811->fs);
+	if (!srate_table) {
 		dev_err(nau8811->dev, "srate table is empty!\n");
-		goto proc_err;
+		return -EINVAL;
 	}
-	/* First check clock from MCLK directly, decide the div for MCLK_INT.
-	 * If not good, consider Multiplier.
-	 */
-	ratio = nau8811_clksrc_div(nau8811, srate_table, nau8811->mclk);
-	dev_dbg(nau8811->dev, "ratio = %d!\n", ratio);
-	if (ratio != NAU8811_MCLK_FS_RATIO_NUM) {
-		mult_sel = NAU8811_SYSCLK_SEL_MCLK;
-		regmap_update_bits(nau8811->regmap, NAU8811_R01_ENA_CTRL,
-				   NAU8811_SYSCLK_SEL_MASK, mult_sel);
-		dev_dbg(nau8811->dev, "MCLK X1 case!\n");
-		goto proc_done;
-	} else {
-		mult_sel = NAU8811_SYSCLK_SEL_2MCLK;
-		regmap_update_bits(nau8811->regmap, NAU8811_R01_ENA_CTRL,
-				   NAU8811_SYSCLK_SEL_MASK, mult_sel);
-		for (i = 0; i < ARRAY_SIZE(mclk_src_mult); i++) {
-			mult_mclk = mclk_src_mult[i].param * nau8811->mclk;
-			ratio = nau8811_clksrc_div(nau8811, srate_table, mult_mclk);
-			if (ratio != NAU8811_MCLK_FS_RATIO_NUM) {
-				nau8811_set_freq_range(nau8811);
-				dev_dbg(nau8811->dev, "MCLK X2 case!\n");
-				goto proc_done;
-			} else {
-				goto proc_err;
-			}
+	for (i = 0; i < ARRAY_SIZE(mclk_src_mult); i++) {
+		sol->ratio = nau8811_clksrc_div(srate_table,
+			mclk_src_mult[i].param * nau8811->mclk, &sol->div);
+		if (sol->ratio != NAU8811_MCLK_FS_RATIO_NUM) {
+			sol->mult = i;
+			return 0;
 		}
 	}
+	dev_err(nau8811->dev, "no clock source of MCLK %u for fs %u\n",
+		nau8811->mclk, nau8811->fs);
 
-proc_err:
 	return -EINVAL;
-proc_done:
-	dev_dbg(nau8811->dev, "Clock settings configure successfully!\n");
+}
+
+/* Look up the clock solution of current MCLK and fs in the cache. If missed,
+ * choose clock source and keep the result in the cache in round robin.
+ */
+static const struct nau8811_clk_solution *
+nau8811_clk_solve(struct nau8811 *nau8811)
+{
+	struct nau8811_clk_solution *sol;
+	int i, ret;
+
+	for (i = 0; i < NAU8811_CLK_CACHE_NUM; i++) {
+		sol = &nau8811->clk_cache[i];
+		if (sol->mclk && sol->mclk == nau8811->mclk &&
+			sol->fs == nau8811->fs)
+			return sol;
+	}
+
+	sol = &nau8811->clk_cache[nau8811->clk_cache_next];
+	sol->mclk = 0;
+	ret = nau8811_clksrc_choose(nau8811, sol);
+	if (ret)
+		return ERR_PTR(ret);
+	sol->mclk = nau8811->mclk;
+	sol->fs = nau8811->fs;
+	nau8811->clk_cache_next =
+		(nau8811->clk_cache_next + 1) % NAU8811_CLK_CACHE_NUM;
+
+	return sol;
+}
+
+static int nau8811_clock_config(struct nau8811 *nau8811)
+{
+	const struct nau8811_clk_solution *sol;
+
+	if (!nau8811->mclk || !nau8811->fs) {
+		dev_err(nau8811->dev, "mclk or fs is empty!\n");
+		return -EINVAL;
+	}
+	sol = nau8811_clk_solve(nau8811);
+	if (IS_ERR(sol))
+		return PTR_ERR(sol);
+
+	regmap_update_bits(nau8811->regmap, NAU8811_R01_ENA_CTRL,
+			   NAU8811_SYSCLK_SEL_MASK, mclk_src_mult[sol->mult].val);
+	if (mclk_src_mult[sol->mult].param > 1)
+		nau8811_set_freq_range(nau8811);
+	regmap_update_bits(nau8811->regmap, NAU8811_R03_CLK_DIVIDER,
+			   NAU8811_CLK_MCLK_SRC_MASK, mclk_src_div[sol->div].val);
+	dev_dbg(nau8811->dev, "MCLK X%d, divided %d, ratio %d\n",
+		mclk_src_mult[sol->mult].param, mclk_src_div[sol->div].param,
+		sol->ratio);
+
 	return 0;
 }
 
@@ -754,14 +964,78 @@ nau8811_get_osr(struct nau8811 *nau8811, int stream)
 	}
 }
 
+/* The OSR taken by a policy instead of the controls. The filters of the
+ * converters keep their group delay short and their noise low with a high
+ * OSR, so both the low latency and the quality take the highest OSR within
+ * CLK_DA_AD_MAX at the rate, and the low power the lowest. The OSR applied
+ * reads back from the OSR controls.
+ */
+static int nau8811_osr_pick(const struct nau8811_osr_attr *sel, int num,
+	unsigned int rate, int policy)
+{
+	int i, pick = -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (!sel[i].osr || rate * sel[i].osr > CLK_DA_AD_MAX)
+			continue;
+		if (pick < 0 || (policy == NAU8811_OSR_LOW_POWER ?
+			sel[i].osr < sel[pick].osr : sel[i].osr > sel[pick].osr))
+			pick = i;
+	}
+
+	return pick;
+}
+
+static const struct nau8811_osr_attr *
+nau8811_osr_select(struct nau8811 *nau8811, int stream, unsigned int rate,
+	int policy)
+{
+	const struct nau8811_osr_attr *sel;
+	int num, i;
+
+	if (policy == NAU8811_OSR_MANUAL)
+		return nau8811_get_osr(nau8811, stream);
+
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		sel = osr_dac_sel;
+		num = ARRAY_SIZE(osr_dac_sel);
+	} else {
+		sel = osr_adc_sel;
+		num = ARRAY_SIZE(osr_adc_sel);
+	}
+	i = nau8811_osr_pick(sel, num, rate, policy);
+
+	return i < 0 ? NULL : &sel[i];
+}
+
+/* Program the OSR selected; the index is the register value, so the
+ * manual selection is written back unchanged.
+ */
+static void nau8811_osr_apply(struct nau8811 *nau8811, int stream,
+	const struct nau8811_osr_attr *osr)
+{
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK)
+		regmap_update_bits(nau8811->regmap, NAU8811_R2C_DAC_CTRL1,
+			NAU8811_OSR_DAC_RATE_MASK, osr - osr_dac_sel);
+	else
+		regmap_update_bits(nau8811->regmap, NAU8811_R2B_ADC_RATE,
+			NAU8811_OSR_ADC_RATE_MASK, osr - osr_adc_sel);
+}
+
 static int nau8811_dai_startup(struct snd_pcm_substream *substream,
 			       struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
 	const struct nau8811_osr_attr *osr;
-
-	osr = nau8811_get_osr(nau8811, substream->stream);
+	ktime_t start = ktime_get();
+
+	nau8811_vref_wait(nau8811);
+	nau_latency_add(&nau8811->latency[NAU8811_LAT_STARTUP], start);
+	/* a policy may take any OSR within the limit at the rate */
+	osr = nau8811_osr_select(nau8811, substream->stream, 0,
+		nau8811->osr_policy == NAU8811_OSR_MANUAL ?
+		NAU8811_OSR_MANUAL : NAU8811_OSR_LOW_POWER);
 	if (!osr || !osr->osr)
 		return -EINVAL;
 
@@ -770,6 +1044,17 @@ static int nau8811_dai_startup(struct snd_pcm_substream *substream,
 					    0, CLK_DA_AD_MAX / osr->osr);
 }
 
+static int nau8811_dai_prepare(struct snd_pcm_substream *substream,
+			       struct snd_soc_dai *dai)
+{
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(dai->component);
+
+	/* the path powers up after the prepare of the stream */
+	nau8811->start_time[substream->stream] = ktime_get();
+
+	return 0;
+}
+
 static int nau8811_hw_params(struct snd_pcm_substream *substream,
 			     struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
 {
@@ -777,8 +1062,15 @@ static int nau8811_hw_params(struct snd_pcm_substream *substream,
 	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0, ctrl_val, bclk_fs, clk_div;
 	const struct nau8811_osr_attr *osr;
+	ktime_t start = ktime_get();
 	int ret=-EINVAL;
 
+	/* the manual OSR is a control that may change at any time */
+	if (nau8811->osr_policy != NAU8811_OSR_MANUAL &&
+	    nau_hw_params_skip(&nau8811->hw_params_cache, substream->stream,
+			       params))
+		return 0;
+
 	nau8811->fs = params_rate(params);
 	if (nau8811->clk_src_sel == INTERNAL_BUF_MCLK) {
 		ret = nau8811_clock_config(nau8811);
@@ -792,11 +1084,13 @@ static int nau8811_hw_params(struct snd_pcm_substream *substream,
 	 * values must be selected such that the maximum frequency is less
 	 * than 6.144 MHz.
 	 */
-	osr = nau8811_get_osr(nau8811, substream->stream);
+	osr = nau8811_osr_select(nau8811, substream->stream, params_rate(params),
+		nau8811->osr_policy);
 	if (!osr || !osr->osr)
 		goto err;
 	if (params_rate(params) * osr->osr > CLK_DA_AD_MAX)
 		goto err;
+	nau8811_osr_apply(nau8811, substream->stream, osr);
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
 		regmap_update_bits(nau8811->regmap, NAU8811_R03_CLK_DIVIDER,
 				   NAU8811_CLK_DAC_SRC_MASK,
@@ -843,6 +1137,13 @@ static int nau8811_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8811->regmap, NAU8811_R1C_I2S_PCM_CTRL1,
 			   NAU8811_WLEN0_MASK, val_len);
+	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
+		nau_biq_rates_switch(&nau8811->dac_biq_rates, params_rate(params));
+	else
+		nau_biq_rates_switch(&nau8811->adc_biq_rates, params_rate(params));
+	nau_hw_params_done(&nau8811->hw_params_cache, substream->stream,
+			   params);
+	nau_latency_add(&nau8811->latency[NAU8811_LAT_HW_PARAMS], start);
 
 	return 0;
 err:
@@ -896,6 +1197,7 @@ static int nau8811_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
 		return -EINVAL;
 	}
 
+	nau_hw_params_reset(&nau8811->hw_params_cache);
 	regmap_update_bits(nau8811->regmap, NAU8811_R1C_I2S_PCM_CTRL1,
 			   NAU8811_AIFMT0_MASK | NAU8811_BCP0_MASK |
 			   NAU8811_LRP0_MASK, ctrl1_val);
@@ -920,6 +1222,7 @@ static int nau8811_digital_mute(struct snd_soc_dai *dai, int mute, int direction
 
 static const struct snd_soc_dai_ops nau8811_dai_ops = {
 	.startup		= nau8811_dai_startup,
+	.prepare		= nau8811_dai_prepare,
 	.hw_params		= nau8811_hw_params,
 	.set_fmt		= nau8811_set_dai_fmt,
 	.mute_stream		= nau8811_digital_mute,
@@ -984,6 +1287,8 @@ static int nau8811_set_sysclk(struct snd_soc_component *component, int clk_id,
 		return -EINVAL;
 	}
 
+	/* hw_params sets the clock up from the MCLK */
+	nau_hw_params_reset(&nau8811->hw_params_cache);
 	regmap_update_bits(nau8811->regmap, NAU8811_R03_CLK_DIVIDER,
 			   NAU8811_CLK_CODEC_SRC_MASK, clk_id << NAU8811_CLK_CODEC_SRC_SFT);
 	nau8811->mclk = freq;
@@ -992,7 +1297,110 @@ static int nau8811_set_sysclk(struct snd_soc_component *component, int clk_id,
 	return  0;
 }
 
+/* Program the first preset as the default coefficients of the biquad and
+ * add the control selecting the presets.
+ */
+static int nau8811_biq_bank_init(struct snd_soc_component *component,
+				 struct nau8811_biq_bank *bank, const char *name)
+{
+	struct snd_kcontrol_new control = {
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = name,
+		.info = snd_soc_info_enum_double,
+		.get = nau8811_biq_preset_get,
+		.put = nau8811_biq_preset_put,
+		.private_value = (unsigned long)&bank->enum_ctl,
+	};
+	int ret;
+
+	if (!bank->num)
+		return 0;
+
+	bank->enum_ctl.reg = SND_SOC_NOPM;
+	bank->enum_ctl.items = bank->num;
+	bank->enum_ctl.texts = bank->names;
+	ret = nau_biq_rates_write(bank->rates, bank->coeffs[0]);
+	if (ret < 0)
+		return ret;
+
+	return snd_soc_add_component_controls(component, &control, 1);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const nau8811_latency_names[NAU8811_LAT_NUM] = {
+	[NAU8811_LAT_STARTUP] = "startup",
+	[NAU8811_LAT_HW_PARAMS] = "hw_params",
+	[NAU8811_LAT_VCM_CHARGE] = "vcm_charge",
+};
+
+/* The start latency of the streams under the debugfs of the component */
+static void nau8811_debugfs_init(struct snd_soc_component *component)
+{
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+	struct dentry *dir;
+
+	if (!component->debugfs_root)
+		return;
+
+	dir = debugfs_create_dir("start", component->debugfs_root);
+	debugfs_create_u32("playback_us", 0444, dir,
+			   &nau8811->start_us[SNDRV_PCM_STREAM_PLAYBACK]);
+	debugfs_create_u32("capture_us", 0444, dir,
+			   &nau8811->start_us[SNDRV_PCM_STREAM_CAPTURE]);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8811->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+					 &nau8811->regcache_report, nau8811->regmap,
+					 &nau8811_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8811->latency,
+				 nau8811_latency_names, NAU8811_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8811->hw_params_cache);
+	nau_biq_rates_debugfs_init(component->debugfs_root,
+				   "dac_biq_rate_switches", &nau8811->dac_biq_rates);
+	nau_biq_rates_debugfs_init(component->debugfs_root,
+				   "adc_biq_rate_switches", &nau8811->adc_biq_rates);
+}
+#else
+static inline void nau8811_debugfs_init(struct snd_soc_component *component)
+{
+}
+#endif
+
+static int nau8811_component_probe(struct snd_soc_component *component)
+{
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	nau8811_debugfs_init(component);
+	/* get VCM charged early in the low latency mode */
+	if (nau8811->vcm_keep_charged)
+		schedule_work(&nau8811->vcm_work);
+
+	ret = nau8811_biq_bank_init(component, &nau8811->dac_biq_bank,
+				    "DAC BIQ Preset");
+	if (ret)
+		return ret;
+
+	ret = nau8811_biq_bank_init(component, &nau8811->adc_biq_bank,
+				    "ADC BIQ Preset");
+	if (ret)
+		return ret;
+	nau_pm_card_link(component);
+
+	return 0;
+}
+
+static void nau8811_component_remove(struct snd_soc_component *component)
+{
+	struct nau8811 *nau8811 = snd_soc_component_get_drvdata(component);
+
+	cancel_work_sync(&nau8811->vcm_work);
+	nau_pm_card_unlink(component);
+}
+
 static const struct snd_soc_component_driver nau8811_component_driver = {
+	.probe			= nau8811_component_probe,
+	.remove			= nau8811_component_remove,
 	.set_sysclk		= nau8811_set_sysclk,
 	.controls		= nau8811_controls,
 	.num_controls		= ARRAY_SIZE(nau8811_controls),
@@ -1019,6 +1427,52 @@ static void nau8811_print_device_properties(struct nau8811 *nau8811)
 	dev_dbg(dev, "micbias-voltage:      %d\n", nau8811->micbias_voltage);
 	dev_dbg(dev, "vref-impedance:       %d\n", nau8811->vref_impedance);
 	dev_dbg(dev, "dmic-clk-threshold:   %d\n", nau8811->dmic_clk_threshold);
+	dev_dbg(dev, "vcm-keep-charged:     %d\n", nau8811->vcm_keep_charged);
+	dev_dbg(dev, "dac-biq-presets:      %d\n", nau8811->dac_biq_bank.num);
+	dev_dbg(dev, "adc-biq-presets:      %d\n", nau8811->adc_biq_bank.num);
+}
+
+/* The presets of a biquad are named by @names_prop, and @coeffs_prop has
+ * their coefficient words one preset after the other.
+ */
+static void nau8811_read_biq_bank(struct device *dev,
+				  struct nau8811_biq_bank *bank,
+				  const char *names_prop, const char *coeffs_prop)
+{
+	u16 coeffs[NAU8811_BIQ_PRESET_MAX * NAU8811_BIQ_COF_NUM];
+	int i, j, num, ret;
+
+	num = device_property_string_array_count(dev, names_prop);
+	if (num <= 0)
+		return;
+	if (num > NAU8811_BIQ_PRESET_MAX) {
+		dev_warn(dev, "Only the first %d presets of %s\n",
+			 NAU8811_BIQ_PRESET_MAX, names_prop);
+		num = NAU8811_BIQ_PRESET_MAX;
+	}
+	ret = device_property_count_u16(dev, coeffs_prop);
+	if (ret < num * NAU8811_BIQ_COF_NUM) {
+		dev_err(dev, "%s needs %d coefficients for %d presets\n",
+			coeffs_prop, num * NAU8811_BIQ_COF_NUM, num);
+		return;
+	}
+	ret = device_property_read_u16_array(dev, coeffs_prop, coeffs,
+					     num * NAU8811_BIQ_COF_NUM);
+	if (ret)
+		return;
+	ret = device_property_read_string_array(dev, names_prop, bank->names,
+						num);
+	if (ret < 0)
+		return;
+	bank->coeffs = devm_kcalloc(dev, num, sizeof(*bank->coeffs),
+				    GFP_KERNEL);
+	if (!bank->coeffs)
+		return;
+	for (i = 0; i < num; i++)
+		for (j = 0; j < NAU8811_BIQ_COF_NUM; j++)
+			put_unaligned_be16(coeffs[i * NAU8811_BIQ_COF_NUM + j],
+					   &bank->coeffs[i][j * 2]);
+	bank->num = num;
 }
 
 static int nau8811_read_device_properties(struct device *dev, struct nau8811 *nau8811)
@@ -1037,6 +1491,17 @@ static int nau8811_read_device_properties(struct device *dev, struct nau8811 *na
 		&nau8811->dmic_clk_threshold);
 	if (ret)
 		nau8811->dmic_clk_threshold = DMIC_CLK;
+	nau8811->vcm_keep_charged =
+		device_property_read_bool(dev, "nuvoton,vcm-keep-charged");
+
+	nau8811->dac_biq_bank.rates = &nau8811->dac_biq_rates;
+	nau8811_read_biq_bank(dev, &nau8811->dac_biq_bank,
+			      "nuvoton,dac-biq-preset-names",
+			      "nuvoton,dac-biq-presets");
+	nau8811->adc_biq_bank.rates = &nau8811->adc_biq_rates;
+	nau8811_read_biq_bank(dev, &nau8811->adc_biq_bank,
+			      "nuvoton,adc-biq-preset-names",
+			      "nuvoton,adc-biq-presets");
 
 	return 0;
 }
@@ -1045,14 +1510,13 @@ static void nau8811_init_regs(struct nau8811 *nau8811)
 {
 	struct regmap *regmap = nau8811->regmap;
 
-	/* Keep slow rising VREF */
+	/* Keep slow rising VREF. VMID and the bias are enabled after it
+	 * settles, in the vref work, so the probe doesn't wait for it.
+	 */
 	regmap_update_bits(regmap, NAU8811_R76_BOOST,
 			   NAU8811_PDVMDFST_DIS, NAU8811_PDVMDFST_DIS);
-	msleep(600);
-	regmap_update_bits(regmap, NAU8811_R66_BIAS_ADJ,
-			   NAU8811_VMIDEN_EN, NAU8811_VMIDEN_EN);
-	regmap_update_bits(regmap, NAU8811_R76_BOOST,
-			   NAU8811_BIASEN_EN, NAU8811_BIASEN_EN);
+	schedule_delayed_work(&nau8811->vref_work,
+			      msecs_to_jiffies(NAU8811_VREF_SETTLE_MS));
 
 	/* VMID Tieoff setting and enable TESTDAC.
 	 * This sets the analog DAC inputs to a '0' input signal to avoid
@@ -1112,11 +1576,28 @@ static int nau8811_i2c_probe(struct i2c_client *i2c)
 	}
 
 	i2c_set_clientdata(i2c, nau8811);
-	nau8811->regmap = devm_regmap_init_i2c(i2c, &nau8811_regmap_config);
+	nau8811->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&nau8811_regmap_config, &nau8811->regstat);
 	if (IS_ERR(nau8811->regmap))
 		return PTR_ERR(nau8811->regmap);
 
 	nau8811->dev = dev;
+	mutex_init(&nau8811->vcm_lock);
+	nau_biq_rates_init(&nau8811->dac_biq_rates, nau8811->regmap,
+			   NAU8811_R41_BIQ1_COF1, NAU8811_BIQ_COF_NUM * 2,
+			   &nau8811->dac_biq_shadow, 0, 0);
+	nau_biq_rates_init(&nau8811->adc_biq_rates, nau8811->regmap,
+			   NAU8811_R21_BIQ0_COF1, NAU8811_BIQ_COF_NUM * 2,
+			   &nau8811->adc_biq_shadow, 0, 0);
+	INIT_WORK(&nau8811->vcm_work, nau8811_vcm_work);
+	ret = devm_delayed_work_autocancel(dev, &nau8811->vref_work,
+					   nau8811_vref_work);
+	if (ret)
+		return ret;
+	ret = devm_delayed_work_autocancel(dev, &nau8811->adc_unmute_work,
+					   nau8811_adc_unmute_work);
+	if (ret)
+		return ret;
 	nau8811_print_device_properties(nau8811);
 
 	nau8811_reset_chip(nau8811->regmap);
@@ -1126,6 +1607,7 @@ static int nau8811_i2c_probe(struct i2c_client *i2c)
 		return ret;
 	}
 	nau8811_init_regs(nau8811);
+	nau_pm_async_init(dev);
 
 	ret = devm_snd_soc_register_component(&i2c->dev,
 					      &nau8811_component_driver, &nau8811_dai, 1);
@@ -1160,6 +1642,7 @@ static struct i2c_driver nau8811_driver = {
 		.name = "nau8811",
 		.of_match_table = of_match_ptr(nau8811_of_ids),
 		.acpi_match_table = ACPI_PTR(nau8811_acpi_match),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8811_i2c_probe,
 	.id_table = nau8811_i2c_ids,
@@ -1169,3 +1652,7 @@ module_i2c_driver(nau8811_driver);
 MODULE_DESCRIPTION("ASoC NAU8811 driver");
 MODULE_AUTHOR("David Lin <ctlinu0@nuvoton.com>");
 MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_SND_SOC_NAU8811_KUNIT_TEST
+#include "nau8811-test.c"
+#endif
@@ -472,15 +472,75 @@
 
 #define NUVOTON_CODEC_DAI "nau8811-hifi"
 
+#define NAU8811_BIQ_COF_NUM	10
+#define NAU8811_BIQ_PRESET_MAX	8
+
+/* The coefficient presets of a biquad, in big endian words like the bytes
+ * control element, selected by an enumerated control.
+ */
+struct nau8811_biq_bank {
+	struct nau_biq_rates *rates;
+	const char *names[NAU8811_BIQ_PRESET_MAX];
+	u8 (*coeffs)[NAU8811_BIQ_COF_NUM * 2];
+	int num;
+	int sel;
+	struct soc_enum enum_ctl;
+};
+
+/* settle of the DC offset of the ADC before the unmute */
+#define NAU8811_ADC_SETTLE_MS	300
+
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8811_LAT_STARTUP,
+	NAU8811_LAT_HW_PARAMS,
+	NAU8811_LAT_VCM_CHARGE,
+	NAU8811_LAT_NUM,
+};
+
+/* The selection of the OSR of a stream at hw_params */
+enum {
+	NAU8811_OSR_MANUAL,	/* the OSR of the controls */
+	NAU8811_OSR_LOW_LATENCY,
+	NAU8811_OSR_LOW_POWER,
+	NAU8811_OSR_QUALITY,
+};
+
 struct nau8811 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_latency latency[NAU8811_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	int osr_policy;
 	int micbias_voltage;
 	int vref_impedance;
 	unsigned int mclk;
 	unsigned int fs;
 	unsigned int clk_src_sel;
+	struct nau8811_clk_solution clk_cache[NAU8811_CLK_CACHE_NUM];
+	int clk_cache_next;
 	unsigned int dmic_clk_threshold;
+	struct nau_coeff_shadow dac_biq_shadow;
+	struct nau_coeff_shadow adc_biq_shadow;
+	/* the coefficients kept per sampling rate */
+	struct nau_biq_rates dac_biq_rates;
+	struct nau_biq_rates adc_biq_rates;
+	struct nau8811_biq_bank dac_biq_bank;
+	struct nau8811_biq_bank adc_biq_bank;
+	/* VCM held charged across streams for low start latency */
+	bool vcm_keep_charged;
+	bool vcm_charged;
+	bool vcm_active;
+	struct mutex vcm_lock;
+	struct work_struct vcm_work;
+	/* VMID and bias enabling after the VREF settles */
+	struct delayed_work vref_work;
+	/* the ADC unmute after its settle */
+	struct delayed_work adc_unmute_work;
+	ktime_t start_time[2];
+	u32 start_us[2];
 };
 
 /* System Clock Source Select */
@@ -506,6 +566,17 @@ struct nau8811_srate_attr {
 	unsigned int mclk_src[NAU8811_MCLK_FS_RATIO_NUM];
 };
 
+/* the clock solutions of MCLK and fs kept by the codec */
+#define NAU8811_CLK_CACHE_NUM 4
+
+struct nau8811_clk_solution {
+	unsigned int mclk;	/* 0 if the entry is unused */
+	unsigned int fs;
+	int mult;		/* index of mclk_src_mult */
+	int div;		/* index of mclk_src_div */
+	int ratio;
+};
+
 struct nau8811_osr_attr {
 	unsigned int osr;
 	unsigned int clk_src;
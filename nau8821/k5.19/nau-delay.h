@@ -0,0 +1,71 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Codec delay reported to the PCM of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_DELAY_H__
+#define __NAU_DELAY_H__
+
+#include <linux/compiler.h>
+#include <linux/debugfs.h>
+#include <linux/kernel.h>
+#include <sound/pcm.h>
+
+/* The group delay of the filters of a sigma-delta converter. The last
+ * stages run at fs, so their part is a count of frames; the first ones run
+ * at the modulator rate, OSR * fs, so their part in frames shrinks as the
+ * OSR grows.
+ */
+struct nau_delay_filter {
+	unsigned int fs_taps;	/* group delay at fs, in samples */
+	unsigned int mod_taps;	/* group delay at OSR * fs, in samples */
+};
+
+static inline unsigned int nau_delay_filter_frames(
+	const struct nau_delay_filter *filter, unsigned int osr)
+{
+	return filter->fs_taps + (osr ? DIV_ROUND_UP(filter->mod_taps, osr) : 0);
+}
+
+/* The frames between the interface and the pins of each direction. The
+ * delay op runs from the PCM pointer, in atomic context, so the delay is
+ * worked out at hw_params from the OSR and the path applied and only read
+ * back there.
+ */
+struct nau_delay {
+	unsigned int frames[2];
+};
+
+static inline void nau_delay_set(struct nau_delay *delay, int stream,
+	unsigned int frames)
+{
+	WRITE_ONCE(delay->frames[stream], frames);
+}
+
+static inline snd_pcm_sframes_t nau_delay_get(struct nau_delay *delay,
+	int stream)
+{
+	return READ_ONCE(delay->frames[stream]);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_delay_debugfs_init(struct dentry *root,
+	struct nau_delay *delay)
+{
+	if (!root)
+		return;
+	debugfs_create_u32("playback_delay_frames", 0444, root,
+			   &delay->frames[SNDRV_PCM_STREAM_PLAYBACK]);
+	debugfs_create_u32("capture_delay_frames", 0444, root,
+			   &delay->frames[SNDRV_PCM_STREAM_CAPTURE]);
+}
+#else
+static inline void nau_delay_debugfs_init(struct dentry *root,
+	struct nau_delay *delay)
+{
+}
+#endif
+
+#endif /* __NAU_DELAY_H__ */
@@ -0,0 +1,289 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the FLL parameter solver of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/module.h>
+
+#include "nau-fll.h"
+
+/* The FLL of NAU88L24, NAU88L25, NAU85L40 and NAU88L21 */
+#define NAU_FLL_TEST_FREF_MAX	13500000
+#define NAU_FLL_TEST_FVCO_MAX	124000000
+#define NAU_FLL_TEST_FVCO_MIN	90000000
+
+static const struct nau_fll_attr nau_fll_test_mclk_src[] = {
+	{ 1, 0x0 }, { 2, 0x2 }, { 4, 0x3 }, { 8, 0x4 }, { 16, 0x5 },
+	{ 32, 0x6 }, { 3, 0x7 }, { 6, 0xa }, { 12, 0xb }, { 24, 0xc },
+	{ 48, 0xd }, { 96, 0xe }, { 5, 0xf },
+};
+
+static const struct nau_fll_attr nau_fll_test_ratio[] = {
+	{ 512000, 0x01 }, { 256000, 0x02 }, { 128000, 0x04 },
+	{ 64000, 0x08 }, { 32000, 0x10 }, { 8000, 0x20 }, { 4000, 0x40 },
+};
+
+static const struct nau_fll_attr nau_fll_test_pre_scalar[] = {
+	{ 1, 0x0 }, { 2, 0x1 }, { 4, 0x2 }, { 8, 0x3 },
+};
+
+static const struct nau_fll_desc nau_fll_test_desc = {
+	.mclk_src = nau_fll_test_mclk_src,
+	.num_mclk_src = ARRAY_SIZE(nau_fll_test_mclk_src),
+	.ratio = nau_fll_test_ratio,
+	.num_ratio = ARRAY_SIZE(nau_fll_test_ratio),
+	.pre_scalar = nau_fll_test_pre_scalar,
+	.num_pre_scalar = ARRAY_SIZE(nau_fll_test_pre_scalar),
+	.fref_max = NAU_FLL_TEST_FREF_MAX,
+	.fvco_min = NAU_FLL_TEST_FVCO_MIN,
+	.fvco_max = NAU_FLL_TEST_FVCO_MAX,
+};
+
+/* The master clocks of the boards, the bit clocks of the FLL_BLK mode
+ * included, and the sample rates of the drivers.
+ */
+static const unsigned int nau_fll_test_mclk[] = {
+	256000, 512000, 1024000, 1411200, 1536000, 2048000, 2822400,
+	3072000, 4096000, 5644800, 6144000, 11289600, 12000000, 12288000,
+	13000000, 19200000, 22579200, 24000000, 24576000, 26000000,
+	38400000, 49152000,
+};
+
+static const unsigned int nau_fll_test_fs[] = {
+	8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000,
+	64000, 88200, 96000, 176400, 192000,
+};
+
+static unsigned int nau_fll_test_param(const struct nau_fll_attr *attr,
+	unsigned int num, unsigned int val)
+{
+	unsigned int i;
+
+	for (i = 0; i < num; i++)
+		if (attr[i].val == val)
+			return attr[i].param;
+
+	return 0;
+}
+
+/* Whether one of the scalings puts the DCO of @fs in the limits */
+static bool nau_fll_test_fvco_ok(const struct nau_fll_desc *desc,
+	unsigned int fs)
+{
+	unsigned int i;
+	u64 fvco;
+
+	for (i = 0; i < desc->num_mclk_src; i++) {
+		fvco = 256ULL * fs * 2 * desc->mclk_src[i].param;
+		if (fvco > desc->fvco_min && fvco < desc->fvco_max)
+			return true;
+	}
+
+	return false;
+}
+
+/* Check a solution against the limits of the FLL: FREF at most fref_max,
+ * FDCO strictly within fvco_min and fvco_max, the 10 bit integer part not
+ * truncated, and FREF * ratio * (int + frac) equal to FDCO to one LSB of
+ * the fraction.
+ */
+static void nau_fll_test_check(struct kunit *test,
+	const struct nau_fll_desc *desc, unsigned int fll_in,
+	unsigned int fs, unsigned int frac_bits, const struct nau_fll *fll)
+{
+	unsigned int pre, ratio, scale, fref;
+	u64 fvco, out, want;
+
+	pre = nau_fll_test_param(desc->pre_scalar, desc->num_pre_scalar,
+				 fll->clk_ref_div);
+	ratio = nau_fll_test_param(desc->ratio, desc->num_ratio, fll->ratio);
+	scale = nau_fll_test_param(desc->mclk_src, desc->num_mclk_src,
+				   fll->mclk_src);
+	KUNIT_ASSERT_NE(test, pre, 0U);
+	KUNIT_ASSERT_NE(test, scale, 0U);
+	KUNIT_ASSERT_NE(test, ratio, 0U);
+	/* the code of a ratio is its multiplier, the param its threshold */
+	KUNIT_EXPECT_GE(test, fll_in / pre, ratio);
+	ratio = fll->ratio;
+
+	fref = fll_in / pre;
+	KUNIT_EXPECT_LE_MSG(test, fref, desc->fref_max,
+			    "mclk %u fs %u", fll_in, fs);
+	fvco = 256ULL * fs * 2 * scale;
+	KUNIT_EXPECT_GT_MSG(test, fvco, (u64)desc->fvco_min,
+			    "mclk %u fs %u", fll_in, fs);
+	KUNIT_EXPECT_LT_MSG(test, fvco, (u64)desc->fvco_max,
+			    "mclk %u fs %u", fll_in, fs);
+
+	KUNIT_EXPECT_LT(test, (unsigned int)fll->fll_frac, 1U << frac_bits);
+	want = div_u64(fvco << frac_bits, fref * ratio);
+	KUNIT_EXPECT_LE_MSG(test, want >> frac_bits, 0x3ffULL,
+			    "integer part truncated, mclk %u fs %u",
+			    fll_in, fs);
+	out = ((u64)fll->fll_int << frac_bits) + fll->fll_frac;
+	KUNIT_EXPECT_EQ_MSG(test, out, want, "mclk %u fs %u", fll_in, fs);
+	/* FREF * ratio * N is FDCO within the resolution of N */
+	out = div_u64(out * fref * ratio, 1U << frac_bits);
+	KUNIT_EXPECT_LE_MSG(test, fvco - out,
+			    div_u64((u64)fref * ratio, 1U << frac_bits) + 1,
+			    "mclk %u fs %u", fll_in, fs);
+}
+
+/* Every MCLK and fs of the drivers, with both fractional widths. A clock
+ * without a solution has no pre-scalar or no scaling in the limits.
+ */
+static void nau_fll_test_sweep(struct kunit *test)
+{
+	const struct nau_fll_desc *desc = &nau_fll_test_desc;
+	static const unsigned int frac_bits[] = { 16, 24 };
+	unsigned int i, j, k, solved = 0, calls = 0;
+	struct nau_fll fll;
+	ktime_t start;
+	u64 ns = 0;
+	int ret;
+
+	for (i = 0; i < ARRAY_SIZE(nau_fll_test_mclk); i++)
+		for (j = 0; j < ARRAY_SIZE(nau_fll_test_fs); j++)
+			for (k = 0; k < ARRAY_SIZE(frac_bits); k++) {
+				start = ktime_get();
+				ret = nau_fll_calc(desc, nau_fll_test_mclk[i],
+						   nau_fll_test_fs[j],
+						   frac_bits[k], &fll);
+				ns += ktime_to_ns(ktime_sub(ktime_get(),
+							    start));
+				calls++;
+				if (ret) {
+					KUNIT_EXPECT_EQ(test, ret, -EINVAL);
+					KUNIT_EXPECT_TRUE_MSG(test,
+						nau_fll_test_mclk[i] / 8 >
+						desc->fref_max ||
+						!nau_fll_test_fvco_ok(desc,
+							nau_fll_test_fs[j]),
+						"no solution, mclk %u fs %u",
+						nau_fll_test_mclk[i],
+						nau_fll_test_fs[j]);
+					continue;
+				}
+				solved++;
+				nau_fll_test_check(test, desc,
+						   nau_fll_test_mclk[i],
+						   nau_fll_test_fs[j],
+						   frac_bits[k], &fll);
+			}
+	/* all the rates of the drivers lock from the common clocks */
+	KUNIT_EXPECT_EQ(test, solved, calls);
+	kunit_info(test, "%u solutions, %llu ns per call\n", solved,
+		   div_u64(ns, calls));
+}
+
+static void nau_fll_test_out_of_range(struct kunit *test)
+{
+	const struct nau_fll_desc *desc = &nau_fll_test_desc;
+	struct nau_fll fll;
+
+	/* FREF above the limit even divided by 8 */
+	KUNIT_EXPECT_EQ(test, nau_fll_calc(desc, 8 * NAU_FLL_TEST_FREF_MAX + 8,
+					   48000, 16, &fll), -EINVAL);
+	/* FREF below the smallest ratio threshold */
+	KUNIT_EXPECT_EQ(test, nau_fll_calc(desc, 2000, 48000, 16, &fll),
+			-EINVAL);
+	KUNIT_EXPECT_EQ(test, nau_fll_calc(desc, 0, 48000, 16, &fll),
+			-EINVAL);
+	/* no scaling puts the DCO of 1 kHz in the limits */
+	KUNIT_EXPECT_EQ(test, nau_fll_calc(desc, 12288000, 1000, 16, &fll),
+			-EINVAL);
+}
+
+/* The cached solutions are the ones of nau_fll_calc(), and the cache
+ * keeps the last NAU_FLL_CACHE_NUM clocks.
+ */
+static void nau_fll_test_cache(struct kunit *test)
+{
+	const struct nau_fll_desc *desc = &nau_fll_test_desc;
+	struct nau_fll_cache cache = { };
+	struct nau_fll fll, want;
+	unsigned int i;
+
+	for (i = 0; i <= NAU_FLL_CACHE_NUM; i++) {
+		KUNIT_ASSERT_EQ(test, nau_fll_solve(desc, &cache,
+			nau_fll_test_mclk[i + 5], 48000, 16, &fll), 0);
+		KUNIT_ASSERT_EQ(test, nau_fll_calc(desc,
+			nau_fll_test_mclk[i + 5], 48000, 16, &want), 0);
+		KUNIT_EXPECT_EQ(test, memcmp(&fll, &want, sizeof(fll)), 0);
+	}
+	KUNIT_EXPECT_EQ(test, cache.num, (unsigned int)NAU_FLL_CACHE_NUM);
+	/* the first clock made room for the last one */
+	for (i = 0; i < cache.num; i++)
+		KUNIT_EXPECT_NE(test, cache.entry[i].fll_in,
+				nau_fll_test_mclk[5]);
+
+	/* a hit leaves the cache as it is */
+	i = cache.next;
+	KUNIT_ASSERT_EQ(test, nau_fll_solve(desc, &cache,
+		nau_fll_test_mclk[9], 48000, 16, &fll), 0);
+	KUNIT_ASSERT_EQ(test, nau_fll_calc(desc, nau_fll_test_mclk[9], 48000,
+					   16, &want), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(&fll, &want, sizeof(fll)), 0);
+	KUNIT_EXPECT_EQ(test, cache.next, i);
+
+	/* another fractional width is another key */
+	KUNIT_ASSERT_EQ(test, nau_fll_solve(desc, &cache,
+		nau_fll_test_mclk[9], 48000, 24, &fll), 0);
+	KUNIT_ASSERT_EQ(test, nau_fll_calc(desc, nau_fll_test_mclk[9], 48000,
+					   24, &want), 0);
+	KUNIT_EXPECT_EQ(test, memcmp(&fll, &want, sizeof(fll)), 0);
+	KUNIT_EXPECT_NE(test, cache.next, i);
+
+	/* a failure is not cached */
+	i = cache.next;
+	KUNIT_EXPECT_EQ(test, nau_fll_solve(desc, &cache, 0, 48000, 16, &fll),
+			-EINVAL);
+	KUNIT_EXPECT_EQ(test, cache.next, i);
+}
+
+/* The time of a cache hit against the one of a solve */
+static void nau_fll_test_cache_time(struct kunit *test)
+{
+	const struct nau_fll_desc *desc = &nau_fll_test_desc;
+	struct nau_fll_cache cache = { };
+	struct nau_fll fll;
+	u64 calc_ns, hit_ns;
+	ktime_t start;
+	int i;
+
+	start = ktime_get();
+	for (i = 0; i < 1000; i++)
+		nau_fll_calc(desc, 12288000, 44100, 16, &fll);
+	calc_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	nau_fll_solve(desc, &cache, 12288000, 44100, 16, &fll);
+	start = ktime_get();
+	for (i = 0; i < 1000; i++)
+		nau_fll_solve(desc, &cache, 12288000, 44100, 16, &fll);
+	hit_ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+
+	kunit_info(test, "solve %llu ns, cache hit %llu ns\n",
+		   div_u64(calc_ns, 1000), div_u64(hit_ns, 1000));
+}
+
+static struct kunit_case nau_fll_test_cases[] = {
+	KUNIT_CASE(nau_fll_test_sweep),
+	KUNIT_CASE(nau_fll_test_out_of_range),
+	KUNIT_CASE(nau_fll_test_cache),
+	KUNIT_CASE(nau_fll_test_cache_time),
+	{}
+};
+
+static struct kunit_suite nau_fll_test_suite = {
+	.name = "nau-fll",
+	.test_cases = nau_fll_test_cases,
+};
+
+kunit_test_suite(nau_fll_test_suite);
+
+MODULE_DESCRIPTION("KUnit tests of the Nuvoton FLL solver");
+MODULE_LICENSE("GPL");
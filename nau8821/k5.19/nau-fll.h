@@ -0,0 +1,197 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * FLL parameter solver of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_FLL_H__
+#define __NAU_FLL_H__
+
+#include <linux/delay.h>
+#include <linux/errno.h>
+#include <linux/kernel.h>
+#include <linux/math64.h>
+
+#include "nau-common.h"
+
+struct nau_fll_attr {
+	unsigned int param;
+	unsigned int val;
+};
+
+/* The FLL of a codec: the tables of the dividers and the limits of the
+ * reference and DCO frequencies.
+ */
+struct nau_fll_desc {
+	const struct nau_fll_attr *mclk_src;
+	unsigned int num_mclk_src;
+	const struct nau_fll_attr *ratio;
+	unsigned int num_ratio;
+	const struct nau_fll_attr *pre_scalar;
+	unsigned int num_pre_scalar;
+	unsigned int fref_max;
+	unsigned int fvco_min;
+	unsigned int fvco_max;
+};
+
+struct nau_fll {
+	int mclk_src;
+	int ratio;
+	int fll_frac;
+	int fll_int;
+	int clk_ref_div;
+};
+
+/* The solutions for the last clocks. The machine drivers switch between
+ * a few rates, so a small cache spares most of the solving.
+ */
+#define NAU_FLL_CACHE_NUM	4
+
+struct nau_fll_cache_entry {
+	unsigned int fll_in;
+	unsigned int fs;
+	unsigned int frac_bits;
+	struct nau_fll fll;
+};
+
+struct nau_fll_cache {
+	struct nau_fll_cache_entry entry[NAU_FLL_CACHE_NUM];
+	unsigned int num;
+	unsigned int next;
+};
+
+/**
+ * nau_fll_calc - Calculate FLL parameters.
+ * @desc: FLL of the codec.
+ * @fll_in: external clock provided to codec.
+ * @fs: sampling rate.
+ * @frac_bits: bits of the fractional input, 16 or 24.
+ * @fll: Pointer to structure of FLL parameters.
+ *
+ * Returns 0 for success or negative error code.
+ */
+#ifdef NAU_COMMON_DECLARE
+int nau_fll_calc(const struct nau_fll_desc *desc, unsigned int fll_in,
+	unsigned int fs, unsigned int frac_bits, struct nau_fll *fll);
+#else
+NAU_COMMON_API int nau_fll_calc(const struct nau_fll_desc *desc,
+	unsigned int fll_in, unsigned int fs, unsigned int frac_bits,
+	struct nau_fll *fll)
+{
+	u64 fvco, fvco_max;
+	unsigned int fref, i, fvco_sel;
+
+	/* Ensure the reference clock frequency (FREF) is <= 13.5MHz by dividing
+	 * freq_in by 1, 2, 4, or 8 using FLL pre-scalar.
+	 */
+	for (i = 0; i < desc->num_pre_scalar; i++) {
+		fref = fll_in / desc->pre_scalar[i].param;
+		if (fref <= desc->fref_max)
+			break;
+	}
+	if (i == desc->num_pre_scalar)
+		return -EINVAL;
+	fll->clk_ref_div = desc->pre_scalar[i].val;
+
+	/* Choose the FLL ratio based on FREF */
+	for (i = 0; i < desc->num_ratio; i++) {
+		if (fref >= desc->ratio[i].param)
+			break;
+	}
+	if (i == desc->num_ratio)
+		return -EINVAL;
+	fll->ratio = desc->ratio[i].val;
+
+	/* Calculate the frequency of DCO (FDCO) given freq_out = 256 * Fs.
+	 * FDCO must be within the limits of the codec or the FFL cannot be
+	 * guaranteed across the full range of operation.
+	 * FDCO = freq_out * 2 * mclk_src_scaling
+	 */
+	fvco_max = 0;
+	fvco_sel = desc->num_mclk_src;
+	for (i = 0; i < desc->num_mclk_src; i++) {
+		fvco = 256ULL * fs * 2 * desc->mclk_src[i].param;
+		if (fvco > desc->fvco_min && fvco < desc->fvco_max &&
+			fvco_max < fvco) {
+			fvco_max = fvco;
+			fvco_sel = i;
+		}
+	}
+	if (fvco_sel == desc->num_mclk_src)
+		return -EINVAL;
+	fll->mclk_src = desc->mclk_src[fvco_sel].val;
+
+	/* Calculate the FLL 10-bit integer input and the FLL fractional
+	 * input based on FDCO, FREF and FLL ratio.
+	 */
+	fvco = div_u64(fvco_max << frac_bits, fref * fll->ratio);
+	fll->fll_int = (fvco >> frac_bits) & 0x3ff;
+	fll->fll_frac = fvco & ((1U << frac_bits) - 1);
+
+	return 0;
+}
+#endif
+
+/**
+ * nau_fll_solve - Get FLL parameters, from the cache when possible.
+ * @desc: FLL of the codec.
+ * @cache: solutions of the codec, replaced in order when full.
+ * @fll_in: external clock provided to codec.
+ * @fs: sampling rate.
+ * @frac_bits: bits of the fractional input, 16 or 24.
+ * @fll: Pointer to structure of FLL parameters.
+ *
+ * Returns 0 for success or negative error code.
+ */
+#ifdef NAU_COMMON_DECLARE
+int nau_fll_solve(const struct nau_fll_desc *desc,
+	struct nau_fll_cache *cache, unsigned int fll_in, unsigned int fs,
+	unsigned int frac_bits, struct nau_fll *fll);
+#else
+NAU_COMMON_API int nau_fll_solve(const struct nau_fll_desc *desc,
+	struct nau_fll_cache *cache, unsigned int fll_in, unsigned int fs,
+	unsigned int frac_bits, struct nau_fll *fll)
+{
+	struct nau_fll_cache_entry *entry;
+	unsigned int i;
+	int ret;
+
+	for (i = 0; i < cache->num; i++) {
+		entry = &cache->entry[i];
+		if (entry->fll_in == fll_in && entry->fs == fs &&
+		    entry->frac_bits == frac_bits) {
+			*fll = entry->fll;
+			return 0;
+		}
+	}
+
+	ret = nau_fll_calc(desc, fll_in, fs, frac_bits, fll);
+	if (ret)
+		return ret;
+
+	entry = &cache->entry[cache->next];
+	entry->fll_in = fll_in;
+	entry->fs = fs;
+	entry->frac_bits = frac_bits;
+	entry->fll = *fll;
+	cache->next = (cache->next + 1) % NAU_FLL_CACHE_NUM;
+	if (cache->num < NAU_FLL_CACHE_NUM)
+		cache->num++;
+
+	return 0;
+}
+#endif
+
+/* The FLL has no lock status to poll. Its lock time is waited in a
+ * sleep with an upper bound, which doesn't spin the CPU.
+ */
+#define NAU_FLL_LOCK_US		2000
+#define NAU_FLL_LOCK_MAX_US	2500
+
+static inline void nau_fll_wait_lock(void)
+{
+	usleep_range(NAU_FLL_LOCK_US, NAU_FLL_LOCK_MAX_US);
+}
+
+#endif /* __NAU_FLL_H__ */
@@ -0,0 +1,50 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Jack type detection settle of the Nuvoton headset codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_JDET_H__
+#define __NAU_JDET_H__
+
+#include <linux/delay.h>
+#include <linux/kernel.h>
+
+/* The wait before the first sample of the jack type detection, adapted
+ * to the jacks of the board. It's halved down to @min_ms after each
+ * detection settled at once, and doubled up to @max_ms after one which
+ * needed more samples. The confirmation by the samples that follow is
+ * left to the driver, so a short wait only costs one more sample.
+ */
+struct nau_jdet_settle {
+	unsigned int min_ms;
+	unsigned int max_ms;
+	unsigned int cur_ms;
+};
+
+static inline void nau_jdet_settle_init(struct nau_jdet_settle *settle,
+	unsigned int min_ms, unsigned int max_ms)
+{
+	settle->min_ms = min(min_ms, max_ms);
+	settle->max_ms = max_ms;
+	settle->cur_ms = max_ms;
+}
+
+static inline void nau_jdet_settle_wait(struct nau_jdet_settle *settle)
+{
+	if (settle->cur_ms)
+		msleep(settle->cur_ms);
+}
+
+static inline void nau_jdet_settle_update(struct nau_jdet_settle *settle,
+	bool at_once)
+{
+	if (at_once)
+		settle->cur_ms = max(settle->cur_ms / 2, settle->min_ms);
+	else
+		settle->cur_ms = min(max(settle->cur_ms * 2, 1U),
+			settle->max_ms);
+}
+
+#endif /* __NAU_JDET_H__ */
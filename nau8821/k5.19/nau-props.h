@@ -0,0 +1,129 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Board profile of the Nuvoton headset codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_PROPS_H__
+#define __NAU_PROPS_H__
+
+#include <linux/device.h>
+#include <linux/list.h>
+#include <linux/mutex.h>
+#include <linux/overflow.h>
+#include <linux/property.h>
+#include <linux/slab.h>
+#include <linux/stddef.h>
+#include <linux/string.h>
+
+/* A device property of one cell, read into an int or u32 member of the
+ * driver data, which takes @def when the property is absent.
+ */
+struct nau_prop_u32 {
+	const char *name;
+	size_t offset;
+	u32 def;
+};
+
+#define NAU_PROP_U32(type, member, prop, val) \
+	{ .name = prop, .offset = offsetof(type, member), .def = val }
+
+static inline void nau_props_read_u32(struct device *dev, void *data,
+	const struct nau_prop_u32 *props, int num)
+{
+	u32 *val;
+	int i;
+
+	for (i = 0; i < num; i++) {
+		val = data + props[i].offset;
+		if (device_property_read_u32(dev, props[i].name, val))
+			*val = props[i].def;
+	}
+}
+
+/* The board profile, the driver data as the device properties left it,
+ * is kept while the probe is deferred. The retries restore it instead of
+ * parsing the properties and matching the quirks again. The profile is
+ * dropped as the probe ends in any other way.
+ */
+struct nau_props_cache_entry {
+	struct list_head node;
+	struct device *dev;
+	size_t size;
+	u8 data[];
+};
+
+static LIST_HEAD(nau_props_cache);
+static DEFINE_MUTEX(nau_props_cache_lock);
+
+static inline struct nau_props_cache_entry *
+nau_props_cache_find(struct device *dev)
+{
+	struct nau_props_cache_entry *entry;
+
+	list_for_each_entry(entry, &nau_props_cache, node)
+		if (entry->dev == dev)
+			return entry;
+
+	return NULL;
+}
+
+/* Returns true if the profile of @dev is restored into @data */
+static inline bool nau_props_cache_restore(struct device *dev, void *data,
+	size_t size)
+{
+	struct nau_props_cache_entry *entry;
+	bool found = false;
+
+	mutex_lock(&nau_props_cache_lock);
+	entry = nau_props_cache_find(dev);
+	if (entry && entry->size == size) {
+		memcpy(data, entry->data, size);
+		found = true;
+	}
+	mutex_unlock(&nau_props_cache_lock);
+
+	return found;
+}
+
+/* Keep the profile just parsed; without memory, the retry parses again */
+static inline void nau_props_cache_store(struct device *dev, const void *data,
+	size_t size)
+{
+	struct nau_props_cache_entry *entry;
+
+	mutex_lock(&nau_props_cache_lock);
+	if (nau_props_cache_find(dev))
+		goto unlock;
+	entry = kmalloc(struct_size(entry, data, size), GFP_KERNEL);
+	if (!entry)
+		goto unlock;
+	entry->dev = dev;
+	entry->size = size;
+	memcpy(entry->data, data, size);
+	list_add(&entry->node, &nau_props_cache);
+unlock:
+	mutex_unlock(&nau_props_cache_lock);
+}
+
+/* The probe is done with the profile of @dev unless it's deferred */
+static inline int nau_props_cache_end(struct device *dev, int ret)
+{
+	struct nau_props_cache_entry *entry;
+
+	if (ret == -EPROBE_DEFER)
+		return ret;
+
+	mutex_lock(&nau_props_cache_lock);
+	entry = nau_props_cache_find(dev);
+	if (entry) {
+		list_del(&entry->node);
+		kfree(entry);
+	}
+	mutex_unlock(&nau_props_cache_lock);
+
+	return ret;
+}
+
+#endif /* __NAU_PROPS_H__ */
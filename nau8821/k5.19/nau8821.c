@@ -14,8 +14,10 @@
 #include <linux/i2c.h>
 #include <linux/module.h>
 #include <linux/math64.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/initval.h>
 #include <sound/jack.h>
@@ -23,6 +25,19 @@
 #include <sound/pcm_params.h>
 #include <sound/soc.h>
 #include <sound/tlv.h>
+#include "nau-biq.h"
+#include "nau-clkplan.h"
+#include "nau-dapm-stat.h"
+#include "nau-delay.h"
+#include "nau-hwparams.h"
+#include "nau-irq.h"
+#include "nau-jack.h"
+#include "nau-jdet.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-props.h"
+#include "nau-regmap.h"
+#include "nau-fll.h"
 #include "nau8821.h"
 
 #define NAU_FREF_MAX 13500000
@@ -32,24 +47,17 @@
 /* the maximum frequency of CLK_ADC and CLK_DAC */
 #define CLK_DA_AD_MAX 6144000
 
+/* KEYDET is confirmed by two samples in a row with the interval */
+#define NAU8821_JDET_CONFIRM_MS 5
+#define NAU8821_JDET_SAMPLE_MAX 4
+
 static int nau8821_configure_sysclk(struct nau8821 *nau8821,
 	int clk_id, unsigned int freq);
-
-struct nau8821_fll {
-	int mclk_src;
-	int ratio;
-	int fll_frac;
-	int fll_int;
-	int clk_ref_div;
-};
-
-struct nau8821_fll_attr {
-	unsigned int param;
-	unsigned int val;
-};
+static int nau8821_clk_plan_run(struct nau8821 *nau8821,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai);
 
 /* scaling for mclk from sysclk_src output */
-static const struct nau8821_fll_attr mclk_src_scaling[] = {
+static const struct nau_fll_attr mclk_src_scaling[] = {
 	{ 1, 0x0 },
 	{ 2, 0x2 },
 	{ 4, 0x3 },
@@ -66,7 +74,7 @@ static const struct nau8821_fll_attr mclk_src_scaling[] = {
 };
 
 /* ratio for input clk freq */
-static const struct nau8821_fll_attr fll_ratio[] = {
+static const struct nau_fll_attr fll_ratio[] = {
 	{ 512000, 0x01 },
 	{ 256000, 0x02 },
 	{ 128000, 0x04 },
@@ -76,11 +84,23 @@ static const struct nau8821_fll_attr fll_ratio[] = {
 	{ 4000, 0x40 },
 };
 
-static const struct nau8821_fll_attr fll_pre_scalar[] = {
-	{ 0, 0x0 },
-	{ 1, 0x1 },
-	{ 2, 0x2 },
-	{ 3, 0x3 },
+static const struct nau_fll_attr fll_pre_scalar[] = {
+	{ 1, 0x0 },
+	{ 2, 0x1 },
+	{ 4, 0x2 },
+	{ 8, 0x3 },
+};
+
+static const struct nau_fll_desc nau8821_fll_desc = {
+	.mclk_src = mclk_src_scaling,
+	.num_mclk_src = ARRAY_SIZE(mclk_src_scaling),
+	.ratio = fll_ratio,
+	.num_ratio = ARRAY_SIZE(fll_ratio),
+	.pre_scalar = fll_pre_scalar,
+	.num_pre_scalar = ARRAY_SIZE(fll_pre_scalar),
+	.fref_max = NAU_FREF_MAX,
+	.fvco_min = NAU_FVCO_MIN,
+	.fvco_max = NAU_FVCO_MAX,
 };
 
 /* over sampling rate */
@@ -104,6 +124,10 @@ static const struct nau8821_osr_attr osr_adc_sel[] = {
 	{ 256, 0 },	/* OSR 256, SRC 1 */
 };
 
+/* the group delay of the converter filters, by their design */
+static const struct nau_delay_filter nau8821_dac_filter = { 17, 128 };
+static const struct nau_delay_filter nau8821_adc_filter = { 13, 96 };
+
 struct nau8821_dmic_speed {
 	unsigned int param;
 	unsigned int val;
@@ -196,75 +220,75 @@ static const struct reg_default nau8821_reg_defaults[] = {
 	{ NAU8821_R80_CHARGE_PUMP, 0x0 },
 };
 
+#define NAU8821_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8821_R00_RESET, NAU8821_R01_ENA_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R03_CLK_DIVIDER, NAU8821_R0B_FLL8) |	\
+	NAU_REG(w, NAU8821_R0D_JACK_DET_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8821_R0F_INTERRUPT_MASK, NAU8821_R13_DMIC_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R1A_GPIO12_CTRL, NAU8821_R1F_RIGHT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8821_R21_BIQ0_COF1, NAU8821_R2D_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8821_R2F_DAC_DGAIN_CTRL, NAU8821_R32_HSVOL_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R34_DACR_CTRL, NAU8821_R3D_DAC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8821_R41_BIQ1_COF1, NAU8821_R4F_FUSE_CTRL3) |	\
+	NAU_REG(w, NAU8821_R51_FUSE_CTRL1) |				\
+	NAU_REG_RANGE(w, NAU8821_R53_OTPDOUT_1, NAU8821_R55_MISC_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R58_I2C_DEVICE_ID, NAU8821_R5A_SOFTWARE_RST) |	\
+	NAU_REG(w, NAU8821_R66_BIAS_ADJ) |				\
+	NAU_REG_RANGE(w, NAU8821_R68_TRIM_SETTINGS, NAU8821_R6B_PGA_MUTE) |	\
+	NAU_REG_RANGE(w, NAU8821_R71_ANALOG_ADC_1, NAU8821_R74_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8821_R76_BOOST, NAU8821_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8821_R7E_PGA_GAIN, NAU8821_R82_GENERAL_STATUS))
+
+static const u32 nau8821_readable_map[] = NAU_REGMAP(NAU8821_READABLE_REGS);
+
 static bool nau8821_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8821_R00_RESET ... NAU8821_R01_ENA_CTRL:
-	case NAU8821_R03_CLK_DIVIDER ... NAU8821_R0B_FLL8:
-	case NAU8821_R0D_JACK_DET_CTRL:
-	case NAU8821_R0F_INTERRUPT_MASK ... NAU8821_R13_DMIC_CTRL:
-	case NAU8821_R1A_GPIO12_CTRL ... NAU8821_R1F_RIGHT_TIME_SLOT:
-	case NAU8821_R21_BIQ0_COF1 ... NAU8821_R2D_DAC_CTRL2:
-	case NAU8821_R2F_DAC_DGAIN_CTRL ... NAU8821_R32_HSVOL_CTRL:
-	case NAU8821_R34_DACR_CTRL ... NAU8821_R3D_DAC_DRC_ATKDCY:
-	case NAU8821_R41_BIQ1_COF1 ... NAU8821_R4F_FUSE_CTRL3:
-	case NAU8821_R51_FUSE_CTRL1:
-	case NAU8821_R53_OTPDOUT_1 ... NAU8821_R55_MISC_CTRL:
-	case NAU8821_R58_I2C_DEVICE_ID ... NAU8821_R5A_SOFTWARE_RST:
-	case NAU8821_R66_BIAS_ADJ:
-	case NAU8821_R68_TRIM_SETTINGS ... NAU8821_R6B_PGA_MUTE:
-	case NAU8821_R71_ANALOG_ADC_1 ... NAU8821_R74_MIC_BIAS:
-	case NAU8821_R76_BOOST ... NAU8821_R77_FEPGA:
-	case NAU8821_R7E_PGA_GAIN ... NAU8821_R82_GENERAL_STATUS:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8821_readable_map, reg);
 }
 
+#define NAU8821_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8821_R00_RESET, NAU8821_R01_ENA_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R03_CLK_DIVIDER, NAU8821_R0B_FLL8) |	\
+	NAU_REG(w, NAU8821_R0D_JACK_DET_CTRL) |				\
+	NAU_REG(w, NAU8821_R0F_INTERRUPT_MASK) |			\
+	NAU_REG_RANGE(w, NAU8821_R11_INT_CLR_KEY_STATUS, NAU8821_R13_DMIC_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R1A_GPIO12_CTRL, NAU8821_R1F_RIGHT_TIME_SLOT) |	\
+	NAU_REG_RANGE(w, NAU8821_R21_BIQ0_COF1, NAU8821_R2D_DAC_CTRL2) |	\
+	NAU_REG_RANGE(w, NAU8821_R2F_DAC_DGAIN_CTRL, NAU8821_R32_HSVOL_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R34_DACR_CTRL, NAU8821_R3D_DAC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8821_R41_BIQ1_COF1, NAU8821_R4C_IMM_MODE_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8821_R4E_FUSE_CTRL2, NAU8821_R4F_FUSE_CTRL3) |	\
+	NAU_REG(w, NAU8821_R51_FUSE_CTRL1) |				\
+	NAU_REG(w, NAU8821_R55_MISC_CTRL) |				\
+	NAU_REG(w, NAU8821_R5A_SOFTWARE_RST) |				\
+	NAU_REG(w, NAU8821_R66_BIAS_ADJ) |				\
+	NAU_REG_RANGE(w, NAU8821_R68_TRIM_SETTINGS, NAU8821_R6B_PGA_MUTE) |	\
+	NAU_REG_RANGE(w, NAU8821_R71_ANALOG_ADC_1, NAU8821_R74_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8821_R76_BOOST, NAU8821_R77_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8821_R7E_PGA_GAIN, NAU8821_R80_CHARGE_PUMP))
+
+static const u32 nau8821_writeable_map[] = NAU_REGMAP(NAU8821_WRITEABLE_REGS);
+
 static bool nau8821_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8821_R00_RESET ... NAU8821_R01_ENA_CTRL:
-	case NAU8821_R03_CLK_DIVIDER ... NAU8821_R0B_FLL8:
-	case NAU8821_R0D_JACK_DET_CTRL:
-	case NAU8821_R0F_INTERRUPT_MASK:
-	case NAU8821_R11_INT_CLR_KEY_STATUS ... NAU8821_R13_DMIC_CTRL:
-	case NAU8821_R1A_GPIO12_CTRL ... NAU8821_R1F_RIGHT_TIME_SLOT:
-	case NAU8821_R21_BIQ0_COF1 ... NAU8821_R2D_DAC_CTRL2:
-	case NAU8821_R2F_DAC_DGAIN_CTRL ... NAU8821_R32_HSVOL_CTRL:
-	case NAU8821_R34_DACR_CTRL ... NAU8821_R3D_DAC_DRC_ATKDCY:
-	case NAU8821_R41_BIQ1_COF1 ... NAU8821_R4C_IMM_MODE_CTRL:
-	case NAU8821_R4E_FUSE_CTRL2 ... NAU8821_R4F_FUSE_CTRL3:
-	case NAU8821_R51_FUSE_CTRL1:
-	case NAU8821_R55_MISC_CTRL:
-	case NAU8821_R5A_SOFTWARE_RST:
-	case NAU8821_R66_BIAS_ADJ:
-	case NAU8821_R68_TRIM_SETTINGS ... NAU8821_R6B_PGA_MUTE:
-	case NAU8821_R71_ANALOG_ADC_1 ... NAU8821_R74_MIC_BIAS:
-	case NAU8821_R76_BOOST ... NAU8821_R77_FEPGA:
-	case NAU8821_R7E_PGA_GAIN ... NAU8821_R80_CHARGE_PUMP:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8821_writeable_map, reg);
 }
 
+#define NAU8821_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8821_R00_RESET) |					\
+	NAU_REG_RANGE(w, NAU8821_R10_IRQ_STATUS, NAU8821_R11_INT_CLR_KEY_STATUS) |	\
+	NAU_REG_RANGE(w, NAU8821_R21_BIQ0_COF1, NAU8821_R2A_BIQ0_COF10) |	\
+	NAU_REG_RANGE(w, NAU8821_R41_BIQ1_COF1, NAU8821_R4A_BIQ1_COF10) |	\
+	NAU_REG(w, NAU8821_R4D_IMM_RMS_L) |				\
+	NAU_REG_RANGE(w, NAU8821_R53_OTPDOUT_1, NAU8821_R54_OTPDOUT_2) |	\
+	NAU_REG_RANGE(w, NAU8821_R58_I2C_DEVICE_ID, NAU8821_R5A_SOFTWARE_RST) |	\
+	NAU_REG_RANGE(w, NAU8821_R81_CHARGE_PUMP_INPUT_READ, NAU8821_R82_GENERAL_STATUS))
+
+static const u32 nau8821_volatile_map[] = NAU_REGMAP(NAU8821_VOLATILE_REGS);
+
 static bool nau8821_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8821_R00_RESET:
-	case NAU8821_R10_IRQ_STATUS ... NAU8821_R11_INT_CLR_KEY_STATUS:
-	case NAU8821_R21_BIQ0_COF1 ... NAU8821_R2A_BIQ0_COF10:
-	case NAU8821_R41_BIQ1_COF1 ... NAU8821_R4A_BIQ1_COF10:
-	case NAU8821_R4D_IMM_RMS_L:
-	case NAU8821_R53_OTPDOUT_1 ... NAU8821_R54_OTPDOUT_2:
-	case NAU8821_R58_I2C_DEVICE_ID ... NAU8821_R5A_SOFTWARE_RST:
-	case NAU8821_R81_CHARGE_PUMP_INPUT_READ ... NAU8821_R82_GENERAL_STATUS:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8821_volatile_map, reg);
 }
 
 static int nau8821_biq_coeff_get(struct snd_kcontrol *kcontrol,
@@ -286,23 +310,13 @@ static int nau8821_biq_coeff_put(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
-	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 
 	if (!component->regmap)
 		return -EINVAL;
 
-	data = kmemdup(ucontrol->value.bytes.data,
-		params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
-
-	regmap_raw_write(component->regmap, NAU8821_R21_BIQ0_COF1,
-		data, params->max);
-
-	kfree(data);
-
-	return 0;
+	return nau_biq_rates_write(&nau8821->biq_rates,
+		ucontrol->value.bytes.data);
 }
 
 static const char * const nau8821_adc_decimation[] = {
@@ -326,6 +340,82 @@ static const DECLARE_TLV_DB_SCALE(playback_vol_tlv, -6600, 50, 1);
 static const DECLARE_TLV_DB_MINMAX(fepga_gain_tlv, -100, 3600);
 static const DECLARE_TLV_DB_MINMAX_MUTE(crosstalk_vol_tlv, -7000, 2400);
 
+static const char * const nau8821_dmic_power_mode[] = {
+	"Performance", "Low Power" };
+
+static const struct soc_enum nau8821_dmic_power_mode_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8821_dmic_power_mode),
+		nau8821_dmic_power_mode);
+
+static int nau8821_dmic_power_mode_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8821->dmic_power_mode;
+
+	return 0;
+}
+
+static int nau8821_dmic_power_mode_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+	unsigned int mode = ucontrol->value.enumerated.item[0];
+
+	if (mode >= ARRAY_SIZE(nau8821_dmic_power_mode))
+		return -EINVAL;
+	if (mode == nau8821->dmic_power_mode)
+		return 0;
+
+	nau8821->dmic_power_mode = mode;
+
+	return 1;
+}
+
+static const char * const nau8821_osr_policy[] = {
+	"Manual", "Low Latency", "Low Power", "Quality" };
+
+static const struct soc_enum nau8821_osr_policy_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8821_osr_policy),
+		nau8821_osr_policy);
+
+static int nau8821_osr_policy_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8821->osr_policy;
+
+	return 0;
+}
+
+/* The policy takes effect at the next hw_params */
+static int nau8821_osr_policy_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+	unsigned int policy = ucontrol->value.enumerated.item[0];
+
+	if (policy >= ARRAY_SIZE(nau8821_osr_policy))
+		return -EINVAL;
+	if (policy == nau8821->osr_policy)
+		return 0;
+
+	nau8821->osr_policy = policy;
+	nau_hw_params_reset(&nau8821->hw_params_cache);
+
+	return 1;
+}
+
 static const struct snd_kcontrol_new nau8821_controls[] = {
 	SOC_DOUBLE_TLV("Mic Volume", NAU8821_R35_ADC_DGAIN_CTRL1,
 		NAU8821_ADCL_CH_VOL_SFT, NAU8821_ADCR_CH_VOL_SFT,
@@ -346,7 +436,11 @@ static const struct snd_kcontrol_new nau8821_controls[] = {
 
 	SOC_ENUM("ADC Decimation Rate", nau8821_adc_decimation_enum),
 	SOC_ENUM("DAC Oversampling Rate", nau8821_dac_oversampl_enum),
-	SND_SOC_BYTES_EXT("BIQ Coefficients", 20,
+	SOC_ENUM_EXT("OSR Policy", nau8821_osr_policy_enum,
+		nau8821_osr_policy_get, nau8821_osr_policy_put),
+	SOC_ENUM_EXT("DMIC Power Mode", nau8821_dmic_power_mode_enum,
+		nau8821_dmic_power_mode_get, nau8821_dmic_power_mode_put),
+	SND_SOC_BYTES_EXT("BIQ Coefficients", NAU8821_BIQ_COF_NUM * 2,
 		nau8821_biq_coeff_get, nau8821_biq_coeff_put),
 	SOC_SINGLE("ADC Phase Switch", NAU8821_R1B_TDM_CTRL,
 		NAU8821_ADCPHS_SFT, 1, 0),
@@ -362,7 +456,7 @@ static int dmic_clock_control(struct snd_soc_dapm_widget *w,
 	struct snd_soc_component *component =
 		snd_soc_dapm_to_component(w->dapm);
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
-	int i, speed_selection = -1, clk_adc_src, clk_adc;
+	int i, speed_selection = -1, clk_adc_src, clk_adc, clk;
 	unsigned int clk_divider_r03;
 
 	/* The DMIC clock is gotten from adc clock divided by
@@ -375,14 +469,31 @@ static int dmic_clock_control(struct snd_soc_dapm_widget *w,
 		>> NAU8821_CLK_ADC_SRC_SFT;
 	clk_adc = (nau8821->fs * 256) >> clk_adc_src;
 
-	for (i = 0 ; i < 4 ; i++)
-		if ((clk_adc >> dmic_speed_sel[i].param) <=
-			nau8821->dmic_clk_threshold) {
-			speed_selection = dmic_speed_sel[i].val;
-			break;
+	/* The low power mode takes the lowest clock in the low-power range
+	 * of the mics, if there is one.
+	 */
+	i = -1;
+	if (nau8821->dmic_power_mode == NAU8821_DMIC_LOW_POWER) {
+		for (i = 3; i >= 0; i--) {
+			clk = clk_adc >> dmic_speed_sel[i].param;
+			if (clk >= nau8821->dmic_lp_clk_min &&
+			    clk <= nau8821->dmic_lp_clk_max &&
+			    clk <= nau8821->dmic_clk_threshold)
+				break;
 		}
-	if (i == 4)
-		return -EINVAL;
+		if (i < 0)
+			dev_dbg(nau8821->dev, "no low power dmic clock for %d\n",
+				clk_adc);
+	}
+	if (i < 0) {
+		for (i = 0 ; i < 4 ; i++)
+			if ((clk_adc >> dmic_speed_sel[i].param) <=
+				nau8821->dmic_clk_threshold)
+				break;
+		if (i == 4)
+			return -EINVAL;
+	}
+	speed_selection = dmic_speed_sel[i].val;
 
 	dev_dbg(nau8821->dev,
 		"clk_adc=%d, dmic_clk_threshold = %d, param=%d, val = %d\n",
@@ -395,46 +506,41 @@ static int dmic_clock_control(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
-static int nau8821_left_adc_event(struct snd_soc_dapm_widget *w,
-	struct snd_kcontrol *kcontrol, int event)
+/* The ADC channels settle muted, and one deferred unmute after the
+ * settle covers both channels starting together, so the capture stream
+ * doesn't hold the DAPM thread for the settle.
+ */
+static void nau8821_adc_unmute_work(struct work_struct *work)
 {
-	struct snd_soc_component *component =
-		snd_soc_dapm_to_component(w->dapm);
-	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
-
-	switch (event) {
-	case SND_SOC_DAPM_POST_PMU:
-		msleep(125);
-		regmap_update_bits(nau8821->regmap, NAU8821_R01_ENA_CTRL,
-			NAU8821_EN_ADCL, NAU8821_EN_ADCL);
-		break;
-	case SND_SOC_DAPM_POST_PMD:
-		regmap_update_bits(nau8821->regmap,
-			NAU8821_R01_ENA_CTRL, NAU8821_EN_ADCL, 0);
-		break;
-	default:
-		return -EINVAL;
-	}
+	struct nau8821 *nau8821 =
+		container_of(work, struct nau8821, adc_unmute_work.work);
 
-	return 0;
+	regmap_update_bits(nau8821->regmap, NAU8821_R31_MUTE_CTRL,
+		NAU8821_ADC_SOFT_MUTE, 0);
 }
 
-static int nau8821_right_adc_event(struct snd_soc_dapm_widget *w,
+static int nau8821_adc_event(struct snd_soc_dapm_widget *w,
 	struct snd_kcontrol *kcontrol, int event)
 {
 	struct snd_soc_component *component =
 		snd_soc_dapm_to_component(w->dapm);
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+	unsigned int val;
 
 	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		regmap_update_bits(nau8821->regmap, NAU8821_R31_MUTE_CTRL,
+			NAU8821_ADC_SOFT_MUTE, NAU8821_ADC_SOFT_MUTE);
+		break;
 	case SND_SOC_DAPM_POST_PMU:
-		msleep(125);
-		regmap_update_bits(nau8821->regmap, NAU8821_R01_ENA_CTRL,
-			NAU8821_EN_ADCR, NAU8821_EN_ADCR);
+		/* no restart of the settle by the other channel */
+		queue_delayed_work(system_wq, &nau8821->adc_unmute_work,
+			msecs_to_jiffies(NAU8821_ADC_SETTLE_MS));
 		break;
 	case SND_SOC_DAPM_POST_PMD:
-		regmap_update_bits(nau8821->regmap,
-			NAU8821_R01_ENA_CTRL, NAU8821_EN_ADCR, 0);
+		regmap_read(nau8821->regmap, NAU8821_R01_ENA_CTRL, &val);
+		if (!(val & (NAU8821_EN_ADCL | NAU8821_EN_ADCR)))
+			cancel_delayed_work_sync(&nau8821->adc_unmute_work);
 		break;
 	default:
 		return -EINVAL;
@@ -450,13 +556,16 @@ static int nau8821_pump_event(struct snd_soc_dapm_widget *w,
 		snd_soc_dapm_to_component(w->dapm);
 	struct nau8821 *nau8821 =
 		snd_soc_component_get_drvdata(component);
+	ktime_t start;
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
+		start = ktime_get();
 		/* Prevent startup click by letting charge pump to ramp up */
 		msleep(20);
 		regmap_update_bits(nau8821->regmap, NAU8821_R80_CHARGE_PUMP,
 			NAU8821_JAMNODCLOW, NAU8821_JAMNODCLOW);
+		nau_latency_add(&nau8821->latency[NAU8821_LAT_PUMP], start);
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
 		regmap_update_bits(nau8821->regmap, NAU8821_R80_CHARGE_PUMP,
@@ -506,12 +615,15 @@ static const struct snd_soc_dapm_widget nau8821_dapm_widgets[] = {
 		NAU8821_PUP_PGA_L_SFT, 0, NULL, 0),
 	SND_SOC_DAPM_PGA_S("Frontend PGA R", 1, NAU8821_R7F_POWER_UP_CONTROL,
 		NAU8821_PUP_PGA_R_SFT, 0, NULL, 0),
+	/* both channels of the same stage go in one register write */
 	SND_SOC_DAPM_PGA_S("ADCL Digital path", 0, NAU8821_R01_ENA_CTRL,
-		NAU8821_EN_ADCL_SFT, 0, nau8821_left_adc_event,
-		SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+		NAU8821_EN_ADCL_SFT, 0, nau8821_adc_event,
+		SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMU |
+		SND_SOC_DAPM_POST_PMD),
 	SND_SOC_DAPM_PGA_S("ADCR Digital path", 0, NAU8821_R01_ENA_CTRL,
-		NAU8821_EN_ADCR_SFT, 0, nau8821_right_adc_event,
-		SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_POST_PMD),
+		NAU8821_EN_ADCR_SFT, 0, nau8821_adc_event,
+		SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMU |
+		SND_SOC_DAPM_POST_PMD),
 	SND_SOC_DAPM_SWITCH("DMIC Enable", SND_SOC_NOPM,
 		0, 0, &nau8821_dmic_mode_switch),
 	SND_SOC_DAPM_AIF_OUT("AIFTX", "Capture", 0, NAU8821_R1D_I2S_PCM_CTRL2,
@@ -658,6 +770,64 @@ nau8821_get_osr(struct nau8821 *nau8821, int stream)
 	}
 }
 
+/* The OSR taken by a policy instead of the controls. The filters of the
+ * converters keep their group delay short and their noise low with a high
+ * OSR, so both the low latency and the quality take the highest OSR within
+ * CLK_DA_AD_MAX at the rate, and the low power the lowest. The OSR applied
+ * reads back from the OSR controls.
+ */
+static int nau8821_osr_pick(const struct nau8821_osr_attr *sel, int num,
+	unsigned int rate, int policy)
+{
+	int i, pick = -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (!sel[i].osr || rate * sel[i].osr > CLK_DA_AD_MAX)
+			continue;
+		if (pick < 0 || (policy == NAU8821_OSR_LOW_POWER ?
+			sel[i].osr < sel[pick].osr : sel[i].osr > sel[pick].osr))
+			pick = i;
+	}
+
+	return pick;
+}
+
+static const struct nau8821_osr_attr *
+nau8821_osr_select(struct nau8821 *nau8821, int stream, unsigned int rate,
+	int policy)
+{
+	const struct nau8821_osr_attr *sel;
+	int num, i;
+
+	if (policy == NAU8821_OSR_MANUAL)
+		return nau8821_get_osr(nau8821, stream);
+
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		sel = osr_dac_sel;
+		num = ARRAY_SIZE(osr_dac_sel);
+	} else {
+		sel = osr_adc_sel;
+		num = ARRAY_SIZE(osr_adc_sel);
+	}
+	i = nau8821_osr_pick(sel, num, rate, policy);
+
+	return i < 0 ? NULL : &sel[i];
+}
+
+/* Program the OSR selected; the index is the register value, so the
+ * manual selection is written back unchanged.
+ */
+static void nau8821_osr_apply(struct nau8821 *nau8821, int stream,
+	const struct nau8821_osr_attr *osr)
+{
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK)
+		regmap_update_bits(nau8821->regmap, NAU8821_R2C_DAC_CTRL1,
+			NAU8821_DAC_OVERSAMPLE_MASK, osr - osr_dac_sel);
+	else
+		regmap_update_bits(nau8821->regmap, NAU8821_R2B_ADC_RATE,
+			NAU8821_ADC_SYNC_DOWN_MASK, osr - osr_adc_sel);
+}
+
 static int nau8821_dai_startup(struct snd_pcm_substream *substream,
 			       struct snd_soc_dai *dai)
 {
@@ -665,7 +835,10 @@ static int nau8821_dai_startup(struct snd_pcm_substream *substream,
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 	const struct nau8821_osr_attr *osr;
 
-	osr = nau8821_get_osr(nau8821, substream->stream);
+	/* a policy may take any OSR within the limit at the rate */
+	osr = nau8821_osr_select(nau8821, substream->stream, 0,
+		nau8821->osr_policy == NAU8821_OSR_MANUAL ?
+		NAU8821_OSR_MANUAL : NAU8821_OSR_LOW_POWER);
 	if (!osr || !osr->osr)
 		return -EINVAL;
 
@@ -681,6 +854,20 @@ static int nau8821_hw_params(struct snd_pcm_substream *substream,
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0, ctrl_val, bclk_fs, clk_div;
 	const struct nau8821_osr_attr *osr;
+	ktime_t start = ktime_get();
+	int ret;
+
+	if (nau8821->clk_plan.enable) {
+		ret = nau8821_clk_plan_run(nau8821, params, dai);
+		if (ret)
+			return ret;
+	}
+
+	/* the manual OSR is a control that may change at any time */
+	if (nau8821->osr_policy != NAU8821_OSR_MANUAL &&
+		nau_hw_params_skip(&nau8821->hw_params_cache, substream->stream,
+		params))
+		return 0;
 
 	nau8821->fs = params_rate(params);
 	/* CLK_DAC or CLK_ADC = OSR * FS
@@ -689,11 +876,17 @@ static int nau8821_hw_params(struct snd_pcm_substream *substream,
 	 * values must be selected such that the maximum frequency is less
 	 * than 6.144 MHz.
 	 */
-	osr = nau8821_get_osr(nau8821, substream->stream);
+	osr = nau8821_osr_select(nau8821, substream->stream, params_rate(params),
+		nau8821->osr_policy);
 	if (!osr || !osr->osr)
 		return -EINVAL;
 	if (nau8821->fs * osr->osr > CLK_DA_AD_MAX)
 		return -EINVAL;
+	nau8821_osr_apply(nau8821, substream->stream, osr);
+	nau_delay_set(&nau8821->delay, substream->stream,
+		nau_delay_filter_frames(substream->stream ==
+		SNDRV_PCM_STREAM_PLAYBACK ? &nau8821_dac_filter :
+		&nau8821_adc_filter, osr->osr));
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
 		regmap_update_bits(nau8821->regmap, NAU8821_R03_CLK_DIVIDER,
 			NAU8821_CLK_DAC_SRC_MASK,
@@ -741,6 +934,10 @@ static int nau8821_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8821->regmap, NAU8821_R1C_I2S_PCM_CTRL1,
 		NAU8821_I2S_DL_MASK, val_len);
+	nau_biq_rates_switch(&nau8821->biq_rates, params_rate(params));
+	nau_hw_params_done(&nau8821->hw_params_cache, substream->stream,
+		params);
+	nau_latency_add(&nau8821->latency[NAU8821_LAT_HW_PARAMS], start);
 
 	return 0;
 }
@@ -792,6 +989,7 @@ static int nau8821_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
 		return -EINVAL;
 	}
 
+	nau_hw_params_reset(&nau8821->hw_params_cache);
 	regmap_update_bits(nau8821->regmap, NAU8821_R1C_I2S_PCM_CTRL1,
 		NAU8821_I2S_DL_MASK | NAU8821_I2S_DF_MASK |
 		NAU8821_I2S_BP_MASK | NAU8821_I2S_PCMB_MASK, ctrl1_val);
@@ -815,11 +1013,23 @@ static int nau8821_digital_mute(struct snd_soc_dai *dai, int mute,
 		NAU8821_R31_MUTE_CTRL, NAU8821_DAC_SOFT_MUTE, val);
 }
 
+/* The frames the filters hold at the OSR of the stream */
+static snd_pcm_sframes_t nau8821_dai_delay(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(dai->component);
+
+	return nau_delay_get(&nau8821->delay, substream->stream);
+}
+
 static const struct snd_soc_dai_ops nau8821_dai_ops = {
 	.startup = nau8821_dai_startup,
 	.hw_params = nau8821_hw_params,
 	.set_fmt = nau8821_set_dai_fmt,
 	.mute_stream = nau8821_digital_mute,
+	/* the ADC soft mute follows its settle, by the ADC widget */
+	.no_capture_mute = 1,
+	.delay = nau8821_dai_delay,
 };
 
 #define NAU8821_RATES SNDRV_PCM_RATE_8000_192000
@@ -861,19 +1071,65 @@ static bool nau8821_is_jack_inserted(struct regmap *regmap)
 	return active_high == is_high;
 }
 
+/* The status register is read once per event, by the interruption, the
+ * probe or the resume; the other paths take the state kept from then.
+ */
+static bool nau8821_jack_sample(struct nau8821 *nau8821)
+{
+	bool present = nau8821_is_jack_inserted(nau8821->regmap);
+
+	WRITE_ONCE(nau8821->jack_present, present);
+
+	return present;
+}
+
+/**
+ * nau8821_int_status_clear - clear the interruption status
+ * @regmap: regmap of the codec
+ * @active_irq: status bits to clear, or negative to read them first
+ *
+ * The clear register takes several status bits in one write, as the
+ * interruption handler does, so all the bits are cleared at once.
+ */
+static void nau8821_int_status_clear(struct regmap *regmap, int active_irq)
+{
+	if (active_irq < 0 && regmap_read(regmap, NAU8821_R10_IRQ_STATUS, &active_irq))
+		return;
+	if (active_irq)
+		regmap_write(regmap, NAU8821_R11_INT_CLR_KEY_STATUS, active_irq);
+}
+
 static void nau8821_int_status_clear_all(struct regmap *regmap)
 {
-	int active_irq, clear_irq, i;
+	nau8821_int_status_clear(regmap, -1);
+}
 
-	/* Reset the intrruption status from rightmost bit if the corres-
-	 * ponding irq event occurs.
-	 */
-	regmap_read(regmap, NAU8821_R10_IRQ_STATUS, &active_irq);
-	for (i = 0; i < NAU8821_REG_DATA_LEN; i++) {
-		clear_irq = (0x1 << i);
-		if (active_irq & clear_irq)
-			regmap_write(regmap,
-				NAU8821_R11_INT_CLR_KEY_STATUS, clear_irq);
+/* Set up the jack detection without a jack by the debounce @profile.
+ * The bypass needs no clock, and the insertion samples the jack state
+ * once more. The filter keeps the internal VCO on for the debounce in the
+ * chip, so a bounce raises no interruption and the insertion needs no
+ * sample. A stream keeps its own clock either way.
+ */
+static void nau8821_jack_db_apply(struct nau8821 *nau8821, int profile)
+{
+	struct regmap *regmap = nau8821->regmap;
+	bool idle = nau8821->dapm->bias_level < SND_SOC_BIAS_PREPARE;
+
+	nau8821->jack_db_applied = profile;
+	if (profile == NAU8821_JACK_DB_FILTER) {
+		/* the debounce runs on the VCO */
+		if (idle)
+			nau8821_configure_sysclk(nau8821,
+				NAU8821_CLK_INTERNAL, 0);
+		regmap_update_bits(regmap, NAU8821_R0D_JACK_DET_CTRL,
+			NAU8821_JACK_DET_DB_BYPASS, 0);
+	} else {
+		regmap_update_bits(regmap, NAU8821_R0D_JACK_DET_CTRL,
+			NAU8821_JACK_DET_DB_BYPASS,
+			NAU8821_JACK_DET_DB_BYPASS);
+		/* Close clock for jack type detection at manual mode */
+		if (idle)
+			nau8821_configure_sysclk(nau8821, NAU8821_CLK_DIS, 0);
 	}
 }
 
@@ -882,13 +1138,16 @@ static void nau8821_eject_jack(struct nau8821 *nau8821)
 	struct snd_soc_dapm_context *dapm = nau8821->dapm;
 	struct regmap *regmap = nau8821->regmap;
 	struct snd_soc_component *component = snd_soc_dapm_to_component(dapm);
+	struct nau_reg_txn txn;
 
+	nau_reg_txn_begin(&txn, regmap);
 	/* Detach 2kOhm Resistors from MICBIAS to MICGND */
-	regmap_update_bits(regmap, NAU8821_R74_MIC_BIAS,
+	nau_reg_txn_update_bits(&txn, NAU8821_R74_MIC_BIAS,
 		NAU8821_MICBIAS_JKR2, 0);
 	/* HPL/HPR short to ground */
-	regmap_update_bits(regmap, NAU8821_R0D_JACK_DET_CTRL,
+	nau_reg_txn_update_bits(&txn, NAU8821_R0D_JACK_DET_CTRL,
 		NAU8821_SPKR_DWN1R | NAU8821_SPKR_DWN1L, 0);
+	nau_reg_txn_commit(&txn);
 	snd_soc_component_disable_pin(component, "MICBIAS");
 	snd_soc_dapm_sync(dapm);
 
@@ -896,28 +1155,154 @@ static void nau8821_eject_jack(struct nau8821 *nau8821)
 	nau8821_int_status_clear_all(regmap);
 
 	/* Enable the insertion interruption, disable the ejection inter-
-	 * ruption, and then bypass de-bounce circuit.
+	 * ruption, and then set the de-bounce circuit up.
 	 */
-	regmap_update_bits(regmap, NAU8821_R12_INTERRUPT_DIS_CTRL,
+	nau_reg_txn_update_bits(&txn, NAU8821_R12_INTERRUPT_DIS_CTRL,
 		NAU8821_IRQ_EJECT_DIS | NAU8821_IRQ_INSERT_DIS,
 		NAU8821_IRQ_EJECT_DIS);
 	/* Mask unneeded IRQs: 1 - disable, 0 - enable */
-	regmap_update_bits(regmap, NAU8821_R0F_INTERRUPT_MASK,
+	nau_reg_txn_update_bits(&txn, NAU8821_R0F_INTERRUPT_MASK,
 		NAU8821_IRQ_EJECT_EN | NAU8821_IRQ_INSERT_EN,
 		NAU8821_IRQ_EJECT_EN);
+	nau_reg_txn_commit(&txn);
 
-	regmap_update_bits(regmap, NAU8821_R0D_JACK_DET_CTRL,
-		NAU8821_JACK_DET_DB_BYPASS, NAU8821_JACK_DET_DB_BYPASS);
-
-	/* Close clock for jack type detection at manual mode */
-	if (dapm->bias_level < SND_SOC_BIAS_PREPARE)
-		nau8821_configure_sysclk(nau8821, NAU8821_CLK_DIS, 0);
+	/* The bypass kept from the resume ends with the jack */
+	cancel_delayed_work(&nau8821->jack_db_work);
+	nau8821_jack_db_apply(nau8821, nau8821->jack_db_profile);
 
 	/* Recover to normal channel input */
 	regmap_update_bits(regmap, NAU8821_R2B_ADC_RATE,
 			NAU8821_ADC_R_SRC_EN, 0);
 }
 
+/**
+ * nau8821_jdet_mic_detected - sample KEYDET for the microphone
+ * @nau8821: the codec private data
+ *
+ * The result is taken once two samples in a row agree. If KEYDET keeps
+ * toggling for NAU8821_JDET_SAMPLE_MAX samples, the last one is used.
+ * The settle before the first sample adapts to how soon they agree.
+ *
+ * Returns true if a microphone is detected.
+ */
+static bool nau8821_jdet_mic_detected(struct nau8821 *nau8821)
+{
+	struct regmap *regmap = nau8821->regmap;
+	int jack_status_reg, i;
+	bool mic_detected, last;
+
+	regmap_read(regmap, NAU8821_R58_I2C_DEVICE_ID, &jack_status_reg);
+	mic_detected = !(jack_status_reg & NAU8821_KEYDET);
+	for (i = 1; i < NAU8821_JDET_SAMPLE_MAX; i++) {
+		msleep(NAU8821_JDET_CONFIRM_MS);
+		last = mic_detected;
+		regmap_read(regmap, NAU8821_R58_I2C_DEVICE_ID,
+			&jack_status_reg);
+		mic_detected = !(jack_status_reg & NAU8821_KEYDET);
+		if (mic_detected == last) {
+			nau_jdet_settle_update(&nau8821->jdet_settle, i == 1);
+			return mic_detected;
+		}
+	}
+	nau_jdet_settle_update(&nau8821->jdet_settle, false);
+	dev_warn(nau8821->dev, "KEYDET unstable, take the last sample\n");
+
+	return mic_detected;
+}
+
+/**
+ * nau8821_pm_get - wake up the codec for the register access
+ * @nau8821: the codec private data
+ *
+ * The registers are only cached while the codec is runtime suspended.
+ * The jack detection and the clock setup out of a stream read the status
+ * of the codec, so they hold it awake around their access.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8821_pm_get(struct nau8821 *nau8821)
+{
+	int ret;
+
+	ret = pm_runtime_resume_and_get(nau8821->dev);
+	if (ret < 0)
+		dev_err(nau8821->dev, "Failed to resume codec: %d\n", ret);
+
+	return ret;
+}
+
+static void nau8821_pm_put(struct nau8821 *nau8821)
+{
+	pm_runtime_mark_last_busy(nau8821->dev);
+	pm_runtime_put_autosuspend(nau8821->dev);
+}
+
+/* Keep the codec awake while DAPM has a path powered up, so the power
+ * sequence reaches the registers and not only the cache.
+ */
+static void nau8821_pm_hold(struct nau8821 *nau8821, bool hold)
+{
+	if (nau8821->pm_held == hold)
+		return;
+
+	if (hold) {
+		if (nau8821_pm_get(nau8821) < 0)
+			return;
+	} else {
+		nau8821_pm_put(nau8821);
+	}
+	nau8821->pm_held = hold;
+}
+
+/* The jack detection runs on the interruption line, or on the polls of
+ * the status on a board without it.
+ */
+static bool nau8821_irq_on(struct nau8821 *nau8821)
+{
+	return nau8821->irq || nau_irq_polled(&nau8821->irq_poll);
+}
+
+static void nau8821_irq_disable(struct nau8821 *nau8821)
+{
+	if (nau8821->irq)
+		disable_irq(nau8821->irq);
+	else
+		nau_irq_poll_disable(&nau8821->irq_poll);
+}
+
+static void nau8821_irq_enable(struct nau8821 *nau8821)
+{
+	if (nau8821->irq)
+		enable_irq(nau8821->irq);
+	else
+		nau_irq_poll_enable(&nau8821->irq_poll);
+}
+
+/* Back to the debounce of the board once the resume settled */
+static void nau8821_jack_db_work(struct work_struct *work)
+{
+	struct nau8821 *nau8821 =
+		container_of(work, struct nau8821, jack_db_work.work);
+
+	if (nau8821_pm_get(nau8821) < 0)
+		return;
+	/* the interruption thread owns the jack detection */
+	nau8821_irq_disable(nau8821);
+	if (!READ_ONCE(nau8821->jack_present) &&
+		nau8821->jack_db_applied != nau8821->jack_db_profile)
+		nau8821_jack_db_apply(nau8821, nau8821->jack_db_profile);
+	nau8821_irq_enable(nau8821);
+	nau8821_pm_put(nau8821);
+}
+
+static void nau8821_jack_db_resumed(struct nau8821 *nau8821)
+{
+	if (nau8821_irq_on(nau8821) &&
+		nau8821->jack_db_profile != NAU8821_JACK_DB_BYPASS)
+		schedule_delayed_work(&nau8821->jack_db_work,
+			msecs_to_jiffies(NAU8821_JACK_DB_RESUME_MS));
+}
+
 static void nau8821_jdet_work(struct work_struct *work)
 {
 	struct nau8821 *nau8821 =
@@ -925,15 +1310,27 @@ static void nau8821_jdet_work(struct work_struct *work)
 	struct snd_soc_dapm_context *dapm = nau8821->dapm;
 	struct snd_soc_component *component = snd_soc_dapm_to_component(dapm);
 	struct regmap *regmap = nau8821->regmap;
-	int jack_status_reg, mic_detected, event = 0, event_mask = 0;
-
-	snd_soc_component_force_enable_pin(component, "MICBIAS");
-	snd_soc_dapm_sync(dapm);
-	msleep(20);
+	int micbias, event = 0, event_mask = 0;
+	ktime_t start = ktime_get();
+	bool armed;
+
+	nau_latency_add(&nau8821->latency[NAU8821_LAT_JDET_QUEUE],
+		nau8821->jdet_queued);
+	if (nau8821_pm_get(nau8821) < 0)
+		return;
+	/* Power up MICBIAS for the detection directly if DAPM keeps it off,
+	 * and then only the headset needs a DAPM sync to take it over. The
+	 * DAPM mutex keeps the MICBIAS power from changing meanwhile.
+	 */
+	mutex_lock_nested(&dapm->card->dapm_mutex, SND_SOC_DAPM_CLASS_RUNTIME);
+	regmap_read(regmap, NAU8821_R74_MIC_BIAS, &micbias);
+	armed = !(micbias & NAU8821_MICBIAS_POWERUP);
+	if (armed)
+		regmap_update_bits(regmap, NAU8821_R74_MIC_BIAS,
+			NAU8821_MICBIAS_POWERUP, NAU8821_MICBIAS_POWERUP);
+	nau_jdet_settle_wait(&nau8821->jdet_settle);
 
-	regmap_read(regmap, NAU8821_R58_I2C_DEVICE_ID, &jack_status_reg);
-	mic_detected = !(jack_status_reg & NAU8821_KEYDET);
-	if (mic_detected) {
+	if (nau8821_jdet_mic_detected(nau8821)) {
 		dev_dbg(nau8821->dev, "Headset connected\n");
 		event |= SND_JACK_HEADSET;
 
@@ -945,14 +1342,28 @@ static void nau8821_jdet_work(struct work_struct *work)
 		 */
 		regmap_update_bits(regmap, NAU8821_R2B_ADC_RATE,
 			NAU8821_ADC_R_SRC_EN, NAU8821_ADC_R_SRC_EN);
+		snd_soc_component_force_enable_pin_unlocked(component,
+			"MICBIAS");
+		snd_soc_dapm_sync_unlocked(dapm);
 	} else {
 		dev_dbg(nau8821->dev, "Headphone connected\n");
 		event |= SND_JACK_HEADPHONE;
-		snd_soc_component_disable_pin(component, "MICBIAS");
-		snd_soc_dapm_sync(dapm);
+		if (armed) {
+			regmap_update_bits(regmap, NAU8821_R74_MIC_BIAS,
+				NAU8821_MICBIAS_POWERUP, 0);
+		} else {
+			snd_soc_component_disable_pin_unlocked(component,
+				"MICBIAS");
+			snd_soc_dapm_sync_unlocked(dapm);
+		}
 	}
+	mutex_unlock(&dapm->card->dapm_mutex);
+
 	event_mask |= SND_JACK_HEADSET;
-	snd_soc_jack_report(nau8821->jack, event, event_mask);
+	nau_jack_report(&nau8821->jack_rpt, nau8821->jack, event,
+		event_mask);
+	nau8821_pm_put(nau8821);
+	nau_latency_add(&nau8821->latency[NAU8821_LAT_JDET_RUN], start);
 }
 
 /* Enable interruptions with internal clock. */
@@ -984,9 +1395,8 @@ static void nau8821_setup_inserted_irq(struct nau8821 *nau8821)
 		NAU8821_IRQ_EJECT_DIS, 0);
 }
 
-static irqreturn_t nau8821_interrupt(int irq, void *data)
+static irqreturn_t nau8821_handle_irq(struct nau8821 *nau8821)
 {
-	struct nau8821 *nau8821 = (struct nau8821 *)data;
 	struct regmap *regmap = nau8821->regmap;
 	int active_irq, clear_irq = 0, event = 0, event_mask = 0;
 
@@ -1001,6 +1411,9 @@ static irqreturn_t nau8821_interrupt(int irq, void *data)
 		NAU8821_JACK_EJECT_DETECTED) {
 		regmap_update_bits(regmap, NAU8821_R71_ANALOG_ADC_1,
 			NAU8821_MICDET_MASK, NAU8821_MICDET_DIS);
+		/* The detection of the jack gone is void */
+		cancel_work_sync(&nau8821->jdet_work);
+		WRITE_ONCE(nau8821->jack_present, false);
 		nau8821_eject_jack(nau8821);
 		event_mask |= SND_JACK_HEADSET;
 		clear_irq = NAU8821_JACK_EJECT_IRQ_MASK;
@@ -1008,10 +1421,15 @@ static irqreturn_t nau8821_interrupt(int irq, void *data)
 		NAU8821_JACK_INSERT_DETECTED) {
 		regmap_update_bits(regmap, NAU8821_R71_ANALOG_ADC_1,
 			NAU8821_MICDET_MASK, NAU8821_MICDET_EN);
-		if (nau8821_is_jack_inserted(regmap)) {
+		/* The debounce filter of the chip had the bounce out */
+		if (nau8821->jack_db_applied == NAU8821_JACK_DB_FILTER)
+			WRITE_ONCE(nau8821->jack_present, true);
+		if (READ_ONCE(nau8821->jack_present) ||
+			nau8821_jack_sample(nau8821)) {
 			/* detect microphone and jack type */
 			cancel_work_sync(&nau8821->jdet_work);
-			schedule_work(&nau8821->jdet_work);
+			nau8821->jdet_queued = ktime_get();
+			queue_work(nau8821->jdet_wq, &nau8821->jdet_work);
 			/* Turn off insertion interruption at manual mode */
 			regmap_update_bits(regmap,
 				NAU8821_R12_INTERRUPT_DIS_CTRL,
@@ -1031,15 +1449,47 @@ static irqreturn_t nau8821_interrupt(int irq, void *data)
 
 	if (!clear_irq)
 		clear_irq = active_irq;
-	/* clears the rightmost interruption */
-	regmap_write(regmap, NAU8821_R11_INT_CLR_KEY_STATUS, clear_irq);
+	/* clears the interruptions handled above at once */
+	nau8821_int_status_clear(regmap, clear_irq);
 
 	if (event_mask)
-		snd_soc_jack_report(nau8821->jack, event, event_mask);
+		nau_jack_report(&nau8821->jack_rpt, nau8821->jack, event,
+			event_mask);
 
 	return IRQ_HANDLED;
 }
 
+/* Stamp the interruption, for the latency of its thread */
+static irqreturn_t nau8821_hardirq(int irq, void *data)
+{
+	struct nau8821 *nau8821 = (struct nau8821 *)data;
+
+	nau8821->irq_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t nau8821_interrupt(int irq, void *data)
+{
+	struct nau8821 *nau8821 = (struct nau8821 *)data;
+	irqreturn_t ret;
+	int passes = 0;
+
+	nau_latency_add(&nau8821->latency[NAU8821_LAT_IRQ_THREAD],
+		nau8821->irq_time);
+	nau_irq_thread_prio(&nau8821->irq_cfg);
+	/* The jack events wake up the codec runtime suspended */
+	if (nau8821_pm_get(nau8821) < 0)
+		return IRQ_NONE;
+	do {
+		ret = nau8821_handle_irq(nau8821);
+	} while (ret == IRQ_HANDLED && nau_irq_edge_again(&nau8821->irq_cfg,
+		nau8821->regmap, NAU8821_R10_IRQ_STATUS, 0x3ff, &passes));
+	nau8821_pm_put(nau8821);
+
+	return ret;
+}
+
 static const struct regmap_config nau8821_regmap_config = {
 	.val_bits = NAU8821_REG_DATA_LEN,
 	.reg_bits = NAU8821_REG_ADDR_LEN,
@@ -1054,6 +1504,20 @@ static const struct regmap_config nau8821_regmap_config = {
 	.num_reg_defaults = ARRAY_SIZE(nau8821_reg_defaults),
 };
 
+static const char * const nau8821_latency_names[NAU8821_LAT_NUM] = {
+	[NAU8821_LAT_HW_PARAMS] = "hw_params",
+	[NAU8821_LAT_PUMP] = "pump_ramp",
+	[NAU8821_LAT_JDET_QUEUE] = "jdet_queue",
+	[NAU8821_LAT_JDET_RUN] = "jdet_run",
+	[NAU8821_LAT_IRQ_THREAD] = "irq_thread",
+};
+
+/* The widgets of the power accounting, which keep the most current */
+static const char * const nau8821_dapm_stat_names[] = {
+	"MICBIAS", "DMIC Clock", "Frontend PGA L", "Frontend PGA R",
+	"Charge Pump", "HP Boost Driver", "Class G",
+};
+
 static int nau8821_component_probe(struct snd_soc_component *component)
 {
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
@@ -1061,79 +1525,46 @@ static int nau8821_component_probe(struct snd_soc_component *component)
 		snd_soc_component_get_dapm(component);
 
 	nau8821->dapm = dapm;
+	INIT_DELAYED_WORK(&nau8821->adc_unmute_work, nau8821_adc_unmute_work);
+	INIT_DELAYED_WORK(&nau8821->jack_db_work, nau8821_jack_db_work);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8821->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+		&nau8821->regcache_report, nau8821->regmap,
+		&nau8821_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8821->latency,
+		nau8821_latency_names, NAU8821_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8821->hw_params_cache);
+	nau_clk_plan_debugfs_init(component->debugfs_root,
+		&nau8821->clk_plan);
+	nau_jack_report_debugfs_init(component->debugfs_root,
+		&nau8821->jack_rpt);
+	nau_irq_poll_debugfs_init(component->debugfs_root,
+		&nau8821->irq_poll);
+	nau_delay_debugfs_init(component->debugfs_root, &nau8821->delay);
+	nau_biq_rates_debugfs_init(component->debugfs_root, "biq_rate_switches",
+		&nau8821->biq_rates);
+	nau_dapm_stat_init(&nau8821->dapm_stat, nau8821_dapm_stat_names,
+		ARRAY_SIZE(nau8821_dapm_stat_names));
+	nau_dapm_stat_debugfs_init(component->debugfs_root,
+		&nau8821->dapm_stat);
+	nau_pm_card_link(component);
 
 	return 0;
 }
 
-/**
- * nau8821_calc_fll_param - Calculate FLL parameters.
- * @fll_in: external clock provided to codec.
- * @fs: sampling rate.
- * @fll_param: Pointer to structure of FLL parameters.
- *
- * Calculate FLL parameters to configure codec.
- *
- * Returns 0 for success or negative error code.
- */
-static int nau8821_calc_fll_param(unsigned int fll_in,
-	unsigned int fs, struct nau8821_fll *fll_param)
+static void nau8821_component_remove(struct snd_soc_component *component)
 {
-	u64 fvco, fvco_max;
-	unsigned int fref, i, fvco_sel;
-
-	/* Ensure the reference clock frequency (FREF) is <= 13.5MHz by
-	 * dividing freq_in by 1, 2, 4, or 8 using FLL pre-scalar.
-	 * FREF = freq_in / NAU8821_FLL_REF_DIV_MASK
-	 */
-	for (i = 0; i < ARRAY_SIZE(fll_pre_scalar); i++) {
-		fref = fll_in >> fll_pre_scalar[i].param;
-		if (fref <= NAU_FREF_MAX)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_pre_scalar))
-		return -EINVAL;
-	fll_param->clk_ref_div = fll_pre_scalar[i].val;
-
-	/* Choose the FLL ratio based on FREF */
-	for (i = 0; i < ARRAY_SIZE(fll_ratio); i++) {
-		if (fref >= fll_ratio[i].param)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_ratio))
-		return -EINVAL;
-	fll_param->ratio = fll_ratio[i].val;
-
-	/* Calculate the frequency of DCO (FDCO) given freq_out = 256 * Fs.
-	 * FDCO must be within the 90MHz - 100MHz or the FFL cannot be
-	 * guaranteed across the full range of operation.
-	 * FDCO = freq_out * 2 * mclk_src_scaling
-	 */
-	fvco_max = 0;
-	fvco_sel = ARRAY_SIZE(mclk_src_scaling);
-	for (i = 0; i < ARRAY_SIZE(mclk_src_scaling); i++) {
-		fvco = 256ULL * fs * 2 * mclk_src_scaling[i].param;
-		if (fvco > NAU_FVCO_MIN && fvco < NAU_FVCO_MAX &&
-			fvco_max < fvco) {
-			fvco_max = fvco;
-			fvco_sel = i;
-		}
-	}
-	if (ARRAY_SIZE(mclk_src_scaling) == fvco_sel)
-		return -EINVAL;
-	fll_param->mclk_src = mclk_src_scaling[fvco_sel].val;
-
-	/* Calculate the FLL 10-bit integer input and the FLL 24-bit fractional
-	 * input based on FDCO, FREF and FLL ratio.
-	 */
-	fvco = div_u64(fvco_max << 24, fref * fll_param->ratio);
-	fll_param->fll_int = (fvco >> 24) & 0x3ff;
-	fll_param->fll_frac = fvco & 0xffffff;
+	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 
-	return 0;
+	cancel_delayed_work_sync(&nau8821->adc_unmute_work);
+	cancel_delayed_work_sync(&nau8821->jack_db_work);
+	nau_jack_report_cancel(&nau8821->jack_rpt);
+	nau_pm_card_unlink(component);
 }
 
 static void nau8821_fll_apply(struct nau8821 *nau8821,
-		struct nau8821_fll *fll_param)
+		struct nau_fll *fll_param)
 {
 	struct regmap *regmap = nau8821->regmap;
 
@@ -1199,11 +1630,12 @@ static int nau8821_set_fll(struct snd_soc_component *component,
 	int pll_id, int source, unsigned int freq_in, unsigned int freq_out)
 {
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
-	struct nau8821_fll fll_set_param, *fll_param = &fll_set_param;
+	struct nau_fll fll_set_param, *fll_param = &fll_set_param;
 	int ret, fs;
 
 	fs = freq_out >> 8;
-	ret = nau8821_calc_fll_param(freq_in, fs, fll_param);
+	ret = nau_fll_solve(&nau8821_fll_desc, &nau8821->fll_cache, freq_in, fs,
+			    24, fll_param);
 	if (ret) {
 		dev_err(nau8821->dev,
 			"Unsupported input clock %d to output clock %d\n",
@@ -1215,10 +1647,16 @@ static int nau8821_set_fll(struct snd_soc_component *component,
 		fll_param->mclk_src, fll_param->ratio, fll_param->fll_frac,
 		fll_param->fll_int, fll_param->clk_ref_div);
 
+	ret = nau8821_pm_get(nau8821);
+	if (ret < 0)
+		return ret;
+	nau8821->clk_plan.enable = false;
+	nau_clk_plan_reset(&nau8821->clk_plan);
 	nau8821_fll_apply(nau8821, fll_param);
-	mdelay(2);
+	nau_fll_wait_lock();
 	regmap_update_bits(nau8821->regmap, NAU8821_R03_CLK_DIVIDER,
 		NAU8821_CLK_SRC_MASK, NAU8821_CLK_SRC_VCO);
+	nau8821_pm_put(nau8821);
 
 	return 0;
 }
@@ -1239,6 +1677,11 @@ static int nau8821_configure_sysclk(struct nau8821 *nau8821,
 {
 	struct regmap *regmap = nau8821->regmap;
 
+	/* the debounce filter of the insertion keeps the VCO on */
+	if (clk_id == NAU8821_CLK_DIS && !READ_ONCE(nau8821->jack_present) &&
+		nau8821->jack_db_applied == NAU8821_JACK_DB_FILTER)
+		clk_id = NAU8821_CLK_INTERNAL;
+	nau_clk_plan_reset(&nau8821->clk_plan);
 	switch (clk_id) {
 	case NAU8821_CLK_DIS:
 		/* Clock provided externally and disable internal VCO clock */
@@ -1251,7 +1694,9 @@ static int nau8821_configure_sysclk(struct nau8821 *nau8821,
 			NAU8821_CLK_MCLK_SRC_MASK, 0);
 		break;
 	case NAU8821_CLK_INTERNAL:
-		if (nau8821_is_jack_inserted(regmap)) {
+		/* off without headset, unless the debounce filter runs on it */
+		if (READ_ONCE(nau8821->jack_present) ||
+			nau8821->jack_db_applied == NAU8821_JACK_DB_FILTER) {
 			regmap_update_bits(regmap, NAU8821_R09_FLL6,
 				NAU8821_DCO_EN, NAU8821_DCO_EN);
 			regmap_update_bits(regmap, NAU8821_R03_CLK_DIVIDER,
@@ -1316,8 +1761,90 @@ static int nau8821_set_sysclk(struct snd_soc_component *component, int clk_id,
 	int source, unsigned int freq, int dir)
 {
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	nau8821->clk_plan.enable = clk_id == NAU8821_CLK_AUTO;
+	if (nau8821->clk_plan.enable) {
+		nau8821->clk_plan.mclk = freq;
+		nau_clk_plan_reset(&nau8821->clk_plan);
+		return 0;
+	}
+
+	/* The machine drivers set the clock at card probe too */
+	ret = nau8821_pm_get(nau8821);
+	if (ret < 0)
+		return ret;
+	ret = nau8821_configure_sysclk(nau8821, clk_id, freq);
+	nau8821_pm_put(nau8821);
+
+	return ret;
+}
+
+/**
+ * nau8821_clk_plan_run - plan the sysclk of a stream at hw_params
+ * @nau8821:  component to register the codec private data with
+ * @params:  parameters of the stream
+ * @dai:  the DAI of the stream
+ *
+ * The planner picks MCLK straight, the FLL from MCLK or the FLL from BCLK,
+ * the first that makes 256 * Fs. The sysclk is shared by the directions,
+ * so a plan of another rate is refused while the other one streams.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8821_clk_plan_run(struct nau8821 *nau8821,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
+{
+	struct nau_clk_planner *planner = &nau8821->clk_plan;
+	unsigned int ctrl_val, bclk = 0;
+	struct nau_clk_plan plan;
+	int ret;
+
+	regmap_read(nau8821->regmap, NAU8821_R1D_I2S_PCM_CTRL2, &ctrl_val);
+	if (!(ctrl_val & NAU8821_I2S_MS_MASTER))
+		bclk = snd_soc_params_to_bclk(params);
+	ret = nau_clk_plan_pick(&nau8821_fll_desc, &nau8821->fll_cache, 24,
+		planner->mclk, bclk, params_rate(params), &plan);
+	if (ret) {
+		dev_err(nau8821->dev, "No sysclk for %dHz from MCLK %uHz\n",
+			params_rate(params), planner->mclk);
+		return ret;
+	}
+	if (nau_clk_plan_applied(planner, &plan))
+		return 0;
+	if (planner->applied.src != NAU_CLK_PLAN_NONE &&
+		snd_soc_dai_active(dai) > 1) {
+		dev_err(nau8821->dev, "Sysclk held by the other stream\n");
+		return -EBUSY;
+	}
+
+	ret = nau8821_pm_get(nau8821);
+	if (ret < 0)
+		return ret;
+	switch (plan.src) {
+	case NAU_CLK_PLAN_MCLK:
+		nau8821_configure_sysclk(nau8821, NAU8821_CLK_MCLK,
+			plan.freq_in);
+		regmap_update_bits(nau8821->regmap, NAU8821_R03_CLK_DIVIDER,
+			NAU8821_CLK_MCLK_SRC_MASK, plan.mclk_div);
+		break;
+	case NAU_CLK_PLAN_FLL_MCLK:
+	case NAU_CLK_PLAN_FLL_BLK:
+		nau8821_configure_sysclk(nau8821,
+			plan.src == NAU_CLK_PLAN_FLL_MCLK ?
+			NAU8821_CLK_FLL_MCLK : NAU8821_CLK_FLL_BLK, plan.freq_in);
+		nau8821_fll_apply(nau8821, &plan.fll);
+		nau_fll_wait_lock();
+		regmap_update_bits(nau8821->regmap, NAU8821_R03_CLK_DIVIDER,
+			NAU8821_CLK_SRC_MASK, NAU8821_CLK_SRC_VCO);
+		break;
+	}
+	nau_clk_plan_done(planner, &plan);
+	nau8821_pm_put(nau8821);
+	dev_dbg(nau8821->dev, "Sysclk planned from source %u at %uHz\n",
+		plan.src, plan.freq_in);
 
-	return nau8821_configure_sysclk(nau8821, clk_id, freq);
+	return 0;
 }
 
 static int nau8821_resume_setup(struct nau8821 *nau8821)
@@ -1325,8 +1852,9 @@ static int nau8821_resume_setup(struct nau8821 *nau8821)
 	struct regmap *regmap = nau8821->regmap;
 
 	/* Close clock when jack type detection at manual mode */
+	nau8821->jack_db_applied = NAU8821_JACK_DB_BYPASS;
 	nau8821_configure_sysclk(nau8821, NAU8821_CLK_DIS, 0);
-	if (nau8821->irq) {
+	if (nau8821_irq_on(nau8821)) {
 		/* Clear all interruption status */
 		nau8821_int_status_clear_all(regmap);
 
@@ -1340,6 +1868,7 @@ static int nau8821_resume_setup(struct nau8821 *nau8821)
 			NAU8821_JACK_DET_DB_BYPASS);
 		regmap_update_bits(regmap, NAU8821_R12_INTERRUPT_DIS_CTRL,
 			NAU8821_IRQ_INSERT_DIS | NAU8821_IRQ_EJECT_DIS, 0);
+		nau8821_jack_db_resumed(nau8821);
 	}
 
 	return 0;
@@ -1350,26 +1879,43 @@ static int nau8821_set_bias_level(struct snd_soc_component *component,
 {
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 	struct regmap *regmap = nau8821->regmap;
+	int ret;
+
+	/* the widgets of the component driver come after its probe */
+	nau_dapm_stat_attach(&nau8821->dapm_stat, component);
+	nau_dapm_stat_bias(&nau8821->dapm_stat, level);
 
 	switch (level) {
 	case SND_SOC_BIAS_ON:
 		break;
 
 	case SND_SOC_BIAS_PREPARE:
+		nau8821_pm_hold(nau8821, true);
 		break;
 
 	case SND_SOC_BIAS_STANDBY:
+		nau8821_pm_hold(nau8821, false);
 		/* Setup codec configuration after resume */
 		if (snd_soc_component_get_bias_level(component) ==
-			SND_SOC_BIAS_OFF)
+			SND_SOC_BIAS_OFF) {
+			ret = nau8821_pm_get(nau8821);
+			if (ret < 0)
+				return ret;
 			nau8821_resume_setup(nau8821);
+			nau8821_pm_put(nau8821);
+		}
 		break;
 
 	case SND_SOC_BIAS_OFF:
+		nau8821_pm_hold(nau8821, false);
+		/* No clock for the jack detection left in suspend */
+		cancel_delayed_work_sync(&nau8821->jack_db_work);
+		if (!READ_ONCE(nau8821->jack_present))
+			nau8821_jack_db_apply(nau8821, NAU8821_JACK_DB_BYPASS);
 		/* HPL/HPR short to ground */
 		regmap_update_bits(regmap, NAU8821_R0D_JACK_DET_CTRL,
 			NAU8821_SPKR_DWN1R | NAU8821_SPKR_DWN1L, 0);
-		if (nau8821->irq) {
+		if (nau8821_irq_on(nau8821)) {
 			/* Reset the configuration of jack type for detection.
 			 * Detach 2kOhm Resistors from MICBIAS to MICGND1/2.
 			 */
@@ -1397,14 +1943,18 @@ static int __maybe_unused nau8821_suspend(struct snd_soc_component *component)
 {
 	struct nau8821 *nau8821 = snd_soc_component_get_drvdata(component);
 
-	if (nau8821->irq)
-		disable_irq(nau8821->irq);
+	nau_hw_params_reset(&nau8821->hw_params_cache);
+	nau8821_irq_disable(nau8821);
+	nau_jack_report_flush(&nau8821->jack_rpt);
 	snd_soc_component_force_bias_level(component, SND_SOC_BIAS_OFF);
 	/* Power down codec power; don't support button wakeup */
 	snd_soc_component_disable_pin(component, "MICBIAS");
 	snd_soc_dapm_sync(nau8821->dapm);
+	cancel_delayed_work_sync(&nau8821->adc_unmute_work);
 	regcache_cache_only(nau8821->regmap, true);
 	regcache_mark_dirty(nau8821->regmap);
+	/* the coefficients are out of the cache and lost with the power */
+	nau8821->biq_shadow.valid = false;
 
 	return 0;
 }
@@ -1415,14 +1965,37 @@ static int __maybe_unused nau8821_resume(struct snd_soc_component *component)
 
 	regcache_cache_only(nau8821->regmap, false);
 	regcache_sync(nau8821->regmap);
-	if (nau8821->irq)
-		enable_irq(nau8821->irq);
+	/* The jack may have moved while suspended */
+	nau8821_jack_sample(nau8821);
+	nau8821_irq_enable(nau8821);
 
 	return 0;
 }
 
+static int __maybe_unused nau8821_runtime_suspend(struct device *dev)
+{
+	struct nau8821 *nau8821 = dev_get_drvdata(dev);
+
+	/* The codec keeps its power and the jack detection; only the bus
+	 * is left idle until a stream, a DAPM path or an interruption.
+	 */
+	regcache_cache_only(nau8821->regmap, true);
+
+	return 0;
+}
+
+static int __maybe_unused nau8821_runtime_resume(struct device *dev)
+{
+	struct nau8821 *nau8821 = dev_get_drvdata(dev);
+
+	regcache_cache_only(nau8821->regmap, false);
+	/* Writes only the registers changed while suspended, if any */
+	return regcache_sync(nau8821->regmap);
+}
+
 static const struct snd_soc_component_driver nau8821_component_driver = {
 	.probe			= nau8821_component_probe,
+	.remove			= nau8821_component_remove,
 	.set_sysclk		= nau8821_set_sysclk,
 	.set_pll		= nau8821_set_fll,
 	.set_bias_level		= nau8821_set_bias_level,
@@ -1460,9 +2033,13 @@ int nau8821_enable_jack_detect(struct snd_soc_component *component,
 	nau8821->jack = jack;
 	/* Initiate jack detection work queue */
 	INIT_WORK(&nau8821->jdet_work, nau8821_jdet_work);
-	ret = devm_request_threaded_irq(nau8821->dev, nau8821->irq, NULL,
-		nau8821_interrupt, IRQF_TRIGGER_LOW | IRQF_ONESHOT,
-		"nau8821", nau8821);
+	if (nau_irq_polled(&nau8821->irq_poll)) {
+		nau_irq_poll_enable(&nau8821->irq_poll);
+		return 0;
+	}
+	ret = nau_irq_request(nau8821->dev, nau8821->irq, &nau8821->irq_cfg,
+		nau8821_hardirq, nau8821_interrupt, IRQF_ONESHOT, "nau8821",
+		nau8821);
 	if (ret) {
 		dev_err(nau8821->dev, "Cannot request irq %d (%d)\n",
 			nau8821->irq, ret);
@@ -1493,104 +2070,110 @@ static void nau8821_print_device_properties(struct nau8821 *nau8821)
 		nau8821->jack_insert_debounce);
 	dev_dbg(dev, "jack-eject-debounce:  %d\n",
 		nau8821->jack_eject_debounce);
+	dev_dbg(dev, "jack-debounce-profile: %d\n",
+		nau8821->jack_db_profile);
 	dev_dbg(dev, "dmic-clk-threshold:       %d\n",
 		nau8821->dmic_clk_threshold);
+	dev_dbg(dev, "dmic-lp-clk:          %d-%d\n",
+		nau8821->dmic_lp_clk_min, nau8821->dmic_lp_clk_max);
+	dev_dbg(dev, "jack-detect-settle:   %d\n",
+		nau8821->jack_detect_settle);
+	dev_dbg(dev, "autosuspend-delay-ms: %d\n",
+		nau8821->autosuspend_delay);
+	dev_dbg(dev, "jack-poll-ms:         %d\n",
+		nau8821->irq_poll.period_ms);
 }
 
-static int nau8821_read_device_properties(struct device *dev,
+static const struct nau_prop_u32 nau8821_props[] = {
+	NAU_PROP_U32(struct nau8821, jkdet_polarity,
+		"nuvoton,jkdet-polarity", 1),
+	NAU_PROP_U32(struct nau8821, jack_rpt.window_ms,
+		"nuvoton,jack-report-window-ms", NAU_JACK_REPORT_MS),
+	NAU_PROP_U32(struct nau8821, micbias_voltage,
+		"nuvoton,micbias-voltage", 6),
+	NAU_PROP_U32(struct nau8821, vref_impedance,
+		"nuvoton,vref-impedance", 2),
+	NAU_PROP_U32(struct nau8821, jack_insert_debounce,
+		"nuvoton,jack-insert-debounce", 7),
+	NAU_PROP_U32(struct nau8821, jack_eject_debounce,
+		"nuvoton,jack-eject-debounce", 0),
+	NAU_PROP_U32(struct nau8821, jack_db_profile,
+		"nuvoton,jack-debounce-profile", NAU8821_JACK_DB_BYPASS),
+	NAU_PROP_U32(struct nau8821, dmic_clk_threshold,
+		"nuvoton,dmic-clk-threshold", 3072000),
+	NAU_PROP_U32(struct nau8821, dmic_lp_clk_min,
+		"nuvoton,dmic-lp-clk-min", 400000),
+	NAU_PROP_U32(struct nau8821, dmic_lp_clk_max,
+		"nuvoton,dmic-lp-clk-max", 800000),
+	NAU_PROP_U32(struct nau8821, jack_detect_settle,
+		"nuvoton,jack-detect-settle", 20),
+	NAU_PROP_U32(struct nau8821, autosuspend_delay,
+		"nuvoton,autosuspend-delay-ms", 3000),
+	NAU_PROP_U32(struct nau8821, irq_poll.period_ms,
+		"nuvoton,jack-poll-ms", 0),
+};
+
+static void nau8821_read_device_properties(struct device *dev,
 	struct nau8821 *nau8821)
 {
-	int ret;
-
 	nau8821->jkdet_enable = device_property_read_bool(dev,
 		"nuvoton,jkdet-enable");
 	nau8821->jkdet_pull_enable = device_property_read_bool(dev,
 		"nuvoton,jkdet-pull-enable");
 	nau8821->jkdet_pull_up = device_property_read_bool(dev,
 		"nuvoton,jkdet-pull-up");
-	ret = device_property_read_u32(dev, "nuvoton,jkdet-polarity",
-		&nau8821->jkdet_polarity);
-	if (ret)
-		nau8821->jkdet_polarity = 1;
-	ret = device_property_read_u32(dev, "nuvoton,micbias-voltage",
-		&nau8821->micbias_voltage);
-	if (ret)
-		nau8821->micbias_voltage = 6;
-	ret = device_property_read_u32(dev, "nuvoton,vref-impedance",
-		&nau8821->vref_impedance);
-	if (ret)
-		nau8821->vref_impedance = 2;
-	ret = device_property_read_u32(dev, "nuvoton,jack-insert-debounce",
-		&nau8821->jack_insert_debounce);
-	if (ret)
-		nau8821->jack_insert_debounce = 7;
-	ret = device_property_read_u32(dev, "nuvoton,jack-eject-debounce",
-		&nau8821->jack_eject_debounce);
-	if (ret)
-		nau8821->jack_eject_debounce = 0;
-	ret = device_property_read_u32(dev, "nuvoton,dmic-clk-threshold",
-		&nau8821->dmic_clk_threshold);
-	if (ret)
-		nau8821->dmic_clk_threshold = 3072000;
-
-	return 0;
+	nau8821->dmic_power_mode = device_property_read_bool(dev,
+		"nuvoton,dmic-low-power") ? NAU8821_DMIC_LOW_POWER :
+		NAU8821_DMIC_PERFORMANCE;
+	nau_irq_cfg_read(dev, &nau8821->irq_cfg);
+	nau_props_read_u32(dev, nau8821, nau8821_props,
+		ARRAY_SIZE(nau8821_props));
+	if ((u32)nau8821->jack_db_profile >= NAU8821_JACK_DB_NUM)
+		nau8821->jack_db_profile = NAU8821_JACK_DB_BYPASS;
 }
 
+/* The fixed part of the initiation, the reset values with the settings
+ * below made. Each register is written once; the settings depending on
+ * the device properties are updated around.
+ */
+static const struct reg_sequence nau8821_init_seq[] = {
+	/* Disable short Frame Sync detection logic */
+	{ NAU8821_R1E_LEFT_TIME_SLOT, 0x2000 },
+	/* Default oversampling/decimations settings are unusable
+	 * (audible hiss). Set it to something better.
+	 */
+	{ NAU8821_R2B_ADC_RATE, 0x0001 },
+	{ NAU8821_R2C_DAC_CTRL1, 0x0080 },
+	/* Class G timer 64ms */
+	{ NAU8821_R4B_CLASSG_CTRL, 0x2000 },
+	/* Class AB bias current to 2x, DAC Capacitor enable MSB/LSB */
+	{ NAU8821_R6A_ANALOG_CONTROL_2, 0x1003 },
+	/* DAC clock delay 2ns, VREF */
+	{ NAU8821_R73_RDAC, 0x002c },
+	/* Enable global bias, disable Boost Driver, Automatic Short circuit
+	 * protection enable.
+	 */
+	{ NAU8821_R76_BOOST, 0x3340 },
+};
+
 static void nau8821_init_regs(struct nau8821 *nau8821)
 {
 	struct regmap *regmap = nau8821->regmap;
 
-	/* Enable Bias/Vmid */
-	regmap_update_bits(regmap, NAU8821_R66_BIAS_ADJ,
-		NAU8821_BIAS_VMID, NAU8821_BIAS_VMID);
-	regmap_update_bits(regmap, NAU8821_R76_BOOST,
-		NAU8821_GLOBAL_BIAS_EN, NAU8821_GLOBAL_BIAS_EN);
-	/* VMID Tieoff setting and enable TESTDAC.
+	/* Enable Bias/Vmid. VMID Tieoff setting and enable TESTDAC.
 	 * This sets the analog DAC inputs to a '0' input signal to avoid
 	 * any glitches due to power up transients in both the analog and
 	 * digital DAC circuit.
 	 */
 	regmap_update_bits(regmap, NAU8821_R66_BIAS_ADJ,
-		NAU8821_BIAS_VMID_SEL_MASK | NAU8821_BIAS_TESTDAC_EN,
+		NAU8821_BIAS_VMID | NAU8821_BIAS_VMID_SEL_MASK |
+		NAU8821_BIAS_TESTDAC_EN, NAU8821_BIAS_VMID |
 		(nau8821->vref_impedance << NAU8821_BIAS_VMID_SEL_SFT) |
 		NAU8821_BIAS_TESTDAC_EN);
-	/* Disable short Frame Sync detection logic */
-	regmap_update_bits(regmap, NAU8821_R1E_LEFT_TIME_SLOT,
-		NAU8821_DIS_FS_SHORT_DET, NAU8821_DIS_FS_SHORT_DET);
-	/* Disable Boost Driver, Automatic Short circuit protection enable */
-	regmap_update_bits(regmap, NAU8821_R76_BOOST,
-		NAU8821_PRECHARGE_DIS | NAU8821_HP_BOOST_DIS |
-		NAU8821_HP_BOOST_G_DIS | NAU8821_SHORT_SHUTDOWN_EN,
-		NAU8821_PRECHARGE_DIS | NAU8821_HP_BOOST_DIS |
-		NAU8821_HP_BOOST_G_DIS | NAU8821_SHORT_SHUTDOWN_EN);
-	/* Class G timer 64ms */
-	regmap_update_bits(regmap, NAU8821_R4B_CLASSG_CTRL,
-		NAU8821_CLASSG_TIMER_MASK,
-		0x20 << NAU8821_CLASSG_TIMER_SFT);
-	/* Class AB bias current to 2x, DAC Capacitor enable MSB/LSB */
-	regmap_update_bits(regmap, NAU8821_R6A_ANALOG_CONTROL_2,
-		NAU8821_HP_NON_CLASSG_CURRENT_2xADJ |
-		NAU8821_DAC_CAPACITOR_MSB | NAU8821_DAC_CAPACITOR_LSB,
-		NAU8821_HP_NON_CLASSG_CURRENT_2xADJ |
-		NAU8821_DAC_CAPACITOR_MSB | NAU8821_DAC_CAPACITOR_LSB);
-	/* Disable DACR/L power */
-	regmap_update_bits(regmap, NAU8821_R80_CHARGE_PUMP,
-		NAU8821_POWER_DOWN_DACR | NAU8821_POWER_DOWN_DACL, 0);
-	/* DAC clock delay 2ns, VREF */
-	regmap_update_bits(regmap, NAU8821_R73_RDAC,
-		NAU8821_DAC_CLK_DELAY_MASK | NAU8821_DAC_VREF_MASK,
-		(0x2 << NAU8821_DAC_CLK_DELAY_SFT) |
-		(0x3 << NAU8821_DAC_VREF_SFT));
-
+	regmap_multi_reg_write(regmap, nau8821_init_seq,
+		ARRAY_SIZE(nau8821_init_seq));
 	regmap_update_bits(regmap, NAU8821_R74_MIC_BIAS,
 		NAU8821_MICBIAS_VOLTAGE_MASK, nau8821->micbias_voltage);
-	/* Default oversampling/decimations settings are unusable
-	 * (audible hiss). Set it to something better.
-	 */
-	regmap_update_bits(regmap, NAU8821_R2B_ADC_RATE,
-		NAU8821_ADC_SYNC_DOWN_MASK, NAU8821_ADC_SYNC_DOWN_64);
-	regmap_update_bits(regmap, NAU8821_R2C_DAC_CTRL1,
-		NAU8821_DAC_OVERSAMPLE_MASK, NAU8821_DAC_OVERSAMPLE_64);
 }
 
 static int nau8821_setup_irq(struct nau8821 *nau8821)
@@ -1631,8 +2214,12 @@ static int nau8821_setup_irq(struct nau8821 *nau8821)
 	return 0;
 }
 
-static int nau8821_i2c_probe(struct i2c_client *i2c,
-	const struct i2c_device_id *id)
+static void nau8821_destroy_wq(void *data)
+{
+	destroy_workqueue(data);
+}
+
+static int __nau8821_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8821 *nau8821 = dev_get_platdata(&i2c->dev);
@@ -1642,16 +2229,36 @@ static int nau8821_i2c_probe(struct i2c_client *i2c,
 		nau8821 = devm_kzalloc(dev, sizeof(*nau8821), GFP_KERNEL);
 		if (!nau8821)
 			return -ENOMEM;
-		nau8821_read_device_properties(dev, nau8821);
+		if (!nau_props_cache_restore(dev, nau8821, sizeof(*nau8821))) {
+			nau8821_read_device_properties(dev, nau8821);
+			nau_props_cache_store(dev, nau8821, sizeof(*nau8821));
+		}
 	}
 	i2c_set_clientdata(i2c, nau8821);
 
-	nau8821->regmap = devm_regmap_init_i2c(i2c, &nau8821_regmap_config);
+	nau8821->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&nau8821_regmap_config, &nau8821->regstat);
 	if (IS_ERR(nau8821->regmap))
 		return PTR_ERR(nau8821->regmap);
 
 	nau8821->dev = dev;
 	nau8821->irq = i2c->irq;
+	/* the polls only stand in for a line not wired */
+	if (nau8821->irq)
+		nau8821->irq_poll.period_ms = 0;
+	nau_irq_poll_init(&nau8821->irq_poll, dev, nau8821->regmap,
+		NAU8821_R10_IRQ_STATUS, 0x3ff, nau8821_hardirq,
+		nau8821_interrupt, nau8821);
+	/* the polls run on a shared worker, at its priority */
+	if (nau_irq_polled(&nau8821->irq_poll))
+		nau8821->irq_cfg.prio = 0;
+	/* The settle property is the longest wait of the detection */
+	nau_jdet_settle_init(&nau8821->jdet_settle, NAU8821_JDET_CONFIRM_MS,
+		nau8821->jack_detect_settle);
+	nau_jack_report_init(&nau8821->jack_rpt, &nau8821->irq_time);
+	nau_biq_rates_init(&nau8821->biq_rates, nau8821->regmap,
+		NAU8821_R21_BIQ0_COF1, NAU8821_BIQ_COF_NUM * 2,
+		&nau8821->biq_shadow, 0, 0);
 	nau8821_print_device_properties(nau8821);
 
 	nau8821_reset_chip(nau8821->regmap);
@@ -1661,9 +2268,31 @@ static int nau8821_i2c_probe(struct i2c_client *i2c,
 		return ret;
 	}
 	nau8821_init_regs(nau8821);
+	nau8821_jack_sample(nau8821);
 
-	if (i2c->irq)
+	/* Runtime PM is up before the interruption, which wakes it up */
+	pm_runtime_set_autosuspend_delay(dev, nau8821->autosuspend_delay);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_set_active(dev);
+	ret = devm_pm_runtime_enable(dev);
+	if (ret)
+		return ret;
+
+	/* The jack detection has a queue of its own, so it doesn't wait
+	 * behind the unrelated work of the system workqueue under load.
+	 */
+	nau8821->jdet_wq = alloc_workqueue("%s-jdet", WQ_HIGHPRI, 0,
+					   dev_name(dev));
+	if (!nau8821->jdet_wq)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(dev, nau8821_destroy_wq,
+				       nau8821->jdet_wq);
+	if (ret)
+		return ret;
+
+	if (nau8821_irq_on(nau8821))
 		nau8821_setup_irq(nau8821);
+	nau_pm_async_init(dev);
 
 	ret = devm_snd_soc_register_component(&i2c->dev,
 		&nau8821_component_driver, &nau8821_dai, 1);
@@ -1671,11 +2300,20 @@ static int nau8821_i2c_probe(struct i2c_client *i2c,
 	return ret;
 }
 
+static int nau8821_i2c_probe(struct i2c_client *i2c,
+	const struct i2c_device_id *id)
+{
+	return nau_props_cache_end(&i2c->dev, __nau8821_i2c_probe(i2c));
+}
+
 static int nau8821_i2c_remove(struct i2c_client *i2c_client)
 {
 	struct nau8821 *nau8821 = i2c_get_clientdata(i2c_client);
 
-	devm_free_irq(nau8821->dev, nau8821->irq, nau8821);
+	if (nau8821->irq)
+		devm_free_irq(nau8821->dev, nau8821->irq, nau8821);
+	else
+		nau_irq_poll_disable(&nau8821->irq_poll);
 
 	return 0;
 }
@@ -1702,11 +2340,18 @@ static const struct acpi_device_id nau8821_acpi_match[] = {
 MODULE_DEVICE_TABLE(acpi, nau8821_acpi_match);
 #endif
 
+static const struct dev_pm_ops nau8821_pm_ops = {
+	SET_RUNTIME_PM_OPS(nau8821_runtime_suspend, nau8821_runtime_resume,
+			   NULL)
+};
+
 static struct i2c_driver nau8821_driver = {
 	.driver = {
 		.name = "nau8821",
 		.of_match_table = of_match_ptr(nau8821_of_ids),
 		.acpi_match_table = ACPI_PTR(nau8821_acpi_match),
+		.pm = &nau8821_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe = nau8821_i2c_probe,
 	.remove = nau8821_i2c_remove,
@@ -296,6 +296,9 @@
 #define NAU8821_BIQ0_ADC_EN_SFT         3
 #define NAU8821_BIQ0_ADC_EN_EN          (0x1 << NAU8821_BIQ0_ADC_EN_SFT)
 
+/* BIQ0_COF1 (0x21) to BIQ0_COF10 (0x2a) */
+#define NAU8821_BIQ_COF_NUM		10
+
 /* ADC_RATE (0x2b) */
 #define NAU8821_ADC_SYNC_DOWN_SFT	0
 #define NAU8821_ADC_SYNC_DOWN_MASK	0x3
@@ -441,6 +444,7 @@
 /* MIC_BIAS (0x74) */
 #define NAU8821_MICBIAS_JKR2		(0x1 << 12)
 #define NAU8821_MICBIAS_POWERUP_SFT	8
+#define NAU8821_MICBIAS_POWERUP		(0x1 << NAU8821_MICBIAS_POWERUP_SFT)
 #define NAU8821_MICBIAS_VOLTAGE_SFT	0
 #define NAU8821_MICBIAS_VOLTAGE_MASK	0x7
 
@@ -505,15 +509,82 @@ enum {
 	NAU8821_CLK_FLL_MCLK,
 	NAU8821_CLK_FLL_BLK,
 	NAU8821_CLK_FLL_FS,
+	/* hw_params plans the sysclk, freq is the MCLK available or 0 */
+	NAU8821_CLK_AUTO,
+};
+
+/* settle time of the ADC channels before the unmute */
+#define NAU8821_ADC_SETTLE_MS	125
+
+/* The debounce of the jack detection without a jack, applied by
+ * nau8821_jack_db_apply()
+ */
+enum {
+	NAU8821_JACK_DB_BYPASS,
+	NAU8821_JACK_DB_FILTER,
+	NAU8821_JACK_DB_NUM,
+};
+
+/* the time the bypass of the debounce is kept after a resume */
+#define NAU8821_JACK_DB_RESUME_MS	1000
+
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8821_LAT_HW_PARAMS,
+	NAU8821_LAT_PUMP,
+	/* the jack type detection, its wait for a worker and its run */
+	NAU8821_LAT_JDET_QUEUE,
+	NAU8821_LAT_JDET_RUN,
+	/* the hard interruption to the run of its thread */
+	NAU8821_LAT_IRQ_THREAD,
+	NAU8821_LAT_NUM,
+};
+
+/* The DMIC clock modes. Performance runs the mics at the highest clock
+ * allowed, for their full SNR and bandwidth. Low Power runs them at the
+ * lowest clock in the low-power range of the mics, which cuts the current
+ * of a mic to a fraction at a few dB less SNR and a bandwidth for speech
+ * rates, 16 kHz capture or less; see the datasheet of the mic. The mode
+ * takes effect at the next DMIC power-up.
+ */
+enum {
+	NAU8821_DMIC_PERFORMANCE,
+	NAU8821_DMIC_LOW_POWER,
+};
+
+/* The selection of the OSR of a stream at hw_params */
+enum {
+	NAU8821_OSR_MANUAL,	/* the OSR of the controls */
+	NAU8821_OSR_LOW_LATENCY,
+	NAU8821_OSR_LOW_POWER,
+	NAU8821_OSR_QUALITY,
 };
 
 struct nau8821 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_latency latency[NAU8821_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	struct nau_clk_planner clk_plan;
+	struct nau_jack_report jack_rpt;
+	struct nau_delay delay;
+	struct nau_dapm_stat dapm_stat;
+	int osr_policy;
 	struct snd_soc_dapm_context *dapm;
 	struct snd_soc_jack *jack;
+	struct workqueue_struct *jdet_wq;
 	struct work_struct jdet_work;
+	ktime_t jdet_queued;
+	/* the jack state the interruption last read */
+	bool jack_present;
+	struct delayed_work adc_unmute_work;
+	struct nau_fll_cache fll_cache;
 	int irq;
+	struct nau_irq_cfg irq_cfg;
+	struct nau_irq_poll irq_poll;	/* in place of a line not wired */
+	ktime_t irq_time;
 	int clk_id;
 	int micbias_voltage;
 	int vref_impedance;
@@ -523,8 +594,21 @@ struct nau8821 {
 	int jkdet_polarity;
 	int jack_insert_debounce;
 	int jack_eject_debounce;
+	int jack_db_profile;	/* the debounce of the board */
+	int jack_db_applied;
+	struct delayed_work jack_db_work;
 	int fs;
 	int dmic_clk_threshold;
+	int dmic_power_mode;
+	int dmic_lp_clk_min;
+	int dmic_lp_clk_max;
+	int jack_detect_settle;
+	struct nau_jdet_settle jdet_settle;
+	int autosuspend_delay;
+	bool pm_held; /* runtime PM held while a DAPM path is powered */
+	struct nau_coeff_shadow biq_shadow;
+	/* the coefficients kept per sampling rate */
+	struct nau_biq_rates biq_rates;
 };
 
 int nau8821_enable_jack_detect(struct snd_soc_component *component,
@@ -0,0 +1,244 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Scene recall of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_SCENE_H__
+#define __NAU_SCENE_H__
+
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/ktime.h>
+#include <linux/property.h>
+#include <sound/soc.h>
+#include "nau-latency.h"
+
+/* A scene is a use case of the board, like music, call or voice assistant,
+ * which the device properties describe:
+ *
+ *	nuvoton,scene-names = "music", "call";
+ *	nuvoton,scene-call-regs = <reg mask val>, ...;
+ *	nuvoton,scene-call-pins-on = "MIC", ...;
+ *	nuvoton,scene-call-pins-off = "SPK", ...;
+ *
+ * The registers take the gains and the EQ, the pins the routing. The
+ * "Scene" control recalls one under the DAPM mutex, with one DAPM walk
+ * at the end, so a profile switch is one write of the client and no
+ * intermediate path gets powered. Item 0 "None" recalls nothing.
+ */
+#define NAU_SCENE_MAX		8
+#define NAU_SCENE_PROP_LEN	64
+
+struct nau_scene {
+	u32 *regs;		/* reg, mask, val triplets */
+	int num_regs;
+	const char **pins_on;
+	int num_on;
+	const char **pins_off;
+	int num_off;
+};
+
+struct nau_scenes {
+	struct nau_scene scene[NAU_SCENE_MAX];
+	const char *texts[NAU_SCENE_MAX + 1];
+	int num;
+	int cur;
+	struct soc_enum en;
+	u32 recalls;
+	struct nau_latency lat;
+};
+
+/* Read the string array @prop, returns the count or 0 */
+static inline int nau_scene_read_pins(struct device *dev, const char *prop,
+	const char ***pins)
+{
+	int num, ret;
+
+	num = device_property_string_array_count(dev, prop);
+	if (num <= 0)
+		return 0;
+	*pins = devm_kcalloc(dev, num, sizeof(**pins), GFP_KERNEL);
+	if (!*pins)
+		return 0;
+	ret = device_property_read_string_array(dev, prop, *pins, num);
+
+	return ret < 0 ? 0 : num;
+}
+
+static inline void nau_scene_read(struct device *dev, struct nau_scene *sc,
+	const char *name)
+{
+	char prop[NAU_SCENE_PROP_LEN];
+	int num;
+
+	snprintf(prop, sizeof(prop), "nuvoton,scene-%s-regs", name);
+	num = device_property_count_u32(dev, prop);
+	if (num > 0) {
+		if (num % 3)
+			dev_warn(dev, "%s takes reg, mask, val triplets\n", prop);
+		num -= num % 3;
+	}
+	if (num > 0) {
+		sc->regs = devm_kcalloc(dev, num, sizeof(*sc->regs),
+			GFP_KERNEL);
+		if (sc->regs &&
+		    !device_property_read_u32_array(dev, prop, sc->regs, num))
+			sc->num_regs = num / 3;
+	}
+	snprintf(prop, sizeof(prop), "nuvoton,scene-%s-pins-on", name);
+	sc->num_on = nau_scene_read_pins(dev, prop, &sc->pins_on);
+	snprintf(prop, sizeof(prop), "nuvoton,scene-%s-pins-off", name);
+	sc->num_off = nau_scene_read_pins(dev, prop, &sc->pins_off);
+}
+
+/**
+ * nau_scenes_read - Read the scenes of the board.
+ * @dev: the device of the codec.
+ * @scenes: the scenes.
+ *
+ * The scenes are kept over a new probe of the component.
+ */
+static inline void nau_scenes_read(struct device *dev,
+	struct nau_scenes *scenes)
+{
+	int i, num;
+
+	if (scenes->num)
+		return;
+	num = device_property_string_array_count(dev, "nuvoton,scene-names");
+	if (num <= 0)
+		return;
+	if (num > NAU_SCENE_MAX) {
+		dev_warn(dev, "Only the first %d scenes\n", NAU_SCENE_MAX);
+		num = NAU_SCENE_MAX;
+	}
+	if (device_property_read_string_array(dev, "nuvoton,scene-names",
+					      &scenes->texts[1], num) < 0)
+		return;
+	scenes->texts[0] = "None";
+	for (i = 0; i < num; i++)
+		nau_scene_read(dev, &scenes->scene[i], scenes->texts[i + 1]);
+	scenes->num = num;
+}
+
+/* Recall the scene @sel, from 1, as one DAPM update */
+static inline int nau_scene_recall(struct snd_soc_component *component,
+	struct nau_scenes *scenes, int sel)
+{
+	struct snd_soc_dapm_context *dapm =
+		snd_soc_component_get_dapm(component);
+	struct nau_scene *sc = &scenes->scene[sel - 1];
+	ktime_t start = ktime_get();
+	int i, ret = 0;
+
+	mutex_lock(&dapm->card->dapm_mutex);
+	for (i = 0; i < sc->num_regs; i++) {
+		ret = snd_soc_component_update_bits(component, sc->regs[i * 3],
+			sc->regs[i * 3 + 1], sc->regs[i * 3 + 2]);
+		if (ret < 0) {
+			dev_err(component->dev, "Scene %s: write of 0x%x: %d\n",
+				scenes->texts[sel], sc->regs[i * 3], ret);
+			goto unlock;
+		}
+	}
+	/* the new path on before the old one goes off, in one walk */
+	for (i = 0; i < sc->num_on; i++)
+		snd_soc_dapm_enable_pin_unlocked(dapm, sc->pins_on[i]);
+	for (i = 0; i < sc->num_off; i++)
+		snd_soc_dapm_disable_pin_unlocked(dapm, sc->pins_off[i]);
+	ret = snd_soc_dapm_sync_unlocked(dapm);
+	scenes->recalls++;
+	nau_latency_add(&scenes->lat, start);
+ unlock:
+	mutex_unlock(&dapm->card->dapm_mutex);
+
+	return ret;
+}
+
+static inline int nau_scene_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	struct nau_scenes *scenes = container_of(e, struct nau_scenes, en);
+
+	ucontrol->value.enumerated.item[0] = scenes->cur;
+
+	return 0;
+}
+
+static inline int nau_scene_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct soc_enum *e = (struct soc_enum *)kcontrol->private_value;
+	struct nau_scenes *scenes = container_of(e, struct nau_scenes, en);
+	unsigned int sel = ucontrol->value.enumerated.item[0];
+	int ret;
+
+	if (sel >= e->items)
+		return -EINVAL;
+	if (sel == scenes->cur)
+		return 0;
+	if (sel) {
+		ret = nau_scene_recall(component, scenes, sel);
+		if (ret < 0)
+			return ret;
+	}
+	scenes->cur = sel;
+
+	return 1;
+}
+
+/**
+ * nau_scenes_init - Add the "Scene" control of the scenes read.
+ * @component: the codec.
+ * @scenes: the scenes.
+ */
+static inline int nau_scenes_init(struct snd_soc_component *component,
+	struct nau_scenes *scenes)
+{
+	struct snd_kcontrol_new control = {
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "Scene",
+		.info = snd_soc_info_enum_double,
+		.get = nau_scene_get,
+		.put = nau_scene_put,
+		.private_value = (unsigned long)&scenes->en,
+	};
+
+	if (!scenes->num)
+		return 0;
+
+	scenes->cur = 0;
+	scenes->en.reg = SND_SOC_NOPM;
+	scenes->en.items = scenes->num + 1;
+	scenes->en.texts = scenes->texts;
+
+	return snd_soc_add_component_controls(component, &control, 1);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_scenes_debugfs_init(struct dentry *root,
+	struct nau_scenes *scenes)
+{
+	struct dentry *dir;
+
+	if (!root || !scenes->num)
+		return;
+
+	dir = debugfs_create_dir("scene", root);
+	debugfs_create_u32("recalls", 0444, dir, &scenes->recalls);
+	debugfs_create_file("latency", 0444, dir, &scenes->lat,
+			    &nau_latency_fops);
+}
+#else
+static inline void nau_scenes_debugfs_init(struct dentry *root,
+	struct nau_scenes *scenes)
+{
+}
+#endif
+
+#endif /* __NAU_SCENE_H__ */
@@ -0,0 +1,157 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the PLL solver of NAU8822
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8822.c, as the solver and its tables are
+ * static.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+/* the input clocks of the boards, in NAU_PLL_REF_MIN..NAU_PLL_REF_MAX */
+static const unsigned int nau8822_test_pll_in[] = {
+	8192000, 11289600, 12000000, 12288000, 13000000, 16384000,
+	19200000, 22579200, 24000000, 24576000, 26000000,
+};
+
+static const unsigned int nau8822_test_fs[] = {
+	8000, 11025, 12000, 16000, 22050, 24000, 32000, 44100, 48000,
+};
+
+/* A scaler of MCLK takes fs to the PLL range, as reference */
+static bool nau8822_test_solvable(unsigned int fs)
+{
+	u64 f2;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nau8822_mclk_scaler); i++) {
+		f2 = 256 * fs * 4 * nau8822_mclk_scaler[i] / 10;
+		if (f2 > NAU_PLL_FREQ_MIN && f2 < NAU_PLL_FREQ_MAX)
+			return true;
+	}
+
+	return false;
+}
+
+/* Check the PLL as nau8822_set_pll() programs it */
+static void nau8822_test_check(struct kunit *test, unsigned int pll_in,
+	unsigned int fs, const struct nau8822_pll *pll)
+{
+	u64 f2, f2_pll, err_max;
+
+	KUNIT_ASSERT_TRUE_MSG(test, pll->mclk_scaler >= 0 &&
+		pll->mclk_scaler < ARRAY_SIZE(nau8822_mclk_scaler),
+		"in %u fs %u: mclk_scaler %d", pll_in, fs, pll->mclk_scaler);
+	KUNIT_EXPECT_TRUE(test, pll->pre_factor == 0 || pll->pre_factor == 1);
+
+	/* the PLL output, divided by 4 and the scaler, is 256 fs */
+	f2 = 256 * fs * 4 * nau8822_mclk_scaler[pll->mclk_scaler] / 10;
+	KUNIT_EXPECT_EQ(test, f2 * 10,
+		(u64)256 * fs * 4 * nau8822_mclk_scaler[pll->mclk_scaler]);
+	KUNIT_EXPECT_TRUE_MSG(test, f2 > NAU_PLL_FREQ_MIN &&
+		f2 < NAU_PLL_FREQ_MAX, "in %u fs %u: PLL %llu out of %d..%d",
+		pll_in, fs, f2, NAU_PLL_FREQ_MIN, NAU_PLL_FREQ_MAX);
+
+	KUNIT_EXPECT_GE_MSG(test, pll->pll_int, NAU_PLL_OPTOP_MIN,
+		"in %u fs %u", pll_in, fs);
+	KUNIT_EXPECT_LE(test, pll->pll_int, 0xf);
+	KUNIT_EXPECT_LT(test, pll->pll_frac, 1 << 24);
+
+	/* N.K of the reference gives the PLL output, K truncated */
+	f2_pll = div_u64((((u64)pll->pll_int << 24) | pll->pll_frac) * pll_in,
+		1 << (24 + pll->pre_factor));
+	err_max = (pll_in >> 24) + 1;
+	KUNIT_EXPECT_LE_MSG(test, f2_pll, f2, "in %u fs %u", pll_in, fs);
+	KUNIT_EXPECT_LE_MSG(test, f2 - f2_pll, err_max,
+		"in %u fs %u: PLL %llu for %llu", pll_in, fs, f2_pll, f2);
+}
+
+/* Sweep the input clock x fs */
+static void nau8822_test_pll_sweep(struct kunit *test)
+{
+	struct nau8822_pll pll;
+	int i, f, ret, calls = 0, solved = 0;
+	ktime_t start, spent = 0;
+
+	for (f = 0; f < ARRAY_SIZE(nau8822_test_fs); f++)
+		for (i = 0; i < ARRAY_SIZE(nau8822_test_pll_in); i++) {
+			memset(&pll, 0, sizeof(pll));
+			start = ktime_get();
+			ret = nau8822_calc_pll(nau8822_test_pll_in[i],
+				nau8822_test_fs[f], &pll);
+			spent = ktime_add(spent, ktime_sub(ktime_get(), start));
+			calls++;
+			KUNIT_EXPECT_EQ_MSG(test, ret,
+				nau8822_test_solvable(nau8822_test_fs[f]) ?
+				0 : -EINVAL,
+				"in %u fs %u: %d", nau8822_test_pll_in[i],
+				nau8822_test_fs[f], ret);
+			if (ret)
+				continue;
+			solved++;
+			nau8822_test_check(test, nau8822_test_pll_in[i],
+				nau8822_test_fs[f], &pll);
+		}
+	KUNIT_EXPECT_EQ(test, solved, calls);
+	kunit_info(test, "%d of %d solved, %lld ns per call\n", solved, calls,
+		div_s64(ktime_to_ns(spent), calls));
+}
+
+static void nau8822_test_pll_out_of_range(struct kunit *test)
+{
+	struct nau8822_pll pll;
+
+	KUNIT_EXPECT_EQ(test, nau8822_calc_pll(NAU_PLL_REF_MIN - 1, 48000,
+		&pll), -EINVAL);
+	KUNIT_EXPECT_EQ(test, nau8822_calc_pll(NAU_PLL_REF_MAX + 1, 48000,
+		&pll), -EINVAL);
+	KUNIT_EXPECT_EQ(test, nau8822_calc_pll(12288000, 0, &pll), -EINVAL);
+}
+
+/* The memo keeps the last NAU8822_CLK_MEMO_NUM solutions */
+static void nau8822_test_clk_memo(struct kunit *test)
+{
+	struct nau8822 *nau8822;
+	const struct nau8822_clk_memo *memo;
+	struct nau8822_pll pll;
+	int i;
+
+	nau8822 = kunit_kzalloc(test, sizeof(*nau8822), GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, nau8822);
+
+	for (i = 0; i <= NAU8822_CLK_MEMO_NUM; i++) {
+		KUNIT_ASSERT_EQ(test, nau8822_calc_pll(nau8822_test_pll_in[i],
+			48000, &pll), 0);
+		nau8822_clk_memo_add(nau8822, nau8822_test_pll_in[i], 48000,
+			NAU8822_CLKM_PLL, &pll);
+	}
+	KUNIT_EXPECT_EQ(test, nau8822->clk_memo_num, NAU8822_CLK_MEMO_NUM);
+
+	/* the oldest one replaced */
+	KUNIT_EXPECT_FALSE(test, nau8822_clk_memo_find(nau8822,
+		nau8822_test_pll_in[0], 48000, NAU8822_CLKM_PLL));
+	memo = nau8822_clk_memo_find(nau8822, nau8822_test_pll_in[i - 1],
+		48000, NAU8822_CLKM_PLL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, memo);
+	KUNIT_EXPECT_EQ(test, memo->pll.pll_int, pll.pll_int);
+	KUNIT_EXPECT_EQ(test, memo->pll.pll_frac, pll.pll_frac);
+	KUNIT_EXPECT_FALSE(test, nau8822_clk_memo_find(nau8822,
+		nau8822_test_pll_in[i - 1], 48000, NAU8822_CLKM_MCLK));
+}
+
+static struct kunit_case nau8822_test_cases[] = {
+	KUNIT_CASE(nau8822_test_pll_sweep),
+	KUNIT_CASE(nau8822_test_pll_out_of_range),
+	KUNIT_CASE(nau8822_test_clk_memo),
+	{}
+};
+
+static struct kunit_suite nau8822_test_suite = {
+	.name = "nau8822-pll",
+	.test_cases = nau8822_test_cases,
+};
+kunit_test_suite(nau8822_test_suite);
@@ -14,11 +14,12 @@
 #include <linux/moduleparam.h>
 #include <linux/kernel.h>
 #include <linux/init.h>
-#include <linux/delay.h>
 #include <linux/pm.h>
 #include <linux/i2c.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
+#include <linux/completion.h>
+#include <linux/workqueue.h>
 #include <sound/core.h>
 #include <sound/pcm.h>
 #include <sound/pcm_params.h>
@@ -26,6 +27,10 @@
 #include <sound/initval.h>
 #include <sound/tlv.h>
 #include <asm/div64.h>
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-regmap.h"
+#include "nau-scene.h"
 #include "nau8822.h"
 
 #define NAU_PLL_FREQ_MAX 100000000
@@ -107,142 +112,496 @@ static const struct reg_default nau8822_reg_defaults[] = {
 	{ NAU8822_REG_OUTPUT_TIEOFF, 0x0000 },
 };
 
+#define NAU8822_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8822_REG_RESET, NAU8822_REG_JACK_DETECT_CONTROL_1) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_DAC_CONTROL, NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME) |	\
+	NAU_REG(w, NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME) |		\
+	NAU_REG_RANGE(w, NAU8822_REG_EQ1, NAU8822_REG_EQ5) |		\
+	NAU_REG_RANGE(w, NAU8822_REG_DAC_LIMITER_1, NAU8822_REG_DAC_LIMITER_2) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_NOTCH_FILTER_1, NAU8822_REG_NOTCH_FILTER_4) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_ALC_CONTROL_1, NAU8822_REG_PLL_K3) |	\
+	NAU_REG(w, NAU8822_REG_3D_CONTROL) |				\
+	NAU_REG(w, NAU8822_REG_RIGHT_SPEAKER_CONTROL) |			\
+	NAU_REG_RANGE(w, NAU8822_REG_INPUT_CONTROL, NAU8822_REG_LEFT_ADC_BOOST_CONTROL) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_RIGHT_ADC_BOOST_CONTROL, NAU8822_REG_AUX1_MIXER) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_POWER_MANAGEMENT_4, NAU8822_REG_DEVICE_ID) |	\
+	NAU_REG(w, NAU8822_REG_DAC_DITHER) |				\
+	NAU_REG_RANGE(w, NAU8822_REG_ALC_ENHANCE_1, NAU8822_REG_MISC_CONTROL) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_INPUT_TIEOFF, NAU8822_REG_OUTPUT_TIEOFF))
+
+static const u32 nau8822_readable_map[] = NAU_REGMAP(NAU8822_READABLE_REGS);
+
 static bool nau8822_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8822_REG_RESET ... NAU8822_REG_JACK_DETECT_CONTROL_1:
-	case NAU8822_REG_DAC_CONTROL ... NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME:
-	case NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME:
-	case NAU8822_REG_EQ1 ... NAU8822_REG_EQ5:
-	case NAU8822_REG_DAC_LIMITER_1 ... NAU8822_REG_DAC_LIMITER_2:
-	case NAU8822_REG_NOTCH_FILTER_1 ... NAU8822_REG_NOTCH_FILTER_4:
-	case NAU8822_REG_ALC_CONTROL_1 ...NAU8822_REG_PLL_K3:
-	case NAU8822_REG_3D_CONTROL:
-	case NAU8822_REG_RIGHT_SPEAKER_CONTROL:
-	case NAU8822_REG_INPUT_CONTROL ... NAU8822_REG_LEFT_ADC_BOOST_CONTROL:
-	case NAU8822_REG_RIGHT_ADC_BOOST_CONTROL ... NAU8822_REG_AUX1_MIXER:
-	case NAU8822_REG_POWER_MANAGEMENT_4 ... NAU8822_REG_DEVICE_ID:
-	case NAU8822_REG_DAC_DITHER:
-	case NAU8822_REG_ALC_ENHANCE_1 ... NAU8822_REG_MISC_CONTROL:
-	case NAU8822_REG_INPUT_TIEOFF ... NAU8822_REG_OUTPUT_TIEOFF:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8822_readable_map, reg);
 }
 
+#define NAU8822_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8822_REG_RESET, NAU8822_REG_JACK_DETECT_CONTROL_1) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_DAC_CONTROL, NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME) |	\
+	NAU_REG(w, NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME) |		\
+	NAU_REG_RANGE(w, NAU8822_REG_EQ1, NAU8822_REG_EQ5) |		\
+	NAU_REG_RANGE(w, NAU8822_REG_DAC_LIMITER_1, NAU8822_REG_DAC_LIMITER_2) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_NOTCH_FILTER_1, NAU8822_REG_NOTCH_FILTER_4) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_ALC_CONTROL_1, NAU8822_REG_PLL_K3) |	\
+	NAU_REG(w, NAU8822_REG_3D_CONTROL) |				\
+	NAU_REG(w, NAU8822_REG_RIGHT_SPEAKER_CONTROL) |			\
+	NAU_REG_RANGE(w, NAU8822_REG_INPUT_CONTROL, NAU8822_REG_LEFT_ADC_BOOST_CONTROL) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_RIGHT_ADC_BOOST_CONTROL, NAU8822_REG_AUX1_MIXER) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_POWER_MANAGEMENT_4, NAU8822_REG_DEVICE_ID) |	\
+	NAU_REG(w, NAU8822_REG_DAC_DITHER) |				\
+	NAU_REG_RANGE(w, NAU8822_REG_ALC_ENHANCE_1, NAU8822_REG_MISC_CONTROL) |	\
+	NAU_REG_RANGE(w, NAU8822_REG_INPUT_TIEOFF, NAU8822_REG_OUTPUT_TIEOFF))
+
+static const u32 nau8822_writeable_map[] = NAU_REGMAP(NAU8822_WRITEABLE_REGS);
+
 static bool nau8822_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8822_REG_RESET ... NAU8822_REG_JACK_DETECT_CONTROL_1:
-	case NAU8822_REG_DAC_CONTROL ... NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME:
-	case NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME:
-	case NAU8822_REG_EQ1 ... NAU8822_REG_EQ5:
-	case NAU8822_REG_DAC_LIMITER_1 ... NAU8822_REG_DAC_LIMITER_2:
-	case NAU8822_REG_NOTCH_FILTER_1 ... NAU8822_REG_NOTCH_FILTER_4:
-	case NAU8822_REG_ALC_CONTROL_1 ...NAU8822_REG_PLL_K3:
-	case NAU8822_REG_3D_CONTROL:
-	case NAU8822_REG_RIGHT_SPEAKER_CONTROL:
-	case NAU8822_REG_INPUT_CONTROL ... NAU8822_REG_LEFT_ADC_BOOST_CONTROL:
-	case NAU8822_REG_RIGHT_ADC_BOOST_CONTROL ... NAU8822_REG_AUX1_MIXER:
-	case NAU8822_REG_POWER_MANAGEMENT_4 ... NAU8822_REG_DEVICE_ID:
-	case NAU8822_REG_DAC_DITHER:
-	case NAU8822_REG_ALC_ENHANCE_1 ... NAU8822_REG_MISC_CONTROL:
-	case NAU8822_REG_INPUT_TIEOFF ... NAU8822_REG_OUTPUT_TIEOFF:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8822_writeable_map, reg);
 }
 
+#define NAU8822_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8822_REG_RESET) |					\
+	NAU_REG(w, NAU8822_REG_DEVICE_REVISION) |			\
+	NAU_REG(w, NAU8822_REG_DEVICE_ID) |				\
+	NAU_REG(w, NAU8822_REG_AGC_PEAK2PEAK) |				\
+	NAU_REG(w, NAU8822_REG_AGC_PEAK_DETECT) |			\
+	NAU_REG(w, NAU8822_REG_AUTOMUTE_CONTROL))
+
+static const u32 nau8822_volatile_map[] = NAU_REGMAP(NAU8822_VOLATILE_REGS);
+
 static bool nau8822_volatile(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8822_REG_RESET:
-	case NAU8822_REG_DEVICE_REVISION:
-	case NAU8822_REG_DEVICE_ID:
-	case NAU8822_REG_AGC_PEAK2PEAK:
-	case NAU8822_REG_AGC_PEAK_DETECT:
-	case NAU8822_REG_AUTOMUTE_CONTROL:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8822_volatile_map, reg);
 }
 
 /* The EQ parameters get function is to get the 5 band equalizer control.
- * The regmap raw read can't work here because regmap doesn't provide
- * value format for value width of 9 bits. Therefore, the driver reads data
- * from cache and makes value format according to the endianness of
- * bytes type control element.
+ * The big endian values of the bytes type control element are the register
+ * format of the regmap bus, so the driver reads them out of the cache in
+ * one raw read.
  */
 static int nau8822_eq_get(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	int i, reg;
-	u16 reg_val, *val;
-
-	val = (u16 *)ucontrol->value.bytes.data;
-	reg = NAU8822_REG_EQ1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		reg_val = snd_soc_component_read(component, reg + i);
-		/* conversion of 16-bit integers between native CPU format
-		 * and big endian format
-		 */
-		reg_val = cpu_to_be16(reg_val);
-		memcpy(val + i, &reg_val, sizeof(reg_val));
-	}
 
-	return 0;
+	return regmap_raw_read(nau8822->regmap, NAU8822_REG_EQ1,
+			       ucontrol->value.bytes.data, params->max);
 }
 
 /* The EQ parameters put function is to make configuration of 5 band equalizer
  * control. These configuration includes central frequency, equalizer gain,
  * cut-off frequency, bandwidth control, and equalizer path.
- * The regmap raw write can't work here because regmap doesn't provide
- * register and value format for register with address 7 bits and value 9 bits.
- * Therefore, the driver makes value format according to the endianness of
- * bytes type control element and writes data to codec.
+ * The words changed since the last configuration go to the codec in raw
+ * writes, which the regmap bus sends as one I2C transfer each.
  */
 static int nau8822_eq_put(struct snd_kcontrol *kcontrol,
 	struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component =
 			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
-	u16 *val, value;
-	int i, reg, ret;
-
-	data = kmemdup(ucontrol->value.bytes.data,
-		params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
-
-	val = (u16 *)data;
-	reg = NAU8822_REG_EQ1;
-	for (i = 0; i < params->max / sizeof(u16); i++) {
-		/* conversion of 16-bit integers between native CPU format
-		 * and big endian format
-		 */
-		value = be16_to_cpu(*(val + i));
-		ret = snd_soc_component_write(component, reg + i, value);
-		if (ret) {
-			dev_err(component->dev,
-			    "EQ configuration fail, register: %x ret: %d\n",
-			    reg + i, ret);
-			kfree(data);
+	int ret;
+
+	ret = nau_regmap_coeff_update(nau8822->regmap, NAU8822_REG_EQ1,
+		&nau8822->eq_shadow, ucontrol->value.bytes.data, params->max,
+		0, 0);
+	if (ret < 0) {
+		dev_err(component->dev, "EQ configuration fail, ret: %d\n",
+			ret);
+		return ret;
+	}
+
+	return !!ret;
+}
+
+/**
+ * nau8822_stereo_volume_set - Change the volume of both channels at once.
+ * @nau8822: the codec.
+ * @lreg: the left volume register.
+ * @rreg: the right volume register.
+ * @mask: the volume field of both registers.
+ * @lval: the left volume in the field.
+ * @rval: the right volume in the field.
+ *
+ * The left volume is held by the clear update bit, and the right register
+ * written with the bit set latches both. A change of the left only still
+ * writes the right register for the latch; one of the right only is a
+ * single write.
+ *
+ * Returns 1 for a change, 0 for none or negative error code.
+ */
+static int nau8822_stereo_volume_set(struct nau8822 *nau8822,
+	unsigned int lreg, unsigned int rreg, unsigned int mask,
+	unsigned int lval, unsigned int rval)
+{
+	bool lchange, rchange;
+	int ret;
+
+	ret = regmap_update_bits_check(nau8822->regmap, lreg,
+		mask | NAU8822_VOL_UPDATE, lval, &lchange);
+	if (ret)
+		return ret;
+	ret = regmap_update_bits_base(nau8822->regmap, rreg,
+		mask | NAU8822_VOL_UPDATE, rval | NAU8822_VOL_UPDATE,
+		&rchange, false, lchange);
+	if (ret)
+		return ret;
+
+	return lchange || rchange;
+}
+
+static int nau8822_put_volsw_latched(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+	unsigned int mask = (1 << fls(mc->max)) - 1;
+	unsigned int lval = ucontrol->value.integer.value[0];
+	unsigned int rval = ucontrol->value.integer.value[1];
+
+	if (lval > mc->max || rval > mc->max)
+		return -EINVAL;
+
+	return nau8822_stereo_volume_set(nau8822, mc->reg, mc->rreg,
+		mask << mc->shift, lval << mc->shift, rval << mc->shift);
+}
+
+/* The analog volumes with a zero cross detection. A volume latched with it
+ * changes at the next zero cross of the signal, so a large step makes no
+ * zipper noise; the slow timer applies it after a timeout if the signal
+ * doesn't cross zero, as in silence.
+ */
+static const unsigned int nau8822_zc_regs[] = {
+	NAU8822_REG_LEFT_INP_PGA_CONTROL, NAU8822_REG_RIGHT_INP_PGA_CONTROL,
+	NAU8822_REG_LHP_VOLUME, NAU8822_REG_RHP_VOLUME,
+	NAU8822_REG_LSPKOUT_VOLUME, NAU8822_REG_RSPKOUT_VOLUME,
+};
+
+/* Returns the mask of nau8822_zc_regs with the zero cross on */
+static unsigned int nau8822_zc_mask(struct nau8822 *nau8822)
+{
+	unsigned int val, mask = 0;
+	int i;
+
+	for (i = 0; i < ARRAY_SIZE(nau8822_zc_regs); i++) {
+		regmap_read(nau8822->regmap, nau8822_zc_regs[i], &val);
+		if (val & NAU8822_VOL_ZC)
+			mask |= BIT(i);
+	}
+
+	return mask;
+}
+
+/* The slow timer runs while a volume uses the zero cross */
+static void nau8822_zc_timeout_update(struct nau8822 *nau8822)
+{
+	regmap_update_bits(nau8822->regmap, NAU8822_REG_ADDITIONAL_CONTROL,
+		NAU8822_SCLKEN, nau8822_zc_mask(nau8822) ? NAU8822_SCLKEN : 0);
+}
+
+static int nau8822_zc_set(struct nau8822 *nau8822, bool on)
+{
+	bool change, changed = false;
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(nau8822_zc_regs); i++) {
+		ret = regmap_update_bits_check(nau8822->regmap,
+			nau8822_zc_regs[i], NAU8822_VOL_ZC,
+			on ? NAU8822_VOL_ZC : 0, &change);
+		if (ret)
 			return ret;
-		}
+		changed |= change;
 	}
-	kfree(data);
+	nau8822_zc_timeout_update(nau8822);
+
+	return changed;
+}
+
+static int nau8822_put_zc(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	ret = snd_soc_put_volsw(kcontrol, ucontrol);
+	if (ret >= 0)
+		nau8822_zc_timeout_update(nau8822);
+
+	return ret;
+}
+
+static int nau8822_volume_zc_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8822_zc_mask(nau8822) ==
+		GENMASK(ARRAY_SIZE(nau8822_zc_regs) - 1, 0);
 
 	return 0;
 }
 
+/* The zero cross of all the analog volumes at once */
+static int nau8822_volume_zc_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+
+	return nau8822_zc_set(nau8822, !!ucontrol->value.integer.value[0]);
+}
+
+/* A step of the fade from the start to the target volume; the channels
+ * unchanged in the step are not written.
+ */
+static void nau8822_fade_work(struct work_struct *work)
+{
+	struct nau8822 *nau8822 =
+		container_of(work, struct nau8822, fade.work.work);
+	struct nau8822_fade *fade = &nau8822->fade;
+	unsigned int vol[2];
+	int i;
+
+	mutex_lock(&fade->lock);
+	if (!fade->active)
+		goto out;
+
+	fade->step++;
+	for (i = 0; i < 2; i++)
+		vol[i] = fade->start[i] + ((int)fade->target[i] -
+			(int)fade->start[i]) * (int)fade->step /
+			(int)fade->steps;
+	nau8822_stereo_volume_set(nau8822,
+		NAU8822_REG_LEFT_DAC_DIGITAL_VOLUME,
+		NAU8822_REG_RIGHT_DAC_DIGITAL_VOLUME,
+		NAU8822_DIGITAL_VOL_MASK, vol[0], vol[1]);
+	if (fade->step < fade->steps)
+		schedule_delayed_work(&fade->work,
+			msecs_to_jiffies(NAU8822_FADE_STEP_MS));
+	else
+		fade->active = false;
+out:
+	mutex_unlock(&fade->lock);
+}
+
+/* Stop the fade at its target volume */
+static void nau8822_fade_stop(struct nau8822 *nau8822)
+{
+	struct nau8822_fade *fade = &nau8822->fade;
+
+	cancel_delayed_work_sync(&fade->work);
+	mutex_lock(&fade->lock);
+	if (fade->active) {
+		nau8822_stereo_volume_set(nau8822,
+			NAU8822_REG_LEFT_DAC_DIGITAL_VOLUME,
+			NAU8822_REG_RIGHT_DAC_DIGITAL_VOLUME,
+			NAU8822_DIGITAL_VOL_MASK,
+			fade->target[0], fade->target[1]);
+		fade->active = false;
+	}
+	mutex_unlock(&fade->lock);
+}
+
+static int nau8822_pcm_volume_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	struct nau8822_fade *fade = &nau8822->fade;
+
+	mutex_lock(&fade->lock);
+	if (fade->active) {
+		ucontrol->value.integer.value[0] = fade->target[0];
+		ucontrol->value.integer.value[1] = fade->target[1];
+		mutex_unlock(&fade->lock);
+		return 0;
+	}
+	mutex_unlock(&fade->lock);
+
+	return snd_soc_get_volsw(kcontrol, ucontrol);
+}
+
+/* The DAC volume goes to the target in the fade time, if there is one */
+static int nau8822_pcm_volume_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	struct soc_mixer_control *mc =
+			(struct soc_mixer_control *)kcontrol->private_value;
+	struct nau8822_fade *fade = &nau8822->fade;
+	unsigned int lval = ucontrol->value.integer.value[0];
+	unsigned int rval = ucontrol->value.integer.value[1];
+	unsigned int val[2];
+	int ret = 1;
+
+	if (!fade->time_ms)
+		return nau8822_put_volsw_latched(kcontrol, ucontrol);
+	if (lval > mc->max || rval > mc->max)
+		return -EINVAL;
+
+	mutex_lock(&fade->lock);
+	regmap_read(nau8822->regmap, mc->reg, &val[0]);
+	regmap_read(nau8822->regmap, mc->rreg, &val[1]);
+	val[0] &= NAU8822_DIGITAL_VOL_MASK;
+	val[1] &= NAU8822_DIGITAL_VOL_MASK;
+	if (fade->active ? (fade->target[0] == lval &&
+	    fade->target[1] == rval) : (val[0] == lval && val[1] == rval)) {
+		ret = 0;
+		goto out;
+	}
+	fade->start[0] = val[0];
+	fade->start[1] = val[1];
+	fade->target[0] = lval;
+	fade->target[1] = rval;
+	fade->step = 0;
+	fade->steps = max(fade->time_ms / NAU8822_FADE_STEP_MS, 1U);
+	fade->active = true;
+	mod_delayed_work(system_wq, &fade->work, 0);
+out:
+	mutex_unlock(&fade->lock);
+
+	return ret;
+}
+
+static int nau8822_fade_time_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8822->fade.time_ms;
+
+	return 0;
+}
+
+static int nau8822_fade_time_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	long time_ms = ucontrol->value.integer.value[0];
+
+	if (time_ms < 0 || time_ms > NAU8822_FADE_TIME_MAX_MS)
+		return -EINVAL;
+	if (time_ms == nau8822->fade.time_ms)
+		return 0;
+	nau8822->fade.time_ms = time_ms;
+
+	return 1;
+}
+
+/* The bypass gain of each preset, -15dB to +6dB in 3dB steps */
+static const unsigned int nau8822_monitor_gain[NAU8822_MONITOR_NUM] = {
+	[NAU8822_MONITOR_M15DB] = 0,
+	[NAU8822_MONITOR_M9DB] = 2,
+	[NAU8822_MONITOR_M3DB] = 4,
+	[NAU8822_MONITOR_0DB] = 5,
+	[NAU8822_MONITOR_P6DB] = 7,
+};
+
+static const char * const nau8822_monitor[NAU8822_MONITOR_NUM] = {
+	"Off", "-15dB", "-9dB", "-3dB", "0dB", "+6dB"};
+
+static const struct soc_enum nau8822_monitor_enum =
+	SOC_ENUM_SINGLE_EXT(NAU8822_MONITOR_NUM, nau8822_monitor);
+
+/* The bypass switch of an output mixer, by the name under the card */
+static struct snd_kcontrol *nau8822_monitor_kcontrol(
+	struct snd_soc_component *component, const char *name)
+{
+	char buf[SNDRV_CTL_ELEM_ID_NAME_MAXLEN];
+
+	if (component->name_prefix) {
+		snprintf(buf, sizeof(buf), "%s %s", component->name_prefix,
+			 name);
+		name = buf;
+	}
+
+	return snd_soc_card_get_kcontrol(component->card, name);
+}
+
+static int nau8822_monitor_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8822->monitor;
+
+	return 0;
+}
+
+/* The bypass of both sides is routed with its gain as one update of the
+ * DAPM, so the gain and the route change between the power sequences of
+ * the same walk. The walk of the right mixer only connects its path.
+ */
+static int nau8822_monitor_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+			snd_soc_kcontrol_component(kcontrol);
+	struct snd_soc_dapm_context *dapm =
+			snd_soc_component_get_dapm(component);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	unsigned int item = ucontrol->value.enumerated.item[0];
+	struct snd_soc_dapm_update update = { 0 };
+	struct snd_kcontrol *left, *right;
+	int connect;
+
+	if (item >= NAU8822_MONITOR_NUM)
+		return -EINVAL;
+	if (item == nau8822->monitor)
+		return 0;
+
+	left = nau8822_monitor_kcontrol(component,
+					"Left Output Mixer LINMIX Switch");
+	right = nau8822_monitor_kcontrol(component,
+					 "Right Output Mixer RINMIX Switch");
+	if (!left || !right)
+		return -ENODEV;
+
+	/* Off only opens the route and leaves the gain as it is */
+	connect = item != NAU8822_MONITOR_OFF;
+	update.kcontrol = left;
+	update.reg = NAU8822_REG_LEFT_MIXER_CONTROL;
+	update.mask = NAU8822_BYPMX;
+	update.val = 0;
+	if (connect) {
+		update.mask |= NAU8822_BYPMXGAIN_MASK;
+		update.val = NAU8822_BYPMX |
+			nau8822_monitor_gain[item] << NAU8822_BYPMXGAIN_SFT;
+	}
+	update.reg2 = NAU8822_REG_RIGHT_MIXER_CONTROL;
+	update.mask2 = update.mask;
+	update.val2 = update.val;
+	update.has_second_set = true;
+
+	snd_soc_dapm_mixer_update_power(dapm, left, connect, &update);
+	snd_soc_dapm_mixer_update_power(dapm, right, connect, NULL);
+	nau8822->monitor = item;
+
+	return 1;
+}
+
 static const char * const nau8822_companding[] = {
 	"Off", "NC", "u-law", "A-law"};
 
@@ -288,9 +647,13 @@ static const struct snd_kcontrol_new nau8822_snd_controls[] = {
 
 	SOC_DOUBLE("DAC Inversion Switch",
 		NAU8822_REG_DAC_CONTROL, 0, 1, 1, 0),
-	SOC_DOUBLE_R_TLV("PCM Volume",
+	SOC_DOUBLE_R_EXT_TLV("PCM Volume",
 		NAU8822_REG_LEFT_DAC_DIGITAL_VOLUME,
-		NAU8822_REG_RIGHT_DAC_DIGITAL_VOLUME, 0, 255, 0, digital_tlv),
+		NAU8822_REG_RIGHT_DAC_DIGITAL_VOLUME, 0, 255, 0,
+		nau8822_pcm_volume_get, nau8822_pcm_volume_put, digital_tlv),
+	SOC_SINGLE_EXT("PCM Fade Time", SND_SOC_NOPM, 0,
+		NAU8822_FADE_TIME_MAX_MS, 0,
+		nau8822_fade_time_get, nau8822_fade_time_put),
 
 	SOC_SINGLE("High Pass Filter Switch",
 		NAU8822_REG_ADC_CONTROL, 8, 1, 0),
@@ -299,9 +662,10 @@ static const struct snd_kcontrol_new nau8822_snd_controls[] = {
 
 	SOC_DOUBLE("ADC Inversion Switch",
 		NAU8822_REG_ADC_CONTROL, 0, 1, 1, 0),
-	SOC_DOUBLE_R_TLV("ADC Volume",
+	SOC_DOUBLE_R_EXT_TLV("ADC Volume",
 		NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME,
-		NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME, 0, 255, 0, digital_tlv),
+		NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME, 0, 255, 0,
+		snd_soc_get_volsw, nau8822_put_volsw_latched, digital_tlv),
 
 	SOC_SINGLE("DAC Limiter Switch",
 		NAU8822_REG_DAC_LIMITER_1, 8, 1, 0),
@@ -333,38 +697,48 @@ static const struct snd_kcontrol_new nau8822_snd_controls[] = {
 	SOC_SINGLE("ALC Noise Gate Threshold",
 		NAU8822_REG_NOISE_GATE, 0, 7, 0),
 
-	SOC_DOUBLE_R("PGA ZC Switch",
+	SOC_SINGLE_BOOL_EXT("Volume ZC Switch", 0,
+		nau8822_volume_zc_get, nau8822_volume_zc_put),
+	SOC_DOUBLE_R_EXT("PGA ZC Switch",
 		NAU8822_REG_LEFT_INP_PGA_CONTROL,
 		NAU8822_REG_RIGHT_INP_PGA_CONTROL,
-		7, 1, 0),
-	SOC_DOUBLE_R_TLV("PGA Volume",
+		7, 1, 0, snd_soc_get_volsw, nau8822_put_zc),
+	SOC_DOUBLE_R_EXT_TLV("PGA Volume",
 		NAU8822_REG_LEFT_INP_PGA_CONTROL,
-		NAU8822_REG_RIGHT_INP_PGA_CONTROL, 0, 63, 0, inpga_tlv),
+		NAU8822_REG_RIGHT_INP_PGA_CONTROL, 0, 63, 0,
+		snd_soc_get_volsw, nau8822_put_volsw_latched, inpga_tlv),
 
-	SOC_DOUBLE_R("Headphone ZC Switch",
+	SOC_DOUBLE_R_EXT("Headphone ZC Switch",
 		NAU8822_REG_LHP_VOLUME,
-		NAU8822_REG_RHP_VOLUME, 7, 1, 0),
+		NAU8822_REG_RHP_VOLUME, 7, 1, 0,
+		snd_soc_get_volsw, nau8822_put_zc),
 	SOC_DOUBLE_R("Headphone Playback Switch",
 		NAU8822_REG_LHP_VOLUME,
 		NAU8822_REG_RHP_VOLUME, 6, 1, 1),
-	SOC_DOUBLE_R_TLV("Headphone Volume",
+	SOC_DOUBLE_R_EXT_TLV("Headphone Volume",
 		NAU8822_REG_LHP_VOLUME,
-		NAU8822_REG_RHP_VOLUME,	0, 63, 0, spk_tlv),
+		NAU8822_REG_RHP_VOLUME,	0, 63, 0,
+		snd_soc_get_volsw, nau8822_put_volsw_latched, spk_tlv),
 
-	SOC_DOUBLE_R("Speaker ZC Switch",
+	SOC_DOUBLE_R_EXT("Speaker ZC Switch",
 		NAU8822_REG_LSPKOUT_VOLUME,
-		NAU8822_REG_RSPKOUT_VOLUME, 7, 1, 0),
+		NAU8822_REG_RSPKOUT_VOLUME, 7, 1, 0,
+		snd_soc_get_volsw, nau8822_put_zc),
 	SOC_DOUBLE_R("Speaker Playback Switch",
 		NAU8822_REG_LSPKOUT_VOLUME,
 		NAU8822_REG_RSPKOUT_VOLUME, 6, 1, 1),
-	SOC_DOUBLE_R_TLV("Speaker Volume",
+	SOC_DOUBLE_R_EXT_TLV("Speaker Volume",
 		NAU8822_REG_LSPKOUT_VOLUME,
-		NAU8822_REG_RSPKOUT_VOLUME, 0, 63, 0, spk_tlv),
+		NAU8822_REG_RSPKOUT_VOLUME, 0, 63, 0,
+		snd_soc_get_volsw, nau8822_put_volsw_latched, spk_tlv),
 
 	SOC_DOUBLE_R("AUXOUT Playback Switch",
 		NAU8822_REG_AUX2_MIXER,
 		NAU8822_REG_AUX1_MIXER, 6, 1, 1),
 
+	SOC_ENUM_EXT("Direct Monitor", nau8822_monitor_enum,
+		nau8822_monitor_get, nau8822_monitor_put),
+
 	SOC_DOUBLE_R_TLV("PGA Boost Volume",
 		NAU8822_REG_LEFT_ADC_BOOST_CONTROL,
 		NAU8822_REG_RIGHT_ADC_BOOST_CONTROL, 8, 1, 0, pga_boost_tlv),
@@ -443,11 +817,10 @@ static int check_mclk_select_pll(struct snd_soc_dapm_widget *source,
 {
 	struct snd_soc_component *component =
 		snd_soc_dapm_to_component(source->dapm);
-	unsigned int value;
-
-	value = snd_soc_component_read(component, NAU8822_REG_CLOCKING);
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 
-	return (value & NAU8822_CLKM_MASK);
+	/* kept by the clock setup, the graph walks read no register */
+	return nau8822->clk_pll;
 }
 
 static const struct snd_soc_dapm_widget nau8822_dapm_widgets[] = {
@@ -618,7 +991,8 @@ static int nau8822_set_dai_sysclk(struct snd_soc_dai *dai, int clk_id,
 	nau8822->div_id = clk_id;
 	nau8822->sysclk = freq;
 	dev_dbg(component->dev, "master sysclk %dHz, source %s\n", freq,
-		clk_id == NAU8822_CLK_PLL ? "PLL" : "MCLK");
+		clk_id == NAU8822_CLK_PLL ? "PLL" :
+		clk_id == NAU8822_CLK_AUTO ? "auto" : "MCLK");
 
 	return 0;
 }
@@ -663,37 +1037,85 @@ static int nau8822_calc_pll(unsigned int pll_in, unsigned int fs,
 	return 0;
 }
 
+static const struct nau8822_clk_memo *
+nau8822_clk_memo_find(struct nau8822 *nau8822, int freq_in, int rate, int clkm)
+{
+	const struct nau8822_clk_memo *memo;
+	int i;
+
+	for (i = 0; i < nau8822->clk_memo_num; i++) {
+		memo = &nau8822->clk_memo[i];
+		if (memo->freq_in == freq_in && memo->rate == rate &&
+		    memo->clkm == clkm)
+			return memo;
+	}
+
+	return NULL;
+}
+
+/* Keep the solution, the oldest one replaced when the memo is full */
+static void nau8822_clk_memo_add(struct nau8822 *nau8822, int freq_in,
+				 int rate, int clkm,
+				 const struct nau8822_pll *pll)
+{
+	struct nau8822_clk_memo *memo =
+		&nau8822->clk_memo[nau8822->clk_memo_next];
+
+	memo->freq_in = freq_in;
+	memo->rate = rate;
+	memo->clkm = clkm;
+	memo->pll = *pll;
+	nau8822->clk_memo_next =
+		(nau8822->clk_memo_next + 1) % NAU8822_CLK_MEMO_NUM;
+	if (nau8822->clk_memo_num < NAU8822_CLK_MEMO_NUM)
+		nau8822->clk_memo_num++;
+}
+
 static int nau8822_config_clkdiv(struct snd_soc_dai *dai, int div, int rate)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 	struct nau8822_pll *pll = &nau8822->pll;
+	const struct nau8822_clk_memo *memo;
+	struct nau8822_pll scaler = { 0 };
 	int i, sclk, imclk;
 
 	switch (nau8822->div_id) {
 	case NAU8822_CLK_MCLK:
-		/* Configure the master clock prescaler div to make system
-		 * clock to approximate the internal master clock (IMCLK);
-		 * and large or equal to IMCLK.
-		 */
-		div = 0;
-		imclk = rate * 256;
-		for (i = 1; i < ARRAY_SIZE(nau8822_mclk_scaler); i++) {
-			sclk = (nau8822->sysclk * 10) /	nau8822_mclk_scaler[i];
-			if (sclk < imclk)
-				break;
-			div = i;
+		memo = nau8822_clk_memo_find(nau8822, nau8822->sysclk, rate,
+					     NAU8822_CLKM_MCLK);
+		if (memo) {
+			div = memo->pll.mclk_scaler;
+		} else {
+			/* Configure the master clock prescaler div to make
+			 * system clock to approximate the internal master
+			 * clock (IMCLK); and large or equal to IMCLK.
+			 */
+			div = 0;
+			imclk = rate * 256;
+			for (i = 1; i < ARRAY_SIZE(nau8822_mclk_scaler); i++) {
+				sclk = (nau8822->sysclk * 10) /
+					nau8822_mclk_scaler[i];
+				if (sclk < imclk)
+					break;
+				div = i;
+			}
+			dev_dbg(component->dev,
+				"master clock prescaler %x for fs %d\n",
+				div, rate);
+			scaler.mclk_scaler = div;
+			nau8822_clk_memo_add(nau8822, nau8822->sysclk, rate,
+					     NAU8822_CLKM_MCLK, &scaler);
 		}
-		dev_dbg(component->dev, "master clock prescaler %x for fs %d\n",
-			div, rate);
 
-		/* master clock from MCLK and disable PLL */
-		snd_soc_component_update_bits(component,
-			NAU8822_REG_CLOCKING, NAU8822_MCLKSEL_MASK,
-			(div << NAU8822_MCLKSEL_SFT));
+		/* master clock from MCLK and disable PLL, written only when
+		 * changed
+		 */
 		snd_soc_component_update_bits(component,
-			NAU8822_REG_CLOCKING, NAU8822_CLKM_MASK,
-			NAU8822_CLKM_MCLK);
+			NAU8822_REG_CLOCKING,
+			NAU8822_MCLKSEL_MASK | NAU8822_CLKM_MASK,
+			(div << NAU8822_MCLKSEL_SFT) | NAU8822_CLKM_MCLK);
+		nau8822->clk_pll = false;
 		break;
 
 	case NAU8822_CLK_PLL:
@@ -704,11 +1126,10 @@ static int nau8822_config_clkdiv(struct snd_soc_dai *dai, int div, int rate)
 			return -EINVAL;
 		}
 		snd_soc_component_update_bits(component,
-			NAU8822_REG_CLOCKING, NAU8822_MCLKSEL_MASK,
-			(div << NAU8822_MCLKSEL_SFT));
-		snd_soc_component_update_bits(component,
-			NAU8822_REG_CLOCKING, NAU8822_CLKM_MASK,
-			NAU8822_CLKM_PLL);
+			NAU8822_REG_CLOCKING,
+			NAU8822_MCLKSEL_MASK | NAU8822_CLKM_MASK,
+			(div << NAU8822_MCLKSEL_SFT) | NAU8822_CLKM_PLL);
+		nau8822->clk_pll = true;
 		break;
 
 	default:
@@ -724,6 +1145,7 @@ static int nau8822_set_pll(struct snd_soc_dai *dai, int pll_id, int source,
 	struct snd_soc_component *component = dai->component;
 	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 	struct nau8822_pll *pll_param = &nau8822->pll;
+	const struct nau8822_clk_memo *memo;
 	int ret, fs;
 
 	if (freq_in == pll_param->freq_in &&
@@ -739,17 +1161,24 @@ static int nau8822_set_pll(struct snd_soc_dai *dai, int pll_id, int source,
 
 	fs = freq_out / 256;
 
-	ret = nau8822_calc_pll(freq_in, fs, pll_param);
-	if (ret < 0) {
-		dev_err(component->dev, "Unsupported input clock %d\n",
-			freq_in);
-		return ret;
-	}
+	memo = nau8822_clk_memo_find(nau8822, freq_in, fs, NAU8822_CLKM_PLL);
+	if (memo) {
+		*pll_param = memo->pll;
+	} else {
+		ret = nau8822_calc_pll(freq_in, fs, pll_param);
+		if (ret < 0) {
+			dev_err(component->dev, "Unsupported input clock %d\n",
+				freq_in);
+			return ret;
+		}
+		nau8822_clk_memo_add(nau8822, freq_in, fs, NAU8822_CLKM_PLL,
+				     pll_param);
 
-	dev_info(component->dev,
-		"pll_int=%x pll_frac=%x mclk_scaler=%x pre_factor=%x\n",
-		pll_param->pll_int, pll_param->pll_frac,
-		pll_param->mclk_scaler, pll_param->pre_factor);
+		dev_info(component->dev,
+			"pll_int=%x pll_frac=%x mclk_scaler=%x pre_factor=%x\n",
+			pll_param->pll_int, pll_param->pll_frac,
+			pll_param->mclk_scaler, pll_param->pre_factor);
+	}
 
 	snd_soc_component_update_bits(component,
 		NAU8822_REG_POWER_MANAGEMENT_1, NAU8822_PLL_EN_MASK, NAU8822_PLL_OFF);
@@ -766,10 +1195,10 @@ static int nau8822_set_pll(struct snd_soc_dai *dai, int pll_id, int source,
 	snd_soc_component_write(component,
 		NAU8822_REG_PLL_K3, pll_param->pll_frac & NAU8822_PLLK3_MASK);
 	snd_soc_component_update_bits(component,
-		NAU8822_REG_CLOCKING, NAU8822_MCLKSEL_MASK,
-		pll_param->mclk_scaler << NAU8822_MCLKSEL_SFT);
-	snd_soc_component_update_bits(component,
-		NAU8822_REG_CLOCKING, NAU8822_CLKM_MASK, NAU8822_CLKM_PLL);
+		NAU8822_REG_CLOCKING, NAU8822_MCLKSEL_MASK | NAU8822_CLKM_MASK,
+		(pll_param->mclk_scaler << NAU8822_MCLKSEL_SFT) |
+		NAU8822_CLKM_PLL);
+	nau8822->clk_pll = true;
 	snd_soc_component_update_bits(component,
 		NAU8822_REG_POWER_MANAGEMENT_1, NAU8822_PLL_EN_MASK, NAU8822_PLL_ON);
 
@@ -779,6 +1208,41 @@ static int nau8822_set_pll(struct snd_soc_dai *dai, int pll_id, int source,
 	return 0;
 }
 
+/* The PLL runs only for the rates no prescaler divides MCLK exactly to.
+ * The PLL supply follows clk_pll, so DAPM powers it down with MCLK straight.
+ */
+static int nau8822_clk_auto(struct snd_soc_dai *dai, int rate)
+{
+	struct snd_soc_component *component = dai->component;
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	u64 imclk = 256 * rate;
+	int i, ret;
+
+	for (i = 0; i < ARRAY_SIZE(nau8822_mclk_scaler); i++) {
+		if ((u64)nau8822->sysclk * 10 != imclk * nau8822_mclk_scaler[i])
+			continue;
+		dev_dbg(component->dev, "MCLK straight, prescaler %x for fs %d\n",
+			i, rate);
+		snd_soc_component_update_bits(component, NAU8822_REG_CLOCKING,
+			NAU8822_MCLKSEL_MASK | NAU8822_CLKM_MASK,
+			(i << NAU8822_MCLKSEL_SFT) | NAU8822_CLKM_MCLK);
+		nau8822->clk_pll = false;
+		return 0;
+	}
+
+	ret = nau8822_set_pll(dai, 0, 0, nau8822->sysclk, 256 * rate);
+	if (ret)
+		return ret;
+	/* the PLL kept from an earlier stream, with MCLK straight since */
+	snd_soc_component_update_bits(component, NAU8822_REG_CLOCKING,
+		NAU8822_MCLKSEL_MASK | NAU8822_CLKM_MASK,
+		(nau8822->pll.mclk_scaler << NAU8822_MCLKSEL_SFT) |
+		NAU8822_CLKM_PLL);
+	nau8822->clk_pll = true;
+
+	return 0;
+}
+
 static int nau8822_set_dai_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 {
 	struct snd_soc_component *component = dai->component;
@@ -847,6 +1311,8 @@ static int nau8822_hw_params(struct snd_pcm_substream *substream,
 	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 	int val_len = 0, val_rate = 0;
 	unsigned int ctrl_val, bclk_fs, bclk_div;
+	ktime_t start = ktime_get();
+	int ret;
 
 	/* make BCLK and LRC divide configuration if the codec as master. */
 	ctrl_val = snd_soc_component_read(component, NAU8822_REG_CLOCKING);
@@ -912,8 +1378,14 @@ static int nau8822_hw_params(struct snd_pcm_substream *substream,
 	/* If the master clock is from MCLK, provide the runtime FS for driver
 	 * to get the master clock prescaler configuration.
 	 */
-	if (nau8822->div_id == NAU8822_CLK_MCLK)
+	if (nau8822->div_id == NAU8822_CLK_MCLK) {
 		nau8822_config_clkdiv(dai, 0, params_rate(params));
+	} else if (nau8822->div_id == NAU8822_CLK_AUTO) {
+		ret = nau8822_clk_auto(dai, params_rate(params));
+		if (ret)
+			return ret;
+	}
+	nau_latency_add(&nau8822->latency[NAU8822_LAT_HW_PARAMS], start);
 
 	return 0;
 }
@@ -934,12 +1406,40 @@ static int nau8822_mute(struct snd_soc_dai *dai, int mute, int direction)
 	return 0;
 }
 
+/* The fast charge of the reference is over, so go to the standby 300K. */
+static void nau8822_charge_work(struct work_struct *work)
+{
+	struct nau8822 *nau8822 =
+		container_of(work, struct nau8822, charge_work.work);
+
+	regmap_update_bits(nau8822->regmap, NAU8822_REG_POWER_MANAGEMENT_1,
+			   NAU8822_REFIMP_MASK, NAU8822_REFIMP_300K);
+	complete_all(&nau8822->charge_done);
+}
+
+/* Stop the fast charge, and release whoever waits for it. */
+static void nau8822_charge_cancel(struct nau8822 *nau8822)
+{
+	cancel_delayed_work_sync(&nau8822->charge_work);
+	complete_all(&nau8822->charge_done);
+}
+
 static int nau8822_set_bias_level(struct snd_soc_component *component,
 				 enum snd_soc_bias_level level)
 {
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	ktime_t start;
+
 	switch (level) {
 	case SND_SOC_BIAS_ON:
 	case SND_SOC_BIAS_PREPARE:
+		/* the first stream waits the fast charge out */
+		start = ktime_get();
+		if (!wait_for_completion_timeout(&nau8822->charge_done,
+			msecs_to_jiffies(NAU8822_REFIMP_TIMEOUT_MS)))
+			dev_warn(component->dev, "Reference charge timeout\n");
+		nau_latency_add(&nau8822->latency[NAU8822_LAT_CHARGE_WAIT],
+				start);
 		snd_soc_component_update_bits(component,
 			NAU8822_REG_POWER_MANAGEMENT_1,
 			NAU8822_REFIMP_MASK, NAU8822_REFIMP_80K);
@@ -953,10 +1453,13 @@ static int nau8822_set_bias_level(struct snd_soc_component *component,
 
 		if (snd_soc_component_get_bias_level(component) ==
 			SND_SOC_BIAS_OFF) {
+			reinit_completion(&nau8822->charge_done);
 			snd_soc_component_update_bits(component,
 				NAU8822_REG_POWER_MANAGEMENT_1,
 				NAU8822_REFIMP_MASK, NAU8822_REFIMP_3K);
-			mdelay(100);
+			schedule_delayed_work(&nau8822->charge_work,
+				msecs_to_jiffies(NAU8822_REFIMP_CHARGE_MS));
+			break;
 		}
 		snd_soc_component_update_bits(component,
 			NAU8822_REG_POWER_MANAGEMENT_1,
@@ -964,6 +1467,7 @@ static int nau8822_set_bias_level(struct snd_soc_component *component,
 		break;
 
 	case SND_SOC_BIAS_OFF:
+		nau8822_charge_cancel(nau8822);
 		snd_soc_component_write(component,
 			NAU8822_REG_POWER_MANAGEMENT_1, 0);
 		snd_soc_component_write(component,
@@ -1012,10 +1516,13 @@ static struct snd_soc_dai_driver nau8822_dai = {
 	.symmetric_rate = 1,
 };
 
+static const struct regmap_config nau8822_regmap_config;
+
 static int nau8822_suspend(struct snd_soc_component *component)
 {
 	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 
+	nau8822_fade_stop(nau8822);
 	snd_soc_component_force_bias_level(component, SND_SOC_BIAS_OFF);
 
 	regcache_mark_dirty(nau8822->regmap);
@@ -1027,7 +1534,10 @@ static int nau8822_resume(struct snd_soc_component *component)
 {
 	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
 
-	regcache_sync(nau8822->regmap);
+	nau_regcache_scan(nau8822->regmap, &nau8822_regmap_config,
+			  &nau8822->resume_sync);
+	nau_regcache_sync(nau8822->regmap, &nau8822_regmap_config,
+			  &nau8822->resume_sync);
 
 	snd_soc_component_force_bias_level(component, SND_SOC_BIAS_STANDBY);
 
@@ -1038,34 +1548,73 @@ static int nau8822_resume(struct snd_soc_component *component)
  * These registers contain an "update" bit - bit 8. This means, for example,
  * that one can write new DAC digital volume for both channels, but only when
  * the update bit is set, will also the volume be updated - simultaneously for
- * both channels.
+ * both channels. They come in runs of contiguous registers, left and right
+ * in turn; the bit is kept on the right only, and the volume controls write
+ * the right one last.
  */
-static const int update_reg[] = {
-	NAU8822_REG_LEFT_DAC_DIGITAL_VOLUME,
-	NAU8822_REG_RIGHT_DAC_DIGITAL_VOLUME,
-	NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME,
-	NAU8822_REG_RIGHT_ADC_DIGITAL_VOLUME,
-	NAU8822_REG_LEFT_INP_PGA_CONTROL,
-	NAU8822_REG_RIGHT_INP_PGA_CONTROL,
-	NAU8822_REG_LHP_VOLUME,
-	NAU8822_REG_RHP_VOLUME,
-	NAU8822_REG_LSPKOUT_VOLUME,
-	NAU8822_REG_RSPKOUT_VOLUME,
+static const struct nau8822_reg_run update_reg[] = {
+	{ NAU8822_REG_LEFT_DAC_DIGITAL_VOLUME, 2 },
+	{ NAU8822_REG_LEFT_ADC_DIGITAL_VOLUME, 2 },
+	{ NAU8822_REG_LEFT_INP_PGA_CONTROL, 2 },
+	{ NAU8822_REG_LHP_VOLUME, 4 },
+};
+
+static const char * const nau8822_latency_names[NAU8822_LAT_NUM] = {
+	[NAU8822_LAT_HW_PARAMS] = "hw_params",
+	[NAU8822_LAT_CHARGE_WAIT] = "charge_wait",
 };
 
 static int nau8822_probe(struct snd_soc_component *component)
 {
-	int i;
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+	u16 val[NAU8822_REG_RUN_MAX];
+	int i, j, ret;
 	struct device_node *of_node = component->dev->of_node;
 
+	INIT_DELAYED_WORK(&nau8822->charge_work, nau8822_charge_work);
+	INIT_DELAYED_WORK(&nau8822->fade.work, nau8822_fade_work);
+	mutex_init(&nau8822->fade.lock);
+	init_completion(&nau8822->charge_done);
+	complete_all(&nau8822->charge_done);
+
+	/* the register sync of resume under the debugfs of the component */
+	nau_regcache_debugfs_init(component->debugfs_root, "resume",
+				  &nau8822->resume_sync);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8822->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+					 &nau8822->regcache_report, nau8822->regmap,
+					 &nau8822_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8822->latency,
+				 nau8822_latency_names, NAU8822_LAT_NUM);
+
 	/*
 	 * Set the update bit in all registers, that have one. This way all
 	 * writes to those registers will also cause the update bit to be
-	 * written.
+	 * written. Each run is read from the cache and written in a burst.
 	 */
-	for (i = 0; i < ARRAY_SIZE(update_reg); i++)
-		snd_soc_component_update_bits(component,
-			update_reg[i], 0x100, 0x100);
+	for (i = 0; i < ARRAY_SIZE(update_reg); i++) {
+		ret = regmap_bulk_read(nau8822->regmap, update_reg[i].reg, val,
+				       update_reg[i].num);
+		if (ret)
+			return ret;
+		for (j = 0; j < update_reg[i].num; j++) {
+			if (j & 1)
+				val[j] |= NAU8822_VOL_UPDATE;
+			else
+				val[j] &= ~NAU8822_VOL_UPDATE;
+		}
+		ret = regmap_bulk_write(nau8822->regmap, update_reg[i].reg, val,
+					update_reg[i].num);
+		if (ret)
+			return ret;
+	}
+
+	/* The analog volumes latched at the zero cross from the start */
+	if (of_property_read_bool(of_node, "nuvoton,volume-zero-cross")) {
+		ret = nau8822_zc_set(nau8822, true);
+		if (ret < 0)
+			return ret;
+	}
 
 	/* Check property to configure the two loudspeaker outputs as
 	 * a single Bridge Tied Load output
@@ -1075,11 +1624,29 @@ static int nau8822_probe(struct snd_soc_component *component)
 					      NAU8822_REG_RIGHT_SPEAKER_CONTROL,
 					      NAU8822_RSUBBYP, NAU8822_RSUBBYP);
 
+	/* the scenes after the update bits, which their writes keep */
+	nau_scenes_read(component->dev, &nau8822->scenes);
+	ret = nau_scenes_init(component, &nau8822->scenes);
+	if (ret)
+		return ret;
+	nau_scenes_debugfs_init(component->debugfs_root, &nau8822->scenes);
+	nau_pm_card_link(component);
+
 	return 0;
 }
 
+static void nau8822_remove(struct snd_soc_component *component)
+{
+	struct nau8822 *nau8822 = snd_soc_component_get_drvdata(component);
+
+	nau8822_charge_cancel(nau8822);
+	nau8822_fade_stop(nau8822);
+	nau_pm_card_unlink(component);
+}
+
 static const struct snd_soc_component_driver soc_component_dev_nau8822 = {
 	.probe				= nau8822_probe,
+	.remove				= nau8822_remove,
 	.suspend			= nau8822_suspend,
 	.resume				= nau8822_resume,
 	.set_bias_level			= nau8822_set_bias_level,
@@ -1095,15 +1662,99 @@ static const struct snd_soc_component_driver soc_component_dev_nau8822 = {
 	.non_legacy_dai_naming		= 1,
 };
 
+/* The NAU8822 takes one 16 bit word per register, 7 bit address and 9 bit
+ * data, and doesn't increase the address by itself. The regmap bus gets
+ * the registers in 8 bit address and 16 bit big endian data, so regmap can
+ * do raw and bulk access, and sends a burst of registers in one I2C
+ * transfer with one message per register.
+ */
+static int nau8822_bus_gather_write(void *context, const void *reg,
+	size_t reg_size, const void *val, size_t val_size)
+{
+	struct i2c_client *client = context;
+	struct i2c_msg msgs[NAU8822_BURST_REGS];
+	u8 buf[NAU8822_BURST_REGS][2];
+	unsigned int addr = *(const u8 *)reg;
+	const u8 *data = val;
+	int i, num = val_size / 2, ret;
+
+	if (reg_size != 1 || val_size % 2 || num > NAU8822_BURST_REGS)
+		return -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		buf[i][0] = ((addr + i) << 1) | (data[i * 2] & 0x1);
+		buf[i][1] = data[i * 2 + 1];
+		msgs[i].addr = client->addr;
+		msgs[i].flags = 0;
+		msgs[i].len = 2;
+		msgs[i].buf = buf[i];
+	}
+	ret = i2c_transfer(client->adapter, msgs, num);
+	if (ret == num)
+		return 0;
+
+	return ret < 0 ? ret : -EIO;
+}
+
+static int nau8822_bus_write(void *context, const void *data, size_t count)
+{
+	if (count < 1)
+		return -EINVAL;
+
+	return nau8822_bus_gather_write(context, data, 1,
+					(const u8 *)data + 1, count - 1);
+}
+
+static int nau8822_bus_read(void *context, const void *reg, size_t reg_size,
+	void *val, size_t val_size)
+{
+	struct i2c_client *client = context;
+	struct i2c_msg msgs[2];
+	u8 addr = *(const u8 *)reg, cmd, *data = val;
+	int i, ret;
+
+	if (reg_size != 1 || val_size % 2)
+		return -EINVAL;
+
+	for (i = 0; i < val_size / 2; i++) {
+		cmd = (addr + i) << 1;
+		msgs[0].addr = client->addr;
+		msgs[0].flags = 0;
+		msgs[0].len = 1;
+		msgs[0].buf = &cmd;
+		msgs[1].addr = client->addr;
+		msgs[1].flags = I2C_M_RD;
+		msgs[1].len = 2;
+		msgs[1].buf = data + i * 2;
+		ret = i2c_transfer(client->adapter, msgs, 2);
+		if (ret != 2)
+			return ret < 0 ? ret : -EIO;
+		data[i * 2] &= 0x1;
+	}
+
+	return 0;
+}
+
+static const struct regmap_bus nau8822_regmap_bus = {
+	.write = nau8822_bus_write,
+	.gather_write = nau8822_bus_gather_write,
+	.read = nau8822_bus_read,
+	.max_raw_write = NAU8822_BURST_REGS * 2,
+	.reg_format_endian_default = REGMAP_ENDIAN_BIG,
+	.val_format_endian_default = REGMAP_ENDIAN_BIG,
+};
+
 static const struct regmap_config nau8822_regmap_config = {
-	.reg_bits = 7,
-	.val_bits = 9,
+	.reg_bits = 8,
+	.val_bits = 16,
 
 	.max_register = NAU8822_REG_MAX_REGISTER,
 	.volatile_reg = nau8822_volatile,
 
 	.readable_reg = nau8822_readable_reg,
 	.writeable_reg = nau8822_writeable_reg,
+	/* contiguous registers are synced in one transfer */
+	.use_single_write = false,
 
 	.cache_type = REGCACHE_RBTREE,
 	.reg_defaults = nau8822_reg_defaults,
@@ -1114,6 +1765,7 @@ static int nau8822_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8822 *nau8822 = dev_get_platdata(dev);
+	unsigned int value;
 	int ret;
 
 	if (!nau8822) {
@@ -1123,7 +1775,11 @@ static int nau8822_i2c_probe(struct i2c_client *i2c)
 	}
 	i2c_set_clientdata(i2c, nau8822);
 
-	nau8822->regmap = devm_regmap_init_i2c(i2c, &nau8822_regmap_config);
+	if (!i2c_check_functionality(i2c->adapter, I2C_FUNC_I2C))
+		return -EIO;
+
+	nau8822->regmap = nau_regstat_regmap_init(dev, &nau8822_regmap_bus, i2c,
+			&nau8822_regmap_config, &nau8822->regstat);
 	if (IS_ERR(nau8822->regmap)) {
 		ret = PTR_ERR(nau8822->regmap);
 		dev_err(&i2c->dev, "Failed to allocate regmap: %d\n", ret);
@@ -1137,6 +1793,10 @@ static int nau8822_i2c_probe(struct i2c_client *i2c)
 		dev_err(&i2c->dev, "Failed to issue reset: %d\n", ret);
 		return ret;
 	}
+	ret = regmap_read(nau8822->regmap, NAU8822_REG_CLOCKING, &value);
+	if (ret)
+		return ret;
+	nau8822->clk_pll = value & NAU8822_CLKM_MASK;
 
 	ret = devm_snd_soc_register_component(dev, &soc_component_dev_nau8822,
 						&nau8822_dai, 1);
@@ -1144,6 +1804,7 @@ static int nau8822_i2c_probe(struct i2c_client *i2c)
 		dev_err(&i2c->dev, "Failed to register CODEC: %d\n", ret);
 		return ret;
 	}
+	nau_pm_async_init(dev);
 
 	return 0;
 }
@@ -1166,6 +1827,7 @@ static struct i2c_driver nau8822_i2c_driver = {
 	.driver = {
 		.name = "nau8822",
 		.of_match_table = of_match_ptr(nau8822_of_match),
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8822_i2c_probe,
 	.id_table = nau8822_i2c_id,
@@ -1175,3 +1837,7 @@ module_i2c_driver(nau8822_i2c_driver);
 MODULE_DESCRIPTION("ASoC NAU8822 codec driver");
 MODULE_AUTHOR("David Lin <ctlin0@nuvoton.com>");
 MODULE_LICENSE("GPL v2");
+
+#ifdef CONFIG_SND_SOC_NAU8822_KUNIT_TEST
+#include "nau8822-test.c"
+#endif
@@ -134,6 +134,7 @@
 #define NAU8822_SMPLR_16K			(0x3 << 1)
 #define NAU8822_SMPLR_12K			(0x4 << 1)
 #define NAU8822_SMPLR_8K			(0x5 << 1)
+#define NAU8822_SCLKEN				0x1
 
 /* NAU8822_REG_EQ1 (0x12) */
 #define NAU8822_EQ1GC_SFT			0
@@ -187,6 +188,11 @@
 /* NAU8822_REG_PLL_K3 (0x27) */
 #define NAU8822_PLLK3_MASK			0x1FF
 
+/* NAU8822_REG_LEFT_MIXER_CONTROL (0x32), RIGHT_MIXER_CONTROL (0x33) */
+#define NAU8822_BYPMXGAIN_SFT			2
+#define NAU8822_BYPMXGAIN_MASK			(0x7 << 2)
+#define NAU8822_BYPMX				(0x1 << 1)
+
 /* NAU8822_REG_RIGHT_SPEAKER_CONTROL (0x2B) */
 #define NAU8822_RMIXMUT				0x20
 #define NAU8822_RSUBBYP				0x10
@@ -196,10 +202,14 @@
 
 #define NAU8822_RAUXSMUT			0x01
 
-/* System Clock Source */
+/* System Clock Source. With NAU8822_CLK_AUTO, set_sysclk() gives the MCLK
+ * rate, and hw_params takes MCLK straight when the prescaler divides it to
+ * 256 * fs exactly, with the PLL powered down, and the PLL from MCLK if not.
+ */
 enum {
 	NAU8822_CLK_MCLK,
 	NAU8822_CLK_PLL,
+	NAU8822_CLK_AUTO,
 };
 
 struct nau8822_pll {
@@ -211,14 +221,102 @@ struct nau8822_pll {
 	int freq_out;
 };
 
+/* The clocks solved for an input clock and fs, from MCLK by the prescaler
+ * or from PLL, kept for the streams restarted at the same rates.
+ */
+#define NAU8822_CLK_MEMO_NUM	4
+
+struct nau8822_clk_memo {
+	int freq_in;
+	int rate;
+	int clkm;
+	struct nau8822_pll pll;
+};
+
+/* contiguous registers written in one burst */
+struct nau8822_reg_run {
+	unsigned int reg;
+	int num;
+};
+
+#define NAU8822_REG_RUN_MAX	4
+
+/* The update bit of the volume registers in runs of stereo pairs. The left
+ * one is kept clear to hold its volume, the right one set to latch both.
+ */
+#define NAU8822_VOL_UPDATE	0x100
+#define NAU8822_DIGITAL_VOL_MASK	0xff
+/* the zero cross of the PGA, headphone and speaker volumes */
+#define NAU8822_VOL_ZC		0x80
+
+/* software fade of the DAC digital volume, one latch per step */
+#define NAU8822_FADE_STEP_MS		5
+#define NAU8822_FADE_TIME_MAX_MS	5000
+
+struct nau8822_fade {
+	struct delayed_work work;
+	/* serialize the volume of the control and the steps */
+	struct mutex lock;
+	unsigned int time_ms;
+	unsigned int start[2];
+	unsigned int target[2];
+	unsigned int step;
+	unsigned int steps;
+	bool active;
+};
+
+/* The direct monitor presets: the boost mixer bypass to the output
+ * mixers at a gain of the preset, both sides in one DAPM update.
+ */
+enum {
+	NAU8822_MONITOR_OFF,
+	NAU8822_MONITOR_M15DB,
+	NAU8822_MONITOR_M9DB,
+	NAU8822_MONITOR_M3DB,
+	NAU8822_MONITOR_0DB,
+	NAU8822_MONITOR_P6DB,
+	NAU8822_MONITOR_NUM,
+};
+
+/* registers of an I2C transfer */
+#define NAU8822_BURST_REGS	16
+
+/* fast charge time of the reference through REFIMP_3K */
+#define NAU8822_REFIMP_CHARGE_MS	100
+#define NAU8822_REFIMP_TIMEOUT_MS	1000
+
 /* Codec Private Data */
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8822_LAT_HW_PARAMS,
+	NAU8822_LAT_CHARGE_WAIT,
+	NAU8822_LAT_NUM,
+};
+
 struct nau8822 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_latency latency[NAU8822_LAT_NUM];
 	int mclk_idx;
 	struct nau8822_pll pll;
+	struct nau8822_clk_memo clk_memo[NAU8822_CLK_MEMO_NUM];
+	int clk_memo_num;
+	int clk_memo_next;
 	int sysclk;
 	int div_id;
+	/* the master clock from PLL, as CLOCKING is programmed */
+	bool clk_pll;
+	struct nau_regcache_stat resume_sync;
+	struct nau_coeff_shadow eq_shadow;
+	/* fast charge of the reference, ended by the work */
+	struct delayed_work charge_work;
+	struct completion charge_done;
+	struct nau8822_fade fade;
+	int monitor;
+	/* the use cases of the board, recalled in one DAPM update */
+	struct nau_scenes scenes;
 };
 
 #endif	/* __NAU8822_H__ */
@@ -0,0 +1,135 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Clock tree planner of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_CLKPLAN_H__
+#define __NAU_CLKPLAN_H__
+
+#include <linux/debugfs.h>
+#include <linux/types.h>
+
+#include "nau-fll.h"
+
+/* The clock sources of the sysclk the planner picks from, in the order
+ * of the power drawn: MCLK straight with the FLL off, then the FLL locked
+ * to MCLK, then the FLL locked to BCLK. The internal VCO free runs off the
+ * exact rates, so it stays the clock of the jack detection and is never
+ * planned for a stream.
+ */
+enum {
+	NAU_CLK_PLAN_NONE,
+	NAU_CLK_PLAN_MCLK,
+	NAU_CLK_PLAN_FLL_MCLK,
+	NAU_CLK_PLAN_FLL_BLK,
+};
+
+struct nau_clk_plan {
+	u32 src;
+	u32 freq_in;
+	u32 fs;
+	unsigned int mclk_div;	/* the MCLK divider value for MCLK straight */
+	struct nau_fll fll;	/* the FLL parameters for the FLL sources */
+};
+
+/* The planner of a codec. The machine driver enables it with the MCLK
+ * rate it can offer, 0 if none, and hw_params then plans the sysclk of
+ * each stream. A plan in place already is left alone; anything else that
+ * changes the sysclk drops it by nau_clk_plan_reset().
+ */
+struct nau_clk_planner {
+	bool enable;
+	unsigned int mclk;
+	struct nau_clk_plan applied;
+	u32 changes;
+};
+
+/**
+ * nau_clk_plan_pick - Pick the sysclk of the lowest power for a stream.
+ * @desc: FLL of the codec.
+ * @cache: FLL solutions of the codec.
+ * @frac_bits: bits of the FLL fractional input, 16 or 24.
+ * @mclk: MCLK rate available, 0 if none.
+ * @bclk: BCLK rate of the stream, 0 if the codec drives BCLK.
+ * @fs: sampling rate.
+ * @plan: the plan picked.
+ *
+ * Returns 0 for success or -EINVAL if no source makes 256 * @fs.
+ */
+static inline int nau_clk_plan_pick(const struct nau_fll_desc *desc,
+	struct nau_fll_cache *cache, unsigned int frac_bits, unsigned int mclk,
+	unsigned int bclk, unsigned int fs, struct nau_clk_plan *plan)
+{
+	unsigned int i;
+
+	plan->fs = fs;
+	if (mclk) {
+		plan->freq_in = mclk;
+		for (i = 0; i < desc->num_mclk_src; i++) {
+			if (mclk != 256 * fs * desc->mclk_src[i].param)
+				continue;
+			plan->src = NAU_CLK_PLAN_MCLK;
+			plan->mclk_div = desc->mclk_src[i].val;
+			return 0;
+		}
+		if (!nau_fll_solve(desc, cache, mclk, fs, frac_bits,
+			&plan->fll)) {
+			plan->src = NAU_CLK_PLAN_FLL_MCLK;
+			return 0;
+		}
+	}
+	if (bclk && !nau_fll_solve(desc, cache, bclk, fs, frac_bits,
+		&plan->fll)) {
+		plan->src = NAU_CLK_PLAN_FLL_BLK;
+		plan->freq_in = bclk;
+		return 0;
+	}
+	plan->src = NAU_CLK_PLAN_NONE;
+
+	return -EINVAL;
+}
+
+/* Returns true if @plan is in place already */
+static inline bool nau_clk_plan_applied(const struct nau_clk_planner *planner,
+	const struct nau_clk_plan *plan)
+{
+	return planner->applied.src == plan->src &&
+		planner->applied.freq_in == plan->freq_in &&
+		planner->applied.fs == plan->fs;
+}
+
+/* Record @plan once it is applied */
+static inline void nau_clk_plan_done(struct nau_clk_planner *planner,
+	const struct nau_clk_plan *plan)
+{
+	planner->applied = *plan;
+	planner->changes++;
+}
+
+static inline void nau_clk_plan_reset(struct nau_clk_planner *planner)
+{
+	planner->applied.src = NAU_CLK_PLAN_NONE;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_clk_plan_debugfs_init(struct dentry *root,
+	struct nau_clk_planner *planner)
+{
+	if (!root)
+		return;
+	debugfs_create_u32("clk_plan_src", 0444, root, &planner->applied.src);
+	debugfs_create_u32("clk_plan_freq_in", 0444, root,
+			   &planner->applied.freq_in);
+	debugfs_create_u32("clk_plan_fs", 0444, root, &planner->applied.fs);
+	debugfs_create_u32("clk_plan_changes", 0444, root, &planner->changes);
+}
+#else
+static inline void nau_clk_plan_debugfs_init(struct dentry *root,
+	struct nau_clk_planner *planner)
+{
+}
+#endif
+
+#endif /* __NAU_CLKPLAN_H__ */
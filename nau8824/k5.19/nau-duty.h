@@ -0,0 +1,69 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Duty cycled button detection of the Nuvoton headset codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_DUTY_H__
+#define __NAU_DUTY_H__
+
+#include <linux/debugfs.h>
+#include <linux/jiffies.h>
+#include <linux/types.h>
+
+/* The buttons of a headset are sampled by the SAR, which runs on the
+ * internal VCO. Both stay on while a headset waits idle, unless a period
+ * is set: then the driver turns them on for NAU_DUTY_AWAKE_MS of each
+ * period, enough for a SAR sample and the key debounce, and off for the
+ * rest. The jack detection doesn't need them and stays on.
+ *
+ *   period     VCO and SAR on     press seen after, at worst
+ *   0          all the time       the key debounce
+ *   100 ms     30 %               70 ms more
+ *   250 ms     12 %               220 ms more
+ *   500 ms     6 %                470 ms more
+ *   1000 ms    3 %                970 ms more
+ *
+ * The idle current of the detection falls with the share it is on. A
+ * press is seen at the next wake up, so a click shorter than the sleep
+ * may be missed; a button held keeps the detection on until released.
+ */
+#define NAU_DUTY_AWAKE_MS	30
+
+struct nau_duty {
+	unsigned int period_ms;	/* 0 keeps the detection on */
+	bool run;		/* cycling, with an idle headset */
+	bool asleep;		/* the VCO and the SAR are off now */
+	u32 wakeups;
+};
+
+static inline bool nau_duty_enabled(const struct nau_duty *duty)
+{
+	return duty->period_ms > NAU_DUTY_AWAKE_MS;
+}
+
+/* The time to the next switch of the detection */
+static inline unsigned long nau_duty_next(const struct nau_duty *duty)
+{
+	return msecs_to_jiffies(duty->asleep ?
+		duty->period_ms - NAU_DUTY_AWAKE_MS : NAU_DUTY_AWAKE_MS);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_duty_debugfs_init(struct dentry *root,
+	struct nau_duty *duty)
+{
+	if (!root)
+		return;
+	debugfs_create_u32("button_duty_ms", 0444, root, &duty->period_ms);
+	debugfs_create_u32("button_duty_wakeups", 0444, root, &duty->wakeups);
+}
+#else
+static inline void nau_duty_debugfs_init(struct dentry *root,
+	struct nau_duty *duty)
+{
+}
+#endif
+
+#endif /* __NAU_DUTY_H__ */
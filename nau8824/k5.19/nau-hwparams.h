@@ -0,0 +1,99 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Parameters applied last by hw_params of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_HWPARAMS_H__
+#define __NAU_HWPARAMS_H__
+
+#include <linux/debugfs.h>
+#include <linux/types.h>
+#include <sound/pcm.h>
+#include <sound/pcm_params.h>
+
+/* The stream parameters hw_params configured the codec with, per stream
+ * direction. A call with the same parameters again, on a reopen or the
+ * recovery of an underrun, leaves the registers as they are. The clocks
+ * and the interface are shared by the directions, so a direction which
+ * applies other parameters drops the fingerprint of the other one. The
+ * DAI format, the TDM slots, the clocks and anything else hw_params
+ * depends on drop them all by nau_hw_params_reset().
+ */
+struct nau_hw_params_key {
+	unsigned int rate;
+	unsigned int channels;
+	snd_pcm_format_t format;
+};
+
+struct nau_hw_params_cache {
+	struct nau_hw_params_key key[2];
+	bool valid[2];
+	u32 skipped;
+};
+
+static inline void nau_hw_params_key_get(struct nau_hw_params_key *key,
+	const struct snd_pcm_hw_params *params)
+{
+	key->rate = params_rate(params);
+	key->channels = params_channels(params);
+	key->format = params_format(params);
+}
+
+static inline bool nau_hw_params_key_same(const struct nau_hw_params_key *a,
+	const struct nau_hw_params_key *b)
+{
+	return a->rate == b->rate && a->channels == b->channels &&
+		a->format == b->format;
+}
+
+/* Returns true if @params of @stream are in place already */
+static inline bool nau_hw_params_skip(struct nau_hw_params_cache *cache,
+	int stream, const struct snd_pcm_hw_params *params)
+{
+	struct nau_hw_params_key key;
+
+	nau_hw_params_key_get(&key, params);
+	if (!cache->valid[stream] ||
+		!nau_hw_params_key_same(&key, &cache->key[stream]))
+		return false;
+	cache->skipped++;
+
+	return true;
+}
+
+/* Record @params of @stream once hw_params applied them all */
+static inline void nau_hw_params_done(struct nau_hw_params_cache *cache,
+	int stream, const struct snd_pcm_hw_params *params)
+{
+	int other = !stream;
+
+	nau_hw_params_key_get(&cache->key[stream], params);
+	cache->valid[stream] = true;
+	if (!nau_hw_params_key_same(&cache->key[stream], &cache->key[other]))
+		cache->valid[other] = false;
+}
+
+static inline void nau_hw_params_reset(struct nau_hw_params_cache *cache)
+{
+	cache->valid[SNDRV_PCM_STREAM_PLAYBACK] = false;
+	cache->valid[SNDRV_PCM_STREAM_CAPTURE] = false;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_hw_params_debugfs_init(struct dentry *root,
+	struct nau_hw_params_cache *cache)
+{
+	if (root)
+		debugfs_create_u32("hw_params_skipped", 0444, root,
+				   &cache->skipped);
+}
+#else
+static inline void nau_hw_params_debugfs_init(struct dentry *root,
+	struct nau_hw_params_cache *cache)
+{
+}
+#endif
+
+#endif /* __NAU_HWPARAMS_H__ */
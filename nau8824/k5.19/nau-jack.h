@@ -0,0 +1,214 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Coalesced jack reports of the Nuvoton headset codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_JACK_H__
+#define __NAU_JACK_H__
+
+#include <linux/debugfs.h>
+#include <linux/jiffies.h>
+#include <linux/ktime.h>
+#include <linux/mutex.h>
+#include <linux/workqueue.h>
+#include <sound/jack.h>
+#include <sound/soc.h>
+
+#include "nau-latency.h"
+
+/* the window of the jack state reports by default */
+#define NAU_JACK_REPORT_MS	50
+
+#define NAU_JACK_BUTTONS (SND_JACK_BTN_0 | SND_JACK_BTN_1 | \
+		SND_JACK_BTN_2 | SND_JACK_BTN_3 | SND_JACK_BTN_4 | \
+		SND_JACK_BTN_5)
+
+/* The reports timed from the interruption that led to them, by event */
+enum {
+	NAU_JACK_LAT_INSERT,
+	NAU_JACK_LAT_EJECT,
+	NAU_JACK_LAT_PRESS,
+	NAU_JACK_LAT_RELEASE,
+	NAU_JACK_LAT_NUM,
+};
+
+/* Each report wakes up the input listeners and the kcontrol ones. The
+ * jack state a plug bounce flips back and forth is held for a window and
+ * only the state at the end is reported, once. The buttons go out at
+ * once, but only their real transitions; a press flushes the jack state
+ * held ahead of it. A window of 0 reports everything as it comes.
+ */
+struct nau_jack_report {
+	struct mutex lock;
+	struct delayed_work work;
+	struct snd_soc_jack *jack;
+	unsigned int window_ms;
+	int pending;
+	int pending_mask;
+	u32 merged;
+	/* the stamp of the last interruption, NULL for no timing */
+	const ktime_t *irq_time;
+	ktime_t irq_seen[NAU_JACK_LAT_NUM];
+	struct nau_latency lat[NAU_JACK_LAT_NUM];
+};
+
+/* Time the report of @event on @mask from the interruption last stamped.
+ * An interruption is taken once per event, so the repeats of a button and
+ * the reports of a resume aren't timed from an old one.
+ */
+static inline void __nau_jack_report_time(struct nau_jack_report *rpt,
+	int event, int mask)
+{
+	ktime_t irq;
+	int type;
+
+	if (!rpt->irq_time)
+		return;
+	irq = READ_ONCE(*rpt->irq_time);
+	if (mask & NAU_JACK_BUTTONS)
+		type = event & mask ? NAU_JACK_LAT_PRESS : NAU_JACK_LAT_RELEASE;
+	else
+		type = event & mask ? NAU_JACK_LAT_INSERT : NAU_JACK_LAT_EJECT;
+	if (ktime_compare(irq, rpt->irq_seen[type]) <= 0)
+		return;
+	rpt->irq_seen[type] = irq;
+	nau_latency_add(&rpt->lat[type], irq);
+}
+
+/* Report the jack state held, with @rpt->lock held */
+static inline void __nau_jack_report_flush(struct nau_jack_report *rpt)
+{
+	struct snd_soc_jack *jack = rpt->jack;
+	int mask = rpt->pending_mask;
+
+	rpt->pending_mask = 0;
+	if (!jack || !mask)
+		return;
+	if ((jack->status ^ rpt->pending) & mask) {
+		__nau_jack_report_time(rpt, rpt->pending,
+				       (jack->status ^ rpt->pending) & mask);
+		snd_soc_jack_report(jack, rpt->pending, mask);
+	} else
+		rpt->merged++;
+}
+
+static inline void nau_jack_report_work(struct work_struct *work)
+{
+	struct nau_jack_report *rpt = container_of(work,
+		struct nau_jack_report, work.work);
+
+	mutex_lock(&rpt->lock);
+	__nau_jack_report_flush(rpt);
+	mutex_unlock(&rpt->lock);
+}
+
+/* The window is a device property, read ahead. @irq_time is the stamp
+ * the hard interruption handler takes, NULL if none.
+ */
+static inline void nau_jack_report_init(struct nau_jack_report *rpt,
+	const ktime_t *irq_time)
+{
+	mutex_init(&rpt->lock);
+	rpt->irq_time = irq_time;
+	INIT_DELAYED_WORK(&rpt->work, nau_jack_report_work);
+}
+
+/**
+ * nau_jack_report - Report the jack state and the buttons, coalesced.
+ * @rpt: the reports of the codec.
+ * @jack: the jack, skipped if NULL.
+ * @event: the state of the bits in @mask.
+ * @mask: the jack type and button bits reported.
+ */
+static inline void nau_jack_report(struct nau_jack_report *rpt,
+	struct snd_soc_jack *jack, int event, int mask)
+{
+	int buttons = mask & NAU_JACK_BUTTONS;
+
+	if (!jack)
+		return;
+	mask &= ~NAU_JACK_BUTTONS;
+	mutex_lock(&rpt->lock);
+	rpt->jack = jack;
+	if (mask) {
+		if (rpt->pending_mask)
+			rpt->merged++;
+		rpt->pending = (rpt->pending & ~mask) | (event & mask);
+		rpt->pending_mask |= mask;
+		if (rpt->window_ms)
+			mod_delayed_work(system_wq, &rpt->work,
+				msecs_to_jiffies(rpt->window_ms));
+		else
+			__nau_jack_report_flush(rpt);
+	}
+	if (buttons) {
+		if ((jack->status ^ event) & buttons) {
+			/* no press ahead of the jack it comes from */
+			if (event & buttons) {
+				cancel_delayed_work(&rpt->work);
+				__nau_jack_report_flush(rpt);
+			}
+			__nau_jack_report_time(rpt, event,
+					       (jack->status ^ event) & buttons);
+			snd_soc_jack_report(jack, event, buttons);
+		} else {
+			rpt->merged++;
+		}
+	}
+	mutex_unlock(&rpt->lock);
+}
+
+/* Report the jack state held now, before a suspend or a new jack */
+static inline void nau_jack_report_flush(struct nau_jack_report *rpt)
+{
+	cancel_delayed_work_sync(&rpt->work);
+	mutex_lock(&rpt->lock);
+	__nau_jack_report_flush(rpt);
+	mutex_unlock(&rpt->lock);
+}
+
+/* Drop the jack state held, as the jack goes away */
+static inline void nau_jack_report_cancel(struct nau_jack_report *rpt)
+{
+	cancel_delayed_work_sync(&rpt->work);
+	mutex_lock(&rpt->lock);
+	rpt->pending_mask = 0;
+	rpt->jack = NULL;
+	mutex_unlock(&rpt->lock);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_jack_report_debugfs_init(struct dentry *root,
+	struct nau_jack_report *rpt)
+{
+	static const char * const names[NAU_JACK_LAT_NUM] = {
+		[NAU_JACK_LAT_INSERT] = "insert",
+		[NAU_JACK_LAT_EJECT] = "eject",
+		[NAU_JACK_LAT_PRESS] = "press",
+		[NAU_JACK_LAT_RELEASE] = "release",
+	};
+	struct dentry *dir;
+	int i;
+
+	if (!root)
+		return;
+	debugfs_create_u32("jack_report_window_ms", 0644, root,
+			   &rpt->window_ms);
+	debugfs_create_u32("jack_report_merged", 0444, root, &rpt->merged);
+	if (!rpt->irq_time)
+		return;
+	dir = debugfs_create_dir("jack_latency", root);
+	for (i = 0; i < NAU_JACK_LAT_NUM; i++)
+		debugfs_create_file(names[i], 0444, dir, &rpt->lat[i],
+				    &nau_latency_fops);
+}
+#else
+static inline void nau_jack_report_debugfs_init(struct dentry *root,
+	struct nau_jack_report *rpt)
+{
+}
+#endif
+
+#endif /* __NAU_JACK_H__ */
@@ -0,0 +1,48 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Tracepoints of the NAU88L24 clock and jack detection lock.
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM nau8824
+
+#if !defined(__NAU8824_TRACE_H__) || defined(TRACE_HEADER_MULTI_READ)
+#define __NAU8824_TRACE_H__
+
+#include <linux/device.h>
+#include <linux/tracepoint.h>
+
+TRACE_EVENT(nau8824_sema_wait,
+
+	TP_PROTO(struct device *dev, bool resume, s64 elapsed_ns, int ret),
+
+	TP_ARGS(dev, resume, elapsed_ns, ret),
+
+	TP_STRUCT__entry(
+		__string(name, dev_name(dev))
+		__field(bool, resume)
+		__field(s64, elapsed_ns)
+		__field(int, ret)
+	),
+
+	TP_fast_assign(
+		__assign_str(name, dev_name(dev));
+		__entry->resume = resume;
+		__entry->elapsed_ns = elapsed_ns;
+		__entry->ret = ret;
+	),
+
+	TP_printk("%s resume=%d elapsed=%lldns ret=%d", __get_str(name),
+		  __entry->resume, __entry->elapsed_ns, __entry->ret)
+);
+
+#endif /* __NAU8824_TRACE_H__ */
+
+/* This part must be outside protection */
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH ../../sound/soc/codecs
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE nau8824-trace
+#include <trace/define_trace.h>
@@ -11,12 +11,15 @@
 #include <linux/dmi.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
 #include <linux/clk.h>
 #include <linux/acpi.h>
 #include <linux/math64.h>
 #include <linux/semaphore.h>
+#include <linux/debugfs.h>
+#include <linux/workqueue.h>
 
 #include <sound/initval.h>
 #include <sound/tlv.h>
@@ -26,8 +29,24 @@
 #include <sound/soc.h>
 #include <sound/jack.h>
 
+#include "nau-clkplan.h"
+#include "nau-dapm-stat.h"
+#include "nau-delay.h"
+#include "nau-duty.h"
+#include "nau-hwparams.h"
+#include "nau-irq.h"
+#include "nau-jack.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-props.h"
+#include "nau-regmap.h"
+#include "nau-fll.h"
+#include "nau-settle.h"
 #include "nau8824.h"
 
+#define CREATE_TRACE_POINTS
+#include "nau8824-trace.h"
+
 #define NAU8824_JD_ACTIVE_HIGH			BIT(0)
 #define NAU8824_MONO_SPEAKER			BIT(1)
 
@@ -38,21 +57,33 @@ MODULE_PARM_DESC(quirk, "Board-specific quirk override");
 
 static int nau8824_config_sysclk(struct nau8824 *nau8824,
 	int clk_id, unsigned int freq);
+static int nau8824_clk_plan_run(struct nau8824 *nau8824,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai);
 static bool nau8824_is_jack_inserted(struct nau8824 *nau8824);
 
 /* the ADC threshold of headset */
 #define DMIC_CLK 3072000
+/* the highest DMIC_SRC, a divider of 32 */
+#define NAU8824_DMIC_SRC_MAX 5
 
 /* the ADC threshold of headset */
 #define HEADSET_SARADC_THD 0x80
 
+/* The jack type is decided once the SAR ADC settles for a number of
+ * samples in a row, or with the last sample after the ceiling time.
+ */
+#define NAU8824_JDET_POLL_MS 10
+#define NAU8824_JDET_TIMEOUT_MS 100
+#define NAU8824_JDET_STABLE_NUM 3
+#define NAU8824_JDET_SAR_TOLERANCE 2
+
 /* the parameter threshold of FLL */
 #define NAU_FREF_MAX 13500000
 #define NAU_FVCO_MAX 100000000
 #define NAU_FVCO_MIN 90000000
 
 /* scaling for mclk from sysclk_src output */
-static const struct nau8824_fll_attr mclk_src_scaling[] = {
+static const struct nau_fll_attr mclk_src_scaling[] = {
 	{ 1, 0x0 },
 	{ 2, 0x2 },
 	{ 4, 0x3 },
@@ -66,7 +97,7 @@ static const struct nau8824_fll_attr mclk_src_scaling[] = {
 };
 
 /* ratio for input clk freq */
-static const struct nau8824_fll_attr fll_ratio[] = {
+static const struct nau_fll_attr fll_ratio[] = {
 	{ 512000, 0x01 },
 	{ 256000, 0x02 },
 	{ 128000, 0x04 },
@@ -76,13 +107,25 @@ static const struct nau8824_fll_attr fll_ratio[] = {
 	{ 4000, 0x40 },
 };
 
-static const struct nau8824_fll_attr fll_pre_scalar[] = {
+static const struct nau_fll_attr fll_pre_scalar[] = {
 	{ 1, 0x0 },
 	{ 2, 0x1 },
 	{ 4, 0x2 },
 	{ 8, 0x3 },
 };
 
+static const struct nau_fll_desc nau8824_fll_desc = {
+	.mclk_src = mclk_src_scaling,
+	.num_mclk_src = ARRAY_SIZE(mclk_src_scaling),
+	.ratio = fll_ratio,
+	.num_ratio = ARRAY_SIZE(fll_ratio),
+	.pre_scalar = fll_pre_scalar,
+	.num_pre_scalar = ARRAY_SIZE(fll_pre_scalar),
+	.fref_max = NAU_FREF_MAX,
+	.fvco_min = NAU_FVCO_MIN,
+	.fvco_max = NAU_FVCO_MAX,
+};
+
 /* the maximum frequency of CLK_ADC and CLK_DAC */
 #define CLK_DA_AD_MAX 6144000
 
@@ -102,6 +145,10 @@ static const struct nau8824_osr_attr osr_adc_sel[] = {
 	{ 256, 0 },	/* OSR 256, SRC 1 */
 };
 
+/* the group delay of the converter filters, by their design */
+static const struct nau_delay_filter nau8824_dac_filter = { 17, 128 };
+static const struct nau_delay_filter nau8824_adc_filter = { 13, 96 };
+
 static const struct reg_default nau8824_reg_defaults[] = {
 	{ NAU8824_REG_ENA_CTRL, 0x0000 },
 	{ NAU8824_REG_CLK_GATING_ENA, 0x0000 },
@@ -205,17 +252,28 @@ static const struct reg_default nau8824_reg_defaults[] = {
 
 static int nau8824_sema_acquire(struct nau8824 *nau8824, long timeout)
 {
+	bool resume = READ_ONCE(nau8824->resume_lock);
+	ktime_t start = ktime_get();
 	int ret;
 
 	if (timeout) {
 		ret = down_timeout(&nau8824->jd_sem, timeout);
-		if (ret < 0)
-			dev_warn(nau8824->dev, "Acquire semaphore timeout\n");
+		if (ret < 0) {
+			nau8824->sema_timeouts++;
+			dev_warn_ratelimited(nau8824->dev,
+				"Acquire semaphore timeout\n");
+		}
 	} else {
 		ret = down_interruptible(&nau8824->jd_sem);
-		if (ret < 0)
-			dev_warn(nau8824->dev, "Acquire semaphore fail\n");
+		if (ret < 0) {
+			nau8824->sema_fails++;
+			dev_warn_ratelimited(nau8824->dev,
+				"Acquire semaphore fail\n");
+		}
 	}
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_SEMA_WAIT], start);
+	trace_nau8824_sema_wait(nau8824->dev, resume,
+		ktime_to_ns(ktime_sub(ktime_get(), start)), ret);
 
 	return ret;
 }
@@ -225,79 +283,87 @@ static inline void nau8824_sema_release(struct nau8824 *nau8824)
 	up(&nau8824->jd_sem);
 }
 
-static bool nau8824_readable_reg(struct device *dev, unsigned int reg)
+/* The semaphore held since resume is released once, by the first of the
+ * resume setup, the jack detection and the ejection.
+ */
+static void nau8824_resume_unlock(struct nau8824 *nau8824)
 {
-	switch (reg) {
-	case NAU8824_REG_ENA_CTRL ... NAU8824_REG_FLL_VCO_RSV:
-	case NAU8824_REG_JACK_DET_CTRL:
-	case NAU8824_REG_INTERRUPT_SETTING_1:
-	case NAU8824_REG_IRQ:
-	case NAU8824_REG_CLEAR_INT_REG ... NAU8824_REG_VDET_THRESHOLD_4:
-	case NAU8824_REG_GPIO_SEL:
-	case NAU8824_REG_PORT0_I2S_PCM_CTRL_1 ... NAU8824_REG_TDM_CTRL:
-	case NAU8824_REG_ADC_HPF_FILTER ... NAU8824_REG_EQ4_EQ5:
-	case NAU8824_REG_ADC_CH0_DGAIN_CTRL ... NAU8824_REG_ADC_TO_DAC_ST:
-	case NAU8824_REG_DRC_KNEE_IP12_ADC_CH01 ... NAU8824_REG_DRC_GAINL_ADC3:
-	case NAU8824_REG_DRC_KNEE_IP12_DAC ... NAU8824_REG_DRC_GAIN_DAC_CH1:
-	case NAU8824_REG_CLASSG ... NAU8824_REG_OTP_EFUSE:
-	case NAU8824_REG_OTPDOUT_1 ... NAU8824_REG_OTPDOUT_2:
-	case NAU8824_REG_I2C_TIMEOUT:
-	case NAU8824_REG_I2C_DEVICE_ID ... NAU8824_REG_SAR_ADC_DATA_OUT:
-	case NAU8824_REG_BIAS_ADJ ... NAU8824_REG_CLASSD_GAIN_2:
-	case NAU8824_REG_ANALOG_ADC_1 ... NAU8824_REG_ATT_PORT1:
-	case NAU8824_REG_POWER_UP_CONTROL ... NAU8824_REG_CHARGE_PUMP_INPUT:
-		return true;
-	default:
-		return false;
-	}
+	if (xchg(&nau8824->resume_lock, false))
+		nau8824_sema_release(nau8824);
+}
+
+#define NAU8824_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8824_REG_ENA_CTRL, NAU8824_REG_FLL_VCO_RSV) |	\
+	NAU_REG(w, NAU8824_REG_JACK_DET_CTRL) |				\
+	NAU_REG(w, NAU8824_REG_INTERRUPT_SETTING_1) |			\
+	NAU_REG(w, NAU8824_REG_IRQ) |					\
+	NAU_REG_RANGE(w, NAU8824_REG_CLEAR_INT_REG, NAU8824_REG_VDET_THRESHOLD_4) |	\
+	NAU_REG(w, NAU8824_REG_GPIO_SEL) |				\
+	NAU_REG_RANGE(w, NAU8824_REG_PORT0_I2S_PCM_CTRL_1, NAU8824_REG_TDM_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ADC_HPF_FILTER, NAU8824_REG_EQ4_EQ5) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ADC_CH0_DGAIN_CTRL, NAU8824_REG_ADC_TO_DAC_ST) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_DRC_KNEE_IP12_ADC_CH01, NAU8824_REG_DRC_GAINL_ADC3) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_DRC_KNEE_IP12_DAC, NAU8824_REG_DRC_GAIN_DAC_CH1) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_CLASSG, NAU8824_REG_OTP_EFUSE) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_OTPDOUT_1, NAU8824_REG_OTPDOUT_2) |	\
+	NAU_REG(w, NAU8824_REG_I2C_TIMEOUT) |				\
+	NAU_REG_RANGE(w, NAU8824_REG_I2C_DEVICE_ID, NAU8824_REG_SAR_ADC_DATA_OUT) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_BIAS_ADJ, NAU8824_REG_CLASSD_GAIN_2) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ANALOG_ADC_1, NAU8824_REG_ATT_PORT1) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_POWER_UP_CONTROL, NAU8824_REG_CHARGE_PUMP_INPUT))
+
+static const u32 nau8824_readable_map[] = NAU_REGMAP(NAU8824_READABLE_REGS);
 
+static bool nau8824_readable_reg(struct device *dev, unsigned int reg)
+{
+	return nau_regmap_access(nau8824_readable_map, reg);
 }
 
+#define NAU8824_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8824_REG_RESET, NAU8824_REG_FLL_VCO_RSV) |	\
+	NAU_REG(w, NAU8824_REG_JACK_DET_CTRL) |				\
+	NAU_REG(w, NAU8824_REG_INTERRUPT_SETTING_1) |			\
+	NAU_REG_RANGE(w, NAU8824_REG_CLEAR_INT_REG, NAU8824_REG_VDET_THRESHOLD_4) |	\
+	NAU_REG(w, NAU8824_REG_GPIO_SEL) |				\
+	NAU_REG_RANGE(w, NAU8824_REG_PORT0_I2S_PCM_CTRL_1, NAU8824_REG_TDM_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ADC_HPF_FILTER, NAU8824_REG_EQ4_EQ5) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ADC_CH0_DGAIN_CTRL, NAU8824_REG_ADC_TO_DAC_ST) |	\
+	NAU_REG(w, NAU8824_REG_DRC_KNEE_IP12_ADC_CH01) |		\
+	NAU_REG(w, NAU8824_REG_DRC_KNEE_IP34_ADC_CH01) |		\
+	NAU_REG(w, NAU8824_REG_DRC_SLOPE_ADC_CH01) |			\
+	NAU_REG(w, NAU8824_REG_DRC_ATKDCY_ADC_CH01) |			\
+	NAU_REG(w, NAU8824_REG_DRC_KNEE_IP12_ADC_CH23) |		\
+	NAU_REG(w, NAU8824_REG_DRC_KNEE_IP34_ADC_CH23) |		\
+	NAU_REG(w, NAU8824_REG_DRC_SLOPE_ADC_CH23) |			\
+	NAU_REG(w, NAU8824_REG_DRC_ATKDCY_ADC_CH23) |			\
+	NAU_REG_RANGE(w, NAU8824_REG_DRC_KNEE_IP12_DAC, NAU8824_REG_DRC_ATKDCY_DAC) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_CLASSG, NAU8824_REG_OTP_EFUSE) |	\
+	NAU_REG(w, NAU8824_REG_I2C_TIMEOUT) |				\
+	NAU_REG_RANGE(w, NAU8824_REG_BIAS_ADJ, NAU8824_REG_CLASSD_GAIN_2) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_ANALOG_ADC_1, NAU8824_REG_ATT_PORT1) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_POWER_UP_CONTROL, NAU8824_REG_CHARGE_PUMP_CONTROL))
+
+static const u32 nau8824_writeable_map[] = NAU_REGMAP(NAU8824_WRITEABLE_REGS);
+
 static bool nau8824_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8824_REG_RESET ... NAU8824_REG_FLL_VCO_RSV:
-	case NAU8824_REG_JACK_DET_CTRL:
-	case NAU8824_REG_INTERRUPT_SETTING_1:
-	case NAU8824_REG_CLEAR_INT_REG ... NAU8824_REG_VDET_THRESHOLD_4:
-	case NAU8824_REG_GPIO_SEL:
-	case NAU8824_REG_PORT0_I2S_PCM_CTRL_1 ... NAU8824_REG_TDM_CTRL:
-	case NAU8824_REG_ADC_HPF_FILTER ... NAU8824_REG_EQ4_EQ5:
-	case NAU8824_REG_ADC_CH0_DGAIN_CTRL ... NAU8824_REG_ADC_TO_DAC_ST:
-	case NAU8824_REG_DRC_KNEE_IP12_ADC_CH01:
-	case NAU8824_REG_DRC_KNEE_IP34_ADC_CH01:
-	case NAU8824_REG_DRC_SLOPE_ADC_CH01:
-	case NAU8824_REG_DRC_ATKDCY_ADC_CH01:
-	case NAU8824_REG_DRC_KNEE_IP12_ADC_CH23:
-	case NAU8824_REG_DRC_KNEE_IP34_ADC_CH23:
-	case NAU8824_REG_DRC_SLOPE_ADC_CH23:
-	case NAU8824_REG_DRC_ATKDCY_ADC_CH23:
-	case NAU8824_REG_DRC_KNEE_IP12_DAC ... NAU8824_REG_DRC_ATKDCY_DAC:
-	case NAU8824_REG_CLASSG ... NAU8824_REG_OTP_EFUSE:
-	case NAU8824_REG_I2C_TIMEOUT:
-	case NAU8824_REG_BIAS_ADJ ... NAU8824_REG_CLASSD_GAIN_2:
-	case NAU8824_REG_ANALOG_ADC_1 ... NAU8824_REG_ATT_PORT1:
-	case NAU8824_REG_POWER_UP_CONTROL ... NAU8824_REG_CHARGE_PUMP_CONTROL:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8824_writeable_map, reg);
 }
 
+#define NAU8824_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8824_REG_RESET) |					\
+	NAU_REG_RANGE(w, NAU8824_REG_IRQ, NAU8824_REG_CLEAR_INT_REG) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_DRC_GAINL_ADC0, NAU8824_REG_DRC_GAINL_ADC3) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_DRC_GAIN_DAC_CH0, NAU8824_REG_DRC_GAIN_DAC_CH1) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_OTPDOUT_1, NAU8824_REG_OTPDOUT_2) |	\
+	NAU_REG_RANGE(w, NAU8824_REG_I2C_DEVICE_ID, NAU8824_REG_SAR_ADC_DATA_OUT) |	\
+	NAU_REG(w, NAU8824_REG_CHARGE_PUMP_INPUT))
+
+static const u32 nau8824_volatile_map[] = NAU_REGMAP(NAU8824_VOLATILE_REGS);
+
 static bool nau8824_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8824_REG_RESET:
-	case NAU8824_REG_IRQ ... NAU8824_REG_CLEAR_INT_REG:
-	case NAU8824_REG_DRC_GAINL_ADC0 ... NAU8824_REG_DRC_GAINL_ADC3:
-	case NAU8824_REG_DRC_GAIN_DAC_CH0 ... NAU8824_REG_DRC_GAIN_DAC_CH1:
-	case NAU8824_REG_OTPDOUT_1 ... NAU8824_REG_OTPDOUT_2:
-	case NAU8824_REG_I2C_DEVICE_ID ... NAU8824_REG_SAR_ADC_DATA_OUT:
-	case NAU8824_REG_CHARGE_PUMP_INPUT:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8824_volatile_map, reg);
 }
 
 static const char * const nau8824_companding[] = {
@@ -360,12 +426,163 @@ static const DECLARE_TLV_DB_MINMAX(hp_vol_tlv, -3000, 0);
 static const DECLARE_TLV_DB_SCALE(mic_vol_tlv, 0, 200, 0);
 static const DECLARE_TLV_DB_SCALE(dmic_vol_tlv, -12800, 50, 0);
 
+/* Switch the SAR to the profile selected, which costs the writes of
+ * SAR_ADC and VDET_COEFFICIENT only, and nothing if already applied.
+ */
+static void nau8824_sar_profile_apply(struct nau8824 *nau8824)
+{
+	struct regmap *regmap = nau8824->regmap;
+	const struct nau8824_sar_profile *prof;
+	int sel;
+
+	mutex_lock(&nau8824->sar_lock);
+	if (nau8824->sar_mode == NAU8824_SAR_MODE_AUTO)
+		sel = nau8824->capture_active ?
+			NAU8824_SAR_FAST : NAU8824_SAR_LOW_POWER;
+	else
+		sel = nau8824->sar_mode == NAU8824_SAR_MODE_FAST ?
+			NAU8824_SAR_FAST : NAU8824_SAR_LOW_POWER;
+	if (sel == nau8824->sar_applied)
+		goto unlock;
+
+	prof = &nau8824->sar_profile[sel];
+	regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
+		NAU8824_SAR_COMPARE_TIME_MASK | NAU8824_SAR_SAMPLING_TIME_MASK,
+		(prof->compare_time << NAU8824_SAR_COMPARE_TIME_SFT) |
+		(prof->sampling_time << NAU8824_SAR_SAMPLING_TIME_SFT));
+	regmap_update_bits(regmap, NAU8824_REG_VDET_COEFFICIENT,
+		NAU8824_SHORTKEY_DEBOUNCE_MASK,
+		prof->key_debounce << NAU8824_SHORTKEY_DEBOUNCE_SFT);
+	nau8824->sar_applied = sel;
+	dev_dbg(nau8824->dev, "SAR profile %d\n", sel);
+unlock:
+	mutex_unlock(&nau8824->sar_lock);
+}
+
+static const char * const nau8824_sar_mode[] = {
+	"Auto", "Low Power", "Fast" };
+
+static const struct soc_enum nau8824_sar_mode_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8824_sar_mode), nau8824_sar_mode);
+
+static int nau8824_sar_mode_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8824->sar_mode;
+
+	return 0;
+}
+
+static int nau8824_sar_mode_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	unsigned int mode = ucontrol->value.enumerated.item[0];
+
+	if (mode >= ARRAY_SIZE(nau8824_sar_mode))
+		return -EINVAL;
+	if (mode == nau8824->sar_mode)
+		return 0;
+
+	nau8824->sar_mode = mode;
+	if (nau8824->sar_threshold_num)
+		nau8824_sar_profile_apply(nau8824);
+
+	return 1;
+}
+
+static const char * const nau8824_dmic_power_mode[] = {
+	"Performance", "Low Power" };
+
+static const struct soc_enum nau8824_dmic_power_mode_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8824_dmic_power_mode),
+		nau8824_dmic_power_mode);
+
+static int nau8824_dmic_power_mode_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8824->dmic_power_mode;
+
+	return 0;
+}
+
+static int nau8824_dmic_power_mode_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	unsigned int mode = ucontrol->value.enumerated.item[0];
+
+	if (mode >= ARRAY_SIZE(nau8824_dmic_power_mode))
+		return -EINVAL;
+	if (mode == nau8824->dmic_power_mode)
+		return 0;
+
+	nau8824->dmic_power_mode = mode;
+
+	return 1;
+}
+
+static const char * const nau8824_osr_policy[] = {
+	"Manual", "Low Latency", "Low Power", "Quality" };
+
+static const struct soc_enum nau8824_osr_policy_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8824_osr_policy),
+		nau8824_osr_policy);
+
+static int nau8824_osr_policy_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8824->osr_policy;
+
+	return 0;
+}
+
+/* The policy takes effect at the next hw_params */
+static int nau8824_osr_policy_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	unsigned int policy = ucontrol->value.enumerated.item[0];
+
+	if (policy >= ARRAY_SIZE(nau8824_osr_policy))
+		return -EINVAL;
+	if (policy == nau8824->osr_policy)
+		return 0;
+
+	nau8824->osr_policy = policy;
+	nau_hw_params_reset(&nau8824->hw_params_cache);
+
+	return 1;
+}
+
 static const struct snd_kcontrol_new nau8824_snd_controls[] = {
 	SOC_ENUM("ADC Companding", nau8824_companding_adc_enum),
 	SOC_ENUM("DAC Companding", nau8824_companding_dac_enum),
 
 	SOC_ENUM("ADC Decimation Rate", nau8824_adc_decimation_enum),
 	SOC_ENUM("DAC Oversampling Rate", nau8824_dac_oversampl_enum),
+	SOC_ENUM_EXT("OSR Policy", nau8824_osr_policy_enum,
+		nau8824_osr_policy_get, nau8824_osr_policy_put),
+	SOC_ENUM_EXT("DMIC Power Mode", nau8824_dmic_power_mode_enum,
+		nau8824_dmic_power_mode_get, nau8824_dmic_power_mode_put),
 
 	SOC_SINGLE_TLV("Speaker Right DACR Volume",
 		NAU8824_REG_CLASSD_GAIN_1, 8, 0x1f, 0, spk_vol_tlv),
@@ -423,6 +640,9 @@ static const struct snd_kcontrol_new nau8824_snd_controls[] = {
 		NAU8824_REG_VDET_THRESHOLD_2, 8, 0xff, 0),
 	SOC_SINGLE("THD for key volume down",
 		NAU8824_REG_VDET_THRESHOLD_2, 0, 0xff, 0),
+
+	SOC_ENUM_EXT("SAR Profile", nau8824_sar_mode_enum,
+		nau8824_sar_mode_get, nau8824_sar_mode_put),
 };
 
 static int nau8824_output_dac_event(struct snd_soc_dapm_widget *w,
@@ -480,13 +700,14 @@ static int nau8824_pump_event(struct snd_soc_dapm_widget *w,
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
-		/* Prevent startup click by letting charge pump to ramp up */
-		msleep(10);
-		regmap_update_bits(nau8824->regmap,
-			NAU8824_REG_CHARGE_PUMP_CONTROL,
-			NAU8824_JAMNODCLOW, NAU8824_JAMNODCLOW);
+		/* Prevent startup click by letting charge pump to ramp up.
+		 * The rest of the DAPM sequence goes on meanwhile, and the
+		 * playback waits for the rest of the ramp at its unmute.
+		 */
+		nau_settle_start(&nau8824->pump_settle, NAU8824_PUMP_RAMP_MS);
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
+		nau_settle_cancel(&nau8824->pump_settle);
 		regmap_update_bits(nau8824->regmap,
 			NAU8824_REG_CHARGE_PUMP_CONTROL,
 			NAU8824_JAMNODCLOW, 0);
@@ -562,16 +783,28 @@ static int dmic_clock_control(struct snd_soc_dapm_widget *w,
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
-	int src;
+	int src, clk;
 
 	/* The DMIC clock is gotten from system clock (256fs) divided by
 	 * DMIC_SRC (1, 2, 4, 8, 16, 32). The clock has to be equal or
-	 * less than 3.072 MHz.
+	 * less than 3.072 MHz. The low power mode takes the lowest clock
+	 * in the low-power range of the mics, if there is one.
 	 */
-	for (src = 0; src < 5; src++) {
+	if (nau8824->dmic_power_mode == NAU8824_DMIC_LOW_POWER) {
+		for (src = NAU8824_DMIC_SRC_MAX; src >= 0; src--) {
+			clk = (0x1 << (8 - src)) * nau8824->fs;
+			if (clk >= nau8824->dmic_lp_clk_min &&
+			    clk <= nau8824->dmic_lp_clk_max && clk <= DMIC_CLK)
+				goto out;
+		}
+		dev_dbg(nau8824->dev, "no low power dmic clock for fs %d\n",
+			nau8824->fs);
+	}
+	for (src = 0; src < NAU8824_DMIC_SRC_MAX; src++) {
 		if ((0x1 << (8 - src)) * nau8824->fs <= DMIC_CLK)
 			break;
 	}
+out:
 	dev_dbg(nau8824->dev, "dmic src %d for mclk %d\n", src, nau8824->fs * 256);
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
 		NAU8824_CLK_DMIC_SRC_MASK, (src << NAU8824_CLK_DMIC_SRC_SFT));
@@ -809,31 +1042,44 @@ static const struct snd_soc_dapm_route nau8824_dapm_routes[] = {
 	{"HPOR", NULL, "HP Boost Driver"},
 };
 
+/* The jack detection runs on the interruption line, or on the polls of
+ * the status on a board without it.
+ */
+static bool nau8824_irq_on(struct nau8824 *nau8824)
+{
+	return nau8824->irq || nau_irq_polled(&nau8824->irq_poll);
+}
+
 static bool nau8824_is_jack_inserted(struct nau8824 *nau8824)
 {
 	struct snd_soc_jack *jack = nau8824->jack;
 	bool insert = false;
 
-	if (nau8824->irq && jack)
+	if (nau8824_irq_on(nau8824) && jack)
 		insert = jack->status & SND_JACK_HEADPHONE;
 
 	return insert;
 }
 
-static void nau8824_int_status_clear_all(struct regmap *regmap)
+/**
+ * nau8824_int_status_clear - clear the interruption status
+ * @regmap: regmap of the codec
+ * @active_irq: status bits to clear, or negative to read them first
+ *
+ * The clear register takes several status bits in one write, as the
+ * interruption handler does, so all the bits are cleared at once.
+ */
+static void nau8824_int_status_clear(struct regmap *regmap, int active_irq)
 {
-	int active_irq, clear_irq, i;
+	if (active_irq < 0 && regmap_read(regmap, NAU8824_REG_IRQ, &active_irq))
+		return;
+	if (active_irq)
+		regmap_write(regmap, NAU8824_REG_CLEAR_INT_REG, active_irq);
+}
 
-	/* Reset the intrruption status from rightmost bit if the corres-
-	 * ponding irq event occurs.
-	 */
-	regmap_read(regmap, NAU8824_REG_IRQ, &active_irq);
-	for (i = 0; i < NAU8824_REG_DATA_LEN; i++) {
-		clear_irq = (0x1 << i);
-		if (active_irq & clear_irq)
-			regmap_write(regmap,
-				NAU8824_REG_CLEAR_INT_REG, clear_irq);
-	}
+static void nau8824_int_status_clear_all(struct regmap *regmap)
+{
+	nau8824_int_status_clear(regmap, -1);
 }
 
 static void nau8824_eject_jack(struct nau8824 *nau8824)
@@ -867,6 +1113,192 @@ static void nau8824_eject_jack(struct nau8824 *nau8824)
 		nau8824_config_sysclk(nau8824, NAU8824_CLK_DIS, 0);
 }
 
+/* The detection for the jack of @gen is void once it's out or in again */
+static bool nau8824_jdet_stale(struct nau8824 *nau8824, int gen)
+{
+	return atomic_read(&nau8824->jdet_gen) != gen;
+}
+
+/**
+ * nau8824_jdet_sar_settle - wait for the SAR ADC to settle
+ * @nau8824: the codec private data
+ * @gen: the generation of the jack detected
+ *
+ * Polls the SAR ADC after MICBIAS is enabled until the data stays
+ * within the tolerance and on the same side of the headset threshold
+ * for NAU8824_JDET_STABLE_NUM samples. The MICBIAS ramp keeps the data
+ * moving, so a headset is not taken for a headphone on the way up.
+ * NAU8824_JDET_TIMEOUT_MS is a ceiling; the last sample decides the
+ * jack type if the data does not settle before it.
+ * The poll stops at once when the jack of @gen is gone.
+ *
+ * Returns the SAR ADC data to detect the jack type with, or -ECANCELED
+ * if the detection went stale.
+ */
+static int nau8824_jdet_sar_settle(struct nau8824 *nau8824, int gen)
+{
+	struct regmap *regmap = nau8824->regmap;
+	int adc_value, last = -1, stable = 0, elapsed = 0;
+
+	while (elapsed < NAU8824_JDET_TIMEOUT_MS) {
+		msleep(NAU8824_JDET_POLL_MS);
+		elapsed += NAU8824_JDET_POLL_MS;
+		if (nau8824_jdet_stale(nau8824, gen))
+			return -ECANCELED;
+
+		regmap_read(regmap, NAU8824_REG_SAR_ADC_DATA_OUT, &adc_value);
+		adc_value = adc_value & NAU8824_SAR_ADC_DATA_MASK;
+		if (last >= 0 && abs(adc_value - last) <=
+			NAU8824_JDET_SAR_TOLERANCE &&
+			(adc_value < HEADSET_SARADC_THD) ==
+			(last < HEADSET_SARADC_THD))
+			stable++;
+		else
+			stable = 1;
+		last = adc_value;
+		if (stable >= NAU8824_JDET_STABLE_NUM)
+			break;
+	}
+
+	nau8824->jdet_count++;
+	if (stable >= NAU8824_JDET_STABLE_NUM)
+		nau8824->jdet_stable_count++;
+	else
+		nau8824->jdet_timeout_count++;
+	nau8824->jdet_last_ms = elapsed;
+	dev_dbg(nau8824->dev, "SAR ADC %s after %d ms\n",
+		stable >= NAU8824_JDET_STABLE_NUM ? "settled" : "unsettled",
+		elapsed);
+
+	return adc_value;
+}
+
+/**
+ * nau8824_pm_get - wake up the codec for the register access
+ * @nau8824: the codec private data
+ *
+ * The registers are only cached while the codec is runtime suspended.
+ * The jack detection and the clock setup out of a stream read the status
+ * of the codec, so they hold it awake around their access.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8824_pm_get(struct nau8824 *nau8824)
+{
+	int ret;
+
+	ret = pm_runtime_resume_and_get(nau8824->dev);
+	if (ret < 0)
+		dev_err(nau8824->dev, "Failed to resume codec: %d\n", ret);
+
+	return ret;
+}
+
+static void nau8824_pm_put(struct nau8824 *nau8824)
+{
+	pm_runtime_mark_last_busy(nau8824->dev);
+	pm_runtime_put_autosuspend(nau8824->dev);
+}
+
+/* Keep the codec awake while DAPM has a path powered up, so the power
+ * sequence reaches the registers and not only the cache.
+ */
+static void nau8824_pm_hold(struct nau8824 *nau8824, bool hold)
+{
+	if (nau8824->pm_held == hold)
+		return;
+
+	if (hold) {
+		if (nau8824_pm_get(nau8824) < 0)
+			return;
+	} else {
+		nau8824_pm_put(nau8824);
+	}
+	nau8824->pm_held = hold;
+}
+
+/* Turn the internal VCO and the SAR off between the button samples, or
+ * back on. The jack detection goes to its sleep mode meanwhile, which
+ * needs no clock, so the ejection still comes.
+ */
+static void nau8824_duty_sleep(struct nau8824 *nau8824, bool sleep)
+{
+	struct regmap *regmap = nau8824->regmap;
+
+	if (sleep) {
+		regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
+			NAU8824_SAR_ADC_EN, 0);
+		regmap_update_bits(regmap, NAU8824_REG_ENA_CTRL,
+			NAU8824_JD_SLEEP_MODE, NAU8824_JD_SLEEP_MODE);
+		nau8824_config_sysclk(nau8824, NAU8824_CLK_DIS, 0);
+	} else {
+		nau8824_config_sysclk(nau8824, NAU8824_CLK_INTERNAL, 0);
+		regmap_update_bits(regmap, NAU8824_REG_ENA_CTRL,
+			NAU8824_JD_SLEEP_MODE, 0);
+		regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
+			NAU8824_SAR_ADC_EN, NAU8824_SAR_ADC_EN);
+	}
+	nau8824->duty.asleep = sleep;
+}
+
+static void nau8824_duty_work(struct work_struct *work)
+{
+	struct nau8824 *nau8824 =
+		container_of(work, struct nau8824, duty_work.work);
+	unsigned int active_irq = 0;
+
+	if (!READ_ONCE(nau8824->duty.run) || nau8824_pm_get(nau8824) < 0)
+		return;
+	if (nau8824->duty.asleep) {
+		nau8824_duty_sleep(nau8824, false);
+		nau8824->duty.wakeups++;
+	} else if (snd_soc_dapm_get_bias_level(nau8824->dapm) >
+		SND_SOC_BIAS_STANDBY) {
+		/* a stream came before the cycle was stopped */
+		WRITE_ONCE(nau8824->duty.run, false);
+	} else {
+		/* a button held, or in the handler yet, keeps it awake */
+		regmap_read(nau8824->regmap, NAU8824_REG_IRQ, &active_irq);
+		if (!(nau8824->jack && (nau8824->jack->status &
+			NAU_JACK_BUTTONS)) && !(active_irq &
+			(NAU8824_KEY_SHORT_PRESS_IRQ |
+			NAU8824_KEY_LONG_PRESS_IRQ | NAU8824_KEY_RELEASE_IRQ)))
+			nau8824_duty_sleep(nau8824, true);
+	}
+	nau8824_pm_put(nau8824);
+	if (READ_ONCE(nau8824->duty.run))
+		queue_delayed_work(system_power_efficient_wq,
+			&nau8824->duty_work, nau_duty_next(&nau8824->duty));
+}
+
+/* Start the duty cycle once a headset with the buttons waits idle */
+static void nau8824_duty_start(struct nau8824 *nau8824)
+{
+	if (!nau_duty_enabled(&nau8824->duty) || !nau8824->dapm)
+		return;
+	mutex_lock(&nau8824->duty_lock);
+	if (!nau8824->duty.run && nau8824_is_jack_inserted(nau8824) &&
+		snd_soc_dapm_get_pin_status(nau8824->dapm, "SAR")) {
+		WRITE_ONCE(nau8824->duty.run, true);
+		queue_delayed_work(system_power_efficient_wq,
+			&nau8824->duty_work, nau_duty_next(&nau8824->duty));
+	}
+	mutex_unlock(&nau8824->duty_lock);
+}
+
+/* Stop the duty cycle, with the VCO and the SAR left on */
+static void nau8824_duty_stop(struct nau8824 *nau8824)
+{
+	mutex_lock(&nau8824->duty_lock);
+	WRITE_ONCE(nau8824->duty.run, false);
+	cancel_delayed_work_sync(&nau8824->duty_work);
+	if (nau8824->duty.asleep && nau8824_pm_get(nau8824) >= 0) {
+		nau8824_duty_sleep(nau8824, false);
+		nau8824_pm_put(nau8824);
+	}
+	mutex_unlock(&nau8824->duty_lock);
+}
+
 static void nau8824_jdet_work(struct work_struct *work)
 {
 	struct nau8824 *nau8824 = container_of(
@@ -874,15 +1306,30 @@ static void nau8824_jdet_work(struct work_struct *work)
 	struct snd_soc_dapm_context *dapm = nau8824->dapm;
 	struct regmap *regmap = nau8824->regmap;
 	int adc_value, event = 0, event_mask = 0;
+	int gen = READ_ONCE(nau8824->jdet_work_gen);
+	ktime_t start = ktime_get();
 
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_JDET_QUEUE],
+		nau8824->jdet_queued);
+	if (nau8824_pm_get(nau8824) < 0)
+		return;
+	if (nau8824_jdet_stale(nau8824, gen))
+		goto cancel;
 	snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
 	snd_soc_dapm_force_enable_pin(dapm, "SAR");
 	snd_soc_dapm_sync(dapm);
 
-	msleep(100);
-
-	regmap_read(regmap, NAU8824_REG_SAR_ADC_DATA_OUT, &adc_value);
-	adc_value = adc_value & NAU8824_SAR_ADC_DATA_MASK;
+	adc_value = nau8824_jdet_sar_settle(nau8824, gen);
+	if (adc_value < 0)
+		goto cancel;
+	/* The jack may go while the report is on the way. The ejection waits
+	 * for it, so the removal is reported last.
+	 */
+	mutex_lock(&nau8824->jdet_lock);
+	if (nau8824_jdet_stale(nau8824, gen)) {
+		mutex_unlock(&nau8824->jdet_lock);
+		goto cancel;
+	}
 	dev_dbg(nau8824->dev, "SAR ADC data 0x%02x\n", adc_value);
 	if (adc_value < HEADSET_SARADC_THD) {
 		event |= SND_JACK_HEADPHONE;
@@ -894,17 +1341,28 @@ static void nau8824_jdet_work(struct work_struct *work)
 		event |= SND_JACK_HEADSET;
 	}
 	event_mask |= SND_JACK_HEADSET;
-	snd_soc_jack_report(nau8824->jack, event, event_mask);
+	nau_jack_report(&nau8824->jack_rpt, nau8824->jack, event,
+		event_mask);
 
 	/* Enable short key press and release interruption. */
 	regmap_update_bits(regmap, NAU8824_REG_INTERRUPT_SETTING,
 		NAU8824_IRQ_KEY_RELEASE_DIS |
 		NAU8824_IRQ_KEY_SHORT_PRESS_DIS, 0);
 
-	if (nau8824->resume_lock) {
-		nau8824_sema_release(nau8824);
-		nau8824->resume_lock = false;
-	}
+	nau8824_resume_unlock(nau8824);
+	mutex_unlock(&nau8824->jdet_lock);
+	nau8824_duty_start(nau8824);
+	goto out;
+
+cancel:
+	/* The jack of this detection is gone or inserted again */
+	snd_soc_dapm_disable_pin(dapm, "SAR");
+	snd_soc_dapm_disable_pin(dapm, "MICBIAS");
+	snd_soc_dapm_sync(dapm);
+	nau8824->jdet_cancel_count++;
+out:
+	nau8824_pm_put(nau8824);
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_JDET_RUN], start);
 }
 
 static void nau8824_setup_auto_irq(struct nau8824 *nau8824)
@@ -950,11 +1408,10 @@ static int nau8824_button_decode(int value)
 #define NAU8824_BUTTONS (SND_JACK_BTN_0 | SND_JACK_BTN_1 | \
 		SND_JACK_BTN_2 | SND_JACK_BTN_3)
 
-static irqreturn_t nau8824_interrupt(int irq, void *data)
+static irqreturn_t nau8824_handle_irq(struct nau8824 *nau8824)
 {
-	struct nau8824 *nau8824 = (struct nau8824 *)data;
 	struct regmap *regmap = nau8824->regmap;
-	int active_irq, clear_irq = 0, event = 0, event_mask = 0;
+	int active_irq, clear_irq, event = 0, event_mask = 0;
 
 	if (regmap_read(regmap, NAU8824_REG_IRQ, &active_irq)) {
 		dev_err(nau8824->dev, "failed to read irq status\n");
@@ -962,19 +1419,26 @@ static irqreturn_t nau8824_interrupt(int irq, void *data)
 	}
 	dev_dbg(nau8824->dev, "IRQ %x\n", active_irq);
 
+	/* All the pending causes are handled in one pass and cleared with
+	 * a single write. The ejection overrides the others because the
+	 * jack is gone.
+	 */
 	if (active_irq & NAU8824_JACK_EJECTION_DETECTED) {
+		/* cancel jack detection without waiting for the work, and
+		 * release semaphore held after resume
+		 */
+		mutex_lock(&nau8824->jdet_lock);
+		atomic_inc(&nau8824->jdet_gen);
+		nau8824_resume_unlock(nau8824);
+		mutex_unlock(&nau8824->jdet_lock);
+		nau8824_duty_stop(nau8824);
 		nau8824_eject_jack(nau8824);
 		event_mask |= SND_JACK_HEADSET;
 		clear_irq = NAU8824_JACK_EJECTION_DETECTED;
-		/* release semaphore held after resume,
-		 * and cancel jack detection
-		 */
-		if (nau8824->resume_lock) {
-			nau8824_sema_release(nau8824);
-			nau8824->resume_lock = false;
-		}
-		cancel_work_sync(&nau8824->jdet_work);
-	} else if (active_irq & NAU8824_KEY_SHORT_PRESS_IRQ) {
+		goto clear;
+	}
+
+	if (active_irq & NAU8824_KEY_SHORT_PRESS_IRQ) {
 		int key_status, button_pressed;
 
 		regmap_read(regmap, NAU8824_REG_CLEAR_INT_REG,
@@ -982,15 +1446,31 @@ static irqreturn_t nau8824_interrupt(int irq, void *data)
 
 		/* lower 8 bits of the register are for pressed keys */
 		button_pressed = nau8824_button_decode(key_status);
+		nau_latency_add(&nau8824->latency[
+			NAU8824_LAT_KEY_LOW_POWER + nau8824->sar_applied],
+			nau8824->irq_time);
 
 		event |= button_pressed;
 		dev_dbg(nau8824->dev, "button %x pressed\n", event);
 		event_mask |= NAU8824_BUTTONS;
-		clear_irq = NAU8824_KEY_SHORT_PRESS_IRQ;
-	} else if (active_irq & NAU8824_KEY_RELEASE_IRQ) {
-		event_mask = NAU8824_BUTTONS;
-		clear_irq = NAU8824_KEY_RELEASE_IRQ;
-	} else if (active_irq & NAU8824_JACK_INSERTION_DETECTED) {
+	}
+
+	if (active_irq & NAU8824_KEY_RELEASE_IRQ) {
+		/* The press and the release of a short click come in the
+		 * same pass. Report the press before the release clears it.
+		 */
+		if (event & NAU8824_BUTTONS) {
+			nau_jack_report(&nau8824->jack_rpt, nau8824->jack, event,
+				event_mask);
+			event &= ~NAU8824_BUTTONS;
+		}
+		event_mask |= NAU8824_BUTTONS;
+	}
+
+	/* The insertion is only taken when no button is pending */
+	if (!(active_irq & (NAU8824_KEY_SHORT_PRESS_IRQ |
+		NAU8824_KEY_RELEASE_IRQ)) &&
+		(active_irq & NAU8824_JACK_INSERTION_DETECTED)) {
 		/* Turn off insertion interruption at manual mode */
 		regmap_update_bits(regmap,
 			NAU8824_REG_INTERRUPT_SETTING,
@@ -999,9 +1479,13 @@ static irqreturn_t nau8824_interrupt(int irq, void *data)
 		regmap_update_bits(regmap,
 			NAU8824_REG_INTERRUPT_SETTING_1,
 			NAU8824_IRQ_INSERT_EN, 0);
-		/* detect microphone and jack type */
-		cancel_work_sync(&nau8824->jdet_work);
-		schedule_work(&nau8824->jdet_work);
+		/* detect microphone and jack type; a detection still
+		 * running for the last insertion goes stale and bails out
+		 */
+		WRITE_ONCE(nau8824->jdet_work_gen,
+			   atomic_inc_return(&nau8824->jdet_gen));
+		nau8824->jdet_queued = ktime_get();
+		queue_work(nau8824->jdet_wq, &nau8824->jdet_work);
 
 		/* Enable interruption for jack type detection at audo
 		 * mode which can detect microphone and jack type.
@@ -1009,17 +1493,49 @@ static irqreturn_t nau8824_interrupt(int irq, void *data)
 		nau8824_setup_auto_irq(nau8824);
 	}
 
-	if (!clear_irq)
-		clear_irq = active_irq;
-	/* clears the rightmost interruption */
-	regmap_write(regmap, NAU8824_REG_CLEAR_INT_REG, clear_irq);
+	/* clears all the interruptions handled above at once */
+	clear_irq = active_irq;
+clear:
+	nau8824_int_status_clear(regmap, clear_irq);
 
 	if (event_mask)
-		snd_soc_jack_report(nau8824->jack, event, event_mask);
+		nau_jack_report(&nau8824->jack_rpt, nau8824->jack, event,
+			event_mask);
 
 	return IRQ_HANDLED;
 }
 
+/* Stamp the interruption, for the response time of the buttons */
+static irqreturn_t nau8824_hardirq(int irq, void *data)
+{
+	struct nau8824 *nau8824 = (struct nau8824 *)data;
+
+	nau8824->irq_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t nau8824_interrupt(int irq, void *data)
+{
+	struct nau8824 *nau8824 = (struct nau8824 *)data;
+	irqreturn_t ret;
+	int passes = 0;
+
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_IRQ_THREAD],
+		nau8824->irq_time);
+	nau_irq_thread_prio(&nau8824->irq_cfg);
+	/* The jack events wake up the codec runtime suspended */
+	if (nau8824_pm_get(nau8824) < 0)
+		return IRQ_NONE;
+	do {
+		ret = nau8824_handle_irq(nau8824);
+	} while (ret == IRQ_HANDLED && nau_irq_edge_again(&nau8824->irq_cfg,
+		nau8824->regmap, NAU8824_REG_IRQ, 0xff, &passes));
+	nau8824_pm_put(nau8824);
+
+	return ret;
+}
+
 static const struct nau8824_osr_attr *
 nau8824_get_osr(struct nau8824 *nau8824, int stream)
 {
@@ -1042,20 +1558,133 @@ nau8824_get_osr(struct nau8824 *nau8824, int stream)
 	}
 }
 
+/* The OSR taken by a policy instead of the controls. The filters of the
+ * converters keep their group delay short and their noise low with a high
+ * OSR, so both the low latency and the quality take the highest OSR within
+ * CLK_DA_AD_MAX at the rate, and the low power the lowest. The OSR applied
+ * reads back from the OSR controls.
+ */
+static int nau8824_osr_pick(const struct nau8824_osr_attr *sel, int num,
+	unsigned int rate, int policy)
+{
+	int i, pick = -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (!sel[i].osr || rate * sel[i].osr > CLK_DA_AD_MAX)
+			continue;
+		if (pick < 0 || (policy == NAU8824_OSR_LOW_POWER ?
+			sel[i].osr < sel[pick].osr : sel[i].osr > sel[pick].osr))
+			pick = i;
+	}
+
+	return pick;
+}
+
+static const struct nau8824_osr_attr *
+nau8824_osr_select(struct nau8824 *nau8824, int stream, unsigned int rate,
+	int policy)
+{
+	const struct nau8824_osr_attr *sel;
+	int num, i;
+
+	if (policy == NAU8824_OSR_MANUAL)
+		return nau8824_get_osr(nau8824, stream);
+
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		sel = osr_dac_sel;
+		num = ARRAY_SIZE(osr_dac_sel);
+	} else {
+		sel = osr_adc_sel;
+		num = ARRAY_SIZE(osr_adc_sel);
+	}
+	i = nau8824_osr_pick(sel, num, rate, policy);
+
+	return i < 0 ? NULL : &sel[i];
+}
+
+/* Program the OSR selected; the index is the register value, so the
+ * manual selection is written back unchanged.
+ */
+static void nau8824_osr_apply(struct nau8824 *nau8824, int stream,
+	const struct nau8824_osr_attr *osr)
+{
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK)
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_DAC_FILTER_CTRL_1,
+			NAU8824_DAC_OVERSAMPLE_MASK, osr - osr_dac_sel);
+	else
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_ADC_FILTER_CTRL,
+			NAU8824_ADC_SYNC_DOWN_MASK, osr - osr_adc_sel);
+}
+
 static int nau8824_dai_startup(struct snd_pcm_substream *substream,
 			       struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
 	const struct nau8824_osr_attr *osr;
+	int ret;
 
-	osr = nau8824_get_osr(nau8824, substream->stream);
+	/* a policy may take any OSR within the limit at the rate */
+	osr = nau8824_osr_select(nau8824, substream->stream, 0,
+		nau8824->osr_policy == NAU8824_OSR_MANUAL ?
+		NAU8824_OSR_MANUAL : NAU8824_OSR_LOW_POWER);
 	if (!osr || !osr->osr)
 		return -EINVAL;
 
-	return snd_pcm_hw_constraint_minmax(substream->runtime,
-					    SNDRV_PCM_HW_PARAM_RATE,
-					    0, CLK_DA_AD_MAX / osr->osr);
+	ret = snd_pcm_hw_constraint_minmax(substream->runtime,
+					   SNDRV_PCM_HW_PARAM_RATE,
+					   0, CLK_DA_AD_MAX / osr->osr);
+	if (ret)
+		return ret;
+	nau8824_duty_stop(nau8824);
+
+	/* The capture is taken as a call, with the buttons responding fast */
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		!nau8824->capture_active++ && nau8824->sar_threshold_num)
+		nau8824_sar_profile_apply(nau8824);
+
+	return 0;
+}
+
+static void nau8824_dai_shutdown(struct snd_pcm_substream *substream,
+				 struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		!--nau8824->capture_active && nau8824->sar_threshold_num)
+		nau8824_sar_profile_apply(nau8824);
+}
+
+/* ADC CH0..CH3 of a capture go out over TDM in one frame, so that the
+ * samples of all the microphones come in matched. Without set_tdm_slot,
+ * TDM is turned on from slot 0 for a capture of more than 2 channels.
+ * CH2 and CH3 only take DMIC3 and DMIC4.
+ */
+static int nau8824_tdm_tx_apply(struct nau8824 *nau8824,
+	unsigned int channels)
+{
+	if (nau8824->tdm_tx && !nau8824->tdm_auto)
+		return hweight8(nau8824->tdm_tx) == channels ? 0 : -EINVAL;
+
+	if (channels > 2) {
+		nau8824->tdm_tx = GENMASK(channels - 1, 0);
+		nau8824->tdm_auto = true;
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_TDM_CTRL,
+			NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN |
+			NAU8824_TDM_TX_MASK, NAU8824_TDM_MODE |
+			NAU8824_TDM_OFFSET_EN | nau8824->tdm_tx);
+		regmap_update_bits(nau8824->regmap,
+			NAU8824_REG_PORT0_LEFT_TIME_SLOT, NAU8824_TSLOT_L_MASK, 0);
+	} else if (nau8824->tdm_auto) {
+		nau8824->tdm_tx = 0;
+		nau8824->tdm_auto = false;
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_TDM_CTRL,
+			NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN, 0);
+	}
+
+	return 0;
 }
 
 static int nau8824_hw_params(struct snd_pcm_substream *substream,
@@ -1065,9 +1694,25 @@ static int nau8824_hw_params(struct snd_pcm_substream *substream,
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0, ctrl_val, bclk_fs, bclk_div;
 	const struct nau8824_osr_attr *osr;
+	ktime_t start = ktime_get();
 	int err = -EINVAL;
 
+	/* ahead of the semaphore, which the sysclk setup takes itself */
+	if (nau8824->clk_plan.enable) {
+		err = nau8824_clk_plan_run(nau8824, params, dai);
+		if (err)
+			return err;
+		err = -EINVAL;
+	}
+
 	nau8824_sema_acquire(nau8824, HZ);
+	/* the manual OSR is a control that may change at any time */
+	if (nau8824->osr_policy != NAU8824_OSR_MANUAL &&
+		nau_hw_params_skip(&nau8824->hw_params_cache, substream->stream,
+		params)) {
+		err = 0;
+		goto error;
+	}
 
 	/* CLK_DAC or CLK_ADC = OSR * FS
 	 * DAC or ADC clock frequency is defined as Over Sampling Rate (OSR)
@@ -1076,11 +1721,17 @@ static int nau8824_hw_params(struct snd_pcm_substream *substream,
 	 * than 6.144 MHz.
 	 */
 	nau8824->fs = params_rate(params);
-	osr = nau8824_get_osr(nau8824, substream->stream);
+	osr = nau8824_osr_select(nau8824, substream->stream, params_rate(params),
+		nau8824->osr_policy);
 	if (!osr || !osr->osr)
 		goto error;
 	if (nau8824->fs * osr->osr > CLK_DA_AD_MAX)
 		goto error;
+	nau8824_osr_apply(nau8824, substream->stream, osr);
+	nau_delay_set(&nau8824->delay, substream->stream,
+		nau_delay_filter_frames(substream->stream ==
+		SNDRV_PCM_STREAM_PLAYBACK ? &nau8824_dac_filter :
+		&nau8824_adc_filter, osr->osr));
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
 		regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
 			NAU8824_CLK_DAC_SRC_MASK,
@@ -1089,13 +1740,17 @@ static int nau8824_hw_params(struct snd_pcm_substream *substream,
 		regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
 			NAU8824_CLK_ADC_SRC_MASK,
 			osr->clk_src << NAU8824_CLK_ADC_SRC_SFT);
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		nau8824_tdm_tx_apply(nau8824, params_channels(params)))
+		goto error;
 
 	/* make BCLK and LRC divde configuration if the codec as master. */
 	regmap_read(nau8824->regmap,
 		NAU8824_REG_PORT0_I2S_PCM_CTRL_2, &ctrl_val);
 	if (ctrl_val & NAU8824_I2S_MS_MASTER) {
-		/* get the bclk and fs ratio */
-		bclk_fs = snd_soc_params_to_bclk(params) / nau8824->fs;
+		/* get the bclk and fs ratio, of all the slots in TDM */
+		bclk_fs = snd_soc_tdm_params_to_bclk(params, nau8824->tdm_width,
+			nau8824->tdm_slots, 1) / nau8824->fs;
 		if (bclk_fs <= 32)
 			bclk_div = 0x3;
 		else if (bclk_fs <= 64)
@@ -1131,10 +1786,13 @@ static int nau8824_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_PORT0_I2S_PCM_CTRL_1,
 		NAU8824_I2S_DL_MASK, val_len);
+	nau_hw_params_done(&nau8824->hw_params_cache, substream->stream,
+		params);
 	err = 0;
 
  error:
 	nau8824_sema_release(nau8824);
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_HW_PARAMS], start);
 
 	return err;
 }
@@ -1188,6 +1846,7 @@ static int nau8824_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 
 	nau8824_sema_acquire(nau8824, HZ);
 
+	nau_hw_params_reset(&nau8824->hw_params_cache);
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_PORT0_I2S_PCM_CTRL_1,
 		NAU8824_I2S_DF_MASK | NAU8824_I2S_BP_MASK |
 		NAU8824_I2S_PCMB_EN, ctrl1_val);
@@ -1202,43 +1861,55 @@ static int nau8824_set_fmt(struct snd_soc_dai *dai, unsigned int fmt)
 /**
  * nau8824_set_tdm_slot - configure DAI TDM.
  * @dai: DAI
- * @tx_mask: Bitmask representing active TX slots. Ex.
+ * @tx_mask: Bitmask representing active TX slots. ADC CH0..CH3 go out
+ *           in the 4 slots of a window; the window is picked by the
+ *           lowest slot in use. Ex.
  *                 0xf for normal 4 channel TDM.
- *                 0xf0 for shifted 4 channel TDM
+ *                 0xf0 for shifted 4 channel TDM.
+ *                 0x30 for ADC CH0/CH1 in slots 4 and 5.
  * @rx_mask: Bitmask [0:1] representing active DACR RX slots.
  *                 Bitmask [2:3] representing active DACL RX slots.
  *                 00=CH0,01=CH1,10=CH2,11=CH3. Ex.
  *                 0xf for DACL/R selecting TDM CH3.
  *                 0xf0 for DACL/R selecting shifted TDM CH3.
- * @slots: Number of slots in use.
+ * @slots: Number of slots in use, up to 16; 0 turns TDM off.
  * @slot_width: Width in bits for each slot.
  *
- * Configures a DAI for TDM operation. Only support 4 slots TDM.
+ * Configures a DAI for TDM operation. The TX and RX masks shall be in the
+ * same window of 4 slots.
  */
 static int nau8824_set_tdm_slot(struct snd_soc_dai *dai,
 	unsigned int tx_mask, unsigned int rx_mask, int slots, int slot_width)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
-	unsigned int tslot_l = 0, ctrl_val = 0;
+	unsigned int tslot_l, ctrl_val, mask = tx_mask | rx_mask, base;
+
+	nau_hw_params_reset(&nau8824->hw_params_cache);
+	if (!slots) {
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_TDM_CTRL,
+			NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN, 0);
+		nau8824->tdm_tx = 0;
+		nau8824->tdm_slots = 0;
+		nau8824->tdm_width = 0;
+		nau8824->tdm_auto = false;
+		return 0;
+	}
 
-	if (slots > 4 || ((tx_mask & 0xf0) && (tx_mask & 0xf)) ||
-		((rx_mask & 0xf0) && (rx_mask & 0xf)) ||
-		((rx_mask & 0xf0) && (tx_mask & 0xf)) ||
-		((rx_mask & 0xf) && (tx_mask & 0xf0)))
+	if (slots > NAU8824_TDM_SLOTS || slot_width <= 0 || slot_width > 32 ||
+		!mask || (mask >> slots))
+		return -EINVAL;
+	base = round_down(__ffs(mask), NAU8824_TDM_WINDOW);
+	if (mask >> base >> NAU8824_TDM_WINDOW)
+		return -EINVAL;
+	tslot_l = base * slot_width;
+	if (tslot_l > NAU8824_TSLOT_L_MASK)
 		return -EINVAL;
 
-	ctrl_val |= (NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN);
-	if (tx_mask & 0xf0) {
-		tslot_l = 4 * slot_width;
-		ctrl_val |= (tx_mask >> 4);
-	} else {
-		ctrl_val |= tx_mask;
-	}
-	if (rx_mask & 0xf0)
-		ctrl_val |= ((rx_mask >> 4) << NAU8824_TDM_DACR_RX_SFT);
-	else
-		ctrl_val |= (rx_mask << NAU8824_TDM_DACR_RX_SFT);
+	ctrl_val = NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN;
+	ctrl_val |= (tx_mask >> base) & NAU8824_TDM_TX_MASK;
+	ctrl_val |= ((rx_mask >> base) << NAU8824_TDM_DACR_RX_SFT) &
+		(NAU8824_TDM_DACL_RX_MASK | NAU8824_TDM_DACR_RX_MASK);
 
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_TDM_CTRL,
 		NAU8824_TDM_MODE | NAU8824_TDM_OFFSET_EN |
@@ -1246,78 +1917,16 @@ static int nau8824_set_tdm_slot(struct snd_soc_dai *dai,
 		NAU8824_TDM_TX_MASK, ctrl_val);
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_PORT0_LEFT_TIME_SLOT,
 		NAU8824_TSLOT_L_MASK, tslot_l);
+	nau8824->tdm_tx = (tx_mask >> base) & NAU8824_TDM_TX_MASK;
+	nau8824->tdm_slots = slots;
+	nau8824->tdm_width = slot_width;
+	nau8824->tdm_auto = false;
 
 	return 0;
 }
 
-/**
- * nau8824_calc_fll_param - Calculate FLL parameters.
- * @fll_in: external clock provided to codec.
- * @fs: sampling rate.
- * @fll_param: Pointer to structure of FLL parameters.
- *
- * Calculate FLL parameters to configure codec.
- *
- * Returns 0 for success or negative error code.
- */
-static int nau8824_calc_fll_param(unsigned int fll_in,
-	unsigned int fs, struct nau8824_fll *fll_param)
-{
-	u64 fvco, fvco_max;
-	unsigned int fref, i, fvco_sel;
-
-	/* Ensure the reference clock frequency (FREF) is <= 13.5MHz by dividing
-	 * freq_in by 1, 2, 4, or 8 using FLL pre-scalar.
-	 * FREF = freq_in / NAU8824_FLL_REF_DIV_MASK
-	 */
-	for (i = 0; i < ARRAY_SIZE(fll_pre_scalar); i++) {
-		fref = fll_in / fll_pre_scalar[i].param;
-		if (fref <= NAU_FREF_MAX)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_pre_scalar))
-		return -EINVAL;
-	fll_param->clk_ref_div = fll_pre_scalar[i].val;
-
-	/* Choose the FLL ratio based on FREF */
-	for (i = 0; i < ARRAY_SIZE(fll_ratio); i++) {
-		if (fref >= fll_ratio[i].param)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_ratio))
-		return -EINVAL;
-	fll_param->ratio = fll_ratio[i].val;
-
-	/* Calculate the frequency of DCO (FDCO) given freq_out = 256 * Fs.
-	 * FDCO must be within the 90MHz - 124MHz or the FFL cannot be
-	 * guaranteed across the full range of operation.
-	 * FDCO = freq_out * 2 * mclk_src_scaling
-	 */
-	fvco_max = 0;
-	fvco_sel = ARRAY_SIZE(mclk_src_scaling);
-	for (i = 0; i < ARRAY_SIZE(mclk_src_scaling); i++) {
-		fvco = 256ULL * fs * 2 * mclk_src_scaling[i].param;
-		if (fvco > NAU_FVCO_MIN && fvco < NAU_FVCO_MAX &&
-			fvco_max < fvco) {
-			fvco_max = fvco;
-			fvco_sel = i;
-		}
-	}
-	if (ARRAY_SIZE(mclk_src_scaling) == fvco_sel)
-		return -EINVAL;
-	fll_param->mclk_src = mclk_src_scaling[fvco_sel].val;
-
-	/* Calculate the FLL 10-bit integer input and the FLL 16-bit fractional
-	 * input based on FDCO, FREF and FLL ratio.
-	 */
-	fvco = div_u64(fvco_max << 16, fref * fll_param->ratio);
-	fll_param->fll_int = (fvco >> 16) & 0x3FF;
-	fll_param->fll_frac = fvco & 0xFFFF;
-	return 0;
-}
-
 static void nau8824_fll_apply(struct regmap *regmap,
-	struct nau8824_fll *fll_param)
+	struct nau_fll *fll_param)
 {
 	regmap_update_bits(regmap, NAU8824_REG_CLK_DIVIDER,
 		NAU8824_CLK_SRC_MASK | NAU8824_CLK_MCLK_SRC_MASK,
@@ -1361,11 +1970,12 @@ static int nau8824_set_pll(struct snd_soc_component *component, int pll_id, int
 		unsigned int freq_in, unsigned int freq_out)
 {
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
-	struct nau8824_fll fll_param;
+	struct nau_fll fll_param;
 	int ret, fs;
 
 	fs = freq_out / 256;
-	ret = nau8824_calc_fll_param(freq_in, fs, &fll_param);
+	ret = nau_fll_solve(&nau8824_fll_desc, &nau8824->fll_cache, freq_in, fs,
+			    16, &fll_param);
 	if (ret < 0) {
 		dev_err(nau8824->dev, "Unsupported input clock %d\n", freq_in);
 		return ret;
@@ -1374,10 +1984,16 @@ static int nau8824_set_pll(struct snd_soc_component *component, int pll_id, int
 		fll_param.mclk_src, fll_param.ratio, fll_param.fll_frac,
 		fll_param.fll_int, fll_param.clk_ref_div);
 
+	ret = nau8824_pm_get(nau8824);
+	if (ret < 0)
+		return ret;
+	nau8824->clk_plan.enable = false;
+	nau_clk_plan_reset(&nau8824->clk_plan);
 	nau8824_fll_apply(nau8824->regmap, &fll_param);
-	mdelay(2);
+	nau_fll_wait_lock();
 	regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
 		NAU8824_CLK_SRC_MASK, NAU8824_CLK_SRC_VCO);
+	nau8824_pm_put(nau8824);
 
 	return 0;
 }
@@ -1387,6 +2003,7 @@ static int nau8824_config_sysclk(struct nau8824 *nau8824,
 {
 	struct regmap *regmap = nau8824->regmap;
 
+	nau_clk_plan_reset(&nau8824->clk_plan);
 	switch (clk_id) {
 	case NAU8824_CLK_DIS:
 		regmap_update_bits(regmap, NAU8824_REG_CLK_DIVIDER,
@@ -1447,14 +2064,98 @@ static int nau8824_set_sysclk(struct snd_soc_component *component,
 	int clk_id, int source, unsigned int freq, int dir)
 {
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	nau8824->clk_plan.enable = clk_id == NAU8824_CLK_AUTO;
+	if (nau8824->clk_plan.enable) {
+		nau8824->clk_plan.mclk = freq;
+		nau_clk_plan_reset(&nau8824->clk_plan);
+		return 0;
+	}
+
+	/* The machine drivers set the clock at card probe too */
+	ret = nau8824_pm_get(nau8824);
+	if (ret < 0)
+		return ret;
+	ret = nau8824_config_sysclk(nau8824, clk_id, freq);
+	nau8824_pm_put(nau8824);
+
+	return ret;
+}
+
+/**
+ * nau8824_clk_plan_run - plan the sysclk of a stream at hw_params
+ * @nau8824: component to register the codec private data with
+ * @params: parameters of the stream
+ * @dai: the DAI of the stream
+ *
+ * The planner picks MCLK straight, the FLL from MCLK or the FLL from BCLK,
+ * the first that makes 256 * Fs. The BCLK counts all the TDM slots. The
+ * sysclk is shared by the directions, so a plan of another rate is refused
+ * while the other one streams.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8824_clk_plan_run(struct nau8824 *nau8824,
+	struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
+{
+	struct nau_clk_planner *planner = &nau8824->clk_plan;
+	unsigned int ctrl_val, bclk = 0;
+	struct nau_clk_plan plan;
+	int ret;
+
+	regmap_read(nau8824->regmap,
+		NAU8824_REG_PORT0_I2S_PCM_CTRL_2, &ctrl_val);
+	if (!(ctrl_val & NAU8824_I2S_MS_MASTER))
+		bclk = snd_soc_tdm_params_to_bclk(params, nau8824->tdm_width,
+			nau8824->tdm_slots, 1);
+	ret = nau_clk_plan_pick(&nau8824_fll_desc, &nau8824->fll_cache, 16,
+		planner->mclk, bclk, params_rate(params), &plan);
+	if (ret) {
+		dev_err(nau8824->dev, "No sysclk for %dHz from MCLK %uHz\n",
+			params_rate(params), planner->mclk);
+		return ret;
+	}
+	if (nau_clk_plan_applied(planner, &plan))
+		return 0;
+	if (planner->applied.src != NAU_CLK_PLAN_NONE &&
+		snd_soc_dai_active(dai) > 1) {
+		dev_err(nau8824->dev, "Sysclk held by the other stream\n");
+		return -EBUSY;
+	}
 
-	return nau8824_config_sysclk(nau8824, clk_id, freq);
+	ret = nau8824_pm_get(nau8824);
+	if (ret < 0)
+		return ret;
+	switch (plan.src) {
+	case NAU_CLK_PLAN_MCLK:
+		nau8824_config_sysclk(nau8824, NAU8824_CLK_MCLK, plan.freq_in);
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
+			NAU8824_CLK_MCLK_SRC_MASK, plan.mclk_div);
+		break;
+	case NAU_CLK_PLAN_FLL_MCLK:
+	case NAU_CLK_PLAN_FLL_BLK:
+		nau8824_config_sysclk(nau8824,
+			plan.src == NAU_CLK_PLAN_FLL_MCLK ?
+			NAU8824_CLK_FLL_MCLK : NAU8824_CLK_FLL_BLK, plan.freq_in);
+		nau8824_fll_apply(nau8824->regmap, &plan.fll);
+		nau_fll_wait_lock();
+		regmap_update_bits(nau8824->regmap, NAU8824_REG_CLK_DIVIDER,
+			NAU8824_CLK_SRC_MASK, NAU8824_CLK_SRC_VCO);
+		break;
+	}
+	nau_clk_plan_done(planner, &plan);
+	nau8824_pm_put(nau8824);
+	dev_dbg(nau8824->dev, "Sysclk planned from source %u at %uHz\n",
+		plan.src, plan.freq_in);
+
+	return 0;
 }
 
 static void nau8824_resume_setup(struct nau8824 *nau8824)
 {
 	nau8824_config_sysclk(nau8824, NAU8824_CLK_DIS, 0);
-	if (nau8824->irq) {
+	if (nau8824_irq_on(nau8824)) {
 		/* Clear all interruption status */
 		nau8824_int_status_clear_all(nau8824->regmap);
 		/* Enable jack detection at sleep mode, insertion detection,
@@ -1470,28 +2171,47 @@ static void nau8824_resume_setup(struct nau8824 *nau8824)
 			NAU8824_REG_INTERRUPT_SETTING,
 			NAU8824_IRQ_EJECT_DIS | NAU8824_IRQ_INSERT_DIS, 0);
 	}
+	/* The clock is settled and the detection armed, so the playback
+	 * goes on while the jack detection runs on the internal clock.
+	 */
+	nau8824_resume_unlock(nau8824);
 }
 
 static int nau8824_set_bias_level(struct snd_soc_component *component,
 	enum snd_soc_bias_level level)
 {
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	/* the widgets of the component driver come after its probe */
+	nau_dapm_stat_attach(&nau8824->dapm_stat, component);
+	nau_dapm_stat_bias(&nau8824->dapm_stat, level);
 
 	switch (level) {
 	case SND_SOC_BIAS_ON:
 		break;
 
 	case SND_SOC_BIAS_PREPARE:
+		nau8824_pm_hold(nau8824, true);
 		break;
 
 	case SND_SOC_BIAS_STANDBY:
+		nau8824_pm_hold(nau8824, false);
+		if (snd_soc_component_get_bias_level(component) ==
+			SND_SOC_BIAS_PREPARE)
+			nau8824_duty_start(nau8824);
 		if (snd_soc_component_get_bias_level(component) == SND_SOC_BIAS_OFF) {
 			/* Setup codec configuration after resume */
+			ret = nau8824_pm_get(nau8824);
+			if (ret < 0)
+				return ret;
 			nau8824_resume_setup(nau8824);
+			nau8824_pm_put(nau8824);
 		}
 		break;
 
 	case SND_SOC_BIAS_OFF:
+		nau8824_pm_hold(nau8824, false);
 		regmap_update_bits(nau8824->regmap,
 			NAU8824_REG_INTERRUPT_SETTING, 0x3ff, 0x3ff);
 		regmap_update_bits(nau8824->regmap,
@@ -1503,22 +2223,112 @@ static int nau8824_set_bias_level(struct snd_soc_component *component,
 	return 0;
 }
 
+static const struct regmap_config nau8824_regmap_config;
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const nau8824_latency_names[NAU8824_LAT_NUM] = {
+	[NAU8824_LAT_HW_PARAMS] = "hw_params",
+	[NAU8824_LAT_SEMA_WAIT] = "sema_wait",
+	[NAU8824_LAT_PUMP] = "pump_ramp",
+	[NAU8824_LAT_KEY_LOW_POWER] = "key_low_power",
+	[NAU8824_LAT_KEY_FAST] = "key_fast",
+	[NAU8824_LAT_JDET_QUEUE] = "jdet_queue",
+	[NAU8824_LAT_JDET_RUN] = "jdet_run",
+	[NAU8824_LAT_IRQ_THREAD] = "irq_thread",
+	[NAU8824_LAT_OUTPUT_SWITCH] = "output_switch",
+};
+
+/* The statistics of the jack type detection under the debugfs of the
+ * component, which show how soon the SAR ADC settles, and the ones of
+ * the register sync of resume and of the stream start.
+ */
+static void nau8824_debugfs_init(struct snd_soc_component *component)
+{
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	struct dentry *dir;
+
+	if (!component->debugfs_root)
+		return;
+
+	dir = debugfs_create_dir("jdet", component->debugfs_root);
+	debugfs_create_u32("count", 0444, dir, &nau8824->jdet_count);
+	debugfs_create_u32("stable", 0444, dir, &nau8824->jdet_stable_count);
+	debugfs_create_u32("timeout", 0444, dir,
+		&nau8824->jdet_timeout_count);
+	debugfs_create_u32("last_ms", 0444, dir, &nau8824->jdet_last_ms);
+	debugfs_create_u32("cancelled", 0444, dir,
+		&nau8824->jdet_cancel_count);
+	nau_irq_poll_debugfs_init(dir, &nau8824->irq_poll);
+	debugfs_create_u32("sema_timeouts", 0444, dir,
+		&nau8824->sema_timeouts);
+	debugfs_create_u32("sema_fails", 0444, dir, &nau8824->sema_fails);
+	nau_regcache_debugfs_init(component->debugfs_root, "resume",
+		&nau8824->resume_sync);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8824->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+		&nau8824->regcache_report, nau8824->regmap,
+		&nau8824_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8824->latency,
+		nau8824_latency_names, NAU8824_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8824->hw_params_cache);
+	nau_clk_plan_debugfs_init(component->debugfs_root,
+		&nau8824->clk_plan);
+	nau_jack_report_debugfs_init(component->debugfs_root,
+		&nau8824->jack_rpt);
+	nau_delay_debugfs_init(component->debugfs_root, &nau8824->delay);
+	nau_duty_debugfs_init(component->debugfs_root, &nau8824->duty);
+	nau_dapm_stat_debugfs_init(component->debugfs_root,
+		&nau8824->dapm_stat);
+}
+#else
+static inline void nau8824_debugfs_init(struct snd_soc_component *component)
+{
+}
+#endif
+
+/* The widgets of the power accounting, which keep the most current */
+static const char * const nau8824_dapm_stat_names[] = {
+	"System Clock", "SAR", "MICBIAS", "DMIC Clock", "Charge Pump",
+	"ClassD", "HP Boost Driver", "Class G",
+};
+
 static int nau8824_component_probe(struct snd_soc_component *component)
 {
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
 	struct snd_soc_dapm_context *dapm = snd_soc_component_get_dapm(component);
 
 	nau8824->dapm = dapm;
+	nau_dapm_stat_init(&nau8824->dapm_stat, nau8824_dapm_stat_names,
+		ARRAY_SIZE(nau8824_dapm_stat_names));
+	nau8824_debugfs_init(component);
+	nau_pm_card_link(component);
 
 	return 0;
 }
 
+static void nau8824_component_remove(struct snd_soc_component *component)
+{
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+
+	nau_irq_poll_disable(&nau8824->irq_poll);
+	nau_jack_report_cancel(&nau8824->jack_rpt);
+	nau8824_duty_stop(nau8824);
+	nau_pm_card_unlink(component);
+}
+
 static int __maybe_unused nau8824_suspend(struct snd_soc_component *component)
 {
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
 
-	if (nau8824->irq) {
+	nau_hw_params_reset(&nau8824->hw_params_cache);
+	if (nau8824->irq)
 		disable_irq(nau8824->irq);
+	else
+		nau_irq_poll_disable(&nau8824->irq_poll);
+	if (nau8824_irq_on(nau8824)) {
+		nau_jack_report_flush(&nau8824->jack_rpt);
+		nau8824_duty_stop(nau8824);
 		snd_soc_component_force_bias_level(component, SND_SOC_BIAS_OFF);
 	}
 	regcache_cache_only(nau8824->regmap, true);
@@ -1532,24 +2342,51 @@ static int __maybe_unused nau8824_resume(struct snd_soc_component *component)
 	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
 	int ret;
 
+	nau_regcache_scan(nau8824->regmap, &nau8824_regmap_config,
+		&nau8824->resume_sync);
 	regcache_cache_only(nau8824->regmap, false);
-	regcache_sync(nau8824->regmap);
-	if (nau8824->irq) {
+	nau_regcache_sync(nau8824->regmap, &nau8824_regmap_config,
+		&nau8824->resume_sync);
+	if (nau8824_irq_on(nau8824)) {
 		/* Hold semaphore to postpone playback happening
-		 * until jack detection done.
+		 * until the clock is set up again after resume.
 		 */
-		nau8824->resume_lock = true;
 		ret = nau8824_sema_acquire(nau8824, 0);
-		if (ret)
-			nau8824->resume_lock = false;
-		enable_irq(nau8824->irq);
+		if (!ret)
+			WRITE_ONCE(nau8824->resume_lock, true);
 	}
+	if (nau8824->irq)
+		enable_irq(nau8824->irq);
+	else
+		nau_irq_poll_enable(&nau8824->irq_poll);
+
+	return 0;
+}
+
+static int __maybe_unused nau8824_runtime_suspend(struct device *dev)
+{
+	struct nau8824 *nau8824 = dev_get_drvdata(dev);
+
+	/* The codec keeps its power and the jack detection; only the bus
+	 * is left idle until a stream, a DAPM path or an interruption.
+	 */
+	regcache_cache_only(nau8824->regmap, true);
 
 	return 0;
 }
 
+static int __maybe_unused nau8824_runtime_resume(struct device *dev)
+{
+	struct nau8824 *nau8824 = dev_get_drvdata(dev);
+
+	regcache_cache_only(nau8824->regmap, false);
+	/* Writes only the registers changed while suspended, if any */
+	return regcache_sync(nau8824->regmap);
+}
+
 static const struct snd_soc_component_driver nau8824_component_driver = {
 	.probe			= nau8824_component_probe,
+	.remove			= nau8824_component_remove,
 	.set_sysclk		= nau8824_set_sysclk,
 	.set_pll		= nau8824_set_pll,
 	.set_bias_level		= nau8824_set_bias_level,
@@ -1568,11 +2405,47 @@ static const struct snd_soc_component_driver nau8824_component_driver = {
 	.non_legacy_dai_naming	= 1,
 };
 
+/* The headphone plays once the charge pump is done with its ramp */
+static int nau8824_mute_stream(struct snd_soc_dai *dai, int mute,
+	int direction)
+{
+	struct snd_soc_component *component = dai->component;
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	ktime_t start = ktime_get();
+
+	if (mute || direction != SNDRV_PCM_STREAM_PLAYBACK)
+		return 0;
+
+	mutex_lock(&nau8824->dapm->card->dapm_mutex);
+	if (nau_settle_wait(&nau8824->pump_settle)) {
+		regmap_update_bits(nau8824->regmap,
+			NAU8824_REG_CHARGE_PUMP_CONTROL,
+			NAU8824_JAMNODCLOW, NAU8824_JAMNODCLOW);
+		nau_latency_add(&nau8824->latency[NAU8824_LAT_PUMP], start);
+	}
+	mutex_unlock(&nau8824->dapm->card->dapm_mutex);
+
+	return 0;
+}
+
+/* The frames the filters hold at the OSR of the stream */
+static snd_pcm_sframes_t nau8824_dai_delay(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(dai->component);
+
+	return nau_delay_get(&nau8824->delay, substream->stream);
+}
+
 static const struct snd_soc_dai_ops nau8824_dai_ops = {
 	.startup = nau8824_dai_startup,
+	.shutdown = nau8824_dai_shutdown,
 	.hw_params = nau8824_hw_params,
 	.set_fmt = nau8824_set_fmt,
 	.set_tdm_slot = nau8824_set_tdm_slot,
+	.mute_stream = nau8824_mute_stream,
+	.no_capture_mute = 1,
+	.delay = nau8824_dai_delay,
 };
 
 #define NAU8824_RATES SNDRV_PCM_RATE_8000_192000
@@ -1591,7 +2464,7 @@ static struct snd_soc_dai_driver nau8824_dai = {
 	.capture = {
 		.stream_name	 = "Capture",
 		.channels_min	 = 1,
-		.channels_max	 = 2,
+		.channels_max	 = 4,
 		.rates		 = NAU8824_RATES,
 		.formats	 = NAU8824_FORMATS,
 	},
@@ -1606,6 +2479,8 @@ static const struct regmap_config nau8824_regmap_config = {
 	.readable_reg = nau8824_readable_reg,
 	.writeable_reg = nau8824_writeable_reg,
 	.volatile_reg = nau8824_volatile_reg,
+	/* contiguous registers are synced in one transfer */
+	.use_single_write = false,
 
 	.cache_type = REGCACHE_RBTREE,
 	.reg_defaults = nau8824_reg_defaults,
@@ -1631,9 +2506,13 @@ int nau8824_enable_jack_detect(struct snd_soc_component *component,
 	nau8824->jack = jack;
 	/* Initiate jack detection work queue */
 	INIT_WORK(&nau8824->jdet_work, nau8824_jdet_work);
-	ret = devm_request_threaded_irq(nau8824->dev, nau8824->irq, NULL,
-		nau8824_interrupt, IRQF_TRIGGER_LOW | IRQF_ONESHOT,
-		"nau8824", nau8824);
+	if (nau_irq_polled(&nau8824->irq_poll)) {
+		nau_irq_poll_enable(&nau8824->irq_poll);
+		return 0;
+	}
+	ret = nau_irq_request(nau8824->dev, nau8824->irq, &nau8824->irq_cfg,
+		nau8824_hardirq, nau8824_interrupt, IRQF_ONESHOT, "nau8824",
+		nau8824);
 	if (ret) {
 		dev_err(nau8824->dev, "Cannot request irq %d (%d)\n",
 			nau8824->irq, ret);
@@ -1643,6 +2522,78 @@ int nau8824_enable_jack_detect(struct snd_soc_component *component,
 }
 EXPORT_SYMBOL_GPL(nau8824_enable_jack_detect);
 
+static const char * const nau8824_spk_pins[] = { "SPKOUTL", "SPKOUTR" };
+static const char * const nau8824_hp_pins[] = { "HPOL", "HPOR" };
+
+static void nau8824_pins_set(struct snd_soc_dapm_context *dapm,
+	const char * const *pins, bool enable)
+{
+	int i;
+
+	for (i = 0; i < 2; i++)
+		if (enable)
+			snd_soc_dapm_enable_pin_unlocked(dapm, pins[i]);
+		else
+			snd_soc_dapm_disable_pin_unlocked(dapm, pins[i]);
+}
+
+/**
+ * nau8824_switch_output - Swap the playback between speaker and headphone
+ * @component: the codec
+ * @headphone: true to play on the headphone, false on the speaker
+ *
+ * For the jack events of the machine driver, in place of the pins of one
+ * output disabled and the ones of the other enabled apart. The output
+ * taking over powers up while the other still plays, so the DACs and the
+ * clocks stay on and the charge pump ramps ahead; the DACs are muted only
+ * across the swap. The outputs are the pins of the codec, which the
+ * machine driver leaves on.
+ */
+int nau8824_switch_output(struct snd_soc_component *component,
+	bool headphone)
+{
+	struct nau8824 *nau8824 = snd_soc_component_get_drvdata(component);
+	struct snd_soc_dapm_context *dapm =
+		snd_soc_component_get_dapm(component);
+	unsigned int vol_l, vol_r;
+	ktime_t start = ktime_get();
+	int ret;
+
+	mutex_lock(&dapm->card->dapm_mutex);
+	nau8824_pins_set(dapm, headphone ? nau8824_hp_pins :
+		nau8824_spk_pins, true);
+	ret = snd_soc_dapm_sync_unlocked(dapm);
+	if (ret)
+		goto unlock;
+	/* the headphone powered up by a playback takes it after the ramp */
+	if (nau_settle_wait(&nau8824->pump_settle))
+		regmap_update_bits(nau8824->regmap,
+			NAU8824_REG_CHARGE_PUMP_CONTROL,
+			NAU8824_JAMNODCLOW, NAU8824_JAMNODCLOW);
+
+	regmap_read(nau8824->regmap, NAU8824_REG_DAC_CH0_DGAIN_CTRL, &vol_l);
+	regmap_read(nau8824->regmap, NAU8824_REG_DAC_CH1_DGAIN_CTRL, &vol_r);
+	regmap_update_bits(nau8824->regmap, NAU8824_REG_DAC_CH0_DGAIN_CTRL,
+		NAU8824_DAC_CH0_VOL_MASK, 0);
+	regmap_update_bits(nau8824->regmap, NAU8824_REG_DAC_CH1_DGAIN_CTRL,
+		NAU8824_DAC_CH1_VOL_MASK, 0);
+	usleep_range(NAU8824_SWITCH_MUTE_MS * 1000,
+		NAU8824_SWITCH_MUTE_MS * 1000 + 500);
+	nau8824_pins_set(dapm, headphone ? nau8824_spk_pins :
+		nau8824_hp_pins, false);
+	ret = snd_soc_dapm_sync_unlocked(dapm);
+	regmap_update_bits(nau8824->regmap, NAU8824_REG_DAC_CH0_DGAIN_CTRL,
+		NAU8824_DAC_CH0_VOL_MASK, vol_l);
+	regmap_update_bits(nau8824->regmap, NAU8824_REG_DAC_CH1_DGAIN_CTRL,
+		NAU8824_DAC_CH1_VOL_MASK, vol_r);
+	nau_latency_add(&nau8824->latency[NAU8824_LAT_OUTPUT_SWITCH], start);
+unlock:
+	mutex_unlock(&dapm->card->dapm_mutex);
+
+	return ret;
+}
+EXPORT_SYMBOL_GPL(nau8824_switch_output);
+
 static void nau8824_reset_chip(struct regmap *regmap)
 {
 	regmap_write(regmap, NAU8824_REG_RESET, 0x00);
@@ -1656,12 +2607,6 @@ static void nau8824_setup_buttons(struct nau8824 *nau8824)
 	regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
 		NAU8824_SAR_TRACKING_GAIN_MASK,
 		nau8824->sar_voltage << NAU8824_SAR_TRACKING_GAIN_SFT);
-	regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
-		NAU8824_SAR_COMPARE_TIME_MASK,
-		nau8824->sar_compare_time << NAU8824_SAR_COMPARE_TIME_SFT);
-	regmap_update_bits(regmap, NAU8824_REG_SAR_ADC,
-		NAU8824_SAR_SAMPLING_TIME_MASK,
-		nau8824->sar_sampling_time << NAU8824_SAR_SAMPLING_TIME_SFT);
 
 	regmap_update_bits(regmap, NAU8824_REG_VDET_COEFFICIENT,
 		NAU8824_LEVELS_NR_MASK,
@@ -1669,9 +2614,9 @@ static void nau8824_setup_buttons(struct nau8824 *nau8824)
 	regmap_update_bits(regmap, NAU8824_REG_VDET_COEFFICIENT,
 		NAU8824_HYSTERESIS_MASK,
 		nau8824->sar_hysteresis << NAU8824_HYSTERESIS_SFT);
-	regmap_update_bits(regmap, NAU8824_REG_VDET_COEFFICIENT,
-		NAU8824_SHORTKEY_DEBOUNCE_MASK,
-		nau8824->key_debounce << NAU8824_SHORTKEY_DEBOUNCE_SFT);
+	/* The SAR timings and the debounce are of the profile selected */
+	nau8824->sar_applied = NAU8824_SAR_PROFILE_NUM;
+	nau8824_sar_profile_apply(nau8824);
 
 	regmap_write(regmap, NAU8824_REG_VDET_THRESHOLD_1,
 		(nau8824->sar_threshold[0] << 8) | nau8824->sar_threshold[1]);
@@ -1683,101 +2628,64 @@ static void nau8824_setup_buttons(struct nau8824 *nau8824)
 		(nau8824->sar_threshold[6] << 8) | nau8824->sar_threshold[7]);
 }
 
-static void nau8824_init_regs(struct nau8824 *nau8824)
-{
-	struct regmap *regmap = nau8824->regmap;
-
-	/* Enable Bias/VMID/VMID Tieoff */
-	regmap_update_bits(regmap, NAU8824_REG_BIAS_ADJ,
-		NAU8824_VMID | NAU8824_VMID_SEL_MASK, NAU8824_VMID |
-		(nau8824->vref_impedance << NAU8824_VMID_SEL_SFT));
-	regmap_update_bits(regmap, NAU8824_REG_BOOST,
-		NAU8824_GLOBAL_BIAS_EN, NAU8824_GLOBAL_BIAS_EN);
-	mdelay(2);
-	regmap_update_bits(regmap, NAU8824_REG_MIC_BIAS,
-		NAU8824_MICBIAS_VOLTAGE_MASK, nau8824->micbias_voltage);
-	/* Disable Boost Driver, Automatic Short circuit protection enable */
-	regmap_update_bits(regmap, NAU8824_REG_BOOST,
-		NAU8824_PRECHARGE_DIS | NAU8824_HP_BOOST_DIS |
-		NAU8824_HP_BOOST_G_DIS | NAU8824_SHORT_SHUTDOWN_EN,
-		NAU8824_PRECHARGE_DIS | NAU8824_HP_BOOST_DIS |
-		NAU8824_HP_BOOST_G_DIS | NAU8824_SHORT_SHUTDOWN_EN);
+/* The fixed part of the initiation, the reset values with the settings
+ * below made. Each register is written once; the settings depending on
+ * the device properties are updated afterwards.
+ */
+static const struct reg_sequence nau8824_init_seq[] = {
+	/* Disable Boost Driver, Automatic Short circuit protection enable,
+	 * and the global bias kept on.
+	 */
+	{ NAU8824_REG_BOOST, 0x3340 },
 	/* Scaling for ADC and DAC clock */
-	regmap_update_bits(regmap, NAU8824_REG_CLK_DIVIDER,
-		NAU8824_CLK_ADC_SRC_MASK | NAU8824_CLK_DAC_SRC_MASK,
-		(0x1 << NAU8824_CLK_ADC_SRC_SFT) |
-		(0x1 << NAU8824_CLK_DAC_SRC_SFT));
-	regmap_update_bits(regmap, NAU8824_REG_DAC_MUTE_CTRL,
-		NAU8824_DAC_ZC_EN, NAU8824_DAC_ZC_EN);
-	regmap_update_bits(regmap, NAU8824_REG_ENA_CTRL,
-		NAU8824_DAC_CH1_EN | NAU8824_DAC_CH0_EN |
-		NAU8824_ADC_CH0_EN | NAU8824_ADC_CH1_EN |
-		NAU8824_ADC_CH2_EN | NAU8824_ADC_CH3_EN,
-		NAU8824_DAC_CH1_EN | NAU8824_DAC_CH0_EN |
-		NAU8824_ADC_CH0_EN | NAU8824_ADC_CH1_EN |
-		NAU8824_ADC_CH2_EN | NAU8824_ADC_CH3_EN);
-	regmap_update_bits(regmap, NAU8824_REG_CLK_GATING_ENA,
-		NAU8824_CLK_ADC_CH23_EN | NAU8824_CLK_ADC_CH01_EN |
-		NAU8824_CLK_DAC_CH1_EN | NAU8824_CLK_DAC_CH0_EN |
-		NAU8824_CLK_I2S_EN | NAU8824_CLK_GAIN_EN |
-		NAU8824_CLK_SAR_EN | NAU8824_CLK_DMIC_CH23_EN,
-		NAU8824_CLK_ADC_CH23_EN | NAU8824_CLK_ADC_CH01_EN |
-		NAU8824_CLK_DAC_CH1_EN | NAU8824_CLK_DAC_CH0_EN |
-		NAU8824_CLK_I2S_EN | NAU8824_CLK_GAIN_EN |
-		NAU8824_CLK_SAR_EN | NAU8824_CLK_DMIC_CH23_EN);
+	{ NAU8824_REG_CLK_DIVIDER, 0x0050 },
+	{ NAU8824_REG_DAC_MUTE_CTRL, 0x0800 },
+	{ NAU8824_REG_ENA_CTRL, 0x003f },
+	{ NAU8824_REG_CLK_GATING_ENA, 0xf0aa },
 	/* Class G timer 64ms */
-	regmap_update_bits(regmap, NAU8824_REG_CLASSG,
-		NAU8824_CLASSG_TIMER_MASK,
-		0x20 << NAU8824_CLASSG_TIMER_SFT);
-	regmap_update_bits(regmap, NAU8824_REG_TRIM_SETTINGS,
-		NAU8824_DRV_CURR_INC, NAU8824_DRV_CURR_INC);
+	{ NAU8824_REG_CLASSG, 0x2000 },
+	{ NAU8824_REG_TRIM_SETTINGS, 0x8000 },
 	/* Disable DACR/L power */
-	regmap_update_bits(regmap, NAU8824_REG_CHARGE_PUMP_CONTROL,
-		NAU8824_SPKR_PULL_DOWN | NAU8824_SPKL_PULL_DOWN |
-		NAU8824_POWER_DOWN_DACR | NAU8824_POWER_DOWN_DACL,
-		NAU8824_SPKR_PULL_DOWN | NAU8824_SPKL_PULL_DOWN |
-		NAU8824_POWER_DOWN_DACR | NAU8824_POWER_DOWN_DACL);
+	{ NAU8824_REG_CHARGE_PUMP_CONTROL, 0x3300 },
 	/* Enable TESTDAC. This sets the analog DAC inputs to a '0' input
 	 * signal to avoid any glitches due to power up transients in both
-	 * the analog and digital DAC circuit.
+	 * the analog and digital DAC circuit. Config L/R channel; the
+	 * channel 0 keeps I2S0 of the reset value.
 	 */
-	regmap_update_bits(regmap, NAU8824_REG_ENABLE_LO,
-		NAU8824_TEST_DAC_EN, NAU8824_TEST_DAC_EN);
-	/* Config L/R channel */
-	regmap_update_bits(regmap, NAU8824_REG_DAC_CH0_DGAIN_CTRL,
-		NAU8824_DAC_CH0_SEL_MASK, NAU8824_DAC_CH0_SEL_I2S0);
-	regmap_update_bits(regmap, NAU8824_REG_DAC_CH1_DGAIN_CTRL,
-		NAU8824_DAC_CH1_SEL_MASK, NAU8824_DAC_CH1_SEL_I2S1);
-	regmap_update_bits(regmap, NAU8824_REG_ENABLE_LO,
-		NAU8824_DACR_HPR_EN | NAU8824_DACL_HPL_EN,
-		NAU8824_DACR_HPR_EN | NAU8824_DACL_HPL_EN);
+	{ NAU8824_REG_ENABLE_LO, 0xc005 },
+	{ NAU8824_REG_DAC_CH1_DGAIN_CTRL, 0x0300 },
 	/* Default oversampling/decimations settings are unusable
 	 * (audible hiss). Set it to something better.
 	 */
-	regmap_update_bits(regmap, NAU8824_REG_ADC_FILTER_CTRL,
-		NAU8824_ADC_SYNC_DOWN_MASK, NAU8824_ADC_SYNC_DOWN_64);
-	regmap_update_bits(regmap, NAU8824_REG_DAC_FILTER_CTRL_1,
-		NAU8824_DAC_CICCLP_OFF | NAU8824_DAC_OVERSAMPLE_MASK,
-		NAU8824_DAC_CICCLP_OFF | NAU8824_DAC_OVERSAMPLE_64);
+	{ NAU8824_REG_ADC_FILTER_CTRL, 0x0001 },
+	{ NAU8824_REG_DAC_FILTER_CTRL_1, 0x0080 },
 	/* DAC clock delay 2ns, VREF */
-	regmap_update_bits(regmap, NAU8824_REG_RDAC,
-		NAU8824_RDAC_CLK_DELAY_MASK | NAU8824_RDAC_VREF_MASK,
-		(0x2 << NAU8824_RDAC_CLK_DELAY_SFT) |
-		(0x3 << NAU8824_RDAC_VREF_SFT));
+	{ NAU8824_REG_RDAC, 0x002c },
 	/* PGA input mode selection */
-	regmap_update_bits(regmap, NAU8824_REG_FEPGA,
-		NAU8824_FEPGA_MODEL_SHORT_EN | NAU8824_FEPGA_MODER_SHORT_EN,
-		NAU8824_FEPGA_MODEL_SHORT_EN | NAU8824_FEPGA_MODER_SHORT_EN);
+	{ NAU8824_REG_FEPGA, 0x0088 },
 	/* Digital microphone control */
-	regmap_update_bits(regmap, NAU8824_REG_ANALOG_CONTROL_1,
-		NAU8824_DMIC_CLK_DRV_STRG | NAU8824_DMIC_CLK_SLEW_FAST,
-		NAU8824_DMIC_CLK_DRV_STRG | NAU8824_DMIC_CLK_SLEW_FAST);
+	{ NAU8824_REG_ANALOG_CONTROL_1, 0x000f },
+};
+
+static void nau8824_init_regs(struct nau8824 *nau8824)
+{
+	struct regmap *regmap = nau8824->regmap;
+
+	/* Enable Bias/VMID/VMID Tieoff */
+	regmap_update_bits(regmap, NAU8824_REG_BIAS_ADJ,
+		NAU8824_VMID | NAU8824_VMID_SEL_MASK, NAU8824_VMID |
+		(nau8824->vref_impedance << NAU8824_VMID_SEL_SFT));
+	regmap_update_bits(regmap, NAU8824_REG_BOOST,
+		NAU8824_GLOBAL_BIAS_EN, NAU8824_GLOBAL_BIAS_EN);
+	usleep_range(2000, 3000);
+	regmap_update_bits(regmap, NAU8824_REG_MIC_BIAS,
+		NAU8824_MICBIAS_VOLTAGE_MASK, nau8824->micbias_voltage);
+	regmap_multi_reg_write(regmap, nau8824_init_seq,
+		ARRAY_SIZE(nau8824_init_seq));
 	regmap_update_bits(regmap, NAU8824_REG_JACK_DET_CTRL,
-		NAU8824_JACK_LOGIC,
+		NAU8824_JACK_LOGIC | NAU8824_JACK_EJECT_DT_MASK,
 		/* jkdet_polarity - 1  is for active-low */
-		nau8824->jkdet_polarity ? 0 : NAU8824_JACK_LOGIC);
-	regmap_update_bits(regmap,
-		NAU8824_REG_JACK_DET_CTRL, NAU8824_JACK_EJECT_DT_MASK,
+		(nau8824->jkdet_polarity ? 0 : NAU8824_JACK_LOGIC) |
 		(nau8824->jack_eject_debounce << NAU8824_JACK_EJECT_DT_SFT));
 	if (nau8824->sar_threshold_num)
 		nau8824_setup_buttons(nau8824);
@@ -1815,30 +2723,75 @@ static void nau8824_print_device_properties(struct nau8824 *nau8824)
 	dev_dbg(dev, "sar-compare-time:     %d\n", nau8824->sar_compare_time);
 	dev_dbg(dev, "sar-sampling-time:    %d\n", nau8824->sar_sampling_time);
 	dev_dbg(dev, "short-key-debounce:   %d\n", nau8824->key_debounce);
+	dev_dbg(dev, "sar-fast-compare-time:  %d\n",
+		nau8824->sar_profile[NAU8824_SAR_FAST].compare_time);
+	dev_dbg(dev, "sar-fast-sampling-time: %d\n",
+		nau8824->sar_profile[NAU8824_SAR_FAST].sampling_time);
+	dev_dbg(dev, "short-key-fast-debounce: %d\n",
+		nau8824->sar_profile[NAU8824_SAR_FAST].key_debounce);
 	dev_dbg(dev, "jack-eject-debounce:  %d\n",
 			nau8824->jack_eject_debounce);
+	dev_dbg(dev, "autosuspend-delay-ms: %d\n",
+			nau8824->autosuspend_delay);
+	dev_dbg(dev, "jack-poll-ms:         %d\n",
+			nau8824->irq_poll.period_ms);
+	dev_dbg(dev, "button-duty-ms:       %d\n", nau8824->duty.period_ms);
+	dev_dbg(dev, "dmic-lp-clk:          %d-%d\n",
+			nau8824->dmic_lp_clk_min, nau8824->dmic_lp_clk_max);
 }
 
-static int nau8824_read_device_properties(struct device *dev,
+static const struct nau_prop_u32 nau8824_props[] = {
+	NAU_PROP_U32(struct nau8824, jkdet_polarity,
+		"nuvoton,jkdet-polarity", 1),
+	NAU_PROP_U32(struct nau8824, jack_rpt.window_ms,
+		"nuvoton,jack-report-window-ms", NAU_JACK_REPORT_MS),
+	NAU_PROP_U32(struct nau8824, micbias_voltage,
+		"nuvoton,micbias-voltage", 6),
+	NAU_PROP_U32(struct nau8824, vref_impedance,
+		"nuvoton,vref-impedance", 2),
+	NAU_PROP_U32(struct nau8824, sar_threshold_num,
+		"nuvoton,sar-threshold-num", 4),
+	NAU_PROP_U32(struct nau8824, sar_hysteresis,
+		"nuvoton,sar-hysteresis", 0),
+	NAU_PROP_U32(struct nau8824, sar_voltage,
+		"nuvoton,sar-voltage", 6),
+	NAU_PROP_U32(struct nau8824, sar_compare_time,
+		"nuvoton,sar-compare-time", 1),
+	NAU_PROP_U32(struct nau8824, sar_sampling_time,
+		"nuvoton,sar-sampling-time", 1),
+	NAU_PROP_U32(struct nau8824, key_debounce,
+		"nuvoton,short-key-debounce", 0),
+	NAU_PROP_U32(struct nau8824, sar_profile[NAU8824_SAR_FAST].compare_time,
+		"nuvoton,sar-fast-compare-time", 0),
+	NAU_PROP_U32(struct nau8824, sar_profile[NAU8824_SAR_FAST].sampling_time,
+		"nuvoton,sar-fast-sampling-time", 0),
+	NAU_PROP_U32(struct nau8824, sar_profile[NAU8824_SAR_FAST].key_debounce,
+		"nuvoton,short-key-fast-debounce", 0),
+	NAU_PROP_U32(struct nau8824, jack_eject_debounce,
+		"nuvoton,jack-eject-debounce", 1),
+	NAU_PROP_U32(struct nau8824, autosuspend_delay,
+		"nuvoton,autosuspend-delay-ms", 3000),
+	NAU_PROP_U32(struct nau8824, irq_poll.period_ms,
+		"nuvoton,jack-poll-ms", 0),
+	NAU_PROP_U32(struct nau8824, duty.period_ms,
+		"nuvoton,button-duty-ms", 0),
+	NAU_PROP_U32(struct nau8824, dmic_lp_clk_min,
+		"nuvoton,dmic-lp-clk-min", 400000),
+	NAU_PROP_U32(struct nau8824, dmic_lp_clk_max,
+		"nuvoton,dmic-lp-clk-max", 800000),
+};
+
+static void nau8824_read_device_properties(struct device *dev,
 	struct nau8824 *nau8824) {
 	int ret;
 
-	ret = device_property_read_u32(dev, "nuvoton,jkdet-polarity",
-		&nau8824->jkdet_polarity);
-	if (ret)
-		nau8824->jkdet_polarity = 1;
-	ret = device_property_read_u32(dev, "nuvoton,micbias-voltage",
-		&nau8824->micbias_voltage);
-	if (ret)
-		nau8824->micbias_voltage = 6;
-	ret = device_property_read_u32(dev, "nuvoton,vref-impedance",
-		&nau8824->vref_impedance);
-	if (ret)
-		nau8824->vref_impedance = 2;
-	ret = device_property_read_u32(dev, "nuvoton,sar-threshold-num",
-		&nau8824->sar_threshold_num);
-	if (ret)
-		nau8824->sar_threshold_num = 4;
+	nau_irq_cfg_read(dev, &nau8824->irq_cfg);
+	nau_props_read_u32(dev, nau8824, nau8824_props,
+		ARRAY_SIZE(nau8824_props));
+	nau8824->dmic_power_mode = device_property_read_bool(dev,
+		"nuvoton,dmic-low-power") ? NAU8824_DMIC_LOW_POWER :
+		NAU8824_DMIC_PERFORMANCE;
+
 	ret = device_property_read_u32_array(dev, "nuvoton,sar-threshold",
 		nau8824->sar_threshold, nau8824->sar_threshold_num);
 	if (ret) {
@@ -1847,32 +2800,12 @@ static int nau8824_read_device_properties(struct device *dev,
 		nau8824->sar_threshold[2] = 0x26;
 		nau8824->sar_threshold[3] = 0x73;
 	}
-	ret = device_property_read_u32(dev, "nuvoton,sar-hysteresis",
-		&nau8824->sar_hysteresis);
-	if (ret)
-		nau8824->sar_hysteresis = 0;
-	ret = device_property_read_u32(dev, "nuvoton,sar-voltage",
-		&nau8824->sar_voltage);
-	if (ret)
-		nau8824->sar_voltage = 6;
-	ret = device_property_read_u32(dev, "nuvoton,sar-compare-time",
-		&nau8824->sar_compare_time);
-	if (ret)
-		nau8824->sar_compare_time = 1;
-	ret = device_property_read_u32(dev, "nuvoton,sar-sampling-time",
-		&nau8824->sar_sampling_time);
-	if (ret)
-		nau8824->sar_sampling_time = 1;
-	ret = device_property_read_u32(dev, "nuvoton,short-key-debounce",
-		&nau8824->key_debounce);
-	if (ret)
-		nau8824->key_debounce = 0;
-	ret = device_property_read_u32(dev, "nuvoton,jack-eject-debounce",
-		&nau8824->jack_eject_debounce);
-	if (ret)
-		nau8824->jack_eject_debounce = 1;
-
-	return 0;
+	nau8824->sar_profile[NAU8824_SAR_LOW_POWER].compare_time =
+		nau8824->sar_compare_time;
+	nau8824->sar_profile[NAU8824_SAR_LOW_POWER].sampling_time =
+		nau8824->sar_sampling_time;
+	nau8824->sar_profile[NAU8824_SAR_LOW_POWER].key_debounce =
+		nau8824->key_debounce;
 }
 
 /* Please keep this list alphabetically sorted */
@@ -1931,10 +2864,18 @@ static const struct dmi_system_id nau8824_quirk_table[] = {
 	{}
 };
 
+/* The quirks of the board don't change, so the DMI is matched once for
+ * the probes and the machine driver.
+ */
 static void nau8824_check_quirks(void)
 {
+	static bool checked;
 	const struct dmi_system_id *dmi_id;
 
+	if (checked)
+		return;
+	checked = true;
+
 	if (quirk_override != -1) {
 		nau8824_quirk = quirk_override;
 		return;
@@ -1956,7 +2897,12 @@ const char *nau8824_components(void)
 }
 EXPORT_SYMBOL_GPL(nau8824_components);
 
-static int nau8824_i2c_probe(struct i2c_client *i2c)
+static void nau8824_destroy_wq(void *data)
+{
+	destroy_workqueue(data);
+}
+
+static int __nau8824_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8824 *nau8824 = dev_get_platdata(dev);
@@ -1966,19 +2912,36 @@ static int nau8824_i2c_probe(struct i2c_client *i2c)
 		nau8824 = devm_kzalloc(dev, sizeof(*nau8824), GFP_KERNEL);
 		if (!nau8824)
 			return -ENOMEM;
-		ret = nau8824_read_device_properties(dev, nau8824);
-		if (ret)
-			return ret;
+		if (!nau_props_cache_restore(dev, nau8824, sizeof(*nau8824))) {
+			nau8824_read_device_properties(dev, nau8824);
+			nau_props_cache_store(dev, nau8824, sizeof(*nau8824));
+		}
 	}
 	i2c_set_clientdata(i2c, nau8824);
 
-	nau8824->regmap = devm_regmap_init_i2c(i2c, &nau8824_regmap_config);
+	nau8824->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&nau8824_regmap_config, &nau8824->regstat);
 	if (IS_ERR(nau8824->regmap))
 		return PTR_ERR(nau8824->regmap);
 	nau8824->resume_lock = false;
 	nau8824->dev = dev;
 	nau8824->irq = i2c->irq;
+	/* the polls only stand in for a line not wired */
+	if (nau8824->irq)
+		nau8824->irq_poll.period_ms = 0;
+	nau_irq_poll_init(&nau8824->irq_poll, dev, nau8824->regmap,
+		NAU8824_REG_IRQ, 0xff, nau8824_hardirq, nau8824_interrupt,
+		nau8824);
+	/* the polls run on a shared worker, at its priority */
+	if (nau_irq_polled(&nau8824->irq_poll))
+		nau8824->irq_cfg.prio = 0;
 	sema_init(&nau8824->jd_sem, 1);
+	mutex_init(&nau8824->sar_lock);
+	mutex_init(&nau8824->jdet_lock);
+	atomic_set(&nau8824->jdet_gen, 0);
+	nau_jack_report_init(&nau8824->jack_rpt, &nau8824->irq_time);
+	mutex_init(&nau8824->duty_lock);
+	INIT_DELAYED_WORK(&nau8824->duty_work, nau8824_duty_work);
 
 	nau8824_check_quirks();
 
@@ -1996,13 +2959,39 @@ static int nau8824_i2c_probe(struct i2c_client *i2c)
 	nau8824_reset_chip(nau8824->regmap);
 	nau8824_init_regs(nau8824);
 
-	if (i2c->irq)
+	/* Runtime PM is up before the interruption, which wakes it up */
+	pm_runtime_set_autosuspend_delay(dev, nau8824->autosuspend_delay);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_set_active(dev);
+	ret = devm_pm_runtime_enable(dev);
+	if (ret)
+		return ret;
+
+	/* The jack detection has a queue of its own, so it doesn't wait
+	 * behind the unrelated work of the system workqueue under load.
+	 */
+	nau8824->jdet_wq = alloc_workqueue("%s-jdet", WQ_HIGHPRI, 0,
+					   dev_name(dev));
+	if (!nau8824->jdet_wq)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(dev, nau8824_destroy_wq,
+				       nau8824->jdet_wq);
+	if (ret)
+		return ret;
+
+	if (nau8824_irq_on(nau8824))
 		nau8824_setup_irq(nau8824);
+	nau_pm_async_init(dev);
 
 	return devm_snd_soc_register_component(dev,
 		&nau8824_component_driver, &nau8824_dai, 1);
 }
 
+static int nau8824_i2c_probe(struct i2c_client *i2c)
+{
+	return nau_props_cache_end(&i2c->dev, __nau8824_i2c_probe(i2c));
+}
+
 static const struct i2c_device_id nau8824_i2c_ids[] = {
 	{ "nau8824", 0 },
 	{ }
@@ -2025,11 +3014,18 @@ static const struct acpi_device_id nau8824_acpi_match[] = {
 MODULE_DEVICE_TABLE(acpi, nau8824_acpi_match);
 #endif
 
+static const struct dev_pm_ops nau8824_pm_ops = {
+	SET_RUNTIME_PM_OPS(nau8824_runtime_suspend, nau8824_runtime_resume,
+			   NULL)
+};
+
 static struct i2c_driver nau8824_i2c_driver = {
 	.driver = {
 		.name = "nau8824",
 		.of_match_table = of_match_ptr(nau8824_of_ids),
 		.acpi_match_table = ACPI_PTR(nau8824_acpi_match),
+		.pm = &nau8824_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8824_i2c_probe,
 	.id_table = nau8824_i2c_ids,
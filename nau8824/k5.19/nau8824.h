@@ -212,6 +212,7 @@
 
 /* SAR_ADC (0x13) */
 #define NAU8824_SAR_ADC_EN_SFT		12
+#define NAU8824_SAR_ADC_EN		(0x1 << NAU8824_SAR_ADC_EN_SFT)
 #define NAU8824_SAR_TRACKING_GAIN_SFT	8
 #define NAU8824_SAR_TRACKING_GAIN_MASK	(0x7 << NAU8824_SAR_TRACKING_GAIN_SFT)
 #define NAU8824_SAR_COMPARE_TIME_SFT	2
@@ -266,6 +267,9 @@
 #define NAU8824_TDM_DACR_RX_SFT	4
 #define NAU8824_TDM_DACR_RX_MASK	(0x3 << NAU8824_TDM_DACR_RX_SFT)
 #define NAU8824_TDM_TX_MASK		0xf
+/* ADC CH0..CH3 go out in a window of 4 slots, at any of 16 slots */
+#define NAU8824_TDM_WINDOW		4
+#define NAU8824_TDM_SLOTS		16
 
 /* ADC_FILTER_CTRL (0x24) */
 #define NAU8824_ADC_SYNC_DOWN_MASK	0x3
@@ -425,17 +429,114 @@ enum {
 	NAU8824_CLK_FLL_MCLK,
 	NAU8824_CLK_FLL_BLK,
 	NAU8824_CLK_FLL_FS,
+	/* hw_params plans the sysclk, freq is the MCLK available or 0 */
+	NAU8824_CLK_AUTO,
+};
+
+/* The SAR timings of the buttons, switched at runtime: the ones of the
+ * device properties for the low power, and shorter ones for the fast
+ * response during a call.
+ */
+enum {
+	NAU8824_SAR_LOW_POWER,
+	NAU8824_SAR_FAST,
+	NAU8824_SAR_PROFILE_NUM,
+};
+
+/* The selection of the profile, automatic by the capture stream */
+enum {
+	NAU8824_SAR_MODE_AUTO,
+	NAU8824_SAR_MODE_LOW_POWER,
+	NAU8824_SAR_MODE_FAST,
+};
+
+struct nau8824_sar_profile {
+	int compare_time;
+	int sampling_time;
+	int key_debounce;
+};
+
+/* the ramp of the charge pump before the headphone plays */
+#define NAU8824_PUMP_RAMP_MS	10
+/* the mute of the DACs around the swap of the outputs, for the zero cross */
+#define NAU8824_SWITCH_MUTE_MS	2
+
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8824_LAT_HW_PARAMS,
+	NAU8824_LAT_SEMA_WAIT,
+	/* the rest of the charge pump ramp left to the playback unmute */
+	NAU8824_LAT_PUMP,
+	/* the interruption to the decode of a button, by SAR profile */
+	NAU8824_LAT_KEY_LOW_POWER,
+	NAU8824_LAT_KEY_FAST,
+	/* the jack type detection, its wait for a worker and its run */
+	NAU8824_LAT_JDET_QUEUE,
+	NAU8824_LAT_JDET_RUN,
+	/* the hard interruption to the run of its thread */
+	NAU8824_LAT_IRQ_THREAD,
+	/* the swap of the playback between the speaker and the headphone */
+	NAU8824_LAT_OUTPUT_SWITCH,
+	NAU8824_LAT_NUM,
+};
+
+/* The DMIC clock modes. Performance runs the mics at the highest clock
+ * allowed, for their full SNR and bandwidth. Low Power runs them at the
+ * lowest clock in the low-power range of the mics, which cuts the current
+ * of a mic to a fraction at a few dB less SNR and a bandwidth for speech
+ * rates, 16 kHz capture or less; see the datasheet of the mic. The mode
+ * takes effect at the next DMIC power-up.
+ */
+enum {
+	NAU8824_DMIC_PERFORMANCE,
+	NAU8824_DMIC_LOW_POWER,
+};
+
+/* The selection of the OSR of a stream at hw_params */
+enum {
+	NAU8824_OSR_MANUAL,	/* the OSR of the controls */
+	NAU8824_OSR_LOW_LATENCY,
+	NAU8824_OSR_LOW_POWER,
+	NAU8824_OSR_QUALITY,
 };
 
 struct nau8824 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
+	struct nau_latency latency[NAU8824_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	struct nau_clk_planner clk_plan;
+	struct nau_jack_report jack_rpt;
+	struct nau_delay delay;
+	/* the VCO and the SAR duty cycled while a headset waits idle */
+	struct nau_duty duty;
+	struct delayed_work duty_work;
+	struct mutex duty_lock;
+	struct nau_dapm_stat dapm_stat;
+	struct nau_settle pump_settle;
+	int osr_policy;
 	struct snd_soc_dapm_context *dapm;
 	struct snd_soc_jack *jack;
+	struct workqueue_struct *jdet_wq;
 	struct work_struct jdet_work;
+	ktime_t jdet_queued;
+	/* The generation of the jack, bumped by each insertion and ejection.
+	 * The work detects for jdet_work_gen and bails out once it's stale;
+	 * jdet_lock orders its report against the ejection.
+	 */
+	atomic_t jdet_gen;
+	int jdet_work_gen;
+	struct mutex jdet_lock;
 	struct semaphore jd_sem;
 	int fs;
+	int dmic_power_mode;
+	int dmic_lp_clk_min;
+	int dmic_lp_clk_max;
 	int irq;
+	struct nau_irq_cfg irq_cfg;
+	struct nau_irq_poll irq_poll;	/* in place of a line not wired */
 	int resume_lock;
 	int micbias_voltage;
 	int vref_impedance;
@@ -447,20 +548,34 @@ struct nau8824 {
 	int sar_compare_time;
 	int sar_sampling_time;
 	int key_debounce;
+	struct nau8824_sar_profile sar_profile[NAU8824_SAR_PROFILE_NUM];
+	struct mutex sar_lock;
+	int sar_mode;
+	int sar_applied; /* NAU8824_SAR_PROFILE_NUM if none */
+	int capture_active;
+	/* The TDM slots of set_tdm_slot; tdm_tx has the ADC channels which
+	 * go out, or is 0 without TDM. tdm_auto is set once hw_params turns
+	 * TDM on by itself for a capture of more than 2 channels.
+	 */
+	unsigned int tdm_tx;
+	int tdm_slots;
+	int tdm_width;
+	bool tdm_auto;
+	ktime_t irq_time;
 	int jack_eject_debounce;
-};
-
-struct nau8824_fll {
-	int mclk_src;
-	int ratio;
-	int fll_frac;
-	int fll_int;
-	int clk_ref_div;
-};
-
-struct nau8824_fll_attr {
-	unsigned int param;
-	unsigned int val;
+	int autosuspend_delay;
+	bool pm_held; /* runtime PM held while a DAPM path is powered */
+	/* statistics of the jack type detection */
+	u32 jdet_count;
+	u32 jdet_stable_count;
+	u32 jdet_timeout_count;
+	u32 jdet_cancel_count;
+	u32 jdet_last_ms;
+	/* the semaphore waits timed out, and interrupted */
+	u32 sema_timeouts;
+	u32 sema_fails;
+	struct nau_regcache_stat resume_sync;
+	struct nau_fll_cache fll_cache;
 };
 
 struct nau8824_osr_attr {
@@ -471,6 +586,8 @@ struct nau8824_osr_attr {
 
 int nau8824_enable_jack_detect(struct snd_soc_component *component,
 	struct snd_soc_jack *jack);
+int nau8824_switch_output(struct snd_soc_component *component,
+	bool headphone);
 const char *nau8824_components(void);
 
 #endif				/* _NAU8824_H */
@@ -0,0 +1,212 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Power accounting of the DAPM widgets of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_DAPM_STAT_H__
+#define __NAU_DAPM_STAT_H__
+
+#include <linux/debugfs.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+#include <linux/seq_file.h>
+#include <linux/string.h>
+#include <sound/soc.h>
+#include <sound/soc-dapm.h>
+
+/* The widgets tracked by a driver, by their names without the prefix.
+ * Their events go through nau_wstat_event, which times the handler of
+ * the driver, sleeps included, and the time the widget stays powered.
+ * The time at each bias level is kept from the bias callback.
+ */
+struct nau_wstat {
+	const char *name;
+	struct snd_soc_dapm_widget *w;
+	int (*event)(struct snd_soc_dapm_widget *w,
+		     struct snd_kcontrol *kcontrol, int event);
+	unsigned short event_flags;
+	bool on;
+	ktime_t on_start;
+	u64 on_ns;
+	u32 power_ups;
+	u32 power_downs;
+	u32 events;
+	u64 event_ns;
+	u64 event_max_ns;
+};
+
+#define NAU_WSTAT_MAX		8
+#define NAU_BIAS_LEVELS		(SND_SOC_BIAS_ON + 1)
+
+struct nau_dapm_stat {
+	struct nau_wstat wstat[NAU_WSTAT_MAX];
+	int num;
+	int level;
+	ktime_t level_start;
+	u64 level_ns[NAU_BIAS_LEVELS];
+	u32 level_changes;
+};
+
+static inline int nau_wstat_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct nau_wstat *ws = w->priv;
+	ktime_t start = ktime_get();
+	u64 ns;
+	int ret = 0;
+
+	if (ws->event && (ws->event_flags & event)) {
+		ret = ws->event(w, kcontrol, event);
+		ns = ktime_to_ns(ktime_sub(ktime_get(), start));
+		ws->event_ns += ns;
+		ws->event_max_ns = max(ws->event_max_ns, ns);
+		ws->events++;
+	}
+
+	if ((event & SND_SOC_DAPM_POST_PMU) && !ws->on) {
+		ws->on = true;
+		ws->on_start = ktime_get();
+		ws->power_ups++;
+	} else if ((event & SND_SOC_DAPM_POST_PMD) && ws->on) {
+		ws->on = false;
+		ws->on_ns += ktime_to_ns(ktime_sub(ktime_get(), ws->on_start));
+		ws->power_downs++;
+	}
+
+	return ret;
+}
+
+static inline bool nau_wstat_match(struct snd_soc_component *component,
+	struct snd_soc_dapm_widget *w, const char *name)
+{
+	const char *wname = w->name;
+	size_t len;
+
+	if (component->name_prefix) {
+		len = strlen(component->name_prefix);
+		if (strncmp(wname, component->name_prefix, len) ||
+		    wname[len] != ' ')
+			return false;
+		wname += len + 1;
+	}
+
+	return !strcmp(wname, name);
+}
+
+/* Take the events of the widgets tracked. It may run again once a driver
+ * added more widgets; those taken already or private to DAPM are skipped.
+ */
+static inline void nau_dapm_stat_attach(struct nau_dapm_stat *stat,
+	struct snd_soc_component *component)
+{
+	struct snd_soc_dapm_context *dapm =
+		snd_soc_component_get_dapm(component);
+	struct snd_soc_dapm_widget *w;
+	struct nau_wstat *ws;
+	int i;
+
+	for (i = 0; i < stat->num; i++) {
+		ws = &stat->wstat[i];
+		if (ws->w)
+			continue;
+		for_each_card_widgets(component->card, w) {
+			if (w->dapm != dapm || w->priv ||
+			    !nau_wstat_match(component, w, ws->name))
+				continue;
+			ws->w = w;
+			ws->event = w->event;
+			ws->event_flags = w->event_flags;
+			w->priv = ws;
+			w->event = nau_wstat_event;
+			w->event_flags |= SND_SOC_DAPM_POST_PMU |
+				SND_SOC_DAPM_POST_PMD;
+			break;
+		}
+	}
+}
+
+/* for the set_bias_level of the component */
+static inline void nau_dapm_stat_bias(struct nau_dapm_stat *stat, int level)
+{
+	ktime_t now = ktime_get();
+
+	if (level == stat->level || level >= NAU_BIAS_LEVELS)
+		return;
+	stat->level_ns[stat->level] +=
+		ktime_to_ns(ktime_sub(now, stat->level_start));
+	stat->level = level;
+	stat->level_start = now;
+	stat->level_changes++;
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline int nau_dapm_stat_show(struct seq_file *s, void *data)
+{
+	static const char * const levels[NAU_BIAS_LEVELS] = {
+		"off", "standby", "prepare", "on" };
+	struct nau_dapm_stat *stat = s->private;
+	ktime_t now = ktime_get();
+	struct nau_wstat *ws;
+	u64 ns;
+	int i;
+
+	seq_puts(s, "widget on_ms power_ups power_downs events event_us event_max_us\n");
+	for (i = 0; i < stat->num; i++) {
+		ws = &stat->wstat[i];
+		if (!ws->w)
+			continue;
+		ns = ws->on_ns;
+		if (ws->on)
+			ns += ktime_to_ns(ktime_sub(now, ws->on_start));
+		seq_printf(s, "\"%s\" %llu %u %u %u %llu %llu\n", ws->name,
+			   div_u64(ns, NSEC_PER_MSEC), ws->power_ups,
+			   ws->power_downs, ws->events,
+			   div_u64(ws->event_ns, NSEC_PER_USEC),
+			   div_u64(ws->event_max_ns, NSEC_PER_USEC));
+	}
+
+	seq_printf(s, "bias changes %u\n", stat->level_changes);
+	for (i = 0; i < NAU_BIAS_LEVELS; i++) {
+		ns = stat->level_ns[i];
+		if (i == stat->level)
+			ns += ktime_to_ns(ktime_sub(now, stat->level_start));
+		seq_printf(s, "bias %s_ms %llu\n", levels[i],
+			   div_u64(ns, NSEC_PER_MSEC));
+	}
+
+	return 0;
+}
+DEFINE_SHOW_ATTRIBUTE(nau_dapm_stat);
+
+static inline void nau_dapm_stat_debugfs_init(struct dentry *root,
+	struct nau_dapm_stat *stat)
+{
+	if (!root)
+		return;
+
+	debugfs_create_file("dapm_stat", 0444, root, stat,
+			    &nau_dapm_stat_fops);
+}
+#else
+static inline void nau_dapm_stat_debugfs_init(struct dentry *root,
+	struct nau_dapm_stat *stat)
+{
+}
+#endif
+
+/* The widgets tracked by @names, up to NAU_WSTAT_MAX */
+static inline void nau_dapm_stat_init(struct nau_dapm_stat *stat,
+	const char * const *names, int num)
+{
+	int i;
+
+	stat->num = min(num, NAU_WSTAT_MAX);
+	for (i = 0; i < stat->num; i++)
+		stat->wstat[i].name = names[i];
+	stat->level = SND_SOC_BIAS_OFF;
+	stat->level_start = ktime_get();
+}
+
+#endif /* __NAU_DAPM_STAT_H__ */
@@ -0,0 +1,259 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Interruption line and thread of the Nuvoton headset codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_IRQ_H__
+#define __NAU_IRQ_H__
+
+#include <linux/cpumask.h>
+#include <linux/debugfs.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/jiffies.h>
+#include <linux/pm_runtime.h>
+#include <linux/regmap.h>
+#include <linux/sched.h>
+#include <linux/workqueue.h>
+#include <uapi/linux/sched/types.h>
+
+#define NAU_IRQ_CPU_ANY		U32_MAX
+/* the handler passes of an edge, beyond which the causes wait the next */
+#define NAU_IRQ_EDGE_PASSES	4
+
+/* The interruption of a codec as the board wants it, from the device
+ * properties:
+ *
+ *   nuvoton,irq-thread-priority  SCHED_FIFO priority of the thread, 1 to
+ *                                99; 0 keeps the one of the IRQ threads
+ *   nuvoton,irq-cpu              CPU of the interruption and its thread
+ *   nuvoton,irq-edge-trigger     the falling edge instead of the low level
+ *
+ * The level stays masked from the hard interruption to the end of the
+ * thread, so a thread kept waiting by the load holds off the next causes.
+ * The thread takes its priority as it runs first. The edge suits the
+ * interruption controllers which latch the edges, or the boards which
+ * share nothing on the line; as the line of the codec stays low while a
+ * cause is pending, the thread runs the handler again while the status
+ * has causes left, so a cause raised during a pass isn't lost.
+ */
+struct nau_irq_cfg {
+	u32 prio;
+	u32 cpu;
+	bool edge;
+	bool prio_applied;
+};
+
+static inline void nau_irq_cfg_read(struct device *dev,
+	struct nau_irq_cfg *cfg)
+{
+	if (device_property_read_u32(dev, "nuvoton,irq-thread-priority",
+		&cfg->prio) || cfg->prio >= MAX_RT_PRIO)
+		cfg->prio = 0;
+	if (device_property_read_u32(dev, "nuvoton,irq-cpu", &cfg->cpu))
+		cfg->cpu = NAU_IRQ_CPU_ANY;
+	cfg->edge = device_property_read_bool(dev, "nuvoton,irq-edge-trigger");
+}
+
+/**
+ * nau_irq_request - request the threaded interruption of a codec
+ * @dev: device of the codec
+ * @irq: interruption
+ * @cfg: interruption configuration of the board
+ * @handler: hard interruption handler, or NULL
+ * @thread_fn: thread function
+ * @flags: flags of the interruption other than the trigger
+ * @name: name of the interruption
+ * @data: argument of the handlers
+ *
+ * A CPU the board asks for which isn't online leaves the affinity alone.
+ *
+ * Return: 0 on success, or the error of the request.
+ */
+static inline int nau_irq_request(struct device *dev, int irq,
+	struct nau_irq_cfg *cfg, irq_handler_t handler,
+	irq_handler_t thread_fn, unsigned long flags, const char *name,
+	void *data)
+{
+	int ret;
+
+	cfg->prio_applied = false;
+	flags |= cfg->edge ? IRQF_TRIGGER_FALLING : IRQF_TRIGGER_LOW;
+	ret = devm_request_threaded_irq(dev, irq, handler, thread_fn, flags,
+					name, data);
+	if (ret)
+		return ret;
+
+	if (cfg->cpu == NAU_IRQ_CPU_ANY)
+		return 0;
+	if (cfg->cpu >= nr_cpu_ids || !cpu_online(cfg->cpu))
+		ret = -EINVAL;
+	else
+		ret = irq_set_affinity(irq, cpumask_of(cfg->cpu));
+	if (ret)
+		dev_warn(dev, "Cannot bind irq %d to CPU %u (%d)\n", irq,
+			 cfg->cpu, ret);
+
+	return 0;
+}
+
+/* Called at the start of the thread function */
+static inline void nau_irq_thread_prio(struct nau_irq_cfg *cfg)
+{
+	struct sched_attr attr = {
+		.size = sizeof(attr),
+		.sched_policy = SCHED_FIFO,
+		.sched_priority = cfg->prio,
+	};
+
+	if (!cfg->prio || cfg->prio_applied)
+		return;
+	cfg->prio_applied = true;
+	if (sched_setattr_nocheck(current, &attr))
+		pr_warn("%s: cannot set the irq thread priority %u\n",
+			current->comm, cfg->prio);
+}
+
+/* Returns true if the thread in the edge mode runs the handler again:
+ * the status at @reg has one of the causes in @mask left, and fewer than
+ * NAU_IRQ_EDGE_PASSES passes ran for the edge.
+ */
+static inline bool nau_irq_edge_again(const struct nau_irq_cfg *cfg,
+	struct regmap *regmap, unsigned int reg, unsigned int mask,
+	int *passes)
+{
+	unsigned int status;
+
+	if (!cfg->edge || ++(*passes) >= NAU_IRQ_EDGE_PASSES)
+		return false;
+
+	return !regmap_read(regmap, reg, &status) && (status & mask);
+}
+
+/* A board without the interruption line polls the status instead, every
+ * "nuvoton,jack-poll-ms" while nothing happens. The thread function runs
+ * from the poll as from the interruption, only if the status has a cause;
+ * the polls then come every NAU_IRQ_POLL_FAST_MS for NAU_IRQ_POLL_FAST_NUM
+ * polls, for the rest of the jack detection and the buttons held, and go
+ * back to the period. A poll with no cause reads the status alone and
+ * leaves the codec runtime suspended after it. The polls stop as the line
+ * would be disabled, and over a system suspend.
+ */
+#define NAU_IRQ_POLL_FAST_MS	20
+#define NAU_IRQ_POLL_FAST_NUM	50
+
+struct nau_irq_poll {
+	struct delayed_work work;
+	struct device *dev;
+	struct regmap *regmap;
+	unsigned int reg;	/* the status */
+	unsigned int mask;	/* the causes in the status */
+	irq_handler_t handler;
+	irq_handler_t thread_fn;
+	void *data;
+	u32 period_ms;		/* 0 if the line is wired */
+	unsigned int fast;	/* fast polls left */
+	int depth;		/* disabled as disable_irq() nests */
+	u32 polls;
+	u32 handled;
+};
+
+static inline bool nau_irq_polled(const struct nau_irq_poll *poll)
+{
+	return poll->period_ms;
+}
+
+static inline void nau_irq_poll_work(struct work_struct *work)
+{
+	struct nau_irq_poll *poll = container_of(to_delayed_work(work),
+		struct nau_irq_poll, work);
+	unsigned int status;
+	int ret;
+
+	poll->polls++;
+	/* the last busy mark is left alone, so the codec suspends again */
+	if (pm_runtime_resume_and_get(poll->dev) < 0)
+		goto next;
+	ret = regmap_read(poll->regmap, poll->reg, &status);
+	pm_runtime_put_autosuspend(poll->dev);
+	if (!ret && (status & poll->mask)) {
+		poll->handled++;
+		poll->fast = NAU_IRQ_POLL_FAST_NUM;
+		if (poll->handler)
+			poll->handler(0, poll->data);
+		poll->thread_fn(0, poll->data);
+	} else if (poll->fast) {
+		poll->fast--;
+	}
+ next:
+	queue_delayed_work(system_freezable_power_efficient_wq, &poll->work,
+		msecs_to_jiffies(poll->fast ? NAU_IRQ_POLL_FAST_MS :
+		poll->period_ms));
+}
+
+/**
+ * nau_irq_poll_init - set up the polls in place of the interruption
+ * @poll: the polls, with the period read from the device properties
+ * @dev: device of the codec
+ * @regmap: register map of the codec
+ * @reg: the status register
+ * @mask: the causes in the status
+ * @handler: hard interruption handler, or NULL
+ * @thread_fn: thread function
+ * @data: argument of the handlers
+ *
+ * The handlers are called with the interruption 0, the hard one first.
+ * The polls start disabled, as a line requested with IRQF_NO_AUTOEN.
+ */
+static inline void nau_irq_poll_init(struct nau_irq_poll *poll,
+	struct device *dev, struct regmap *regmap, unsigned int reg,
+	unsigned int mask, irq_handler_t handler, irq_handler_t thread_fn,
+	void *data)
+{
+	INIT_DELAYED_WORK(&poll->work, nau_irq_poll_work);
+	poll->dev = dev;
+	poll->regmap = regmap;
+	poll->reg = reg;
+	poll->mask = mask;
+	poll->handler = handler;
+	poll->thread_fn = thread_fn;
+	poll->data = data;
+	poll->depth = 1;
+}
+
+/* Not from the thread function, which the disable waits for */
+static inline void nau_irq_poll_disable(struct nau_irq_poll *poll)
+{
+	if (nau_irq_polled(poll) && !poll->depth++)
+		cancel_delayed_work_sync(&poll->work);
+}
+
+/* The first poll comes at once, for the changes meanwhile */
+static inline void nau_irq_poll_enable(struct nau_irq_poll *poll)
+{
+	if (!nau_irq_polled(poll) || WARN_ON(!poll->depth) || --poll->depth)
+		return;
+	poll->fast = 0;
+	queue_delayed_work(system_freezable_power_efficient_wq, &poll->work, 0);
+}
+
+#ifdef CONFIG_DEBUG_FS
+static inline void nau_irq_poll_debugfs_init(struct dentry *root,
+	struct nau_irq_poll *poll)
+{
+	if (!root || !nau_irq_polled(poll))
+		return;
+	debugfs_create_u32("jack_poll_ms", 0444, root, &poll->period_ms);
+	debugfs_create_u32("jack_polls", 0444, root, &poll->polls);
+	debugfs_create_u32("jack_polls_handled", 0444, root, &poll->handled);
+}
+#else
+static inline void nau_irq_poll_debugfs_init(struct dentry *root,
+	struct nau_irq_poll *poll)
+{
+}
+#endif
+
+#endif /* __NAU_IRQ_H__ */
@@ -0,0 +1,51 @@
+/* SPDX-License-Identifier: GPL-2.0-only */
+/*
+ * Deferred settle of the DAPM events of the Nuvoton codec drivers
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ */
+
+#ifndef __NAU_SETTLE_H__
+#define __NAU_SETTLE_H__
+
+#include <linux/delay.h>
+#include <linux/ktime.h>
+
+/* The settle time of a block powered up by a DAPM event. The event only
+ * records when the block is ready, and the DAPM sequence goes on; the
+ * widget that depends on the block waits for the time left, which the
+ * widgets powered in between have already taken a part of.
+ */
+struct nau_settle {
+	ktime_t ready;
+	bool pending;
+};
+
+static inline void nau_settle_start(struct nau_settle *settle,
+	unsigned int ms)
+{
+	settle->ready = ktime_add_ms(ktime_get(), ms);
+	settle->pending = true;
+}
+
+static inline void nau_settle_cancel(struct nau_settle *settle)
+{
+	settle->pending = false;
+}
+
+/* Returns true if the settle was pending, as the waiter which ends it */
+static inline bool nau_settle_wait(struct nau_settle *settle)
+{
+	s64 left_us;
+
+	if (!settle->pending)
+		return false;
+	left_us = ktime_us_delta(settle->ready, ktime_get());
+	if (left_us > 0)
+		usleep_range(left_us, left_us + 500);
+	settle->pending = false;
+
+	return true;
+}
+
+#endif /* __NAU_SETTLE_H__ */
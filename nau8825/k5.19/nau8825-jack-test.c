@@ -0,0 +1,792 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the jack detection of NAU88L25
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8825.c, as the interruption handler and the
+ * cross talk measurement are static. The device sits on a fake I2C
+ * adapter, which plays the jack side of the chip: the jack pin, the
+ * debounce of the insertion and the ejection, the jack type detection
+ * after a restart, and the impedance measurement, each raising its status
+ * after the time modelled below. The line of the codec is a simulated
+ * interruption. The tests script the plugs, check the jack reports, and
+ * report the time from the last plug edge to the report.
+ */
+
+#include <kunit/test.h>
+#include <linux/delay.h>
+#include <linux/i2c.h>
+#include <linux/interrupt.h>
+#include <linux/irq.h>
+#include <linux/irq_sim.h>
+#include <linux/irqdomain.h>
+#include <linux/ktime.h>
+#include <linux/property.h>
+
+#define NAU8825_TEST_ADDR		0x1a
+/* the jack type detection after a restart at auto mode */
+#define NAU8825_TEST_DETECT_MS		20
+/* an impedance measurement after IMM_EN */
+#define NAU8825_TEST_IMM_MS		20
+/* the longest wait of a plug for its report, a measurement in it */
+#define NAU8825_TEST_WAIT_MS		1000
+#define NAU8825_TEST_XTALK_MS		3000
+/* the reports kept of a test */
+#define NAU8825_TEST_REPORT_NUM		8
+
+/* the causes of the status, which the mask bits of the same place mask */
+#define NAU8825_TEST_CAUSES (NAU8825_JACK_INSERTION_DETECTED | \
+	NAU8825_JACK_EJECTION_DETECTED | NAU8825_KEY_SHORT_PRESS_IRQ | \
+	NAU8825_KEY_LONG_PRESS_IRQ | NAU8825_KEY_RELEASE_IRQ | \
+	NAU8825_IMPEDANCE_MEAS_IRQ | NAU8825_HEADSET_COMPLETION_IRQ)
+
+/* a headset as the chip measures it */
+struct nau8825_test_headset {
+	/* the jack type of GENERAL_STATUS, 2 for CTIA */
+	int mic_type;
+	u16 sar;
+	/* IMM_RMS_L of the right and the left headphone */
+	u16 hpr_rms;
+	u16 hpl_rms;
+};
+
+static const struct nau8825_test_headset nau8825_test_ctia = {
+	.mic_type = 2,
+	.sar = 0x40,
+	.hpr_rms = 0x200,
+	.hpl_rms = 0x20,
+};
+
+struct nau8825_test_chip {
+	struct i2c_adapter adap;
+	/* the bus against the steps of the test */
+	struct mutex lock;
+	/* register addressed by the last write on the bus */
+	unsigned int reg;
+	u16 regs[NAU8825_REG_MAX + 1];
+	bool plugged;
+	const struct nau8825_test_headset *headset;
+	/* the events of the chip due, 0 for none */
+	ktime_t insert_due;
+	ktime_t eject_due;
+	ktime_t detect_due;
+	ktime_t imm_due;
+	/* the line asserted, and a falling edge on it not raised yet */
+	bool line;
+	bool edge;
+	unsigned int xfers;
+};
+
+struct nau8825_test_report {
+	int status;
+	s64 us;
+};
+
+struct nau8825_test_ctx {
+	struct nau8825_test_chip chip;
+	struct irq_domain *domain;
+	int virq;
+	struct i2c_client *client;
+	void *group;
+	struct nau8825 *nau8825;
+	/* the card, the component and the jack of the machine driver */
+	struct snd_soc_card card;
+	struct snd_soc_component component;
+	struct snd_soc_jack jack;
+	struct notifier_block nb;
+	spinlock_t report_lock;
+	ktime_t edge_time;
+	struct nau8825_test_report report[NAU8825_TEST_REPORT_NUM];
+	unsigned int reports;
+};
+
+/* The jack pin active low and pulled up. The simulated interruption
+ * takes no level, so the board asks for the falling edge.
+ */
+static const struct property_entry nau8825_test_props[] = {
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-enable"),
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-pull-enable"),
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-pull-up"),
+	PROPERTY_ENTRY_BOOL("nuvoton,irq-edge-trigger"),
+	{ }
+};
+
+static const struct software_node nau8825_test_board = {
+	.properties = nau8825_test_props,
+};
+
+static const struct property_entry nau8825_test_xtalk_props[] = {
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-enable"),
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-pull-enable"),
+	PROPERTY_ENTRY_BOOL("nuvoton,jkdet-pull-up"),
+	PROPERTY_ENTRY_BOOL("nuvoton,irq-edge-trigger"),
+	PROPERTY_ENTRY_BOOL("nuvoton,crosstalk-enable"),
+	{ }
+};
+
+static const struct software_node nau8825_test_xtalk_board = {
+	.properties = nau8825_test_xtalk_props,
+};
+
+static void nau8825_test_chip_reset(struct nau8825_test_chip *chip)
+{
+	int i;
+
+	memset(chip->regs, 0, sizeof(chip->regs));
+	for (i = 0; i < ARRAY_SIZE(nau8825_reg_defaults); i++)
+		chip->regs[nau8825_reg_defaults[i].reg] =
+			nau8825_reg_defaults[i].def;
+	chip->insert_due = chip->eject_due = 0;
+	chip->detect_due = chip->imm_due = 0;
+}
+
+/* the debounce of the jack pin, 4ms to 512ms by the selection */
+static unsigned int nau8825_test_db_ms(u16 jkdet, unsigned int mask,
+				       unsigned int sft)
+{
+	if (jkdet & NAU8825_JACK_DET_DB_BYPASS)
+		return 0;
+
+	return 4 << ((jkdet & mask) >> sft);
+}
+
+static u16 nau8825_test_reg_read(struct nau8825_test_chip *chip,
+				 unsigned int reg)
+{
+	bool active_high;
+
+	switch (reg) {
+	case NAU8825_REG_I2C_DEVICE_ID:
+		/* GPIO2JD1 is the jack pin, at the polarity when plugged */
+		active_high = chip->regs[NAU8825_REG_JACK_DET_CTRL] &
+			NAU8825_JACK_POLARITY;
+		return NAU8825_SOFTWARE_ID_NAU8825 |
+			(chip->plugged == active_high ? NAU8825_GPIO2JD1 : 0);
+	case NAU8825_REG_SARDOUT_RAM_STATUS:
+		return chip->plugged && chip->headset ? chip->headset->sar : 0;
+	default:
+		return reg <= NAU8825_REG_MAX ? chip->regs[reg] : 0;
+	}
+}
+
+static void nau8825_test_reg_write(struct nau8825_test_chip *chip,
+				   unsigned int reg, u16 val)
+{
+	u16 old;
+
+	if (reg > NAU8825_REG_MAX)
+		return;
+	old = chip->regs[reg];
+	switch (reg) {
+	case NAU8825_REG_RESET:
+		nau8825_test_chip_reset(chip);
+		return;
+	case NAU8825_REG_INT_CLR_KEY_STATUS:
+		chip->regs[NAU8825_REG_IRQ_STATUS] &= ~val;
+		return;
+	case NAU8825_REG_IRQ_STATUS:
+	case NAU8825_REG_IMM_RMS_L:
+	case NAU8825_REG_I2C_DEVICE_ID:
+	case NAU8825_REG_SARDOUT_RAM_STATUS:
+	case NAU8825_REG_GENERAL_STATUS:
+		return;
+	case NAU8825_REG_JACK_DET_CTRL:
+		/* the detection restarts as RESTART goes back to 0 */
+		if ((old & NAU8825_JACK_DET_RESTART) &&
+			!(val & NAU8825_JACK_DET_RESTART))
+			chip->detect_due = ktime_add_ms(ktime_get(),
+				NAU8825_TEST_DETECT_MS);
+		break;
+	case NAU8825_REG_IMM_MODE_CTRL:
+		if (!(val & NAU8825_IMM_EN))
+			chip->imm_due = 0;
+		else if (!(old & NAU8825_IMM_EN))
+			chip->imm_due = ktime_add_ms(ktime_get(),
+				NAU8825_TEST_IMM_MS);
+		break;
+	default:
+		break;
+	}
+	chip->regs[reg] = val;
+}
+
+/* The line is low while a cause not masked is pending, and the output
+ * enabled; it goes low with a falling edge.
+ */
+static void nau8825_test_chip_line(struct nau8825_test_chip *chip)
+{
+	u16 mask = chip->regs[NAU8825_REG_INTERRUPT_MASK];
+	bool line = (mask & NAU8825_IRQ_OUTPUT_EN) &&
+		(chip->regs[NAU8825_REG_IRQ_STATUS] & ~mask &
+		 NAU8825_TEST_CAUSES);
+
+	if (line && !chip->line)
+		chip->edge = true;
+	chip->line = line;
+}
+
+static bool nau8825_test_due(ktime_t *due, ktime_t now)
+{
+	if (!*due || ktime_before(now, *due))
+		return false;
+	*due = 0;
+
+	return true;
+}
+
+/* Raise the status of the events of the chip due at @now */
+static void nau8825_test_chip_step(struct nau8825_test_chip *chip,
+				   ktime_t now)
+{
+	const struct nau8825_test_headset *hs = chip->headset;
+	u16 *regs = chip->regs;
+	u16 dis = regs[NAU8825_REG_INTERRUPT_DIS_CTRL];
+	u16 bias = regs[NAU8825_REG_BIAS_ADJ];
+
+	if (nau8825_test_due(&chip->insert_due, now) && chip->plugged &&
+		!(dis & NAU8825_IRQ_INSERT_DIS))
+		regs[NAU8825_REG_IRQ_STATUS] |= NAU8825_JACK_INSERTION_DETECTED;
+	if (nau8825_test_due(&chip->eject_due, now) && !chip->plugged &&
+		!(dis & NAU8825_IRQ_EJECT_DIS))
+		regs[NAU8825_REG_IRQ_STATUS] |= NAU8825_JACK_EJECTION_DETECTED;
+	if (nau8825_test_due(&chip->detect_due, now) && chip->plugged && hs &&
+		(regs[NAU8825_REG_HSD_CTRL] & NAU8825_HSD_AUTO_MODE)) {
+		regs[NAU8825_REG_GENERAL_STATUS] =
+			(regs[NAU8825_REG_GENERAL_STATUS] & ~(3 << 10)) |
+			(hs->mic_type << 10);
+		if (!(dis & NAU8825_IRQ_HEADSET_COMPLETE_DIS))
+			regs[NAU8825_REG_IRQ_STATUS] |=
+				NAU8825_HEADSET_COMPLETION_IRQ;
+	}
+	if (nau8825_test_due(&chip->imm_due, now) && chip->plugged && hs) {
+		if (bias & NAU8825_BIAS_HPR_IMP)
+			regs[NAU8825_REG_IMM_RMS_L] = hs->hpr_rms;
+		else if (bias & NAU8825_BIAS_HPL_IMP)
+			regs[NAU8825_REG_IMM_RMS_L] = hs->hpl_rms;
+		else
+			regs[NAU8825_REG_IMM_RMS_L] = 0;
+		regs[NAU8825_REG_IRQ_STATUS] |= NAU8825_IMPEDANCE_MEAS_IRQ;
+	}
+}
+
+/* Transfers of 16 bit registers, auto incremented over several values */
+static int nau8825_test_xfer(struct i2c_adapter *adap, struct i2c_msg *msgs,
+			     int num)
+{
+	struct nau8825_test_chip *chip = i2c_get_adapdata(adap);
+	struct i2c_msg *msg;
+	unsigned int val;
+	int i, j, ret = num;
+
+	mutex_lock(&chip->lock);
+	chip->xfers++;
+	for (i = 0; i < num; i++) {
+		msg = &msgs[i];
+		if (msg->len % 2) {
+			ret = -EINVAL;
+			break;
+		}
+		if (msg->flags & I2C_M_RD) {
+			for (j = 0; j < msg->len; j += 2, chip->reg++) {
+				val = nau8825_test_reg_read(chip, chip->reg);
+				msg->buf[j] = val >> 8;
+				msg->buf[j + 1] = val & 0xff;
+			}
+			continue;
+		}
+		if (!msg->len) {
+			ret = -EINVAL;
+			break;
+		}
+		chip->reg = (msg->buf[0] << 8) | msg->buf[1];
+		for (j = 2; j < msg->len; j += 2, chip->reg++)
+			nau8825_test_reg_write(chip, chip->reg,
+					       (msg->buf[j] << 8) | msg->buf[j + 1]);
+	}
+	nau8825_test_chip_line(chip);
+	mutex_unlock(&chip->lock);
+
+	return ret;
+}
+
+static u32 nau8825_test_func(struct i2c_adapter *adap)
+{
+	return I2C_FUNC_I2C;
+}
+
+static const struct i2c_algorithm nau8825_test_algo = {
+	.master_xfer = nau8825_test_xfer,
+	.functionality = nau8825_test_func,
+};
+
+static u16 nau8825_test_reg(struct nau8825_test_ctx *ctx, unsigned int reg)
+{
+	u16 val;
+
+	mutex_lock(&ctx->chip.lock);
+	val = nau8825_test_reg_read(&ctx->chip, reg);
+	mutex_unlock(&ctx->chip.lock);
+
+	return val;
+}
+
+/* A step of the chip: raise the events due and the edge of the line */
+static void nau8825_test_tick(struct nau8825_test_ctx *ctx)
+{
+	struct nau8825_test_chip *chip = &ctx->chip;
+	bool edge;
+
+	mutex_lock(&chip->lock);
+	nau8825_test_chip_step(chip, ktime_get());
+	nau8825_test_chip_line(chip);
+	edge = chip->edge;
+	chip->edge = false;
+	mutex_unlock(&chip->lock);
+	if (edge)
+		irq_set_irqchip_state(ctx->virq, IRQCHIP_STATE_PENDING, true);
+	usleep_range(500, 1000);
+}
+
+/* Plug or pull out the jack, which starts the debounce of the pin */
+static void nau8825_test_plug(struct nau8825_test_ctx *ctx, bool plugged)
+{
+	struct nau8825_test_chip *chip = &ctx->chip;
+	u16 jkdet;
+	ktime_t now;
+
+	mutex_lock(&chip->lock);
+	now = ktime_get();
+	jkdet = chip->regs[NAU8825_REG_JACK_DET_CTRL];
+	chip->plugged = plugged;
+	if (plugged) {
+		chip->eject_due = 0;
+		chip->insert_due = ktime_add_ms(now, nau8825_test_db_ms(jkdet,
+			NAU8825_JACK_INSERT_DEBOUNCE_MASK,
+			NAU8825_JACK_INSERT_DEBOUNCE_SFT));
+	} else {
+		chip->insert_due = 0;
+		chip->eject_due = ktime_add_ms(now, nau8825_test_db_ms(jkdet,
+			NAU8825_JACK_EJECT_DEBOUNCE_MASK,
+			NAU8825_JACK_EJECT_DEBOUNCE_SFT));
+	}
+	mutex_unlock(&chip->lock);
+	spin_lock(&ctx->report_lock);
+	ctx->edge_time = now;
+	spin_unlock(&ctx->report_lock);
+}
+
+/* a plug edge at @ms after the start of a script */
+struct nau8825_test_edge {
+	unsigned int ms;
+	bool plugged;
+};
+
+static void nau8825_test_script(struct nau8825_test_ctx *ctx,
+				const struct nau8825_test_edge *edges, int num)
+{
+	ktime_t start = ktime_get();
+	int i = 0;
+
+	while (i < num) {
+		if (ktime_ms_delta(ktime_get(), start) >= edges[i].ms)
+			nau8825_test_plug(ctx, edges[i++].plugged);
+		else
+			nau8825_test_tick(ctx);
+	}
+}
+
+/* Run the chip until @done, or for @ms; true if done */
+static bool nau8825_test_wait(struct nau8825_test_ctx *ctx,
+			      bool (*done)(struct nau8825_test_ctx *ctx),
+			      unsigned int ms)
+{
+	ktime_t end = ktime_add_ms(ktime_get(), ms);
+
+	while (ktime_before(ktime_get(), end)) {
+		if (done && done(ctx))
+			return true;
+		nau8825_test_tick(ctx);
+	}
+
+	return done && done(ctx);
+}
+
+static int nau8825_test_jack_notify(struct notifier_block *nb,
+				    unsigned long status, void *data)
+{
+	struct nau8825_test_ctx *ctx =
+		container_of(nb, struct nau8825_test_ctx, nb);
+	struct nau8825_test_report *rpt;
+
+	spin_lock(&ctx->report_lock);
+	if (ctx->reports < NAU8825_TEST_REPORT_NUM) {
+		rpt = &ctx->report[ctx->reports];
+		rpt->status = status;
+		rpt->us = ktime_us_delta(ktime_get(), ctx->edge_time);
+	}
+	ctx->reports++;
+	spin_unlock(&ctx->report_lock);
+
+	return NOTIFY_OK;
+}
+
+/* The reports so far, and the last one in @rpt if any */
+static unsigned int nau8825_test_reports(struct nau8825_test_ctx *ctx,
+					 struct nau8825_test_report *rpt)
+{
+	unsigned int num;
+
+	spin_lock(&ctx->report_lock);
+	num = ctx->reports;
+	if (rpt && num)
+		*rpt = ctx->report[min_t(unsigned int, num,
+					 NAU8825_TEST_REPORT_NUM) - 1];
+	spin_unlock(&ctx->report_lock);
+
+	return num;
+}
+
+static bool nau8825_test_headset_in(struct nau8825_test_ctx *ctx)
+{
+	struct nau8825_test_report rpt;
+
+	return nau8825_test_reports(ctx, &rpt) &&
+		rpt.status == SND_JACK_HEADSET;
+}
+
+static bool nau8825_test_jack_out(struct nau8825_test_ctx *ctx)
+{
+	struct nau8825_test_report rpt;
+
+	return nau8825_test_reports(ctx, &rpt) && !rpt.status;
+}
+
+/* the cross talk measured, past its preparation */
+static bool nau8825_test_xtalk_imm(struct nau8825_test_ctx *ctx)
+{
+	int state = READ_ONCE(ctx->nau8825->xtalk_state);
+
+	return state != NAU8825_XTALK_PREPARE && state != NAU8825_XTALK_DONE;
+}
+
+static bool nau8825_test_xtalk_idle(struct nau8825_test_ctx *ctx)
+{
+	return !nau8825_xtalk_measuring(ctx->nau8825) &&
+		READ_ONCE(ctx->nau8825->xtalk_state) == NAU8825_XTALK_DONE;
+}
+
+static bool nau8825_test_pin_forced(struct nau8825_test_ctx *ctx,
+				    const char *pin)
+{
+	struct snd_soc_dapm_widget *w;
+
+	list_for_each_entry(w, &ctx->card.widgets, list)
+		if (w->dapm == &ctx->component.dapm && !strcmp(w->name, pin))
+			return w->force;
+
+	return false;
+}
+
+/* Probe the codec of @board, and arm the jack detection as the component
+ * probe and the card going to STANDBY do.
+ */
+static void nau8825_test_probe(struct kunit *test,
+			       const struct software_node *board)
+{
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct snd_soc_dapm_context *dapm = &ctx->component.dapm;
+	struct i2c_board_info info = {
+		I2C_BOARD_INFO("nau8825-kunit", NAU8825_TEST_ADDR),
+		.swnode = board,
+	};
+	struct i2c_client *client;
+	struct nau8825 *nau8825;
+
+	client = i2c_new_client_device(&ctx->chip.adap, &info);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, client);
+	ctx->client = client;
+	/* as the bus sets it up for a driver bound */
+	client->irq = ctx->virq;
+	ctx->group = devres_open_group(&client->dev, NULL, GFP_KERNEL);
+	KUNIT_ASSERT_NOT_ERR_OR_NULL(test, ctx->group);
+	KUNIT_ASSERT_EQ(test, nau8825_i2c_probe(client), 0);
+	nau8825 = i2c_get_clientdata(client);
+
+	ctx->card.dev = &client->dev;
+	ctx->component.dev = &client->dev;
+	snd_soc_dapm_init(dapm, &ctx->card, NULL);
+	KUNIT_ASSERT_EQ(test, snd_soc_dapm_new_controls(dapm,
+		nau8825_dapm_widgets, ARRAY_SIZE(nau8825_dapm_widgets)), 0);
+	nau8825->dapm = dapm;
+	INIT_DELAYED_WORK(&nau8825->adc_unmute_work, nau8825_adc_unmute_work);
+	ctx->nau8825 = nau8825;
+
+	nau8825_enable_jack_detect(&ctx->component, &ctx->jack);
+	KUNIT_ASSERT_EQ(test, nau8825_pm_get(nau8825), 0);
+	nau8825_resume_setup(nau8825);
+	nau8825_pm_put(nau8825);
+}
+
+static int nau8825_test_init(struct kunit *test)
+{
+	struct nau8825_test_ctx *ctx;
+	struct snd_soc_card *card;
+	struct snd_soc_jack *jack;
+	int ret;
+
+	ctx = kunit_kzalloc(test, sizeof(*ctx), GFP_KERNEL);
+	if (!ctx)
+		return -ENOMEM;
+	mutex_init(&ctx->chip.lock);
+	nau8825_test_chip_reset(&ctx->chip);
+	spin_lock_init(&ctx->report_lock);
+
+	card = &ctx->card;
+	card->name = "nau8825-kunit";
+	INIT_LIST_HEAD(&card->widgets);
+	INIT_LIST_HEAD(&card->paths);
+	INIT_LIST_HEAD(&card->dapm_list);
+	INIT_LIST_HEAD(&card->dapm_dirty);
+	mutex_init(&card->mutex);
+	mutex_init(&card->dapm_mutex);
+	ctx->component.dapm.card = card;
+	INIT_LIST_HEAD(&ctx->component.dapm.list);
+
+	/* no input device; the notifier takes the reports */
+	jack = &ctx->jack;
+	mutex_init(&jack->mutex);
+	INIT_LIST_HEAD(&jack->pins);
+	INIT_LIST_HEAD(&jack->jack_zones);
+	BLOCKING_INIT_NOTIFIER_HEAD(&jack->notifier);
+	jack->card = card;
+	ctx->nb.notifier_call = nau8825_test_jack_notify;
+	snd_soc_jack_notifier_register(jack, &ctx->nb);
+
+	ctx->domain = irq_domain_create_sim(NULL, 1);
+	if (IS_ERR(ctx->domain))
+		return PTR_ERR(ctx->domain);
+	ctx->virq = irq_create_mapping(ctx->domain, 0);
+	if (!ctx->virq) {
+		ret = -ENXIO;
+		goto err_domain;
+	}
+
+	ctx->chip.adap.owner = THIS_MODULE;
+	ctx->chip.adap.algo = &nau8825_test_algo;
+	strscpy(ctx->chip.adap.name, "nau8825-kunit",
+		sizeof(ctx->chip.adap.name));
+	i2c_set_adapdata(&ctx->chip.adap, &ctx->chip);
+	ret = i2c_add_adapter(&ctx->chip.adap);
+	if (ret)
+		goto err_mapping;
+	test->priv = ctx;
+
+	return 0;
+
+err_mapping:
+	irq_dispose_mapping(ctx->virq);
+err_domain:
+	irq_domain_remove_sim(ctx->domain);
+	return ret;
+}
+
+static void nau8825_test_exit(struct kunit *test)
+{
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct nau8825 *nau8825;
+
+	if (!ctx)
+		return;
+	nau8825 = ctx->nau8825;
+	if (nau8825) {
+		/* the line quiet, then as the component is removed */
+		nau8825_irq_disable(nau8825);
+		nau8825_adc_unmute_cancel(nau8825);
+		nau8825_xtalk_cancel(nau8825);
+		nau_jack_report_cancel(&nau8825->jack_rpt);
+		nau8825_duty_stop(nau8825);
+		cancel_delayed_work_sync(&nau8825->jack_db_work);
+		nau8825_fll_keep_stop(nau8825);
+		nau8825_i2c_remove(ctx->client);
+	}
+	if (ctx->group)
+		devres_release_group(&ctx->client->dev, ctx->group);
+	if (ctx->client)
+		i2c_unregister_device(ctx->client);
+	snd_soc_dapm_free(&ctx->component.dapm);
+	i2c_del_adapter(&ctx->chip.adap);
+	irq_dispose_mapping(ctx->virq);
+	irq_domain_remove_sim(ctx->domain);
+}
+
+/* A headset plugged and pulled out cleanly */
+static void nau8825_test_clean_plug(struct kunit *test)
+{
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct nau8825_test_report plug, eject;
+
+	nau8825_test_probe(test, &nau8825_test_board);
+	ctx->chip.headset = &nau8825_test_ctia;
+
+	nau8825_test_plug(ctx, true);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx,
+		nau8825_test_headset_in, NAU8825_TEST_WAIT_MS));
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, &plug), 1U);
+	KUNIT_EXPECT_TRUE(test, nau8825_test_pin_forced(ctx, "MICBIAS"));
+	KUNIT_EXPECT_TRUE(test, nau8825_test_pin_forced(ctx, "SAR"));
+
+	nau8825_test_plug(ctx, false);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx,
+		nau8825_test_jack_out, NAU8825_TEST_WAIT_MS));
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, &eject), 2U);
+	KUNIT_EXPECT_FALSE(test, nau8825_test_pin_forced(ctx, "MICBIAS"));
+	KUNIT_EXPECT_FALSE(test, nau8825_test_pin_forced(ctx, "SAR"));
+
+	kunit_info(test, "plug to report %lld us, eject to report %lld us, %u irq passes, %u bus transfers\n",
+		   plug.us, eject.us, ctx->nau8825->irq_count,
+		   ctx->chip.xfers);
+}
+
+/* A plug bouncing within the debounce of the ejection */
+static void nau8825_test_bounce(struct kunit *test)
+{
+	static const struct nau8825_test_edge edges[] = {
+		{ 0, true }, { 2, false }, { 5, true }, { 6, false },
+		{ 8, true },
+	};
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct nau8825_test_report rpt;
+
+	nau8825_test_probe(test, &nau8825_test_board);
+	ctx->chip.headset = &nau8825_test_ctia;
+
+	nau8825_test_script(ctx, edges, ARRAY_SIZE(edges));
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx,
+		nau8825_test_headset_in, NAU8825_TEST_WAIT_MS));
+	/* nothing behind it, once the report window passed */
+	nau8825_test_wait(ctx, NULL, 2 * NAU_JACK_REPORT_MS);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, &rpt), 1U);
+	KUNIT_EXPECT_EQ(test, rpt.status, SND_JACK_HEADSET);
+	KUNIT_EXPECT_EQ(test, ctx->jack.status, SND_JACK_HEADSET);
+
+	kunit_info(test, "settled plug to report %lld us, %u irq passes, %u merged\n",
+		   rpt.us, ctx->nau8825->irq_count,
+		   ctx->nau8825->jack_rpt.merged);
+}
+
+/* A stream preempts the cross talk measurement of the plug, which runs
+ * again once the codec is idle, without a report of its own.
+ */
+static void nau8825_test_plug_playback(struct kunit *test)
+{
+	const struct nau8825_test_headset *hs = &nau8825_test_ctia;
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct nau8825_test_report rpt;
+	struct nau8825 *nau8825;
+	ktime_t start;
+	s64 wait_us;
+	u32 sidetone;
+	bool owned;
+
+	if (!NAU8825_XTALK_BUILT)
+		kunit_skip(test, "cross talk measurement not built");
+	nau8825_test_probe(test, &nau8825_test_xtalk_board);
+	nau8825 = ctx->nau8825;
+	ctx->chip.headset = hs;
+
+	nau8825_test_plug(ctx, true);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx, nau8825_test_xtalk_imm,
+		NAU8825_TEST_WAIT_MS));
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, NULL), 0U);
+
+	/* the hw_params of the stream */
+	start = ktime_get();
+	owned = nau8825_audio_acquire(nau8825, 3 * HZ);
+	wait_us = ktime_us_delta(ktime_get(), start);
+	KUNIT_EXPECT_TRUE(test, owned);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx,
+		nau8825_test_headset_in, NAU8825_TEST_WAIT_MS));
+	nau8825_audio_release(nau8825, owned);
+	nau8825_test_reports(ctx, &rpt);
+	KUNIT_EXPECT_EQ(test, nau8825->xtalk_preempt_count, 1U);
+	KUNIT_EXPECT_TRUE(test, nau8825->xtalk_deferred);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reg(ctx, NAU8825_REG_DAC_DGAIN_CTRL),
+			(u16)0);
+
+	/* the STANDBY after the stream */
+	nau8825_xtalk_rerun(nau8825);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx, nau8825_test_xtalk_idle,
+		NAU8825_XTALK_IDLE_MS + NAU8825_TEST_XTALK_MS));
+	nau8825_test_wait(ctx, NULL, 2 * NAU_JACK_REPORT_MS);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, NULL), 1U);
+	KUNIT_EXPECT_FALSE(test, nau8825->xtalk_deferred);
+	KUNIT_EXPECT_EQ(test, nau8825->imp_rms[NAU8825_XTALK_HPR_R2L],
+			(int)hs->hpr_rms);
+	KUNIT_EXPECT_EQ(test, nau8825->imp_rms[NAU8825_XTALK_HPL_R2L],
+			(int)hs->hpl_rms);
+	sidetone = nau8825_xtalk_sidetone(hs->hpr_rms, hs->hpl_rms);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reg(ctx, NAU8825_REG_DAC_DGAIN_CTRL),
+			(u16)((sidetone << 8) | sidetone));
+
+	kunit_info(test, "plug to report %lld us, stream waited %lld us, %u irq passes\n",
+		   rpt.us, wait_us, nau8825->irq_count);
+}
+
+/* The jack pulled out during the cross talk measurement, which stops and
+ * reports nothing.
+ */
+static void nau8825_test_eject_xtalk(struct kunit *test)
+{
+	struct nau8825_test_ctx *ctx = test->priv;
+	struct nau8825 *nau8825;
+	s64 idle_us;
+	ktime_t start;
+	bool owned;
+
+	if (!NAU8825_XTALK_BUILT)
+		kunit_skip(test, "cross talk measurement not built");
+	nau8825_test_probe(test, &nau8825_test_xtalk_board);
+	nau8825 = ctx->nau8825;
+	ctx->chip.headset = &nau8825_test_ctia;
+
+	nau8825_test_plug(ctx, true);
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx, nau8825_test_xtalk_imm,
+		NAU8825_TEST_WAIT_MS));
+
+	nau8825_test_plug(ctx, false);
+	start = ktime_get();
+	KUNIT_ASSERT_TRUE(test, nau8825_test_wait(ctx, nau8825_test_xtalk_idle,
+		NAU8825_TEST_WAIT_MS));
+	idle_us = ktime_us_delta(ktime_get(), start);
+	nau8825_test_wait(ctx, NULL, 2 * NAU_JACK_REPORT_MS);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reports(ctx, NULL), 0U);
+	KUNIT_EXPECT_EQ(test, ctx->jack.status, 0);
+	KUNIT_EXPECT_EQ(test, nau8825_test_reg(ctx, NAU8825_REG_IMM_MODE_CTRL),
+			(u16)0);
+	KUNIT_EXPECT_FALSE(test, nau8825_test_pin_forced(ctx, "MICBIAS"));
+
+	/* the protection is free for a stream */
+	owned = nau8825_audio_acquire(nau8825, 0);
+	KUNIT_EXPECT_TRUE(test, owned);
+	nau8825_audio_release(nau8825, owned);
+
+	kunit_info(test, "eject to the measurement stopped %lld us, %u irq passes, %u merged\n",
+		   idle_us, nau8825->irq_count, nau8825->jack_rpt.merged);
+}
+
+static struct kunit_case nau8825_jack_test_cases[] = {
+	KUNIT_CASE(nau8825_test_clean_plug),
+	KUNIT_CASE(nau8825_test_bounce),
+	KUNIT_CASE(nau8825_test_plug_playback),
+	KUNIT_CASE(nau8825_test_eject_xtalk),
+	{}
+};
+
+static struct kunit_suite nau8825_jack_test_suite = {
+	.name = "nau8825-jack",
+	.init = nau8825_test_init,
+	.exit = nau8825_test_exit,
+	.test_cases = nau8825_jack_test_cases,
+};
+kunit_test_suite(nau8825_jack_test_suite);
@@ -0,0 +1,147 @@
+// SPDX-License-Identifier: GPL-2.0-only
+/*
+ * KUnit tests of the clocks of NAU88L25
+ *
+ * Copyright 2022 Nuvoton Technology Corp.
+ *
+ * Included at the end of nau8825.c, as the FLL description and the OSR
+ * tables are static. The solver itself is tested by nau-fll-test.c; this
+ * checks the tables of the driver against its limits.
+ */
+
+#include <kunit/test.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>
+
+static const unsigned int nau8825_test_mclk[] = {
+	256000, 512000, 1024000, 1411200, 1536000, 2048000, 2822400,
+	3072000, 4096000, 5644800, 6144000, 11289600, 12000000, 12288000,
+	13000000, 19200000, 22579200, 24000000, 24576000, 26000000,
+	38400000, 49152000,
+};
+
+static const unsigned int nau8825_test_fs[] = {
+	8000, 11025, 16000, 22050, 32000, 44100, 48000, 64000, 88200,
+	96000, 176400, 192000,
+};
+
+static unsigned int nau8825_test_param(const struct nau_fll_attr *attr,
+	int num, int val)
+{
+	int i;
+
+	for (i = 0; i < num; i++)
+		if (attr[i].val == val)
+			return attr[i].param;
+
+	return 0;
+}
+
+/* Sweep MCLK x fs with the FLL of the driver, both fractional widths */
+static void nau8825_test_fll_sweep(struct kunit *test)
+{
+	struct nau_fll_cache cache = { 0 };
+	struct nau_fll fll, hit;
+	unsigned int pre, scale, bits;
+	int i, f, ret, calls = 0, solved = 0;
+	ktime_t start, spent = 0;
+	u64 fvco;
+
+	for (bits = 16; bits <= 24; bits += 8)
+		for (f = 0; f < ARRAY_SIZE(nau8825_test_fs); f++)
+			for (i = 0; i < ARRAY_SIZE(nau8825_test_mclk); i++) {
+				start = ktime_get();
+				ret = nau_fll_calc(&nau8825_fll_desc,
+					nau8825_test_mclk[i],
+					nau8825_test_fs[f], bits, &fll);
+				spent = ktime_add(spent,
+					ktime_sub(ktime_get(), start));
+				calls++;
+				KUNIT_EXPECT_EQ_MSG(test, ret, 0,
+					"MCLK %u fs %u", nau8825_test_mclk[i],
+					nau8825_test_fs[f]);
+				if (ret)
+					continue;
+				solved++;
+				pre = nau8825_test_param(fll_pre_scalar,
+					ARRAY_SIZE(fll_pre_scalar),
+					fll.clk_ref_div);
+				scale = nau8825_test_param(mclk_src_scaling,
+					ARRAY_SIZE(mclk_src_scaling),
+					fll.mclk_src);
+				KUNIT_ASSERT_NE(test, pre, 0U);
+				KUNIT_ASSERT_NE(test, scale, 0U);
+				KUNIT_EXPECT_LE(test, nau8825_test_mclk[i] / pre,
+					(unsigned int)NAU_FREF_MAX);
+				fvco = 256ULL * nau8825_test_fs[f] * 2 * scale;
+				KUNIT_EXPECT_GT(test, fvco, (u64)NAU_FVCO_MIN);
+				KUNIT_EXPECT_LT(test, fvco, (u64)NAU_FVCO_MAX);
+
+				/* the cache gives the solution solved */
+				KUNIT_ASSERT_EQ(test, nau_fll_solve(
+					&nau8825_fll_desc, &cache,
+					nau8825_test_mclk[i],
+					nau8825_test_fs[f], bits, &hit), 0);
+				KUNIT_EXPECT_EQ(test, memcmp(&hit, &fll,
+					sizeof(fll)), 0);
+			}
+	KUNIT_EXPECT_EQ(test, solved, calls);
+	kunit_info(test, "%d of %d solved, %lld ns per call\n", solved, calls,
+		div_s64(ktime_to_ns(spent), calls));
+}
+
+/* The OSR of each policy is within CLK_DA_AD_MAX, the highest or lowest */
+static void nau8825_test_osr_pick(struct kunit *test)
+{
+	static const int policies[] = {
+		NAU8825_OSR_LOW_LATENCY, NAU8825_OSR_LOW_POWER,
+		NAU8825_OSR_QUALITY,
+	};
+	const struct nau8825_osr_attr *sel;
+	unsigned int fs;
+	int f, p, s, i, num, pick;
+
+	for (f = 0; f < ARRAY_SIZE(nau8825_test_fs); f++) {
+		fs = nau8825_test_fs[f];
+		for (s = 0; s < 2; s++) {
+			sel = s ? osr_adc_sel : osr_dac_sel;
+			num = s ? ARRAY_SIZE(osr_adc_sel) :
+				ARRAY_SIZE(osr_dac_sel);
+			for (p = 0; p < ARRAY_SIZE(policies); p++) {
+				pick = nau8825_osr_pick(sel, num, fs,
+					policies[p]);
+				KUNIT_ASSERT_GE_MSG(test, pick, 0,
+					"fs %u %s policy %d", fs,
+					s ? "ADC" : "DAC", policies[p]);
+				KUNIT_EXPECT_NE(test, sel[pick].osr, 0U);
+				KUNIT_EXPECT_LE(test, fs * sel[pick].osr,
+					(unsigned int)CLK_DA_AD_MAX);
+				for (i = 0; i < num; i++) {
+					if (!sel[i].osr ||
+					    fs * sel[i].osr > CLK_DA_AD_MAX)
+						continue;
+					if (policies[p] == NAU8825_OSR_LOW_POWER)
+						KUNIT_EXPECT_LE(test,
+							sel[pick].osr,
+							sel[i].osr);
+					else
+						KUNIT_EXPECT_GE(test,
+							sel[pick].osr,
+							sel[i].osr);
+				}
+			}
+		}
+	}
+}
+
+static struct kunit_case nau8825_test_cases[] = {
+	KUNIT_CASE(nau8825_test_fll_sweep),
+	KUNIT_CASE(nau8825_test_osr_pick),
+	{}
+};
+
+static struct kunit_suite nau8825_test_suite = {
+	.name = "nau8825-clk",
+	.test_cases = nau8825_test_cases,
+};
+kunit_test_suite(nau8825_test_suite);
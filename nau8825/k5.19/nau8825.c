@@ -12,12 +12,20 @@
 #include <linux/delay.h>
 #include <linux/init.h>
 #include <linux/i2c.h>
+#include <linux/input.h>
+#include <linux/pm_runtime.h>
 #include <linux/regmap.h>
 #include <linux/slab.h>
 #include <linux/clk.h>
 #include <linux/acpi.h>
 #include <linux/math64.h>
-#include <linux/semaphore.h>
+#include <linux/atomic.h>
+#include <linux/debugfs.h>
+#include <linux/wait.h>
+#include <linux/completion.h>
+#include <linux/mutex.h>
+#include <linux/nvmem-consumer.h>
+#include <linux/workqueue.h>
 
 #include <sound/initval.h>
 #include <sound/tlv.h>
@@ -28,6 +36,21 @@
 #include <sound/jack.h>
 
 
+#include "nau-regmap.h"
+#include "nau-biq.h"
+#include "nau-clkplan.h"
+#include "nau-dapm-stat.h"
+#include "nau-delay.h"
+#include "nau-duty.h"
+#include "nau-fll.h"
+#include "nau-hwparams.h"
+#include "nau-irq.h"
+#include "nau-jack.h"
+#include "nau-latency.h"
+#include "nau-pm.h"
+#include "nau-props.h"
+#include "nau-scene.h"
+#include "nau-settle.h"
 #include "nau8825.h"
 
 
@@ -38,33 +61,49 @@
 #define NAU_FVCO_MIN 90000000
 
 /* cross talk suppression detection */
-#define LOG10_MAGIC 646456993
+/* 20 * log10(2) * 1000 / 2^16 in Q24 */
+#define MDB_PER_LOG2_Q16 1541274
 #define GAIN_AUGMENT 22500
 #define SIDETONE_BASE 207000
 
 /* the maximum frequency of CLK_ADC and CLK_DAC */
 #define CLK_DA_AD_MAX 6144000
 
+/* The probe attempts of the driver, the deferred ones included, and the
+ * time spent in them, for debugfs.
+ */
+static u32 nau8825_probe_attempts;
+static u32 nau8825_probe_us;
+
+/* headphone volume ramp, 10ms per step */
+#define NAU8825_HPVOL_RAMP_DELAY_MS 10
+#define NAU8825_HPVOL_RAMP_TIMEOUT_MS 1000
+
+/* The cross talk measurement builds in, unless the kernel picks the
+ * features of the Nuvoton codecs by CONFIG_SND_SOC_NAU_FEATURES without
+ * CONFIG_SND_SOC_NAU8825_XTALK. Its branches then fold away, and the
+ * measurement with them; the factory calibration stays.
+ */
+#define NAU8825_XTALK_BUILT (!IS_ENABLED(CONFIG_SND_SOC_NAU_FEATURES) || \
+	IS_ENABLED(CONFIG_SND_SOC_NAU8825_XTALK))
+
+static inline bool nau8825_xtalk_on(struct nau8825 *nau8825)
+{
+	return NAU8825_XTALK_BUILT && nau8825->xtalk_enable;
+}
+
 static int nau8825_configure_sysclk(struct nau8825 *nau8825,
 		int clk_id, unsigned int freq);
-static bool nau8825_is_jack_inserted(struct regmap *regmap);
-
-struct nau8825_fll {
-	int mclk_src;
-	int ratio;
-	int fll_frac;
-	int fll_frac_num;
-	int fll_int;
-	int clk_ref_div;
-};
-
-struct nau8825_fll_attr {
-	unsigned int param;
-	unsigned int val;
-};
+static int nau8825_clk_plan_run(struct nau8825 *nau8825,
+		struct snd_pcm_hw_params *params, struct snd_soc_dai *dai);
+static bool nau8825_jack_present(struct nau8825 *nau8825);
+static void nau8825_adc_detect_off(struct nau8825 *nau8825);
+static void nau8825_warm_update(struct nau8825 *nau8825);
+static void nau8825_duty_start(struct nau8825 *nau8825);
+static void nau8825_duty_stop(struct nau8825 *nau8825);
 
 /* scaling for mclk from sysclk_src output */
-static const struct nau8825_fll_attr mclk_src_scaling[] = {
+static const struct nau_fll_attr mclk_src_scaling[] = {
 	{ 1, 0x0 },
 	{ 2, 0x2 },
 	{ 4, 0x3 },
@@ -81,7 +120,7 @@ static const struct nau8825_fll_attr mclk_src_scaling[] = {
 };
 
 /* ratio for input clk freq */
-static const struct nau8825_fll_attr fll_ratio[] = {
+static const struct nau_fll_attr fll_ratio[] = {
 	{ 512000, 0x01 },
 	{ 256000, 0x02 },
 	{ 128000, 0x04 },
@@ -91,13 +130,25 @@ static const struct nau8825_fll_attr fll_ratio[] = {
 	{ 4000, 0x40 },
 };
 
-static const struct nau8825_fll_attr fll_pre_scalar[] = {
+static const struct nau_fll_attr fll_pre_scalar[] = {
 	{ 1, 0x0 },
 	{ 2, 0x1 },
 	{ 4, 0x2 },
 	{ 8, 0x3 },
 };
 
+static const struct nau_fll_desc nau8825_fll_desc = {
+	.mclk_src = mclk_src_scaling,
+	.num_mclk_src = ARRAY_SIZE(mclk_src_scaling),
+	.ratio = fll_ratio,
+	.num_ratio = ARRAY_SIZE(fll_ratio),
+	.pre_scalar = fll_pre_scalar,
+	.num_pre_scalar = ARRAY_SIZE(fll_pre_scalar),
+	.fref_max = NAU_FREF_MAX,
+	.fvco_min = NAU_FVCO_MIN,
+	.fvco_max = NAU_FVCO_MAX,
+};
+
 /* over sampling rate */
 struct nau8825_osr_attr {
 	unsigned int osr;
@@ -119,6 +170,10 @@ static const struct nau8825_osr_attr osr_adc_sel[] = {
 	{ 256, 0 },	/* OSR 256, SRC 1 */
 };
 
+/* the group delay of the converter filters, by their design */
+static const struct nau_delay_filter nau8825_dac_filter = { 17, 128 };
+static const struct nau_delay_filter nau8825_adc_filter = { 13, 96 };
+
 static const struct reg_default nau8825_reg_defaults[] = {
 	{ NAU8825_REG_ENA_CTRL, 0x00ff },
 	{ NAU8825_REG_IIC_ADDR_SET, 0x0 },
@@ -196,11 +251,11 @@ static const struct reg_default nau8825_reg_defaults[] = {
 };
 
 /* register backup table when cross talk detection */
-static struct reg_default nau8825_xtalk_baktab[] = {
-	{ NAU8825_REG_ADC_DGAIN_CTRL, 0x00cf },
-	{ NAU8825_REG_HSVOL_CTRL, 0 },
-	{ NAU8825_REG_DACL_CTRL, 0x00cf },
-	{ NAU8825_REG_DACR_CTRL, 0x02cf },
+static const unsigned int nau8825_xtalk_bakreg[NAU8825_XTALK_BAK_NUM] = {
+	[NAU8825_XTALK_BAK_ADC_DGAIN] = NAU8825_REG_ADC_DGAIN_CTRL,
+	[NAU8825_XTALK_BAK_DACL] = NAU8825_REG_DACL_CTRL,
+	[NAU8825_XTALK_BAK_DACR] = NAU8825_REG_DACR_CTRL,
+	[NAU8825_XTALK_BAK_HSVOL] = NAU8825_REG_HSVOL_CTRL,
 };
 
 /* The regmap patch for Rev C */
@@ -255,67 +310,208 @@ static const unsigned short logtable[256] = {
 };
 
 /**
- * nau8825_sema_acquire - acquire the semaphore of nau88l25
+ * nau8825_xtalk_own - hand the cross talk protection over
  * @nau8825:  component to register the codec private data with
- * @timeout: how long in jiffies to wait before failure or zero to wait
- * until release
+ * @from: owner expected to hold the protection
+ * @to: new owner of the protection
  *
- * Attempts to acquire the semaphore with number of jiffies. If no more
- * tasks are allowed to acquire the semaphore, calling this function will
- * put the task to sleep. If the semaphore is not released within the
- * specified number of jiffies, this function returns.
- * If the semaphore is not released within the specified number of jiffies,
- * this function returns -ETIME. If the sleep is interrupted by a signal,
- * this function will return -EINTR. It returns 0 if the semaphore was
- * acquired successfully.
+ * The ownership moves atomically, so it may be called from any context.
+ * Returns true if @from owned the protection and @to owns it now.
+ */
+static inline bool nau8825_xtalk_own(struct nau8825 *nau8825,
+	int from, int to)
+{
+	return atomic_cmpxchg(&nau8825->xtalk_owner, from, to) == from;
+}
+
+static inline bool nau8825_xtalk_measuring(struct nau8825 *nau8825)
+{
+	return atomic_read(&nau8825->xtalk_owner) ==
+		NAU8825_XTALK_OWNER_MEASURE;
+}
+
+/**
+ * nau8825_xtalk_claim - raise the protection for cross talk measurement
+ * @nau8825:  component to register the codec private data with
  *
- * Acquires the semaphore without jiffies. Try to acquire the semaphore
- * atomically. Returns 0 if the semaphore has been acquired successfully
- * or 1 if it cannot be acquired.
+ * Takes the protection if nobody owns it, or over from the resume path.
+ * Returns true if the cross talk measurement owns the protection, or
+ * false if the playback configuration is holding it.
  */
-static int nau8825_sema_acquire(struct nau8825 *nau8825, long timeout)
+static bool nau8825_xtalk_claim(struct nau8825 *nau8825)
 {
-	int ret;
+	if (nau8825_xtalk_measuring(nau8825) ||
+		nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_NONE,
+			NAU8825_XTALK_OWNER_MEASURE) ||
+		nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_RESUME,
+			NAU8825_XTALK_OWNER_MEASURE))
+		return true;
 
-	if (timeout) {
-		ret = down_timeout(&nau8825->xtalk_sem, timeout);
-		if (ret < 0)
-			dev_warn(nau8825->dev, "Acquire semaphore timeout\n");
-	} else {
-		ret = down_trylock(&nau8825->xtalk_sem);
-		if (ret)
-			dev_warn(nau8825->dev, "Acquire semaphore fail\n");
-	}
+	dev_warn(nau8825->dev, "Acquire cross talk protection fail\n");
+	return false;
+}
 
-	return ret;
+/**
+ * nau8825_xtalk_release - relieve the protection for cross talk
+ * @nau8825:  component to register the codec private data with
+ *
+ * Drops the protection raised by resume or cross talk measurement and
+ * wakes up the playback configuration waiting for it. The protection
+ * held by the playback configuration is not touched.
+ */
+static void nau8825_xtalk_release(struct nau8825 *nau8825)
+{
+	if (nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_MEASURE,
+			NAU8825_XTALK_OWNER_NONE) ||
+		nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_RESUME,
+			NAU8825_XTALK_OWNER_NONE))
+		wake_up_all(&nau8825->xtalk_wq);
 }
 
 /**
- * nau8825_sema_release - release the semaphore of nau88l25
+ * nau8825_audio_acquire - hold the playback until cross talk finishes
  * @nau8825:  component to register the codec private data with
+ * @timeout: how long in jiffies to wait for the protection
  *
- * Release the semaphore which may be called from any context and
- * even by tasks which have never called down().
+ * Sleeps until nobody owns the protection and then takes it for the
+ * playback configuration. The stream outranks the cross talk measurement,
+ * so an ongoing measurement is stopped by its work at once and taken
+ * again once the codec is idle. If the protection is not released within
+ * the specified number of jiffies, the configuration goes on without it.
+ * Returns true if the protection has been acquired, which is passed to
+ * nau8825_audio_release() afterwards.
  */
-static inline void nau8825_sema_release(struct nau8825 *nau8825)
+static bool nau8825_audio_acquire(struct nau8825 *nau8825, long timeout)
+{
+	ktime_t start = ktime_get();
+	long left;
+
+	if (nau8825_xtalk_on(nau8825) && nau8825_xtalk_measuring(nau8825)) {
+		WRITE_ONCE(nau8825->xtalk_preempt, true);
+		nau8825->xtalk_due = start;
+		mod_delayed_work(nau8825->jdet_wq, &nau8825->xtalk_work, 0);
+	}
+	left = wait_event_timeout(nau8825->xtalk_wq,
+		nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_NONE,
+			NAU8825_XTALK_OWNER_AUDIO), timeout);
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_XTALK_WAIT], start);
+	if (left)
+		return true;
+
+	dev_warn(nau8825->dev, "Acquire cross talk protection timeout\n");
+	return false;
+}
+
+static void nau8825_audio_release(struct nau8825 *nau8825, bool owned)
 {
-	up(&nau8825->xtalk_sem);
+	if (owned && nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_AUDIO,
+			NAU8825_XTALK_OWNER_NONE))
+		wake_up_all(&nau8825->xtalk_wq);
 }
 
 /**
- * nau8825_sema_reset - reset the semaphore for nau88l25
+ * nau8825_pm_get - wake up the codec for the register access
  * @nau8825:  component to register the codec private data with
  *
- * Reset the counter of the semaphore. Call this function to restart
- * a new round task management.
+ * The registers are only cached while the codec is runtime suspended.
+ * The jack detection and the clock setup out of a stream read the status
+ * of the codec, so they hold it awake around their access.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8825_pm_get(struct nau8825 *nau8825)
+{
+	int ret;
+
+	ret = pm_runtime_resume_and_get(nau8825->dev);
+	if (ret < 0)
+		dev_err(nau8825->dev, "Failed to resume codec: %d\n", ret);
+
+	return ret;
+}
+
+static void nau8825_pm_put(struct nau8825 *nau8825)
+{
+	pm_runtime_mark_last_busy(nau8825->dev);
+	pm_runtime_put_autosuspend(nau8825->dev);
+}
+
+/* Keep the codec awake while DAPM has a path powered up, so the power
+ * sequence reaches the registers and not only the cache.
+ */
+static void nau8825_pm_hold(struct nau8825 *nau8825, bool hold)
+{
+	if (nau8825->pm_held == hold)
+		return;
+
+	if (hold) {
+		if (nau8825_pm_get(nau8825) < 0)
+			return;
+	} else {
+		nau8825_pm_put(nau8825);
+	}
+	nau8825->pm_held = hold;
+}
+
+/* The jack detection runs on the interruption line, or on the polls of
+ * the status on a board without it.
  */
-static inline void nau8825_sema_reset(struct nau8825 *nau8825)
+static bool nau8825_irq_on(struct nau8825 *nau8825)
+{
+	return nau8825->irq || nau_irq_polled(&nau8825->irq_poll);
+}
+
+static void nau8825_irq_disable(struct nau8825 *nau8825)
+{
+	if (nau8825->irq)
+		disable_irq(nau8825->irq);
+	else
+		nau_irq_poll_disable(&nau8825->irq_poll);
+}
+
+static void nau8825_irq_enable(struct nau8825 *nau8825)
+{
+	if (nau8825->irq)
+		enable_irq(nau8825->irq);
+	else
+		nau_irq_poll_enable(&nau8825->irq_poll);
+}
+
+static void nau8825_hpvol_set(struct nau8825 *nau8825, unsigned int value)
+{
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_HSVOL_CTRL,
+		NAU8825_HPL_VOL_MASK | NAU8825_HPR_VOL_MASK,
+		(value << NAU8825_HPL_VOL_SFT) | value);
+}
+
+static void nau8825_hpvol_ramp_work(struct work_struct *work)
 {
-	nau8825->xtalk_sem.count = 1;
+	struct nau8825 *nau8825 = container_of(to_delayed_work(work),
+		struct nau8825, hpvol_work);
+	unsigned int cur, target, step;
+
+	mutex_lock(&nau8825->hpvol_lock);
+	cur = nau8825->hpvol_cur;
+	target = nau8825->hpvol_target;
+	step = nau8825->hpvol_step;
+	if (cur < target)
+		cur = target - cur > step ? cur + step : target;
+	else if (cur > target)
+		cur = cur - target > step ? cur - step : target;
+	nau8825->hpvol_cur = cur;
+	nau8825_hpvol_set(nau8825, cur);
+	if (cur == target) {
+		nau8825->hpvol_ramping = false;
+		complete_all(&nau8825->hpvol_done);
+	} else {
+		schedule_delayed_work(&nau8825->hpvol_work,
+			msecs_to_jiffies(NAU8825_HPVOL_RAMP_DELAY_MS));
+	}
+	mutex_unlock(&nau8825->hpvol_lock);
 }
 
 /**
- * nau8825_hpvol_ramp - Ramp up the headphone volume change gradually to target level.
+ * nau8825_hpvol_ramp - Ramp the headphone volume change gradually to target level.
  *
  * @nau8825:  component to register the codec private data with
  * @vol_from: the volume to start up
@@ -325,108 +521,115 @@ static inline void nau8825_sema_reset(struct nau8825 *nau8825)
  * The headphone volume is from 0dB to minimum -54dB and -1dB per step.
  * If the volume changes sharp, there is a pop noise heard in headphone. We
  * provide the function to ramp up the volume up or down by delaying 10ms
- * per step.
+ * per step. The ramp runs in a delayed work and the function returns at
+ * once. If a ramp is running, it turns to the new target from the current
+ * volume. The headphone volume has no zero-cross hardware, so the ramp is
+ * done by software.
  */
 static void nau8825_hpvol_ramp(struct nau8825 *nau8825,
 	unsigned int vol_from, unsigned int vol_to, unsigned int step)
 {
-	unsigned int value, volume, ramp_up, from, to;
-
-	if (vol_from == vol_to || step == 0) {
+	if (step == 0)
 		return;
-	} else if (vol_from < vol_to) {
-		ramp_up = true;
-		from = vol_from;
-		to = vol_to;
-	} else {
-		ramp_up = false;
-		from = vol_to;
-		to = vol_from;
-	}
 	/* only handle volume from 0dB to minimum -54dB */
-	if (to > NAU8825_HP_VOL_MIN)
-		to = NAU8825_HP_VOL_MIN;
+	if (vol_from > NAU8825_HP_VOL_MIN)
+		vol_from = NAU8825_HP_VOL_MIN;
+	if (vol_to > NAU8825_HP_VOL_MIN)
+		vol_to = NAU8825_HP_VOL_MIN;
+
+	mutex_lock(&nau8825->hpvol_lock);
+	nau8825->hpvol_target = vol_to;
+	nau8825->hpvol_step = step;
+	if (!nau8825->hpvol_ramping && vol_from != vol_to) {
+		nau8825->hpvol_cur = vol_from;
+		nau8825_hpvol_set(nau8825, vol_from);
+		nau8825->hpvol_ramping = true;
+		reinit_completion(&nau8825->hpvol_done);
+		schedule_delayed_work(&nau8825->hpvol_work,
+			msecs_to_jiffies(NAU8825_HPVOL_RAMP_DELAY_MS));
+	}
+	mutex_unlock(&nau8825->hpvol_lock);
+}
 
-	for (volume = from; volume < to; volume += step) {
-		if (ramp_up)
-			value = volume;
-		else
-			value = to - volume + from;
-		regmap_update_bits(nau8825->regmap, NAU8825_REG_HSVOL_CTRL,
-			NAU8825_HPL_VOL_MASK | NAU8825_HPR_VOL_MASK,
-			(value << NAU8825_HPL_VOL_SFT) | value);
-		usleep_range(10000, 10500);
-	}
-	if (ramp_up)
-		value = to;
-	else
-		value = from;
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_HSVOL_CTRL,
-		NAU8825_HPL_VOL_MASK | NAU8825_HPR_VOL_MASK,
-		(value << NAU8825_HPL_VOL_SFT) | value);
+/* Whether the headphone volume reached the target of the ramp. */
+static bool nau8825_hpvol_ramp_done(struct nau8825 *nau8825)
+{
+	return completion_done(&nau8825->hpvol_done);
+}
+
+/* Stop the ramp, and apply the target volume at once if finish. */
+static void nau8825_hpvol_ramp_cancel(struct nau8825 *nau8825, bool finish)
+{
+	cancel_delayed_work_sync(&nau8825->hpvol_work);
+	mutex_lock(&nau8825->hpvol_lock);
+	if (nau8825->hpvol_ramping && finish) {
+		nau8825->hpvol_cur = nau8825->hpvol_target;
+		nau8825_hpvol_set(nau8825, nau8825->hpvol_cur);
+	}
+	nau8825->hpvol_ramping = false;
+	complete_all(&nau8825->hpvol_done);
+	mutex_unlock(&nau8825->hpvol_lock);
 }
 
 /**
- * nau8825_intlog10_dec3 - Computes log10 of a value
- * the result is round off to 3 decimal. This function takes reference to
- * dvb-math. The source code locates as the following.
+ * nau8825_log2_q16 - Computes log2 of a value in Q16 fixed point
+ * This follows the table lookup of dvb-math. The source code locates as
+ * the following.
  * Linux/drivers/media/dvb-core/dvb_math.c
- * @value:  input for log10
+ * @value:  input for log2, must not be zero
  *
- * return log10(value) * 1000
+ * return log2(value) * 2^16
  */
-static u32 nau8825_intlog10_dec3(u32 value)
+static u32 nau8825_log2_q16(u32 value)
 {
-	u32 msb, logentry, significand, interpolation, log10val;
-	u64 log2val;
+	u32 msb, logentry, significand, next, interpolation;
 
 	/* first detect the msb (count begins at 0) */
 	msb = fls(value) - 1;
 	/**
-	 *      now we use a logtable after the following method:
-	 *
-	 *      log2(2^x * y) * 2^24 = x * 2^24 + log2(y) * 2^24
-	 *      where x = msb and therefore 1 <= y < 2
-	 *      first y is determined by shifting the value left
-	 *      so that msb is bit 31
-	 *              0x00231f56 -> 0x8C7D5800
-	 *      the result is y * 2^31 -> "significand"
-	 *      then the highest 9 bits are used for a table lookup
-	 *      the highest bit is discarded because it's always set
-	 *      the highest nine bits in our example are 100011000
-	 *      so we would use the entry 0x18
+	 *      log2(2^x * y) * 2^16 = x * 2^16 + log2(y) * 2^16
+	 *      where x = msb and therefore 1 <= y < 2. The value is shifted
+	 *      left so that msb is bit 31, then the nine highest bits less
+	 *      the always set msb are the table entry.
 	 */
 	significand = value << (31 - msb);
 	logentry = (significand >> 23) & 0xff;
 	/**
-	 *      last step we do is interpolation because of the
-	 *      limitations of the log table the error is that part of
-	 *      the significand which isn't used for lookup then we
-	 *      compute the ratio between the error and the next table entry
-	 *      and interpolate it between the log table entry used and the
-	 *      next one the biggest error possible is 0x7fffff
-	 *      (in our example it's 0x7D5800)
-	 *      needed value for next table entry is 0x800000
-	 *      so the interpolation is
-	 *      (error / 0x800000) * (logtable_next - logtable_current)
-	 *      in the implementation the division is moved to the end for
-	 *      better accuracy there is also an overflow correction if
-	 *      logtable_next is 256
+	 *      interpolate between the entry used and the next one with the
+	 *      16 highest bits of the 23 bits left over, so the product
+	 *      stays in 32 bits. The entry next to the last one is 2^16.
 	 */
-	interpolation = ((significand & 0x7fffff) *
-		((logtable[(logentry + 1) & 0xff] -
-		logtable[logentry]) & 0xffff)) >> 15;
+	next = logentry < 255 ? logtable[logentry + 1] : 0x10000;
+	interpolation = (((significand & 0x7fffff) >> 7) *
+		(next - logtable[logentry])) >> 16;
 
-	log2val = ((msb << 24) + (logtable[logentry] << 8) + interpolation);
-	/**
-	 *      log10(x) = log2(x) * log10(2)
-	 */
-	log10val = (log2val * LOG10_MAGIC) >> 31;
-	/**
-	 *      the result is round off to 3 decimal
-	 */
-	return log10val / ((1 << 24) / 1000);
+	return (msb << 16) + logtable[logentry] + interpolation;
+}
+
+/**
+ * nau8825_ratio_to_mdb - Converts a ratio of signal levels to milli-decibel
+ *
+ * @num: numerator signal level
+ * @den: denominator signal level
+ *
+ * The ratio is computed as the difference of both log2 values, so there
+ * is no division. The difference is scaled to decibel with a single
+ * multiplication by 20 * log10(2) * 1000 / 2^16 in Q24.
+ *
+ * return 20 * log10(num / den) * 1000, or 0 if any level is zero
+ */
+int nau8825_ratio_to_mdb(u32 num, u32 den)
+{
+	s32 diff;
+
+	if (!num || !den)
+		return 0;
+
+	diff = nau8825_log2_q16(num) - nau8825_log2_q16(den);
+
+	return ((s64)diff * MDB_PER_LOG2_Q16) >> 24;
 }
+EXPORT_SYMBOL_GPL(nau8825_ratio_to_mdb);
 
 /**
  * nau8825_xtalk_sidetone - computes cross talk suppression sidetone gain.
@@ -448,26 +651,126 @@ static u32 nau8825_xtalk_sidetone(u32 sig_org, u32 sig_cros)
 	if (WARN_ON(sig_org == 0 || sig_cros == 0))
 		return 0;
 
-	sig_org = nau8825_intlog10_dec3(sig_org);
-	sig_cros = nau8825_intlog10_dec3(sig_cros);
-	if (sig_org >= sig_cros)
-		gain = (sig_org - sig_cros) * 20 + GAIN_AUGMENT;
-	else
-		gain = (sig_cros - sig_org) * 20 + GAIN_AUGMENT;
+	gain = abs(nau8825_ratio_to_mdb(sig_org, sig_cros)) + GAIN_AUGMENT;
 	sidetone = SIDETONE_BASE - gain * 2;
 	sidetone /= 1000;
 
 	return sidetone;
 }
 
-static int nau8825_xtalk_baktab_index_by_reg(unsigned int reg)
+static bool nau8825_xtalk_fp_match(struct nau8825 *nau8825,
+	const struct nau8825_xtalk_cache *entry)
+{
+	unsigned int diff;
+
+	if (entry->mic_type != nau8825->xtalk_fp_type)
+		return false;
+	if (entry->sar > nau8825->xtalk_fp_sar)
+		diff = entry->sar - nau8825->xtalk_fp_sar;
+	else
+		diff = nau8825->xtalk_fp_sar - entry->sar;
+
+	return diff <= NAU8825_XTALK_SAR_TOLERANCE;
+}
+
+/* Move the entry to the front as the most recently used one. */
+static void nau8825_xtalk_cache_promote(struct nau8825 *nau8825, int index)
+{
+	struct nau8825_xtalk_cache entry = nau8825->xtalk_cache[index];
+
+	memmove(&nau8825->xtalk_cache[1], &nau8825->xtalk_cache[0],
+		index * sizeof(entry));
+	nau8825->xtalk_cache[0] = entry;
+}
+
+/**
+ * nau8825_xtalk_cache_lookup - find the cross talk result of the headset
+ * @nau8825:  component to register the codec private data with
+ * @dgain: the DAC_DGAIN_CTRL value measured before for the headset
+ *
+ * Returns true if the fingerprint of the inserted headset matches one of
+ * the recent headsets.
+ */
+static bool nau8825_xtalk_cache_lookup(struct nau8825 *nau8825,
+	unsigned int *dgain)
+{
+	int i;
+
+	if (!nau8825->xtalk_fp_valid)
+		return false;
+	for (i = 0; i < nau8825->xtalk_cache_num; i++) {
+		if (nau8825_xtalk_fp_match(nau8825, &nau8825->xtalk_cache[i])) {
+			nau8825_xtalk_cache_promote(nau8825, i);
+			*dgain = nau8825->xtalk_cache[0].dgain;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+/* Keep the result of the headset, and drop the least recently used one. */
+/**
+ * nau8825_xtalk_calib_lookup - find the factory calibrated cross talk
+ * @nau8825:  component to register the codec private data with
+ * @dgain: the DAC_DGAIN_CTRL value calibrated for the headset
+ *
+ * The bin of the SAR reading takes the headset, or else the gain for all.
+ * Returns true if a calibration is there.
+ */
+static bool nau8825_xtalk_calib_lookup(struct nau8825 *nau8825,
+	unsigned int *dgain)
+{
+	int i;
+
+	if (nau8825->xtalk_fp_valid)
+		for (i = 0; i < nau8825->xtalk_calib_bins; i++)
+			if (nau8825->xtalk_fp_sar <=
+				nau8825->xtalk_calib_bin[i].sar) {
+				*dgain = nau8825->xtalk_calib_bin[i].dgain;
+				return true;
+			}
+	if (!nau8825->xtalk_calib)
+		return false;
+	*dgain = nau8825->xtalk_calib_gain;
+
+	return true;
+}
+
+static void nau8825_xtalk_cache_store(struct nau8825 *nau8825,
+	unsigned int dgain)
+{
+	int i;
+
+	if (!nau8825->xtalk_fp_valid)
+		return;
+	for (i = 0; i < nau8825->xtalk_cache_num; i++)
+		if (nau8825_xtalk_fp_match(nau8825, &nau8825->xtalk_cache[i]))
+			break;
+	if (i == nau8825->xtalk_cache_num) {
+		if (i < NAU8825_XTALK_CACHE_NUM)
+			nau8825->xtalk_cache_num++;
+		else
+			i = NAU8825_XTALK_CACHE_NUM - 1;
+	}
+	nau8825->xtalk_cache[i].mic_type = nau8825->xtalk_fp_type;
+	nau8825->xtalk_cache[i].sar = nau8825->xtalk_fp_sar;
+	nau8825->xtalk_cache[i].dgain = dgain;
+	nau8825_xtalk_cache_promote(nau8825, i);
+}
+
+/* The sidetone is muted while the cross talk is measured, as the ADC
+ * would loop the test signal back to the DAC. The backup of the cross
+ * talk detection is in place during the measurement.
+ */
+static void nau8825_sidetone_apply(struct nau8825 *nau8825)
 {
-	int index;
+	unsigned int val = 0;
 
-	for (index = 0; index < ARRAY_SIZE(nau8825_xtalk_baktab); index++)
-		if (nau8825_xtalk_baktab[index].reg == reg)
-			return index;
-	return -EINVAL;
+	if (nau8825->sidetone_on && !nau8825->xtalk_baktab_initialized)
+		val = nau8825->sidetone_gain;
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL,
+		NAU8825_ADC_SIDETONE_MASK, val);
 }
 
 static void nau8825_xtalk_backup(struct nau8825 *nau8825)
@@ -477,40 +780,49 @@ static void nau8825_xtalk_backup(struct nau8825 *nau8825)
 	if (nau8825->xtalk_baktab_initialized)
 		return;
 
-	/* Backup some register values to backup table */
-	for (i = 0; i < ARRAY_SIZE(nau8825_xtalk_baktab); i++)
-		regmap_read(nau8825->regmap, nau8825_xtalk_baktab[i].reg,
-				&nau8825_xtalk_baktab[i].def);
+	/* Backup some register values to backup table; the registers are
+	 * not volatile, so the values are served by the register cache.
+	 */
+	for (i = 0; i < NAU8825_XTALK_BAK_NUM; i++) {
+		nau8825->xtalk_baktab[i].reg = nau8825_xtalk_bakreg[i];
+		regmap_read(nau8825->regmap, nau8825_xtalk_bakreg[i],
+				&nau8825->xtalk_baktab[i].def);
+	}
 
 	nau8825->xtalk_baktab_initialized = true;
+	nau8825_sidetone_apply(nau8825);
 }
 
 static void nau8825_xtalk_restore(struct nau8825 *nau8825, bool cause_cancel)
 {
-	int i, volume;
+	int volume;
 
 	if (!nau8825->xtalk_baktab_initialized)
 		return;
+	if (cause_cancel)
+		nau8825_hpvol_ramp_cancel(nau8825, false);
 
 	/* Restore register values from backup table; When the driver restores
 	 * the headphone volume in XTALK_DONE state, it needs recover to
 	 * original level gradually with 3dB per step for less pop noise.
-	 * Otherwise, the restore should do ASAP.
+	 * Otherwise, the restore should do ASAP. The headphone volume is
+	 * the last entry, so the others are restored in one go anyway.
 	 */
-	for (i = 0; i < ARRAY_SIZE(nau8825_xtalk_baktab); i++) {
-		if (!cause_cancel && nau8825_xtalk_baktab[i].reg ==
-			NAU8825_REG_HSVOL_CTRL) {
-			/* Ramping up the volume change to reduce pop noise */
-			volume = nau8825_xtalk_baktab[i].def &
-				NAU8825_HPR_VOL_MASK;
-			nau8825_hpvol_ramp(nau8825, 0, volume, 3);
-			continue;
-		}
-		regmap_write(nau8825->regmap, nau8825_xtalk_baktab[i].reg,
-				nau8825_xtalk_baktab[i].def);
+	if (cause_cancel) {
+		regmap_multi_reg_write(nau8825->regmap, nau8825->xtalk_baktab,
+			NAU8825_XTALK_BAK_NUM);
+	} else {
+		regmap_multi_reg_write(nau8825->regmap, nau8825->xtalk_baktab,
+			NAU8825_XTALK_BAK_HSVOL);
+		/* Ramping up the volume change to reduce pop noise */
+		volume = nau8825->xtalk_baktab[NAU8825_XTALK_BAK_HSVOL].def &
+			NAU8825_HPR_VOL_MASK;
+		nau8825_hpvol_ramp(nau8825, 0, volume, 3);
 	}
 
 	nau8825->xtalk_baktab_initialized = false;
+	/* the backup holds the sidetone as it was before the detection */
+	nau8825_sidetone_apply(nau8825);
 }
 
 static void nau8825_xtalk_prepare_dac(struct nau8825 *nau8825)
@@ -572,6 +884,7 @@ static void nau8825_xtalk_clock(struct nau8825 *nau8825)
 	regmap_write(nau8825->regmap, NAU8825_REG_FLL5, 0x0);
 	regmap_write(nau8825->regmap, NAU8825_REG_FLL6, 0x6000);
 	/* Enable internal VCO clock for detection signal generated */
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
 		NAU8825_CLK_SRC_MASK, NAU8825_CLK_SRC_VCO);
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_FLL6, NAU8825_DCO_EN,
@@ -587,10 +900,11 @@ static void nau8825_xtalk_clock(struct nau8825 *nau8825)
 
 static void nau8825_xtalk_prepare(struct nau8825 *nau8825)
 {
-	int volume, index;
+	int volume;
 
 	/* Backup those registers changed by cross talk detection */
 	nau8825_xtalk_backup(nau8825);
+	nau_hw_params_reset(&nau8825->hw_params_cache);
 	/* Config IIS as master to output signal by codec */
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2,
 		NAU8825_I2S_MS_MASK | NAU8825_I2S_LRC_DIV_MASK |
@@ -599,12 +913,9 @@ static void nau8825_xtalk_prepare(struct nau8825 *nau8825)
 	/* Ramp up headphone volume to 0dB to get better performance and
 	 * avoid pop noise in headphone.
 	 */
-	index = nau8825_xtalk_baktab_index_by_reg(NAU8825_REG_HSVOL_CTRL);
-	if (index != -EINVAL) {
-		volume = nau8825_xtalk_baktab[index].def &
-				NAU8825_HPR_VOL_MASK;
-		nau8825_hpvol_ramp(nau8825, volume, 0, 3);
-	}
+	volume = nau8825->xtalk_baktab[NAU8825_XTALK_BAK_HSVOL].def &
+			NAU8825_HPR_VOL_MASK;
+	nau8825_hpvol_ramp(nau8825, volume, 0, 3);
 	nau8825_xtalk_clock(nau8825);
 	nau8825_xtalk_prepare_dac(nau8825);
 	nau8825_xtalk_prepare_adc(nau8825);
@@ -674,7 +985,7 @@ static void nau8825_xtalk_clean_dac(struct nau8825 *nau8825)
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_ENA_CTRL,
 		NAU8825_ENABLE_DACR | NAU8825_ENABLE_DACL |
 		NAU8825_ENABLE_ADC_CLK | NAU8825_ENABLE_DAC_CLK, 0);
-	if (!nau8825->irq)
+	if (!nau8825_irq_on(nau8825))
 		regmap_update_bits(nau8825->regmap,
 			NAU8825_REG_ENA_CTRL, NAU8825_ENABLE_ADC, 0);
 }
@@ -701,13 +1012,20 @@ static void nau8825_xtalk_clean(struct nau8825 *nau8825, bool cause_cancel)
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2,
 		NAU8825_I2S_MS_MASK | NAU8825_I2S_LRC_DIV_MASK |
 		NAU8825_I2S_BLK_DIV_MASK, NAU8825_I2S_MS_SLAVE);
+	nau_hw_params_reset(&nau8825->hw_params_cache);
 	/* Restore value of specific register for cross talk */
 	nau8825_xtalk_restore(nau8825, cause_cancel);
 }
 
-static void nau8825_xtalk_imm_start(struct nau8825 *nau8825, int vol)
+static void nau8825_xtalk_imm_start(struct nau8825 *nau8825)
 {
+	int vol;
+
 	/* Apply ADC volume for better cross talk performance */
+	if (nau8825->xtalk_state == NAU8825_XTALK_HPR_R2L)
+		vol = 0x00d2;
+	else
+		vol = 0x00ff;
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL,
 				NAU8825_ADC_DIG_VOL_MASK, vol);
 	/* Disables JKTIP(HPL) DAC channel for right to left measurement.
@@ -732,12 +1050,33 @@ static void nau8825_xtalk_imm_start(struct nau8825 *nau8825, int vol)
 	default:
 		break;
 	}
-	msleep(100);
+}
+
+static void nau8825_xtalk_imm_enable(struct nau8825 *nau8825)
+{
 	/* Impedance measurement mode enable */
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_IMM_MODE_CTRL,
 				NAU8825_IMM_EN, NAU8825_IMM_EN);
 }
 
+/* Queue a step of cross talk detection to run after @delay_ms. The time
+ * it's due is kept to account the wait for a worker past it.
+ */
+static void nau8825_xtalk_queue(struct nau8825 *nau8825, int delay_ms)
+{
+	nau8825->xtalk_due = ktime_add_ms(ktime_get(), delay_ms);
+	queue_delayed_work(nau8825->jdet_wq, &nau8825->xtalk_work,
+			   msecs_to_jiffies(delay_ms));
+}
+
+/* Run the next step of cross talk detection after the settle time. */
+static void nau8825_xtalk_defer(struct nau8825 *nau8825, int pending,
+	int delay_ms)
+{
+	nau8825->xtalk_pending = pending;
+	nau8825_xtalk_queue(nau8825, delay_ms);
+}
+
 static void nau8825_xtalk_imm_stop(struct nau8825 *nau8825)
 {
 	/* Impedance measurement mode disable */
@@ -765,20 +1104,91 @@ static void nau8825_xtalk_imm_stop(struct nau8825 *nau8825)
  *     and cross talk signal level. Apply this gain and then restore codec
  *     configuration. Then transfer to Done state for ending.
  */
+static const struct nau8825_hp_profile
+nau8825_hp_profiles[NAU8825_HP_PROFILE_NUM] = {
+	[NAU8825_HP_LOW_IMPED] = { .bias_2x = true, .boost = true },
+	[NAU8825_HP_HIGH_IMPED] = { .bias_2x = false, .boost = false },
+};
+
+static const char * const nau8825_hp_profile_names[] = {
+	"Low Impedance", "High Impedance" };
+
+/* Apply the output power profile of the load. The class AB bias current
+ * changes at once, the boost driver at its next power up.
+ */
+static void nau8825_hp_profile_apply(struct nau8825 *nau8825, int profile)
+{
+	const struct nau8825_hp_profile *p = &nau8825_hp_profiles[profile];
+
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_ANALOG_CONTROL_2,
+		NAU8825_HP_NON_CLASSG_CURRENT_2xADJ,
+		p->bias_2x ? NAU8825_HP_NON_CLASSG_CURRENT_2xADJ : 0);
+	if (nau8825->hp_profile != profile)
+		dev_dbg(nau8825->dev, "headphone power profile: %s\n",
+			nau8825_hp_profile_names[profile]);
+	WRITE_ONCE(nau8825->hp_profile, profile);
+}
+
+/* The load is of high impedance by the mic detection of the insertion,
+ * or by the IMM level of the right headphone once measured, which is the
+ * lower the higher the impedance.
+ */
+static void nau8825_hp_profile_select(struct nau8825 *nau8825, int imm_rms)
+{
+	bool high = nau8825->high_imped;
+
+	if (imm_rms >= 0 && nau8825->hp_high_imped_rms)
+		high = imm_rms <= nau8825->hp_high_imped_rms;
+	nau8825_hp_profile_apply(nau8825,
+		high ? NAU8825_HP_HIGH_IMPED : NAU8825_HP_LOW_IMPED);
+}
+
 static void nau8825_xtalk_measure(struct nau8825 *nau8825)
 {
 	u32 sidetone;
 
+	switch (nau8825->xtalk_pending) {
+	case NAU8825_XTALK_PEND_HPVOL:
+		/* The measurement runs at 0dB headphone volume. The ramp is
+		 * checked again a ramp step later, not waited for.
+		 */
+		if (!nau8825_hpvol_ramp_done(nau8825)) {
+			if (ktime_before(ktime_get(), nau8825->xtalk_hpvol_end)) {
+				nau8825_xtalk_queue(nau8825,
+					NAU8825_HPVOL_RAMP_DELAY_MS);
+				return;
+			}
+			dev_warn(nau8825->dev, "Headphone volume ramp timeout\n");
+		}
+		nau8825->xtalk_pending = NAU8825_XTALK_PEND_IMM_SETUP;
+		fallthrough;
+	case NAU8825_XTALK_PEND_IMM_SETUP:
+		nau8825_xtalk_imm_start(nau8825);
+		nau8825_xtalk_defer(nau8825, NAU8825_XTALK_PEND_IMM_EN,
+			nau8825->xtalk_imm_delay);
+		return;
+	case NAU8825_XTALK_PEND_IMM_EN:
+		/* The measurement result is ready at the IMM interruption. */
+		nau8825->xtalk_pending = NAU8825_XTALK_PEND_NONE;
+		nau8825_xtalk_imm_enable(nau8825);
+		return;
+	default:
+		break;
+	}
+
 	switch (nau8825->xtalk_state) {
 	case NAU8825_XTALK_PREPARE:
 		/* In prepare state, set up clock, intrruption, DAC path, ADC
 		 * path and cross talk detection parameters for preparation.
+		 * Trigger right headphone impedance detection after settling.
 		 */
 		nau8825_xtalk_prepare(nau8825);
-		msleep(280);
-		/* Trigger right headphone impedance detection */
 		nau8825->xtalk_state = NAU8825_XTALK_HPR_R2L;
-		nau8825_xtalk_imm_start(nau8825, 0x00d2);
+		nau8825->xtalk_hpvol_end = ktime_add_ms(ktime_get(),
+			nau8825->xtalk_prepare_delay +
+			NAU8825_HPVOL_RAMP_TIMEOUT_MS);
+		nau8825_xtalk_defer(nau8825, NAU8825_XTALK_PEND_HPVOL,
+			nau8825->xtalk_prepare_delay);
 		break;
 	case NAU8825_XTALK_HPR_R2L:
 		/* In right headphone IMM state, read out right headphone
@@ -792,7 +1202,9 @@ static void nau8825_xtalk_measure(struct nau8825 *nau8825)
 		nau8825_xtalk_imm_stop(nau8825);
 		/* Trigger left headphone impedance detection */
 		nau8825->xtalk_state = NAU8825_XTALK_HPL_R2L;
-		nau8825_xtalk_imm_start(nau8825, 0x00ff);
+		nau8825_xtalk_imm_start(nau8825);
+		nau8825_xtalk_defer(nau8825, NAU8825_XTALK_PEND_IMM_EN,
+			nau8825->xtalk_imm_delay);
 		break;
 	case NAU8825_XTALK_HPL_R2L:
 		/* In left headphone IMM state, read out left headphone
@@ -806,8 +1218,9 @@ static void nau8825_xtalk_measure(struct nau8825 *nau8825)
 		dev_dbg(nau8825->dev, "HPL_R2L imm: %x\n",
 			nau8825->imp_rms[NAU8825_XTALK_HPL_R2L]);
 		nau8825_xtalk_imm_stop(nau8825);
-		msleep(150);
 		nau8825->xtalk_state = NAU8825_XTALK_IMM;
+		nau8825_xtalk_defer(nau8825, NAU8825_XTALK_PEND_NONE,
+			nau8825->xtalk_done_delay);
 		break;
 	case NAU8825_XTALK_IMM:
 		/* In impedance measure state, the orignal and cross talk
@@ -821,7 +1234,10 @@ static void nau8825_xtalk_measure(struct nau8825 *nau8825)
 		dev_dbg(nau8825->dev, "cross talk sidetone: %x\n", sidetone);
 		regmap_write(nau8825->regmap, NAU8825_REG_DAC_DGAIN_CTRL,
 					(sidetone << 8) | sidetone);
+		nau8825_xtalk_cache_store(nau8825, (sidetone << 8) | sidetone);
 		nau8825_xtalk_clean(nau8825, false);
+		nau8825_hp_profile_select(nau8825,
+			nau8825->imp_rms[NAU8825_XTALK_HPR_R2L]);
 		nau8825->xtalk_state = NAU8825_XTALK_DONE;
 		break;
 	default:
@@ -829,30 +1245,88 @@ static void nau8825_xtalk_measure(struct nau8825 *nau8825)
 	}
 }
 
-static void nau8825_xtalk_work(struct work_struct *work)
+/* The measurement stopped by a stream leaves the sidetone with no cross
+ * talk suppression; the jack is reported as if it completed.
+ */
+static void nau8825_xtalk_preempt(struct nau8825 *nau8825)
 {
-	struct nau8825 *nau8825 = container_of(
-		work, struct nau8825, xtalk_work);
+	if (nau8825->xtalk_state != NAU8825_XTALK_PREPARE)
+		nau8825_xtalk_clean(nau8825, true);
+	regmap_write(nau8825->regmap, NAU8825_REG_DAC_DGAIN_CTRL, 0);
+	nau8825->xtalk_pending = NAU8825_XTALK_PEND_NONE;
+	nau8825->xtalk_state = NAU8825_XTALK_DONE;
+	nau8825->xtalk_deferred = true;
+	nau8825->xtalk_preempt_count++;
+	dev_dbg(nau8825->dev, "cross talk preempted by stream\n");
+}
 
-	nau8825_xtalk_measure(nau8825);
-	/* To determine the cross talk side tone gain when reach
-	 * the impedance measure state.
-	 */
-	if (nau8825->xtalk_state == NAU8825_XTALK_IMM)
+/* Start the cross talk measurement owed by the preemption after the codec
+ * has been idle for a while; a stream in between preempts it again.
+ */
+static void nau8825_xtalk_rerun(struct nau8825 *nau8825)
+{
+	if (!nau8825->xtalk_deferred || !nau8825_jack_present(nau8825) ||
+		!nau8825_xtalk_claim(nau8825))
+		return;
+
+	nau8825->xtalk_deferred = false;
+	nau8825->xtalk_rerun = true;
+	WRITE_ONCE(nau8825->xtalk_preempt, false);
+	nau8825->xtalk_state = NAU8825_XTALK_PREPARE;
+	nau8825->xtalk_pending = NAU8825_XTALK_PEND_NONE;
+	nau8825_xtalk_queue(nau8825, NAU8825_XTALK_IDLE_MS);
+}
+
+/* The jack goes out without waiting for the cross talk detection, as
+ * asked for itself or as the headphone reported at the insertion already.
+ */
+static bool nau8825_jack_early(struct nau8825 *nau8825)
+{
+	return nau8825->xtalk_early_report || nau8825->hp_early_report;
+}
+
+/* Each step of the cross talk detection runs from the work which is
+ * triggered by the IMM interruption or after a settle time, so no task
+ * sleeps during the detection.
+ */
+static void nau8825_xtalk_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 = container_of(to_delayed_work(work),
+		struct nau8825, xtalk_work);
+	ktime_t start = ktime_get();
+
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_XTALK_QUEUE],
+		ktime_before(nau8825->xtalk_due, start) ?
+		nau8825->xtalk_due : start);
+	if (nau8825_pm_get(nau8825) < 0)
+		return;
+	if (READ_ONCE(nau8825->xtalk_preempt)) {
+		WRITE_ONCE(nau8825->xtalk_preempt, false);
+		nau8825_xtalk_preempt(nau8825);
+	} else {
 		nau8825_xtalk_measure(nau8825);
+	}
 
 	/* Delay jack report until cross talk detection process
 	 * completed. It can avoid application to do playback
 	 * preparation before cross talk detection is still working.
 	 * Meanwhile, the protection of the cross talk detection
-	 * is released.
+	 * is released. If the jack reported early or before the rerun,
+	 * only the sidetone gain is applied here.
 	 */
 	if (nau8825->xtalk_state == NAU8825_XTALK_DONE) {
-		snd_soc_jack_report(nau8825->jack, nau8825->xtalk_event,
-				nau8825->xtalk_event_mask);
-		nau8825_sema_release(nau8825);
-		nau8825->xtalk_protect = false;
+		if (!nau8825_jack_early(nau8825) && !nau8825->xtalk_rerun)
+			nau_jack_report(&nau8825->jack_rpt, nau8825->jack,
+					nau8825->xtalk_event,
+					nau8825->xtalk_event_mask);
+		nau8825->xtalk_rerun = false;
+		nau8825_xtalk_release(nau8825);
+		nau8825_adc_detect_off(nau8825);
+		nau8825_warm_update(nau8825);
+		nau8825_duty_start(nau8825);
 	}
+	nau8825_pm_put(nau8825);
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_XTALK_RUN], start);
 }
 
 static void nau8825_xtalk_cancel(struct nau8825 *nau8825)
@@ -861,84 +1335,91 @@ static void nau8825_xtalk_cancel(struct nau8825 *nau8825)
 	 * the driver forces to cancel the crosstalk task and
 	 * restores the configuration to original status.
 	 */
-	if (nau8825->xtalk_enable && nau8825->xtalk_state !=
+	if (nau8825_xtalk_on(nau8825) && nau8825->xtalk_state !=
 		NAU8825_XTALK_DONE) {
-		cancel_work_sync(&nau8825->xtalk_work);
+		cancel_delayed_work_sync(&nau8825->xtalk_work);
 		nau8825_xtalk_clean(nau8825, true);
+	} else {
+		/* Finish the volume restore of last measurement at once. */
+		nau8825_hpvol_ramp_cancel(nau8825, true);
 	}
-	/* Reset parameters for cross talk suppression function */
-	nau8825_sema_reset(nau8825);
+	/* Reset parameters for cross talk suppression function, then
+	 * wake up the playback waiting for the protection at once.
+	 */
+	nau8825->xtalk_pending = NAU8825_XTALK_PEND_NONE;
 	nau8825->xtalk_state = NAU8825_XTALK_DONE;
-	nau8825->xtalk_protect = false;
+	WRITE_ONCE(nau8825->xtalk_preempt, false);
+	nau8825->xtalk_deferred = false;
+	nau8825->xtalk_rerun = false;
+	nau8825_xtalk_release(nau8825);
 }
 
+#define NAU8825_READABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8825_REG_ENA_CTRL, NAU8825_REG_FLL_VCO_RSV) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_HSD_CTRL, NAU8825_REG_JACK_DET_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_INTERRUPT_MASK, NAU8825_REG_KEYDET_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_VDET_THRESHOLD_1, NAU8825_REG_DACR_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_ADC_DRC_KNEE_IP12, NAU8825_REG_ADC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_DAC_DRC_KNEE_IP12, NAU8825_REG_DAC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_IMM_MODE_CTRL, NAU8825_REG_IMM_RMS_R) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_CLASSG_CTRL, NAU8825_REG_OPT_EFUSE_CTRL) |	\
+	NAU_REG(w, NAU8825_REG_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8825_REG_I2C_DEVICE_ID, NAU8825_REG_FLL2_UPPER) |	\
+	NAU_REG(w, NAU8825_REG_BIAS_ADJ) |				\
+	NAU_REG_RANGE(w, NAU8825_REG_TRIM_SETTINGS, NAU8825_REG_ANALOG_CONTROL_2) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_ANALOG_ADC_1, NAU8825_REG_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_BOOST, NAU8825_REG_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_POWER_UP_CONTROL, NAU8825_REG_GENERAL_STATUS))
+
+static const u32 nau8825_readable_map[] = NAU_REGMAP(NAU8825_READABLE_REGS);
+
 static bool nau8825_readable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8825_REG_ENA_CTRL ... NAU8825_REG_FLL_VCO_RSV:
-	case NAU8825_REG_HSD_CTRL ... NAU8825_REG_JACK_DET_CTRL:
-	case NAU8825_REG_INTERRUPT_MASK ... NAU8825_REG_KEYDET_CTRL:
-	case NAU8825_REG_VDET_THRESHOLD_1 ... NAU8825_REG_DACR_CTRL:
-	case NAU8825_REG_ADC_DRC_KNEE_IP12 ... NAU8825_REG_ADC_DRC_ATKDCY:
-	case NAU8825_REG_DAC_DRC_KNEE_IP12 ... NAU8825_REG_DAC_DRC_ATKDCY:
-	case NAU8825_REG_IMM_MODE_CTRL ... NAU8825_REG_IMM_RMS_R:
-	case NAU8825_REG_CLASSG_CTRL ... NAU8825_REG_OPT_EFUSE_CTRL:
-	case NAU8825_REG_MISC_CTRL:
-	case NAU8825_REG_I2C_DEVICE_ID ... NAU8825_REG_FLL2_UPPER:
-	case NAU8825_REG_BIAS_ADJ:
-	case NAU8825_REG_TRIM_SETTINGS ... NAU8825_REG_ANALOG_CONTROL_2:
-	case NAU8825_REG_ANALOG_ADC_1 ... NAU8825_REG_MIC_BIAS:
-	case NAU8825_REG_BOOST ... NAU8825_REG_FEPGA:
-	case NAU8825_REG_POWER_UP_CONTROL ... NAU8825_REG_GENERAL_STATUS:
-		return true;
-	default:
-		return false;
-	}
-
+	return nau_regmap_access(nau8825_readable_map, reg);
 }
 
+#define NAU8825_WRITEABLE_REGS(w) (					\
+	NAU_REG_RANGE(w, NAU8825_REG_RESET, NAU8825_REG_FLL_VCO_RSV) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_HSD_CTRL, NAU8825_REG_JACK_DET_CTRL) |	\
+	NAU_REG(w, NAU8825_REG_INTERRUPT_MASK) |			\
+	NAU_REG_RANGE(w, NAU8825_REG_INT_CLR_KEY_STATUS, NAU8825_REG_KEYDET_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_VDET_THRESHOLD_1, NAU8825_REG_DACR_CTRL) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_ADC_DRC_KNEE_IP12, NAU8825_REG_ADC_DRC_ATKDCY) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_DAC_DRC_KNEE_IP12, NAU8825_REG_DAC_DRC_ATKDCY) |	\
+	NAU_REG(w, NAU8825_REG_IMM_MODE_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8825_REG_CLASSG_CTRL, NAU8825_REG_OPT_EFUSE_CTRL) |	\
+	NAU_REG(w, NAU8825_REG_MISC_CTRL) |				\
+	NAU_REG_RANGE(w, NAU8825_REG_FLL2_LOWER, NAU8825_REG_FLL2_UPPER) |	\
+	NAU_REG(w, NAU8825_REG_BIAS_ADJ) |				\
+	NAU_REG_RANGE(w, NAU8825_REG_TRIM_SETTINGS, NAU8825_REG_ANALOG_CONTROL_2) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_ANALOG_ADC_1, NAU8825_REG_MIC_BIAS) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_BOOST, NAU8825_REG_FEPGA) |	\
+	NAU_REG_RANGE(w, NAU8825_REG_POWER_UP_CONTROL, NAU8825_REG_CHARGE_PUMP))
+
+static const u32 nau8825_writeable_map[] = NAU_REGMAP(NAU8825_WRITEABLE_REGS);
+
 static bool nau8825_writeable_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8825_REG_RESET ... NAU8825_REG_FLL_VCO_RSV:
-	case NAU8825_REG_HSD_CTRL ... NAU8825_REG_JACK_DET_CTRL:
-	case NAU8825_REG_INTERRUPT_MASK:
-	case NAU8825_REG_INT_CLR_KEY_STATUS ... NAU8825_REG_KEYDET_CTRL:
-	case NAU8825_REG_VDET_THRESHOLD_1 ... NAU8825_REG_DACR_CTRL:
-	case NAU8825_REG_ADC_DRC_KNEE_IP12 ... NAU8825_REG_ADC_DRC_ATKDCY:
-	case NAU8825_REG_DAC_DRC_KNEE_IP12 ... NAU8825_REG_DAC_DRC_ATKDCY:
-	case NAU8825_REG_IMM_MODE_CTRL:
-	case NAU8825_REG_CLASSG_CTRL ... NAU8825_REG_OPT_EFUSE_CTRL:
-	case NAU8825_REG_MISC_CTRL:
-	case NAU8825_REG_FLL2_LOWER ... NAU8825_REG_FLL2_UPPER:
-	case NAU8825_REG_BIAS_ADJ:
-	case NAU8825_REG_TRIM_SETTINGS ... NAU8825_REG_ANALOG_CONTROL_2:
-	case NAU8825_REG_ANALOG_ADC_1 ... NAU8825_REG_MIC_BIAS:
-	case NAU8825_REG_BOOST ... NAU8825_REG_FEPGA:
-	case NAU8825_REG_POWER_UP_CONTROL ... NAU8825_REG_CHARGE_PUMP:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8825_writeable_map, reg);
 }
 
+#define NAU8825_VOLATILE_REGS(w) (					\
+	NAU_REG(w, NAU8825_REG_RESET) |					\
+	NAU_REG(w, NAU8825_REG_IRQ_STATUS) |				\
+	NAU_REG(w, NAU8825_REG_INT_CLR_KEY_STATUS) |			\
+	NAU_REG(w, NAU8825_REG_IMM_RMS_L) |				\
+	NAU_REG(w, NAU8825_REG_IMM_RMS_R) |				\
+	NAU_REG(w, NAU8825_REG_I2C_DEVICE_ID) |				\
+	NAU_REG(w, NAU8825_REG_SARDOUT_RAM_STATUS) |			\
+	NAU_REG(w, NAU8825_REG_CHARGE_PUMP_INPUT_READ) |		\
+	NAU_REG(w, NAU8825_REG_GENERAL_STATUS) |			\
+	NAU_REG_RANGE(w, NAU8825_REG_BIQ_CTRL, NAU8825_REG_BIQ_COF10))
+
+static const u32 nau8825_volatile_map[] = NAU_REGMAP(NAU8825_VOLATILE_REGS);
+
 static bool nau8825_volatile_reg(struct device *dev, unsigned int reg)
 {
-	switch (reg) {
-	case NAU8825_REG_RESET:
-	case NAU8825_REG_IRQ_STATUS:
-	case NAU8825_REG_INT_CLR_KEY_STATUS:
-	case NAU8825_REG_IMM_RMS_L:
-	case NAU8825_REG_IMM_RMS_R:
-	case NAU8825_REG_I2C_DEVICE_ID:
-	case NAU8825_REG_SARDOUT_RAM_STATUS:
-	case NAU8825_REG_CHARGE_PUMP_INPUT_READ:
-	case NAU8825_REG_GENERAL_STATUS:
-	case NAU8825_REG_BIQ_CTRL ... NAU8825_REG_BIQ_COF10:
-		return true;
-	default:
-		return false;
-	}
+	return nau_regmap_access(nau8825_volatile_map, reg);
 }
 
 static int nau8825_fepga_event(struct snd_soc_dapm_widget *w,
@@ -946,9 +1427,11 @@ static int nau8825_fepga_event(struct snd_soc_dapm_widget *w,
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	ktime_t start;
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
+		start = ktime_get();
 		regmap_update_bits(nau8825->regmap, NAU8825_REG_FEPGA,
 				   NAU8825_ACDC_CTRL_MASK,
 				   NAU8825_ACDC_VREF_MICP | NAU8825_ACDC_VREF_MICN);
@@ -959,6 +1442,7 @@ static int nau8825_fepga_event(struct snd_soc_dapm_widget *w,
 				   NAU8825_DISCHRG_EN, 0);
 		regmap_update_bits(nau8825->regmap, NAU8825_REG_FEPGA,
 				   NAU8825_ACDC_CTRL_MASK, 0);
+		nau_latency_add(&nau8825->latency[NAU8825_LAT_FEPGA], start);
 		break;
 	default:
 		break;
@@ -967,22 +1451,133 @@ static int nau8825_fepga_event(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
-static int nau8825_adc_event(struct snd_soc_dapm_widget *w,
-		struct snd_kcontrol *kcontrol, int event)
+/* Give the mic volume back, unless it was changed during the settle. */
+/* the mic volume at zero is the ADC mute */
+static void nau8825_adc_mute(struct nau8825 *nau8825)
 {
-	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
-	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	unsigned int val;
 
-	switch (event) {
-	case SND_SOC_DAPM_POST_PMU:
-		msleep(nau8825->adc_delay);
-		regmap_update_bits(nau8825->regmap, NAU8825_REG_ENA_CTRL,
-			NAU8825_ENABLE_ADC, NAU8825_ENABLE_ADC);
+	if (nau8825->adc_muted)
+		return;
+	regmap_read(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL, &val);
+	nau8825->adc_vol = val & NAU8825_ADC_DIG_VOL_MASK;
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL,
+		NAU8825_ADC_DIG_VOL_MASK, 0);
+	nau8825->adc_muted = true;
+}
+
+static void nau8825_adc_unmute(struct nau8825 *nau8825)
+{
+	unsigned int val;
+
+	regmap_read(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL, &val);
+	if (!(val & NAU8825_ADC_DIG_VOL_MASK))
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_ADC_DGAIN_CTRL,
+			NAU8825_ADC_DIG_VOL_MASK, nau8825->adc_vol);
+	nau8825->adc_muted = false;
+}
+
+/* The auto mode powers the main ADC for the jack type detection only.
+ * With the SAR only detection, it's off again once the jack type and
+ * the cross talk are settled and no capture runs; the capture turns it
+ * on by its widget.
+ */
+static void nau8825_adc_detect_off(struct nau8825 *nau8825)
+{
+	if (!nau8825->sar_only || READ_ONCE(nau8825->adc_capture) ||
+		!nau8825_jack_present(nau8825) ||
+		nau8825->xtalk_state != NAU8825_XTALK_DONE)
+		return;
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_ENA_CTRL,
+		NAU8825_ENABLE_ADC, 0);
+}
+
+/* The ADC settles muted, and the unmute is deferred after the settle,
+ * so the capture stream doesn't hold the DAPM thread for adc_delay.
+ */
+static void nau8825_adc_unmute_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 =
+		container_of(work, struct nau8825, adc_unmute_work.work);
+
+	nau8825_adc_unmute(nau8825);
+}
+
+/* Stop a pending unmute, and apply it at once so no mute is left. */
+static void nau8825_adc_unmute_cancel(struct nau8825 *nau8825)
+{
+	if (cancel_delayed_work_sync(&nau8825->adc_unmute_work) ||
+		nau8825->adc_muted)
+		nau8825_adc_unmute(nau8825);
+}
+
+static int nau8825_adc_event(struct snd_soc_dapm_widget *w,
+		struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	switch (event) {
+	case SND_SOC_DAPM_POST_PMU:
+		nau8825_adc_mute(nau8825);
+		WRITE_ONCE(nau8825->adc_capture, true);
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_ENA_CTRL,
+			NAU8825_ENABLE_ADC, NAU8825_ENABLE_ADC);
+		nau8825->adc_ready = ktime_add_ms(ktime_get(),
+			nau8825->adc_delay);
+		/* the warm path stays muted until a capture starts */
+		if (nau8825->adc_vol && (!nau8825->warm || nau8825->capture_on))
+			queue_delayed_work(system_wq,
+				&nau8825->adc_unmute_work,
+				msecs_to_jiffies(nau8825->adc_delay));
 		break;
 	case SND_SOC_DAPM_POST_PMD:
-		if (!nau8825->irq)
+		nau8825_adc_unmute_cancel(nau8825);
+		WRITE_ONCE(nau8825->adc_capture, false);
+		if (!nau8825_irq_on(nau8825))
 			regmap_update_bits(nau8825->regmap,
 				NAU8825_REG_ENA_CTRL, NAU8825_ENABLE_ADC, 0);
+		else
+			nau8825_adc_detect_off(nau8825);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+/* The AIF powers up ahead of the ADC, so a cold capture path settles in
+ * the ADC event. The warm one is up already and only unmutes, once its
+ * settle is over.
+ */
+static int nau8825_aiftx_event(struct snd_soc_dapm_widget *w,
+		struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	s64 left;
+
+	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		nau8825->capture_on = true;
+		if (!nau8825->warm || !nau8825->adc_muted ||
+			!READ_ONCE(nau8825->adc_capture))
+			break;
+		left = ktime_ms_delta(nau8825->adc_ready, ktime_get());
+		if (left > 0)
+			queue_delayed_work(system_wq,
+				&nau8825->adc_unmute_work,
+				msecs_to_jiffies(left));
+		else
+			nau8825_adc_unmute(nau8825);
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		nau8825->capture_on = false;
+		if (!nau8825->warm || !READ_ONCE(nau8825->adc_capture))
+			break;
+		cancel_delayed_work_sync(&nau8825->adc_unmute_work);
+		nau8825_adc_mute(nau8825);
 		break;
 	default:
 		return -EINVAL;
@@ -999,12 +1594,14 @@ static int nau8825_pump_event(struct snd_soc_dapm_widget *w,
 
 	switch (event) {
 	case SND_SOC_DAPM_POST_PMU:
-		/* Prevent startup click by letting charge pump to ramp up */
-		msleep(10);
-		regmap_update_bits(nau8825->regmap, NAU8825_REG_CHARGE_PUMP,
-			NAU8825_JAMNODCLOW, NAU8825_JAMNODCLOW);
+		/* Prevent startup click by letting charge pump to ramp up.
+		 * The analog DAC comes up meanwhile, and the output driver
+		 * waits for the rest of the ramp.
+		 */
+		nau_settle_start(&nau8825->pump_settle, NAU8825_PUMP_RAMP_MS);
 		break;
 	case SND_SOC_DAPM_PRE_PMD:
+		nau_settle_cancel(&nau8825->pump_settle);
 		regmap_update_bits(nau8825->regmap, NAU8825_REG_CHARGE_PUMP,
 			NAU8825_JAMNODCLOW, 0);
 		break;
@@ -1015,6 +1612,81 @@ static int nau8825_pump_event(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
+/* The first output driver stage runs on the charge pump; the stages of
+ * both sides are in one step, and the first of them ends the ramp.
+ */
+static int nau8825_hp_driver_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	ktime_t start = ktime_get();
+
+	if (nau_settle_wait(&nau8825->pump_settle)) {
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_CHARGE_PUMP,
+			NAU8825_JAMNODCLOW, NAU8825_JAMNODCLOW);
+		nau_latency_add(&nau8825->latency[NAU8825_LAT_PUMP], start);
+	}
+
+	return 0;
+}
+
+/* The sine of the impedance measurement plays the tone of a beep through
+ * the DACs, in place of the audio of the interface; the generator runs on
+ * the internal VCO, the clock of the jack detection.
+ */
+static int nau8825_tone_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		nau8825_duty_stop(nau8825);
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_INTERNAL, 0);
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_IMM_MODE_CTRL,
+			NAU8825_IMM_GEN_VOL_MASK | NAU8825_IMM_EN |
+			NAU8825_IMM_DAC_SRC_MASK, NAU8825_IMM_GEN_VOL_1_16th |
+			NAU8825_IMM_EN | NAU8825_IMM_DAC_SRC_SIN);
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_IMM_MODE_CTRL,
+			NAU8825_IMM_EN | NAU8825_IMM_DAC_SRC_MASK,
+			NAU8825_IMM_DAC_SRC_BIQ);
+		nau8825_duty_start(nau8825);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
+static int nau8825_hp_boost_event(struct snd_soc_dapm_widget *w,
+	struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	int profile = READ_ONCE(nau8825->hp_profile);
+
+	switch (event) {
+	case SND_SOC_DAPM_PRE_PMU:
+		if (nau8825_hp_profiles[profile].boost)
+			regmap_update_bits(nau8825->regmap, NAU8825_REG_BOOST,
+				NAU8825_HP_BOOST_DIS, 0);
+		break;
+	case SND_SOC_DAPM_POST_PMD:
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_BOOST,
+			NAU8825_HP_BOOST_DIS, NAU8825_HP_BOOST_DIS);
+		break;
+	default:
+		return -EINVAL;
+	}
+
+	return 0;
+}
+
 static int nau8825_output_dac_event(struct snd_soc_dapm_widget *w,
 	struct snd_kcontrol *kcontrol, int event)
 {
@@ -1053,31 +1725,262 @@ static int nau8825_output_dac_event(struct snd_soc_dapm_widget *w,
 	return 0;
 }
 
+/* Set clock source to disable or internal clock before the playback or
+ * capture end. Codec needs clock for Jack detection and button press if
+ * jack inserted; otherwise, the clock should be closed.
+ */
+static void nau8825_sysclk_idle(struct nau8825 *nau8825)
+{
+	if (nau8825_jack_present(nau8825))
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_INTERNAL, 0);
+	else
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
+}
+
+/* The FLL left locked after the last stream goes at the end of the keep,
+ * unless another clock took over meanwhile.
+ */
+static void nau8825_fll_keep_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 = container_of(to_delayed_work(work),
+		struct nau8825, fll_keep_work);
+
+	if (!nau8825->fll_locked || !nau8825->fll_idle)
+		return;
+	if (nau8825_pm_get(nau8825) < 0)
+		return;
+	nau8825_sysclk_idle(nau8825);
+	nau8825_pm_put(nau8825);
+	nau8825_duty_start(nau8825);
+}
+
+/* Hold the FLL kept while the clocks are set up for the next stream */
+static void nau8825_fll_keep_stop(struct nau8825 *nau8825)
+{
+	cancel_delayed_work_sync(&nau8825->fll_keep_work);
+}
+
+/**
+ * nau8825_fll_keep_take - take the FLL left locked by the last stream
+ * @nau8825:  component to register the codec private data with
+ * @src: the clock id of the FLL reference
+ * @freq_in: the FLL reference rate
+ * @fs: the sampling rate
+ *
+ * Returns true if the FLL is locked to @freq_in for @fs already, so the
+ * stream skips the FLL setup and its lock time.
+ */
+static bool nau8825_fll_keep_take(struct nau8825 *nau8825, int src,
+	unsigned int freq_in, unsigned int fs)
+{
+	if (!nau8825->fll_locked || nau8825->fll_src != src ||
+		nau8825->fll_in != freq_in || nau8825->fll_fs != fs)
+		return false;
+	if (nau8825->fll_idle)
+		nau8825->fll_reused++;
+
+	return true;
+}
+
+/* Record the FLL locked, which a stop of the streams keeps for a while */
+static void nau8825_fll_keep_done(struct nau8825 *nau8825, int src,
+	unsigned int freq_in, unsigned int fs)
+{
+	nau8825->fll_locked = true;
+	nau8825->fll_src = src;
+	nau8825->fll_in = freq_in;
+	nau8825->fll_fs = fs;
+}
+
 static int system_clock_control(struct snd_soc_dapm_widget *w,
 				struct snd_kcontrol *k, int  event)
 {
 	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
-	struct regmap *regmap = nau8825->regmap;
 
-	if (SND_SOC_DAPM_EVENT_OFF(event)) {
+	if (SND_SOC_DAPM_EVENT_ON(event)) {
+		nau8825_fll_keep_stop(nau8825);
+		nau8825->fll_idle = false;
+	} else {
 		dev_dbg(nau8825->dev, "system clock control : POWER OFF\n");
-		/* Set clock source to disable or internal clock before the
-		 * playback or capture end. Codec needs clock for Jack
-		 * detection and button press if jack inserted; otherwise,
-		 * the clock should be closed.
-		 */
-		if (nau8825_is_jack_inserted(regmap)) {
-			nau8825_configure_sysclk(nau8825,
-						 NAU8825_CLK_INTERNAL, 0);
+		/* Short streams in a row lock the FLL once */
+		nau8825->fll_idle = true;
+		if (nau8825->fll_locked && nau8825->fll_keep_ms)
+			queue_delayed_work(system_power_efficient_wq,
+				&nau8825->fll_keep_work,
+				msecs_to_jiffies(nau8825->fll_keep_ms));
+		else
+			nau8825_sysclk_idle(nau8825);
+	}
+
+	return 0;
+}
+
+/* Turn the internal VCO and the SAR off between the button samples, or
+ * back on. The debounce of the jack detection runs on the VCO, so it's
+ * bypassed meanwhile and the ejection still comes.
+ */
+static void nau8825_duty_sleep(struct nau8825 *nau8825, bool sleep)
+{
+	struct regmap *regmap = nau8825->regmap;
+
+	if (sleep) {
+		regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
+			NAU8825_SAR_ADC_EN, 0);
+		regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
+			NAU8825_JACK_DET_DB_BYPASS, NAU8825_JACK_DET_DB_BYPASS);
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
+	} else {
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_INTERNAL, 0);
+		regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
+			NAU8825_JACK_DET_DB_BYPASS, 0);
+		regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
+			NAU8825_SAR_ADC_EN, NAU8825_SAR_ADC_EN);
+	}
+	nau8825->duty.asleep = sleep;
+}
+
+static void nau8825_duty_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 =
+		container_of(work, struct nau8825, duty_work.work);
+	unsigned int active_irq = 0;
+
+	if (!READ_ONCE(nau8825->duty.run) || nau8825_pm_get(nau8825) < 0)
+		return;
+	if (nau8825->duty.asleep) {
+		nau8825_duty_sleep(nau8825, false);
+		nau8825->duty.wakeups++;
+	} else if (snd_soc_dapm_get_bias_level(nau8825->dapm) >
+		SND_SOC_BIAS_STANDBY) {
+		/* a stream came before the cycle was stopped */
+		WRITE_ONCE(nau8825->duty.run, false);
+	} else {
+		/* a button held, or in the handler yet, keeps it awake */
+		regmap_read(nau8825->regmap, NAU8825_REG_IRQ_STATUS,
+			&active_irq);
+		if (!nau8825->button_pressed && !(active_irq &
+			(NAU8825_KEY_SHORT_PRESS_IRQ |
+			NAU8825_KEY_LONG_PRESS_IRQ | NAU8825_KEY_RELEASE_IRQ)))
+			nau8825_duty_sleep(nau8825, true);
+	}
+	nau8825_pm_put(nau8825);
+	if (READ_ONCE(nau8825->duty.run))
+		queue_delayed_work(system_power_efficient_wq,
+			&nau8825->duty_work, nau_duty_next(&nau8825->duty));
+}
+
+/* Start the duty cycle once a headset with the buttons waits idle */
+static void nau8825_duty_start(struct nau8825 *nau8825)
+{
+	if (!nau_duty_enabled(&nau8825->duty) || !nau8825->dapm)
+		return;
+	mutex_lock(&nau8825->duty_lock);
+	/* the VCO clocks the warm capture path, and the FLL kept the codec */
+	if (!nau8825->duty.run && !nau8825->warm &&
+		!delayed_work_pending(&nau8825->fll_keep_work) &&
+		nau8825_jack_present(nau8825) &&
+		nau8825->xtalk_state == NAU8825_XTALK_DONE &&
+		snd_soc_dapm_get_pin_status(nau8825->dapm, "SAR")) {
+		WRITE_ONCE(nau8825->duty.run, true);
+		queue_delayed_work(system_power_efficient_wq,
+			&nau8825->duty_work, nau_duty_next(&nau8825->duty));
+	}
+	mutex_unlock(&nau8825->duty_lock);
+}
+
+/* Stop the duty cycle, with the VCO and the SAR left on */
+static void nau8825_duty_stop(struct nau8825 *nau8825)
+{
+	mutex_lock(&nau8825->duty_lock);
+	WRITE_ONCE(nau8825->duty.run, false);
+	cancel_delayed_work_sync(&nau8825->duty_work);
+	if (nau8825->duty.asleep && nau8825_pm_get(nau8825) >= 0) {
+		nau8825_duty_sleep(nau8825, false);
+		nau8825_pm_put(nau8825);
+	}
+	mutex_unlock(&nau8825->duty_lock);
+}
+
+/* the widgets of the capture path held powered by the warm capture */
+static const char * const nau8825_warm_pins[] = {
+	"Frontend PGA", "ADC",
+};
+
+/* Hold the capture path powered or release it. A forced pin is released
+ * by disabling and enabling it again.
+ */
+static void nau8825_warm_apply(struct nau8825 *nau8825, bool warm)
+{
+	struct snd_soc_dapm_context *dapm = nau8825->dapm;
+	int i;
+
+	if (!dapm)
+		return;
+	mutex_lock(&dapm->card->dapm_mutex);
+	if (warm == nau8825->warm)
+		goto out;
+	/* ahead of the ADC event, which keeps the warm path muted */
+	nau8825->warm = warm;
+	for (i = 0; i < ARRAY_SIZE(nau8825_warm_pins); i++) {
+		if (warm) {
+			snd_soc_dapm_force_enable_pin_unlocked(dapm,
+				nau8825_warm_pins[i]);
 		} else {
-			nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
+			snd_soc_dapm_disable_pin_unlocked(dapm,
+				nau8825_warm_pins[i]);
+			snd_soc_dapm_enable_pin_unlocked(dapm,
+				nau8825_warm_pins[i]);
 		}
 	}
+	snd_soc_dapm_sync_unlocked(dapm);
+	dev_dbg(nau8825->dev, "warm capture %s\n", warm ? "on" : "off");
+out:
+	mutex_unlock(&dapm->card->dapm_mutex);
+}
+
+/* The capture path is held warm while the mode is on and a headset mic is
+ * present, once the jack type and the cross talk are settled.
+ */
+static void nau8825_warm_update(struct nau8825 *nau8825)
+{
+	bool warm = nau8825->warm_capture && nau8825->dapm &&
+		nau8825_jack_present(nau8825) &&
+		nau8825->xtalk_state == NAU8825_XTALK_DONE &&
+		snd_soc_dapm_get_pin_status(nau8825->dapm, "MICBIAS");
+
+	nau8825_warm_apply(nau8825, warm);
+}
+
+static int nau8825_warm_capture_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = nau8825->warm_capture;
 
 	return 0;
 }
 
+/* Trade the idle power of the capture path for its start latency */
+static int nau8825_warm_capture_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	bool warm = !!ucontrol->value.integer.value[0];
+
+	if (nau8825->warm_capture == warm)
+		return 0;
+	nau8825->warm_capture = warm;
+	nau8825_warm_update(nau8825);
+
+	return 1;
+}
+
 static int nau8825_biq_coeff_get(struct snd_kcontrol *kcontrol,
 				     struct snd_ctl_elem_value *ucontrol)
 {
@@ -1096,26 +1999,13 @@ static int nau8825_biq_coeff_put(struct snd_kcontrol *kcontrol,
 				     struct snd_ctl_elem_value *ucontrol)
 {
 	struct snd_soc_component *component = snd_kcontrol_chip(kcontrol);
-	struct soc_bytes_ext *params = (void *)kcontrol->private_value;
-	void *data;
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 
 	if (!component->regmap)
 		return -EINVAL;
 
-	data = kmemdup(ucontrol->value.bytes.data,
-		params->max, GFP_KERNEL | GFP_DMA);
-	if (!data)
-		return -ENOMEM;
-
-	regmap_update_bits(component->regmap, NAU8825_REG_BIQ_CTRL,
-		NAU8825_BIQ_WRT_EN, 0);
-	regmap_raw_write(component->regmap, NAU8825_REG_BIQ_COF1,
-		data, params->max);
-	regmap_update_bits(component->regmap, NAU8825_REG_BIQ_CTRL,
-		NAU8825_BIQ_WRT_EN, NAU8825_BIQ_WRT_EN);
-
-	kfree(data);
-	return 0;
+	return nau_biq_rates_write(&nau8825->biq_rates,
+		ucontrol->value.bytes.data);
 }
 
 static const char * const nau8825_biq_path[] = {
@@ -1148,11 +2038,191 @@ static const DECLARE_TLV_DB_MINMAX(dac_vol_tlv, -5400, 0);
 static const DECLARE_TLV_DB_MINMAX(fepga_gain_tlv, -100, 3600);
 static const DECLARE_TLV_DB_MINMAX_MUTE(crosstalk_vol_tlv, -9600, 2400);
 
+/* Switch the SAR to the profile selected, which costs the writes of
+ * SAR_CTRL and KEYDET_CTRL only, and nothing if already applied.
+ */
+static void nau8825_sar_profile_apply(struct nau8825 *nau8825)
+{
+	struct regmap *regmap = nau8825->regmap;
+	const struct nau8825_sar_profile *prof;
+	int sel;
+
+	mutex_lock(&nau8825->sar_lock);
+	if (nau8825->sar_mode == NAU8825_SAR_MODE_AUTO)
+		sel = nau8825->capture_active ?
+			NAU8825_SAR_FAST : NAU8825_SAR_LOW_POWER;
+	else
+		sel = nau8825->sar_mode == NAU8825_SAR_MODE_FAST ?
+			NAU8825_SAR_FAST : NAU8825_SAR_LOW_POWER;
+	if (sel == nau8825->sar_applied)
+		goto unlock;
+
+	prof = &nau8825->sar_profile[sel];
+	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
+		NAU8825_SAR_COMPARE_TIME_MASK | NAU8825_SAR_SAMPLING_TIME_MASK,
+		(prof->compare_time << NAU8825_SAR_COMPARE_TIME_SFT) |
+		(prof->sampling_time << NAU8825_SAR_SAMPLING_TIME_SFT));
+	regmap_update_bits(regmap, NAU8825_REG_KEYDET_CTRL,
+		NAU8825_KEYDET_SHORTKEY_DEBOUNCE_MASK,
+		prof->key_debounce << NAU8825_KEYDET_SHORTKEY_DEBOUNCE_SFT);
+	nau8825->sar_applied = sel;
+	dev_dbg(nau8825->dev, "SAR profile %d\n", sel);
+unlock:
+	mutex_unlock(&nau8825->sar_lock);
+}
+
+static const char * const nau8825_sar_mode[] = {
+	"Auto", "Low Power", "Fast" };
+
+static const struct soc_enum nau8825_sar_mode_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8825_sar_mode), nau8825_sar_mode);
+
+static int nau8825_sar_mode_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8825->sar_mode;
+
+	return 0;
+}
+
+static int nau8825_sar_mode_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	unsigned int mode = ucontrol->value.enumerated.item[0];
+
+	if (mode >= ARRAY_SIZE(nau8825_sar_mode))
+		return -EINVAL;
+	if (mode == nau8825->sar_mode)
+		return 0;
+
+	nau8825->sar_mode = mode;
+	if (nau8825->sar_threshold_num)
+		nau8825_sar_profile_apply(nau8825);
+
+	return 1;
+}
+
+static int nau8825_sidetone_event(struct snd_soc_dapm_widget *w,
+		struct snd_kcontrol *kcontrol, int event)
+{
+	struct snd_soc_component *component = snd_soc_dapm_to_component(w->dapm);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	nau8825->sidetone_on = SND_SOC_DAPM_EVENT_ON(event);
+	nau8825_sidetone_apply(nau8825);
+
+	return 0;
+}
+
+static int nau8825_sidetone_vol_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.integer.value[0] = (nau8825->sidetone_gain >>
+		NAU8825_ADC_SIDETONE_L_SFT) & NAU8825_ADC_SIDETONE_MAX;
+	ucontrol->value.integer.value[1] = (nau8825->sidetone_gain >>
+		NAU8825_ADC_SIDETONE_R_SFT) & NAU8825_ADC_SIDETONE_MAX;
+
+	return 0;
+}
+
+/* The gain is kept, and reaches the codec while the sidetone is on */
+static int nau8825_sidetone_vol_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	long left = ucontrol->value.integer.value[0];
+	long right = ucontrol->value.integer.value[1];
+	unsigned int gain;
+
+	if (left < 0 || left > NAU8825_ADC_SIDETONE_MAX ||
+		right < 0 || right > NAU8825_ADC_SIDETONE_MAX)
+		return -EINVAL;
+	gain = (left << NAU8825_ADC_SIDETONE_L_SFT) |
+		(right << NAU8825_ADC_SIDETONE_R_SFT);
+	if (gain == nau8825->sidetone_gain)
+		return 0;
+
+	nau8825->sidetone_gain = gain;
+	nau8825_sidetone_apply(nau8825);
+
+	return 1;
+}
+
+static const char * const nau8825_osr_policy[] = {
+	"Manual", "Low Latency", "Low Power", "Quality" };
+
+static const struct soc_enum nau8825_osr_policy_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8825_osr_policy),
+		nau8825_osr_policy);
+
+static int nau8825_osr_policy_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = nau8825->osr_policy;
+
+	return 0;
+}
+
+/* The policy takes effect at the next hw_params */
+static int nau8825_osr_policy_put(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	unsigned int policy = ucontrol->value.enumerated.item[0];
+
+	if (policy >= ARRAY_SIZE(nau8825_osr_policy))
+		return -EINVAL;
+	if (policy == nau8825->osr_policy)
+		return 0;
+
+	nau8825->osr_policy = policy;
+	nau_hw_params_reset(&nau8825->hw_params_cache);
+
+	return 1;
+}
+
+static const struct soc_enum nau8825_hp_profile_enum =
+	SOC_ENUM_SINGLE_EXT(ARRAY_SIZE(nau8825_hp_profile_names),
+		nau8825_hp_profile_names);
+
+static int nau8825_hp_profile_get(struct snd_kcontrol *kcontrol,
+	struct snd_ctl_elem_value *ucontrol)
+{
+	struct snd_soc_component *component =
+		snd_soc_kcontrol_component(kcontrol);
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	ucontrol->value.enumerated.item[0] = READ_ONCE(nau8825->hp_profile);
+
+	return 0;
+}
+
 static const struct snd_kcontrol_new nau8825_controls[] = {
 	SOC_SINGLE_TLV("Mic Volume", NAU8825_REG_ADC_DGAIN_CTRL,
 		0, 0xff, 0, adc_vol_tlv),
-	SOC_DOUBLE_TLV("Headphone Bypass Volume", NAU8825_REG_ADC_DGAIN_CTRL,
-		12, 8, 0x0f, 0, sidetone_vol_tlv),
+	SOC_DOUBLE_EXT_TLV("Headphone Bypass Volume", SND_SOC_NOPM,
+		NAU8825_ADC_SIDETONE_L_SFT, NAU8825_ADC_SIDETONE_R_SFT,
+		NAU8825_ADC_SIDETONE_MAX, 0, nau8825_sidetone_vol_get,
+		nau8825_sidetone_vol_put, sidetone_vol_tlv),
 	SOC_DOUBLE_TLV("Headphone Volume", NAU8825_REG_HSVOL_CTRL,
 		6, 0, 0x3f, 1, dac_vol_tlv),
 	SOC_SINGLE_TLV("Frontend PGA Volume", NAU8825_REG_POWER_UP_CONTROL,
@@ -1162,10 +2232,25 @@ static const struct snd_kcontrol_new nau8825_controls[] = {
 
 	SOC_ENUM("ADC Decimation Rate", nau8825_adc_decimation_enum),
 	SOC_ENUM("DAC Oversampling Rate", nau8825_dac_oversampl_enum),
+	SOC_ENUM_EXT("OSR Policy", nau8825_osr_policy_enum,
+		nau8825_osr_policy_get, nau8825_osr_policy_put),
+	{
+		.iface = SNDRV_CTL_ELEM_IFACE_MIXER,
+		.name = "Headphone Power Profile",
+		.access = SNDRV_CTL_ELEM_ACCESS_READ |
+			SNDRV_CTL_ELEM_ACCESS_VOLATILE,
+		.info = snd_soc_info_enum_double,
+		.get = nau8825_hp_profile_get,
+		.private_value = (unsigned long)&nau8825_hp_profile_enum,
+	},
 	/* programmable biquad filter */
 	SOC_ENUM("BIQ Path Select", nau8825_biq_path_enum),
-	SND_SOC_BYTES_EXT("BIQ Coefficients", 20,
+	SND_SOC_BYTES_EXT("BIQ Coefficients", NAU8825_BIQ_COF_NUM * 2,
 		  nau8825_biq_coeff_get, nau8825_biq_coeff_put),
+	SOC_ENUM_EXT("SAR Profile", nau8825_sar_mode_enum,
+		  nau8825_sar_mode_get, nau8825_sar_mode_put),
+	SOC_SINGLE_BOOL_EXT("Warm Capture Switch", 0,
+		  nau8825_warm_capture_get, nau8825_warm_capture_put),
 };
 
 /* DAC Mux 0x33[9] and 0x34[9] */
@@ -1181,6 +2266,10 @@ static SOC_ENUM_SINGLE_DECL(
 	nau8825_dacr_enum, NAU8825_REG_DACR_CTRL,
 	NAU8825_DACR_CH_SEL_SFT, nau8825_dac_src);
 
+/* The ADC to DAC sidetone of the digital path */
+static const struct snd_kcontrol_new nau8825_sidetone_switch =
+	SOC_DAPM_SINGLE("Switch", SND_SOC_NOPM, 0, 1, 0);
+
 static const struct snd_kcontrol_new nau8825_dacl_mux =
 	SOC_DAPM_ENUM("DACL Source", nau8825_dacl_enum);
 
@@ -1189,11 +2278,13 @@ static const struct snd_kcontrol_new nau8825_dacr_mux =
 
 
 static const struct snd_soc_dapm_widget nau8825_dapm_widgets[] = {
-	SND_SOC_DAPM_AIF_OUT("AIFTX", "Capture", 0, NAU8825_REG_I2S_PCM_CTRL2,
-		15, 1),
+	SND_SOC_DAPM_AIF_OUT_E("AIFTX", "Capture", 0, NAU8825_REG_I2S_PCM_CTRL2,
+		15, 1, nau8825_aiftx_event,
+		SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
 	SND_SOC_DAPM_AIF_IN("AIFRX", "Playback", 0, SND_SOC_NOPM, 0, 0),
 	SND_SOC_DAPM_SUPPLY("System Clock", SND_SOC_NOPM, 0, 0,
-			    system_clock_control, SND_SOC_DAPM_POST_PMD),
+			    system_clock_control,
+			    SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
 
 	SND_SOC_DAPM_INPUT("MIC"),
 	SND_SOC_DAPM_MICBIAS("MICBIAS", NAU8825_REG_MIC_BIAS, 8, 0),
@@ -1215,17 +2306,22 @@ static const struct snd_soc_dapm_widget nau8825_dapm_widgets[] = {
 	SND_SOC_DAPM_SUPPLY("SAR", NAU8825_REG_SAR_CTRL,
 		NAU8825_SAR_ADC_EN_SFT, 0, NULL, 0),
 
-	SND_SOC_DAPM_PGA_S("ADACL", 2, NAU8825_REG_RDAC, 12, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("ADACR", 2, NAU8825_REG_RDAC, 13, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("ADACL Clock", 3, NAU8825_REG_RDAC, 8, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("ADACR Clock", 3, NAU8825_REG_RDAC, 9, 0, NULL, 0),
-
 	SND_SOC_DAPM_DAC("DDACR", NULL, NAU8825_REG_ENA_CTRL,
 		NAU8825_ENABLE_DACR_SFT, 0),
 	SND_SOC_DAPM_DAC("DDACL", NULL, NAU8825_REG_ENA_CTRL,
 		NAU8825_ENABLE_DACL_SFT, 0),
 	SND_SOC_DAPM_SUPPLY("DDAC Clock", NAU8825_REG_ENA_CTRL, 6, 0, NULL, 0),
 
+	/* the beep played by the codec, enabled by its input device */
+	SND_SOC_DAPM_SIGGEN("Tone"),
+	SND_SOC_DAPM_PGA_E("Tone Generator", SND_SOC_NOPM, 0, 0, NULL, 0,
+		nau8825_tone_event, SND_SOC_DAPM_PRE_PMU |
+		SND_SOC_DAPM_POST_PMD),
+
+	SND_SOC_DAPM_SWITCH_E("Sidetone", SND_SOC_NOPM, 0, 0,
+		&nau8825_sidetone_switch, nau8825_sidetone_event,
+		SND_SOC_DAPM_POST_PMU | SND_SOC_DAPM_PRE_PMD),
+
 	SND_SOC_DAPM_MUX("DACL Mux", SND_SOC_NOPM, 0, 0, &nau8825_dacl_mux),
 	SND_SOC_DAPM_MUX("DACR Mux", SND_SOC_NOPM, 0, 0, &nau8825_dacr_mux),
 
@@ -1238,18 +2334,9 @@ static const struct snd_soc_dapm_widget nau8825_dapm_widgets[] = {
 		nau8825_pump_event, SND_SOC_DAPM_POST_PMU |
 		SND_SOC_DAPM_PRE_PMD),
 
-	SND_SOC_DAPM_PGA_S("Output Driver R Stage 1", 4,
-		NAU8825_REG_POWER_UP_CONTROL, 5, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("Output Driver L Stage 1", 4,
-		NAU8825_REG_POWER_UP_CONTROL, 4, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("Output Driver R Stage 2", 5,
-		NAU8825_REG_POWER_UP_CONTROL, 3, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("Output Driver L Stage 2", 5,
-		NAU8825_REG_POWER_UP_CONTROL, 2, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("Output Driver R Stage 3", 6,
-		NAU8825_REG_POWER_UP_CONTROL, 1, 0, NULL, 0),
-	SND_SOC_DAPM_PGA_S("Output Driver L Stage 3", 6,
-		NAU8825_REG_POWER_UP_CONTROL, 0, 0, NULL, 0),
+	/* The analog DAC and the output driver stages are added at the
+	 * probe, in the sequence chosen by the board.
+	 */
 
 	SND_SOC_DAPM_PGA_S("Output DACL", 7,
 		SND_SOC_NOPM, 0, 0, nau8825_output_dac_event,
@@ -1265,9 +2352,10 @@ static const struct snd_soc_dapm_widget nau8825_dapm_widgets[] = {
 	SND_SOC_DAPM_PGA_S("HPOR Pulldown", 8,
 		NAU8825_REG_HSD_CTRL, 1, 1, NULL, 0),
 
-	/* High current HPOL/R boost driver */
+	/* High current HPOL/R boost driver, by the power profile */
 	SND_SOC_DAPM_PGA_S("HP Boost Driver", 9,
-		NAU8825_REG_BOOST, 9, 1, NULL, 0),
+		SND_SOC_NOPM, 0, 0, nau8825_hp_boost_event,
+		SND_SOC_DAPM_PRE_PMU | SND_SOC_DAPM_POST_PMD),
 
 	/* Class G operation control*/
 	SND_SOC_DAPM_PGA_S("Class G", 10,
@@ -1277,6 +2365,61 @@ static const struct snd_soc_dapm_widget nau8825_dapm_widgets[] = {
 	SND_SOC_DAPM_OUTPUT("HPOR"),
 };
 
+/* The analog DAC and the output driver stages of the headphone, powered
+ * up one stage after the other to keep the pop noise down. DAPM takes
+ * the left and right bits of a stage in one register write.
+ */
+static const struct snd_soc_dapm_widget nau8825_hp_stage_widgets[] = {
+	SND_SOC_DAPM_PGA_S("ADACL", 2, NAU8825_REG_RDAC, 12, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACR", 2, NAU8825_REG_RDAC, 13, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACL Clock", 3, NAU8825_REG_RDAC, 8, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACR Clock", 3, NAU8825_REG_RDAC, 9, 0, NULL, 0),
+
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 1", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 5, 0, nau8825_hp_driver_event,
+		SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 1", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 4, 0, nau8825_hp_driver_event,
+		SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 2", 5,
+		NAU8825_REG_POWER_UP_CONTROL, 3, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 2", 5,
+		NAU8825_REG_POWER_UP_CONTROL, 2, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 3", 6,
+		NAU8825_REG_POWER_UP_CONTROL, 1, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 3", 6,
+		NAU8825_REG_POWER_UP_CONTROL, 0, 0, NULL, 0),
+};
+
+/* The fast headphone start, by the property nuvoton,fast-hp-start, takes
+ * the analog DAC with its clock, and the three output driver stages, each
+ * in one step of the sequence. DAPM then writes RDAC and POWER_UP_CONTROL
+ * once each, four register writes less at each power up and down. The
+ * order of the other stages is kept. The board has to check the pop noise
+ * of its headphone with it.
+ */
+static const struct snd_soc_dapm_widget nau8825_hp_fast_widgets[] = {
+	SND_SOC_DAPM_PGA_S("ADACL", 2, NAU8825_REG_RDAC, 12, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACR", 2, NAU8825_REG_RDAC, 13, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACL Clock", 2, NAU8825_REG_RDAC, 8, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("ADACR Clock", 2, NAU8825_REG_RDAC, 9, 0, NULL, 0),
+
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 1", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 5, 0, nau8825_hp_driver_event,
+		SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 1", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 4, 0, nau8825_hp_driver_event,
+		SND_SOC_DAPM_PRE_PMU),
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 2", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 3, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 2", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 2, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver R Stage 3", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 1, 0, NULL, 0),
+	SND_SOC_DAPM_PGA_S("Output Driver L Stage 3", 4,
+		NAU8825_REG_POWER_UP_CONTROL, 0, 0, NULL, 0),
+};
+
 static const struct snd_soc_dapm_route nau8825_dapm_routes[] = {
 	{"Frontend PGA", NULL, "MIC"},
 	{"ADC", NULL, "Frontend PGA"},
@@ -1290,6 +2433,17 @@ static const struct snd_soc_dapm_route nau8825_dapm_routes[] = {
 	{"DDACR", NULL, "AIFRX"},
 	{"DDACL", NULL, "DDAC Clock"},
 	{"DDACR", NULL, "DDAC Clock"},
+	/* the sidetone mixes into the DAC, so it keeps the headphone path
+	 * up for the monitoring without any stream
+	 */
+	{"Sidetone", "Switch", "ADC"},
+	{"Sidetone", NULL, "System Clock"},
+	{"DDACL", NULL, "Sidetone"},
+	{"DDACR", NULL, "Sidetone"},
+	{"Tone Generator", NULL, "Tone"},
+	{"Tone Generator", NULL, "System Clock"},
+	{"DDACL", NULL, "Tone Generator"},
+	{"DDACR", NULL, "Tone Generator"},
 	{"DACL Mux", "DACL", "DDACL"},
 	{"DACL Mux", "DACR", "DDACR"},
 	{"DACR Mux", "DACL", "DDACL"},
@@ -1341,20 +2495,105 @@ nau8825_get_osr(struct nau8825 *nau8825, int stream)
 	}
 }
 
+/* The OSR taken by a policy instead of the controls. The filters of the
+ * converters keep their group delay short and their noise low with a high
+ * OSR, so both the low latency and the quality take the highest OSR within
+ * CLK_DA_AD_MAX at the rate, and the low power the lowest. The OSR applied
+ * reads back from the OSR controls.
+ */
+static int nau8825_osr_pick(const struct nau8825_osr_attr *sel, int num,
+	unsigned int rate, int policy)
+{
+	int i, pick = -EINVAL;
+
+	for (i = 0; i < num; i++) {
+		if (!sel[i].osr || rate * sel[i].osr > CLK_DA_AD_MAX)
+			continue;
+		if (pick < 0 || (policy == NAU8825_OSR_LOW_POWER ?
+			sel[i].osr < sel[pick].osr : sel[i].osr > sel[pick].osr))
+			pick = i;
+	}
+
+	return pick;
+}
+
+static const struct nau8825_osr_attr *
+nau8825_osr_select(struct nau8825 *nau8825, int stream, unsigned int rate,
+	int policy)
+{
+	const struct nau8825_osr_attr *sel;
+	int num, i;
+
+	if (policy == NAU8825_OSR_MANUAL)
+		return nau8825_get_osr(nau8825, stream);
+
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK) {
+		sel = osr_dac_sel;
+		num = ARRAY_SIZE(osr_dac_sel);
+	} else {
+		sel = osr_adc_sel;
+		num = ARRAY_SIZE(osr_adc_sel);
+	}
+	i = nau8825_osr_pick(sel, num, rate, policy);
+
+	return i < 0 ? NULL : &sel[i];
+}
+
+/* Program the OSR selected; the index is the register value, so the
+ * manual selection is written back unchanged.
+ */
+static void nau8825_osr_apply(struct nau8825 *nau8825, int stream,
+	const struct nau8825_osr_attr *osr)
+{
+	if (stream == SNDRV_PCM_STREAM_PLAYBACK)
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_DAC_CTRL1,
+			NAU8825_DAC_OVERSAMPLE_MASK, osr - osr_dac_sel);
+	else
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_ADC_RATE,
+			NAU8825_ADC_SYNC_DOWN_MASK, osr - osr_adc_sel);
+}
+
 static int nau8825_dai_startup(struct snd_pcm_substream *substream,
 			       struct snd_soc_dai *dai)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	const struct nau8825_osr_attr *osr;
+	ktime_t start = ktime_get();
+	int ret;
 
-	osr = nau8825_get_osr(nau8825, substream->stream);
+	/* a policy may take any OSR within the limit at the rate */
+	osr = nau8825_osr_select(nau8825, substream->stream, 0,
+		nau8825->osr_policy == NAU8825_OSR_MANUAL ?
+		NAU8825_OSR_MANUAL : NAU8825_OSR_LOW_POWER);
 	if (!osr || !osr->osr)
 		return -EINVAL;
 
-	return snd_pcm_hw_constraint_minmax(substream->runtime,
-					    SNDRV_PCM_HW_PARAM_RATE,
-					    0, CLK_DA_AD_MAX / osr->osr);
+	ret = snd_pcm_hw_constraint_minmax(substream->runtime,
+					   SNDRV_PCM_HW_PARAM_RATE,
+					   0, CLK_DA_AD_MAX / osr->osr);
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_STARTUP], start);
+	if (ret)
+		return ret;
+	nau8825_duty_stop(nau8825);
+
+	/* The capture is taken as a call, with the buttons responding fast */
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		!nau8825->capture_active++ && nau8825->sar_threshold_num)
+		nau8825_sar_profile_apply(nau8825);
+
+	return 0;
+}
+
+static void nau8825_dai_shutdown(struct snd_pcm_substream *substream,
+				 struct snd_soc_dai *dai)
+{
+	struct snd_soc_component *component = dai->component;
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+
+	if (substream->stream == SNDRV_PCM_STREAM_CAPTURE &&
+		!--nau8825->capture_active && nau8825->sar_threshold_num)
+		nau8825_sar_profile_apply(nau8825);
 }
 
 static int nau8825_hw_params(struct snd_pcm_substream *substream,
@@ -1365,9 +2604,28 @@ static int nau8825_hw_params(struct snd_pcm_substream *substream,
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	unsigned int val_len = 0, ctrl_val, bclk_fs, bclk_div;
 	const struct nau8825_osr_attr *osr;
+	ktime_t start = ktime_get();
 	int err = -EINVAL;
+	bool owned;
+
+	/* ahead of the protection, which the sysclk setup acquires itself */
+	if (nau8825->clk_plan.enable) {
+		err = nau8825_clk_plan_run(nau8825, params, dai);
+		if (err)
+			return err;
+		err = -EINVAL;
+	}
 
-	nau8825_sema_acquire(nau8825, 3 * HZ);
+	owned = nau8825_audio_acquire(nau8825, 3 * HZ);
+	/* After the wait, as the cross talk measurement takes the interface.
+	 * The manual OSR is a control that may change at any time.
+	 */
+	if (nau8825->osr_policy != NAU8825_OSR_MANUAL &&
+		nau_hw_params_skip(&nau8825->hw_params_cache, substream->stream,
+		params)) {
+		err = 0;
+		goto error;
+	}
 
 	/* CLK_DAC or CLK_ADC = OSR * FS
 	 * DAC or ADC clock frequency is defined as Over Sampling Rate (OSR)
@@ -1375,11 +2633,17 @@ static int nau8825_hw_params(struct snd_pcm_substream *substream,
 	 * values must be selected such that the maximum frequency is less
 	 * than 6.144 MHz.
 	 */
-	osr = nau8825_get_osr(nau8825, substream->stream);
+	osr = nau8825_osr_select(nau8825, substream->stream, params_rate(params),
+		nau8825->osr_policy);
 	if (!osr || !osr->osr)
 		goto error;
 	if (params_rate(params) * osr->osr > CLK_DA_AD_MAX)
 		goto error;
+	nau8825_osr_apply(nau8825, substream->stream, osr);
+	nau_delay_set(&nau8825->delay, substream->stream,
+		nau_delay_filter_frames(substream->stream ==
+		SNDRV_PCM_STREAM_PLAYBACK ? &nau8825_dac_filter :
+		&nau8825_adc_filter, osr->osr));
 	if (substream->stream == SNDRV_PCM_STREAM_PLAYBACK)
 		regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
 			NAU8825_CLK_DAC_SRC_MASK,
@@ -1426,11 +2690,15 @@ static int nau8825_hw_params(struct snd_pcm_substream *substream,
 
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL1,
 		NAU8825_I2S_DL_MASK, val_len);
+	nau_biq_rates_switch(&nau8825->biq_rates, params_rate(params));
+	nau_hw_params_done(&nau8825->hw_params_cache, substream->stream,
+		params);
 	err = 0;
 
  error:
-	/* Release the semaphore. */
-	nau8825_sema_release(nau8825);
+	/* Release the protection. */
+	nau8825_audio_release(nau8825, owned);
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_HW_PARAMS], start);
 
 	return err;
 }
@@ -1440,6 +2708,7 @@ static int nau8825_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
 	struct snd_soc_component *component = codec_dai->component;
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	unsigned int ctrl1_val = 0, ctrl2_val = 0;
+	bool owned;
 
 	switch (fmt & SND_SOC_DAIFMT_MASTER_MASK) {
 	case SND_SOC_DAIFMT_CBM_CFM:
@@ -1482,8 +2751,9 @@ static int nau8825_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
 		return -EINVAL;
 	}
 
-	nau8825_sema_acquire(nau8825, 3 * HZ);
+	owned = nau8825_audio_acquire(nau8825, 3 * HZ);
 
+	nau_hw_params_reset(&nau8825->hw_params_cache);
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL1,
 		NAU8825_I2S_DL_MASK | NAU8825_I2S_DF_MASK |
 		NAU8825_I2S_BP_MASK | NAU8825_I2S_PCMB_MASK,
@@ -1491,8 +2761,8 @@ static int nau8825_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2,
 		NAU8825_I2S_MS_MASK, ctrl2_val);
 
-	/* Release the semaphore. */
-	nau8825_sema_release(nau8825);
+	/* Release the protection. */
+	nau8825_audio_release(nau8825, owned);
 
 	return 0;
 }
@@ -1505,84 +2775,61 @@ static int nau8825_set_dai_fmt(struct snd_soc_dai *codec_dai, unsigned int fmt)
  * @slots: Number of slots in use.
  * @slot_width: Width in bits for each slot.
  *
- * Configures a DAI for TDM operation. Support TDM 4/8 slots.
- * The limitation is DAC and ADC need shift 4 slots at 8 slots mode.
+ * Configures a DAI for TDM operation of up to 16 slots, so the codec
+ * shares a bus with others. The DAC and ADC slots are chosen in a window
+ * of 4 slots, which starts at the lowest slot used at an offset computed
+ * from @slot_width. The DACs take one slot each or share one; the ADC is
+ * mono and sends on one slot.
  */
 static int nau8825_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
 				unsigned int rx_mask, int slots, int slot_width)
 {
 	struct snd_soc_component *component = dai->component;
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
-	unsigned int ctrl_val = 0, ctrl_offset = 0, value = 0, dac_s, adc_s;
+	unsigned int ctrl_val = NAU8825_TDM_MODE, ctrl_offset = 0, value;
+	unsigned int mask = tx_mask | rx_mask, base;
 
-	if (slots != 4 && slots != 8) {
-		dev_err(nau8825->dev, "Only support 4 or 8 slots!\n");
+	if (slots <= 0 || slots > NAU8825_TDM_SLOTS || slot_width <= 0 ||
+	    slot_width > 32 || (mask >> slots)) {
+		dev_err(nau8825->dev, "Only support up to %d slots!\n",
+			NAU8825_TDM_SLOTS);
 		return -EINVAL;
 	}
 
-	/* The driver is limited to 1-channel for ADC, and 2-channel for DAC on TDM mode */
 	if (hweight_long((unsigned long) tx_mask) != 1 ||
-	    hweight_long((unsigned long) rx_mask) != 2) {
+	    !rx_mask || hweight_long((unsigned long) rx_mask) > 2) {
 		dev_err(nau8825->dev,
-			"The limitation is 1-channel for ADC, and 2-channel for DAC on TDM mode.\n");
+			"The limitation is 1-channel for ADC, and 1 or 2-channel for DAC on TDM mode.\n");
 		return -EINVAL;
 	}
 
-	if (((tx_mask & 0xf) && (tx_mask & 0xf0)) ||
-	    ((rx_mask & 0xf) && (rx_mask & 0xf0)) ||
-	    ((tx_mask & 0xf) && (rx_mask & 0xf0)) ||
-	    ((rx_mask & 0xf) && (tx_mask & 0xf0))) {
+	base = __ffs(mask);
+	if ((mask >> base) >= BIT(NAU8825_TDM_WINDOW)) {
 		dev_err(nau8825->dev,
-			"Slot assignment of DAC and ADC need to set same interval.\n");
+			"Slot assignment of DAC and ADC need to be within %d slots.\n",
+			NAU8825_TDM_WINDOW);
 		return -EINVAL;
 	}
 
-	/* The offset of fixed 4 slots for 8 slots support */
-	if (rx_mask & 0xf0) {
-		regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2,
-				   NAU8825_I2S_PCM_TS_EN_MASK, NAU8825_I2S_PCM_TS_EN);
+	/* The offset of the window from the start of the frame */
+	if (base) {
 		regmap_read(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL1, &value);
-		ctrl_val |= NAU8825_TDM_OFFSET_EN;
-		ctrl_offset = 4 * slot_width;
+		ctrl_offset = base * slot_width;
 		if (!(value & NAU8825_I2S_PCMB_MASK))
 			ctrl_offset += 1;
-		dac_s = (rx_mask & 0xf0) >> 4;
-		adc_s = fls((tx_mask & 0xf0) >> 4);
-	} else {
-		dac_s = rx_mask & 0xf;
-		adc_s = fls(tx_mask & 0xf);
-	}
-
-	ctrl_val |= NAU8825_TDM_MODE;
-
-	switch (dac_s) {
-	case 0x3:
-		ctrl_val |= 1 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	case 0x5:
-		ctrl_val |= 2 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	case 0x6:
-		ctrl_val |= 1 << NAU8825_TDM_DACL_RX_SFT;
-		ctrl_val |= 2 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	case 0x9:
-		ctrl_val |= 3 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	case 0xa:
-		ctrl_val |= 1 << NAU8825_TDM_DACL_RX_SFT;
-		ctrl_val |= 3 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	case 0xc:
-		ctrl_val |= 2 << NAU8825_TDM_DACL_RX_SFT;
-		ctrl_val |= 3 << NAU8825_TDM_DACR_RX_SFT;
-		break;
-	default:
-		return -EINVAL;
+		if (ctrl_offset > NAU8825_TSLOT_L0_MASK)
+			return -EINVAL;
+		ctrl_val |= NAU8825_TDM_OFFSET_EN;
 	}
 
-	ctrl_val |= adc_s - 1;
+	ctrl_val |= __ffs(rx_mask >> base) << NAU8825_TDM_DACL_RX_SFT;
+	ctrl_val |= __fls(rx_mask >> base) << NAU8825_TDM_DACR_RX_SFT;
+	ctrl_val |= __ffs(tx_mask >> base);
 
+	nau_hw_params_reset(&nau8825->hw_params_cache);
+	regmap_update_bits(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2,
+			   NAU8825_I2S_PCM_TS_EN_MASK,
+			   base ? NAU8825_I2S_PCM_TS_EN : 0);
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_TDM_CTRL,
 			   NAU8825_TDM_MODE | NAU8825_TDM_OFFSET_EN |
 			   NAU8825_TDM_DACL_RX_MASK | NAU8825_TDM_DACR_RX_MASK |
@@ -1593,11 +2840,22 @@ static int nau8825_set_tdm_slot(struct snd_soc_dai *dai, unsigned int tx_mask,
 	return 0;
 }
 
+/* The frames the filters hold at the OSR of the stream */
+static snd_pcm_sframes_t nau8825_dai_delay(struct snd_pcm_substream *substream,
+	struct snd_soc_dai *dai)
+{
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(dai->component);
+
+	return nau_delay_get(&nau8825->delay, substream->stream);
+}
+
 static const struct snd_soc_dai_ops nau8825_dai_ops = {
 	.startup	= nau8825_dai_startup,
+	.shutdown	= nau8825_dai_shutdown,
 	.hw_params	= nau8825_hw_params,
 	.set_fmt	= nau8825_set_dai_fmt,
 	.set_tdm_slot	= nau8825_set_tdm_slot,
+	.delay		= nau8825_dai_delay,
 };
 
 #define NAU8825_RATES	SNDRV_PCM_RATE_8000_192000
@@ -1639,6 +2897,8 @@ int nau8825_enable_jack_detect(struct snd_soc_component *component,
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	struct regmap *regmap = nau8825->regmap;
 
+	/* the state held goes to the jack it was detected for */
+	nau_jack_report_flush(&nau8825->jack_rpt);
 	nau8825->jack = jack;
 
 	if (!nau8825->jack) {
@@ -1674,6 +2934,23 @@ static bool nau8825_is_jack_inserted(struct regmap *regmap)
 	return active_high == is_high;
 }
 
+/* The status register is read once per event, by the interruption, the
+ * probe or the resume; the other paths take the state kept from then.
+ */
+static bool nau8825_jack_sample(struct nau8825 *nau8825)
+{
+	bool present = nau8825_is_jack_inserted(nau8825->regmap);
+
+	WRITE_ONCE(nau8825->jack_present, present);
+
+	return present;
+}
+
+static bool nau8825_jack_present(struct nau8825 *nau8825)
+{
+	return READ_ONCE(nau8825->jack_present);
+}
+
 static void nau8825_restart_jack_detection(struct regmap *regmap)
 {
 	/* this will restart the entire jack detection process including MIC/GND
@@ -1686,37 +2963,106 @@ static void nau8825_restart_jack_detection(struct regmap *regmap)
 		NAU8825_JACK_DET_RESTART, 0);
 }
 
+/**
+ * nau8825_int_status_clear - clear the interruption status
+ * @regmap: regmap of the codec
+ * @active_irq: status bits to clear, or negative to read them first
+ *
+ * The clear register takes several status bits in one write, as the
+ * interruption handler does, so all the bits are cleared at once.
+ */
+static void nau8825_int_status_clear(struct regmap *regmap, int active_irq)
+{
+	if (active_irq < 0 && regmap_read(regmap, NAU8825_REG_IRQ_STATUS, &active_irq))
+		return;
+	if (active_irq)
+		regmap_write(regmap, NAU8825_REG_INT_CLR_KEY_STATUS, active_irq);
+}
+
 static void nau8825_int_status_clear_all(struct regmap *regmap)
 {
-	int active_irq, clear_irq, i;
+	nau8825_int_status_clear(regmap, -1);
+}
 
-	/* Reset the intrruption status from rightmost bit if the corres-
-	 * ponding irq event occurs.
-	 */
-	regmap_read(regmap, NAU8825_REG_IRQ_STATUS, &active_irq);
-	for (i = 0; i < NAU8825_REG_DATA_LEN; i++) {
-		clear_irq = (0x1 << i);
-		if (active_irq & clear_irq)
-			regmap_write(regmap,
-				NAU8825_REG_INT_CLR_KEY_STATUS, clear_irq);
+static void nau8825_key_repeat_stop(struct nau8825 *nau8825)
+{
+	nau8825->button_long = 0;
+	cancel_delayed_work_sync(&nau8825->key_repeat_work);
+}
+
+/* Set up the jack detection without a jack by the debounce @profile.
+ * The bypass needs no clock, and the insertion samples the jack state
+ * once more. The filter keeps the internal VCO on for the debounce in the
+ * chip, by nuvoton,jack-insert-debounce, so a bounce raises no
+ * interruption and the insertion needs no sample. The resume starts with
+ * the bypass for a while, for a jack plugged during the suspend, and the
+ * system suspend goes back to it.
+ */
+static void nau8825_jack_db_apply(struct nau8825 *nau8825, int profile)
+{
+	struct regmap *regmap = nau8825->regmap;
+
+	nau8825->jack_db_applied = profile;
+	if (profile == NAU8825_JACK_DB_FILTER) {
+		/* the debounce runs on the VCO */
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_INTERNAL, 0);
+		regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
+			NAU8825_JACK_DET_DB_BYPASS, 0);
+	} else {
+		regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
+			NAU8825_JACK_DET_DB_BYPASS, NAU8825_JACK_DET_DB_BYPASS);
+		/* Close clock for jack type detection at manual mode */
+		nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
 	}
 }
 
+/* Back to the debounce of the board once the resume settled */
+static void nau8825_jack_db_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 =
+		container_of(work, struct nau8825, jack_db_work.work);
+
+	if (nau8825_pm_get(nau8825) < 0)
+		return;
+	/* the interruption thread owns the jack detection */
+	nau8825_irq_disable(nau8825);
+	if (!nau8825_jack_present(nau8825) &&
+		nau8825->jack_db_applied != nau8825->jack_db_profile)
+		nau8825_jack_db_apply(nau8825, nau8825->jack_db_profile);
+	nau8825_irq_enable(nau8825);
+	nau8825_pm_put(nau8825);
+}
+
+static void nau8825_jack_db_resumed(struct nau8825 *nau8825)
+{
+	if (nau8825_irq_on(nau8825) &&
+		nau8825->jack_db_profile != NAU8825_JACK_DB_BYPASS)
+		schedule_delayed_work(&nau8825->jack_db_work,
+			msecs_to_jiffies(NAU8825_JACK_DB_RESUME_MS));
+}
+
 static void nau8825_eject_jack(struct nau8825 *nau8825)
 {
 	struct snd_soc_dapm_context *dapm = nau8825->dapm;
 	struct regmap *regmap = nau8825->regmap;
+	struct nau_reg_txn txn;
 
 	/* Force to cancel the cross talk detection process */
 	nau8825_xtalk_cancel(nau8825);
+	/* The buttons held are gone with the jack */
+	nau8825_key_repeat_stop(nau8825);
+	nau8825_warm_apply(nau8825, false);
 
 	snd_soc_dapm_disable_pin(dapm, "SAR");
 	snd_soc_dapm_disable_pin(dapm, "MICBIAS");
+	nau_reg_txn_begin(&txn, regmap);
 	/* Detach 2kOhm Resistors from MICBIAS to MICGND1/2 */
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_MIC_BIAS,
 		NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2, 0);
 	/* ground HPL/HPR, MICGRND1/2 */
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL, 0xf, 0xf);
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_HSD_CTRL, 0xf, 0xf);
+	nau_reg_txn_commit(&txn);
+	nau8825_hp_profile_apply(nau8825, NAU8825_HP_LOW_IMPED);
 
 	snd_soc_dapm_sync(dapm);
 
@@ -1724,25 +3070,25 @@ static void nau8825_eject_jack(struct nau8825 *nau8825)
 	nau8825_int_status_clear_all(regmap);
 
 	/* Enable the insertion interruption, disable the ejection inter-
-	 * ruption, and then bypass de-bounce circuit.
+	 * ruption, and then set the de-bounce circuit up.
 	 */
-	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_DIS_CTRL,
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_INTERRUPT_DIS_CTRL,
 		NAU8825_IRQ_EJECT_DIS | NAU8825_IRQ_INSERT_DIS,
 		NAU8825_IRQ_EJECT_DIS);
-	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK,
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_INTERRUPT_MASK,
 		NAU8825_IRQ_OUTPUT_EN | NAU8825_IRQ_EJECT_EN |
 		NAU8825_IRQ_HEADSET_COMPLETE_EN | NAU8825_IRQ_INSERT_EN,
 		NAU8825_IRQ_OUTPUT_EN | NAU8825_IRQ_EJECT_EN |
 		NAU8825_IRQ_HEADSET_COMPLETE_EN);
-	regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
-		NAU8825_JACK_DET_DB_BYPASS, NAU8825_JACK_DET_DB_BYPASS);
 
 	/* Disable ADC needed for interruptions at audo mode */
-	regmap_update_bits(regmap, NAU8825_REG_ENA_CTRL,
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_ENA_CTRL,
 		NAU8825_ENABLE_ADC, 0);
+	nau_reg_txn_commit(&txn);
 
-	/* Close clock for jack type detection at manual mode */
-	nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
+	/* The bypass kept from the resume ends with the jack */
+	cancel_delayed_work(&nau8825->jack_db_work);
+	nau8825_jack_db_apply(nau8825, nau8825->jack_db_profile);
 }
 
 /* Enable audo mode interruptions with internal clock. */
@@ -1763,6 +3109,7 @@ static void nau8825_setup_auto_irq(struct nau8825 *nau8825)
 	/* Enable internal VCO needed for interruptions */
 	nau8825_configure_sysclk(nau8825, NAU8825_CLK_INTERNAL, 0);
 	/* Raise up the internal clock for jack detection */
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
 	regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
 			   NAU8825_CLK_MCLK_SRC_MASK, 0);
 
@@ -1812,119 +3159,156 @@ static int nau8825_button_decode(int value)
 	return buttons;
 }
 
+#define NAU8825_HSD_GND_MASK (NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | \
+	NAU8825_SPKR_DWN1R | NAU8825_SPKR_DWN1L)
+
+/* Ground MICGND1/2, set up the SAR ADC for the high impedance detection
+ * and power MICBIAS and SAR up.
+ */
+static const struct nau_reg_update nau8825_imped_setup_seq[] = {
+	{ NAU8825_REG_HSD_CTRL, NAU8825_HSD_GND_MASK,
+		NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 },
+	{ NAU8825_REG_ANALOG_CONTROL_1, NAU8825_TESTDACIN_MASK,
+		NAU8825_TESTDACIN_GND },
+	{ NAU8825_REG_TRIM_SETTINGS, 0xffff, 0x6 },
+	{ NAU8825_REG_MIC_BIAS, NAU8825_MICBIAS_POWERUP |
+		NAU8825_MICBIAS_LOWNOISE_MASK | NAU8825_MICBIAS_VOLTAGE_MASK,
+		NAU8825_MICBIAS_POWERUP | NAU8825_MICBIAS_LOWNOISE_EN },
+	{ NAU8825_REG_SAR_CTRL, NAU8825_SAR_ADC_EN | NAU8825_SAR_INPUT_MASK |
+		NAU8825_SAR_TRACKING_GAIN_MASK | NAU8825_SAR_HV_SEL_MASK |
+		NAU8825_SAR_RES_SEL_MASK | NAU8825_SAR_COMPARE_TIME_MASK |
+		NAU8825_SAR_SAMPLING_TIME_MASK, NAU8825_SAR_ADC_EN |
+		NAU8825_SAR_HV_SEL_VDDMIC | NAU8825_SAR_RES_SEL_70K },
+};
+
+/* The SARADC reads MICGND1 with MICGND2 grounded */
+static const struct nau_reg_update nau8825_imped_mg1_seq[] = {
+	{ NAU8825_REG_HSD_CTRL, NAU8825_HSD_GND_MASK, NAU8825_SPKR_ENGND2 },
+	{ NAU8825_REG_MIC_BIAS, NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
+		NAU8825_MICBIAS_JKR2 },
+};
+
+/* The SARADC reads MICGND2 with MICGND1 grounded */
+static const struct nau_reg_update nau8825_imped_mg2_seq[] = {
+	{ NAU8825_REG_HSD_CTRL, NAU8825_HSD_GND_MASK, NAU8825_SPKR_ENGND1 },
+	{ NAU8825_REG_MIC_BIAS, NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
+		NAU8825_MICBIAS_JKSLV },
+	{ NAU8825_REG_SAR_CTRL, NAU8825_SAR_INPUT_MASK,
+		NAU8825_SAR_INPUT_JKSLV },
+};
+
+/**
+ * nau8825_high_imped_detection - detect the jack type of high impedance
+ * @nau8825:  component to register the codec private data with
+ *
+ * The SARADC reads MICGND1 and MICGND2 in turn, and the greater one is
+ * the microphone. The detection runs as register transactions where the
+ * writes to each register are merged. MICBIAS and SAR are powered by
+ * the registers directly under the DAPM mutex since they have no DAPM
+ * path. A headset hands them over to DAPM with one sync, or they are
+ * powered down again with the restore of the configuration if the jack
+ * is broken.
+ *
+ * Returns 0 if a headset is detected, or -EINVAL if the jack is broken.
+ */
 static int nau8825_high_imped_detection(struct nau8825 *nau8825)
 {
 	struct regmap *regmap = nau8825->regmap;
 	struct snd_soc_dapm_context *dapm = nau8825->dapm;
-	unsigned int adc_mg1, adc_mg2;
-
-	/* Initial phase */
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-			   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | NAU8825_SPKR_DWN1R |
-			   NAU8825_SPKR_DWN1L, NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2);
-	regmap_update_bits(regmap, NAU8825_REG_ANALOG_CONTROL_1,
-			   NAU8825_TESTDACIN_MASK, NAU8825_TESTDACIN_GND);
-	regmap_write(regmap, NAU8825_REG_TRIM_SETTINGS, 0x6);
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-			   NAU8825_MICBIAS_LOWNOISE_MASK | NAU8825_MICBIAS_VOLTAGE_MASK,
-			   NAU8825_MICBIAS_LOWNOISE_EN);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-			   NAU8825_SAR_INPUT_MASK | NAU8825_SAR_TRACKING_GAIN_MASK |
-			   NAU8825_SAR_HV_SEL_MASK | NAU8825_SAR_RES_SEL_MASK |
-			   NAU8825_SAR_COMPARE_TIME_MASK | NAU8825_SAR_SAMPLING_TIME_MASK,
-			   NAU8825_SAR_HV_SEL_VDDMIC | NAU8825_SAR_RES_SEL_70K);
-
-	snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
-	snd_soc_dapm_force_enable_pin(dapm, "SAR");
-	snd_soc_dapm_sync(dapm);
-
-	/* Configure settings for first reading of SARADC */
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-			   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | NAU8825_SPKR_DWN1R |
-			   NAU8825_SPKR_DWN1L, NAU8825_SPKR_ENGND2);
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-			   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
-			   NAU8825_MICBIAS_JKR2);
+	unsigned int adc_mg1, adc_mg2, micbias, sar, hsd, input;
+	struct nau_reg_txn txn;
+	int ret = 0;
+
+	mutex_lock_nested(&dapm->card->dapm_mutex, SND_SOC_DAPM_CLASS_RUNTIME);
+	/* Keep the power of MICBIAS and SAR which DAPM raised before */
+	regmap_read(regmap, NAU8825_REG_MIC_BIAS, &micbias);
+	regmap_read(regmap, NAU8825_REG_SAR_CTRL, &sar);
+	micbias &= NAU8825_MICBIAS_POWERUP;
+	sar &= NAU8825_SAR_ADC_EN;
+
+	/* MICGND1/2 are both grounded before MICBIAS and SAR are up */
+	nau_reg_txn_begin(&txn, regmap);
+	nau_reg_txn_seq(&txn, nau8825_imped_setup_seq,
+		ARRAY_SIZE(nau8825_imped_setup_seq));
+	nau_reg_txn_barrier(&txn);
+	nau_reg_txn_seq(&txn, nau8825_imped_mg1_seq,
+		ARRAY_SIZE(nau8825_imped_mg1_seq));
+	nau_reg_txn_commit(&txn);
 	regmap_read(regmap, NAU8825_REG_SARDOUT_RAM_STATUS, &adc_mg1);
-
-	/* Configure settings for second reading of SARADC */
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-			   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2, 0);
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-			   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | NAU8825_SPKR_DWN1R |
-			   NAU8825_SPKR_DWN1L, NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 |
-			   NAU8825_SPKR_DWN1R | NAU8825_SPKR_DWN1L);
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-			   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | NAU8825_SPKR_DWN1R |
-			   NAU8825_SPKR_DWN1L, NAU8825_SPKR_ENGND1);
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-			   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
-			   NAU8825_MICBIAS_JKSLV);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-			   NAU8825_SAR_INPUT_MASK, NAU8825_SAR_INPUT_JKSLV);
+	nau_reg_txn_seq(&txn, nau8825_imped_mg2_seq,
+		ARRAY_SIZE(nau8825_imped_mg2_seq));
+	nau_reg_txn_commit(&txn);
 	regmap_read(regmap, NAU8825_REG_SARDOUT_RAM_STATUS, &adc_mg2);
-
-	/* Disable phase */
-	snd_soc_dapm_disable_pin(dapm, "SAR");
-	snd_soc_dapm_disable_pin(dapm, "MICBIAS");
-	snd_soc_dapm_sync(dapm);
-
-	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-			   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_LOWNOISE_MASK |
-			   NAU8825_MICBIAS_VOLTAGE_MASK, nau8825->micbias_voltage);
-	regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-			   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 | NAU8825_SPKR_DWN1R |
-			   NAU8825_SPKR_DWN1L, NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2 |
-			   NAU8825_SPKR_DWN1R | NAU8825_SPKR_DWN1L);
-	regmap_update_bits(regmap, NAU8825_REG_ANALOG_CONTROL_1,
-			   NAU8825_TESTDACIN_MASK, NAU8825_TESTDACIN_GND);
-	regmap_write(regmap, NAU8825_REG_TRIM_SETTINGS, 0);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-			   NAU8825_SAR_TRACKING_GAIN_MASK | NAU8825_SAR_HV_SEL_MASK,
-			   nau8825->sar_voltage << NAU8825_SAR_TRACKING_GAIN_SFT);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-			   NAU8825_SAR_COMPARE_TIME_MASK | NAU8825_SAR_SAMPLING_TIME_MASK,
-			   (nau8825->sar_compare_time << NAU8825_SAR_COMPARE_TIME_SFT) |
-			   (nau8825->sar_sampling_time << NAU8825_SAR_SAMPLING_TIME_SFT));
 	dev_dbg(nau8825->dev, "adc_mg1:%x, adc_mg2:%x\n", adc_mg1, adc_mg2);
 
-	/* Confirmation phase */
+	/* Confirmation phase, and the restore of the configuration takes
+	 * the microphone found in the same writes.
+	 */
+	hsd = NAU8825_HSD_GND_MASK;
 	if (adc_mg1 > adc_mg2) {
 		dev_dbg(nau8825->dev, "OMTP (micgnd1) mic connected\n");
-
-		/* Unground MICGND1 */
-		regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-				   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2,
-				   NAU8825_SPKR_ENGND2);
-		/* Attach 2kOhm Resistor from MICBIAS to MICGND1 */
-		regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-				   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
-				   NAU8825_MICBIAS_JKR2);
-		/* Attach SARADC to MICGND1 */
-		regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-				   NAU8825_SAR_INPUT_MASK,
-				   NAU8825_SAR_INPUT_JKR2);
+		/* Unground MICGND1, attach 2kOhm Resistor from MICBIAS
+		 * and SARADC to MICGND1
+		 */
+		hsd &= ~NAU8825_SPKR_ENGND1;
+		micbias = NAU8825_MICBIAS_POWERUP | NAU8825_MICBIAS_JKR2;
+		sar = NAU8825_SAR_ADC_EN;
+		input = NAU8825_SAR_INPUT_JKR2;
 	} else if (adc_mg1 < adc_mg2) {
 		dev_dbg(nau8825->dev, "CTIA (micgnd2) mic connected\n");
-
-		/* Unground MICGND2 */
-		regmap_update_bits(regmap, NAU8825_REG_HSD_CTRL,
-				   NAU8825_SPKR_ENGND1 | NAU8825_SPKR_ENGND2,
-				   NAU8825_SPKR_ENGND1);
-		/* Attach 2kOhm Resistor from MICBIAS to MICGND2 */
-		regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
-				   NAU8825_MICBIAS_JKSLV | NAU8825_MICBIAS_JKR2,
-				   NAU8825_MICBIAS_JKSLV);
-		/* Attach SARADC to MICGND2 */
-		regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-				   NAU8825_SAR_INPUT_MASK,
-				   NAU8825_SAR_INPUT_JKSLV);
+		/* Unground MICGND2, attach 2kOhm Resistor from MICBIAS
+		 * and SARADC to MICGND2
+		 */
+		hsd &= ~NAU8825_SPKR_ENGND2;
+		micbias = NAU8825_MICBIAS_POWERUP | NAU8825_MICBIAS_JKSLV;
+		sar = NAU8825_SAR_ADC_EN;
+		input = NAU8825_SAR_INPUT_JKSLV;
 	} else {
 		dev_err(nau8825->dev, "Jack broken.\n");
-		return -EINVAL;
+		input = NAU8825_SAR_INPUT_JKSLV;
+		ret = -EINVAL;
 	}
 
-	return 0;
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_MIC_BIAS,
+		NAU8825_MICBIAS_POWERUP | NAU8825_MICBIAS_JKSLV |
+		NAU8825_MICBIAS_JKR2 | NAU8825_MICBIAS_LOWNOISE_MASK |
+		NAU8825_MICBIAS_VOLTAGE_MASK,
+		micbias | nau8825->micbias_voltage);
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_HSD_CTRL,
+		NAU8825_HSD_GND_MASK, hsd);
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_TRIM_SETTINGS, 0xffff, 0);
+	nau_reg_txn_update_bits(&txn, NAU8825_REG_SAR_CTRL,
+		NAU8825_SAR_ADC_EN | NAU8825_SAR_INPUT_MASK |
+		NAU8825_SAR_TRACKING_GAIN_MASK | NAU8825_SAR_HV_SEL_MASK |
+		NAU8825_SAR_COMPARE_TIME_MASK | NAU8825_SAR_SAMPLING_TIME_MASK,
+		sar | input |
+		(nau8825->sar_voltage << NAU8825_SAR_TRACKING_GAIN_SFT) |
+		(nau8825->sar_compare_time << NAU8825_SAR_COMPARE_TIME_SFT) |
+		(nau8825->sar_sampling_time << NAU8825_SAR_SAMPLING_TIME_SFT));
+	nau_reg_txn_commit(&txn);
+
+	if (!ret) {
+		snd_soc_dapm_force_enable_pin_unlocked(dapm, "MICBIAS");
+		snd_soc_dapm_force_enable_pin_unlocked(dapm, "SAR");
+		snd_soc_dapm_sync_unlocked(dapm);
+	}
+	mutex_unlock(&dapm->card->dapm_mutex);
+
+	return ret;
+}
+
+/* The SAR reading of the microphone identifies the headset quickly. */
+static void nau8825_xtalk_fingerprint(struct nau8825 *nau8825, int mic_type)
+{
+	if (!nau8825_xtalk_on(nau8825) && !nau8825->xtalk_calib_bins)
+		return;
+	if (regmap_read(nau8825->regmap, NAU8825_REG_SARDOUT_RAM_STATUS,
+		&nau8825->xtalk_fp_sar))
+		return;
+	nau8825->xtalk_fp_type = mic_type;
+	nau8825->xtalk_fp_valid = true;
+	dev_dbg(nau8825->dev, "headset fingerprint: type %d, SAR %x\n",
+		mic_type, nau8825->xtalk_fp_sar);
 }
 
 static int nau8825_jack_insert(struct nau8825 *nau8825)
@@ -1936,6 +3320,7 @@ static int nau8825_jack_insert(struct nau8825 *nau8825)
 
 	regmap_read(regmap, NAU8825_REG_GENERAL_STATUS, &jack_status_reg);
 	mic_detected = (jack_status_reg >> 10) & 3;
+	nau8825->xtalk_fp_valid = false;
 	/* The JKSLV and JKR2 all detected in high impedance headset */
 	if (mic_detected == 0x3)
 		nau8825->high_imped = true;
@@ -1966,6 +3351,7 @@ static int nau8825_jack_insert(struct nau8825 *nau8825)
 		snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
 		snd_soc_dapm_force_enable_pin(dapm, "SAR");
 		snd_soc_dapm_sync(dapm);
+		nau8825_xtalk_fingerprint(nau8825, mic_detected);
 		break;
 	case 2:
 		dev_dbg(nau8825->dev, "CTIA (micgnd2) mic connected\n");
@@ -1986,22 +3372,24 @@ static int nau8825_jack_insert(struct nau8825 *nau8825)
 		snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
 		snd_soc_dapm_force_enable_pin(dapm, "SAR");
 		snd_soc_dapm_sync(dapm);
+		nau8825_xtalk_fingerprint(nau8825, mic_detected);
 		break;
 	case 3:
 		/* Detection failure case */
 		dev_warn(nau8825->dev,
 			 "Detection failure. Try the manually mechanism for jack type checking.\n");
-		if (!nau8825_high_imped_detection(nau8825)) {
+		if (!nau8825_high_imped_detection(nau8825))
 			type = SND_JACK_HEADSET;
-			snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
-			snd_soc_dapm_force_enable_pin(dapm, "SAR");
-			snd_soc_dapm_sync(dapm);
-		} else
+		else
 			type = SND_JACK_HEADPHONE;
 		break;
 	}
 
+	/* The power profile of the load until the IMM level is measured */
+	nau8825_hp_profile_select(nau8825, -1);
+
 	/* Update to the default divider of internal clock for power saving */
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
 	regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
 			   NAU8825_CLK_MCLK_SRC_MASK, 0xf);
 
@@ -2018,135 +3406,368 @@ static int nau8825_jack_insert(struct nau8825 *nau8825)
 #define NAU8825_BUTTONS (SND_JACK_BTN_0 | SND_JACK_BTN_1 | \
 		SND_JACK_BTN_2 | SND_JACK_BTN_3)
 
-static irqreturn_t nau8825_interrupt(int irq, void *data)
+/* Delay jack report until cross talk detection is done. It can avoid
+ * application to do playback preparation when cross talk detection
+ * process is still working. Otherwise, the resource like clock and
+ * power will be issued by them at the same time and conflict happens.
+ */
+static void nau8825_jack_report(struct nau8825 *nau8825,
+	int event, int event_mask)
 {
-	struct nau8825 *nau8825 = (struct nau8825 *)data;
-	struct regmap *regmap = nau8825->regmap;
-	int active_irq, clear_irq = 0, event = 0, event_mask = 0;
+	if (event_mask && (nau8825->xtalk_state == NAU8825_XTALK_DONE ||
+		nau8825_jack_early(nau8825)))
+		nau_jack_report(&nau8825->jack_rpt, nau8825->jack, event,
+				event_mask);
+}
 
-	if (regmap_read(regmap, NAU8825_REG_IRQ_STATUS, &active_irq)) {
-		dev_err(nau8825->dev, "failed to read irq status\n");
-		return IRQ_NONE;
-	}
+/* A long press is reported as the release and the press again of the
+ * buttons held, which the input layer sees as a new key down. The repeat
+ * sends the same pulse from a work, so no interruption or polling of the
+ * SAR is needed while the buttons are held.
+ */
+static void nau8825_button_pulse(struct nau8825 *nau8825, int buttons)
+{
+	nau8825_jack_report(nau8825, nau8825->button_pressed & ~buttons,
+		NAU8825_BUTTONS);
+	nau8825_jack_report(nau8825, nau8825->button_pressed,
+		NAU8825_BUTTONS);
+}
 
-	if ((active_irq & NAU8825_JACK_EJECTION_IRQ_MASK) ==
-		NAU8825_JACK_EJECTION_DETECTED) {
+static void nau8825_key_repeat_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 = container_of(
+		work, struct nau8825, key_repeat_work.work);
 
-		nau8825_eject_jack(nau8825);
-		event_mask |= SND_JACK_HEADSET;
-		clear_irq = NAU8825_JACK_EJECTION_IRQ_MASK;
-	} else if (active_irq & NAU8825_KEY_SHORT_PRESS_IRQ) {
-		int key_status;
+	if (!nau8825->button_long)
+		return;
+	nau8825_button_pulse(nau8825, nau8825->button_long);
+	schedule_delayed_work(&nau8825->key_repeat_work,
+		msecs_to_jiffies(nau8825->key_repeat));
+}
 
-		regmap_read(regmap, NAU8825_REG_INT_CLR_KEY_STATUS,
-			&key_status);
+/* A pass of the handler over the causes of one status read */
+struct nau8825_irq_pass {
+	int active;	/* the status read */
+	int clear;	/* the status cleared at the end of the pass */
+	int event;
+	int event_mask;
+};
 
-		/* upper 8 bits of the register are for short pressed keys,
-		 * lower 8 bits - for long pressed buttons
-		 */
-		nau8825->button_pressed = nau8825_button_decode(
-			key_status >> 8);
-
-		event |= nau8825->button_pressed;
-		event_mask |= NAU8825_BUTTONS;
-		clear_irq = NAU8825_KEY_SHORT_PRESS_IRQ;
-	} else if (active_irq & NAU8825_KEY_RELEASE_IRQ) {
-		event_mask = NAU8825_BUTTONS;
-		clear_irq = NAU8825_KEY_RELEASE_IRQ;
-	} else if (active_irq & NAU8825_HEADSET_COMPLETION_IRQ) {
-		if (nau8825_is_jack_inserted(regmap)) {
-			event |= nau8825_jack_insert(nau8825);
-			if (nau8825->xtalk_enable && !nau8825->high_imped) {
-				/* Apply the cross talk suppression in the
-				 * headset without high impedance.
-				 */
-				if (!nau8825->xtalk_protect) {
-					/* Raise protection for cross talk de-
-					 * tection if no protection before.
-					 * The driver has to cancel the pro-
-					 * cess and restore changes if process
-					 * is ongoing when ejection.
-					 */
-					int ret;
-					nau8825->xtalk_protect = true;
-					ret = nau8825_sema_acquire(nau8825, 0);
-					if (ret)
-						nau8825->xtalk_protect = false;
-				}
-				/* Startup cross talk detection process */
-				if (nau8825->xtalk_protect) {
-					nau8825->xtalk_state =
-						NAU8825_XTALK_PREPARE;
-					schedule_work(&nau8825->xtalk_work);
-				}
-			} else {
-				/* The cross talk suppression shouldn't apply
-				 * in the headset with high impedance. Thus,
-				 * relieve the protection raised before.
-				 */
-				if (nau8825->xtalk_protect) {
-					nau8825_sema_release(nau8825);
-					nau8825->xtalk_protect = false;
-				}
+/* The causes at audo mode, which the insertion at manual mode yields to */
+#define NAU8825_IRQ_AUTO_CAUSES (NAU8825_HEADSET_COMPLETION_IRQ | \
+	NAU8825_KEY_SHORT_PRESS_IRQ | NAU8825_KEY_LONG_PRESS_IRQ | \
+	NAU8825_KEY_RELEASE_IRQ | NAU8825_IMPEDANCE_MEAS_IRQ)
+
+/* The ejection overrides the others because the jack is gone, and its
+ * status is cleared during the ejection.
+ */
+static bool nau8825_irq_eject(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	/* gone before the clock of the ejection is decided */
+	WRITE_ONCE(nau8825->jack_present, false);
+	nau8825_duty_stop(nau8825);
+	nau8825_eject_jack(nau8825);
+	pass->event_mask |= SND_JACK_HEADSET;
+	pass->clear = NAU8825_JACK_EJECTION_IRQ_MASK;
+
+	return true;
+}
+
+static bool nau8825_irq_headset_completion(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	struct regmap *regmap = nau8825->regmap;
+	bool ejected = false;
+	unsigned int dgain;
+
+	if (nau8825_jack_sample(nau8825)) {
+		pass->event |= nau8825_jack_insert(nau8825);
+		if (!nau8825->high_imped &&
+			nau8825_xtalk_calib_lookup(nau8825, &dgain)) {
+			/* Calibrated in the factory, no detection */
+			dev_dbg(nau8825->dev, "cross talk calibrated: %x\n",
+				dgain);
+			regmap_write(regmap, NAU8825_REG_DAC_DGAIN_CTRL, dgain);
+			nau8825_xtalk_release(nau8825);
+		} else if (nau8825_xtalk_on(nau8825) && !nau8825->high_imped &&
+			nau8825_xtalk_cache_lookup(nau8825, &dgain)) {
+			/* The same headset measured recently, apply its
+			 * sidetone and skip the detection.
+			 */
+			dev_dbg(nau8825->dev, "cross talk cached: %x\n", dgain);
+			regmap_write(regmap, NAU8825_REG_DAC_DGAIN_CTRL, dgain);
+			nau8825_xtalk_release(nau8825);
+		} else if (nau8825_xtalk_on(nau8825) && !nau8825->high_imped) {
+			/* Apply the cross talk suppression in the headset
+			 * without high impedance.
+			 */
+			/* Raise protection for cross talk detection if no
+			 * protection before, and startup cross talk detection
+			 * process. The driver has to cancel the process and
+			 * restore changes if process is ongoing when ejection.
+			 */
+			if (nau8825_xtalk_claim(nau8825)) {
+				WRITE_ONCE(nau8825->xtalk_preempt, false);
+				nau8825->xtalk_state = NAU8825_XTALK_PREPARE;
+				nau8825->xtalk_pending =
+					NAU8825_XTALK_PEND_NONE;
+				nau8825_xtalk_queue(nau8825, 0);
 			}
 		} else {
-			dev_warn(nau8825->dev, "Headset completion IRQ fired but no headset connected\n");
-			nau8825_eject_jack(nau8825);
+			/* The cross talk suppression shouldn't apply in the
+			 * headset with high impedance. Thus, relieve the
+			 * protection raised before.
+			 */
+			nau8825_xtalk_release(nau8825);
 		}
+	} else {
+		dev_warn(nau8825->dev, "Headset completion IRQ fired but no headset connected\n");
+		nau8825_eject_jack(nau8825);
+		ejected = true;
+	}
 
-		event_mask |= SND_JACK_HEADSET;
-		clear_irq = NAU8825_HEADSET_COMPLETION_IRQ;
-		/* Record the interruption report event for driver to report
-		 * the event later. The jack report will delay until cross
-		 * talk detection process is done.
-		 */
-		if (nau8825->xtalk_state == NAU8825_XTALK_PREPARE) {
-			nau8825->xtalk_event = event;
-			nau8825->xtalk_event_mask = event_mask;
+	pass->event_mask |= SND_JACK_HEADSET;
+	/* Record the interruption report event for driver to report the
+	 * event later. The jack report will delay until cross talk
+	 * detection process is done.
+	 */
+	if (nau8825->xtalk_state == NAU8825_XTALK_PREPARE) {
+		nau8825->xtalk_event = pass->event;
+		nau8825->xtalk_event_mask = pass->event_mask;
+	} else if (!ejected) {
+		nau8825_adc_detect_off(nau8825);
+		nau8825_warm_update(nau8825);
+		nau8825_duty_start(nau8825);
+	}
+	if (ejected)
+		pass->clear = NAU8825_HEADSET_COMPLETION_IRQ;
+
+	return ejected;
+}
+
+static bool nau8825_irq_key_short_press(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	int key_status;
+
+	regmap_read(nau8825->regmap, NAU8825_REG_INT_CLR_KEY_STATUS,
+		&key_status);
+
+	/* upper 8 bits of the register are for short pressed keys,
+	 * lower 8 bits - for long pressed buttons
+	 */
+	nau8825->button_pressed = nau8825_button_decode(key_status >> 8);
+	nau_latency_add(&nau8825->latency[
+		NAU8825_LAT_KEY_LOW_POWER + nau8825->sar_applied],
+		nau8825->irq_time);
+
+	pass->event |= nau8825->button_pressed;
+	pass->event_mask |= NAU8825_BUTTONS;
+
+	return false;
+}
+
+/* The long press flags the buttons still held when the debounce of the
+ * chip expires. Its press is reported at first, so the pulse after it
+ * comes in order.
+ */
+static bool nau8825_irq_key_long_press(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	int key_status, buttons;
+
+	if (pass->active & NAU8825_KEY_RELEASE_IRQ)
+		return false;
+
+	regmap_read(nau8825->regmap, NAU8825_REG_INT_CLR_KEY_STATUS,
+		&key_status);
+	buttons = nau8825_button_decode(key_status & 0xff);
+	nau8825->button_pressed |= buttons;
+	if (buttons) {
+		if (pass->event_mask & NAU8825_BUTTONS) {
+			nau8825_jack_report(nau8825, pass->event,
+				pass->event_mask);
+			pass->event_mask &= ~NAU8825_BUTTONS;
 		}
-	} else if (active_irq & NAU8825_IMPEDANCE_MEAS_IRQ) {
-		/* crosstalk detection enable and process on going */
-		if (nau8825->xtalk_enable && nau8825->xtalk_protect)
-			schedule_work(&nau8825->xtalk_work);
-		clear_irq = NAU8825_IMPEDANCE_MEAS_IRQ;
-	} else if ((active_irq & NAU8825_JACK_INSERTION_IRQ_MASK) ==
-		NAU8825_JACK_INSERTION_DETECTED) {
-		/* One more step to check GPIO status directly. Thus, the
-		 * driver can confirm the real insertion interruption because
-		 * the intrruption at manual mode has bypassed debounce
-		 * circuit which can get rid of unstable status.
+		nau8825->button_long = buttons;
+		nau8825_button_pulse(nau8825, buttons);
+		if (nau8825->key_repeat)
+			schedule_delayed_work(&nau8825->key_repeat_work,
+				msecs_to_jiffies(nau8825->key_repeat));
+	}
+
+	return false;
+}
+
+static bool nau8825_irq_key_release(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	nau8825_key_repeat_stop(nau8825);
+	/* The press and the release of a short click come in the same
+	 * pass. Report the press before the release clears it.
+	 */
+	if (pass->event & NAU8825_BUTTONS) {
+		nau8825_jack_report(nau8825, pass->event, pass->event_mask);
+		pass->event &= ~NAU8825_BUTTONS;
+	}
+	pass->event_mask |= NAU8825_BUTTONS;
+
+	return false;
+}
+
+static bool nau8825_irq_impedance_meas(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	/* crosstalk detection enable and process on going */
+	if (nau8825_xtalk_on(nau8825) && nau8825_xtalk_measuring(nau8825))
+		nau8825_xtalk_queue(nau8825, 0);
+
+	return false;
+}
+
+/* The insertion at manual mode is only taken when no interruption at audo
+ * mode is pending.
+ */
+static bool nau8825_irq_insert(struct nau8825 *nau8825,
+	struct nau8825_irq_pass *pass)
+{
+	struct regmap *regmap = nau8825->regmap;
+
+	if (pass->active & NAU8825_IRQ_AUTO_CAUSES)
+		return false;
+
+	/* One more step to check GPIO status directly. Thus, the driver can
+	 * confirm the real insertion interruption because the intrruption
+	 * at manual mode has bypassed debounce circuit which can get rid of
+	 * unstable status. The debounce filter of the chip did it otherwise.
+	 */
+	if (nau8825->jack_db_applied == NAU8825_JACK_DB_FILTER)
+		WRITE_ONCE(nau8825->jack_present, true);
+	if (nau8825_jack_present(nau8825) || nau8825_jack_sample(nau8825)) {
+		/* Turn off insertion interruption at manual mode */
+		regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_DIS_CTRL,
+			NAU8825_IRQ_INSERT_DIS, NAU8825_IRQ_INSERT_DIS);
+		regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK,
+			NAU8825_IRQ_INSERT_EN, NAU8825_IRQ_INSERT_EN);
+		/* Enable interruption for jack type detection at audo mode
+		 * which can detect microphone and jack type.
 		 */
-		if (nau8825_is_jack_inserted(regmap)) {
-			/* Turn off insertion interruption at manual mode */
-			regmap_update_bits(regmap,
-				NAU8825_REG_INTERRUPT_DIS_CTRL,
-				NAU8825_IRQ_INSERT_DIS,
-				NAU8825_IRQ_INSERT_DIS);
-			regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK,
-				NAU8825_IRQ_INSERT_EN, NAU8825_IRQ_INSERT_EN);
-			/* Enable interruption for jack type detection at audo
-			 * mode which can detect microphone and jack type.
-			 */
-			nau8825_setup_auto_irq(nau8825);
+		nau8825_setup_auto_irq(nau8825);
+		/* The headphone goes out now, and the headset completion
+		 * upgrades it once the microphone is classified.
+		 */
+		if (nau8825->hp_early_report) {
+			pass->event |= SND_JACK_HEADPHONE;
+			pass->event_mask |= SND_JACK_HEADSET;
 		}
 	}
 
-	if (!clear_irq)
-		clear_irq = active_irq;
-	/* clears the rightmost interruption */
-	regmap_write(regmap, NAU8825_REG_INT_CLR_KEY_STATUS, clear_irq);
+	return false;
+}
+
+/* The causes in the order they are handled in a pass. A handler which
+ * returns true ends the pass, and clears only the status it set.
+ */
+static const struct nau8825_irq_cause nau8825_irq_causes[] = {
+	{ "eject", NAU8825_JACK_EJECTION_IRQ_MASK,
+		NAU8825_JACK_EJECTION_DETECTED, nau8825_irq_eject },
+	{ "headset_completion", NAU8825_HEADSET_COMPLETION_IRQ,
+		NAU8825_HEADSET_COMPLETION_IRQ,
+		nau8825_irq_headset_completion },
+	{ "key_short_press", NAU8825_KEY_SHORT_PRESS_IRQ,
+		NAU8825_KEY_SHORT_PRESS_IRQ, nau8825_irq_key_short_press },
+	{ "key_long_press", NAU8825_KEY_LONG_PRESS_IRQ,
+		NAU8825_KEY_LONG_PRESS_IRQ, nau8825_irq_key_long_press },
+	{ "key_release", NAU8825_KEY_RELEASE_IRQ, NAU8825_KEY_RELEASE_IRQ,
+		nau8825_irq_key_release },
+	{ "impedance_meas", NAU8825_IMPEDANCE_MEAS_IRQ,
+		NAU8825_IMPEDANCE_MEAS_IRQ, nau8825_irq_impedance_meas },
+	{ "insert", NAU8825_JACK_INSERTION_IRQ_MASK,
+		NAU8825_JACK_INSERTION_DETECTED, nau8825_irq_insert },
+	{ "short_circuit", NAU8825_SHORT_CIRCUIT_IRQ,
+		NAU8825_SHORT_CIRCUIT_IRQ },
+};
+
+static bool nau8825_irq_cause_active(const struct nau8825_irq_cause *cause,
+	int active_irq)
+{
+	return (active_irq & cause->mask) == cause->detected;
+}
+
+/* Count the handler passes and each cause pending in them. */
+static void nau8825_irq_stat(struct nau8825 *nau8825, int active_irq)
+{
+	int i;
+
+	nau8825->irq_count++;
+	for (i = 0; i < ARRAY_SIZE(nau8825_irq_causes); i++)
+		if (nau8825_irq_cause_active(&nau8825_irq_causes[i],
+			active_irq))
+			nau8825->irq_cause_count[i]++;
+}
+
+static irqreturn_t nau8825_handle_irq(struct nau8825 *nau8825)
+{
+	const struct nau8825_irq_cause *cause;
+	struct nau8825_irq_pass pass = { 0 };
+	int i;
+
+	if (regmap_read(nau8825->regmap, NAU8825_REG_IRQ_STATUS,
+		&pass.active)) {
+		dev_err(nau8825->dev, "failed to read irq status\n");
+		return IRQ_NONE;
+	}
+	nau8825_irq_stat(nau8825, pass.active);
 
-	/* Delay jack report until cross talk detection is done. It can avoid
-	 * application to do playback preparation when cross talk detection
-	 * process is still working. Otherwise, the resource like clock and
-	 * power will be issued by them at the same time and conflict happens.
+	/* All the pending causes are handled in one pass and cleared with
+	 * a single write, unless a handler ends the pass.
 	 */
-	if (event_mask && nau8825->xtalk_state == NAU8825_XTALK_DONE)
-		snd_soc_jack_report(nau8825->jack, event, event_mask);
+	pass.clear = pass.active;
+	for (i = 0; i < ARRAY_SIZE(nau8825_irq_causes); i++) {
+		cause = &nau8825_irq_causes[i];
+		if (cause->handle && nau8825_irq_cause_active(cause,
+			pass.active) && cause->handle(nau8825, &pass))
+			break;
+	}
+	nau8825_int_status_clear(nau8825->regmap, pass.clear);
+
+	nau8825_jack_report(nau8825, pass.event, pass.event_mask);
 
 	return IRQ_HANDLED;
 }
 
+/* Stamp the interruption, for the response time of the buttons */
+static irqreturn_t nau8825_hardirq(int irq, void *data)
+{
+	struct nau8825 *nau8825 = (struct nau8825 *)data;
+
+	nau8825->irq_time = ktime_get();
+
+	return IRQ_WAKE_THREAD;
+}
+
+static irqreturn_t nau8825_interrupt(int irq, void *data)
+{
+	struct nau8825 *nau8825 = (struct nau8825 *)data;
+	irqreturn_t ret;
+	int passes = 0;
+
+	nau_latency_add(&nau8825->latency[NAU8825_LAT_IRQ_THREAD],
+		nau8825->irq_time);
+	nau_irq_thread_prio(&nau8825->irq_cfg);
+	/* The jack events wake up the codec runtime suspended */
+	if (nau8825_pm_get(nau8825) < 0)
+		return IRQ_NONE;
+	do {
+		ret = nau8825_handle_irq(nau8825);
+	} while (ret == IRQ_HANDLED && nau_irq_edge_again(&nau8825->irq_cfg,
+		nau8825->regmap, NAU8825_REG_IRQ_STATUS, 0x7ff, &passes));
+	nau8825_pm_put(nau8825);
+
+	return ret;
+}
+
 static void nau8825_setup_buttons(struct nau8825 *nau8825)
 {
 	struct regmap *regmap = nau8825->regmap;
@@ -2154,12 +3775,6 @@ static void nau8825_setup_buttons(struct nau8825 *nau8825)
 	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
 		NAU8825_SAR_TRACKING_GAIN_MASK,
 		nau8825->sar_voltage << NAU8825_SAR_TRACKING_GAIN_SFT);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-		NAU8825_SAR_COMPARE_TIME_MASK,
-		nau8825->sar_compare_time << NAU8825_SAR_COMPARE_TIME_SFT);
-	regmap_update_bits(regmap, NAU8825_REG_SAR_CTRL,
-		NAU8825_SAR_SAMPLING_TIME_MASK,
-		nau8825->sar_sampling_time << NAU8825_SAR_SAMPLING_TIME_SFT);
 
 	regmap_update_bits(regmap, NAU8825_REG_KEYDET_CTRL,
 		NAU8825_KEYDET_LEVELS_NR_MASK,
@@ -2167,9 +3782,9 @@ static void nau8825_setup_buttons(struct nau8825 *nau8825)
 	regmap_update_bits(regmap, NAU8825_REG_KEYDET_CTRL,
 		NAU8825_KEYDET_HYSTERESIS_MASK,
 		nau8825->sar_hysteresis << NAU8825_KEYDET_HYSTERESIS_SFT);
-	regmap_update_bits(regmap, NAU8825_REG_KEYDET_CTRL,
-		NAU8825_KEYDET_SHORTKEY_DEBOUNCE_MASK,
-		nau8825->key_debounce << NAU8825_KEYDET_SHORTKEY_DEBOUNCE_SFT);
+	/* The SAR timings and the debounce are of the profile selected */
+	nau8825->sar_applied = NAU8825_SAR_PROFILE_NUM;
+	nau8825_sar_profile_apply(nau8825);
 
 	regmap_write(regmap, NAU8825_REG_VDET_THRESHOLD_1,
 		(nau8825->sar_threshold[0] << 8) | nau8825->sar_threshold[1]);
@@ -2180,62 +3795,75 @@ static void nau8825_setup_buttons(struct nau8825 *nau8825)
 	regmap_write(regmap, NAU8825_REG_VDET_THRESHOLD_4,
 		(nau8825->sar_threshold[6] << 8) | nau8825->sar_threshold[7]);
 
-	/* Enable short press and release interruptions */
+	/* Enable short press, long press and release interruptions */
 	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK,
-		NAU8825_IRQ_KEY_SHORT_PRESS_EN | NAU8825_IRQ_KEY_RELEASE_EN,
-		0);
+		NAU8825_IRQ_KEY_SHORT_PRESS_EN | NAU8825_IRQ_KEY_LONG_PRESS_EN |
+		NAU8825_IRQ_KEY_RELEASE_EN, 0);
 }
 
+/* The fixed part of the initiation, the reset values with the settings
+ * below made. Each register is written once; the settings depending on
+ * the device properties or the chip revision are updated afterwards.
+ */
+static const struct reg_sequence nau8825_init_seq[] = {
+	/* Latch IIC LSB value */
+	{ NAU8825_REG_IIC_ADDR_SET, 0x0001 },
+	/* Disable Boost Driver, Automatic Short circuit protection enable,
+	 * and the global bias on.
+	 */
+	{ NAU8825_REG_BOOST, 0x3340 },
+	/* Pull up IRQ pin, mask unneeded IRQs: 1 - disable, 0 - enable */
+	{ NAU8825_REG_INTERRUPT_MASK, 0x67ff },
+	/* Default oversampling/decimations settings are unusable
+	 * (audible hiss). Set it to something better. CICCLP off.
+	 */
+	{ NAU8825_REG_ADC_RATE, 0x0001 },
+	{ NAU8825_REG_DAC_CTRL1, 0x0080 },
+	/* Class AB bias current to 2x, DAC Capacitor enable MSB/LSB */
+	{ NAU8825_REG_ANALOG_CONTROL_2, 0x1003 },
+	/* Class G timer 64ms */
+	{ NAU8825_REG_CLASSG_CTRL, 0x2000 },
+	/* DAC clock delay 2ns, VREF */
+	{ NAU8825_REG_RDAC, 0x002c },
+	/* Config L/R channel */
+	{ NAU8825_REG_DACL_CTRL, 0x00cf },
+	{ NAU8825_REG_DACR_CTRL, 0x02cf },
+	/* Disable short Frame Sync detection logic */
+	{ NAU8825_REG_LEFT_TIME_SLOT, 0x2000 },
+};
+
 static void nau8825_init_regs(struct nau8825 *nau8825)
 {
 	struct regmap *regmap = nau8825->regmap;
+	unsigned int dac_pwr = 0;
 
-	/* Latch IIC LSB value */
-	regmap_write(regmap, NAU8825_REG_IIC_ADDR_SET, 0x0001);
-	/* Enable Bias/Vmid */
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_BIAS_ADJ,
-		NAU8825_BIAS_VMID, NAU8825_BIAS_VMID);
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_BOOST,
-		NAU8825_GLOBAL_BIAS_EN, NAU8825_GLOBAL_BIAS_EN);
-
-	/* VMID Tieoff */
+	/* Enable Bias/Vmid and VMID Tieoff. Enable TESTDAC, which sets the
+	 * analog DAC inputs to a '0' input signal to avoid any glitches due
+	 * to power up transients in both the analog and digital DAC circuit.
+	 */
 	regmap_update_bits(regmap, NAU8825_REG_BIAS_ADJ,
-		NAU8825_BIAS_VMID_SEL_MASK,
-		nau8825->vref_impedance << NAU8825_BIAS_VMID_SEL_SFT);
-	/* Disable Boost Driver, Automatic Short circuit protection enable */
-	regmap_update_bits(regmap, NAU8825_REG_BOOST,
-		NAU8825_PRECHARGE_DIS | NAU8825_HP_BOOST_DIS |
-		NAU8825_HP_BOOST_G_DIS | NAU8825_SHORT_SHUTDOWN_EN,
-		NAU8825_PRECHARGE_DIS | NAU8825_HP_BOOST_DIS |
-		NAU8825_HP_BOOST_G_DIS | NAU8825_SHORT_SHUTDOWN_EN);
+		NAU8825_BIAS_VMID | NAU8825_BIAS_VMID_SEL_MASK |
+		NAU8825_BIAS_TESTDAC_EN, NAU8825_BIAS_VMID |
+		(nau8825->vref_impedance << NAU8825_BIAS_VMID_SEL_SFT) |
+		NAU8825_BIAS_TESTDAC_EN);
+	regmap_multi_reg_write(regmap, nau8825_init_seq,
+		ARRAY_SIZE(nau8825_init_seq));
 
 	regmap_update_bits(regmap, NAU8825_REG_GPIO12_CTRL,
-		NAU8825_JKDET_OUTPUT_EN,
-		nau8825->jkdet_enable ? 0 : NAU8825_JKDET_OUTPUT_EN);
-	regmap_update_bits(regmap, NAU8825_REG_GPIO12_CTRL,
-		NAU8825_JKDET_PULL_EN,
-		nau8825->jkdet_pull_enable ? 0 : NAU8825_JKDET_PULL_EN);
-	regmap_update_bits(regmap, NAU8825_REG_GPIO12_CTRL,
+		NAU8825_JKDET_OUTPUT_EN | NAU8825_JKDET_PULL_EN |
 		NAU8825_JKDET_PULL_UP,
-		nau8825->jkdet_pull_up ? NAU8825_JKDET_PULL_UP : 0);
-	regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
-		NAU8825_JACK_POLARITY,
-		/* jkdet_polarity - 1  is for active-low */
-		nau8825->jkdet_polarity ? 0 : NAU8825_JACK_POLARITY);
-
-	regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
-		NAU8825_JACK_INSERT_DEBOUNCE_MASK,
-		nau8825->jack_insert_debounce << NAU8825_JACK_INSERT_DEBOUNCE_SFT);
+		(nau8825->jkdet_enable ? 0 : NAU8825_JKDET_OUTPUT_EN) |
+		(nau8825->jkdet_pull_enable ? 0 : NAU8825_JKDET_PULL_EN) |
+		(nau8825->jkdet_pull_up ? NAU8825_JKDET_PULL_UP : 0));
 	regmap_update_bits(regmap, NAU8825_REG_JACK_DET_CTRL,
+		NAU8825_JACK_POLARITY | NAU8825_JACK_INSERT_DEBOUNCE_MASK |
 		NAU8825_JACK_EJECT_DEBOUNCE_MASK,
-		nau8825->jack_eject_debounce << NAU8825_JACK_EJECT_DEBOUNCE_SFT);
-
-	/* Pull up IRQ pin */
-	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK,
-		NAU8825_IRQ_PIN_PULLUP | NAU8825_IRQ_PIN_PULL_EN,
-		NAU8825_IRQ_PIN_PULLUP | NAU8825_IRQ_PIN_PULL_EN);
-	/* Mask unneeded IRQs: 1 - disable, 0 - enable */
-	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_MASK, 0x7ff, 0x7ff);
+		/* jkdet_polarity - 1  is for active-low */
+		(nau8825->jkdet_polarity ? 0 : NAU8825_JACK_POLARITY) |
+		(nau8825->jack_insert_debounce <<
+		NAU8825_JACK_INSERT_DEBOUNCE_SFT) |
+		(nau8825->jack_eject_debounce <<
+		NAU8825_JACK_EJECT_DEBOUNCE_SFT));
 
 	regmap_update_bits(regmap, NAU8825_REG_MIC_BIAS,
 		NAU8825_MICBIAS_VOLTAGE_MASK, nau8825->micbias_voltage);
@@ -2243,78 +3871,248 @@ static void nau8825_init_regs(struct nau8825 *nau8825)
 	if (nau8825->sar_threshold_num)
 		nau8825_setup_buttons(nau8825);
 
-	/* Default oversampling/decimations settings are unusable
-	 * (audible hiss). Set it to something better.
-	 */
-	regmap_update_bits(regmap, NAU8825_REG_ADC_RATE,
-		NAU8825_ADC_SYNC_DOWN_MASK | NAU8825_ADC_SINC4_EN,
-		NAU8825_ADC_SYNC_DOWN_64);
-	regmap_update_bits(regmap, NAU8825_REG_DAC_CTRL1,
-		NAU8825_DAC_OVERSAMPLE_MASK, NAU8825_DAC_OVERSAMPLE_64);
-	/* Disable DACR/L power */
+	/* Disable DACR/L power, ADCDAT IO drive strength control */
 	if (nau8825->sw_id == NAU8825_SOFTWARE_ID_NAU8825)
-		regmap_update_bits(regmap, NAU8825_REG_CHARGE_PUMP,
-				   NAU8825_POWER_DOWN_DACR | NAU8825_POWER_DOWN_DACL,
-				   NAU8825_POWER_DOWN_DACR | NAU8825_POWER_DOWN_DACL);
-	/* Enable TESTDAC. This sets the analog DAC inputs to a '0' input
-	 * signal to avoid any glitches due to power up transients in both
-	 * the analog and digital DAC circuit.
-	 */
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_BIAS_ADJ,
-		NAU8825_BIAS_TESTDAC_EN, NAU8825_BIAS_TESTDAC_EN);
-	/* CICCLP off */
-	regmap_update_bits(regmap, NAU8825_REG_DAC_CTRL1,
-		NAU8825_DAC_CLIP_OFF, NAU8825_DAC_CLIP_OFF);
+		dac_pwr = NAU8825_POWER_DOWN_DACR | NAU8825_POWER_DOWN_DACL;
+	regmap_update_bits(regmap, NAU8825_REG_CHARGE_PUMP,
+		NAU8825_POWER_DOWN_DACR | NAU8825_POWER_DOWN_DACL |
+		NAU8825_ADCOUT_DS_MASK,
+		dac_pwr | (nau8825->adcout_ds << NAU8825_ADCOUT_DS_SFT));
+}
+
+static const struct regmap_config nau8825_regmap_config = {
+	.val_bits = NAU8825_REG_DATA_LEN,
+	.reg_bits = NAU8825_REG_ADDR_LEN,
+
+	.max_register = NAU8825_REG_MAX,
+	.readable_reg = nau8825_readable_reg,
+	.writeable_reg = nau8825_writeable_reg,
+	.volatile_reg = nau8825_volatile_reg,
+
+	/* contiguous registers are synced in one transfer */
+	.use_single_write = false,
+
+	.cache_type = REGCACHE_RBTREE,
+	.reg_defaults = nau8825_reg_defaults,
+	.num_reg_defaults = ARRAY_SIZE(nau8825_reg_defaults),
+};
+
+#ifdef CONFIG_DEBUG_FS
+static const char * const nau8825_latency_names[NAU8825_LAT_NUM] = {
+	[NAU8825_LAT_STARTUP] = "startup",
+	[NAU8825_LAT_HW_PARAMS] = "hw_params",
+	[NAU8825_LAT_XTALK_WAIT] = "xtalk_wait",
+	[NAU8825_LAT_FEPGA] = "fepga_settle",
+	[NAU8825_LAT_PUMP] = "pump_ramp",
+	[NAU8825_LAT_KEY_LOW_POWER] = "key_low_power",
+	[NAU8825_LAT_KEY_FAST] = "key_fast",
+	[NAU8825_LAT_XTALK_QUEUE] = "xtalk_queue",
+	[NAU8825_LAT_XTALK_RUN] = "xtalk_run",
+	[NAU8825_LAT_IRQ_THREAD] = "irq_thread",
+};
+
+/* The interruption counters under the debugfs of the component, which
+ * quantify the cost of interruption storm like plug bounce, the
+ * register sync of resume and the stages of the stream start.
+ */
+static void nau8825_debugfs_init(struct snd_soc_component *component)
+{
+	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	struct dentry *dir;
+	int i;
+
+	if (!component->debugfs_root)
+		return;
+
+	dir = debugfs_create_dir("irq", component->debugfs_root);
+	debugfs_create_u32("count", 0444, dir, &nau8825->irq_count);
+	for (i = 0; i < ARRAY_SIZE(nau8825_irq_causes); i++)
+		debugfs_create_u32(nau8825_irq_causes[i].name, 0444, dir,
+			&nau8825->irq_cause_count[i]);
+	nau_irq_poll_debugfs_init(dir, &nau8825->irq_poll);
+	dir = debugfs_create_dir("xtalk", component->debugfs_root);
+	debugfs_create_u32("preempted", 0444, dir,
+		&nau8825->xtalk_preempt_count);
+	nau_regcache_debugfs_init(component->debugfs_root, "resume",
+		&nau8825->resume_sync);
+	nau_regstat_debugfs_init(component->debugfs_root, &nau8825->regstat);
+	nau_regcache_report_debugfs_init(component->debugfs_root,
+		&nau8825->regcache_report, nau8825->regmap,
+		&nau8825_regmap_config);
+	nau_latency_debugfs_init(component->debugfs_root, nau8825->latency,
+		nau8825_latency_names, NAU8825_LAT_NUM);
+	nau_hw_params_debugfs_init(component->debugfs_root,
+		&nau8825->hw_params_cache);
+	nau_clk_plan_debugfs_init(component->debugfs_root,
+		&nau8825->clk_plan);
+	debugfs_create_u32("fll_keepalive_ms", 0644, component->debugfs_root,
+		&nau8825->fll_keep_ms);
+	debugfs_create_u32("fll_reused", 0444, component->debugfs_root,
+		&nau8825->fll_reused);
+	debugfs_create_u32("beeps", 0444, component->debugfs_root,
+		&nau8825->beeps);
+	debugfs_create_u32("beep_skips", 0444, component->debugfs_root,
+		&nau8825->beep_skips);
+	nau_jack_report_debugfs_init(component->debugfs_root,
+		&nau8825->jack_rpt);
+	nau_delay_debugfs_init(component->debugfs_root, &nau8825->delay);
+	nau_duty_debugfs_init(component->debugfs_root, &nau8825->duty);
+	nau_biq_rates_debugfs_init(component->debugfs_root, "biq_rate_switches",
+		&nau8825->biq_rates);
+	nau_dapm_stat_debugfs_init(component->debugfs_root,
+		&nau8825->dapm_stat);
+	nau_scenes_debugfs_init(component->debugfs_root, &nau8825->scenes);
+
+	dir = debugfs_create_dir("probe", component->debugfs_root);
+	debugfs_create_u32("attempts", 0444, dir, &nau8825_probe_attempts);
+	debugfs_create_u32("time_us", 0444, dir, &nau8825_probe_us);
+}
+#else
+static inline void nau8825_debugfs_init(struct snd_soc_component *component)
+{
+}
+#endif
+
+/* The widgets of the power accounting, which keep the most current */
+static const char * const nau8825_dapm_stat_names[] = {
+	"System Clock", "MICBIAS", "SAR", "Frontend PGA", "ADC",
+	"Charge Pump", "HP Boost Driver", "Class G",
+};
+
+/* The cycle of the sine in samples of the internal VCO, which makes 23 Hz
+ * of 8192 ones; the tone asked gets the nearest of 184, 92, 46 and 23 Hz.
+ */
+static unsigned int nau8825_tone_cycle(unsigned int hz)
+{
+	if (hz >= 130)
+		return NAU8825_IMM_CYC_1024;
+	if (hz >= 65)
+		return NAU8825_IMM_CYC_2048;
+	if (hz >= 33)
+		return NAU8825_IMM_CYC_4096;
+
+	return NAU8825_IMM_CYC_8192;
+}
+
+/* A beep plays on the headphone without any stream, so the host keeps its
+ * audio path and DMA down for a click or a bell. The tone takes the DACs
+ * over, so it's skipped while a stream or the cross talk detection uses
+ * them.
+ */
+static void nau8825_beep_work(struct work_struct *work)
+{
+	struct nau8825 *nau8825 = container_of(work, struct nau8825,
+		beep_work);
+	struct snd_soc_dapm_context *dapm = nau8825->dapm;
+	unsigned int hz = READ_ONCE(nau8825->beep_hz);
+
+	mutex_lock(&dapm->card->dapm_mutex);
+	if (hz && !snd_soc_dapm_get_pin_status(dapm, "Tone") &&
+		(snd_soc_component_active(dapm->component) ||
+		nau8825->xtalk_state != NAU8825_XTALK_DONE ||
+		!nau8825_jack_present(nau8825))) {
+		nau8825->beep_skips++;
+		goto unlock;
+	}
+	if (hz) {
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_IMM_MODE_CTRL,
+			NAU8825_IMM_CYC_MASK, nau8825_tone_cycle(hz));
+		if (!snd_soc_dapm_get_pin_status(dapm, "Tone"))
+			nau8825->beeps++;
+		snd_soc_dapm_enable_pin_unlocked(dapm, "Tone");
+	} else {
+		snd_soc_dapm_disable_pin_unlocked(dapm, "Tone");
+	}
+	snd_soc_dapm_sync_unlocked(dapm);
+unlock:
+	mutex_unlock(&dapm->card->dapm_mutex);
+}
+
+static int nau8825_beep_event(struct input_dev *dev, unsigned int type,
+	unsigned int code, int hz)
+{
+	struct nau8825 *nau8825 = input_get_drvdata(dev);
+
+	if (type != EV_SND)
+		return -EINVAL;
+	switch (code) {
+	case SND_BELL:
+		if (hz)
+			hz = NAU8825_BELL_HZ;
+		break;
+	case SND_TONE:
+		break;
+	default:
+		return -EINVAL;
+	}
+	WRITE_ONCE(nau8825->beep_hz, hz);
+	schedule_work(&nau8825->beep_work);
 
-	/* Class AB bias current to 2x, DAC Capacitor enable MSB/LSB */
-	regmap_update_bits(regmap, NAU8825_REG_ANALOG_CONTROL_2,
-		NAU8825_HP_NON_CLASSG_CURRENT_2xADJ |
-		NAU8825_DAC_CAPACITOR_MSB | NAU8825_DAC_CAPACITOR_LSB,
-		NAU8825_HP_NON_CLASSG_CURRENT_2xADJ |
-		NAU8825_DAC_CAPACITOR_MSB | NAU8825_DAC_CAPACITOR_LSB);
-	/* Class G timer 64ms */
-	regmap_update_bits(regmap, NAU8825_REG_CLASSG_CTRL,
-		NAU8825_CLASSG_TIMER_MASK,
-		0x20 << NAU8825_CLASSG_TIMER_SFT);
-	/* DAC clock delay 2ns, VREF */
-	regmap_update_bits(regmap, NAU8825_REG_RDAC,
-		NAU8825_RDAC_CLK_DELAY_MASK | NAU8825_RDAC_VREF_MASK,
-		(0x2 << NAU8825_RDAC_CLK_DELAY_SFT) |
-		(0x3 << NAU8825_RDAC_VREF_SFT));
-	/* Config L/R channel */
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_DACL_CTRL,
-		NAU8825_DACL_CH_SEL_MASK, NAU8825_DACL_CH_SEL_L);
-	regmap_update_bits(nau8825->regmap, NAU8825_REG_DACR_CTRL,
-		NAU8825_DACL_CH_SEL_MASK, NAU8825_DACL_CH_SEL_R);
-	/* Disable short Frame Sync detection logic */
-	regmap_update_bits(regmap, NAU8825_REG_LEFT_TIME_SLOT,
-		NAU8825_DIS_FS_SHORT_DET, NAU8825_DIS_FS_SHORT_DET);
-	/* ADCDAT IO drive strength control */
-	regmap_update_bits(regmap, NAU8825_REG_CHARGE_PUMP,
-			   NAU8825_ADCOUT_DS_MASK,
-			   nau8825->adcout_ds << NAU8825_ADCOUT_DS_SFT);
+	return 0;
 }
 
-static const struct regmap_config nau8825_regmap_config = {
-	.val_bits = NAU8825_REG_DATA_LEN,
-	.reg_bits = NAU8825_REG_ADDR_LEN,
+static void nau8825_beep_init(struct nau8825 *nau8825)
+{
+	struct input_dev *beep;
+	int ret;
 
-	.max_register = NAU8825_REG_MAX,
-	.readable_reg = nau8825_readable_reg,
-	.writeable_reg = nau8825_writeable_reg,
-	.volatile_reg = nau8825_volatile_reg,
+	INIT_WORK(&nau8825->beep_work, nau8825_beep_work);
+	beep = input_allocate_device();
+	if (!beep)
+		return;
+	beep->name = "NAU8825 Beep Generator";
+	beep->phys = dev_name(nau8825->dev);
+	beep->id.bustype = BUS_I2C;
+	beep->dev.parent = nau8825->dev;
+	beep->evbit[0] = BIT_MASK(EV_SND);
+	beep->sndbit[0] = BIT_MASK(SND_BELL) | BIT_MASK(SND_TONE);
+	beep->event = nau8825_beep_event;
+	input_set_drvdata(beep, nau8825);
+	ret = input_register_device(beep);
+	if (ret) {
+		dev_warn(nau8825->dev, "No beep generator (%d)\n", ret);
+		input_free_device(beep);
+		return;
+	}
+	nau8825->beep = beep;
+}
 
-	.cache_type = REGCACHE_RBTREE,
-	.reg_defaults = nau8825_reg_defaults,
-	.num_reg_defaults = ARRAY_SIZE(nau8825_reg_defaults),
-};
+static void nau8825_beep_remove(struct nau8825 *nau8825)
+{
+	if (!nau8825->beep)
+		return;
+	input_unregister_device(nau8825->beep);
+	nau8825->beep = NULL;
+	cancel_work_sync(&nau8825->beep_work);
+}
 
 static int nau8825_component_probe(struct snd_soc_component *component)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	struct snd_soc_dapm_context *dapm = snd_soc_component_get_dapm(component);
+	int ret;
 
 	nau8825->dapm = dapm;
+	/* before the routes of the component driver, which take them */
+	if (nau8825->fast_hp_start)
+		ret = snd_soc_dapm_new_controls(dapm, nau8825_hp_fast_widgets,
+			ARRAY_SIZE(nau8825_hp_fast_widgets));
+	else
+		ret = snd_soc_dapm_new_controls(dapm, nau8825_hp_stage_widgets,
+			ARRAY_SIZE(nau8825_hp_stage_widgets));
+	if (ret)
+		return ret;
+	nau_scenes_read(nau8825->dev, &nau8825->scenes);
+	ret = nau_scenes_init(component, &nau8825->scenes);
+	if (ret)
+		return ret;
+	INIT_DELAYED_WORK(&nau8825->adc_unmute_work, nau8825_adc_unmute_work);
+	snd_soc_dapm_disable_pin(dapm, "Tone");
+	nau8825_beep_init(nau8825);
+	nau_dapm_stat_init(&nau8825->dapm_stat, nau8825_dapm_stat_names,
+		ARRAY_SIZE(nau8825_dapm_stat_names));
+	nau8825_debugfs_init(component);
+	nau_pm_card_link(component);
 
 	return 0;
 }
@@ -2323,81 +4121,19 @@ static void nau8825_component_remove(struct snd_soc_component *component)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 
+	nau8825_beep_remove(nau8825);
+	nau8825_adc_unmute_cancel(nau8825);
 	/* Cancel and reset cross tak suppresstion detection funciton */
 	nau8825_xtalk_cancel(nau8825);
-}
-
-/**
- * nau8825_calc_fll_param - Calculate FLL parameters.
- * @fll_in: external clock provided to codec.
- * @fs: sampling rate.
- * @fll_param: Pointer to structure of FLL parameters.
- *
- * Calculate FLL parameters to configure codec.
- *
- * Returns 0 for success or negative error code.
- */
-static int nau8825_calc_fll_param(unsigned int fll_in, unsigned int fs,
-		struct nau8825_fll *fll_param)
-{
-	u64 fvco, fvco_max;
-	unsigned int fref, i, fvco_sel;
-
-	/* Ensure the reference clock frequency (FREF) is <= 13.5MHz by dividing
-	 * freq_in by 1, 2, 4, or 8 using FLL pre-scalar.
-	 * FREF = freq_in / NAU8825_FLL_REF_DIV_MASK
-	 */
-	for (i = 0; i < ARRAY_SIZE(fll_pre_scalar); i++) {
-		fref = fll_in / fll_pre_scalar[i].param;
-		if (fref <= NAU_FREF_MAX)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_pre_scalar))
-		return -EINVAL;
-	fll_param->clk_ref_div = fll_pre_scalar[i].val;
-
-	/* Choose the FLL ratio based on FREF */
-	for (i = 0; i < ARRAY_SIZE(fll_ratio); i++) {
-		if (fref >= fll_ratio[i].param)
-			break;
-	}
-	if (i == ARRAY_SIZE(fll_ratio))
-		return -EINVAL;
-	fll_param->ratio = fll_ratio[i].val;
-
-	/* Calculate the frequency of DCO (FDCO) given freq_out = 256 * Fs.
-	 * FDCO must be within the 90MHz - 124MHz or the FFL cannot be
-	 * guaranteed across the full range of operation.
-	 * FDCO = freq_out * 2 * mclk_src_scaling
-	 */
-	fvco_max = 0;
-	fvco_sel = ARRAY_SIZE(mclk_src_scaling);
-	for (i = 0; i < ARRAY_SIZE(mclk_src_scaling); i++) {
-		fvco = 256ULL * fs * 2 * mclk_src_scaling[i].param;
-		if (fvco > NAU_FVCO_MIN && fvco < NAU_FVCO_MAX &&
-			fvco_max < fvco) {
-			fvco_max = fvco;
-			fvco_sel = i;
-		}
-	}
-	if (ARRAY_SIZE(mclk_src_scaling) == fvco_sel)
-		return -EINVAL;
-	fll_param->mclk_src = mclk_src_scaling[fvco_sel].val;
-
-	/* Calculate the FLL 10-bit integer input and the FLL 16-bit fractional
-	 * input based on FDCO, FREF and FLL ratio.
-	 */
-	fvco = div_u64(fvco_max << fll_param->fll_frac_num, fref * fll_param->ratio);
-	fll_param->fll_int = (fvco >> fll_param->fll_frac_num) & 0x3FF;
-	if (fll_param->fll_frac_num == 16)
-		fll_param->fll_frac = fvco & 0xFFFF;
-	else
-		fll_param->fll_frac = fvco & 0xFFFFFF;
-	return 0;
+	nau_jack_report_cancel(&nau8825->jack_rpt);
+	nau8825_duty_stop(nau8825);
+	cancel_delayed_work_sync(&nau8825->jack_db_work);
+	nau8825_fll_keep_stop(nau8825);
+	nau_pm_card_unlink(component);
 }
 
 static void nau8825_fll_apply(struct nau8825 *nau8825,
-		struct nau8825_fll *fll_param)
+		struct nau_fll *fll_param)
 {
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
 		NAU8825_CLK_SRC_MASK | NAU8825_CLK_MCLK_SRC_MASK,
@@ -2407,7 +4143,7 @@ static void nau8825_fll_apply(struct nau8825 *nau8825,
 		NAU8825_FLL_RATIO_MASK | NAU8825_ICTRL_LATCH_MASK,
 		fll_param->ratio | (0x6 << NAU8825_ICTRL_LATCH_SFT));
 	/* FLL 16/24 bit fractional input */
-	if (fll_param->fll_frac_num == 16)
+	if (nau8825->sw_id == NAU8825_SOFTWARE_ID_NAU8825)
 		regmap_write(nau8825->regmap, NAU8825_REG_FLL2,
 			     fll_param->fll_frac);
 	else {
@@ -2454,16 +4190,22 @@ static int nau8825_set_pll(struct snd_soc_component *component, int pll_id, int
 		unsigned int freq_in, unsigned int freq_out)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
-	struct nau8825_fll fll_param;
-	int ret, fs;
+	struct nau_fll fll_param;
+	int ret, fs, frac_bits;
 
 	if (nau8825->sw_id == NAU8825_SOFTWARE_ID_NAU8825)
-		fll_param.fll_frac_num = 16;
+		frac_bits = 16;
 	else
-		fll_param.fll_frac_num = 24;
+		frac_bits = 24;
 
 	fs = freq_out / 256;
-	ret = nau8825_calc_fll_param(freq_in, fs, &fll_param);
+	nau8825_fll_keep_stop(nau8825);
+	if (nau8825_fll_keep_take(nau8825, nau8825->sysclk_id, freq_in, fs)) {
+		nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
+		return 0;
+	}
+	ret = nau_fll_solve(&nau8825_fll_desc, &nau8825->fll_cache, freq_in, fs,
+			    frac_bits, &fll_param);
 	if (ret < 0) {
 		dev_err(component->dev, "Unsupported input clock %d\n", freq_in);
 		return ret;
@@ -2472,22 +4214,31 @@ static int nau8825_set_pll(struct snd_soc_component *component, int pll_id, int
 		fll_param.mclk_src, fll_param.ratio, fll_param.fll_frac,
 		fll_param.fll_int, fll_param.clk_ref_div);
 
+	ret = nau8825_pm_get(nau8825);
+	if (ret < 0)
+		return ret;
+	/* The FLL takes over the clock source of the system clock */
+	nau8825_fll_keep_done(nau8825, nau8825->sysclk_id, freq_in, fs);
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
+	nau8825->clk_plan.enable = false;
+	nau_clk_plan_reset(&nau8825->clk_plan);
 	nau8825_fll_apply(nau8825, &fll_param);
-	mdelay(2);
+	nau_fll_wait_lock();
 	regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
 			NAU8825_CLK_SRC_MASK, NAU8825_CLK_SRC_VCO);
+	nau8825_pm_put(nau8825);
 	return 0;
 }
 
+/* The MCLK got at probe, NULL if managed externally, is enabled as long
+ * as the sysclk takes it. Its rate is set only when it changes.
+ */
 static int nau8825_mclk_prepare(struct nau8825 *nau8825, unsigned int freq)
 {
 	int ret;
 
-	nau8825->mclk = devm_clk_get(nau8825->dev, "mclk");
-	if (IS_ERR(nau8825->mclk)) {
-		dev_info(nau8825->dev, "No 'mclk' clock found, assume MCLK is managed externally");
+	if (!nau8825->mclk)
 		return 0;
-	}
 
 	if (!nau8825->mclk_freq) {
 		ret = clk_prepare_enable(nau8825->mclk);
@@ -2497,19 +4248,30 @@ static int nau8825_mclk_prepare(struct nau8825 *nau8825, unsigned int freq)
 		}
 	}
 
-	if (nau8825->mclk_freq != freq) {
-		freq = clk_round_rate(nau8825->mclk, freq);
-		ret = clk_set_rate(nau8825->mclk, freq);
+	if (nau8825->mclk_rate != freq) {
+		ret = clk_set_rate(nau8825->mclk,
+			clk_round_rate(nau8825->mclk, freq));
 		if (ret) {
 			dev_err(nau8825->dev, "Unable to set mclk rate\n");
+			if (!nau8825->mclk_freq)
+				clk_disable_unprepare(nau8825->mclk);
 			return ret;
 		}
-		nau8825->mclk_freq = freq;
+		nau8825->mclk_rate = freq;
 	}
+	nau8825->mclk_freq = freq;
 
 	return 0;
 }
 
+static void nau8825_mclk_release(struct nau8825 *nau8825)
+{
+	if (nau8825->mclk_freq) {
+		clk_disable_unprepare(nau8825->mclk);
+		nau8825->mclk_freq = 0;
+	}
+}
+
 static void nau8825_configure_mclk_as_sysclk(struct regmap *regmap)
 {
 	regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
@@ -2525,31 +4287,61 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 	unsigned int freq)
 {
 	struct regmap *regmap = nau8825->regmap;
+	bool owned;
 	int ret;
 
+	/* The internal clock turns off without headset, same as disabled,
+	 * unless the debounce filter of the insertion runs on it.
+	 */
+	if ((clk_id == NAU8825_CLK_INTERNAL || clk_id == NAU8825_CLK_DIS) &&
+		!nau8825_jack_present(nau8825)) {
+		if (nau8825->jack_db_applied == NAU8825_JACK_DB_FILTER) {
+			clk_id = NAU8825_CLK_INTERNAL;
+		} else if (clk_id == NAU8825_CLK_INTERNAL) {
+			clk_id = NAU8825_CLK_DIS;
+			dev_dbg(nau8825->dev, "Disable clock for power saving when no headset connected\n");
+		}
+	}
+	/* The jack and the DAPM paths ask for the same clock again and
+	 * again; skip the registers and the cross talk protection then.
+	 */
+	if (clk_id == nau8825->sysclk_id && freq == nau8825->sysclk_freq)
+		return 0;
+	nau_clk_plan_reset(&nau8825->clk_plan);
+	/* The FLL kept is taken again only from the same reference; the
+	 * other clocks leave the FLL.
+	 */
+	switch (clk_id) {
+	case NAU8825_CLK_FLL_MCLK:
+	case NAU8825_CLK_FLL_BLK:
+	case NAU8825_CLK_FLL_FS:
+		if (clk_id == nau8825->fll_src)
+			break;
+		fallthrough;
+	default:
+		nau8825->fll_locked = false;
+	}
+
 	switch (clk_id) {
 	case NAU8825_CLK_DIS:
 		/* Clock provided externally and disable internal VCO clock */
 		nau8825_configure_mclk_as_sysclk(regmap);
-		if (nau8825->mclk_freq) {
-			clk_disable_unprepare(nau8825->mclk);
-			nau8825->mclk_freq = 0;
-		}
+		nau8825_mclk_release(nau8825);
 
 		break;
 	case NAU8825_CLK_MCLK:
-		/* Acquire the semaphore to synchronize the playback and
+		/* Acquire the protection to synchronize the playback and
 		 * interrupt handler. In order to avoid the playback inter-
 		 * fered by cross talk process, the driver make the playback
 		 * preparation halted until cross talk process finish.
 		 */
-		nau8825_sema_acquire(nau8825, 3 * HZ);
+		owned = nau8825_audio_acquire(nau8825, 3 * HZ);
 		nau8825_configure_mclk_as_sysclk(regmap);
 		/* MCLK not changed by clock tree */
 		regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
 			NAU8825_CLK_MCLK_SRC_MASK, 0);
-		/* Release the semaphore. */
-		nau8825_sema_release(nau8825);
+		/* Release the protection. */
+		nau8825_audio_release(nau8825, owned);
 
 		ret = nau8825_mclk_prepare(nau8825, freq);
 		if (ret)
@@ -2557,41 +4349,30 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 
 		break;
 	case NAU8825_CLK_INTERNAL:
-		if (nau8825_is_jack_inserted(nau8825->regmap)) {
-			regmap_update_bits(regmap, NAU8825_REG_FLL6,
-				NAU8825_DCO_EN, NAU8825_DCO_EN);
-			regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
-				NAU8825_CLK_SRC_MASK, NAU8825_CLK_SRC_VCO);
-			/* Decrease the VCO frequency and make DSP operate
-			 * as default setting for power saving.
-			 */
-			regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
-				NAU8825_CLK_MCLK_SRC_MASK, 0xf);
-			regmap_update_bits(regmap, NAU8825_REG_FLL1,
-				NAU8825_ICTRL_LATCH_MASK |
-				NAU8825_FLL_RATIO_MASK, 0x10);
-			regmap_update_bits(regmap, NAU8825_REG_FLL6,
-				NAU8825_SDM_EN, NAU8825_SDM_EN);
-		} else {
-			/* The clock turns off intentionally for power saving
-			 * when no headset connected.
-			 */
-			nau8825_configure_mclk_as_sysclk(regmap);
-			dev_warn(nau8825->dev, "Disable clock for power saving when no headset connected\n");
-		}
-		if (nau8825->mclk_freq) {
-			clk_disable_unprepare(nau8825->mclk);
-			nau8825->mclk_freq = 0;
-		}
+		regmap_update_bits(regmap, NAU8825_REG_FLL6,
+			NAU8825_DCO_EN, NAU8825_DCO_EN);
+		regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
+			NAU8825_CLK_SRC_MASK, NAU8825_CLK_SRC_VCO);
+		/* Decrease the VCO frequency and make DSP operate
+		 * as default setting for power saving.
+		 */
+		regmap_update_bits(regmap, NAU8825_REG_CLK_DIVIDER,
+			NAU8825_CLK_MCLK_SRC_MASK, 0xf);
+		regmap_update_bits(regmap, NAU8825_REG_FLL1,
+			NAU8825_ICTRL_LATCH_MASK |
+			NAU8825_FLL_RATIO_MASK, 0x10);
+		regmap_update_bits(regmap, NAU8825_REG_FLL6,
+			NAU8825_SDM_EN, NAU8825_SDM_EN);
+		nau8825_mclk_release(nau8825);
 
 		break;
 	case NAU8825_CLK_FLL_MCLK:
-		/* Acquire the semaphore to synchronize the playback and
+		/* Acquire the protection to synchronize the playback and
 		 * interrupt handler. In order to avoid the playback inter-
 		 * fered by cross talk process, the driver make the playback
 		 * preparation halted until cross talk process finish.
 		 */
-		nau8825_sema_acquire(nau8825, 3 * HZ);
+		owned = nau8825_audio_acquire(nau8825, 3 * HZ);
 		/* Higher FLL reference input frequency can only set lower
 		 * gain error, such as 0000 for input reference from MCLK
 		 * 12.288Mhz.
@@ -2599,8 +4380,8 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 		regmap_update_bits(regmap, NAU8825_REG_FLL3,
 			NAU8825_FLL_CLK_SRC_MASK | NAU8825_GAIN_ERR_MASK,
 			NAU8825_FLL_CLK_SRC_MCLK | 0);
-		/* Release the semaphore. */
-		nau8825_sema_release(nau8825);
+		/* Release the protection. */
+		nau8825_audio_release(nau8825, owned);
 
 		ret = nau8825_mclk_prepare(nau8825, freq);
 		if (ret)
@@ -2608,12 +4389,12 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 
 		break;
 	case NAU8825_CLK_FLL_BLK:
-		/* Acquire the semaphore to synchronize the playback and
+		/* Acquire the protection to synchronize the playback and
 		 * interrupt handler. In order to avoid the playback inter-
 		 * fered by cross talk process, the driver make the playback
 		 * preparation halted until cross talk process finish.
 		 */
-		nau8825_sema_acquire(nau8825, 3 * HZ);
+		owned = nau8825_audio_acquire(nau8825, 3 * HZ);
 		/* If FLL reference input is from low frequency source,
 		 * higher error gain can apply such as 0xf which has
 		 * the most sensitive gain error correction threshold,
@@ -2624,22 +4405,19 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 			NAU8825_FLL_CLK_SRC_MASK | NAU8825_GAIN_ERR_MASK,
 			NAU8825_FLL_CLK_SRC_BLK |
 			(0xf << NAU8825_GAIN_ERR_SFT));
-		/* Release the semaphore. */
-		nau8825_sema_release(nau8825);
+		/* Release the protection. */
+		nau8825_audio_release(nau8825, owned);
 
-		if (nau8825->mclk_freq) {
-			clk_disable_unprepare(nau8825->mclk);
-			nau8825->mclk_freq = 0;
-		}
+		nau8825_mclk_release(nau8825);
 
 		break;
 	case NAU8825_CLK_FLL_FS:
-		/* Acquire the semaphore to synchronize the playback and
+		/* Acquire the protection to synchronize the playback and
 		 * interrupt handler. In order to avoid the playback inter-
 		 * fered by cross talk process, the driver make the playback
 		 * preparation halted until cross talk process finish.
 		 */
-		nau8825_sema_acquire(nau8825, 3 * HZ);
+		owned = nau8825_audio_acquire(nau8825, 3 * HZ);
 		/* If FLL reference input is from low frequency source,
 		 * higher error gain can apply such as 0xf which has
 		 * the most sensitive gain error correction threshold,
@@ -2650,13 +4428,10 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 			NAU8825_FLL_CLK_SRC_MASK | NAU8825_GAIN_ERR_MASK,
 			NAU8825_FLL_CLK_SRC_FS |
 			(0xf << NAU8825_GAIN_ERR_SFT));
-		/* Release the semaphore. */
-		nau8825_sema_release(nau8825);
+		/* Release the protection. */
+		nau8825_audio_release(nau8825, owned);
 
-		if (nau8825->mclk_freq) {
-			clk_disable_unprepare(nau8825->mclk);
-			nau8825->mclk_freq = 0;
-		}
+		nau8825_mclk_release(nau8825);
 
 		break;
 	default:
@@ -2664,6 +4439,9 @@ static int nau8825_configure_sysclk(struct nau8825 *nau8825, int clk_id,
 		return -EINVAL;
 	}
 
+	nau8825->sysclk_id = clk_id;
+	nau8825->sysclk_freq = freq;
+
 	dev_dbg(nau8825->dev, "Sysclk is %dHz and clock id is %d\n", freq,
 		clk_id);
 	return 0;
@@ -2673,8 +4451,109 @@ static int nau8825_set_sysclk(struct snd_soc_component *component, int clk_id,
 	int source, unsigned int freq, int dir)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
+	int ret;
+
+	nau8825->clk_plan.enable = clk_id == NAU8825_CLK_AUTO;
+	if (nau8825->clk_plan.enable) {
+		nau8825->clk_plan.mclk = freq;
+		nau_clk_plan_reset(&nau8825->clk_plan);
+		return 0;
+	}
+
+	/* The machine drivers set the clock at card probe too */
+	nau8825_fll_keep_stop(nau8825);
+	ret = nau8825_pm_get(nau8825);
+	if (ret < 0)
+		return ret;
+	ret = nau8825_configure_sysclk(nau8825, clk_id, freq);
+	nau8825_pm_put(nau8825);
+
+	return ret;
+}
+
+/**
+ * nau8825_clk_plan_run - plan the sysclk of a stream at hw_params
+ * @nau8825: component to register the codec private data with
+ * @params: parameters of the stream
+ * @dai: the DAI of the stream
+ *
+ * The planner picks MCLK straight, the FLL from MCLK or the FLL from BCLK,
+ * the first that makes 256 * Fs. The sysclk is shared by the directions,
+ * so a plan of another rate is refused while the other one streams.
+ *
+ * Returns 0 for success or negative error code.
+ */
+static int nau8825_clk_plan_run(struct nau8825 *nau8825,
+		struct snd_pcm_hw_params *params, struct snd_soc_dai *dai)
+{
+	struct nau_clk_planner *planner = &nau8825->clk_plan;
+	unsigned int ctrl_val, bclk = 0;
+	struct nau_clk_plan plan;
+	int ret, frac_bits;
+
+	if (nau8825->sw_id == NAU8825_SOFTWARE_ID_NAU8825)
+		frac_bits = 16;
+	else
+		frac_bits = 24;
+	regmap_read(nau8825->regmap, NAU8825_REG_I2S_PCM_CTRL2, &ctrl_val);
+	if (!(ctrl_val & NAU8825_I2S_MS_MASTER))
+		bclk = snd_soc_params_to_bclk(params);
+	ret = nau_clk_plan_pick(&nau8825_fll_desc, &nau8825->fll_cache,
+		frac_bits, planner->mclk, bclk, params_rate(params), &plan);
+	if (ret) {
+		dev_err(nau8825->dev, "No sysclk for %dHz from MCLK %uHz\n",
+			params_rate(params), planner->mclk);
+		return ret;
+	}
+	nau8825_fll_keep_stop(nau8825);
+	if (nau_clk_plan_applied(planner, &plan)) {
+		if (plan.src != NAU_CLK_PLAN_MCLK)
+			nau8825_fll_keep_take(nau8825, nau8825->fll_src,
+				plan.freq_in, plan.fs);
+		return 0;
+	}
+	if (planner->applied.src != NAU_CLK_PLAN_NONE &&
+		snd_soc_dai_active(dai) > 1) {
+		dev_err(nau8825->dev, "Sysclk held by the other stream\n");
+		return -EBUSY;
+	}
+
+	ret = nau8825_pm_get(nau8825);
+	if (ret < 0)
+		return ret;
+	switch (plan.src) {
+	case NAU_CLK_PLAN_MCLK:
+		ret = nau8825_configure_sysclk(nau8825, NAU8825_CLK_MCLK,
+			plan.freq_in);
+		if (ret)
+			goto out;
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
+			NAU8825_CLK_MCLK_SRC_MASK, plan.mclk_div);
+		break;
+	case NAU_CLK_PLAN_FLL_MCLK:
+	case NAU_CLK_PLAN_FLL_BLK:
+		ret = nau8825_configure_sysclk(nau8825,
+			plan.src == NAU_CLK_PLAN_FLL_MCLK ?
+			NAU8825_CLK_FLL_MCLK : NAU8825_CLK_FLL_BLK,
+			plan.src == NAU_CLK_PLAN_FLL_MCLK ? plan.freq_in : 0);
+		if (ret)
+			goto out;
+		nau8825_fll_keep_done(nau8825, nau8825->sysclk_id,
+			plan.freq_in, plan.fs);
+		nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
+		nau8825_fll_apply(nau8825, &plan.fll);
+		nau_fll_wait_lock();
+		regmap_update_bits(nau8825->regmap, NAU8825_REG_CLK_DIVIDER,
+			NAU8825_CLK_SRC_MASK, NAU8825_CLK_SRC_VCO);
+		break;
+	}
+	nau_clk_plan_done(planner, &plan);
+	dev_dbg(nau8825->dev, "Sysclk planned from source %u at %uHz\n",
+		plan.src, plan.freq_in);
+ out:
+	nau8825_pm_put(nau8825);
 
-	return nau8825_configure_sysclk(nau8825, clk_id, freq);
+	return ret;
 }
 
 static int nau8825_resume_setup(struct nau8825 *nau8825)
@@ -2682,6 +4561,7 @@ static int nau8825_resume_setup(struct nau8825 *nau8825)
 	struct regmap *regmap = nau8825->regmap;
 
 	/* Close clock when jack type detection at manual mode */
+	nau8825->jack_db_applied = NAU8825_JACK_DB_BYPASS;
 	nau8825_configure_sysclk(nau8825, NAU8825_CLK_DIS, 0);
 
 	/* Clear all interruption status */
@@ -2698,24 +4578,77 @@ static int nau8825_resume_setup(struct nau8825 *nau8825)
 		NAU8825_JACK_DET_DB_BYPASS, NAU8825_JACK_DET_DB_BYPASS);
 	regmap_update_bits(regmap, NAU8825_REG_INTERRUPT_DIS_CTRL,
 		NAU8825_IRQ_INSERT_DIS | NAU8825_IRQ_EJECT_DIS, 0);
+	nau8825_jack_db_resumed(nau8825);
 
 	return 0;
 }
 
+/* The jack wakes the system up out of suspend. Only its comparator is
+ * left on: the insertion at manual mode, which needs no clock, without
+ * a jack, or the ejection on the internal VCO, kept from the auto mode,
+ * with one. The jack type detected stays in place for the resume.
+ */
+static void nau8825_wake_arm(struct nau8825 *nau8825)
+{
+	struct regmap *regmap = nau8825->regmap;
+
+	regmap_read(regmap, NAU8825_REG_INTERRUPT_DIS_CTRL,
+		&nau8825->wake_dis_ctrl);
+	regmap_write(regmap, NAU8825_REG_INTERRUPT_DIS_CTRL, 0xffff &
+		~(nau8825->wake_inserted ? NAU8825_IRQ_EJECT_DIS :
+		NAU8825_IRQ_INSERT_DIS));
+	if (!nau8825->wake_inserted)
+		regmap_update_bits(regmap, NAU8825_REG_ENA_CTRL,
+			NAU8825_ENABLE_ADC, 0);
+}
+
+/* The jack is found as it was before suspend: enable the interruptions
+ * of then again, and the buttons of a headset, instead of a detection.
+ */
+static void nau8825_wake_restore(struct nau8825 *nau8825)
+{
+	struct snd_soc_dapm_context *dapm = nau8825->dapm;
+
+	nau8825->wake_carry = false;
+	regmap_write(nau8825->regmap, NAU8825_REG_INTERRUPT_DIS_CTRL,
+		nau8825->wake_dis_ctrl);
+	if (nau8825->wake_jack_status & SND_JACK_MICROPHONE) {
+		snd_soc_dapm_force_enable_pin(dapm, "MICBIAS");
+		snd_soc_dapm_force_enable_pin(dapm, "SAR");
+		snd_soc_dapm_sync(dapm);
+	}
+	nau8825_adc_detect_off(nau8825);
+	nau8825_jack_db_resumed(nau8825);
+	dev_dbg(nau8825->dev, "jack kept over suspend\n");
+}
+
 static int nau8825_set_bias_level(struct snd_soc_component *component,
 				   enum snd_soc_bias_level level)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 	int ret;
 
+	/* the widgets of the component driver come after its probe */
+	nau_dapm_stat_attach(&nau8825->dapm_stat, component);
+	nau_dapm_stat_bias(&nau8825->dapm_stat, level);
+
 	switch (level) {
 	case SND_SOC_BIAS_ON:
 		break;
 
 	case SND_SOC_BIAS_PREPARE:
+		nau8825_pm_hold(nau8825, true);
 		break;
 
 	case SND_SOC_BIAS_STANDBY:
+		nau8825_pm_hold(nau8825, false);
+		/* the streams are gone, measure the cross talk preempted */
+		if (snd_soc_component_get_bias_level(component) ==
+			SND_SOC_BIAS_PREPARE && nau8825_xtalk_on(nau8825))
+			nau8825_xtalk_rerun(nau8825);
+		if (snd_soc_component_get_bias_level(component) ==
+			SND_SOC_BIAS_PREPARE)
+			nau8825_duty_start(nau8825);
 		if (snd_soc_component_get_bias_level(component) == SND_SOC_BIAS_OFF) {
 			if (nau8825->mclk_freq) {
 				ret = clk_prepare_enable(nau8825->mclk);
@@ -2725,11 +4658,31 @@ static int nau8825_set_bias_level(struct snd_soc_component *component,
 				}
 			}
 			/* Setup codec configuration after resume */
-			nau8825_resume_setup(nau8825);
+			ret = nau8825_pm_get(nau8825);
+			if (ret < 0)
+				return ret;
+			if (nau8825->wake_carry)
+				nau8825_wake_restore(nau8825);
+			else
+				nau8825_resume_setup(nau8825);
+			nau8825_pm_put(nau8825);
 		}
 		break;
 
 	case SND_SOC_BIAS_OFF:
+		nau8825_pm_hold(nau8825, false);
+		/* Cancel and reset cross talk detection funciton */
+		nau8825_xtalk_cancel(nau8825);
+		/* No clock for the jack detection left in suspend */
+		cancel_delayed_work_sync(&nau8825->jack_db_work);
+		if (!nau8825_jack_present(nau8825))
+			nau8825_jack_db_apply(nau8825, NAU8825_JACK_DB_BYPASS);
+		if (nau8825->wake_armed) {
+			nau8825_wake_arm(nau8825);
+			if (nau8825->mclk_freq)
+				clk_disable_unprepare(nau8825->mclk);
+			break;
+		}
 		/* Reset the configuration of jack type for detection */
 		/* Detach 2kOhm Resistors from MICBIAS to MICGND1/2 */
 		regmap_update_bits(nau8825->regmap, NAU8825_REG_MIC_BIAS,
@@ -2737,8 +4690,6 @@ static int nau8825_set_bias_level(struct snd_soc_component *component,
 		/* ground HPL/HPR, MICGRND1/2 */
 		regmap_update_bits(nau8825->regmap,
 			NAU8825_REG_HSD_CTRL, 0xf, 0xf);
-		/* Cancel and reset cross talk detection funciton */
-		nau8825_xtalk_cancel(nau8825);
 		/* Turn off all interruptions before system shutdown. Keep the
 		 * interruption quiet before resume setup completes.
 		 */
@@ -2758,14 +4709,36 @@ static int __maybe_unused nau8825_suspend(struct snd_soc_component *component)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
 
-	disable_irq(nau8825->irq);
+	nau_hw_params_reset(&nau8825->hw_params_cache);
+	nau8825_irq_disable(nau8825);
+	nau_jack_report_flush(&nau8825->jack_rpt);
+	nau8825_duty_stop(nau8825);
+	/* The interruption line disabled still wakes up once armed */
+	if (nau8825->jack_wakeup && device_may_wakeup(nau8825->dev) &&
+		!enable_irq_wake(nau8825->irq)) {
+		nau8825->wake_armed = true;
+		nau8825->wake_inserted = nau8825_jack_present(nau8825);
+		nau8825->wake_jack_status = nau8825->wake_inserted &&
+			nau8825->jack ? nau8825->jack->status : 0;
+	}
+	/* held warm again by the jack detection of the resume */
+	nau8825_warm_apply(nau8825, false);
+	/* the FLL kept goes now, not after the clock is lost */
+	nau8825_fll_keep_stop(nau8825);
+	if (nau8825->fll_locked && nau8825->fll_idle)
+		nau8825_sysclk_idle(nau8825);
 	snd_soc_component_force_bias_level(component, SND_SOC_BIAS_OFF);
 	/* Power down codec power; don't suppoet button wakeup */
 	snd_soc_dapm_disable_pin(nau8825->dapm, "SAR");
 	snd_soc_dapm_disable_pin(nau8825->dapm, "MICBIAS");
 	snd_soc_dapm_sync(nau8825->dapm);
+	nau8825_adc_unmute_cancel(nau8825);
 	regcache_cache_only(nau8825->regmap, true);
 	regcache_mark_dirty(nau8825->regmap);
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
+	nau8825->fll_locked = false;
+	/* the coefficients are out of the cache and lost with the power */
+	nau8825->biq_shadow.valid = false;
 
 	return 0;
 }
@@ -2773,19 +4746,67 @@ static int __maybe_unused nau8825_suspend(struct snd_soc_component *component)
 static int __maybe_unused nau8825_resume(struct snd_soc_component *component)
 {
 	struct nau8825 *nau8825 = snd_soc_component_get_drvdata(component);
-	int ret;
 
+	nau_regcache_scan(nau8825->regmap, &nau8825_regmap_config,
+		&nau8825->resume_sync);
 	regcache_cache_only(nau8825->regmap, false);
-	regcache_sync(nau8825->regmap);
-	nau8825->xtalk_protect = true;
-	ret = nau8825_sema_acquire(nau8825, 0);
-	if (ret)
-		nau8825->xtalk_protect = false;
-	enable_irq(nau8825->irq);
+	/* Only the registers changed since probe are written back; the
+	 * patch of Rev C lives out of the cache and goes first.
+	 */
+	if (nau8825->sw_id == NAU8825_SOFTWARE_ID_NAU8825C)
+		regmap_multi_reg_write_bypassed(nau8825->regmap,
+			nau8825_regmap_patch, ARRAY_SIZE(nau8825_regmap_patch));
+	nau_regcache_sync(nau8825->regmap, &nau8825_regmap_config,
+		&nau8825->resume_sync);
+	/* The jack may have moved while suspended */
+	nau8825_jack_sample(nau8825);
+	if (nau8825->wake_armed) {
+		unsigned int active_irq = 0;
+
+		disable_irq_wake(nau8825->irq);
+		nau8825->wake_armed = false;
+		/* Carry the detection over if the jack didn't move */
+		regmap_read(nau8825->regmap, NAU8825_REG_IRQ_STATUS,
+			&active_irq);
+		nau8825->wake_carry = nau8825->wake_inserted ==
+			nau8825_jack_present(nau8825) &&
+			!(active_irq & (NAU8825_JACK_EJECTION_IRQ_MASK |
+			NAU8825_JACK_INSERTION_IRQ_MASK));
+	}
+	/* Hold the playback until the jack detection restarted after
+	 * resume finishes. Without a headset there is no detection to
+	 * wait for, and the insertion raises its own protection.
+	 */
+	if (nau8825_xtalk_on(nau8825) && !nau8825->wake_carry &&
+		nau8825_jack_present(nau8825))
+		nau8825_xtalk_own(nau8825, NAU8825_XTALK_OWNER_NONE,
+			NAU8825_XTALK_OWNER_RESUME);
+	nau8825_irq_enable(nau8825);
+
+	return 0;
+}
+
+static int __maybe_unused nau8825_runtime_suspend(struct device *dev)
+{
+	struct nau8825 *nau8825 = dev_get_drvdata(dev);
+
+	/* The codec keeps its power and the jack detection; only the bus
+	 * is left idle until a stream, a DAPM path or an interruption.
+	 */
+	regcache_cache_only(nau8825->regmap, true);
 
 	return 0;
 }
 
+static int __maybe_unused nau8825_runtime_resume(struct device *dev)
+{
+	struct nau8825 *nau8825 = dev_get_drvdata(dev);
+
+	regcache_cache_only(nau8825->regmap, false);
+	/* Writes only the registers changed while suspended, if any */
+	return regcache_sync(nau8825->regmap);
+}
+
 static int nau8825_set_jack(struct snd_soc_component *component,
 			    struct snd_soc_jack *jack, void *data)
 {
@@ -2828,6 +4849,8 @@ static void nau8825_print_device_properties(struct nau8825 *nau8825)
 	dev_dbg(dev, "jkdet-enable:         %d\n", nau8825->jkdet_enable);
 	dev_dbg(dev, "jkdet-pull-enable:    %d\n", nau8825->jkdet_pull_enable);
 	dev_dbg(dev, "jkdet-pull-up:        %d\n", nau8825->jkdet_pull_up);
+	dev_dbg(dev, "jack-wakeup:          %d\n", nau8825->jack_wakeup);
+	dev_dbg(dev, "sar-only-detection:   %d\n", nau8825->sar_only);
 	dev_dbg(dev, "jkdet-polarity:       %d\n", nau8825->jkdet_polarity);
 	dev_dbg(dev, "micbias-voltage:      %d\n", nau8825->micbias_voltage);
 	dev_dbg(dev, "vref-impedance:       %d\n", nau8825->vref_impedance);
@@ -2842,42 +4865,180 @@ static void nau8825_print_device_properties(struct nau8825 *nau8825)
 	dev_dbg(dev, "sar-compare-time:     %d\n", nau8825->sar_compare_time);
 	dev_dbg(dev, "sar-sampling-time:    %d\n", nau8825->sar_sampling_time);
 	dev_dbg(dev, "short-key-debounce:   %d\n", nau8825->key_debounce);
+	dev_dbg(dev, "sar-fast-compare-time:  %d\n",
+		nau8825->sar_profile[NAU8825_SAR_FAST].compare_time);
+	dev_dbg(dev, "sar-fast-sampling-time: %d\n",
+		nau8825->sar_profile[NAU8825_SAR_FAST].sampling_time);
+	dev_dbg(dev, "short-key-fast-debounce: %d\n",
+		nau8825->sar_profile[NAU8825_SAR_FAST].key_debounce);
+	dev_dbg(dev, "key-repeat-ms:        %d\n", nau8825->key_repeat);
+	dev_dbg(dev, "button-duty-ms:       %d\n", nau8825->duty.period_ms);
+	dev_dbg(dev, "hp-high-imped-rms:    %d\n",
+			nau8825->hp_high_imped_rms);
 	dev_dbg(dev, "jack-insert-debounce: %d\n",
 			nau8825->jack_insert_debounce);
 	dev_dbg(dev, "jack-eject-debounce:  %d\n",
 			nau8825->jack_eject_debounce);
+	dev_dbg(dev, "jack-debounce-profile: %d\n",
+			nau8825->jack_db_profile);
 	dev_dbg(dev, "crosstalk-enable:     %d\n",
 			nau8825->xtalk_enable);
 	dev_dbg(dev, "adcout-drive-strong:  %d\n", nau8825->adcout_ds);
 	dev_dbg(dev, "adc-delay-ms:         %d\n", nau8825->adc_delay);
+	dev_dbg(dev, "crosstalk-prepare-ms: %d\n",
+			nau8825->xtalk_prepare_delay);
+	dev_dbg(dev, "crosstalk-imm-ms:     %d\n", nau8825->xtalk_imm_delay);
+	dev_dbg(dev, "crosstalk-done-ms:    %d\n", nau8825->xtalk_done_delay);
+	dev_dbg(dev, "crosstalk-early-report: %d\n",
+			nau8825->xtalk_early_report);
+	dev_dbg(dev, "headphone-early-report: %d\n",
+			nau8825->hp_early_report);
+	dev_dbg(dev, "warm-capture:         %d\n", nau8825->warm_capture);
+	if (nau8825->xtalk_calib)
+		dev_dbg(dev, "crosstalk-gain:       %x\n",
+			nau8825->xtalk_calib_gain);
+	for (i = 0; i < nau8825->xtalk_calib_bins; i++)
+		dev_dbg(dev, "crosstalk-gain-table[%d]: sar %x gain %x\n", i,
+			nau8825->xtalk_calib_bin[i].sar,
+			nau8825->xtalk_calib_bin[i].dgain);
+	dev_dbg(dev, "fast-hp-start:        %d\n", nau8825->fast_hp_start);
+	dev_dbg(dev, "autosuspend-delay-ms: %d\n",
+			nau8825->autosuspend_delay);
+	dev_dbg(dev, "fll-keepalive-ms:     %d\n", nau8825->fll_keep_ms);
+	dev_dbg(dev, "jack-poll-ms:         %d\n",
+			nau8825->irq_poll.period_ms);
+}
+
+static const struct nau_prop_u32 nau8825_props[] = {
+	NAU_PROP_U32(struct nau8825, jkdet_polarity,
+		"nuvoton,jkdet-polarity", 1),
+	NAU_PROP_U32(struct nau8825, jack_rpt.window_ms,
+		"nuvoton,jack-report-window-ms", NAU_JACK_REPORT_MS),
+	NAU_PROP_U32(struct nau8825, micbias_voltage,
+		"nuvoton,micbias-voltage", 6),
+	NAU_PROP_U32(struct nau8825, vref_impedance,
+		"nuvoton,vref-impedance", 2),
+	NAU_PROP_U32(struct nau8825, sar_threshold_num,
+		"nuvoton,sar-threshold-num", 4),
+	NAU_PROP_U32(struct nau8825, sar_hysteresis,
+		"nuvoton,sar-hysteresis", 0),
+	NAU_PROP_U32(struct nau8825, sar_voltage,
+		"nuvoton,sar-voltage", 6),
+	NAU_PROP_U32(struct nau8825, sar_compare_time,
+		"nuvoton,sar-compare-time", 1),
+	NAU_PROP_U32(struct nau8825, sar_sampling_time,
+		"nuvoton,sar-sampling-time", 1),
+	NAU_PROP_U32(struct nau8825, key_debounce,
+		"nuvoton,short-key-debounce", 3),
+	NAU_PROP_U32(struct nau8825, sar_profile[NAU8825_SAR_FAST].compare_time,
+		"nuvoton,sar-fast-compare-time", 0),
+	NAU_PROP_U32(struct nau8825, sar_profile[NAU8825_SAR_FAST].sampling_time,
+		"nuvoton,sar-fast-sampling-time", 0),
+	NAU_PROP_U32(struct nau8825, sar_profile[NAU8825_SAR_FAST].key_debounce,
+		"nuvoton,short-key-fast-debounce", 0),
+	NAU_PROP_U32(struct nau8825, key_repeat,
+		"nuvoton,key-repeat-ms", 0),
+	NAU_PROP_U32(struct nau8825, duty.period_ms,
+		"nuvoton,button-duty-ms", 0),
+	NAU_PROP_U32(struct nau8825, jack_insert_debounce,
+		"nuvoton,jack-insert-debounce", 7),
+	NAU_PROP_U32(struct nau8825, jack_eject_debounce,
+		"nuvoton,jack-eject-debounce", 0),
+	NAU_PROP_U32(struct nau8825, xtalk_prepare_delay,
+		"nuvoton,crosstalk-prepare-ms", 280),
+	NAU_PROP_U32(struct nau8825, xtalk_imm_delay,
+		"nuvoton,crosstalk-imm-ms", 100),
+	NAU_PROP_U32(struct nau8825, xtalk_done_delay,
+		"nuvoton,crosstalk-done-ms", 150),
+	NAU_PROP_U32(struct nau8825, adc_delay,
+		"nuvoton,adc-delay-ms", 125),
+	NAU_PROP_U32(struct nau8825, autosuspend_delay,
+		"nuvoton,autosuspend-delay-ms", 3000),
+	NAU_PROP_U32(struct nau8825, fll_keep_ms,
+		"nuvoton,fll-keepalive-ms", 0),
+	NAU_PROP_U32(struct nau8825, irq_poll.period_ms,
+		"nuvoton,jack-poll-ms", 0),
+	NAU_PROP_U32(struct nau8825, hp_high_imped_rms,
+		"nuvoton,hp-high-imped-rms", 0),
+	NAU_PROP_U32(struct nau8825, jack_db_profile,
+		"nuvoton,jack-debounce-profile", NAU8825_JACK_DB_BYPASS),
+};
+
+/* The factory calibration of the cross talk, a DAC_DGAIN_CTRL value for
+ * all the headsets and pairs of the SAR reading upper bound and the gain.
+ */
+static void nau8825_read_xtalk_calib(struct device *dev,
+	struct nau8825 *nau8825)
+{
+	u32 table[NAU8825_XTALK_CALIB_NUM * 2];
+	int i, num;
+
+	if (!device_property_read_u32(dev, "nuvoton,crosstalk-gain",
+		&nau8825->xtalk_calib_gain)) {
+		if (nau8825->xtalk_calib_gain > 0xffff)
+			dev_warn(dev, "Invalid crosstalk-gain %x\n",
+				nau8825->xtalk_calib_gain);
+		else
+			nau8825->xtalk_calib = true;
+	}
+
+	num = device_property_count_u32(dev, "nuvoton,crosstalk-gain-table");
+	if (num <= 0)
+		return;
+	if (num % 2 || num > ARRAY_SIZE(table) ||
+		device_property_read_u32_array(dev,
+			"nuvoton,crosstalk-gain-table", table, num)) {
+		dev_warn(dev, "Invalid crosstalk-gain-table\n");
+		return;
+	}
+	for (i = 0; i < num / 2; i++) {
+		if (table[2 * i + 1] > 0xffff ||
+			(i && table[2 * i] <= table[2 * i - 2])) {
+			dev_warn(dev, "Invalid crosstalk-gain-table\n");
+			return;
+		}
+		nau8825->xtalk_calib_bin[i].sar = table[2 * i];
+		nau8825->xtalk_calib_bin[i].dgain = table[2 * i + 1];
+	}
+	nau8825->xtalk_calib_bins = num / 2;
+}
+
+/* The gain calibrated for the unit in NVMEM wins over the one in DT */
+static int nau8825_read_xtalk_nvmem(struct device *dev,
+	struct nau8825 *nau8825)
+{
+	u16 gain;
+	int ret;
+
+	ret = nvmem_cell_read_u16(dev, "crosstalk-gain", &gain);
+	if (ret == -EPROBE_DEFER)
+		return ret;
+	if (ret)
+		return 0;
+	nau8825->xtalk_calib_gain = gain;
+	nau8825->xtalk_calib = true;
+
+	return 0;
 }
 
-static int nau8825_read_device_properties(struct device *dev,
+static void nau8825_read_device_properties(struct device *dev,
 	struct nau8825 *nau8825) {
 	int ret;
 
+	nau_irq_cfg_read(dev, &nau8825->irq_cfg);
+	nau_props_read_u32(dev, nau8825, nau8825_props,
+		ARRAY_SIZE(nau8825_props));
+
 	nau8825->jkdet_enable = device_property_read_bool(dev,
 		"nuvoton,jkdet-enable");
 	nau8825->jkdet_pull_enable = device_property_read_bool(dev,
 		"nuvoton,jkdet-pull-enable");
 	nau8825->jkdet_pull_up = device_property_read_bool(dev,
 		"nuvoton,jkdet-pull-up");
-	ret = device_property_read_u32(dev, "nuvoton,jkdet-polarity",
-		&nau8825->jkdet_polarity);
-	if (ret)
-		nau8825->jkdet_polarity = 1;
-	ret = device_property_read_u32(dev, "nuvoton,micbias-voltage",
-		&nau8825->micbias_voltage);
-	if (ret)
-		nau8825->micbias_voltage = 6;
-	ret = device_property_read_u32(dev, "nuvoton,vref-impedance",
-		&nau8825->vref_impedance);
-	if (ret)
-		nau8825->vref_impedance = 2;
-	ret = device_property_read_u32(dev, "nuvoton,sar-threshold-num",
-		&nau8825->sar_threshold_num);
-	if (ret)
-		nau8825->sar_threshold_num = 4;
+	nau8825->jack_wakeup = device_property_read_bool(dev,
+		"nuvoton,jack-wakeup");
+	nau8825->sar_only = device_property_read_bool(dev,
+		"nuvoton,sar-only-detection");
 	ret = device_property_read_u32_array(dev, "nuvoton,sar-threshold",
 		nau8825->sar_threshold, nau8825->sar_threshold_num);
 	if (ret) {
@@ -2886,43 +5047,34 @@ static int nau8825_read_device_properties(struct device *dev,
 		nau8825->sar_threshold[2] = 0x26;
 		nau8825->sar_threshold[3] = 0x73;
 	}
-	ret = device_property_read_u32(dev, "nuvoton,sar-hysteresis",
-		&nau8825->sar_hysteresis);
-	if (ret)
-		nau8825->sar_hysteresis = 0;
-	ret = device_property_read_u32(dev, "nuvoton,sar-voltage",
-		&nau8825->sar_voltage);
-	if (ret)
-		nau8825->sar_voltage = 6;
-	ret = device_property_read_u32(dev, "nuvoton,sar-compare-time",
-		&nau8825->sar_compare_time);
-	if (ret)
-		nau8825->sar_compare_time = 1;
-	ret = device_property_read_u32(dev, "nuvoton,sar-sampling-time",
-		&nau8825->sar_sampling_time);
-	if (ret)
-		nau8825->sar_sampling_time = 1;
-	ret = device_property_read_u32(dev, "nuvoton,short-key-debounce",
-		&nau8825->key_debounce);
-	if (ret)
-		nau8825->key_debounce = 3;
-	ret = device_property_read_u32(dev, "nuvoton,jack-insert-debounce",
-		&nau8825->jack_insert_debounce);
-	if (ret)
-		nau8825->jack_insert_debounce = 7;
-	ret = device_property_read_u32(dev, "nuvoton,jack-eject-debounce",
-		&nau8825->jack_eject_debounce);
-	if (ret)
-		nau8825->jack_eject_debounce = 0;
+	nau8825->sar_profile[NAU8825_SAR_LOW_POWER].compare_time =
+		nau8825->sar_compare_time;
+	nau8825->sar_profile[NAU8825_SAR_LOW_POWER].sampling_time =
+		nau8825->sar_sampling_time;
+	nau8825->sar_profile[NAU8825_SAR_LOW_POWER].key_debounce =
+		nau8825->key_debounce;
 	nau8825->xtalk_enable = device_property_read_bool(dev,
 		"nuvoton,crosstalk-enable");
+	if (nau8825->xtalk_enable && !NAU8825_XTALK_BUILT)
+		dev_warn(dev, "Cross talk measurement not built in\n");
+	nau8825->xtalk_early_report = device_property_read_bool(dev,
+		"nuvoton,crosstalk-early-report");
+	nau8825->hp_early_report = device_property_read_bool(dev,
+		"nuvoton,headphone-early-report");
+	nau8825->warm_capture = device_property_read_bool(dev,
+		"nuvoton,warm-capture");
+	nau8825_read_xtalk_calib(dev, nau8825);
+	nau8825->fast_hp_start = device_property_read_bool(dev,
+		"nuvoton,fast-hp-start");
 	nau8825->adcout_ds = device_property_read_bool(dev, "nuvoton,adcout-drive-strong");
-	ret = device_property_read_u32(dev, "nuvoton,adc-delay-ms", &nau8825->adc_delay);
-	if (ret)
-		nau8825->adc_delay = 125;
 	if (nau8825->adc_delay < 125 || nau8825->adc_delay > 500)
 		dev_warn(dev, "Please set the suitable delay time!\n");
+	if ((u32)nau8825->jack_db_profile >= NAU8825_JACK_DB_NUM)
+		nau8825->jack_db_profile = NAU8825_JACK_DB_BYPASS;
+}
 
+static int nau8825_get_mclk(struct device *dev, struct nau8825 *nau8825)
+{
 	nau8825->mclk = devm_clk_get(dev, "mclk");
 	if (PTR_ERR(nau8825->mclk) == -EPROBE_DEFER) {
 		return -EPROBE_DEFER;
@@ -2941,9 +5093,10 @@ static int nau8825_setup_irq(struct nau8825 *nau8825)
 {
 	int ret;
 
-	ret = devm_request_threaded_irq(nau8825->dev, nau8825->irq, NULL,
-		nau8825_interrupt, IRQF_TRIGGER_LOW | IRQF_ONESHOT,
-		"nau8825", nau8825);
+	/* Requested before the initiation of the chip, and enabled after */
+	ret = nau_irq_request(nau8825->dev, nau8825->irq, &nau8825->irq_cfg,
+		nau8825_hardirq, nau8825_interrupt,
+		IRQF_ONESHOT | IRQF_NO_AUTOEN, "nau8825", nau8825);
 
 	if (ret) {
 		dev_err(nau8825->dev, "Cannot request irq %d (%d)\n",
@@ -2954,7 +5107,12 @@ static int nau8825_setup_irq(struct nau8825 *nau8825)
 	return 0;
 }
 
-static int nau8825_i2c_probe(struct i2c_client *i2c)
+static void nau8825_destroy_wq(void *data)
+{
+	destroy_workqueue(data);
+}
+
+static int __nau8825_i2c_probe(struct i2c_client *i2c)
 {
 	struct device *dev = &i2c->dev;
 	struct nau8825 *nau8825 = dev_get_platdata(&i2c->dev);
@@ -2964,26 +5122,83 @@ static int nau8825_i2c_probe(struct i2c_client *i2c)
 		nau8825 = devm_kzalloc(dev, sizeof(*nau8825), GFP_KERNEL);
 		if (!nau8825)
 			return -ENOMEM;
-		ret = nau8825_read_device_properties(dev, nau8825);
+		if (!nau_props_cache_restore(dev, nau8825, sizeof(*nau8825))) {
+			nau8825_read_device_properties(dev, nau8825);
+			nau_props_cache_store(dev, nau8825, sizeof(*nau8825));
+		}
+		ret = nau8825_read_xtalk_nvmem(dev, nau8825);
 		if (ret)
 			return ret;
 	}
+	/* once, the sysclk changes of every stream only enable it */
+	ret = nau8825_get_mclk(dev, nau8825);
+	if (ret)
+		return ret;
 
 	i2c_set_clientdata(i2c, nau8825);
 
-	nau8825->regmap = devm_regmap_init_i2c(i2c, &nau8825_regmap_config);
+	nau8825->regmap = nau_regstat_regmap_init_i2c(i2c,
+			&nau8825_regmap_config, &nau8825->regstat);
 	if (IS_ERR(nau8825->regmap))
 		return PTR_ERR(nau8825->regmap);
 	nau8825->dev = dev;
 	nau8825->irq = i2c->irq;
-	/* Initiate parameters, semaphore and work queue which are needed in
+	/* the polls only stand in for a line not wired */
+	if (nau8825->irq)
+		nau8825->irq_poll.period_ms = 0;
+	nau_irq_poll_init(&nau8825->irq_poll, dev, nau8825->regmap,
+		NAU8825_REG_IRQ_STATUS, 0x7ff, nau8825_hardirq,
+		nau8825_interrupt, nau8825);
+	/* the polls run on a shared worker, at its priority */
+	if (nau_irq_polled(&nau8825->irq_poll))
+		nau8825->irq_cfg.prio = 0;
+	nau8825->sysclk_id = NAU8825_CLK_UNKNOWN;
+	/* Initiate parameters, protection and work queue which are needed in
 	 * cross talk suppression measurment function.
 	 */
 	nau8825->xtalk_state = NAU8825_XTALK_DONE;
-	nau8825->xtalk_protect = false;
 	nau8825->xtalk_baktab_initialized = false;
-	sema_init(&nau8825->xtalk_sem, 1);
-	INIT_WORK(&nau8825->xtalk_work, nau8825_xtalk_work);
+	atomic_set(&nau8825->xtalk_owner, NAU8825_XTALK_OWNER_NONE);
+	init_waitqueue_head(&nau8825->xtalk_wq);
+	nau8825->xtalk_pending = NAU8825_XTALK_PEND_NONE;
+	if (NAU8825_XTALK_BUILT)
+		INIT_DELAYED_WORK(&nau8825->xtalk_work, nau8825_xtalk_work);
+	mutex_init(&nau8825->hpvol_lock);
+	mutex_init(&nau8825->sar_lock);
+	init_completion(&nau8825->hpvol_done);
+	complete_all(&nau8825->hpvol_done);
+	INIT_DELAYED_WORK(&nau8825->hpvol_work, nau8825_hpvol_ramp_work);
+	INIT_DELAYED_WORK(&nau8825->key_repeat_work, nau8825_key_repeat_work);
+	nau_jack_report_init(&nau8825->jack_rpt, &nau8825->irq_time);
+	mutex_init(&nau8825->duty_lock);
+	nau_biq_rates_init(&nau8825->biq_rates, nau8825->regmap,
+		NAU8825_REG_BIQ_COF1, NAU8825_BIQ_COF_NUM * 2,
+		&nau8825->biq_shadow, NAU8825_REG_BIQ_CTRL, NAU8825_BIQ_WRT_EN);
+	INIT_DELAYED_WORK(&nau8825->duty_work, nau8825_duty_work);
+	INIT_DELAYED_WORK(&nau8825->jack_db_work, nau8825_jack_db_work);
+	INIT_DELAYED_WORK(&nau8825->fll_keep_work, nau8825_fll_keep_work);
+	/* The cross talk detection has a queue of its own, so it doesn't
+	 * wait behind the unrelated work of the system workqueue under load.
+	 */
+	nau8825->jdet_wq = alloc_workqueue("%s-jdet", WQ_HIGHPRI, 0,
+					   dev_name(dev));
+	if (!nau8825->jdet_wq)
+		return -ENOMEM;
+	ret = devm_add_action_or_reset(dev, nau8825_destroy_wq,
+				       nau8825->jdet_wq);
+	if (ret)
+		return ret;
+
+	/* All the resources which may defer the probe are taken before the
+	 * chip is reset and initiated, so the initiation is done once.
+	 */
+	if (i2c->irq) {
+		ret = nau8825_setup_irq(nau8825);
+		if (ret)
+			return ret;
+		if (nau8825->jack_wakeup)
+			device_init_wakeup(dev, true);
+	}
 
 	nau8825_print_device_properties(nau8825);
 
@@ -3012,17 +5227,43 @@ static int nau8825_i2c_probe(struct i2c_client *i2c)
 	}
 
 	nau8825_init_regs(nau8825);
+	nau8825_jack_sample(nau8825);
+
+	/* Runtime PM is up before the interruption, which wakes it up */
+	pm_runtime_set_autosuspend_delay(dev, nau8825->autosuspend_delay);
+	pm_runtime_use_autosuspend(dev);
+	pm_runtime_set_active(dev);
+	ret = devm_pm_runtime_enable(dev);
+	if (ret)
+		return ret;
 
-	if (i2c->irq)
-		nau8825_setup_irq(nau8825);
+	nau8825_irq_enable(nau8825);
+	nau_pm_async_init(dev);
 
 	return devm_snd_soc_register_component(&i2c->dev,
 		&nau8825_component_driver,
 		&nau8825_dai, 1);
 }
 
+static int nau8825_i2c_probe(struct i2c_client *i2c)
+{
+	ktime_t start = ktime_get();
+	int ret;
+
+	ret = __nau8825_i2c_probe(i2c);
+	nau8825_probe_attempts++;
+	nau8825_probe_us += ktime_us_delta(ktime_get(), start);
+
+	return nau_props_cache_end(&i2c->dev, ret);
+}
+
 static int nau8825_i2c_remove(struct i2c_client *client)
 {
+	struct nau8825 *nau8825 = i2c_get_clientdata(client);
+
+	nau_irq_poll_disable(&nau8825->irq_poll);
+	nau8825_key_repeat_stop(nau8825);
+	device_init_wakeup(&client->dev, false);
 	return 0;
 }
 
@@ -3048,11 +5289,18 @@ static const struct acpi_device_id nau8825_acpi_match[] = {
 MODULE_DEVICE_TABLE(acpi, nau8825_acpi_match);
 #endif
 
+static const struct dev_pm_ops nau8825_pm_ops = {
+	SET_RUNTIME_PM_OPS(nau8825_runtime_suspend, nau8825_runtime_resume,
+			   NULL)
+};
+
 static struct i2c_driver nau8825_driver = {
 	.driver = {
 		.name = "nau8825",
 		.of_match_table = of_match_ptr(nau8825_of_ids),
 		.acpi_match_table = ACPI_PTR(nau8825_acpi_match),
+		.pm = &nau8825_pm_ops,
+		.probe_type = PROBE_PREFER_ASYNCHRONOUS,
 	},
 	.probe_new = nau8825_i2c_probe,
 	.remove = nau8825_i2c_remove,
@@ -3063,3 +5311,8 @@ module_i2c_driver(nau8825_driver);
 MODULE_DESCRIPTION("ASoC nau8825 driver");
 MODULE_AUTHOR("Anatol Pomozov <anatol@chromium.org>");
 MODULE_LICENSE("GPL");
+
+#ifdef CONFIG_SND_SOC_NAU8825_KUNIT_TEST
+#include "nau8825-test.c"
+#include "nau8825-jack-test.c"
+#endif
@@ -178,6 +178,7 @@
 #define NAU8825_IRQ_HEADSET_COMPLETE_EN (1 << 10)
 #define NAU8825_IRQ_RMS_EN (1 << 8)
 #define NAU8825_IRQ_KEY_RELEASE_EN (1 << 7)
+#define NAU8825_IRQ_KEY_LONG_PRESS_EN (1 << 6)
 #define NAU8825_IRQ_KEY_SHORT_PRESS_EN (1 << 5)
 #define NAU8825_IRQ_EJECT_EN (1 << 2)
 #define NAU8825_IRQ_INSERT_EN (1 << 0)
@@ -248,6 +249,9 @@
 #define NAU8825_TDM_DACR_RX_SFT		4
 #define NAU8825_TDM_DACR_RX_MASK	(0x3 << NAU8825_TDM_DACR_RX_SFT)
 #define NAU8825_TDM_TX_MASK		0x3
+/* the slots of a frame, and the window of the slots of DAC and ADC */
+#define NAU8825_TDM_SLOTS		16
+#define NAU8825_TDM_WINDOW		4
 
 /* I2S_PCM_CTRL1 (0x1c) */
 #define NAU8825_I2S_BP_SFT	7
@@ -296,6 +300,8 @@
 #define NAU8825_BIQ_PATH_MASK  (1 << NAU8825_BIQ_PATH_SFT)
 #define NAU8825_BIQ_PATH_ADC   (0 << NAU8825_BIQ_PATH_SFT)
 #define NAU8825_BIQ_PATH_DAC   (1 << NAU8825_BIQ_PATH_SFT)
+/* BIQ_COF1 (0x21) to BIQ_COF10 (0x2a) */
+#define NAU8825_BIQ_COF_NUM	10
 
 /* ADC_RATE (0x2b) */
 #define NAU8825_ADC_SINC4_SFT		4
@@ -317,6 +323,10 @@
 #define NAU8825_DAC_OVERSAMPLE_32	4
 
 /* ADC_DGAIN_CTRL (0x30) */
+#define NAU8825_ADC_SIDETONE_L_SFT	12
+#define NAU8825_ADC_SIDETONE_R_SFT	8
+#define NAU8825_ADC_SIDETONE_MAX	0xf
+#define NAU8825_ADC_SIDETONE_MASK	(0xff << 8)
 #define NAU8825_ADC_DIG_VOL_MASK	0xff
 
 /* MUTE_CTRL (0x31) */
@@ -439,6 +449,7 @@
 #define NAU8825_MICBIAS_LOWNOISE_MASK	(0x1 << NAU8825_MICBIAS_LOWNOISE_SFT)
 #define NAU8825_MICBIAS_LOWNOISE_EN	(0x1 << NAU8825_MICBIAS_LOWNOISE_SFT)
 #define NAU8825_MICBIAS_POWERUP_SFT	8
+#define NAU8825_MICBIAS_POWERUP	(0x1 << NAU8825_MICBIAS_POWERUP_SFT)
 #define NAU8825_MICBIAS_VOLTAGE_SFT	0
 #define NAU8825_MICBIAS_VOLTAGE_MASK	0x7
 
@@ -481,8 +492,13 @@ enum {
 	NAU8825_CLK_FLL_MCLK,
 	NAU8825_CLK_FLL_BLK,
 	NAU8825_CLK_FLL_FS,
+	/* hw_params plans the sysclk, freq is the MCLK available or 0 */
+	NAU8825_CLK_AUTO,
 };
 
+/* The clock setting of the registers is not known */
+#define NAU8825_CLK_UNKNOWN	(-1)
+
 /* Cross talk detection state */
 enum {
 	NAU8825_XTALK_PREPARE = 0,
@@ -492,23 +508,244 @@ enum {
 	NAU8825_XTALK_DONE,
 };
 
+/* Registers backed up during cross talk detection, the headphone volume
+ * is restored last with a ramp.
+ */
+enum {
+	NAU8825_XTALK_BAK_ADC_DGAIN = 0,
+	NAU8825_XTALK_BAK_DACL,
+	NAU8825_XTALK_BAK_DACR,
+	NAU8825_XTALK_BAK_HSVOL,
+	NAU8825_XTALK_BAK_NUM,
+};
+
+/* Owner of the cross talk protection */
+enum {
+	NAU8825_XTALK_OWNER_NONE = 0,
+	NAU8825_XTALK_OWNER_AUDIO,	/* playback configuration */
+	NAU8825_XTALK_OWNER_RESUME,	/* jack detection after resume */
+	NAU8825_XTALK_OWNER_MEASURE,	/* cross talk measurement */
+};
+
+/* Cross talk detection action deferred by the settle time */
+enum {
+	NAU8825_XTALK_PEND_NONE = 0,
+	NAU8825_XTALK_PEND_HPVOL,	/* the headphone volume ramp to 0dB */
+	NAU8825_XTALK_PEND_IMM_SETUP,
+	NAU8825_XTALK_PEND_IMM_EN,
+};
+
+/* Interruption cause counted for debugfs, and its handler */
+#define NAU8825_IRQ_CAUSE_NUM	8
+
+struct nau8825;
+struct nau8825_irq_pass;
+
+struct nau8825_irq_cause {
+	const char *name;
+	int mask;
+	int detected;
+	bool (*handle)(struct nau8825 *nau8825, struct nau8825_irq_pass *pass);
+};
+
+/* The cross talk results of recent headsets, keyed by a SAR fingerprint */
+#define NAU8825_XTALK_CACHE_NUM	4
+#define NAU8825_XTALK_SAR_TOLERANCE	2
+/* The factory calibrated cross talk gain, in bins of the SAR reading of
+ * the headset microphone
+ */
+#define NAU8825_XTALK_CALIB_NUM	8
+
+struct nau8825_xtalk_bin {
+	unsigned int sar;
+	unsigned int dgain;
+};
+
+/* the idle time before the measurement preempted by a stream reruns */
+#define NAU8825_XTALK_IDLE_MS	1000
+
+struct nau8825_xtalk_cache {
+	int mic_type;
+	unsigned int sar;
+	unsigned int dgain;
+};
+
+/* The SAR timings of the buttons, switched at runtime: the ones of the
+ * device properties for the low power, and shorter ones for the fast
+ * response during a call.
+ */
+enum {
+	NAU8825_SAR_LOW_POWER,
+	NAU8825_SAR_FAST,
+	NAU8825_SAR_PROFILE_NUM,
+};
+
+/* The selection of the profile, automatic by the capture stream */
+enum {
+	NAU8825_SAR_MODE_AUTO,
+	NAU8825_SAR_MODE_LOW_POWER,
+	NAU8825_SAR_MODE_FAST,
+};
+
+struct nau8825_sar_profile {
+	int compare_time;
+	int sampling_time;
+	int key_debounce;
+};
+
+/* The debounce of the jack detection without a jack, applied by
+ * nau8825_jack_db_apply()
+ */
+enum {
+	NAU8825_JACK_DB_BYPASS,
+	NAU8825_JACK_DB_FILTER,
+	NAU8825_JACK_DB_NUM,
+};
+
+/* the time the bypass of the debounce is kept after a resume */
+#define NAU8825_JACK_DB_RESUME_MS	1000
+
+/* the ramp of the charge pump before the output driver */
+#define NAU8825_PUMP_RAMP_MS	10
+
+/* the tone of a bell on the beep generator */
+#define NAU8825_BELL_HZ		184
+
+/* The stages of the stream start timed under debugfs */
+enum {
+	NAU8825_LAT_STARTUP,
+	NAU8825_LAT_HW_PARAMS,
+	NAU8825_LAT_XTALK_WAIT,
+	NAU8825_LAT_FEPGA,
+	/* the rest of the charge pump ramp left to the output driver */
+	NAU8825_LAT_PUMP,
+	/* the interruption to the decode of a button, by SAR profile */
+	NAU8825_LAT_KEY_LOW_POWER,
+	NAU8825_LAT_KEY_FAST,
+	/* the steps of the cross talk detection, their wait for a worker
+	 * past the settle time and their run
+	 */
+	NAU8825_LAT_XTALK_QUEUE,
+	NAU8825_LAT_XTALK_RUN,
+	/* the hard interruption to the run of its thread */
+	NAU8825_LAT_IRQ_THREAD,
+	NAU8825_LAT_NUM,
+};
+
+/* The output power profiles of the headphone by its load. A high
+ * impedance load draws little current, so the class AB bias current
+ * stays at 1x and the high current boost driver is left off.
+ */
+enum {
+	NAU8825_HP_LOW_IMPED,
+	NAU8825_HP_HIGH_IMPED,
+	NAU8825_HP_PROFILE_NUM,
+};
+
+struct nau8825_hp_profile {
+	bool bias_2x;
+	bool boost;
+};
+
+/* The selection of the OSR of a stream at hw_params */
+enum {
+	NAU8825_OSR_MANUAL,	/* the OSR of the controls */
+	NAU8825_OSR_LOW_LATENCY,
+	NAU8825_OSR_LOW_POWER,
+	NAU8825_OSR_QUALITY,
+};
+
 struct nau8825 {
 	struct device *dev;
 	struct regmap *regmap;
+	struct nau_regstat regstat;
+	struct nau_regcache_report regcache_report;
 	struct snd_soc_dapm_context *dapm;
 	struct snd_soc_jack *jack;
 	struct clk *mclk;
-	struct work_struct xtalk_work;
-	struct semaphore xtalk_sem;
+	struct workqueue_struct *jdet_wq;
+	struct delayed_work xtalk_work;
+	ktime_t xtalk_due;
+	ktime_t xtalk_hpvol_end;	/* the last wait for the volume ramp */
+	atomic_t xtalk_owner;
+	wait_queue_head_t xtalk_wq;
+	/* headphone volume ramp */
+	struct delayed_work hpvol_work;
+	struct mutex hpvol_lock;
+	struct completion hpvol_done;
+	unsigned int hpvol_cur;
+	unsigned int hpvol_target;
+	unsigned int hpvol_step;
+	bool hpvol_ramping;
 	int sw_id;
 	int irq;
+	struct nau_irq_cfg irq_cfg;
+	struct nau_irq_poll irq_poll;	/* in place of a line not wired */
 	int mclk_freq; /* 0 - mclk is disabled */
+	unsigned int mclk_rate; /* the rate set to mclk last */
+	int sysclk_id; /* the clock applied, NAU8825_CLK_UNKNOWN if none */
+	unsigned int sysclk_freq;
+	bool pm_held; /* runtime PM held while a DAPM path is powered */
+	int autosuspend_delay;
 	int button_pressed;
+	/* the buttons held past the long press, repeated every key_repeat
+	 * milliseconds until the release; no repeat if zero
+	 */
+	int button_long;
+	int key_repeat;
+	struct delayed_work key_repeat_work;
+	u32 irq_count;
+	u32 irq_cause_count[NAU8825_IRQ_CAUSE_NUM];
+	struct nau_regcache_stat resume_sync;
+	struct nau_latency latency[NAU8825_LAT_NUM];
+	struct nau_hw_params_cache hw_params_cache;
+	struct nau_clk_planner clk_plan;
+	struct nau_jack_report jack_rpt;
+	struct nau_delay delay;
+	/* the VCO and the SAR duty cycled while a headset waits idle */
+	struct nau_duty duty;
+	struct delayed_work duty_work;
+	/* the beep generator, the tone asked and the beeps played or not */
+	struct input_dev *beep;
+	struct work_struct beep_work;
+	unsigned int beep_hz;
+	u32 beeps;
+	u32 beep_skips;
+	struct mutex duty_lock;
+	struct nau_dapm_stat dapm_stat;
+	struct nau_settle pump_settle;
+	int osr_policy;
+	struct nau_fll_cache fll_cache;
+	/* the FLL left locked for fll_keep_ms after the last stream, and
+	 * taken as is by a stream of the same reference and rate
+	 */
+	unsigned int fll_keep_ms;
+	struct delayed_work fll_keep_work;
+	bool fll_locked;
+	bool fll_idle;		/* no stream holds the system clock */
+	int fll_src;		/* the clock id of the reference */
+	unsigned int fll_in;
+	unsigned int fll_fs;
+	u32 fll_reused;
+	struct nau_coeff_shadow biq_shadow;
+	/* the coefficients kept per sampling rate */
+	struct nau_biq_rates biq_rates;
 	int micbias_voltage;
 	int vref_impedance;
 	bool jkdet_enable;
 	bool jkdet_pull_enable;
 	bool jkdet_pull_up;
+	/* wake on jack out of system suspend, and the state kept for the
+	 * resume when the jack is found unchanged
+	 */
+	bool jack_wakeup;
+	bool wake_armed;
+	bool wake_inserted;
+	bool wake_carry;
+	/* the jack state the interruption last read */
+	bool jack_present;
+	int wake_jack_status;
+	unsigned int wake_dis_ctrl;
 	int jkdet_polarity;
 	int sar_threshold_num;
 	int sar_threshold[8];
@@ -517,22 +754,89 @@ struct nau8825 {
 	int sar_compare_time;
 	int sar_sampling_time;
 	int key_debounce;
+	struct nau8825_sar_profile sar_profile[NAU8825_SAR_PROFILE_NUM];
+	struct mutex sar_lock;
+	int sar_mode;
+	int sar_applied; /* NAU8825_SAR_PROFILE_NUM if none */
+	int capture_active;
+	ktime_t irq_time;
 	int jack_insert_debounce;
 	int jack_eject_debounce;
+	int jack_db_profile;	/* the debounce of the board */
+	int jack_db_applied;
+	struct delayed_work jack_db_work;
 	int high_imped;
+	/* the output power profile of the load, and the IMM level at or
+	 * under which the load is of high impedance, 0 if unused
+	 */
+	int hp_profile;
+	int hp_high_imped_rms;
 	int xtalk_state;
 	int xtalk_event;
 	int xtalk_event_mask;
-	bool xtalk_protect;
+	int xtalk_pending;
+	int xtalk_prepare_delay;
+	int xtalk_imm_delay;
+	int xtalk_done_delay;
+	bool xtalk_early_report;
+	bool hp_early_report;
+	bool fast_hp_start;
+	/* fingerprint of the inserted headset, and the results kept in
+	 * most recently used order
+	 */
+	bool xtalk_fp_valid;
+	int xtalk_fp_type;
+	unsigned int xtalk_fp_sar;
+	struct nau8825_xtalk_cache xtalk_cache[NAU8825_XTALK_CACHE_NUM];
+	int xtalk_cache_num;
 	int imp_rms[NAU8825_XTALK_IMM];
 	int xtalk_enable;
+	/* A stream preempts the measurement, which is then owed until the
+	 * codec is idle again; the rerun doesn't report the jack again.
+	 */
+	bool xtalk_preempt;
+	bool xtalk_deferred;
+	bool xtalk_rerun;
+	u32 xtalk_preempt_count;
+	/* The calibrated DAC_DGAIN_CTRL, for all the headsets or in bins
+	 * of ascending SAR readings, which skips the measurement.
+	 */
+	bool xtalk_calib;
+	unsigned int xtalk_calib_gain;
+	struct nau8825_xtalk_bin xtalk_calib_bin[NAU8825_XTALK_CALIB_NUM];
+	int xtalk_calib_bins;
+	struct reg_sequence xtalk_baktab[NAU8825_XTALK_BAK_NUM];
 	bool xtalk_baktab_initialized; /* True if initialized. */
 	bool adcout_ds;
+	/* the main ADC is off while no capture needs it, once the jack type
+	 * is detected, and the SAR senses the buttons and the ejection alone
+	 */
+	bool sar_only;
+	bool adc_capture;
 	int adc_delay;
+	/* deferred unmute of the ADC after the settle */
+	struct delayed_work adc_unmute_work;
+	unsigned int adc_vol;
+	bool adc_muted;
+	ktime_t adc_ready;	/* the end of the ADC settle */
+	/* the capture path held powered and muted while a headset mic is
+	 * present, so a capture start only unmutes it
+	 */
+	bool warm_capture;
+	bool warm;
+	bool capture_on;
+	/* the sidetone gain in ADC_DGAIN_CTRL format, applied while the
+	 * sidetone path is powered
+	 */
+	unsigned int sidetone_gain;
+	bool sidetone_on;
+	/* the use cases of the board, recalled in one DAPM update */
+	struct nau_scenes scenes;
 };
 
 int nau8825_enable_jack_detect(struct snd_soc_component *component,
 				struct snd_soc_jack *jack);
+int nau8825_ratio_to_mdb(u32 num, u32 den);
 
 
 #endif  /* __NAU8825_H__ */
@@ -0,0 +1,630 @@
+// SPDX-License-Identifier: GPL-2.0-only
+//
+// nau-bench.c  --  Latency benchmark of the Nuvoton codec paths
+//
+// Copyright 2022 Nuvoton Technology Corp.
+//
+// Measures from userspace, through alsa-lib and evdev, the latencies the
+// drivers are tuned for:
+//   playback  open to the trigger and to the first period played
+//   capture   open to the first period captured
+//   mixer     the write of each control given by -m
+//   jack      the codec interruption to the SW event of the jack
+//   resume    the return of a suspend to the first period played
+//
+// Every sample and the summary of each test come out as one JSON object a
+// line, tagged with the codec and the kernel release, for the comparison
+// of the kernel variants and of the runs of a regression test.
+//
+// Build: gcc -O2 -Wall -o nau-bench nau-bench.c -lasound
+
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/input.h>
+#include <sys/ioctl.h>
+#include <sys/utsname.h>
+#include <alsa/asoundlib.h>
+
+#define BENCH_RATE		48000
+#define BENCH_CHANNELS		2
+#define BENCH_PERIOD		256
+#define BENCH_PERIODS		4
+#define BENCH_TIMEOUT_MS	2000
+#define BENCH_CONTROLS_MAX	16
+#define BENCH_IRQ_POLL_MS	1
+
+struct bench_stat {
+	const char *test;
+	unsigned int num;
+	unsigned int fails;
+	int64_t min;
+	int64_t max;
+	int64_t sum;
+};
+
+static struct {
+	const char *pcm;
+	const char *ctl;
+	const char *codec;
+	const char *jack_dev;
+	const char *irq_name;
+	const char *controls[BENCH_CONTROLS_MAX];
+	unsigned int num_controls;
+	unsigned int iterations;
+	unsigned int suspend_s;
+	unsigned int idle_s;
+	char kernel[65];
+} bench = {
+	.pcm = "default",
+	.ctl = "default",
+	.codec = "unknown",
+	.iterations = 10,
+	.suspend_s = 5,
+	.idle_s = 6,
+};
+
+static int64_t now_us(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static int64_t ts_us(const snd_htimestamp_t *ts)
+{
+	return (int64_t)ts->tv_sec * 1000000 + ts->tv_nsec / 1000;
+}
+
+static void bench_print_head(const char *test)
+{
+	printf("{\"codec\":\"%s\",\"kernel\":\"%s\",\"test\":\"%s\"",
+	       bench.codec, bench.kernel, test);
+}
+
+static void bench_sample(struct bench_stat *stat, unsigned int iter,
+			 const char *name, int64_t us)
+{
+	bench_print_head(stat->test);
+	if (name)
+		printf(",\"name\":\"%s\"", name);
+	printf(",\"iter\":%u,\"us\":%lld}\n", iter, (long long)us);
+
+	if (!stat->num || us < stat->min)
+		stat->min = us;
+	if (!stat->num || us > stat->max)
+		stat->max = us;
+	stat->sum += us;
+	stat->num++;
+}
+
+static void bench_fail(struct bench_stat *stat, unsigned int iter,
+		       const char *what, int err)
+{
+	bench_print_head(stat->test);
+	printf(",\"iter\":%u,\"error\":\"%s: %s\"}\n", iter, what,
+	       snd_strerror(err));
+	stat->fails++;
+}
+
+static void bench_summary(const struct bench_stat *stat, const char *name)
+{
+	bench_print_head(stat->test);
+	if (name)
+		printf(",\"name\":\"%s\"", name);
+	printf(",\"summary\":true,\"n\":%u,\"fails\":%u", stat->num,
+	       stat->fails);
+	if (stat->num)
+		printf(",\"min_us\":%lld,\"avg_us\":%lld,\"max_us\":%lld",
+		       (long long)stat->min,
+		       (long long)(stat->sum / stat->num),
+		       (long long)stat->max);
+	printf("}\n");
+	fflush(stdout);
+}
+
+/* The stream of the test, with the trigger stamped in CLOCK_MONOTONIC */
+static int bench_pcm_open(snd_pcm_t **pcm, snd_pcm_stream_t stream)
+{
+	snd_pcm_hw_params_t *hw;
+	snd_pcm_sw_params_t *sw;
+	snd_pcm_uframes_t period = BENCH_PERIOD;
+	snd_pcm_uframes_t buffer = BENCH_PERIOD * BENCH_PERIODS;
+	unsigned int rate = BENCH_RATE;
+	int err;
+
+	err = snd_pcm_open(pcm, bench.pcm, stream, 0);
+	if (err < 0)
+		return err;
+
+	snd_pcm_hw_params_alloca(&hw);
+	snd_pcm_hw_params_any(*pcm, hw);
+	err = snd_pcm_hw_params_set_access(*pcm, hw,
+					   SND_PCM_ACCESS_RW_INTERLEAVED);
+	if (!err)
+		err = snd_pcm_hw_params_set_format(*pcm, hw,
+						   SND_PCM_FORMAT_S16_LE);
+	if (!err)
+		err = snd_pcm_hw_params_set_channels(*pcm, hw,
+						     BENCH_CHANNELS);
+	if (!err)
+		err = snd_pcm_hw_params_set_rate_near(*pcm, hw, &rate, NULL);
+	if (!err)
+		err = snd_pcm_hw_params_set_period_size_near(*pcm, hw,
+							     &period, NULL);
+	if (!err)
+		err = snd_pcm_hw_params_set_buffer_size_near(*pcm, hw,
+							     &buffer);
+	if (!err)
+		err = snd_pcm_hw_params(*pcm, hw);
+	if (err < 0)
+		goto err;
+
+	snd_pcm_sw_params_alloca(&sw);
+	snd_pcm_sw_params_current(*pcm, sw);
+	snd_pcm_sw_params_set_tstamp_mode(*pcm, sw, SND_PCM_TSTAMP_ENABLE);
+	snd_pcm_sw_params_set_tstamp_type(*pcm, sw,
+					  SND_PCM_TSTAMP_TYPE_MONOTONIC);
+	err = snd_pcm_sw_params(*pcm, sw);
+	if (err < 0)
+		goto err;
+
+	/* the power up of the codec runs here */
+	err = snd_pcm_prepare(*pcm);
+	if (err < 0)
+		goto err;
+
+	return 0;
+err:
+	snd_pcm_close(*pcm);
+	return err;
+}
+
+/* Fill the buffer with silence, which starts the stream, and wait the
+ * first period to be played. Returns the time of the trigger.
+ */
+static int bench_playback_run(snd_pcm_t *pcm, int64_t *trigger,
+			      int64_t *first)
+{
+	int16_t buf[BENCH_PERIOD * BENCH_CHANNELS] = { 0 };
+	snd_pcm_status_t *status;
+	snd_htimestamp_t ts;
+	snd_pcm_sframes_t full, avail;
+	int64_t deadline;
+	int i, err;
+
+	for (i = 0; i < BENCH_PERIODS; i++) {
+		err = snd_pcm_writei(pcm, buf, BENCH_PERIOD);
+		if (err < 0)
+			return err;
+	}
+	if (snd_pcm_state(pcm) != SND_PCM_STATE_RUNNING) {
+		err = snd_pcm_start(pcm);
+		if (err < 0)
+			return err;
+	}
+
+	full = snd_pcm_avail_update(pcm);
+	if (full < 0)
+		return full;
+	deadline = now_us() + BENCH_TIMEOUT_MS * 1000;
+	do {
+		avail = snd_pcm_avail_update(pcm);
+		if (avail < 0)
+			return avail;
+		if (avail > full)
+			break;
+		usleep(200);
+	} while (now_us() < deadline);
+	if (avail <= full)
+		return -ETIMEDOUT;
+	*first = now_us();
+
+	snd_pcm_status_alloca(&status);
+	err = snd_pcm_status(pcm, status);
+	if (err < 0)
+		return err;
+	snd_pcm_status_get_trigger_htstamp(status, &ts);
+	*trigger = ts_us(&ts);
+
+	return 0;
+}
+
+static void bench_playback(void)
+{
+	struct bench_stat open_stat = { .test = "playback_open_to_trigger" };
+	struct bench_stat first_stat = { .test = "playback_open_to_first" };
+	int64_t start, trigger, first;
+	snd_pcm_t *pcm;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < bench.iterations; i++) {
+		start = now_us();
+		err = bench_pcm_open(&pcm, SND_PCM_STREAM_PLAYBACK);
+		if (err < 0) {
+			bench_fail(&first_stat, i, "open", err);
+			continue;
+		}
+		err = bench_playback_run(pcm, &trigger, &first);
+		snd_pcm_drop(pcm);
+		snd_pcm_close(pcm);
+		if (err < 0) {
+			bench_fail(&first_stat, i, "run", err);
+			continue;
+		}
+		bench_sample(&open_stat, i, NULL, trigger - start);
+		bench_sample(&first_stat, i, NULL, first - start);
+		/* past the pmdown time, so each one powers up again */
+		sleep(bench.idle_s);
+	}
+	bench_summary(&open_stat, NULL);
+	bench_summary(&first_stat, NULL);
+}
+
+static void bench_capture(void)
+{
+	struct bench_stat stat = { .test = "capture_open_to_first" };
+	int16_t buf[BENCH_PERIOD * BENCH_CHANNELS];
+	snd_pcm_t *pcm;
+	int64_t start;
+	unsigned int i;
+	int err;
+
+	for (i = 0; i < bench.iterations; i++) {
+		start = now_us();
+		err = bench_pcm_open(&pcm, SND_PCM_STREAM_CAPTURE);
+		if (err < 0) {
+			bench_fail(&stat, i, "open", err);
+			continue;
+		}
+		err = snd_pcm_start(pcm);
+		if (!err)
+			err = snd_pcm_readi(pcm, buf, BENCH_PERIOD);
+		if (err >= 0)
+			bench_sample(&stat, i, NULL, now_us() - start);
+		else
+			bench_fail(&stat, i, "read", err);
+		snd_pcm_drop(pcm);
+		snd_pcm_close(pcm);
+		sleep(bench.idle_s);
+	}
+	bench_summary(&stat, NULL);
+}
+
+/* Alternate the control between two values, then restore it. A byte
+ * control, such as the DSP commands of nau8310, is written back as read.
+ */
+static void bench_mixer_one(snd_ctl_t *ctl, const char *name)
+{
+	struct bench_stat stat = { .test = "mixer_write" };
+	snd_ctl_elem_id_t *id;
+	snd_ctl_elem_info_t *info;
+	snd_ctl_elem_value_t *orig, *val;
+	snd_ctl_elem_type_t type;
+	unsigned int i, j, count;
+	int64_t start;
+	long lo = 0, hi = 1;
+	int err;
+
+	snd_ctl_elem_id_alloca(&id);
+	snd_ctl_elem_info_alloca(&info);
+	snd_ctl_elem_value_alloca(&orig);
+	snd_ctl_elem_value_alloca(&val);
+
+	snd_ctl_elem_id_set_interface(id, SND_CTL_ELEM_IFACE_MIXER);
+	snd_ctl_elem_id_set_name(id, name);
+	snd_ctl_elem_info_set_id(info, id);
+	err = snd_ctl_elem_info(ctl, info);
+	if (err < 0) {
+		bench_fail(&stat, 0, name, err);
+		bench_summary(&stat, name);
+		return;
+	}
+	type = snd_ctl_elem_info_get_type(info);
+	count = snd_ctl_elem_info_get_count(info);
+	if (type == SND_CTL_ELEM_TYPE_INTEGER) {
+		lo = snd_ctl_elem_info_get_min(info);
+		hi = snd_ctl_elem_info_get_max(info);
+	} else if (type == SND_CTL_ELEM_TYPE_ENUMERATED) {
+		hi = snd_ctl_elem_info_get_items(info) > 1;
+	}
+
+	snd_ctl_elem_value_set_id(orig, id);
+	err = snd_ctl_elem_read(ctl, orig);
+	if (err < 0) {
+		bench_fail(&stat, 0, name, err);
+		bench_summary(&stat, name);
+		return;
+	}
+
+	for (i = 0; i < bench.iterations; i++) {
+		snd_ctl_elem_value_copy(val, orig);
+		for (j = 0; j < count; j++) {
+			long v = i & 1 ? hi : lo;
+
+			switch (type) {
+			case SND_CTL_ELEM_TYPE_BOOLEAN:
+				snd_ctl_elem_value_set_boolean(val, j, i & 1);
+				break;
+			case SND_CTL_ELEM_TYPE_INTEGER:
+				snd_ctl_elem_value_set_integer(val, j, v);
+				break;
+			case SND_CTL_ELEM_TYPE_ENUMERATED:
+				snd_ctl_elem_value_set_enumerated(val, j, v);
+				break;
+			default:
+				break;
+			}
+		}
+		start = now_us();
+		err = snd_ctl_elem_write(ctl, val);
+		if (err < 0)
+			bench_fail(&stat, i, name, err);
+		else
+			bench_sample(&stat, i, name, now_us() - start);
+	}
+	snd_ctl_elem_write(ctl, orig);
+	bench_summary(&stat, name);
+}
+
+static void bench_mixer(void)
+{
+	snd_ctl_t *ctl;
+	unsigned int i;
+	int err;
+
+	err = snd_ctl_open(&ctl, bench.ctl, 0);
+	if (err < 0) {
+		struct bench_stat stat = { .test = "mixer_write" };
+
+		bench_fail(&stat, 0, "ctl open", err);
+		bench_summary(&stat, NULL);
+		return;
+	}
+	for (i = 0; i < bench.num_controls; i++)
+		bench_mixer_one(ctl, bench.controls[i]);
+	snd_ctl_close(ctl);
+}
+
+/* The interruptions counted for the IRQ of the codec in /proc/interrupts */
+static long long bench_irq_count(const char *name)
+{
+	char line[1024], *p, *end;
+	long long count = -1, v;
+	FILE *f;
+
+	f = fopen("/proc/interrupts", "r");
+	if (!f)
+		return -1;
+	while (fgets(line, sizeof(line), f)) {
+		if (!strstr(line, name))
+			continue;
+		p = strchr(line, ':');
+		if (!p)
+			break;
+		count = 0;
+		for (p++;; p = end) {
+			v = strtoll(p, &end, 10);
+			if (end == p)
+				break;
+			count += v;
+		}
+		break;
+	}
+	fclose(f);
+
+	return count;
+}
+
+/* Each plug or unplug of the jack by hand: from the first interruption of
+ * the codec after the last report, to the report of the SW event stamped
+ * by evdev. Without -i, the delivery of the event to userspace only.
+ */
+static void bench_jack(void)
+{
+	struct bench_stat stat = { .test = "jack_irq_to_event" };
+	struct bench_stat deliver = { .test = "jack_event_delivery" };
+	int clk = CLOCK_MONOTONIC;
+	long long irqs = -1, cnt;
+	int64_t irq_time = 0, ev_time;
+	struct input_event ev;
+	struct pollfd pfd;
+	unsigned int i = 0;
+	bool sw = false;
+	int fd;
+
+	fd = open(bench.jack_dev, O_RDONLY | O_NONBLOCK);
+	if (fd < 0) {
+		bench_fail(&stat, 0, bench.jack_dev, -errno);
+		bench_summary(&stat, NULL);
+		return;
+	}
+	ioctl(fd, EVIOCSCLOCKID, &clk);
+	if (bench.irq_name)
+		irqs = bench_irq_count(bench.irq_name);
+	fprintf(stderr, "plug and unplug the jack %u times\n",
+		bench.iterations);
+
+	pfd.fd = fd;
+	pfd.events = POLLIN;
+	while (i < bench.iterations) {
+		if (poll(&pfd, 1, BENCH_IRQ_POLL_MS) < 0)
+			break;
+		if (irqs >= 0 && !irq_time) {
+			cnt = bench_irq_count(bench.irq_name);
+			if (cnt > irqs)
+				irq_time = now_us();
+			irqs = cnt;
+		}
+		while (read(fd, &ev, sizeof(ev)) == sizeof(ev)) {
+			if (ev.type == EV_SW) {
+				sw = true;
+				continue;
+			}
+			if (ev.type != EV_SYN || ev.code != SYN_REPORT || !sw)
+				continue;
+			ev_time = (int64_t)ev.input_event_sec * 1000000 +
+				ev.input_event_usec;
+			bench_sample(&deliver, i, NULL, now_us() - ev_time);
+			if (irq_time)
+				bench_sample(&stat, i, NULL, ev_time - irq_time);
+			irq_time = 0;
+			if (irqs >= 0)
+				irqs = bench_irq_count(bench.irq_name);
+			sw = false;
+			i++;
+		}
+	}
+	close(fd);
+	if (irqs >= 0)
+		bench_summary(&stat, NULL);
+	bench_summary(&deliver, NULL);
+}
+
+static int bench_write_file(const char *path, const char *val)
+{
+	ssize_t len = strlen(val);
+	int fd, ret = 0;
+
+	fd = open(path, O_WRONLY);
+	if (fd < 0)
+		return -errno;
+	if (write(fd, val, len) != len)
+		ret = -errno;
+	close(fd);
+
+	return ret;
+}
+
+/* Suspend to memory with the RTC alarm to wake up, and play at once */
+static void bench_resume(void)
+{
+	struct bench_stat stat = { .test = "resume_to_first" };
+	char alarm[16];
+	int64_t resumed, trigger, first;
+	snd_pcm_t *pcm;
+	unsigned int i;
+	int err;
+
+	snprintf(alarm, sizeof(alarm), "+%u", bench.suspend_s);
+	for (i = 0; i < bench.iterations; i++) {
+		bench_write_file("/sys/class/rtc/rtc0/wakealarm", "0");
+		err = bench_write_file("/sys/class/rtc/rtc0/wakealarm", alarm);
+		if (!err)
+			err = bench_write_file("/sys/power/state", "mem");
+		if (err < 0) {
+			bench_fail(&stat, i, "suspend", err);
+			break;
+		}
+		resumed = now_us();
+		err = bench_pcm_open(&pcm, SND_PCM_STREAM_PLAYBACK);
+		if (err < 0) {
+			bench_fail(&stat, i, "open", err);
+			continue;
+		}
+		err = bench_playback_run(pcm, &trigger, &first);
+		snd_pcm_drop(pcm);
+		snd_pcm_close(pcm);
+		if (err < 0)
+			bench_fail(&stat, i, "run", err);
+		else
+			bench_sample(&stat, i, NULL, first - resumed);
+	}
+	bench_summary(&stat, NULL);
+}
+
+static void usage(const char *prog)
+{
+	fprintf(stderr,
+		"usage: %s [options] test...\n"
+		"tests: playback capture mixer jack resume\n"
+		"  -D pcm      PCM device, default \"default\"\n"
+		"  -C ctl      control device, default \"default\"\n"
+		"  -c codec    codec tag of the output\n"
+		"  -n num      iterations, default 10\n"
+		"  -m name     control of the mixer test, repeatable\n"
+		"  -j event    evdev node of the jack\n"
+		"  -i irq      name of the codec IRQ in /proc/interrupts\n"
+		"  -s sec      suspend time of the resume test, default 5\n"
+		"  -w sec      idle time between the streams, over the pmdown\n"
+		"              time of the card, default 6\n",
+		prog);
+}
+
+int main(int argc, char *argv[])
+{
+	struct utsname uts;
+	int opt, i;
+
+	while ((opt = getopt(argc, argv, "D:C:c:n:m:j:i:s:w:h")) != -1) {
+		switch (opt) {
+		case 'D':
+			bench.pcm = optarg;
+			break;
+		case 'C':
+			bench.ctl = optarg;
+			break;
+		case 'c':
+			bench.codec = optarg;
+			break;
+		case 'n':
+			bench.iterations = strtoul(optarg, NULL, 0);
+			break;
+		case 'm':
+			if (bench.num_controls < BENCH_CONTROLS_MAX)
+				bench.controls[bench.num_controls++] = optarg;
+			break;
+		case 'j':
+			bench.jack_dev = optarg;
+			break;
+		case 'i':
+			bench.irq_name = optarg;
+			break;
+		case 's':
+			bench.suspend_s = strtoul(optarg, NULL, 0);
+			break;
+		case 'w':
+			bench.idle_s = strtoul(optarg, NULL, 0);
+			break;
+		default:
+			usage(argv[0]);
+			return opt == 'h' ? 0 : 1;
+		}
+	}
+	if (optind >= argc) {
+		usage(argv[0]);
+		return 1;
+	}
+	if (!uname(&uts))
+		snprintf(bench.kernel, sizeof(bench.kernel), "%s", uts.release);
+
+	for (i = optind; i < argc; i++) {
+		if (!strcmp(argv[i], "playback")) {
+			bench_playback();
+		} else if (!strcmp(argv[i], "capture")) {
+			bench_capture();
+		} else if (!strcmp(argv[i], "mixer")) {
+			bench_mixer();
+		} else if (!strcmp(argv[i], "jack") && bench.jack_dev) {
+			bench_jack();
+		} else if (!strcmp(argv[i], "resume")) {
+			bench_resume();
+		} else {
+			fprintf(stderr, "unknown test or missing option: %s\n",
+				argv[i]);
+			return 1;
+		}
+	}
+
+	return 0;
+}